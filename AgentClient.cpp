@@ -0,0 +1,326 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  AgentClient.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include "framework.h"
+#include "AgentClient.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// Agent request paths
+static LPCWSTR szAgentRequestPaths[AGENTREQ_COUNT] = {
+    L"/status",
+    L"/now"
+};
+
+// Transport in use. It's used with the lock shared (from the probe worker,
+// and the transport threads for retries), and deleted with it exclusive.
+static AgentTransport* pAgentTransport = NULL;
+static SRWLOCK srwAgentTransport = SRWLOCK_INIT;
+
+// Pending requests (only one request of each type at a time per endpoint)
+static AgentRequest* volatile pAgentRequests[AGENT_MAX_ENDPOINTS][AGENTREQ_COUNT] = {};
+
+// Statistics (updated from the transport threads)
+static AgentClientStats agentClientStats = {};
+static SRWLOCK srwAgentClientStats = SRWLOCK_INIT;
+
+
+//-[CLIENT]--------------------------------------------------------------------
+
+// Returns the pending request of the given type to an endpoint, if any (it's
+// read atomically, as the transport threads complete the requests)
+static AgentRequest* GetPendingRequest(AgentRequestType type, DWORD dwEndpoint)
+{
+    return (AgentRequest*)InterlockedCompareExchangePointer((PVOID volatile*)&pAgentRequests[dwEndpoint][type], NULL, NULL);
+}
+
+// Cancels the pending request of the given type to an endpoint on a transport
+// (if any). Returns FALSE if there was no pending request.
+static BOOL CancelRequest(AgentTransport* pTransport, AgentRequestType type, DWORD dwEndpoint)
+{
+    AgentRequest* pReq = (AgentRequest*)InterlockedExchangePointer((PVOID volatile*)&pAgentRequests[dwEndpoint][type], NULL);
+    if (pReq == NULL)
+        return FALSE;
+    if (pTransport != NULL)
+        pTransport->Cancel(pReq);
+    AgentRequestRelease(pReq);
+    return TRUE;
+}
+
+// Sets the transport used to reach the Agent (the client takes ownership of it)
+VOID AgentClientInit(AgentTransport* pTransport)
+{
+    AcquireSRWLockExclusive(&srwAgentTransport);
+    pAgentTransport = pTransport;
+    ReleaseSRWLockExclusive(&srwAgentTransport);
+}
+
+// Cancels the pending requests and closes the transport. It's detached first,
+// so no request can be sent or retried on it while they are cancelled.
+VOID AgentClientClose()
+{
+    AcquireSRWLockExclusive(&srwAgentTransport);
+    AgentTransport* pTransport = pAgentTransport;
+    pAgentTransport = NULL;
+    ReleaseSRWLockExclusive(&srwAgentTransport);
+
+    for (DWORD dwEndpoint = 0; dwEndpoint < AGENT_MAX_ENDPOINTS; dwEndpoint++) {
+        for (int type = 0; type < AGENTREQ_COUNT; type++)
+            CancelRequest(pTransport, (AgentRequestType)type, dwEndpoint);
+    }
+    delete pTransport;
+}
+
+// Changes the local Agent HTTPD port
+VOID AgentClientSetPort(DWORD dwPort)
+{
+    AgentClientSetEndpoint(AGENT_LOCAL_ENDPOINT, L"127.0.0.1", dwPort);
+}
+
+// Changes the host and HTTPD port of an Agent endpoint (a NULL host removes it)
+VOID AgentClientSetEndpoint(DWORD dwEndpoint, LPCWSTR szHost, DWORD dwPort)
+{
+    AcquireSRWLockShared(&srwAgentTransport);
+    if (pAgentTransport != NULL && dwEndpoint < AGENT_MAX_ENDPOINTS)
+        pAgentTransport->SetEndpoint(dwEndpoint, szHost, dwPort);
+    ReleaseSRWLockShared(&srwAgentTransport);
+}
+
+// Returns a copy of the client statistics
+AgentClientStats AgentClientGetStats()
+{
+    AcquireSRWLockShared(&srwAgentClientStats);
+    AgentClientStats stats = agentClientStats;
+    ReleaseSRWLockShared(&srwAgentClientStats);
+    return stats;
+}
+
+// Updates the client statistics with a completed request
+static VOID UpdateAgentClientStats(AgentRequest* pReq, DWORD dwError)
+{
+    LARGE_INTEGER liFreq;
+    QueryPerformanceFrequency(&liFreq);
+
+    AcquireSRWLockExclusive(&srwAgentClientStats);
+    agentClientStats.dwRequests++;
+    if (dwError != ERROR_SUCCESS)
+        agentClientStats.dwErrors++;
+    if (pReq->dwStatusCode != 0)
+    {
+        if (pReq->bNewConnection)
+            agentClientStats.dwNewConnections++;
+        else
+            agentClientStats.dwReusedConnections++;
+
+        ULONGLONG ullRttUs = (ULONGLONG)(pReq->liHeaders.QuadPart - pReq->liSent.QuadPart) * 1000000 / liFreq.QuadPart;
+        if (agentClientStats.dwRttSamples == 0 || ullRttUs < agentClientStats.ullRttMinUs)
+            agentClientStats.ullRttMinUs = ullRttUs;
+        if (ullRttUs > agentClientStats.ullRttMaxUs)
+            agentClientStats.ullRttMaxUs = ullRttUs;
+        agentClientStats.ullRttTotalUs += ullRttUs;
+        agentClientStats.dwRttSamples++;
+    }
+    ReleaseSRWLockExclusive(&srwAgentClientStats);
+}
+
+// Sends a request to an Agent endpoint (asynchronous). The response is posted to hWnd with
+// the uMsg message. Returns FALSE if a request of the same type is still pending.
+BOOL AgentClientSend(HWND hWnd, UINT uMsg, AgentRequestType type, DWORD dwEndpoint)
+{
+    if (dwEndpoint >= AGENT_MAX_ENDPOINTS || GetPendingRequest(type, dwEndpoint) != NULL)
+        return FALSE;
+
+    // Referenced by the pending requests and by the transport
+    AgentRequest* pReq = new AgentRequest();
+    pReq->lRefs = 2;
+    pReq->type = type;
+    pReq->dwEndpoint = dwEndpoint;
+    pReq->hWnd = hWnd;
+    pReq->uMsg = uMsg;
+    pReq->ullStart = GetTickCount64();
+    QueryPerformanceCounter(&pReq->liStart);
+
+    AcquireSRWLockShared(&srwAgentTransport);
+    BOOL bSent = (pAgentTransport != NULL &&
+        InterlockedCompareExchangePointer((PVOID volatile*)&pAgentRequests[dwEndpoint][type], pReq, NULL) == NULL);
+    if (bSent)
+        pAgentTransport->Get(pReq, szAgentRequestPaths[type]);
+    ReleaseSRWLockShared(&srwAgentTransport);
+    if (!bSent)
+        delete pReq;
+    return bSent;
+}
+
+// Cancels the pending request of the given type to an endpoint. Its response won't be
+// posted. Returns FALSE if there was no pending request.
+BOOL AgentClientCancel(AgentRequestType type, DWORD dwEndpoint)
+{
+    AcquireSRWLockShared(&srwAgentTransport);
+    BOOL bCancelled = CancelRequest(pAgentTransport, type, dwEndpoint);
+    ReleaseSRWLockShared(&srwAgentTransport);
+    return bCancelled;
+}
+
+// Returns TRUE if a request of the given type to an endpoint is pending
+BOOL AgentClientIsPending(AgentRequestType type, DWORD dwEndpoint)
+{
+    return GetPendingRequest(type, dwEndpoint) != NULL;
+}
+
+// Releases a reference to a request, freeing it with the last one
+VOID AgentRequestRelease(AgentRequest* pReq)
+{
+    if (InterlockedDecrement(&pReq->lRefs) == 0)
+        delete pReq;
+}
+
+// Response headers were received
+VOID AgentClientOnHeaders(AgentRequest* pReq, DWORD dwStatusCode)
+{
+    QueryPerformanceCounter(&pReq->liHeaders);
+    pReq->dwStatusCode = dwStatusCode;
+}
+
+// Response data was received (returns FALSE if the response is too large to be drained)
+BOOL AgentClientOnData(AgentRequest* pReq, const CHAR* pData, DWORD cbData)
+{
+    // Responses are read to the end, so the connection can be kept alive,
+    // but only the /status one is parsed
+    pReq->cbReceived += cbData;
+    if (pReq->cbReceived > AGENT_MAX_DRAIN)
+        return FALSE;
+    if (pReq->type == AGENTREQ_STATUS)
+        AgentStatusParserFeed(&pReq->parser, pData, cbData);
+    return TRUE;
+}
+
+// Converts an UTF-8 string to UTF-16, truncating it if it doesn't fit
+static VOID Utf8ToWide(const CHAR* szSrc, LPWSTR szDest, int cchDest)
+{
+    int cchConverted = MultiByteToWideChar(CP_UTF8, 0, szSrc, -1, szDest, cchDest);
+    if (cchConverted == 0)
+        szDest[cchDest - 1] = L'\0';
+}
+
+// Sends the retry of a request, which replaces it as the pending request
+// (the transport lock must be held). Returns FALSE if it was cancelled.
+static BOOL SendRetry(AgentRequest* pReq)
+{
+    AgentRequest* pRetryReq = new AgentRequest();
+    pRetryReq->lRefs = 2;
+    pRetryReq->type = pReq->type;
+    pRetryReq->dwEndpoint = pReq->dwEndpoint;
+    pRetryReq->hWnd = pReq->hWnd;
+    pRetryReq->uMsg = pReq->uMsg;
+    pRetryReq->ullStart = pReq->ullStart;
+    pRetryReq->liStart = pReq->liStart;
+    pRetryReq->bRetried = TRUE;
+    if (InterlockedCompareExchangePointer((PVOID volatile*)&pAgentRequests[pReq->dwEndpoint][pReq->type], pRetryReq, pReq) != pReq) {
+        delete pRetryReq;
+        return FALSE;
+    }
+    AgentRequestRelease(pReq);
+
+    AcquireSRWLockExclusive(&srwAgentClientStats);
+    agentClientStats.dwRetries++;
+    ReleaseSRWLockExclusive(&srwAgentClientStats);
+
+    pAgentTransport->Get(pRetryReq, szAgentRequestPaths[pRetryReq->type]);
+    return TRUE;
+}
+
+// The request is complete, post the response to the requesting window
+VOID AgentClientOnComplete(AgentRequest* pReq, DWORD dwError)
+{
+    // A cancelled request may fail more than once
+    if (InterlockedExchange(&pReq->lCompleted, TRUE))
+        return;
+
+    UpdateAgentClientStats(pReq, dwError);
+
+    // Retry once over a new connection if the kept-alive one was lost. This may
+    // run within a transport call, which holds the transport lock shared: it's
+    // only tried, so it can't wait behind AgentClientClose, and there's no
+    // retry once the client is closing.
+    if (dwError != ERROR_SUCCESS && pReq->bRetryable && !pReq->bRetried &&
+        TryAcquireSRWLockShared(&srwAgentTransport))
+    {
+        BOOL bRetried = (pAgentTransport != NULL && SendRetry(pReq));
+        ReleaseSRWLockShared(&srwAgentTransport);
+        if (bRetried)
+            return;
+    }
+
+    // Cancelled requests are not reported
+    if (InterlockedCompareExchangePointer((PVOID volatile*)&pAgentRequests[pReq->dwEndpoint][pReq->type], NULL, pReq) != pReq)
+        return;
+
+    AgentResponse* pResp = new AgentResponse();
+    pResp->type = pReq->type;
+    pResp->dwEndpoint = pReq->dwEndpoint;
+    pResp->dwError = dwError;
+    pResp->dwStatusCode = pReq->dwStatusCode;
+    pResp->ullElapsed = GetTickCount64() - pReq->ullStart;
+    LARGE_INTEGER liNow, liFreq;
+    QueryPerformanceCounter(&liNow);
+    QueryPerformanceFrequency(&liFreq);
+    pResp->ullElapsedUs = (ULONGLONG)(liNow.QuadPart - pReq->liStart.QuadPart) * 1000000 / liFreq.QuadPart;
+    if (pReq->type == AGENTREQ_STATUS && dwError == ERROR_SUCCESS)
+    {
+        AgentStatusParser* pParser = &pReq->parser;
+        AgentStatusParserEnd(pParser);
+        for (DWORD i = 0; i < pParser->dwFields; i++)
+        {
+            Utf8ToWide(pParser->fields[i].szKey, pResp->fields[i].szKey, ARRAYSIZE(pResp->fields[i].szKey));
+            Utf8ToWide(pParser->fields[i].szValue, pResp->fields[i].szValue, ARRAYSIZE(pResp->fields[i].szValue));
+        }
+        pResp->dwFields = pParser->dwFields;
+
+        const CHAR* szStatus = AgentStatusParserGet(pParser, "status");
+        if (szStatus != NULL)
+        {
+            Utf8ToWide(szStatus, pResp->szStatus, ARRAYSIZE(pResp->szStatus));
+            pResp->bStatusFound = TRUE;
+        }
+    }
+
+    if (!PostMessage(pReq->hWnd, pReq->uMsg, 0, (LPARAM)pResp))
+        delete pResp;
+    AgentRequestRelease(pReq);
+}
@@ -0,0 +1,189 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  AgentClient.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include "framework.h"
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// /status response parser limits (longer keys or values are truncated,
+// extra fields are dropped)
+#define AGENTSTATUS_MAX_FIELDS  8
+#define AGENTSTATUS_MAX_KEY     32
+#define AGENTSTATUS_MAX_VALUE   256
+
+// Agents the client can reach (endpoint 0 is the local Agent)
+#define AGENT_MAX_ENDPOINTS     16
+#define AGENT_LOCAL_ENDPOINT    0
+
+// Largest response drained to keep the connection alive (bytes)
+#define AGENT_MAX_DRAIN         65536
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// Agent requests
+enum AgentRequestType {
+    AGENTREQ_STATUS,            // GET /status
+    AGENTREQ_NOW,               // GET /now (force inventory)
+    AGENTREQ_COUNT
+};
+
+// /status response field ("key: value" line)
+struct AgentStatusField {
+    CHAR szKey[AGENTSTATUS_MAX_KEY];
+    CHAR szValue[AGENTSTATUS_MAX_VALUE];
+};
+
+// Incremental /status response parser. The response can be fed in chunks split
+// at any position and the memory used is fixed. A zero-initialized parser is
+// ready to be fed.
+enum AgentStatusParserState {
+    AGENTPARSER_KEY,            // Reading a key, up to ':'
+    AGENTPARSER_VALUE_START,    // Skipping the spaces before a value
+    AGENTPARSER_VALUE           // Reading a value, up to the end of line
+};
+struct AgentStatusParser {
+    AgentStatusParserState state;
+    AgentStatusField line;      // Line being parsed
+    DWORD cchKey;
+    DWORD cchValue;
+    AgentStatusField fields[AGENTSTATUS_MAX_FIELDS];
+    DWORD dwFields;
+    BOOL bTruncated;            // A key or value was truncated, or a field dropped
+};
+
+// /status response field, converted for display
+struct AgentResponseField {
+    WCHAR szKey[AGENTSTATUS_MAX_KEY];
+    WCHAR szValue[AGENTSTATUS_MAX_VALUE];
+};
+
+// Agent response, posted to the requesting window as the LPARAM of the
+// requested message when a request is complete (must be freed with delete)
+struct AgentResponse {
+    AgentRequestType type;
+    DWORD dwEndpoint;           // Agent endpoint the request was sent to
+    DWORD dwError;              // ERROR_SUCCESS or transport error code
+    DWORD dwStatusCode;         // HTTP status code
+    BOOL bStatusFound;          // /status: "status" value found
+    WCHAR szStatus[AGENTSTATUS_MAX_VALUE]; // /status: Agent status
+    DWORD dwFields;             // /status: all the response fields
+    AgentResponseField fields[AGENTSTATUS_MAX_FIELDS];
+    ULONGLONG ullElapsed;       // Request duration (ms)
+    ULONGLONG ullElapsedUs;     // Request duration (us, from QueryPerformanceCounter)
+};
+
+// Agent request in progress. It's referenced by the client while pending and
+// by the transport until it's done with it, and freed by AgentRequestRelease.
+struct AgentRequest {
+    volatile LONG lRefs;
+    PVOID volatile pvHandle;    // Transport handle (closed on completion or cancellation)
+    volatile LONG lCompleted;   // Completion already reported
+    AgentRequestType type;
+    DWORD dwEndpoint;           // Agent endpoint
+    HWND hWnd;                  // Window to post the response to
+    UINT uMsg;                  // Message to post the response with
+    ULONGLONG ullStart;         // Request start (GetTickCount64)
+    LARGE_INTEGER liStart;      // Request start (QueryPerformanceCounter)
+    LARGE_INTEGER liSent;       // Request sent (QueryPerformanceCounter)
+    LARGE_INTEGER liHeaders;    // Response headers received (QueryPerformanceCounter)
+    BOOL bNewConnection;        // Set by the transport if a new connection was opened
+    BOOL bRetryable;            // Set by the transport if the request failed on a
+                                // kept-alive connection before getting a response
+    BOOL bRetried;              // Request already retried
+    DWORD dwStatusCode;         // HTTP status code
+    AgentStatusParser parser;   // /status response parser
+    DWORD cbReceived;           // Response bytes received
+    CHAR readBuf[512];          // Transport receive buffer
+};
+
+// Agent client statistics
+struct AgentClientStats {
+    DWORD dwRequests;           // Completed requests
+    DWORD dwErrors;             // Failed requests
+    DWORD dwNewConnections;     // Responses received over a new connection
+    DWORD dwReusedConnections;  // Responses received over a kept-alive connection
+    DWORD dwRetries;            // Requests retried after losing a kept-alive connection
+    DWORD dwRttSamples;         // Round-trip times (request sent to response headers)
+    ULONGLONG ullRttTotalUs;
+    ULONGLONG ullRttMinUs;
+    ULONGLONG ullRttMaxUs;
+};
+
+// HTTP transport used by the client to reach the Agent. Responses are
+// reported back through AgentClientOnHeaders, AgentClientOnData and
+// AgentClientOnComplete, which may be called from any thread.
+class AgentTransport
+{
+public:
+    virtual ~AgentTransport() {}
+    // Starts an asynchronous GET request
+    virtual VOID Get(AgentRequest* pReq, LPCWSTR szPath) = 0;
+    // Aborts a request (it's still completed, with an error)
+    virtual VOID Cancel(AgentRequest* pReq) = 0;
+    // Changes the host and HTTPD port of an Agent endpoint for the next
+    // requests (a NULL host removes the endpoint)
+    virtual VOID SetEndpoint(DWORD dwEndpoint, LPCWSTR szHost, DWORD dwPort) = 0;
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// WinHTTP transport (AgentWinHttp.cpp)
+AgentTransport* CreateWinHttpTransport(LPCWSTR szUserAgent, DWORD dwPort);
+
+// Client
+VOID AgentClientInit(AgentTransport* pTransport);
+VOID AgentClientClose();
+VOID AgentClientSetPort(DWORD dwPort);
+VOID AgentClientSetEndpoint(DWORD dwEndpoint, LPCWSTR szHost, DWORD dwPort);
+BOOL AgentClientSend(HWND hWnd, UINT uMsg, AgentRequestType type, DWORD dwEndpoint = AGENT_LOCAL_ENDPOINT);
+BOOL AgentClientCancel(AgentRequestType type, DWORD dwEndpoint = AGENT_LOCAL_ENDPOINT);
+BOOL AgentClientIsPending(AgentRequestType type, DWORD dwEndpoint = AGENT_LOCAL_ENDPOINT);
+AgentClientStats AgentClientGetStats();
+
+// Transport callbacks
+VOID AgentClientOnHeaders(AgentRequest* pReq, DWORD dwStatusCode);
+BOOL AgentClientOnData(AgentRequest* pReq, const CHAR* pData, DWORD cbData);
+VOID AgentClientOnComplete(AgentRequest* pReq, DWORD dwError);
+VOID AgentRequestRelease(AgentRequest* pReq);
+
+// Response parsing
+VOID AgentStatusParserFeed(AgentStatusParser* pParser, const CHAR* pData, size_t cbData);
+VOID AgentStatusParserEnd(AgentStatusParser* pParser);
+const CHAR* AgentStatusParserGet(const AgentStatusParser* pParser, const CHAR* szKey);
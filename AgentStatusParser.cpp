@@ -0,0 +1,181 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  AgentStatusParser.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <string.h>
+#include "framework.h"
+#include "AgentClient.h"
+
+
+//-[RESPONSE PARSING]----------------------------------------------------------
+
+// Appends a span to a parser key or value, truncating it if it doesn't fit (only
+// trailing spaces past the limit aren't reported, they'd be trimmed anyway)
+static VOID AppendSpan(AgentStatusParser* pParser, CHAR* szDest, DWORD* pcchDest, DWORD cchMax,
+    const CHAR* pSpan, size_t cchSpan)
+{
+    size_t cchFree = cchMax - 1 - *pcchDest;
+    if (cchSpan > cchFree) {
+        for (size_t i = cchFree; i < cchSpan && !pParser->bTruncated; i++) {
+            if (pSpan[i] != ' ' && pSpan[i] != '\t' && pSpan[i] != '\r')
+                pParser->bTruncated = TRUE;
+        }
+        cchSpan = cchFree;
+    }
+    CopyMemory(&szDest[*pcchDest], pSpan, cchSpan);
+    *pcchDest += (DWORD)cchSpan;
+}
+
+// Stores the line being parsed as a field, then starts a new line
+static VOID CommitLine(AgentStatusParser* pParser)
+{
+    AgentStatusField* pLine = &pParser->line;
+    DWORD cchKey = pParser->cchKey;
+    DWORD cchValue = pParser->cchValue;
+
+    // Trim the trailing spaces (and the CR of CRLF line endings)
+    while (cchKey > 0 && (pLine->szKey[cchKey - 1] == ' ' || pLine->szKey[cchKey - 1] == '\t'))
+        cchKey--;
+    while (cchValue > 0 && (pLine->szValue[cchValue - 1] == ' ' || pLine->szValue[cchValue - 1] == '\t' ||
+        pLine->szValue[cchValue - 1] == '\r'))
+        cchValue--;
+    pLine->szKey[cchKey] = '\0';
+    pLine->szValue[cchValue] = '\0';
+
+    if (cchKey > 0)
+    {
+        if (pParser->dwFields < AGENTSTATUS_MAX_FIELDS)
+            pParser->fields[pParser->dwFields++] = *pLine;
+        else
+            pParser->bTruncated = TRUE;
+    }
+
+    pParser->state = AGENTPARSER_KEY;
+    pParser->cchKey = 0;
+    pParser->cchValue = 0;
+}
+
+// Parses a span of a /status response without NUL bytes
+static VOID FeedSpan(AgentStatusParser* pParser, const CHAR* pData, size_t cbData)
+{
+    const CHAR* pEnd = pData + cbData;
+
+    while (pData < pEnd)
+    {
+        switch (pParser->state)
+        {
+            // Key, up to ':' (a line without it is skipped)
+            case AGENTPARSER_KEY: {
+                const CHAR* pStop = pData;
+                while (pStop < pEnd && *pStop != ':' && *pStop != '\n')
+                    pStop++;
+                // Leading spaces are skipped
+                while (pParser->cchKey == 0 && pData < pStop && (*pData == ' ' || *pData == '\t'))
+                    pData++;
+                AppendSpan(pParser, pParser->line.szKey, &pParser->cchKey, AGENTSTATUS_MAX_KEY, pData, pStop - pData);
+                if (pStop == pEnd)
+                    return;
+                if (*pStop == ':')
+                    pParser->state = AGENTPARSER_VALUE_START;
+                else {
+                    pParser->cchKey = 0;
+                    pParser->cchValue = 0;
+                }
+                pData = pStop + 1;
+                break;
+            }
+
+            // Spaces between ':' and the value
+            case AGENTPARSER_VALUE_START:
+                while (pData < pEnd && (*pData == ' ' || *pData == '\t'))
+                    pData++;
+                if (pData < pEnd)
+                    pParser->state = AGENTPARSER_VALUE;
+                break;
+
+            // Value, up to the end of line
+            case AGENTPARSER_VALUE: {
+                const CHAR* pStop = (const CHAR*)memchr(pData, '\n', pEnd - pData);
+                if (pStop == NULL) {
+                    AppendSpan(pParser, pParser->line.szValue, &pParser->cchValue, AGENTSTATUS_MAX_VALUE,
+                        pData, pEnd - pData);
+                    return;
+                }
+                AppendSpan(pParser, pParser->line.szValue, &pParser->cchValue, AGENTSTATUS_MAX_VALUE,
+                    pData, pStop - pData);
+                CommitLine(pParser);
+                pData = pStop + 1;
+                break;
+            }
+        }
+    }
+}
+
+// Parses a /status response chunk ("key: value" lines). Chunks can be split at
+// any position: the line in progress is kept in the parser until its end is fed.
+// NUL bytes are skipped, as the fields are stored as strings.
+VOID AgentStatusParserFeed(AgentStatusParser* pParser, const CHAR* pData, size_t cbData)
+{
+    const CHAR* pNul;
+    while ((pNul = (const CHAR*)memchr(pData, '\0', cbData)) != NULL) {
+        FeedSpan(pParser, pData, pNul - pData);
+        cbData -= pNul + 1 - pData;
+        pData = pNul + 1;
+    }
+    FeedSpan(pParser, pData, cbData);
+}
+
+// Ends the parsing (the last line may have no line ending)
+VOID AgentStatusParserEnd(AgentStatusParser* pParser)
+{
+    if (pParser->state == AGENTPARSER_VALUE_START || pParser->state == AGENTPARSER_VALUE)
+        CommitLine(pParser);
+    pParser->state = AGENTPARSER_KEY;
+    pParser->cchKey = 0;
+    pParser->cchValue = 0;
+}
+
+// Gets the value of the first field with the given key (case insensitive), or NULL
+const CHAR* AgentStatusParserGet(const AgentStatusParser* pParser, const CHAR* szKey)
+{
+    for (DWORD i = 0; i < pParser->dwFields; i++)
+    {
+        if (_stricmp(pParser->fields[i].szKey, szKey) == 0)
+            return pParser->fields[i].szValue;
+    }
+    return NULL;
+}
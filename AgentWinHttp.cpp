@@ -0,0 +1,233 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  AgentWinHttp.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <winhttp.h>
+#include "framework.h"
+#include "AgentClient.h"
+
+
+//-[WINHTTP TRANSPORT]---------------------------------------------------------
+
+class WinHttpTransport : public AgentTransport
+{
+public:
+    WinHttpTransport(LPCWSTR szUserAgent, DWORD dwPort);
+    ~WinHttpTransport();
+    VOID Get(AgentRequest* pReq, LPCWSTR szPath);
+    VOID Cancel(AgentRequest* pReq);
+    VOID SetEndpoint(DWORD dwEndpoint, LPCWSTR szHost, DWORD dwPort);
+
+private:
+    static VOID CALLBACK Callback(HINTERNET hInternet, DWORD_PTR dwContext, DWORD dwInternetStatus,
+        LPVOID lpvStatusInfo, DWORD dwStatusInfoLength);
+    static VOID Complete(AgentRequest* pReq, DWORD dwError);
+    static VOID CloseRequestHandle(AgentRequest* pReq);
+
+    // A single session is shared by all the endpoints, WinHTTP pools
+    // its kept-alive connections by host and port
+    HINTERNET hSession;
+    HINTERNET hConns[AGENT_MAX_ENDPOINTS];
+    // Retries are sent from the WinHTTP threads, while the endpoints
+    // may be changed from the probe worker thread
+    SRWLOCK srwConn;
+};
+
+WinHttpTransport::WinHttpTransport(LPCWSTR szUserAgent, DWORD dwPort)
+{
+    InitializeSRWLock(&srwConn);
+
+    // WinHTTP keeps the connections to the Agent alive and reuses them for the
+    // next requests, as long as each response is read completely
+    hSession = WinHttpOpen(szUserAgent, WINHTTP_ACCESS_TYPE_NO_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, WINHTTP_FLAG_ASYNC);
+    WinHttpSetTimeouts(hSession, 100, 10000, 10000, 10000);
+    ZeroMemory(hConns, sizeof(hConns));
+    hConns[AGENT_LOCAL_ENDPOINT] = WinHttpConnect(hSession, L"127.0.0.1", (INTERNET_PORT)dwPort, 0);
+}
+
+WinHttpTransport::~WinHttpTransport()
+{
+    for (int i = 0; i < AGENT_MAX_ENDPOINTS; i++) {
+        if (hConns[i] != NULL)
+            WinHttpCloseHandle(hConns[i]);
+    }
+    WinHttpCloseHandle(hSession);
+}
+
+VOID WinHttpTransport::SetEndpoint(DWORD dwEndpoint, LPCWSTR szHost, DWORD dwPort)
+{
+    // Requests in progress keep their own reference to the previous connection
+    AcquireSRWLockExclusive(&srwConn);
+    if (hConns[dwEndpoint] != NULL)
+        WinHttpCloseHandle(hConns[dwEndpoint]);
+    hConns[dwEndpoint] = (szHost != NULL ? WinHttpConnect(hSession, szHost, (INTERNET_PORT)dwPort, 0) : NULL);
+    ReleaseSRWLockExclusive(&srwConn);
+}
+
+VOID WinHttpTransport::Get(AgentRequest* pReq, LPCWSTR szPath)
+{
+    HINTERNET hReq = NULL;
+    DWORD dwErr = ERROR_NOT_FOUND;
+    AcquireSRWLockShared(&srwConn);
+    if (hConns[pReq->dwEndpoint] != NULL) {
+        hReq = WinHttpOpenRequest(hConns[pReq->dwEndpoint], L"GET", szPath, NULL, WINHTTP_NO_REFERER,
+            WINHTTP_DEFAULT_ACCEPT_TYPES, WINHTTP_FLAG_BYPASS_PROXY_CACHE);
+        if (hReq == NULL)
+            dwErr = GetLastError();
+    }
+    ReleaseSRWLockShared(&srwConn);
+    if (hReq == NULL) {
+        AgentClientOnComplete(pReq, dwErr);
+        AgentRequestRelease(pReq);
+        return;
+    }
+
+    // The request is released when its handle is closed (WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING),
+    // so the context is set before anything can fail
+    pReq->pvHandle = hReq;
+    DWORD_PTR dwContext = (DWORD_PTR)pReq;
+    WinHttpSetOption(hReq, WINHTTP_OPTION_CONTEXT_VALUE, &dwContext, sizeof(dwContext));
+    WinHttpSetStatusCallback(hReq, Callback, WINHTTP_CALLBACK_FLAG_ALL_COMPLETIONS | WINHTTP_CALLBACK_FLAG_HANDLES |
+        WINHTTP_CALLBACK_FLAG_CONNECT_TO_SERVER, NULL);
+
+    QueryPerformanceCounter(&pReq->liSent);
+    if (!WinHttpSendRequest(hReq, WINHTTP_NO_ADDITIONAL_HEADERS, 0, WINHTTP_NO_REQUEST_DATA, 0, 0, dwContext))
+        Complete(pReq, GetLastError());
+}
+
+// Closing the request handle makes any WinHTTP operation in progress fail
+// with ERROR_WINHTTP_OPERATION_CANCELLED
+VOID WinHttpTransport::Cancel(AgentRequest* pReq)
+{
+    CloseRequestHandle(pReq);
+}
+
+// Closes the request handle, once (it's closed either on completion or on cancellation)
+VOID WinHttpTransport::CloseRequestHandle(AgentRequest* pReq)
+{
+    HINTERNET hReq = (HINTERNET)InterlockedExchangePointer(&pReq->pvHandle, NULL);
+    if (hReq != NULL)
+        WinHttpCloseHandle(hReq);
+}
+
+// Reports the request completion and closes its handle
+VOID WinHttpTransport::Complete(AgentRequest* pReq, DWORD dwError)
+{
+    // A kept-alive connection may have been closed by the Agent meanwhile (i.e. it was restarted)
+    pReq->bRetryable = !pReq->bNewConnection && pReq->dwStatusCode == 0 &&
+        (dwError == ERROR_WINHTTP_CONNECTION_ERROR || dwError == ERROR_WINHTTP_INVALID_SERVER_RESPONSE);
+    AgentClientOnComplete(pReq, dwError);
+    CloseRequestHandle(pReq);
+}
+
+// Callback called by the asynchronous WinHTTP requests
+VOID CALLBACK WinHttpTransport::Callback(HINTERNET hInternet, DWORD_PTR dwContext, DWORD dwInternetStatus,
+    LPVOID lpvStatusInfo, DWORD dwStatusInfoLength)
+{
+    AgentRequest* pReq = (AgentRequest*)dwContext;
+    if (pReq == NULL)
+        return;
+
+    switch (dwInternetStatus)
+    {
+        // A new connection was opened for this request (otherwise, a kept-alive one is reused)
+        case WINHTTP_CALLBACK_STATUS_CONNECTED_TO_SERVER:
+            pReq->bNewConnection = TRUE;
+            break;
+
+        // Request is sent, receive response
+        case WINHTTP_CALLBACK_STATUS_SENDREQUEST_COMPLETE:
+            if (!WinHttpReceiveResponse(hInternet, NULL))
+                Complete(pReq, GetLastError());
+            break;
+
+        // Response headers are available, get the status code and query for data
+        case WINHTTP_CALLBACK_STATUS_HEADERS_AVAILABLE: {
+            DWORD dwStatusCode = 0;
+            DWORD dwSize = sizeof(dwStatusCode);
+            WinHttpQueryHeaders(hInternet, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+                WINHTTP_HEADER_NAME_BY_INDEX, &dwStatusCode, &dwSize, WINHTTP_NO_HEADER_INDEX);
+            AgentClientOnHeaders(pReq, dwStatusCode);
+            if (!WinHttpQueryDataAvailable(hInternet, NULL))
+                Complete(pReq, GetLastError());
+            break;
+        }
+
+        // Data is available, read it (no more data means the response is complete)
+        case WINHTTP_CALLBACK_STATUS_DATA_AVAILABLE: {
+            DWORD dwSize = *(LPDWORD)lpvStatusInfo;
+            if (dwSize == 0) {
+                Complete(pReq, ERROR_SUCCESS);
+                break;
+            }
+            if (dwSize > sizeof(pReq->readBuf))
+                dwSize = sizeof(pReq->readBuf);
+            if (!WinHttpReadData(hInternet, pReq->readBuf, dwSize, NULL))
+                Complete(pReq, GetLastError());
+            break;
+        }
+
+        // Data was read, pass it to the client and query for more
+        case WINHTTP_CALLBACK_STATUS_READ_COMPLETE:
+            if (dwStatusInfoLength == 0) {
+                Complete(pReq, ERROR_SUCCESS);
+                break;
+            }
+            if (!AgentClientOnData(pReq, (const CHAR*)lpvStatusInfo, dwStatusInfoLength)) {
+                Complete(pReq, ERROR_INSUFFICIENT_BUFFER);
+                break;
+            }
+            if (!WinHttpQueryDataAvailable(hInternet, NULL))
+                Complete(pReq, GetLastError());
+            break;
+
+        case WINHTTP_CALLBACK_STATUS_REQUEST_ERROR:
+            Complete(pReq, ((WINHTTP_ASYNC_RESULT*)lpvStatusInfo)->dwError);
+            break;
+
+        // No more callbacks will be called for this request
+        case WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING:
+            AgentRequestRelease(pReq);
+            break;
+    }
+}
+
+// Creates the WinHTTP transport, connecting to the Agent on localhost
+AgentTransport* CreateWinHttpTransport(LPCWSTR szUserAgent, DWORD dwPort)
+{
+    return new WinHttpTransport(szUserAgent, dwPort);
+}
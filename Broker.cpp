@@ -0,0 +1,250 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  Broker.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <wchar.h>
+#include <shellapi.h>
+#include <objbase.h>
+#include <bcrypt.h>
+#include "framework.h"
+#include "Broker.h"
+
+
+//-[PIPE]----------------------------------------------------------------------
+
+// Longest wait for a request to be run by the broker (a service may take a
+// while to accept a control)
+#define BROKER_CALL_TIMEOUT     30000
+
+// Runs the broker: creates its pipe, waits for the Monitor that started it and
+// serves it until it closes the pipe or exits. The pipe only lets the user of
+// the Monitor in (which may not be the user of the broker, if an administrator
+// account was used to elevate), and the client must be the Monitor process.
+DWORD BrokerRun(LPCWSTR szCmdLine, BrokerBackend* pBackend)
+{
+    LPCWSTR szArgs = wcsstr(szCmdLine, L"/broker");
+    WCHAR szSuffix[33];
+    DWORD dwMonitorPid;
+    if (szArgs == nullptr || swscanf_s(szArgs, L"/broker %32s %lu", szSuffix, (unsigned)ARRAYSIZE(szSuffix), &dwMonitorPid) != 2)
+        return ERROR_INVALID_PARAMETER;
+
+    HANDLE hMonitor = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION | SYNCHRONIZE, FALSE, dwMonitorPid);
+    if (hMonitor == NULL)
+        return GetLastError();
+
+    WCHAR szName[96];
+    PSECURITY_DESCRIPTOR pSd = NULL;
+    swprintf_s(szName, L"%s%s", BROKER_PIPE_PREFIX, szSuffix);
+    if (!HandoffGetPipeSecurity(hMonitor, &pSd)) {
+        DWORD dwErr = GetLastError();
+        CloseHandle(hMonitor);
+        return dwErr;
+    }
+    SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), pSd, FALSE };
+    HANDLE hPipe = CreateNamedPipe(szName, PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1,
+        sizeof(BrokerReply), sizeof(BrokerHeader) + sizeof(BrokerBody), 0, &sa);
+    DWORD dwErr = (hPipe == INVALID_HANDLE_VALUE ? GetLastError() : ERROR_SUCCESS);
+    LocalFree(pSd);
+    if (hPipe == INVALID_HANDLE_VALUE) {
+        CloseHandle(hMonitor);
+        return dwErr;
+    }
+
+    // Wait for the Monitor (given up if it exits meanwhile)
+    OVERLAPPED ov = {};
+    ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    DWORD cbDone = 0;
+    BOOL bConnected = (ov.hEvent != NULL && ConnectNamedPipe(hPipe, &ov));
+    if (!bConnected && ov.hEvent != NULL) {
+        dwErr = GetLastError();
+        if (dwErr == ERROR_IO_PENDING) {
+            HANDLE hWaitHandles[2] = { ov.hEvent, hMonitor };
+            if (WaitForMultipleObjects(2, hWaitHandles, FALSE, BROKER_CONNECT_TIMEOUT) == WAIT_OBJECT_0) {
+                bConnected = GetOverlappedResult(hPipe, &ov, &cbDone, FALSE);
+            }
+            else {
+                CancelIoEx(hPipe, &ov);
+                GetOverlappedResult(hPipe, &ov, &cbDone, TRUE);
+            }
+        }
+        else if (dwErr == ERROR_PIPE_CONNECTED) {
+            bConnected = TRUE;
+        }
+    }
+
+    // Serve the Monitor only, reads being aborted when it exits
+    ULONG ulClientPid = 0;
+    dwErr = ERROR_ACCESS_DENIED;
+    if (bConnected && GetNamedPipeClientProcessId(hPipe, &ulClientPid) && ulClientPid == dwMonitorPid) {
+        HandoffStream* pStream = HandoffCreatePipeStream(hPipe, hMonitor, INFINITE);
+        BrokerServe(pStream, pBackend);
+        delete pStream;
+        dwErr = ERROR_SUCCESS;
+    }
+
+    if (ov.hEvent != NULL)
+        CloseHandle(ov.hEvent);
+    CloseHandle(hPipe);
+    CloseHandle(hMonitor);
+    return dwErr;
+}
+
+// Monitor side connection to the broker
+static SRWLOCK srwClient = SRWLOCK_INIT;
+static HANDLE hBrokerProcess = NULL;
+static HANDLE hBrokerPipe = NULL;
+static HandoffStream* pBrokerStream = NULL;
+static DWORD dwBrokerSeq = 0;
+
+// Closes the connection to the broker, which then exits (srwClient held)
+static VOID DisconnectBroker()
+{
+    if (pBrokerStream != NULL) {
+        delete pBrokerStream;
+        pBrokerStream = NULL;
+    }
+    if (hBrokerPipe != NULL) {
+        CloseHandle(hBrokerPipe);
+        hBrokerPipe = NULL;
+    }
+    if (hBrokerProcess != NULL) {
+        CloseHandle(hBrokerProcess);
+        hBrokerProcess = NULL;
+    }
+}
+
+// Starts the broker in a new elevated Monitor instance (the user is prompted
+// by UAC) and connects to it (srwClient held). Its pipe name is random, and
+// the pipe server must be the started process.
+static DWORD ConnectBroker(HWND hWnd)
+{
+    BYTE random[16];
+    if (!BCRYPT_SUCCESS(BCryptGenRandom(NULL, random, sizeof(random), BCRYPT_USE_SYSTEM_PREFERRED_RNG)))
+        return ERROR_GEN_FAILURE;
+    WCHAR szSuffix[33];
+    for (DWORD i = 0; i < sizeof(random); i++)
+        swprintf_s(szSuffix + i * 2, 3, L"%02x", random[i]);
+
+    WCHAR szFilename[MAX_PATH], szParams[64], szName[96];
+    GetModuleFileName(NULL, szFilename, MAX_PATH);
+    swprintf_s(szParams, L"/broker %s %lu", szSuffix, GetCurrentProcessId());
+    swprintf_s(szName, L"%s%s", BROKER_PIPE_PREFIX, szSuffix);
+
+    // Returns once the UAC prompt is answered
+    SHELLEXECUTEINFO sei = { sizeof(SHELLEXECUTEINFO) };
+    sei.hwnd = hWnd;
+    sei.fMask = SEE_MASK_NOCLOSEPROCESS | SEE_MASK_NOASYNC | SEE_MASK_FLAG_NO_UI;
+    sei.lpFile = szFilename;
+    sei.lpParameters = szParams;
+    sei.lpVerb = L"runas";
+    sei.nShow = SW_HIDE;
+    HRESULT hrCo = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE);
+    BOOL bStarted = ShellExecuteEx(&sei);
+    DWORD dwErr = (bStarted ? ERROR_SUCCESS : GetLastError());
+    if (SUCCEEDED(hrCo))
+        CoUninitialize();
+    if (!bStarted)
+        return dwErr;
+    if (sei.hProcess == NULL)
+        return ERROR_INVALID_HANDLE;
+    hBrokerProcess = sei.hProcess;
+
+    // Wait for the pipe, while the broker runs
+    ULONGLONG ullDeadline = GetTickCount64() + BROKER_CONNECT_TIMEOUT;
+    for (;;)
+    {
+        hBrokerPipe = CreateFile(szName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING,
+            FILE_FLAG_OVERLAPPED | SECURITY_SQOS_PRESENT | SECURITY_IDENTIFICATION, NULL);
+        if (hBrokerPipe != INVALID_HANDLE_VALUE)
+            break;
+        dwErr = GetLastError();
+        hBrokerPipe = NULL;
+        if (dwErr != ERROR_FILE_NOT_FOUND || GetTickCount64() >= ullDeadline ||
+            WaitForSingleObject(hBrokerProcess, 20) != WAIT_TIMEOUT) {
+            DisconnectBroker();
+            return dwErr;
+        }
+    }
+
+    ULONG ulServerPid = 0;
+    if (!GetNamedPipeServerProcessId(hBrokerPipe, &ulServerPid) || ulServerPid != GetProcessId(hBrokerProcess)) {
+        DisconnectBroker();
+        return ERROR_ACCESS_DENIED;
+    }
+    pBrokerStream = HandoffCreatePipeStream(hBrokerPipe, hBrokerProcess, BROKER_CALL_TIMEOUT);
+    return ERROR_SUCCESS;
+}
+
+// Runs a request in the broker, starting it first if needed (hWnd is the
+// owner of the UAC prompt). A broken connection is restarted once. Returns
+// FALSE if the request couldn't be run (error code set, i.e. ERROR_CANCELLED
+// if the user declined the UAC prompt).
+BOOL BrokerClientCall(HWND hWnd, WORD wCommand, const VOID* pvBody, DWORD cbBody, DWORD* pdwResult)
+{
+    AcquireSRWLockExclusive(&srwClient);
+    DWORD dwErr = ERROR_SUCCESS;
+    BOOL bDone = FALSE;
+    for (int nTry = 0; nTry < 2 && !bDone; nTry++)
+    {
+        BOOL bReused = (pBrokerStream != NULL);
+        if (!bReused)
+            dwErr = ConnectBroker(hWnd);
+        if (dwErr != ERROR_SUCCESS)
+            break;
+        bDone = BrokerCall(pBrokerStream, wCommand, ++dwBrokerSeq, pvBody, cbBody, pdwResult);
+        if (!bDone) {
+            dwErr = ERROR_BROKEN_PIPE;
+            DisconnectBroker();
+            if (!bReused)
+                break;
+            dwErr = ERROR_SUCCESS;
+        }
+    }
+    ReleaseSRWLockExclusive(&srwClient);
+    if (!bDone)
+        SetLastError(dwErr);
+    return bDone;
+}
+
+// Disconnects from the broker, which exits (waits for a running request)
+VOID BrokerClientStop()
+{
+    AcquireSRWLockExclusive(&srwClient);
+    DisconnectBroker();
+    ReleaseSRWLockExclusive(&srwClient);
+}
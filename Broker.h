@@ -0,0 +1,122 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  Broker.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include "framework.h"
+#include "Handoff.h"
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// Requests the Monitor sends to its elevated broker (many per connection)
+#define BROKER_MAGIC            0x4B424D47  // "GMBK"
+#define BROKER_VERSION          1
+
+// Commands
+#define BROKER_CMD_SERVICE      1           // Service operation (BrokerServiceBody)
+#define BROKER_CMD_SETTINGS     2           // Monitor settings write (BrokerSettingsBody)
+#define BROKER_CMD_MAX          2
+
+// Monitor settings written by BROKER_CMD_SETTINGS
+#define BROKER_SETTINGS_NEWTICKET_URL           0x1
+#define BROKER_SETTINGS_NEWTICKET_SCREENSHOT    0x2
+#define BROKER_SETTINGS_ALL                     0x3
+
+#define BROKER_MAX_URL          300
+
+// Longest wait for the Monitor to connect to the broker once it's started (ms)
+#define BROKER_CONNECT_TIMEOUT  10000
+
+// Pipe name prefix (followed by a random suffix, generated by the Monitor)
+#define BROKER_PIPE_PREFIX      L"\\\\.\\pipe\\GLPI-AgentMonitor-Broker-"
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// Request header, followed by cbBody bytes of the command body, and reply.
+// A body of another size than the one of its command is rejected.
+#pragma pack(push, 1)
+struct BrokerHeader {
+    DWORD dwMagic;
+    WORD wVersion;
+    WORD wCommand;              // BROKER_CMD_*
+    DWORD dwSeq;                // Echoed in the reply
+    DWORD cbBody;
+};
+struct BrokerServiceBody {
+    DWORD dwOperation;          // HANDOFF_SVC_*
+};
+struct BrokerSettingsBody {
+    DWORD dwMask;               // Settings to write (BROKER_SETTINGS_*)
+    DWORD dwNewTicketScreenshot;
+    WCHAR szNewTicketURL[BROKER_MAX_URL];
+};
+union BrokerBody {
+    BrokerServiceBody service;
+    BrokerSettingsBody settings;
+};
+struct BrokerReply {
+    DWORD dwMagic;
+    DWORD dwSeq;
+    DWORD dwResult;             // ERROR_SUCCESS or error code
+};
+#pragma pack(pop)
+
+// Privileged operations done by the broker (the service and the registry, or
+// fakes in tests). Bodies are validated before being passed.
+class BrokerBackend
+{
+public:
+    virtual ~BrokerBackend() {}
+    virtual DWORD ControlService(DWORD dwOperation) = 0;
+    virtual DWORD WriteSettings(const BrokerSettingsBody* pSettings) = 0;
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Protocol
+BOOL BrokerCall(HandoffStream* pStream, WORD wCommand, DWORD dwSeq, const VOID* pvBody, DWORD cbBody, DWORD* pdwResult);
+BOOL BrokerServeOne(HandoffStream* pStream, BrokerBackend* pBackend);
+DWORD BrokerServe(HandoffStream* pStream, BrokerBackend* pBackend);
+BOOL BrokerIsWebUrl(LPCWSTR szUrl);
+
+// Broker (elevated instance, started with "/broker <pipe suffix> <Monitor PID>")
+DWORD BrokerRun(LPCWSTR szCmdLine, BrokerBackend* pBackend);
+
+// Monitor side (calls are serialized, the first one starts the broker)
+BOOL BrokerClientCall(HWND hWnd, WORD wCommand, const VOID* pvBody, DWORD cbBody, DWORD* pdwResult);
+VOID BrokerClientStop();
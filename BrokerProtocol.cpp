@@ -0,0 +1,129 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  BrokerProtocol.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <wchar.h>
+#include "framework.h"
+#include "Broker.h"
+
+
+//-[PROTOCOL]------------------------------------------------------------------
+
+// Sends a request and reads its result (Monitor side)
+BOOL BrokerCall(HandoffStream* pStream, WORD wCommand, DWORD dwSeq, const VOID* pvBody, DWORD cbBody, DWORD* pdwResult)
+{
+    BrokerHeader hdr;
+    hdr.dwMagic = BROKER_MAGIC;
+    hdr.wVersion = BROKER_VERSION;
+    hdr.wCommand = wCommand;
+    hdr.dwSeq = dwSeq;
+    hdr.cbBody = cbBody;
+
+    BrokerReply reply;
+    if (!pStream->Write(&hdr, sizeof(hdr)) || (cbBody > 0 && !pStream->Write(pvBody, cbBody)) ||
+        !pStream->Read(&reply, sizeof(reply)) || reply.dwMagic != BROKER_MAGIC || reply.dwSeq != dwSeq)
+        return FALSE;
+    *pdwResult = reply.dwResult;
+    return TRUE;
+}
+
+// Returns whether a new ticket URL is a web one (http:// or https://), the
+// only ones opened by the Monitor
+BOOL BrokerIsWebUrl(LPCWSTR szUrl)
+{
+    return _wcsnicmp(szUrl, L"http://", 7) == 0 || _wcsnicmp(szUrl, L"https://", 8) == 0;
+}
+
+// Checks a request body, returns ERROR_SUCCESS if it can be passed to the backend
+// (an empty new ticket URL restores the default one)
+static DWORD CheckBody(WORD wCommand, const BrokerBody* pBody, DWORD cbBody)
+{
+    switch (wCommand) {
+        case BROKER_CMD_SERVICE:
+            if (cbBody != sizeof(BrokerServiceBody) ||
+                pBody->service.dwOperation < HANDOFF_SVC_START || pBody->service.dwOperation > HANDOFF_SVC_CONTINUE)
+                return ERROR_INVALID_PARAMETER;
+            return ERROR_SUCCESS;
+        case BROKER_CMD_SETTINGS:
+            if (cbBody != sizeof(BrokerSettingsBody) || pBody->settings.dwMask == 0 ||
+                (pBody->settings.dwMask & ~BROKER_SETTINGS_ALL) != 0 || pBody->settings.dwNewTicketScreenshot > 1 ||
+                wcsnlen(pBody->settings.szNewTicketURL, BROKER_MAX_URL) == BROKER_MAX_URL)
+                return ERROR_INVALID_PARAMETER;
+            if ((pBody->settings.dwMask & BROKER_SETTINGS_NEWTICKET_URL) &&
+                pBody->settings.szNewTicketURL[0] != '\0' && !BrokerIsWebUrl(pBody->settings.szNewTicketURL))
+                return ERROR_INVALID_PARAMETER;
+            return ERROR_SUCCESS;
+    }
+    return ERROR_NOT_SUPPORTED;
+}
+
+// Reads a request, runs it and writes its result (broker side). Returns FALSE
+// when the connection must be closed: the stream failed, or it's out of sync
+// (no request header, or a body larger than any command's).
+BOOL BrokerServeOne(HandoffStream* pStream, BrokerBackend* pBackend)
+{
+    BrokerHeader hdr;
+    if (!pStream->Read(&hdr, sizeof(hdr)) || hdr.dwMagic != BROKER_MAGIC || hdr.cbBody > sizeof(BrokerBody))
+        return FALSE;
+    BrokerBody body = {};
+    if (hdr.cbBody > 0 && !pStream->Read(&body, hdr.cbBody))
+        return FALSE;
+
+    BrokerReply reply;
+    reply.dwMagic = BROKER_MAGIC;
+    reply.dwSeq = hdr.dwSeq;
+    if (hdr.wVersion != BROKER_VERSION)
+        reply.dwResult = ERROR_NOT_SUPPORTED;
+    else
+        reply.dwResult = CheckBody(hdr.wCommand, &body, hdr.cbBody);
+    if (reply.dwResult == ERROR_SUCCESS) {
+        if (hdr.wCommand == BROKER_CMD_SERVICE)
+            reply.dwResult = pBackend->ControlService(body.service.dwOperation);
+        else
+            reply.dwResult = pBackend->WriteSettings(&body.settings);
+    }
+    return pStream->Write(&reply, sizeof(reply));
+}
+
+// Serves requests until the connection is closed, returns how many were served
+DWORD BrokerServe(HandoffStream* pStream, BrokerBackend* pBackend)
+{
+    DWORD dwServed = 0;
+    while (BrokerServeOne(pStream, pBackend))
+        dwServed++;
+    return dwServed;
+}
@@ -38,21 +38,75 @@
 #pragma comment(linker,"/manifestdependency:\"type='win32' name='Microsoft.Windows.Common-Controls' version='6.0.0.0' processorArchitecture='*' publicKeyToken='6595b64144ccf1df' language='*'\"")
 #pragma comment(lib, "comctl32.lib")
 #pragma comment(lib, "gdiplus.lib")
-#pragma comment(lib, "version.lib")
 #pragma comment(lib, "Winhttp.lib")
 #pragma comment(lib, "Shlwapi.lib")
+#pragma comment(lib, "Ws2_32.lib")
+#pragma comment(lib, "Dwmapi.lib")
+#pragma comment(lib, "Bcrypt.lib")
+#pragma comment(lib, "Crypt32.lib")
 
 
 //-[DEFINES]-------------------------------------------------------------------
 
 #define SERVICE_NAME L"GLPI-Agent"
+#define AGENT_DEFAULT_PORT 62354
 #define USERAGENT_NAME L"GLPI-AgentMonitor"
 
+// Agent status polling intervals (ms) while the main window is shown, backing off
+// while the status is steady, and while tracking a forced inventory
+#define AGENTPOLL_MIN_INTERVAL 2000
+#define AGENTPOLL_MAX_INTERVAL 16000
+#define AGENTPOLL_INVENTORY_INTERVAL 500
+// Registry polling interval (ms), used when change notifications are unavailable
+#define REGPOLL_INTERVAL 2000
+// Remote Agents polling interval (ms), and consecutive failed requests
+// before a remote Agent is reported as not responding
+#define ENDPOINTPOLL_INTERVAL 10000
+#define ENDPOINT_MAX_FAILURES 2
+// Status shared between sessions: interval (ms) of the leader heartbeat, of
+// the followers reads while the main window is shown, and of their attempts to
+// take the lead otherwise. The leader is gone without a heartbeat for
+// SHAREDSTATUS_STALE_TIMEOUT, and polls the Agent while a follower read the
+// status within SHAREDSTATUS_DEMAND_TIMEOUT.
+#define SHAREDSTATUS_LEADER_INTERVAL 2000
+#define SHAREDSTATUS_READ_INTERVAL 1000
+#define SHAREDSTATUS_ELECT_INTERVAL 5000
+#define SHAREDSTATUS_STALE_TIMEOUT 15000
+#define SHAREDSTATUS_DEMAND_TIMEOUT 5000
+// Forced inventory tracking timeouts (ms), for the task to start and to finish
+#define INVENTORY_START_TIMEOUT 30000
+#define INVENTORY_FINISH_TIMEOUT 3600000
+// Status publishing retry interval (ms), used when the main window lags behind
+#define PUBLISH_RETRY_INTERVAL 100
+// Time given to the probe worker to stop when exiting (ms)
+#define PROBE_STOP_TIMEOUT 5000
+// Probe worker window class
+#define PROBE_WNDCLASS L"GLPI-AgentMonitor-Probes"
+// Headless mode window class
+#define HEADLESS_WNDCLASS L"GLPI-AgentMonitor-Headless"
+// Agent logfile scan interval (ms), while the main window is shown, and the
+// most mapped per scan
+#define LOGSCAN_INTERVAL 30000
+#define LOGSCAN_MAX_CHUNK (64 * 1024 * 1024)
+// Rotated Agent log segments scanned per run (they're scanned once, before
+// the logfile, when it's rotated)
+#define LOGSCAN_ARCHIVE_CHUNK (4 * 1024 * 1024)
+// Log viewer: logfile polling interval (ms), used along with the change
+// notifications, size of the logfile views mapped while indexing, and the
+// longest line prefix shown
+#define LOGTAIL_POLL_INTERVAL 1000
+#define LOGTAIL_VIEW_SIZE (16 * 1024 * 1024)
+#define LOGTAIL_FEED_SIZE (1024 * 1024)
+#define LOGVIEW_MAX_LINE 1024
+// Time given to the log tailer to stop (ms)
+#define LOGTAIL_STOP_TIMEOUT 5000
+
 
 //-[INCLUDES]------------------------------------------------------------------
 
 #include <vector>
 #include <string>
+#include <stdio.h>
 #include <windows.h>
 #include <winhttp.h>
 #include <winuser.h>
@@ -60,10 +114,30 @@
 #include <CommCtrl.h>
 #include <gdiplus.h>
 #include <Shlwapi.h>
-#include <Tlhelp32.h>
 #include <ShlObj.h>
+#include <dpapi.h>
 #include "framework.h"
 #include "resource.h"
+#include "version.h"
+#include "AgentClient.h"
+#include "Scheduler.h"
+#include "SpscChannel.h"
+#include "Metrics.h"
+#include "StringTable.h"
+#include "StatusHistory.h"
+#include "LogIndex.h"
+#include "LogScan.h"
+#include "LogStream.h"
+#include "Screenshot.h"
+#include "GlpiApi.h"
+#include "TicketQueue.h"
+#include "Outbox.h"
+#include "SharedStatus.h"
+#include "Handoff.h"
+#include "Broker.h"
+#include "MonitorSnapshot.h"
+#include "ServiceWatch.h"
+#include "RegistryConfig.h"
 
 
 //-[GLOBALS AND OTHERS]--------------------------------------------------------
@@ -74,6 +148,20 @@ using namespace std;
 LRESULT CALLBACK DlgProc(HWND, UINT, WPARAM, LPARAM);
 // Settings dialog message processing callback
 LRESULT CALLBACK SettingsDlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
+// Probe worker window message processing callback
+LRESULT CALLBACK ProbeWndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
+// Headless mode window message processing callback
+LRESULT CALLBACK HeadlessWndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
+// Status history dialog message processing callback
+LRESULT CALLBACK HistoryDlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
+// Log viewer dialog message processing callback
+LRESULT CALLBACK LogsDlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
+// Probe scheduling (adjusts the probe intervals to the current state)
+VOID ScheduleProbes(HWND hWnd);
+// Status publishing (from the probe worker to the main window)
+VOID PublishStatus();
+// Metrics serving (on the port set in the Monitor settings)
+VOID ApplyMetricsConfig();
 
 // Command line used to execute the Monitor
 WCHAR szCmdLine[1024];
@@ -84,36 +172,153 @@ HINSTANCE hInst;
 // App mutex (to prevent multiple instances)
 HANDLE hMutex;
 
-// EnumWindows callback data
-struct EnumWindowsData {
-    DWORD dwSearchPID;
-    HWND hWndFound;
-};
-
-// WinHTTP connection and session handles
-HINTERNET hSession, hConn;
-
-// Runtime variables
-BOOL bAgentInstalled = true;
-BOOL glpiAgentOk = true;
-SERVICE_STATUS svcStatus;
-SERVICE_STATUS lastSvcStatus = {};
-WCHAR szAgStatus[128];
+// Monitor state, owned by the probe worker and published as snapshots
+MonitorSnapshot monitorState = {};
 
-// WinHTTP request handle
-HINTERNET hReq = NULL;
+// Remote Agent endpoint ("host[:port]" line of the "Endpoints" Monitor setting)
+struct EndpointConfig {
+    WCHAR szHost[128];
+    DWORD dwPort;
+};
 
-// GDI+ related
+// Remote Agents state, owned by the probe worker (indexed by Agent client endpoint)
+struct EndpointState {
+    EndpointConfig config;
+    BOOL bResponding;           // Responding (assumed until its requests fail)
+    DWORD dwFailures;           // Consecutive failed requests
+};
+EndpointState endpointStates[AGENT_MAX_ENDPOINTS] = {};
+DWORD dwRemoteEndpoints = 0;
+
+// Status history, recorded by the probe worker (last transitions recorded)
+BOOL bHistoryRecorded = FALSE;
+DWORD dwHistorySvcState = 0;
+WCHAR szHistoryAgStatus[AGENTSTATUS_MAX_VALUE] = {};
+DWORD dwHistoryAgentError = 0;
+
+// Status history shown by the history dialog (decoded when it's opened)
+HistoryEntry* pHistoryEntries = NULL;
+DWORD dwHistoryEntries = 0;
+
+// Agent logfile scan, run by the probe worker (the file scanned is identified
+// by its path and file index)
+LogScanState logScanState = {};
+WCHAR szLogScanFile[MAX_PATH] = {};
+BY_HANDLE_FILE_INFORMATION logScanFileInfo = {};
+BOOL bLogScanPending = FALSE;
+
+// Rotated Agent log segments scan, which logScanState continues from (the
+// bytes left by each chunk scanned are carried over to the next one, and the
+// state is restored to its checkpoint if a segment can't be decompressed)
+LogStream* pLogScanArchive = NULL;
+LogScanState logScanArchiveState = {};
+LogScanState logScanArchiveCheckpoint = {};
+CHAR* pLogScanArchiveBuf = NULL;
+size_t cbLogScanArchiveCarry = 0;
+
+// Agent log viewer. The logfile is indexed by the tailer thread as it grows,
+// and the dialog list only reads the lines shown from its own handle.
+LogIndex logIndex = {};
+SRWLOCK srwLogIndex = SRWLOCK_INIT;
+WCHAR szLogViewFile[MAX_PATH];
+HANDLE hLogTailThread = NULL;
+HANDLE hLogTailStop = NULL;
+HANDLE hLogReadFile = INVALID_HANDLE_VALUE;
+HWND hLogsWnd = NULL;
+volatile LONG lLogIndexPosted = 0;
+volatile LONG lLogIndexReset = 0;
+// Log list rows: the lines matching the severity filter, or a range of lines
+// when all severities are shown
+LogFilter logViewFilter = {};
+vector<DWORD> logViewLines;
+DWORD dwLogViewFiltered = 0;
+DWORD dwLogViewFirstLine = 0;
+
+// Forced inventory tracking (the Agent status is polled faster until the
+// inventory task requested by the user finishes)
+BOOL bInventoryTracking = FALSE;
+BOOL bInventoryTaskSeen = FALSE;
+ULONGLONG ullInventoryTrackStart = 0;
+// Forced inventory requested by the user, not replayed from the outbox
+BOOL bInventoryUserRequest = FALSE;
+// The Agent responded to the last /status request
+BOOL bAgentResponding = FALSE;
+
+// Offline outbox: the forced inventories the Agent didn't respond to and the
+// ticket queue runs that failed, journaled to outbox.dat (next to the status
+// history) and replayed by the probe worker once possible
+Outbox outbox;
+
+// Status shared with the Monitors of the other sessions (terminal servers): a
+// single leader polls the local Agent and publishes its /status responses, the
+// followers use them instead of polling
+SharedStatus sharedStatus = {};
+SharedStatusData sharedData = {};   // Last response published (leader) or used (follower)
+SharedStatusData confirmedData = {};    // Follower: last response to its own request
+BOOL bSharedFresh = FALSE;          // Follower: the leader is alive
+BOOL bSharedDemand = FALSE;         // Leader: a follower shows the status
+
+// Agent service watcher (cached SCM handles, notifications and polling), owned
+// by the probe worker or by a one-shot instance
+ServiceWatch svcWatch = {};
+
+// Probe scheduler (a single timer drives the service, Agent and registry probes)
+ProbeScheduler probeScheduler;
+UINT uAgentPollInterval = AGENTPOLL_MIN_INTERVAL;
+
+// Probe worker thread. It runs the probes and handles their notifications and
+// responses, then publishes the resulting status to the main window, whose
+// message loop never waits on the SCM, the registry or the Agent.
+HWND hMainWnd = NULL;
+HWND hProbeWnd = NULL;
+HANDLE hProbeThread = NULL;
+
+// GDI+ related (only started to decode the logo, when the main window is
+// first shown)
 Gdiplus::GdiplusStartupInput gdiplusStartupInput;
-ULONG_PTR gdiplusToken;
+ULONG_PTR gdiplusToken = 0;
+
+// Monitor version, as in the executable version info
+#ifdef VI_VERSIONDEF
+const WORD wMonitorVersion[4] = { VI_VERSIONDEF };
+#else
+const WORD wMonitorVersion[4] = { 1, 5, 0, 0 };
+#endif
 
 // Taskbar icon identifier
 NOTIFYICONDATA nid = { sizeof(nid) };
 // Taskbar icon interaction message ID
 UINT const WMAPP_NOTIFYCALLBACK = WM_APP + 1;
-
-// Dynamic text colors
-COLORREF colorSvcStatus = RGB(0, 0, 0);
+// Agent service status change notification message ID
+UINT const WMAPP_SVCNOTIFY = WM_APP + 2;
+// Registry change notification message ID
+UINT const WMAPP_REGNOTIFY = WM_APP + 3;
+// Agent response message ID
+UINT const WMAPP_AGENTRESPONSE = WM_APP + 4;
+// Status published message ID (main window)
+UINT const WMAPP_STATUS = WM_APP + 5;
+// Status refresh request message ID (probe worker)
+UINT const WMAPP_REFRESH = WM_APP + 6;
+// Forced inventory request message ID (probe worker)
+UINT const WMAPP_FORCEINVENTORY = WM_APP + 7;
+// Logfile indexed message ID (log viewer)
+UINT const WMAPP_LOGINDEXED = WM_APP + 8;
+// Screenshot saved message ID (main window)
+UINT const WMAPP_SCREENSHOT = WM_APP + 9;
+// Ticket queue run message ID (main window)
+UINT const WMAPP_TICKETQUEUE = WM_APP + 10;
+// Outbox action result message ID (probe worker)
+UINT const WMAPP_OUTBOXRESULT = WM_APP + 11;
+// Elevated broker request result message ID (main window)
+UINT const WMAPP_BROKERRESULT = WM_APP + 12;
+// Handed service operation message ID (probe worker, sent)
+UINT const WMAPP_SERVICEOPERATION = WM_APP + 13;
+
+// GLPI Agent HTTPD port
+DWORD dwAgentPort = AGENT_DEFAULT_PORT;
+
+// Guards the settings below, reloaded by the probe worker and read by the main window
+SRWLOCK srwSettings = SRWLOCK_INIT;
 
 // GLPI server URL
 WCHAR szServer[256];
@@ -127,6 +332,83 @@ WCHAR szLogfile[MAX_PATH];
 // Enable screenshot capture
 BOOL bNewTicketScreenshot = TRUE;
 
+// Run the service operations and settings writes in a long-lived elevated
+// broker ("Elevation-Broker" Monitor setting), instead of a new elevated
+// Monitor instance each time
+BOOL bElevationBroker = FALSE;
+
+// Settings being written by the elevated broker for the settings dialog, which
+// is disabled until the write is reported (WMAPP_BROKERRESULT)
+BrokerSettingsBody brokerSettings = {};
+BOOL bBrokerSettingsPending = FALSE;
+
+// GLPI REST API ticket creation ("NewTicket-API" and "NewTicket-AppToken" Monitor
+// settings, and the user token of each user, see LoadTicketUserToken). When both
+// the API URL and the user token are set, new tickets are created directly,
+// through a queue, instead of opening the new ticket URL.
+TicketQueueConfig ticketApiConfig = {};
+
+// Drafts waiting for their screenshot to be saved (main window)
+vector<TicketDraft*> screenshotDrafts;
+
+// Action done when the last notification shown is clicked
+enum NotifyClickAction {
+    NOTIFYCLICK_NONE,
+    NOTIFYCLICK_SCREENSHOT,     // Show the last screenshot saved
+    NOTIFYCLICK_TICKET          // Open the last ticket created
+};
+NotifyClickAction notifyClickAction = NOTIFYCLICK_NONE;
+WCHAR szScreenshotFile[MAX_PATH] = {};
+DWORD dwNotifiedTicketId = 0;
+
+// Remote Agents monitored along with the local one ("Endpoints" Monitor setting,
+// "host[:port]" lines). They are only reached over HTTP, as the Agent client
+// endpoints 1 to N (the local Agent being endpoint 0).
+EndpointConfig endpointConfigs[AGENT_MAX_ENDPOINTS - 1];
+DWORD dwEndpointConfigs = 0;
+
+// Loopback port the metrics are served on ("Metrics-Port" Monitor setting, 0 = disabled)
+DWORD dwMetricsPort = 0;
+
+// Published snapshots, consumed by the main window. A single WMAPP_STATUS message
+// is posted for any number of snapshots published before it's handled.
+SpscChannel<MonitorSnapshot, 16> snapshotChannel;
+volatile LONG lStatusPosted = 0;
+MonitorSnapshot publishedSnapshot = {};
+// Snapshot currently shown in the main window
+MonitorSnapshot shownSnapshot = {};
+BOOL bSnapshotShown = FALSE;
+
+// Service status display (label, start/stop button and label color),
+// by service state
+struct SvcStateDisplay {
+    DWORD dwState;
+    UINT uLabelResId;
+    UINT uButtonResId;
+    COLORREF color;
+    BOOL bEnableButton;
+};
+const SvcStateDisplay svcStateDisplays[] = {
+    { SERVICE_STOPPED,          IDS_SVC_STOPPED,            IDS_STARTSVC,   RGB(255, 0, 0),     TRUE },
+    { SERVICE_RUNNING,          IDS_SVC_RUNNING,            IDS_STOPSVC,    RGB(0, 127, 0),     TRUE },
+    { SERVICE_PAUSED,           IDS_SVC_PAUSED,             IDS_RESUMESVC,  RGB(255, 165, 0),   TRUE },
+    { SERVICE_CONTINUE_PENDING, IDS_SVC_CONTINUEPENDING,    IDS_RESUMESVC,  RGB(255, 165, 0),   FALSE },
+    { SERVICE_PAUSE_PENDING,    IDS_SVC_PAUSEPENDING,       IDS_STOPSVC,    RGB(255, 165, 0),   FALSE },
+    { SERVICE_START_PENDING,    IDS_SVC_STARTPENDING,       IDS_STARTSVC,   RGB(255, 165, 0),   FALSE },
+    { SERVICE_STOP_PENDING,     IDS_SVC_STOPPENDING,        IDS_STOPSVC,    RGB(255, 165, 0),   FALSE }
+};
+// Shown when the service status couldn't be queried
+const SvcStateDisplay svcStateDisplayError = { 0, IDS_ERR_SERVICE, IDS_STARTSVC, RGB(255, 0, 0), FALSE };
+
+// Headless mode (/headless): the probes run without the main window, GDI+ or the
+// taskbar icon, and each published snapshot is written as a JSON line to the
+// standard output (or the parent console)
+BOOL bHeadless = FALSE;
+HeadlessStream headlessStream = {};
+
+// Agent registry values and their change notifications
+RegistryConfig regConfig = {};
+
 // Global string buffer
 WCHAR szBuffer[256];
 DWORD dwBufferLen = sizeof(szBuffer) / sizeof(WCHAR);
@@ -199,8 +481,8 @@ VOID ShowWindowFront(HWND hWnd, int nCmdShow)
 VOID LoadStringAndMessageBox(HINSTANCE hIns, HWND hWn, UINT msgResId, UINT titleResId, UINT mbFlags, UINT errCode = NULL)
 {
     WCHAR szBuf[256], szTitleBuf[128];
-    LoadString(hIns, msgResId, szBuf, sizeof(szBuf) / sizeof(WCHAR));
-    LoadString(hIns, titleResId, szTitleBuf, sizeof(szTitleBuf) / sizeof(WCHAR));
+    LoadCachedString(msgResId, szBuf, sizeof(szBuf) / sizeof(WCHAR));
+    LoadCachedString(titleResId, szTitleBuf, sizeof(szTitleBuf) / sizeof(WCHAR));
     if (errCode != NULL)
     {
         LPWSTR errMsgBuf = nullptr;
@@ -212,6 +494,282 @@ VOID LoadStringAndMessageBox(HINSTANCE hIns, HWND hWn, UINT msgResId, UINT title
     MessageBox(hWn, szBuf, szTitleBuf, mbFlags);
 }
 
+// Loads the specified strings from the resources and shows them as a taskbar icon notification.
+// The message can be a format string, with a single number argument.
+VOID LoadStringAndShowNotification(UINT titleResId, UINT msgResId, DWORD dwInfoFlags, DWORD dwArg = 0)
+{
+    notifyClickAction = NOTIFYCLICK_NONE;
+    nid.uFlags |= NIF_INFO;
+    nid.dwInfoFlags = dwInfoFlags;
+    LoadCachedString(titleResId, nid.szInfoTitle, ARRAYSIZE(nid.szInfoTitle));
+    _snwprintf_s(nid.szInfo, _TRUNCATE, GetString(msgResId), dwArg);
+    Shell_NotifyIcon(NIM_MODIFY, &nid);
+}
+
+// Builds a new ticket screenshot file path, in the user temporary folder
+BOOL GetScreenshotPath(LPWSTR szPath, DWORD cchPath)
+{
+    WCHAR szTemp[MAX_PATH];
+    DWORD cchTemp = GetTempPath(ARRAYSIZE(szTemp), szTemp);
+    if (cchTemp == 0 || cchTemp >= ARRAYSIZE(szTemp))
+        return FALSE;
+    SYSTEMTIME st;
+    GetLocalTime(&st);
+    return _snwprintf_s(szPath, cchPath, _TRUNCATE, L"%sGLPI-AgentMonitor-%04u%02u%02u-%02u%02u%02u.png", szTemp,
+        st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond) > 0;
+}
+
+// Opens an Explorer window with the last screenshot saved selected
+VOID ShowScreenshotFile()
+{
+    WCHAR szParams[MAX_PATH + 16];
+    if (_snwprintf_s(szParams, _TRUNCATE, L"/select,\"%s\"", szScreenshotFile) > 0)
+        ShellExecute(NULL, L"open", L"explorer.exe", szParams, NULL, SW_SHOWNORMAL);
+}
+
+// Opens a ticket created through the API, in the GLPI interface (the API URL
+// is usually "<GLPI URL>/apirest.php")
+VOID ShowTicket(DWORD dwTicketId)
+{
+    WCHAR szURL[ARRAYSIZE(ticketApiConfig.szApiUrl) + 64];
+    AcquireSRWLockShared(&srwSettings);
+    wcscpy_s(szURL, ticketApiConfig.szApiUrl);
+    ReleaseSRWLockShared(&srwSettings);
+    LPWSTR szApi = StrRStrI(szURL, NULL, L"apirest.php");
+    if (szApi == NULL)
+        return;
+    size_t cchBase = szApi - szURL;
+    _snwprintf_s(szApi, ARRAYSIZE(szURL) - cchBase, _TRUNCATE, L"front/ticket.form.php?id=%u", dwTicketId);
+    ShellExecute(NULL, L"open", szURL, NULL, NULL, SW_SHOWNORMAL);
+}
+
+// Converts a string to UTF-8
+string ToUtf8(LPCWSTR szText)
+{
+    int cbUtf8 = WideCharToMultiByte(CP_UTF8, 0, szText, -1, NULL, 0, NULL, NULL);
+    if (cbUtf8 <= 1)
+        return string();
+    string strUtf8(cbUtf8 - 1, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, szText, -1, &strUtf8[0], cbUtf8, NULL, NULL);
+    return strUtf8;
+}
+
+// Builds a ticket draft from the status shown in the main window, along with
+// the Agent logfile (its tail is attached by the ticket queue)
+TicketDraft* CreateTicketDraft(HWND hWnd)
+{
+    static const UINT statusLines[][2] = {
+        { IDS_STATIC_AGENTVER, IDC_AGENTVER },
+        { IDS_STATIC_SERVICESTATUS, IDC_SERVICESTATUS },
+        { IDS_STATIC_STARTTYPE, IDC_STARTTYPE },
+        { IDS_STATIC_AGENTSTATUS, IDC_AGENTSTATUS },
+        { 0, IDC_LASTINVENTORY }
+    };
+    WCHAR szComputer[MAX_COMPUTERNAME_LENGTH + 1];
+    DWORD cchComputer = ARRAYSIZE(szComputer);
+    if (!GetComputerName(szComputer, &cchComputer))
+        szComputer[0] = '\0';
+
+    TicketDraft* pDraft = new TicketDraft();
+    WCHAR szFormat[256];
+    WCHAR szText[512];
+    LoadCachedString(IDS_TICKET_NAME, szFormat, ARRAYSIZE(szFormat));
+    _snwprintf_s(szText, _TRUNCATE, szFormat, szComputer);
+    pDraft->name = ToUtf8(szText);
+
+    LoadCachedString(IDS_TICKET_CONTENT, szFormat, ARRAYSIZE(szFormat));
+    _snwprintf_s(szText, _TRUNCATE, szFormat, szComputer);
+    string strText = ToUtf8(szText);
+    pDraft->content = "<p>";
+    GlpiAppendHtml(pDraft->content, strText.c_str(), strText.size());
+    pDraft->content += "</p><p>";
+    for (const UINT* pLine : statusLines) {
+        szText[0] = '\0';
+        if (pLine[0] != 0) {
+            int cchLabel = LoadCachedString(pLine[0], szText, ARRAYSIZE(szText));
+            // Not all the labels end with a colon
+            if (cchLabel > 0 && szText[cchLabel - 1] != ':')
+                wcscat_s(szText, L":");
+            wcscat_s(szText, L" ");
+        }
+        size_t cchText = wcslen(szText);
+        GetDlgItemText(hWnd, pLine[1], szText + cchText, (int)(ARRAYSIZE(szText) - cchText));
+        strText = ToUtf8(szText);
+        GlpiAppendHtml(pDraft->content, strText.c_str(), strText.size());
+        pDraft->content += "<br>";
+    }
+    pDraft->content += "</p>";
+
+    AcquireSRWLockShared(&srwSettings);
+    wcscpy_s(pDraft->szLogfile, szLogfile);
+    ReleaseSRWLockShared(&srwSettings);
+    return pDraft;
+}
+
+// Queues a ticket draft (if any) and sends the ticket queue, if the GLPI REST
+// API is set (the draft is dropped otherwise)
+BOOL SubmitTicket(TicketDraft* pDraft)
+{
+    AcquireSRWLockShared(&srwSettings);
+    TicketQueueConfig cfg = ticketApiConfig;
+    ReleaseSRWLockShared(&srwSettings);
+    if (cfg.szApiUrl[0] == '\0') {
+        delete pDraft;
+        return FALSE;
+    }
+    return TicketQueueSubmit(&cfg, pDraft);
+}
+
+// Reports a ticket queue run. If the GLPI server couldn't be reached, the probe
+// worker keeps a ticket queue run in the outbox, replayed later.
+VOID OnTicketQueueResult(const TicketQueueResult* pResult)
+{
+    if (pResult->dwCreated > 0) {
+        LoadStringAndShowNotification(IDS_RMENU_NEWTICKET, IDS_NOTIF_TICKET_CREATED, NIIF_INFO, pResult->dwTicketId);
+        notifyClickAction = NOTIFYCLICK_TICKET;
+        dwNotifiedTicketId = pResult->dwTicketId;
+    }
+    else if (pResult->bRetry) {
+        // Only reported for a new ticket, not on each retry
+        if (pResult->dwQueued > 0)
+            LoadStringAndShowNotification(IDS_RMENU_NEWTICKET, IDS_NOTIF_TICKET_QUEUED, NIIF_WARNING);
+    }
+    else if (pResult->dwStatusCode != 0) {
+        LoadStringAndShowNotification(IDS_RMENU_NEWTICKET, IDS_ERR_TICKET_HTTP, NIIF_ERROR, pResult->dwStatusCode);
+    }
+    else if (pResult->dwError != ERROR_SUCCESS) {
+        LoadStringAndShowNotification(IDS_RMENU_NEWTICKET, IDS_ERR_TICKET, NIIF_ERROR, pResult->dwError);
+    }
+
+    // The tickets the server refused were moved aside by the queue. The ones
+    // left are retried if the server couldn't be reached or failed, or else
+    // (i.e. the API session was refused) at the next ticket queue run.
+    OutboxResult result = OUTBOX_DONE;
+    if (pResult->bRetry)
+        result = OUTBOX_RETRY;
+    else if (pResult->dwPending > 0)
+        result = OUTBOX_DROP;
+    PostMessage(hProbeWnd, WMAPP_OUTBOXRESULT, OUTBOX_ACTION_TICKETS, result);
+}
+
+// Parses a "host[:port]" endpoint (IPv6 addresses must be enclosed in brackets)
+BOOL ParseEndpoint(LPCWSTR szEndpoint, EndpointConfig* pCfg)
+{
+    WCHAR szBuf[ARRAYSIZE(pCfg->szHost)];
+    if (wcslen(szEndpoint) >= ARRAYSIZE(szBuf))
+        return FALSE;
+    wcscpy_s(szBuf, szEndpoint);
+    StrTrim(szBuf, L" \t");
+
+    LPWSTR szHost = szBuf;
+    LPWSTR szPort = NULL;
+    if (szHost[0] == '[') {
+        LPWSTR szHostEnd = wcschr(szHost, ']');
+        if (szHostEnd == nullptr)
+            return FALSE;
+        *szHostEnd = '\0';
+        szHost++;
+        if (szHostEnd[1] == ':')
+            szPort = szHostEnd + 2;
+    }
+    else {
+        szPort = wcschr(szHost, ':');
+        if (szPort != nullptr)
+            *szPort++ = '\0';
+    }
+    if (szHost[0] == '\0')
+        return FALSE;
+
+    pCfg->dwPort = AGENT_DEFAULT_PORT;
+    if (szPort != NULL) {
+        pCfg->dwPort = _wtoi(szPort);
+        if (pCfg->dwPort == 0 || pCfg->dwPort > 65535)
+            return FALSE;
+    }
+    wcscpy_s(pCfg->szHost, szHost);
+    return TRUE;
+}
+
+// Sets the new ticket URL to the GLPI server's new ticket page
+VOID SetDefaultNewTicketURL()
+{
+    if (!BrokerIsWebUrl(szServer)) {
+        // Place an "http://" before the URL so that it is at least opened by the system's
+        // default browser instead of doing nothing or unexpected behavior, even if
+        // for some reason the Agent's "server" parameter is empty
+        wsprintf(szNewTicketURL, L"http://%s/front/ticket.form.php", szServer);
+    }
+    else {
+        wsprintf(szNewTicketURL, L"%s/front/ticket.form.php", szServer);
+    }
+}
+
+// Stores the GLPI REST API user token of the current user, protected with
+// DPAPI (only readable by this user), or removes it if empty
+LONG SaveTicketUserToken(LPCWSTR szToken)
+{
+    HKEY hk;
+    WCHAR szKey[MAX_PATH];
+
+    wsprintf(szKey, L"SOFTWARE\\%s\\Monitor", SERVICE_NAME);
+    LONG lRes = RegCreateKeyEx(HKEY_CURRENT_USER, szKey, 0, NULL, REG_OPTION_NON_VOLATILE, KEY_WRITE, NULL, &hk, NULL);
+    if (lRes != ERROR_SUCCESS)
+        return lRes;
+
+    if (szToken[0] == '\0') {
+        lRes = RegDeleteValue(hk, L"NewTicket-UserToken");
+        if (lRes == ERROR_FILE_NOT_FOUND)
+            lRes = ERROR_SUCCESS;
+    }
+    else {
+        DATA_BLOB in = { (DWORD)(wcslen(szToken) * sizeof(WCHAR)), (LPBYTE)szToken };
+        DATA_BLOB out = {};
+        if (CryptProtectData(&in, NULL, NULL, NULL, NULL, CRYPTPROTECT_UI_FORBIDDEN, &out)) {
+            lRes = RegSetValueEx(hk, L"NewTicket-UserToken", 0, REG_BINARY, out.pbData, out.cbData);
+            LocalFree(out.pbData);
+        }
+        else {
+            lRes = GetLastError();
+        }
+    }
+    RegCloseKey(hk);
+    return lRes;
+}
+
+// Loads the GLPI REST API user token of the current user ("NewTicket-UserToken"
+// value of its HKCU Monitor key, stored by SaveTicketUserToken). Each user
+// creates tickets with their own token, which no other user can read.
+BOOL LoadTicketUserToken(LPWSTR szToken, DWORD cchToken)
+{
+    HKEY hk;
+    WCHAR szKey[MAX_PATH];
+    BYTE protectedToken[1024];
+    DWORD cbProtected = sizeof(protectedToken);
+
+    szToken[0] = '\0';
+    wsprintf(szKey, L"SOFTWARE\\%s\\Monitor", SERVICE_NAME);
+    if (RegOpenKeyEx(HKEY_CURRENT_USER, szKey, 0, KEY_READ, &hk) != ERROR_SUCCESS)
+        return FALSE;
+    DWORD dwType;
+    LONG lRes = RegQueryValueEx(hk, L"NewTicket-UserToken", 0, &dwType, protectedToken, &cbProtected);
+    RegCloseKey(hk);
+    if (lRes != ERROR_SUCCESS || dwType != REG_BINARY)
+        return FALSE;
+
+    DATA_BLOB in = { cbProtected, protectedToken };
+    DATA_BLOB out = {};
+    if (!CryptUnprotectData(&in, NULL, NULL, NULL, NULL, CRYPTPROTECT_UI_FORBIDDEN, &out))
+        return FALSE;
+    BOOL bLoaded = (out.cbData % sizeof(WCHAR) == 0 && out.cbData < cchToken * sizeof(WCHAR));
+    if (bLoaded) {
+        CopyMemory(szToken, out.pbData, out.cbData);
+        szToken[out.cbData / sizeof(WCHAR)] = '\0';
+    }
+    SecureZeroMemory(out.pbData, out.cbData);
+    LocalFree(out.pbData);
+    return bLoaded && szToken[0] != '\0';
+}
+
 VOID LoadMonitorSettings()
 {
     HKEY hk;
@@ -233,18 +791,8 @@ VOID LoadMonitorSettings()
     // Get new ticket URL
     DWORD szNewTicketURLLen = sizeof(szNewTicketURL);
     lRes = RegQueryValueEx(hk, L"NewTicket-URL", 0, NULL, (LPBYTE)szNewTicketURL, &szNewTicketURLLen);
-    if (lRes != ERROR_SUCCESS || !wcscmp(szNewTicketURL, L"")) {
-        // Default value if not found or empty
-        if (wcsncmp(L"https://", szServer, 8) != 0 && wcsncmp(L"http://", szServer, 7) != 0) {
-            // Place an "http://" before the URL so that it is at least opened by the system's
-            // default browser instead of doing nothing or unexpected behavior, even if
-            // for some reason the Agent's "server" parameter is empty
-            wsprintf(szNewTicketURL, L"http://%s/front/ticket.form.php", szServer);
-        }
-        else {
-            wsprintf(szNewTicketURL, L"%s/front/ticket.form.php", szServer);
-        }
-    }
+    if (lRes != ERROR_SUCCESS || !wcscmp(szNewTicketURL, L""))
+        SetDefaultNewTicketURL();
 
     // Get new ticket screenshot enable
     DWORD dwNewTicketScreenshotTmp = NULL;
@@ -254,467 +802,1832 @@ VOID LoadMonitorSettings()
         bNewTicketScreenshot = (dwNewTicketScreenshotTmp == 1);
     }
 
+    // Get the GLPI REST API settings (tickets are created through the browser by
+    // default, the API is only used with both its URL and the user's own token)
+    TicketQueueConfig apiCfg = {};
+    DWORD dwApiUrlLen = sizeof(apiCfg.szApiUrl) - sizeof(WCHAR);
+    DWORD dwAppTokenLen = sizeof(apiCfg.szAppToken) - sizeof(WCHAR);
+    if (RegQueryValueEx(hk, L"NewTicket-API", 0, NULL, (LPBYTE)apiCfg.szApiUrl, &dwApiUrlLen) != ERROR_SUCCESS ||
+        apiCfg.szApiUrl[0] == '\0' || !LoadTicketUserToken(apiCfg.szUserToken, ARRAYSIZE(apiCfg.szUserToken)))
+        apiCfg = {};
+    else if (RegQueryValueEx(hk, L"NewTicket-AppToken", 0, NULL, (LPBYTE)apiCfg.szAppToken, &dwAppTokenLen) != ERROR_SUCCESS)
+        apiCfg.szAppToken[0] = '\0';
+    ticketApiConfig = apiCfg;
+
+    // Get the metrics port (metrics are not served by default)
+    DWORD dwMetricsPortLen = sizeof(dwMetricsPort);
+    lRes = RegQueryValueEx(hk, L"Metrics-Port", 0, NULL, (LPBYTE)&dwMetricsPort, &dwMetricsPortLen);
+    if (lRes != ERROR_SUCCESS || dwMetricsPort > 65535)
+        dwMetricsPort = 0;
+
+    // Get the elevation broker setting (disabled by default)
+    DWORD dwElevationBroker = 0;
+    DWORD dwElevationBrokerLen = sizeof(dwElevationBroker);
+    lRes = RegQueryValueEx(hk, L"Elevation-Broker", 0, NULL, (LPBYTE)&dwElevationBroker, &dwElevationBrokerLen);
+    bElevationBroker = (lRes == ERROR_SUCCESS && dwElevationBroker != 0);
+
+    // Get the remote Agents to monitor (invalid lines are skipped)
+    WCHAR szEndpoints[2048] = {};
+    DWORD dwEndpointsLen = sizeof(szEndpoints) - 2 * sizeof(WCHAR);
+    dwEndpointConfigs = 0;
+    lRes = RegQueryValueEx(hk, L"Endpoints", 0, NULL, (LPBYTE)szEndpoints, &dwEndpointsLen);
+    if (lRes == ERROR_SUCCESS) {
+        for (LPWSTR szLine = szEndpoints; *szLine != '\0' && dwEndpointConfigs < ARRAYSIZE(endpointConfigs);
+            szLine += wcslen(szLine) + 1) {
+            if (ParseEndpoint(szLine, &endpointConfigs[dwEndpointConfigs]))
+                dwEndpointConfigs++;
+        }
+    }
+
     RegCloseKey(hk);
 }
 
-// Unsets the asynchronous callback and close the WinHttp handle
-VOID CloseWinHttpRequest(HINTERNET hInternet) {
-    WinHttpSetStatusCallback(hInternet, NULL, NULL, NULL);
-    WinHttpCloseHandle(hInternet);
-    hReq = NULL;
+// Writes the Monitor settings selected by their mask to the registry (needs
+// elevation). Returns ERROR_SUCCESS or the registry error code.
+LONG WriteMonitorSettings(const BrokerSettingsBody* pSettings)
+{
+    HKEY hk, hkMonitor;
+    WCHAR szKey[MAX_PATH];
+
+    wsprintf(szKey, L"SOFTWARE\\%s", SERVICE_NAME);
+    LONG lRes = RegOpenKeyEx(HKEY_LOCAL_MACHINE, szKey, 0, KEY_WRITE | KEY_WOW64_64KEY, &hk);
+    if (lRes == ERROR_FILE_NOT_FOUND)
+    {
+        wsprintf(szKey, L"SOFTWARE\\WOW6432Node\\%s", SERVICE_NAME);
+        lRes = RegOpenKeyEx(HKEY_LOCAL_MACHINE, szKey, 0, KEY_WRITE | KEY_WOW64_64KEY, &hk);
+    }
+    if (lRes != ERROR_SUCCESS)
+        return lRes;
+    // Only web URLs are opened (see BrokerIsWebUrl), an empty one restores the default
+    if ((pSettings->dwMask & BROKER_SETTINGS_NEWTICKET_URL) && pSettings->szNewTicketURL[0] != '\0' &&
+        !BrokerIsWebUrl(pSettings->szNewTicketURL)) {
+        RegCloseKey(hk);
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    wcscat_s(szKey, L"\\Monitor");
+    lRes = RegOpenKeyEx(HKEY_LOCAL_MACHINE, szKey, 0, KEY_WRITE | KEY_WOW64_64KEY, &hkMonitor);
+    if (lRes != ERROR_SUCCESS)
+        lRes = RegCreateKeyEx(hk, L"Monitor", 0, NULL, REG_OPTION_NON_VOLATILE, KEY_WRITE, NULL, &hkMonitor, NULL);
+    if (lRes == ERROR_SUCCESS)
+    {
+        if (pSettings->dwMask & BROKER_SETTINGS_NEWTICKET_URL)
+            lRes = RegSetValueEx(hkMonitor, L"NewTicket-URL", 0, REG_SZ, (LPBYTE)pSettings->szNewTicketURL,
+                (DWORD)((wcslen(pSettings->szNewTicketURL) + 1) * sizeof(WCHAR)));
+        if (lRes == ERROR_SUCCESS && (pSettings->dwMask & BROKER_SETTINGS_NEWTICKET_SCREENSHOT))
+            lRes = RegSetValueEx(hkMonitor, L"NewTicket-Screenshot", 0, REG_DWORD,
+                (LPBYTE)&pSettings->dwNewTicketScreenshot, sizeof(pSettings->dwNewTicketScreenshot));
+        RegCloseKey(hkMonitor);
+    }
+    RegCloseKey(hk);
+    return lRes;
 }
 
-// Callback called by the asynchronous WinHTTP request
-VOID CALLBACK WinHttpCallback(HINTERNET hInternet, DWORD_PTR dwContext, DWORD dwInternetStatus, LPVOID lpvStatusInfo, DWORD dwStatusInfoLength)
+// Loads GLPI Agent settings from the registry (HTTPD port, server URL and logfile)
+// On error, returns the error code and sets the error message resource ID
+LONG LoadAgentSettings(UINT *puErrResId)
 {
-    switch (dwInternetStatus)
-    {
-        // Request is sent, receive response
-        case WINHTTP_CALLBACK_STATUS_SENDREQUEST_COMPLETE:
-            if (!WinHttpReceiveResponse(hInternet, NULL)) {
-                CloseWinHttpRequest(hInternet);
-            }
-            break;
+    AgentSettings settings;
+    LONG lRes = RegConfigReadAgentSettings(&regConfig, &settings, puErrResId);
+    if (lRes != ERROR_SUCCESS)
+        return lRes;
+    dwAgentPort = settings.dwPort;
+    wcscpy_s(szServer, settings.szServer);
+    wcscpy_s(szLogfile, settings.szLogfile);
+    return ERROR_SUCCESS;
+}
 
-        // Response headers are available, query for data
-        case WINHTTP_CALLBACK_STATUS_HEADERS_AVAILABLE:
-            if (!WinHttpQueryDataAvailable(hInternet, NULL)) {
-                CloseWinHttpRequest(hInternet);
-            }
-            break;
+// Returns whether the status is being watched (main window shown, or headless mode),
+// in which case the probes run at their shorter intervals
+BOOL IsStatusShown()
+{
+    return bHeadless || IsWindowVisible(hMainWnd);
+}
 
-        // Data is available, read it
-        case WINHTTP_CALLBACK_STATUS_DATA_AVAILABLE: {
-            DWORD dwSize = *(LPDWORD)lpvStatusInfo;
-            DWORD dwDownloaded;
-            CHAR szResponse[128] = "";
-            DWORD dwResponseLen = sizeof(szResponse);
-
-            // If the response size is greater than expected, set "Agent not responding" string and close the WinHTTP handle
-            if (dwSize >= dwResponseLen) {
-                LoadString(hInst, IDS_ERR_NOTRESPONDING, szAgStatus, sizeof(szAgStatus) / sizeof(WCHAR));
-                SetDlgItemText((HWND)dwContext, IDC_AGENTSTATUS, szAgStatus);
-                CloseWinHttpRequest(hInternet);
-                break;
-            }
+// Queues a taskbar icon notification, shown by the main window along with the next published status
+VOID QueueNotification(UINT titleResId, UINT msgResId, DWORD dwInfoFlags)
+{
+    MonitorSnapshotNotify(&monitorState, titleResId, msgResId, dwInfoFlags);
+}
 
-            if (dwSize == 0 || !WinHttpReadData(hInternet, &szResponse, dwSize, &dwDownloaded)) {
-                CloseWinHttpRequest(hInternet);
-                break;
-            }
+// Returns whether the local Agent status is taken from the leader instead of
+// being polled (a forced inventory is still tracked by polling the Agent)
+BOOL UsesSharedStatus()
+{
+    return sharedStatus.pBlock != NULL && !sharedStatus.bLeader && bSharedFresh && !bInventoryTracking;
+}
 
-            // If the number of downloaded bytes is equal or greater than expected, set "Agent not responding" string and close the WinHTTP handle
-            if(dwDownloaded >= dwResponseLen) {
-                LoadString(hInst, IDS_ERR_NOTRESPONDING, szAgStatus, sizeof(szAgStatus) / sizeof(WCHAR));
-                SetDlgItemText((HWND)dwContext, IDC_AGENTSTATUS, szAgStatus);
-                CloseWinHttpRequest(hInternet);
-                break;
-            }
+// Requests GLPI Agent status via HTTP (asynchronous)
+VOID GetAgentStatus(HWND hWnd)
+{
+    // Only one request is sent at a time, the response is handled by OnAgentResponse
+    if (monitorState.dwSvcState == SERVICE_RUNNING && !UsesSharedStatus())
+        AgentClientSend(hWnd, WMAPP_AGENTRESPONSE, AGENTREQ_STATUS);
+}
 
-            // Set last character to null
-            szResponse[dwDownloaded] = '\0';
+// Starts or stops tracking a forced inventory, polling the Agent status faster meanwhile
+VOID SetInventoryTracking(HWND hWnd, BOOL bTrack)
+{
+    if (bTrack) {
+        bInventoryTaskSeen = FALSE;
+        ullInventoryTrackStart = GetTickCount64();
+    }
+    if (bTrack != bInventoryTracking) {
+        bInventoryTracking = bTrack;
+        ScheduleProbes(hWnd);
+    }
+}
 
-            size_t cnvChars = 0;
+// Tracks the forced inventory from an Agent status response. The Agent reports
+// "waiting" while idle, so the inventory is done once it's back to it.
+VOID TrackInventory(HWND hWnd, AgentResponse* pResp)
+{
+    BOOL bAgentIdle = pResp->bStatusFound && _wcsnicmp(pResp->szStatus, L"waiting", 7) == 0;
 
-            // Must remove "status: " from the string (dwDownloaded - 7, szResponse[8])
-            mbstowcs_s(&cnvChars, szAgStatus, (size_t)dwDownloaded - 7, (LPCSTR)&szResponse[8], _TRUNCATE);
-            SetDlgItemText((HWND)dwContext, IDC_AGENTSTATUS, szAgStatus);
-            break;
-        }
+    if (pResp->bStatusFound && !bAgentIdle) {
+        bInventoryTaskSeen = TRUE;
+    }
+    else if (bAgentIdle && bInventoryTaskSeen) {
+        SetInventoryTracking(hWnd, FALSE);
+        QueueNotification(IDS_APP_TITLE, IDS_NOTIF_FORCEINV_DONE, NIIF_INFO);
+        return;
+    }
+
+    // Give up if the task never started (i.e. it was too fast to be seen) or doesn't finish
+    ULONGLONG ullElapsed = GetTickCount64() - ullInventoryTrackStart;
+    if (ullElapsed > (bInventoryTaskSeen ? INVENTORY_FINISH_TIMEOUT : INVENTORY_START_TIMEOUT))
+        SetInventoryTracking(hWnd, FALSE);
+}
+
+// Appends an outbox record to its journal (the outbox still works from memory
+// if the journal can't be written)
+VOID WriteOutbox(const string& record)
+{
+    if (!record.empty())
+        OutboxWrite(&outbox, record);
+}
 
-        // Set "Agent not responding" string on error and close the WinHTTP handle (on both error and read complete)
-        case WINHTTP_CALLBACK_STATUS_REQUEST_ERROR:
-            LoadString(hInst, IDS_ERR_NOTRESPONDING, szAgStatus, sizeof(szAgStatus) / sizeof(WCHAR));
-            SetDlgItemText((HWND)dwContext, IDC_AGENTSTATUS, szAgStatus);
-        case WINHTTP_CALLBACK_STATUS_READ_COMPLETE:
-            CloseWinHttpRequest(hInternet);
+// Handles a forced inventory outcome. An inventory the Agent didn't respond to
+// is kept in the outbox, and requested again once the Agent responds.
+// Inventories replayed from the outbox are only notified once done.
+VOID OnInventoryResult(HWND hWnd, OutboxResult result)
+{
+    string record;
+    DWORD dwSeq = OutboxFindInFlight(&outbox, OUTBOX_ACTION_INVENTORY);
+    if (dwSeq != 0)
+        OutboxComplete(&outbox, dwSeq, result, record);
+    else if (result == OUTBOX_RETRY)
+        OutboxAdd(&outbox, OUTBOX_ACTION_INVENTORY, string(), record);
+    WriteOutbox(record);
+
+    BOOL bUserRequest = bInventoryUserRequest;
+    bInventoryUserRequest = FALSE;
+    switch (result) {
+        case OUTBOX_DONE:
+            QueueNotification(IDS_APP_TITLE, IDS_MSG_FORCEINV_OK, NIIF_INFO);
+            SetInventoryTracking(hWnd, TRUE);
+            break;
+        case OUTBOX_DROP:
+            QueueNotification(IDS_ERROR, IDS_ERR_FORCEINV_NOTALLOWED, NIIF_ERROR);
+            break;
+        case OUTBOX_RETRY:
+            if (bUserRequest)
+                QueueNotification(IDS_APP_TITLE, IDS_NOTIF_FORCEINV_QUEUED, NIIF_WARNING);
             break;
     }
+    ScheduleProbes(hWnd);
 }
 
-// Requests GLPI Agent status via HTTP (asynchronous)
-VOID GetAgentStatus(HWND hWnd)
+// Requests an inventory via HTTP (asynchronous). An inventory waiting in the
+// outbox is requested now instead of a new one, so that repeated requests
+// don't add up.
+VOID ForceInventory(HWND hWnd)
 {
-    if (svcStatus.dwCurrentState == SERVICE_RUNNING)
-    {
-        // Only do another request if the previous one is closed
-        if (hReq == NULL)
-        {
-            hReq = WinHttpOpenRequest(hConn, L"GET", L"/status", NULL, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES,
-                WINHTTP_FLAG_BYPASS_PROXY_CACHE);
+    if (monitorState.dwSvcState == SERVICE_RUNNING) {
+        bInventoryUserRequest = TRUE;
+        OutboxWake(&outbox, OUTBOX_ACTION_INVENTORY);
+        vector<OutboxAction> batch;
+        OutboxTakeBatch(&outbox, 1 << OUTBOX_ACTION_INVENTORY, batch);
+        if (AgentClientSend(hWnd, WMAPP_AGENTRESPONSE, AGENTREQ_NOW))
+            MetricsIncrement(CNT_FORCED_INVENTORIES);
+        else if (!AgentClientIsPending(AGENTREQ_NOW))
+            OnInventoryResult(hWnd, OUTBOX_RETRY);
+    }
+    else
+        QueueNotification(IDS_ERROR, IDS_ERR_NOTRUNNING, NIIF_ERROR);
+}
+
+// Handles a ticket queue run outcome (reported by the main window). A failed
+// run is kept in the outbox, unless it was already being replayed from it.
+VOID OnTicketsResult(HWND hWnd, OutboxResult result)
+{
+    string record;
+    DWORD dwSeq = OutboxFindInFlight(&outbox, OUTBOX_ACTION_TICKETS);
+    if (dwSeq != 0)
+        OutboxComplete(&outbox, dwSeq, result, record);
+    else if (result == OUTBOX_RETRY)
+        OutboxAdd(&outbox, OUTBOX_ACTION_TICKETS, string(), record);
+    WriteOutbox(record);
+    ScheduleProbes(hWnd);
+}
 
-            // Callback is set for this request only, not for the entire WinHTTP session,
-            // as "Force Inventory" is synchronous
-            WinHttpSetStatusCallback(hReq, WinHttpCallback, WINHTTP_CALLBACK_FLAG_ALL_NOTIFICATIONS, NULL);
+// Returns the outbox actions that can be replayed now: forced inventories
+// while the Agent service runs, and ticket queue runs (the ticket queue finds
+// out by itself whether the GLPI server is reachable). Nothing is replayed in
+// headless mode.
+DWORD GetOutboxReplayMask()
+{
+    if (bHeadless)
+        return 0;
+    DWORD dwMask = (1 << OUTBOX_ACTION_TICKETS);
+    if (monitorState.dwSvcState == SERVICE_RUNNING)
+        dwMask |= (1 << OUTBOX_ACTION_INVENTORY);
+    return dwMask;
+}
 
-            WinHttpSendRequest(hReq, WINHTTP_NO_ADDITIONAL_HEADERS, NULL, WINHTTP_NO_REQUEST_DATA, NULL, NULL, (DWORD_PTR)hWnd);
+// Replays a batch of outbox actions. Their outcome is reported back to
+// OnInventoryResult and OnTicketsResult.
+VOID ReplayOutbox(HWND hWnd)
+{
+    vector<OutboxAction> batch;
+    OutboxTakeBatch(&outbox, GetOutboxReplayMask(), batch);
+    for (const OutboxAction& action : batch)
+    {
+        switch (action.wAction) {
+            case OUTBOX_ACTION_INVENTORY:
+                // A /now request already pending completes the action
+                if (AgentClientSend(hWnd, WMAPP_AGENTRESPONSE, AGENTREQ_NOW))
+                    MetricsIncrement(CNT_FORCED_INVENTORIES);
+                else if (!AgentClientIsPending(AGENTREQ_NOW))
+                    OnInventoryResult(hWnd, OUTBOX_RETRY);
+                break;
+            case OUTBOX_ACTION_TICKETS:
+                // Dropped if the GLPI REST API is no longer set
+                if (!SubmitTicket(NULL))
+                    OnTicketsResult(hWnd, OUTBOX_DROP);
+                break;
         }
     }
 }
 
-// Requests an inventory via HTTP (synchronous)
-VOID ForceInventory(HWND hWnd)
+// Counts the responding remote Agents into the monitor state
+VOID UpdateEndpointSummary()
 {
-    if (svcStatus.dwCurrentState == SERVICE_RUNNING)
-    {
-        if (glpiAgentOk)
-        {
-            HINTERNET hReq = WinHttpOpenRequest(hConn, L"GET", L"/now", NULL, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES,
-                WINHTTP_FLAG_BYPASS_PROXY_CACHE);
+    monitorState.dwEndpoints = dwRemoteEndpoints;
+    monitorState.dwEndpointsResponding = 0;
+    for (DWORD i = 1; i <= dwRemoteEndpoints; i++) {
+        if (endpointStates[i].bResponding)
+            monitorState.dwEndpointsResponding++;
+    }
+}
 
-            if (WinHttpSendRequest(hReq, WINHTTP_NO_ADDITIONAL_HEADERS, NULL, WINHTTP_NO_REQUEST_DATA, NULL, NULL, NULL)) 
-            {
-                if (WinHttpReceiveResponse(hReq, NULL)) {
-                    DWORD dwStatusCode = 0;
-                    DWORD dwSize = sizeof(dwStatusCode);
+// Requests the remote Agents status (asynchronous, the responses are handled by
+// OnEndpointResponse). A remote Agent still handling the previous request is skipped.
+VOID PollEndpoints(HWND hWnd)
+{
+    for (DWORD i = 1; i <= dwRemoteEndpoints; i++)
+        AgentClientSend(hWnd, WMAPP_AGENTRESPONSE, AGENTREQ_STATUS, i);
+}
 
-                    if (!WinHttpQueryHeaders(hReq, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
-                        WINHTTP_HEADER_NAME_BY_INDEX, &dwStatusCode, &dwSize, WINHTTP_NO_HEADER_INDEX))
-                    {
-                        LoadStringAndMessageBox(hInst, hWnd, IDS_ERR_FORCEINV_NORESPONSE, IDS_ERROR, MB_OK | MB_ICONERROR);
-                    }
-                    else {
-                        if (dwStatusCode != 200)
-                            LoadStringAndMessageBox(hInst, hWnd, IDS_ERR_FORCEINV_NOTALLOWED, IDS_ERROR, MB_OK | MB_ICONERROR);
-                        else
-                            LoadStringAndMessageBox(hInst, hWnd, IDS_MSG_FORCEINV_OK, IDS_APP_TITLE, MB_OK | MB_ICONINFORMATION);
-                    }
-                }
-            }
-            WinHttpCloseHandle(hReq);
-        }
-        else
-            LoadStringAndMessageBox(hInst, hWnd, IDS_ERR_AGENTERR, IDS_ERROR, MB_OK | MB_ICONERROR);
+// Handles a remote Agent /status response. A remote Agent is reported as not
+// responding after a few consecutive failures, so a single lost request is ignored.
+VOID OnEndpointResponse(AgentResponse* pResp)
+{
+    if (pResp->dwEndpoint > dwRemoteEndpoints)
+        return;
+
+    EndpointState* pState = &endpointStates[pResp->dwEndpoint];
+    if (pResp->dwError == ERROR_SUCCESS && pResp->dwStatusCode == 200 && pResp->bStatusFound) {
+        pState->dwFailures = 0;
+        pState->bResponding = TRUE;
+    }
+    else if (++pState->dwFailures >= ENDPOINT_MAX_FAILURES && pState->bResponding) {
+        pState->bResponding = FALSE;
+        MetricsIncrement(CNT_ENDPOINTS_DOWN);
+        QueueNotification(IDS_ERROR, IDS_NOTIF_ENDPOINT_DOWN, NIIF_WARNING);
     }
+    UpdateEndpointSummary();
+}
+
+// Records the local Agent /status request failures to the status history
+// (only the first one, until the Agent responds again or fails differently)
+VOID RecordAgentError(AgentResponse* pResp)
+{
+    WORD wType = 0;
+    DWORD dwValue = 0;
+    if (pResp->dwError != ERROR_SUCCESS) {
+        wType = HISTORY_AGENTERROR;
+        dwValue = pResp->dwError;
+    }
+    else if (pResp->dwStatusCode != 200) {
+        wType = HISTORY_AGENTHTTP;
+        dwValue = pResp->dwStatusCode;
+    }
+
+    DWORD dwAgentError = MAKELONG(min(dwValue, (DWORD)0xFFFF), wType);
+    if (dwAgentError != dwHistoryAgentError && wType != 0)
+        HistoryAppend(wType, dwValue);
+    dwHistoryAgentError = dwAgentError;
+}
+
+// Applies a local Agent /status response (polled, or published by the leader)
+VOID ApplyAgentStatus(HWND hWnd, AgentResponse* pResp)
+{
+    RecordAgentError(pResp);
+
+    WCHAR szLastAgStatus[ARRAYSIZE(monitorState.szAgStatus)];
+    wcscpy_s(szLastAgStatus, monitorState.szAgStatus);
+    if (pResp->dwError != ERROR_SUCCESS || pResp->dwStatusCode != 200 || !pResp->bStatusFound) {
+        LoadCachedString(IDS_ERR_NOTRESPONDING, monitorState.szAgStatus, ARRAYSIZE(monitorState.szAgStatus));
+        MetricsIncrement(CNT_AGENT_ERRORS);
+        if (wcscmp(monitorState.szAgStatus, szLastAgStatus) != 0)
+            MetricsIncrement(CNT_AGENT_NOTRESPONDING);
+        bAgentResponding = FALSE;
+    }
+    else {
+        wcscpy_s(monitorState.szAgStatus, pResp->szStatus);
+        // An inventory waiting in the outbox is requested right away
+        // once the Agent responds again
+        if (!bAgentResponding)
+            OutboxWake(&outbox, OUTBOX_ACTION_INVENTORY);
+        bAgentResponding = TRUE;
+    }
+
+    // Poll less often while the status is steady
+    if (wcscmp(monitorState.szAgStatus, szLastAgStatus) != 0)
+        uAgentPollInterval = AGENTPOLL_MIN_INTERVAL;
     else
-        LoadStringAndMessageBox(hInst, hWnd, IDS_ERR_NOTRUNNING, IDS_ERROR, MB_OK | MB_ICONERROR);
+        uAgentPollInterval = min(uAgentPollInterval * 2, AGENTPOLL_MAX_INTERVAL);
+
+    if (bInventoryTracking)
+        TrackInventory(hWnd, pResp);
+    ScheduleProbes(hWnd);
+}
+
+// Publishes a local Agent /status response to the followers (leader), or
+// records it to confirm the ones the leader publishes (follower)
+VOID ShareAgentStatus(const AgentResponse* pResp)
+{
+    SharedStatusData* pData = (sharedStatus.bLeader ? &sharedData : &confirmedData);
+    pData->dwError = pResp->dwError;
+    pData->dwStatusCode = pResp->dwStatusCode;
+    pData->bStatusFound = pResp->bStatusFound;
+    wcscpy_s(pData->szStatus, pResp->szStatus);
+    if (!sharedStatus.bLeader)
+        return;
+
+    sharedData.ullHeartbeat = GetTickCount64();
+    sharedData.ullResponse = sharedData.ullHeartbeat;
+    if (++sharedData.dwResponseSeq == 0)
+        sharedData.dwResponseSeq = 1;
+    SharedStatusWrite(sharedStatus.pBlock, &sharedData);
 }
 
-// Updates service related statuses
-VOID CALLBACK UpdateServiceStatus(HWND hWnd, UINT message, UINT idTimer, DWORD dwTime) {
-    WCHAR szBtnString[32];
-    DWORD dwBtnStringLen = sizeof(szBtnString) / sizeof(WCHAR);
-    BOOL bQuerySvcOk = FALSE;
-    BOOL bSvcChangedState = FALSE;
+// Handles an Agent response posted by the Agent client
+VOID OnAgentResponse(HWND hWnd, AgentResponse* pResp)
+{
+    if (pResp->dwEndpoint != AGENT_LOCAL_ENDPOINT) {
+        OnEndpointResponse(pResp);
+        return;
+    }
 
-    // Open Service Manager and Agent service handle and query Agent service status
-    SC_HANDLE hSc = OpenSCManager(NULL, SERVICES_ACTIVE_DATABASE, SC_MANAGER_CONNECT | SC_MANAGER_ENUMERATE_SERVICE);
-    if (hSc != NULL) {
-        SC_HANDLE hAgentSvc = OpenService(hSc, SERVICE_NAME, SERVICE_QUERY_STATUS);
+    switch (pResp->type)
+    {
+        case AGENTREQ_STATUS:
+            // If the service stopped meanwhile, the status was
+            // already replaced by ApplyServiceStatus
+            if (monitorState.dwSvcState != SERVICE_RUNNING)
+                break;
 
-        if (hAgentSvc != NULL) {
-            bQuerySvcOk = QueryServiceStatus(hAgentSvc, &svcStatus);
-            CloseServiceHandle(hAgentSvc);
-        }
+            MetricsObserve(HIST_AGENT_STATUS, pResp->ullElapsedUs);
+            ShareAgentStatus(pResp);
+            ApplyAgentStatus(hWnd, pResp);
+            break;
 
-        CloseServiceHandle(hSc);
+        // The result is shown as a notification, as the request may
+        // complete long after the user clicked "Force inventory"
+        case AGENTREQ_NOW:
+            MetricsObserve(HIST_AGENT_NOW, pResp->ullElapsedUs);
+            if (pResp->dwError != ERROR_SUCCESS || pResp->dwStatusCode == 0)
+                OnInventoryResult(hWnd, OUTBOX_RETRY);
+            else if (pResp->dwStatusCode != 200)
+                OnInventoryResult(hWnd, OUTBOX_DROP);
+            else
+                OnInventoryResult(hWnd, OUTBOX_DONE);
+            break;
     }
+}
 
-    if (!bQuerySvcOk || !bAgentInstalled) {
-        if (IsWindowVisible(hWnd)) {
-            LoadString(hInst, IDS_ERR_SERVICE, szBuffer, dwBufferLen);
-            LoadString(hInst, IDS_STARTSVC, szBtnString, dwBtnStringLen);
-            colorSvcStatus = RGB(255, 0, 0);
-            SetDlgItemText(hWnd, IDC_SERVICESTATUS, szBuffer);
-            SetDlgItemText(hWnd, IDC_BTN_STARTSTOPSVC, szBtnString);
-            HWND hWndSvcButton = GetDlgItem(hWnd, IDC_BTN_STARTSTOPSVC);
-            EnableWindow(hWndSvcButton, FALSE);
-            SetFocus(hWndSvcButton);
-        }
+// Shared status probe. A Monitor takes the lead once there's no leader anymore
+// (i.e. it exited). The leader then writes its heartbeat and checks whether a
+// follower shows the status, and a follower applies the last response the
+// leader published, unless it's too old (the leader only polls the Agent on
+// demand). As any user may write the block, a follower ignores inconsistent
+// data, and requests the Agent status itself when the leader publishes a
+// response it didn't get yet: only confirmed responses are shown.
+VOID SyncSharedStatus(HWND hWnd)
+{
+    ULONGLONG ullNow = GetTickCount64();
+    SharedStatusData data;
+    if (!sharedStatus.bLeader && SharedStatusTryLead(&sharedStatus)) {
+        // The responses numbering goes on from the previous leader's
+        if (SharedStatusRead(sharedStatus.pBlock, &data))
+            sharedData.dwResponseSeq = data.dwResponseSeq;
+        bSharedFresh = FALSE;
+        MetricsSetGauge(GAUGE_STATUS_LEADER, 1);
+    }
 
-        LoadIconMetric(hInst, MAKEINTRESOURCE(IDI_GLPIERR), LIM_LARGE, &nid.hIcon);
-        LoadString(hInst, IDS_GLPINOTIFYERROR, nid.szTip, ARRAYSIZE(nid.szTip));
-        nid.szInfo[0] = '\0';
-        Shell_NotifyIcon(NIM_MODIFY, &nid);
-        glpiAgentOk = false;
+    if (sharedStatus.bLeader) {
+        // Takes the metrics port over (again if the previous leader's
+        // socket wasn't closed yet)
+        ApplyMetricsConfig();
+        sharedData.ullHeartbeat = ullNow;
+        SharedStatusWrite(sharedStatus.pBlock, &sharedData);
+        bSharedDemand = (sharedStatus.pDemand == NULL ||
+            SharedStatusGetDemand(sharedStatus.pDemand) + SHAREDSTATUS_DEMAND_TIMEOUT > ullNow);
+        return;
+    }
+
+    bSharedFresh = (SharedStatusRead(sharedStatus.pBlock, &data) && SharedStatusValidate(&data, ullNow) &&
+        data.ullHeartbeat + SHAREDSTATUS_STALE_TIMEOUT > ullNow);
+    if (!UsesSharedStatus() || !IsStatusShown())
+        return;
+
+    if (sharedStatus.pDemand != NULL)
+        SharedStatusSetDemand(sharedStatus.pDemand, ullNow);
+    if (data.dwResponseSeq == 0 || data.dwResponseSeq == sharedData.dwResponseSeq ||
+        data.ullResponse + SHAREDSTATUS_STALE_TIMEOUT <= ullNow)
+        return;
+    if (!SharedStatusSameResponse(&data, &confirmedData)) {
+        // The response is applied by OnAgentResponse, and confirms this one
+        if (monitorState.dwSvcState == SERVICE_RUNNING)
+            AgentClientSend(hWnd, WMAPP_AGENTRESPONSE, AGENTREQ_STATUS);
+        return;
     }
-    else if (bQuerySvcOk) {
-        bSvcChangedState = svcStatus.dwCurrentState != lastSvcStatus.dwCurrentState;
+    sharedData = data;
+
+    // If the service isn't running, the status was set by ApplyServiceStatus
+    if (monitorState.dwSvcState == SERVICE_RUNNING) {
+        AgentResponse* pResp = new AgentResponse();
+        pResp->type = AGENTREQ_STATUS;
+        pResp->dwEndpoint = AGENT_LOCAL_ENDPOINT;
+        pResp->dwError = data.dwError;
+        pResp->dwStatusCode = data.dwStatusCode;
+        pResp->bStatusFound = data.bStatusFound;
+        wcscpy_s(pResp->szStatus, data.szStatus);
+        ApplyAgentStatus(hWnd, pResp);
+        delete pResp;
     }
+}
+
+// Updates service related statuses from a queried service state
+// (returns TRUE if the service changed its state)
+BOOL ApplyServiceStatus(HWND hWnd, BOOL bQuerySvcOk, DWORD dwCurrentState)
+{
+    BOOL bSvcChangedState = MonitorSnapshotSetService(&monitorState,
+        bQuerySvcOk && monitorState.config.bInstalled, dwCurrentState);
 
     if (bSvcChangedState)
     {
-        BOOL bEnableButton = FALSE;
-        switch (svcStatus.dwCurrentState)
-        {
-            case SERVICE_STOPPED:
-                LoadString(hInst, IDS_SVC_STOPPED, szBuffer, dwBufferLen);
-                LoadString(hInst, IDS_STARTSVC, szBtnString, dwBtnStringLen);
-                colorSvcStatus = RGB(255, 0, 0);
-                bEnableButton = TRUE;
-                break;
-            case SERVICE_RUNNING:
-                LoadString(hInst, IDS_SVC_RUNNING, szBuffer, dwBufferLen);
-                LoadString(hInst, IDS_STOPSVC, szBtnString, dwBtnStringLen);
-                colorSvcStatus = RGB(0, 127, 0);
-                bEnableButton = TRUE;
-                break;
-            case SERVICE_PAUSED:
-                LoadString(hInst, IDS_SVC_PAUSED, szBuffer, dwBufferLen);
-                LoadString(hInst, IDS_RESUMESVC, szBtnString, dwBtnStringLen);
-                colorSvcStatus = RGB(255, 165, 0);
-                bEnableButton = TRUE;
-                break;
-            case SERVICE_CONTINUE_PENDING:
-                LoadString(hInst, IDS_SVC_CONTINUEPENDING, szBuffer, dwBufferLen);
-                LoadString(hInst, IDS_RESUMESVC, szBtnString, dwBtnStringLen);
-                colorSvcStatus = RGB(255, 165, 0);
-                break;
-            case SERVICE_PAUSE_PENDING:
-                LoadString(hInst, IDS_SVC_PAUSEPENDING, szBuffer, dwBufferLen);
-                LoadString(hInst, IDS_STOPSVC, szBtnString, dwBtnStringLen);
-                colorSvcStatus = RGB(255, 165, 0);
-                break;
-            case SERVICE_START_PENDING:
-                LoadString(hInst, IDS_SVC_STARTPENDING, szBuffer, dwBufferLen);
-                LoadString(hInst, IDS_STARTSVC, szBtnString, dwBtnStringLen);
-                colorSvcStatus = RGB(255, 165, 0);
-                break;
-            case SERVICE_STOP_PENDING:
-                LoadString(hInst, IDS_SVC_STOPPENDING, szBuffer, dwBufferLen);
-                LoadString(hInst, IDS_STOPSVC, szBtnString, dwBtnStringLen);
-                colorSvcStatus = RGB(255, 165, 0);
-                break;
-            default:
-                LoadString(hInst, IDS_ERR_SERVICE, szBuffer, dwBufferLen);
-                LoadString(hInst, IDS_STARTSVC, szBtnString, dwBtnStringLen);
-                colorSvcStatus = RGB(255, 0, 0);
-                break;
-        }
-        SetDlgItemText(hWnd, IDC_SERVICESTATUS, szBuffer);
-        SetDlgItemText(hWnd, IDC_BTN_STARTSTOPSVC, szBtnString);
-
-        LoadString(hInst, (svcStatus.dwCurrentState == SERVICE_STOPPED ? IDS_ERR_NOTRUNNING : IDS_WAIT), szBuffer, dwBufferLen);
-        SetDlgItemText(hWnd, IDC_AGENTSTATUS, szBuffer);
+        MetricsIncrement(CNT_SERVICE_CHANGES);
 
-        HWND hWndSvcButton = GetDlgItem(hWnd, IDC_BTN_STARTSTOPSVC);
-        EnableWindow(hWndSvcButton, bEnableButton);
-        if (IsWindowVisible(hWnd)) {
-            SetFocus(hWndSvcButton);
-        }
+        // The Agent status is unknown until it's requested again
+        LoadCachedString((dwCurrentState == SERVICE_STOPPED ? IDS_ERR_NOTRUNNING : IDS_WAIT),
+            monitorState.szAgStatus, ARRAYSIZE(monitorState.szAgStatus));
 
-        // Taskbar icon routine
-        if (svcStatus.dwCurrentState != SERVICE_RUNNING)
+        // Requests in progress can't succeed anymore (a forced inventory
+        // is kept in the outbox, until the service runs again)
+        if (dwCurrentState != SERVICE_RUNNING)
         {
-            if (glpiAgentOk)
-            {
-                LoadIconMetric(hInst, MAKEINTRESOURCE(IDI_GLPIERR), LIM_LARGE, &nid.hIcon);
-                LoadString(hInst, IDS_GLPINOTIFYERROR, nid.szTip, ARRAYSIZE(nid.szTip));
-                nid.szInfo[0] = '\0';
-                Shell_NotifyIcon(NIM_MODIFY, &nid);
-                glpiAgentOk = false;
-            }
+            AgentClientCancel(AGENTREQ_STATUS);
+            if (AgentClientCancel(AGENTREQ_NOW))
+                OnInventoryResult(hWnd, OUTBOX_RETRY);
+            SetInventoryTracking(hWnd, FALSE);
+            bAgentResponding = FALSE;
         }
-        else
-        {
-            if (!glpiAgentOk)
-            {
-                LoadIconMetric(hInst, MAKEINTRESOURCE(IDI_GLPIOK), LIM_LARGE, &nid.hIcon);
-                LoadString(hInst, IDS_GLPINOTIFY, nid.szTip, ARRAYSIZE(nid.szTip));
-                nid.szInfo[0] = '\0';
-                Shell_NotifyIcon(NIM_MODIFY, &nid);
-                glpiAgentOk = true;
-            }
+        else {
+            OutboxWake(&outbox, OUTBOX_ACTION_INVENTORY);
         }
-
-        lastSvcStatus.dwCurrentState = svcStatus.dwCurrentState;
     }
+
+    return bSvcChangedState;
 }
 
-// Updates the main window statuses
-VOID CALLBACK UpdateStatus(HWND hWnd, UINT message, UINT idTimer, DWORD dwTime)
+// Arms a SCM notification for the next Agent service state change
+BOOL StartServiceWatch(HWND hWnd)
 {
-    if (IsWindowVisible(hWnd))
+    return ServiceWatchArm(&svcWatch, monitorState.dwSvcState, hWnd, WMAPP_SVCNOTIFY);
+}
+
+// Adjusts the service status polling interval (see ServiceWatchNextInterval)
+VOID UpdateServicePollInterval(HWND hWnd, BOOL bSvcChangedState)
+{
+    UINT uMaxInterval = (IsStatusShown() ? SVCPOLL_MAX_INTERVAL : SVCPOLL_HIDDEN_MAX_INTERVAL);
+    ServiceWatchNextInterval(&svcWatch, bSvcChangedState, monitorState.dwSvcState, uMaxInterval);
+    ScheduleProbes(hWnd);
+}
+
+// Handles a SCM notification posted by the service watcher
+VOID OnServiceNotify(HWND hWnd, DWORD dwNotificationStatus, LPARAM lParam)
+{
+    DWORD dwState;
+    BOOL bQuerySvcOk = ServiceWatchOnNotify(&svcWatch, dwNotificationStatus, lParam, &dwState);
+    BOOL bSvcChangedState = ApplyServiceStatus(hWnd, bQuerySvcOk, dwState);
+
+    StartServiceWatch(hWnd);
+    UpdateServicePollInterval(hWnd, bSvcChangedState);
+}
+
+// Updates service related statuses (polling fallback for SCM notifications)
+VOID UpdateServiceStatus(HWND hWnd)
+{
+    DWORD dwState;
+    BOOL bQuerySvcOk = ServiceWatchPoll(&svcWatch, &dwState);
+    BOOL bSvcChangedState = ApplyServiceStatus(hWnd, bQuerySvcOk, dwState);
+
+    // Try to (re)arm SCM notifications if they are not active
+    if (!svcWatch.bWatchActive)
+        StartServiceWatch(hWnd);
+
+    UpdateServicePollInterval(hWnd, bSvcChangedState);
+}
+
+// Applies the remote Agents setting to the Agent client endpoints. The remote
+// Agents whose host or port changed are reset, and polled right away.
+VOID ApplyEndpointConfig(HWND hWnd)
+{
+    BOOL bChanged = FALSE;
+
+    AcquireSRWLockShared(&srwSettings);
+    for (DWORD i = 1; i < AGENT_MAX_ENDPOINTS; i++)
     {
-        // Agent version
-        HKEY hk;
-        LONG lRes;
-        WCHAR szKey[MAX_PATH];
-        DWORD dwValue = -1;
-        DWORD dwValueLen = sizeof(dwValue);
-
-        // We can find the agent version under the Installer subkey, value "Version"
-        lRes = RegOpenKeyEx(HKEY_LOCAL_MACHINE, L"SOFTWARE\\GLPI-Agent\\Installer", 0, KEY_READ | KEY_WOW64_64KEY, &hk);
-        if (lRes != ERROR_SUCCESS)
-        {
-            lRes = RegOpenKeyEx(HKEY_LOCAL_MACHINE, L"SOFTWARE\\GLPI-Agent\\Installer", 0, KEY_READ | KEY_WOW64_64KEY, &hk);
-            if (lRes != ERROR_SUCCESS) {
-                LoadString(hInst, IDS_ERR_AGENTNOTFOUND, szBuffer, dwBufferLen);
-                SetDlgItemText(hWnd, IDC_AGENTVER, szBuffer);
-                bAgentInstalled = false;
-            }
+        const EndpointConfig* pCfg = (i <= dwEndpointConfigs ? &endpointConfigs[i - 1] : NULL);
+        EndpointState* pState = &endpointStates[i];
+        if (i > dwRemoteEndpoints ? pCfg == NULL :
+            (pCfg != NULL && pCfg->dwPort == pState->config.dwPort && wcscmp(pCfg->szHost, pState->config.szHost) == 0))
+            continue;
+
+        AgentClientCancel(AGENTREQ_STATUS, i);
+        AgentClientSetEndpoint(i, (pCfg != NULL ? pCfg->szHost : NULL), (pCfg != NULL ? pCfg->dwPort : 0));
+        ZeroMemory(pState, sizeof(EndpointState));
+        if (pCfg != NULL) {
+            pState->config = *pCfg;
+            pState->bResponding = TRUE;
         }
-        if (lRes == ERROR_SUCCESS)
-        {
-            WCHAR szValue[128] = {};
-            DWORD szValueLen = sizeof(szValue);
-            lRes = RegQueryValueEx(hk, L"Version", 0, NULL, (LPBYTE)szValue, &szValueLen);
-            if (lRes != ERROR_SUCCESS)
-                LoadString(hInst, IDS_ERR_AGENTVERNOTFOUND, szBuffer, dwBufferLen);
-            else
-                wsprintf(szBuffer, L"GLPI Agent %s", szValue);
-            SetDlgItemText(hWnd, IDC_AGENTVER, szBuffer);
-            bAgentInstalled = true;
+        bChanged = TRUE;
+    }
+    dwRemoteEndpoints = dwEndpointConfigs;
+    ReleaseSRWLockShared(&srwSettings);
+
+    if (bChanged) {
+        UpdateEndpointSummary();
+        ScheduleProbes(hWnd);
+        SchedulerRunNow(&probeScheduler, PROBE_ENDPOINTS);
+        ScheduleProbes(hWnd);
+    }
+}
+
+// Serves the metrics on the port set in the Monitor settings (if any). The
+// setting is machine-wide and a single process can bind the port, so when the
+// Monitors of several sessions share the status only the leader serves them.
+VOID ApplyMetricsConfig()
+{
+    AcquireSRWLockShared(&srwSettings);
+    DWORD dwPort = dwMetricsPort;
+    ReleaseSRWLockShared(&srwSettings);
+    if (sharedStatus.pBlock != NULL && !sharedStatus.bLeader)
+        dwPort = 0;
+    MetricsServerStart(dwPort);
+}
+
+// Refreshes the cached registry values after a change notification
+VOID OnRegistryChange(HWND hWnd, int nWatch)
+{
+    // Re-arm the notification first, so no change is missed
+    RegConfigArmWatch(&regConfig, nWatch);
+    LONGLONG llStart = MetricsNow();
+
+    if (nWatch == REGWATCH_AGENT)
+    {
+        RegConfigReadVersion(&regConfig, &monitorState.config);
+
+        // Reconnect to the Agent if its HTTPD port was changed
+        UINT uErrResId;
+        DWORD dwOldPort = dwAgentPort;
+        AcquireSRWLockExclusive(&srwSettings);
+        LONG lRes = LoadAgentSettings(&uErrResId);
+        LoadMonitorSettings();
+        ReleaseSRWLockExclusive(&srwSettings);
+        if (lRes == ERROR_SUCCESS && dwAgentPort != dwOldPort)
+            AgentClientSetPort(dwAgentPort);
+        ApplyEndpointConfig(hWnd);
+        ApplyMetricsConfig();
+    }
+    else
+    {
+        RegConfigReadStartType(&regConfig, &monitorState.config);
+    }
+    MetricsObserveSince(HIST_REGISTRY_READ, llStart);
+}
+
+// Re-reads the registry values whose change notifications couldn't be armed
+VOID PollRegistry(HWND hWnd)
+{
+    for (int nWatch = 0; nWatch < REGWATCH_COUNT; nWatch++) {
+        if (!RegConfigIsWatched(&regConfig, nWatch))
+            OnRegistryChange(hWnd, nWatch);
+    }
+}
+
+// Scans a mapped logfile chunk (see FeedLogIndex, the file may be truncated
+// while it's mapped)
+size_t ScanLogView(const CHAR* pData, size_t cbData, BOOL bEnd)
+{
+    __try {
+        return LogScanFeed(&logScanState, pData, cbData, bEnd);
+    }
+    __except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH) {
+        return 0;
+    }
+}
+
+// Stops the rotated Agent log segments scan
+VOID CloseLogArchive()
+{
+    if (pLogScanArchive != NULL) {
+        LogStreamClose(pLogScanArchive);
+        delete[] pLogScanArchiveBuf;
+        pLogScanArchive = NULL;
+        pLogScanArchiveBuf = NULL;
+    }
+}
+
+// Opens the rotated segments of the Agent logfile to be scanned before it
+VOID OpenLogArchive(LPCWSTR szFile)
+{
+    CloseLogArchive();
+    pLogScanArchive = LogStreamOpen(szFile, FALSE);
+    if (pLogScanArchive->segments.empty()) {
+        LogStreamClose(pLogScanArchive);
+        pLogScanArchive = NULL;
+        return;
+    }
+    pLogScanArchiveBuf = new CHAR[LOGSCAN_ARCHIVE_CHUNK];
+    cbLogScanArchiveCarry = 0;
+    logScanArchiveState = {};
+    logScanArchiveCheckpoint = {};
+}
+
+// Scans the next chunk of the rotated Agent log segments (the compressed ones
+// are decompressed ahead on the thread pool). Returns FALSE once they're all
+// scanned.
+BOOL ScanLogArchive()
+{
+    size_t cbRead = LogStreamRead(pLogScanArchive, pLogScanArchiveBuf + cbLogScanArchiveCarry,
+        LOGSCAN_ARCHIVE_CHUNK - cbLogScanArchiveCarry);
+    size_t cbData = cbLogScanArchiveCarry + cbRead;
+    if (cbRead > 0) {
+        size_t cbScanned = LogScanFeed(&logScanArchiveState, pLogScanArchiveBuf, cbData, FALSE);
+        cbLogScanArchiveCarry = cbData - cbScanned;
+        memmove(pLogScanArchiveBuf, pLogScanArchiveBuf + cbScanned, cbLogScanArchiveCarry);
+        return TRUE;
+    }
+
+    // Segment end: its last lines are scanned, unless its decompression failed.
+    // What was scanned from it is dropped then, as it may be cut or garbage.
+    int nInflateRes;
+    BOOL bMore = LogStreamNextSegment(pLogScanArchive, &nInflateRes);
+    if (nInflateRes == INFLATE_OK) {
+        LogScanFeed(&logScanArchiveState, pLogScanArchiveBuf, cbData, TRUE);
+        logScanArchiveCheckpoint = logScanArchiveState;
+    }
+    else {
+        logScanArchiveState = logScanArchiveCheckpoint;
+    }
+    cbLogScanArchiveCarry = 0;
+    return bMore;
+}
+
+// Scans the Agent logfile for the last inventory run, from where the previous
+// scan stopped (the whole file is scanned again if it was changed, rotated or
+// truncated, after its rotated segments so that an inventory logged before
+// the rotation is still found). At most LOGSCAN_MAX_CHUNK bytes are mapped
+// per run (LOGSCAN_ARCHIVE_CHUNK for the rotated segments), the rest is left
+// for the next runs, scheduled right away.
+VOID ScanAgentLog()
+{
+    WCHAR szFile[MAX_PATH];
+    AcquireSRWLockShared(&srwSettings);
+    wcscpy_s(szFile, szLogfile);
+    ReleaseSRWLockShared(&srwSettings);
+
+    bLogScanPending = FALSE;
+    HANDLE hFile = CreateFile(szFile, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        CloseLogArchive();
+        monitorState.dwLastInvState = LASTINV_UNKNOWN;
+        monitorState.dwLastInvErrors = 0;
+        return;
+    }
+
+    BY_HANDLE_FILE_INFORMATION fi;
+    LARGE_INTEGER liSize;
+    if (!GetFileInformationByHandle(hFile, &fi) || !GetFileSizeEx(hFile, &liSize)) {
+        CloseHandle(hFile);
+        return;
+    }
+    ULONGLONG ullSize = liSize.QuadPart;
+    if (wcscmp(szFile, szLogScanFile) != 0 || fi.dwVolumeSerialNumber != logScanFileInfo.dwVolumeSerialNumber ||
+        fi.nFileIndexHigh != logScanFileInfo.nFileIndexHigh || fi.nFileIndexLow != logScanFileInfo.nFileIndexLow ||
+        ullSize < logScanState.ullScanned) {
+        wcscpy_s(szLogScanFile, szFile);
+        logScanFileInfo = fi;
+        logScanState = {};
+        OpenLogArchive(szFile);
+    }
+
+    // The logfile scan continues the rotated segments one
+    if (pLogScanArchive != NULL) {
+        if (ScanLogArchive()) {
+            bLogScanPending = TRUE;
+            CloseHandle(hFile);
+            return;
+        }
+        logScanState = logScanArchiveState;
+        logScanState.ullScanned = 0;
+        CloseLogArchive();
+    }
+
+    HANDLE hMapping = (ullSize > logScanState.ullScanned ? CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL) : NULL);
+    if (hMapping != NULL)
+    {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        ULONGLONG ullViewStart = logScanState.ullScanned - logScanState.ullScanned % si.dwAllocationGranularity;
+        SIZE_T cbView = (SIZE_T)min(ullSize - ullViewStart, (ULONGLONG)LOGSCAN_MAX_CHUNK);
+        const CHAR* pView = (const CHAR*)MapViewOfFile(hMapping, FILE_MAP_READ, (DWORD)(ullViewStart >> 32), (DWORD)ullViewStart, cbView);
+        if (pView != NULL) {
+            size_t cbSkip = (size_t)(logScanState.ullScanned - ullViewStart);
+            size_t cbScanned = ScanLogView(pView + cbSkip, cbView - cbSkip, (ullViewStart + cbView == ullSize));
+            UnmapViewOfFile(pView);
+            bLogScanPending = (cbScanned > 0 && ullViewStart + cbView < ullSize);
         }
+        CloseHandle(hMapping);
+    }
+    CloseHandle(hFile);
 
+    if (!logScanState.bInventoryFound)
+        monitorState.dwLastInvState = LASTINV_UNKNOWN;
+    else
+        monitorState.dwLastInvState = (logScanState.dwInventoryErrors > 0 ? LASTINV_FAILED : LASTINV_OK);
+    monitorState.dwLastInvErrors = logScanState.dwInventoryErrors;
+}
 
-        // Startup type
-        wsprintf(szKey, L"SYSTEM\\CurrentControlSet\\Services\\%s", SERVICE_NAME);
-        lRes = RegOpenKeyEx(HKEY_LOCAL_MACHINE, szKey, 0, KEY_READ | KEY_WOW64_64KEY, &hk);
-        if (lRes == ERROR_SUCCESS)
-        {
-            lRes = RegQueryValueEx(hk, L"Start", 0, NULL, (LPBYTE)&dwValue, &dwValueLen);
-            if (lRes == ERROR_SUCCESS)
-            {
-                switch (dwValue)
-                {
-                    case SERVICE_BOOT_START:
-                        LoadString(hInst, IDS_SVCSTART_BOOT, szBuffer, dwBufferLen);
-                        break;
-                    case SERVICE_SYSTEM_START:
-                        LoadString(hInst, IDS_SVCSTART_SYSTEM, szBuffer, dwBufferLen);
-                        break;
-                    case SERVICE_AUTO_START:
-                    {
-                        lRes = RegQueryValueEx(hk, L"DelayedAutostart", 0, NULL, (LPBYTE)&dwValue, &dwValueLen);
-                        if (lRes == ERROR_SUCCESS)
-                            LoadString(hInst, IDS_SVCSTART_DELAYEDAUTO, szBuffer, dwBufferLen);
-                        else
-                            LoadString(hInst, IDS_SVCSTART_AUTO, szBuffer, dwBufferLen);
-                        break;
-                    }
-                    case SERVICE_DEMAND_START:
-                        LoadString(hInst, IDS_SVCSTART_MANUAL, szBuffer, dwBufferLen);
-                        break;
-                    case SERVICE_DISABLED:
-                        LoadString(hInst, IDS_SVCSTART_DISABLED, szBuffer, dwBufferLen);
-                        break;
-                    default:
-                        LoadString(hInst, IDS_ERR_UNKSVCSTART, szBuffer, dwBufferLen);
-                }
-                SetDlgItemText(hWnd, IDC_STARTTYPE, szBuffer);
-            }
-            else
-            {
-                LoadString(hInst, IDS_ERR_UNKSVCSTART, szBuffer, dwBufferLen);
-                SetDlgItemText(hWnd, IDC_STARTTYPE, szBuffer);
+// Scheduler timer callback, runs the probes that are due
+VOID CALLBACK RunScheduledProbes(HWND hWnd, UINT message, UINT idTimer, DWORD dwTime)
+{
+    LONGLONG llStart = MetricsNow();
+    DWORD dwProbes = SchedulerTakeDueProbes(&probeScheduler);
+
+    if (dwProbes & (1 << PROBE_SERVICE))
+        UpdateServiceStatus(hWnd);
+    // Before the Agent probe, which followers skip
+    if (dwProbes & (1 << PROBE_SHARED))
+        SyncSharedStatus(hWnd);
+    if (dwProbes & (1 << PROBE_REGISTRY))
+        PollRegistry(hWnd);
+    // If the service is not running, the status will
+    // be replaced by UpdateServiceStatus
+    if (dwProbes & (1 << PROBE_AGENT))
+        GetAgentStatus(hWnd);
+    if (dwProbes & (1 << PROBE_ENDPOINTS))
+        PollEndpoints(hWnd);
+    if (dwProbes & (1 << PROBE_LOGSCAN))
+        ScanAgentLog();
+    if (dwProbes & (1 << PROBE_OUTBOX))
+        ReplayOutbox(hWnd);
+
+    ScheduleProbes(hWnd);
+    MetricsObserveSince(HIST_PROBE_RUN, llStart);
+    PublishStatus();
+}
+
+// Sets the probe intervals from the current state and re-arms the scheduler timer:
+// - Service: see UpdateServicePollInterval
+// - Agent: only while the main window is shown (backing off while the status is
+//   steady) or a forced inventory is tracked, and the service is running. The
+//   leader also polls while a follower shows the status, and followers don't.
+// - Registry: only while the main window is shown and notifications are unavailable
+// - Remote Agents: at a fixed interval, while any is configured
+// - Agent logfile: only while the main window is shown, right away while the
+//   scan is catching up with the logfile
+// - Outbox: once an action can be replayed (see OutboxGetWait)
+// - Shared status: see SyncSharedStatus
+VOID ScheduleProbes(HWND hWnd)
+{
+    BOOL bVisible = IsStatusShown();
+
+    UINT uAgentInterval = 0;
+    if (monitorState.dwSvcState == SERVICE_RUNNING && !UsesSharedStatus()) {
+        if (bInventoryTracking)
+            uAgentInterval = AGENTPOLL_INVENTORY_INTERVAL;
+        else if (bVisible || bSharedDemand)
+            uAgentInterval = uAgentPollInterval;
+    }
+
+    UINT uSharedInterval = 0;
+    if (sharedStatus.pBlock != NULL) {
+        if (sharedStatus.bLeader)
+            uSharedInterval = SHAREDSTATUS_LEADER_INTERVAL;
+        else
+            uSharedInterval = (bVisible ? SHAREDSTATUS_READ_INTERVAL : SHAREDSTATUS_ELECT_INTERVAL);
+    }
+
+    UINT uRegInterval = 0;
+    if (bVisible && (!RegConfigIsWatched(&regConfig, REGWATCH_AGENT) || !RegConfigIsWatched(&regConfig, REGWATCH_SERVICE)))
+        uRegInterval = REGPOLL_INTERVAL;
+
+    SchedulerSetInterval(&probeScheduler, PROBE_SERVICE, svcWatch.uPollInterval);
+    SchedulerSetInterval(&probeScheduler, PROBE_AGENT, uAgentInterval);
+    SchedulerSetInterval(&probeScheduler, PROBE_REGISTRY, uRegInterval);
+    SchedulerSetInterval(&probeScheduler, PROBE_ENDPOINTS, (dwRemoteEndpoints > 0 ? ENDPOINTPOLL_INTERVAL : 0));
+    SchedulerSetInterval(&probeScheduler, PROBE_LOGSCAN, (bVisible ? (bLogScanPending ? USER_TIMER_MINIMUM : LOGSCAN_INTERVAL) : 0));
+    DWORD dwOutboxWait = OutboxGetWait(&outbox, GetOutboxReplayMask());
+    SchedulerSetInterval(&probeScheduler, PROBE_OUTBOX, (dwOutboxWait == INFINITE ? 0 : max(dwOutboxWait, USER_TIMER_MINIMUM)));
+    SchedulerSetInterval(&probeScheduler, PROBE_SHARED, uSharedInterval);
+
+    DWORD dwWait = SchedulerGetWait(&probeScheduler);
+    if (dwWait == INFINITE)
+        KillTimer(hWnd, IDT_SCHEDULER);
+    else
+        SetTimer(hWnd, IDT_SCHEDULER, max(dwWait, USER_TIMER_MINIMUM), (TIMERPROC)RunScheduledProbes);
+}
+
+// Updates the statuses right away (i.e. when the main window is shown)
+VOID UpdateStatus(HWND hWnd)
+{
+    uAgentPollInterval = AGENTPOLL_MIN_INTERVAL;
+    ScheduleProbes(hWnd);
+    SchedulerRunNow(&probeScheduler, PROBE_AGENT);
+    SchedulerRunNow(&probeScheduler, PROBE_SHARED);
+    SchedulerRunNow(&probeScheduler, PROBE_REGISTRY);
+    SchedulerRunNow(&probeScheduler, PROBE_LOGSCAN);
+
+    RunScheduledProbes(hWnd, NULL, NULL, NULL);
+}
+
+// Retrieves a message like GetMessage does, but waits in an alertable state
+// so that the APCs queued to this thread (SCM notifications) can run.
+// Registry change notifications are also forwarded to the given window.
+BOOL GetMessageAlertable(LPMSG lpMsg, HWND hWnd)
+{
+    while (!PeekMessage(lpMsg, NULL, 0, 0, PM_REMOVE))
+    {
+        HANDLE hEvents[REGWATCH_COUNT];
+        int nWatches[REGWATCH_COUNT];
+        DWORD dwEvents = 0;
+        for (int nWatch = 0; nWatch < REGWATCH_COUNT; nWatch++) {
+            if (regConfig.hWatchEvents[nWatch] != NULL) {
+                hEvents[dwEvents] = regConfig.hWatchEvents[nWatch];
+                nWatches[dwEvents++] = nWatch;
             }
         }
-        else
+
+        DWORD dwRes = MsgWaitForMultipleObjectsEx(dwEvents, hEvents, INFINITE, QS_ALLINPUT, MWMO_ALERTABLE | MWMO_INPUTAVAILABLE);
+        if (dwRes >= WAIT_OBJECT_0 && dwRes < WAIT_OBJECT_0 + dwEvents)
+            PostMessage(hWnd, WMAPP_REGNOTIFY, nWatches[dwRes - WAIT_OBJECT_0], 0);
+    }
+    return lpMsg->message != WM_QUIT;
+}
+
+// Builds the path of a Monitor data file, kept in the user's local app data
+// folder, or in the ProgramData folder for the files shared by every user
+// (created if needed)
+BOOL GetMonitorDataPath(REFKNOWNFOLDERID folderId, LPCWSTR szName, LPWSTR szPath, DWORD cchPath)
+{
+    PWSTR szAppData = NULL;
+    HRESULT hr = SHGetKnownFolderPath(folderId, 0, NULL, &szAppData);
+    if (FAILED(hr)) {
+        CoTaskMemFree(szAppData);
+        return FALSE;
+    }
+
+    int cchFolder = _snwprintf_s(szPath, cchPath, _TRUNCATE, L"%s\\%s\\Monitor", szAppData, SERVICE_NAME);
+    CoTaskMemFree(szAppData);
+    if (cchFolder < 0)
+        return FALSE;
+    SHCreateDirectoryEx(NULL, szPath, NULL);
+    return _snwprintf_s(szPath + cchFolder, cchPath - cchFolder, _TRUNCATE, L"\\%s", szName) > 0;
+}
+
+// Opens the status history file
+VOID OpenStatusHistory()
+{
+    WCHAR szPath[MAX_PATH];
+    if (GetMonitorDataPath(FOLDERID_LocalAppData, L"history.dat", szPath, ARRAYSIZE(szPath)))
+        HistoryOpen(szPath);
+}
+
+// Opens the outbox and loads its journal (its actions are replayed once
+// possible). It's only used along with the main window.
+VOID OpenOutbox()
+{
+    OutboxInit(&outbox, NULL);
+    WCHAR szPath[MAX_PATH];
+    if (!bHeadless && GetMonitorDataPath(FOLDERID_LocalAppData, L"outbox.dat", szPath, ARRAYSIZE(szPath)))
+        OutboxOpen(&outbox, szPath);
+}
+
+// Opens the status shared with the Monitors of the other sessions. The first
+// Monitor able to write it takes the lead on its first shared status probe.
+VOID OpenSharedStatus()
+{
+    WCHAR szPath[MAX_PATH];
+    WCHAR szDemandPath[MAX_PATH];
+    if (!bHeadless && GetMonitorDataPath(FOLDERID_ProgramData, L"status.shm", szPath, ARRAYSIZE(szPath)) &&
+        GetMonitorDataPath(FOLDERID_ProgramData, L"status-demand.shm", szDemandPath, ARRAYSIZE(szDemandPath)))
+        SharedStatusOpen(&sharedStatus, szPath, szDemandPath);
+}
+
+// Records the service state and Agent status transitions to the status history
+// (the current ones are recorded again when the Monitor is started)
+VOID RecordStatusHistory()
+{
+    DWORD dwSvcState = (monitorState.bSvcQueryOk ? monitorState.dwSvcState : 0);
+    if (!bHistoryRecorded || dwSvcState != dwHistorySvcState) {
+        HistoryAppend(HISTORY_SERVICE, dwSvcState);
+        dwHistorySvcState = dwSvcState;
+    }
+    if (!bHistoryRecorded || wcscmp(monitorState.szAgStatus, szHistoryAgStatus) != 0) {
+        HistoryAppendString(HISTORY_AGENTSTATUS, monitorState.szAgStatus);
+        wcscpy_s(szHistoryAgStatus, monitorState.szAgStatus);
+    }
+    bHistoryRecorded = TRUE;
+}
+
+// Publishes a snapshot of the monitor state to the main window, unless nothing
+// changed since the last one published. If the main window lags behind and the
+// channel is full, publishing is retried shortly.
+VOID PublishStatus()
+{
+    RecordStatusHistory();
+    if (publishedSnapshot.dwVersion != 0 && MonitorSnapshotDiff(&publishedSnapshot, &monitorState) == 0)
+        return;
+
+    monitorState.dwVersion = publishedSnapshot.dwVersion + 1;
+    if (!snapshotChannel.Push(monitorState)) {
+        SetTimer(hProbeWnd, IDT_PUBLISH, PUBLISH_RETRY_INTERVAL, NULL);
+        return;
+    }
+    publishedSnapshot = monitorState;
+    MetricsIncrement(CNT_SNAPSHOTS);
+    MetricsSetGauge(GAUGE_SERVICE_STATE, monitorState.bSvcQueryOk ? monitorState.dwSvcState : 0);
+    MetricsSetGauge(GAUGE_AGENT_OK, monitorState.bAgentOk);
+    MetricsSetGauge(GAUGE_ENDPOINTS, monitorState.dwEndpoints);
+    MetricsSetGauge(GAUGE_ENDPOINTS_UP, monitorState.dwEndpointsResponding);
+
+    // Only one message is queued at a time, the main window takes all the published snapshots
+    if (InterlockedExchange(&lStatusPosted, 1) == 0 && !PostMessage(hMainWnd, WMAPP_STATUS, 0, 0))
+        InterlockedExchange(&lStatusPosted, 0);
+}
+
+// Probe worker thread. It owns the probe window, which receives the SCM and registry
+// notifications, the Agent responses and the scheduler timer. The ready event is
+// signaled once the probe window is created (or failed to be).
+DWORD WINAPI ProbeThreadProc(LPVOID lpParam)
+{
+    HANDLE hReady = (HANDLE)lpParam;
+
+    WNDCLASSEX wcex = { sizeof(WNDCLASSEX) };
+    wcex.lpfnWndProc = ProbeWndProc;
+    wcex.hInstance = hInst;
+    wcex.lpszClassName = PROBE_WNDCLASS;
+    RegisterClassEx(&wcex);
+    hProbeWnd = CreateWindowEx(0, PROBE_WNDCLASS, NULL, 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, hInst, NULL);
+    DWORD dwErr = (hProbeWnd == NULL ? GetLastError() : ERROR_SUCCESS);
+    SetEvent(hReady);
+    if (dwErr != ERROR_SUCCESS)
+        return dwErr;
+
+    LONGLONG llPhaseStart = MetricsNow();
+    OpenStatusHistory();
+    OpenOutbox();
+    OpenSharedStatus();
+    MetricsStartupPhase(STARTUP_PROBESTORES, llPhaseStart);
+    llPhaseStart = MetricsNow();
+
+    // Read the Agent config snapshot and watch for registry changes
+    RegConfigArmWatch(&regConfig, REGWATCH_AGENT);
+    RegConfigArmWatch(&regConfig, REGWATCH_SERVICE);
+    RegConfigReadVersion(&regConfig, &monitorState.config);
+    RegConfigReadStartType(&regConfig, &monitorState.config);
+    LoadCachedString(IDS_LOADING, monitorState.szAgStatus, ARRAYSIZE(monitorState.szAgStatus));
+
+    // A single timer drives all the probes (service status changes are notified by the SCM
+    // and registry changes by the registry, their probes are only a fallback)
+    SchedulerInit(&probeScheduler, NULL);
+    ApplyEndpointConfig(hProbeWnd);
+    ApplyMetricsConfig();
+    UpdateServiceStatus(hProbeWnd);
+    UpdateStatus(hProbeWnd);
+    PublishStatus();
+    MetricsStartupPhase(STARTUP_FIRSTSTATUS, llPhaseStart);
+
+    // Probe worker message loop
+    MSG msg;
+    while (GetMessageAlertable(&msg, hProbeWnd))
+        DispatchMessage(&msg);
+
+    MetricsServerStop();
+    CloseLogArchive();
+    HistoryClose();
+    OutboxClose(&outbox);
+    SharedStatusClose(&sharedStatus);
+    ServiceWatchClose(&svcWatch);
+    RegConfigCloseWatches(&regConfig);
+    return (DWORD)msg.wParam;
+}
+
+// Returns how the service status of a snapshot is displayed
+const SvcStateDisplay* GetSvcStateDisplay(const MonitorSnapshot* pSnapshot)
+{
+    if (pSnapshot->bSvcQueryOk) {
+        for (size_t i = 0; i < ARRAYSIZE(svcStateDisplays); i++) {
+            if (svcStateDisplays[i].dwState == pSnapshot->dwSvcState)
+                return &svcStateDisplays[i];
+        }
+    }
+    return &svcStateDisplayError;
+}
+
+// Formats a status history entry time (local time, user's locale)
+VOID FormatHistoryTime(const HistoryEntry* pEntry, LPWSTR szTime, int cchTime)
+{
+    ULARGE_INTEGER uli;
+    uli.QuadPart = pEntry->ullTime * 10000000;
+    FILETIME ft = { uli.LowPart, uli.HighPart };
+    SYSTEMTIME stUtc, stLocal;
+    FileTimeToSystemTime(&ft, &stUtc);
+    SystemTimeToTzSpecificLocalTime(NULL, &stUtc, &stLocal);
+
+    int cchDate = GetDateFormatEx(LOCALE_NAME_USER_DEFAULT, DATE_SHORTDATE, &stLocal, NULL, szTime, cchTime, NULL);
+    if (cchDate == 0) {
+        szTime[0] = '\0';
+        return;
+    }
+    if (cchDate >= cchTime)
+        return;
+    szTime[cchDate - 1] = ' ';
+    if (GetTimeFormatEx(LOCALE_NAME_USER_DEFAULT, 0, &stLocal, NULL, szTime + cchDate, cchTime - cchDate) == 0)
+        szTime[cchDate - 1] = '\0';
+}
+
+// Formats a status history entry event
+VOID FormatHistoryEvent(const HistoryEntry* pEntry, LPWSTR szEvent, int cchEvent)
+{
+    WCHAR szFormat[128];
+    WCHAR szValue[256];
+    WCHAR szLine[512];
+
+    switch (pEntry->wType)
+    {
+        case HISTORY_SERVICE:
         {
-            LoadString(hInst, IDS_ERR_REGFAIL, szBuffer, dwBufferLen);
-            SetDlgItemText(hWnd, IDC_STARTTYPE, szBuffer);
+            MonitorSnapshot snapshot = {};
+            snapshot.bSvcQueryOk = (pEntry->wValue != 0);
+            snapshot.dwSvcState = pEntry->wValue;
+            LoadCachedString(IDS_HISTORY_SERVICE, szFormat, ARRAYSIZE(szFormat));
+            LoadCachedString(GetSvcStateDisplay(&snapshot)->uLabelResId, szValue, ARRAYSIZE(szValue));
+            wsprintf(szLine, szFormat, szValue);
+            break;
         }
+        case HISTORY_AGENTSTATUS:
+            LoadCachedString(IDS_HISTORY_AGENTSTATUS, szFormat, ARRAYSIZE(szFormat));
+            if (!HistoryGetString(pEntry->wValue, szValue, ARRAYSIZE(szValue)))
+                wcscpy_s(szValue, L"?");
+            wsprintf(szLine, szFormat, szValue);
+            break;
+        case HISTORY_AGENTERROR:
+        case HISTORY_AGENTHTTP:
+            LoadCachedString((pEntry->wType == HISTORY_AGENTERROR ? IDS_HISTORY_AGENTERROR : IDS_HISTORY_AGENTHTTP),
+                szFormat, ARRAYSIZE(szFormat));
+            wsprintf(szLine, szFormat, pEntry->wValue);
+            break;
+        default:
+            szLine[0] = '\0';
+    }
+    wcsncpy_s(szEvent, cchEvent, szLine, _TRUNCATE);
+}
 
-        RegCloseKey(hk);
+// Notifies the log viewer that lines were indexed (a single message is pending
+// at once, the viewer picks up all the lines indexed meanwhile)
+VOID PostLogIndexed()
+{
+    if (InterlockedExchange(&lLogIndexPosted, 1) == 0 && !PostMessage(hLogsWnd, WMAPP_LOGINDEXED, 0, 0))
+        InterlockedExchange(&lLogIndexPosted, 0);
+}
+
+// Clears the log index, when the logfile was truncated or replaced
+VOID ResetLogIndex()
+{
+    AcquireSRWLockExclusive(&srwLogIndex);
+    LogIndexFree(&logIndex);
+    ReleaseSRWLockExclusive(&srwLogIndex);
+    InterlockedExchange(&lLogIndexReset, 1);
+    PostLogIndexed();
+}
+
+// Opens the logfile, allowing the Agent to keep writing, rotating or deleting it
+HANDLE OpenLogfile()
+{
+    return CreateFile(szLogViewFile, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+// Checks if the logfile path still refers to an open file (FALSE if it was
+// rotated or replaced since, TRUE if that can't be told)
+BOOL IsSameLogfile(HANDLE hFile)
+{
+    HANDLE hPathFile = CreateFile(szLogViewFile, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hPathFile == INVALID_HANDLE_VALUE)
+        return TRUE;
+    BY_HANDLE_FILE_INFORMATION fiOpen, fiPath;
+    BOOL bSame = TRUE;
+    if (GetFileInformationByHandle(hFile, &fiOpen) && GetFileInformationByHandle(hPathFile, &fiPath))
+        bSame = (fiOpen.dwVolumeSerialNumber == fiPath.dwVolumeSerialNumber &&
+            fiOpen.nFileIndexHigh == fiPath.nFileIndexHigh && fiOpen.nFileIndexLow == fiPath.nFileIndexLow);
+    CloseHandle(hPathFile);
+    return bSame;
+}
+
+// Indexes a mapped logfile slice. The file may be truncated while it's mapped,
+// in which case reading the pages gone fails and nothing more is indexed.
+size_t FeedLogIndex(const CHAR* pData, size_t cbData, BOOL bEndLine)
+{
+    __try {
+        return LogIndexFeed(&logIndex, pData, cbData, bEndLine);
+    }
+    __except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH) {
+        return 0;
+    }
+}
 
-        // Update agent status
-        // If the service is not running, the status will
-        // be replaced by UpdateServiceStatus
-        if (svcStatus.dwCurrentState == SERVICE_RUNNING) {
-            GetAgentStatus(hWnd);
+// Indexes the lines appended to the logfile since the last call, mapping the
+// new data by views. Returns FALSE if the file is now shorter than what was
+// indexed (truncated).
+BOOL IndexLogfile(HANDLE hFile)
+{
+    LARGE_INTEGER liSize;
+    if (!GetFileSizeEx(hFile, &liSize))
+        return TRUE;
+    ULONGLONG ullSize = liSize.QuadPart;
+    ULONGLONG ullIndexed = logIndex.ullIndexed;
+    if (ullSize < ullIndexed)
+        return FALSE;
+    if (ullSize == ullIndexed)
+        return TRUE;
+
+    HANDLE hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hMapping == NULL)
+        return TRUE;
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+
+    while (ullIndexed < ullSize && WaitForSingleObject(hLogTailStop, 0) == WAIT_TIMEOUT)
+    {
+        ULONGLONG ullViewStart = ullIndexed - ullIndexed % si.dwAllocationGranularity;
+        SIZE_T cbView = (SIZE_T)min(ullSize - ullViewStart, (ULONGLONG)LOGTAIL_VIEW_SIZE);
+        const CHAR* pView = (const CHAR*)MapViewOfFile(hMapping, FILE_MAP_READ, (DWORD)(ullViewStart >> 32), (DWORD)ullViewStart, cbView);
+        if (pView == NULL)
+            break;
+
+        // The view is fed by slices, so the list is never kept waiting long on the
+        // index. A line that doesn't fit in a view is split at its end.
+        const CHAR* pViewData = pView + (ullIndexed - ullViewStart);
+        const CHAR* pData = pViewData;
+        const CHAR* pEnd = pView + cbView;
+        while (pData < pEnd)
+        {
+            size_t cbSlice = min((size_t)(pEnd - pData), (size_t)LOGTAIL_FEED_SIZE);
+            AcquireSRWLockExclusive(&srwLogIndex);
+            size_t cbFed = FeedLogIndex(pData, cbSlice, FALSE);
+            if (cbFed == 0 && cbSlice < (size_t)(pEnd - pData))
+                cbFed = FeedLogIndex(pData, pEnd - pData, FALSE);
+            if (cbFed == 0 && pData == pViewData && cbView == LOGTAIL_VIEW_SIZE)
+                cbFed = FeedLogIndex(pData, pEnd - pData, TRUE);
+            ReleaseSRWLockExclusive(&srwLogIndex);
+            if (cbFed == 0)
+                break;
+            pData += cbFed;
         }
+        UnmapViewOfFile(pView);
+
+        // Stop at the incomplete last line (or a page that couldn't be read)
+        if (logIndex.ullIndexed == ullIndexed)
+            break;
+        ullIndexed = logIndex.ullIndexed;
+        PostLogIndexed();
     }
+    CloseHandle(hMapping);
+    return TRUE;
 }
 
-// EnumWindows callback
-// (called by EnumWindows to find the hWnd for the running GLPI Agent Monitor instance)
-BOOL CALLBACK EnumWindowsProc(HWND hWnd, LPARAM lParam)
+// Log tailer thread: indexes the logfile, then the lines appended to it until
+// the log viewer is closed, starting over when the file is rotated
+DWORD WINAPI LogTailThreadProc(LPVOID lpParam)
 {
-    EnumWindowsData& ed = *(EnumWindowsData*)lParam;
-    DWORD dwPID = 0x0;
-    GetWindowThreadProcessId(hWnd, &dwPID);
-    if (ed.dwSearchPID == dwPID)
+    // The logfile directory changes wake the tailer up, the polling catches the
+    // writes NTFS only reports when the Agent closes the file
+    WCHAR szLogDir[MAX_PATH];
+    wcscpy_s(szLogDir, szLogViewFile);
+    PathRemoveFileSpec(szLogDir);
+    HANDLE hChange = FindFirstChangeNotification(szLogDir, FALSE,
+        FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+
+    for (;;)
     {
-        ed.hWndFound = hWnd;
-        SetLastError(ERROR_SUCCESS);
+        if (hFile != INVALID_HANDLE_VALUE && !IsSameLogfile(hFile)) {
+            CloseHandle(hFile);
+            hFile = INVALID_HANDLE_VALUE;
+            ResetLogIndex();
+        }
+        if (hFile == INVALID_HANDLE_VALUE)
+            hFile = OpenLogfile();
+        if (hFile != INVALID_HANDLE_VALUE && !IndexLogfile(hFile)) {
+            ResetLogIndex();
+            IndexLogfile(hFile);
+        }
+
+        HANDLE hWaitHandles[2] = { hLogTailStop, hChange };
+        DWORD dwRes = WaitForMultipleObjects((hChange != INVALID_HANDLE_VALUE ? 2 : 1), hWaitHandles, FALSE, LOGTAIL_POLL_INTERVAL);
+        if (dwRes == WAIT_OBJECT_0 || dwRes == WAIT_FAILED)
+            break;
+        if (dwRes == WAIT_OBJECT_0 + 1)
+            FindNextChangeNotification(hChange);
+    }
+
+    if (hFile != INVALID_HANDLE_VALUE)
+        CloseHandle(hFile);
+    if (hChange != INVALID_HANDLE_VALUE)
+        FindCloseChangeNotification(hChange);
+    return 0;
+}
+
+// Starts indexing the Agent logfile for the log viewer
+BOOL StartLogTailer(HWND hWnd)
+{
+    AcquireSRWLockShared(&srwSettings);
+    wcscpy_s(szLogViewFile, szLogfile);
+    ReleaseSRWLockShared(&srwSettings);
+
+    hLogReadFile = OpenLogfile();
+    if (hLogReadFile == INVALID_HANDLE_VALUE)
         return FALSE;
+
+    hLogsWnd = hWnd;
+    LogIndexInit(&logIndex);
+    lLogIndexPosted = 0;
+    lLogIndexReset = 0;
+    hLogTailStop = CreateEvent(NULL, TRUE, FALSE, NULL);
+    hLogTailThread = CreateThread(NULL, 0, LogTailThreadProc, NULL, 0, NULL);
+    return TRUE;
+}
+
+// Stops the log tailer and frees the index
+VOID StopLogTailer()
+{
+    if (hLogTailThread != NULL) {
+        SetEvent(hLogTailStop);
+        WaitForSingleObject(hLogTailThread, LOGTAIL_STOP_TIMEOUT);
+        CloseHandle(hLogTailThread);
+        hLogTailThread = NULL;
+    }
+    if (hLogTailStop != NULL) {
+        CloseHandle(hLogTailStop);
+        hLogTailStop = NULL;
     }
+    if (hLogReadFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(hLogReadFile);
+        hLogReadFile = INVALID_HANDLE_VALUE;
+    }
+    LogIndexFree(&logIndex);
+    logViewLines.clear();
+    logViewLines.shrink_to_fit();
+    hLogsWnd = NULL;
+}
+
+// Returns the logfile line shown by a log list row
+DWORD GetLogViewLine(int iRow)
+{
+    if (logViewFilter.bMaxSeverity != LOGSEV_NONE)
+        return ((size_t)iRow < logViewLines.size() ? logViewLines[iRow] : MAXDWORD);
+    return dwLogViewFirstLine + iRow;
+}
+
+// Reads a logfile line for display (up to LOGVIEW_MAX_LINE bytes, without the
+// line break). Returns FALSE if the line isn't indexed (anymore).
+BOOL ReadLogLine(DWORD dwLine, LPWSTR szText, int cchText)
+{
+    ULONGLONG ullStart, ullEnd;
+    BYTE bSeverity;
+    AcquireSRWLockShared(&srwLogIndex);
+    BOOL bFound = LogIndexGetLine(&logIndex, dwLine, &ullStart, &ullEnd, &bSeverity);
+    ReleaseSRWLockShared(&srwLogIndex);
+    szText[0] = '\0';
+    if (!bFound)
+        return FALSE;
+
+    CHAR szLine[LOGVIEW_MAX_LINE];
+    WCHAR szWideLine[LOGVIEW_MAX_LINE + 1];
+    OVERLAPPED ov = {};
+    ov.Offset = (DWORD)ullStart;
+    ov.OffsetHigh = (DWORD)(ullStart >> 32);
+    DWORD cbRead;
+    if (!ReadFile(hLogReadFile, szLine, (DWORD)min(ullEnd - ullStart, (ULONGLONG)LOGVIEW_MAX_LINE), &cbRead, &ov))
+        return FALSE;
+    while (cbRead > 0 && (szLine[cbRead - 1] == '\n' || szLine[cbRead - 1] == '\r'))
+        cbRead--;
+    int cchLine = MultiByteToWideChar(CP_UTF8, 0, szLine, cbRead, szWideLine, LOGVIEW_MAX_LINE);
+    szWideLine[cchLine] = '\0';
+    wcsncpy_s(szText, cchText, szWideLine, _TRUNCATE);
     return TRUE;
 }
 
-// Get running Monitor process' hWnd
-HWND GetRunningMonitorHwnd() {
+// Updates the log list with the lines indexed since the last update, or with
+// all of them when the filter changed. The list follows the new lines while
+// its last row is visible.
+VOID UpdateLogView(HWND hWnd, BOOL bRefilter)
+{
+    HWND hList = GetDlgItem(hWnd, IDC_LOGS_LIST);
+    int iRows = ListView_GetItemCount(hList);
+    BOOL bFollow = (iRows == 0 || ListView_IsItemVisible(hList, iRows - 1));
+
+    if (bRefilter) {
+        static const BYTE severities[] = { LOGSEV_NONE, LOGSEV_ERROR, LOGSEV_WARNING, LOGSEV_INFO, LOGSEV_DEBUG };
+        static const ULONGLONG periods[] = { 0, 3600, 86400, 7 * 86400 };
+        int iSeverity = (int)SendDlgItemMessage(hWnd, IDC_LOGS_SEVERITY, CB_GETCURSEL, 0, 0);
+        int iPeriod = (int)SendDlgItemMessage(hWnd, IDC_LOGS_PERIOD, CB_GETCURSEL, 0, 0);
+        logViewFilter.bMaxSeverity = severities[(iSeverity >= 0 && iSeverity < (int)ARRAYSIZE(severities)) ? iSeverity : 0];
+        logViewFilter.ullFromTime = 0;
+        if (iPeriod > 0 && iPeriod < (int)ARRAYSIZE(periods)) {
+            // The Agent logs its local time
+            SYSTEMTIME st;
+            GetLocalTime(&st);
+            logViewFilter.ullFromTime = LogMakeTime(st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond) - periods[iPeriod];
+        }
+        logViewLines.clear();
+        dwLogViewFiltered = 0;
+        bFollow = TRUE;
+    }
+
+    AcquireSRWLockShared(&srwLogIndex);
+    DWORD dwLines = logIndex.dwLines;
+    if (bRefilter)
+        dwLogViewFirstLine = (logViewFilter.ullFromTime != 0 ? LogIndexFindTime(&logIndex, logViewFilter.ullFromTime) : 0);
+    if (logViewFilter.bMaxSeverity != LOGSEV_NONE)
+        dwLogViewFiltered = LogIndexFilter(&logIndex, &logViewFilter, dwLogViewFiltered, logViewLines);
+    ReleaseSRWLockShared(&srwLogIndex);
+
+    DWORD dwRows;
+    if (logViewFilter.bMaxSeverity != LOGSEV_NONE)
+        dwRows = (DWORD)logViewLines.size();
+    else
+        dwRows = (dwLines > dwLogViewFirstLine ? dwLines - dwLogViewFirstLine : 0);
+    ListView_SetItemCountEx(hList, dwRows, (bRefilter ? 0 : LVSICF_NOINVALIDATEALL | LVSICF_NOSCROLL));
+    if (bFollow && dwRows > 0)
+        ListView_EnsureVisible(hList, dwRows - 1, FALSE);
+
+    WCHAR szFormat[64], szLines[128];
+    LoadCachedString(IDS_LOGS_LINES, szFormat, ARRAYSIZE(szFormat));
+    wsprintf(szLines, szFormat, dwRows, dwLines);
+    SetDlgItemText(hWnd, IDC_LOGS_STATIC_LINES, szLines);
+}
 
-    // Get GLPI Agent Monitor executable name
-    WCHAR szFilePath[MAX_PATH];
-    GetModuleFileName(NULL, szFilePath, MAX_PATH);
-    LPWSTR szFileName = PathFindFileName(szFilePath);
+// Shows a published snapshot in the main window, only redrawing
+// the fields that differ from the snapshot already shown
+VOID ShowMonitorSnapshot(HWND hWnd, const MonitorSnapshot* pSnapshot)
+{
+    WCHAR szBuf[256];
+    DWORD dwChanged = MonitorSnapshotDiff(bSnapshotShown ? &shownSnapshot : NULL, pSnapshot);
 
-    // Look through processes, try to get it's hWnd when the process is found
-    // and then send a WM_CLOSE message to stop it gracefully
-    HANDLE hSnapshot = CreateToolhelp32Snapshot(TH32CS_SNAPALL, NULL);
-    PROCESSENTRY32 pEntry{};
-    pEntry.dwSize = sizeof(pEntry);
-    BOOL hRes = Process32First(hSnapshot, &pEntry);
-    while (hRes)
+    // Service status and start/stop button (the label color is
+    // applied by WM_CTLCOLORSTATIC, once the snapshot is shown)
+    if (dwChanged & SNAPSHOT_SERVICE)
     {
-        if (lstrcmp(pEntry.szExeFile, szFileName) == 0)
-        {
-            // Don't close itself
-            if (pEntry.th32ProcessID != GetCurrentProcessId())
-            {
-                EnumWindowsData ed = {
-                    pEntry.th32ProcessID,
-                    NULL
-                };
-
-                if (!EnumWindows(EnumWindowsProc, (LPARAM)&ed) && (GetLastError() == ERROR_SUCCESS)) {
-                    CloseHandle(hSnapshot);
-                    return ed.hWndFound;
-                }
-            }
+        const SvcStateDisplay* pDisplay = GetSvcStateDisplay(pSnapshot);
+        SetDlgItemText(hWnd, IDC_SERVICESTATUS, GetString(pDisplay->uLabelResId));
+        SetDlgItemText(hWnd, IDC_BTN_STARTSTOPSVC, GetString(pDisplay->uButtonResId));
+
+        HWND hWndSvcButton = GetDlgItem(hWnd, IDC_BTN_STARTSTOPSVC);
+        EnableWindow(hWndSvcButton, pDisplay->bEnableButton);
+        if (IsWindowVisible(hWnd)) {
+            SetFocus(hWndSvcButton);
+        }
+    }
+
+    if (dwChanged & SNAPSHOT_AGENTSTATUS)
+        SetDlgItemText(hWnd, IDC_AGENTSTATUS, pSnapshot->szAgStatus);
+
+    if (dwChanged & SNAPSHOT_AGENTVERSION)
+    {
+        if (!pSnapshot->config.bInstalled) {
+            SetDlgItemText(hWnd, IDC_AGENTVER, GetString(IDS_ERR_AGENTNOTFOUND));
+        }
+        else if (!pSnapshot->config.bVersionFound) {
+            SetDlgItemText(hWnd, IDC_AGENTVER, GetString(IDS_ERR_AGENTVERNOTFOUND));
         }
-        hRes = Process32Next(hSnapshot, &pEntry);
+        else {
+            wsprintf(szBuf, L"GLPI Agent %s", pSnapshot->config.szVersion);
+            SetDlgItemText(hWnd, IDC_AGENTVER, szBuf);
+        }
+    }
+
+    if (dwChanged & SNAPSHOT_STARTTYPE)
+    {
+        SetDlgItemText(hWnd, IDC_STARTTYPE, GetString(pSnapshot->config.uStartTypeResId));
+    }
+
+    if (dwChanged & SNAPSHOT_LASTINVENTORY)
+    {
+        static const UINT lastInvResIds[] = { IDS_LASTINV_UNKNOWN, IDS_LASTINV_OK, IDS_LASTINV_FAILED };
+        wsprintf(szBuf, GetString(lastInvResIds[pSnapshot->dwLastInvState]), pSnapshot->dwLastInvErrors);
+        SetDlgItemText(hWnd, IDC_LASTINVENTORY, szBuf);
+    }
+
+    // Taskbar icon routine (the tooltip also summarizes the remote Agents, if any)
+    if (dwChanged & (SNAPSHOT_AGENTOK | SNAPSHOT_ENDPOINTS))
+    {
+        LoadIconMetric(hInst, MAKEINTRESOURCE(pSnapshot->bAgentOk ? IDI_GLPIOK : IDI_GLPIERR), LIM_LARGE, &nid.hIcon);
+        LoadCachedString((pSnapshot->bAgentOk ? IDS_GLPINOTIFY : IDS_GLPINOTIFYERROR), nid.szTip, ARRAYSIZE(nid.szTip));
+        if (pSnapshot->dwEndpoints > 0) {
+            wsprintf(szBuf, GetString(IDS_TIP_ENDPOINTS), pSnapshot->dwEndpointsResponding, pSnapshot->dwEndpoints);
+            wcscat_s(nid.szTip, L"\n");
+            wcsncat_s(nid.szTip, szBuf, _TRUNCATE);
+        }
+        nid.szInfo[0] = '\0';
+        Shell_NotifyIcon(NIM_MODIFY, &nid);
+    }
+
+    // Notification queued by the probe worker
+    if ((dwChanged & SNAPSHOT_NOTIFICATION) && pSnapshot->dwNotifySeq != 0)
+        LoadStringAndShowNotification(pSnapshot->uNotifyTitleResId, pSnapshot->uNotifyMsgResId, pSnapshot->dwNotifyFlags);
+
+    shownSnapshot = *pSnapshot;
+    bSnapshotShown = TRUE;
+    if (dwChanged & SNAPSHOT_SERVICE)
+        InvalidateRect(GetDlgItem(hWnd, IDC_SERVICESTATUS), NULL, TRUE);
+}
+
+// Handles the snapshots published by the probe worker
+VOID OnStatusPublished(HWND hWnd)
+{
+    // Clear the posted flag first, so a snapshot published
+    // meanwhile either gets popped below or posts again
+    InterlockedExchange(&lStatusPosted, 0);
+
+    MonitorSnapshot snapshot;
+    while (snapshotChannel.Pop(&snapshot))
+        ShowMonitorSnapshot(hWnd, &snapshot);
+}
+
+// Asks the probe worker to update the statuses right away
+VOID RefreshStatus()
+{
+    PostMessage(hProbeWnd, WMAPP_REFRESH, 0, 0);
+}
+
+// Asks the probe worker to force an inventory, if the Agent is able to run it
+VOID RequestInventory(HWND hWnd)
+{
+    if (shownSnapshot.dwSvcState == SERVICE_RUNNING)
+    {
+        if (shownSnapshot.bAgentOk)
+            PostMessage(hProbeWnd, WMAPP_FORCEINVENTORY, 0, 0);
+        else
+            LoadStringAndMessageBox(hInst, hWnd, IDS_ERR_AGENTERR, IDS_ERROR, MB_OK | MB_ICONERROR);
+    }
+    else
+        LoadStringAndMessageBox(hInst, hWnd, IDS_ERR_NOTRUNNING, IDS_ERROR, MB_OK | MB_ICONERROR);
+}
+
+// Starts the probe worker, which publishes the statuses to the given window
+BOOL StartProbeWorker(HWND hWnd)
+{
+    hMainWnd = hWnd;
+    HANDLE hProbeReady = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (hProbeReady == NULL)
+        return FALSE;
+    hProbeThread = CreateThread(NULL, 0, ProbeThreadProc, hProbeReady, 0, NULL);
+    if (hProbeThread != NULL)
+        WaitForSingleObject(hProbeReady, INFINITE);
+    CloseHandle(hProbeReady);
+    return hProbeWnd != NULL;
+}
+
+// Stops the probe worker (it releases the service handles and registry watches)
+VOID StopProbeWorker()
+{
+    if (hProbeThread == NULL)
+        return;
+    PostMessage(hProbeWnd, WM_CLOSE, 0, 0);
+    WaitForSingleObject(hProbeThread, PROBE_STOP_TIMEOUT);
+    CloseHandle(hProbeThread);
+    hProbeThread = NULL;
+}
+
+// Console control handler (headless mode): Ctrl+C, Ctrl+Break and
+// closing the console stop the Monitor gracefully
+BOOL WINAPI HeadlessCtrlHandler(DWORD dwCtrlType)
+{
+    PostMessage(hMainWnd, WM_CLOSE, 0, 0);
+    return TRUE;
+}
+
+// Does a service operation (HANDOFF_SVC_*) with the cached SCM handles, so it
+// must run on the thread owning them: the probe worker (WMAPP_SERVICEOPERATION),
+// the broker or a one-shot instance. Returns the error code, and the resource
+// ID of the error message to show.
+DWORD ControlAgentService(DWORD dwOperation, UINT* puErrResId)
+{
+    return ServiceWatchControl(&svcWatch, dwOperation, puErrResId);
+}
+
+// Runs a request handed by a new Monitor instance (called by the handoff
+// server thread, pvContext being the main window)
+DWORD OnHandoffRequest(const HandoffRequest* pReq, PVOID pvContext)
+{
+    HWND hWnd = (HWND)pvContext;
+    DWORD_PTR dwResult;
+    switch (pReq->wCommand) {
+        // Also lets the running instance refresh its statuses
+        case HANDOFF_CMD_SHOW:
+            return (PostMessage(hWnd, WM_COMMAND, ID_RMENU_OPEN, 0) ? ERROR_SUCCESS : GetLastError());
+        // The result is shown as a notification
+        case HANDOFF_CMD_FORCEINV:
+            return (PostMessage(hProbeWnd, WMAPP_FORCEINVENTORY, 0, 0) ? ERROR_SUCCESS : GetLastError());
+        // Done by the probe worker, with the rights of the running instance
+        // (ERROR_TIMEOUT if it's still running)
+        case HANDOFF_CMD_SERVICE:
+            if (!SendMessageTimeout(hProbeWnd, WMAPP_SERVICEOPERATION, pReq->dwArg, 0, SMTO_NORMAL, HANDOFF_SERVICE_TIMEOUT, &dwResult))
+                return GetLastError();
+            return (DWORD)dwResult;
+    }
+    return ERROR_NOT_SUPPORTED;
+}
+
+// Privileged operations run by the elevated broker (/broker)
+class MonitorBrokerBackend : public BrokerBackend
+{
+public:
+    DWORD ControlService(DWORD dwOperation)
+    {
+        UINT uErrResId;
+        return ControlAgentService(dwOperation, &uErrResId);
+    }
+
+    DWORD WriteSettings(const BrokerSettingsBody* pSettings)
+    {
+        return WriteMonitorSettings(pSettings);
     }
-    CloseHandle(hSnapshot);
+};
+
+// Runs a service operation in the elevated broker (thread pool callback, the
+// first request waiting for the UAC prompt) and reports it to the main window
+VOID CALLBACK RunBrokerServiceOperation(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext)
+{
+    BrokerServiceBody body = { (DWORD)(ULONG_PTR)pvContext };
+    DWORD dwResult;
+    if (!BrokerClientCall(hMainWnd, BROKER_CMD_SERVICE, &body, sizeof(body), &dwResult))
+        dwResult = GetLastError();
+    PostMessage(hMainWnd, WMAPP_BROKERRESULT, BROKER_CMD_SERVICE, dwResult);
+}
+
+// Writes the settings in the elevated broker (thread pool callback, the first
+// request waiting for the UAC prompt) and reports it to the settings dialog
+VOID CALLBACK RunBrokerSettingsWrite(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext)
+{
+    HWND hDlg = (HWND)pvContext;
+    DWORD dwResult;
+    if (!BrokerClientCall(hDlg, BROKER_CMD_SETTINGS, &brokerSettings, sizeof(brokerSettings), &dwResult))
+        dwResult = GetLastError();
+    PostMessage(hDlg, WMAPP_BROKERRESULT, BROKER_CMD_SETTINGS, dwResult);
+}
+
+// Reads the Monitor version (built from the same definitions as the executable
+// version info, so it doesn't have to be read from the file at startup)
+VOID ReadMonitorVersion(DWORD* pdwVerMaj, DWORD* pdwVerMin, DWORD* pdwVerRev)
+{
+    *pdwVerMaj = wMonitorVersion[0];
+    *pdwVerMin = wMonitorVersion[1];
+    *pdwVerRev = wMonitorVersion[2];
+}
+
+// Formats the HTTP User-Agent of the Monitor requests
+VOID FormatUserAgent(LPWSTR szUserAgent, DWORD dwVerMaj, DWORD dwVerMin, DWORD dwVerRev)
+{
+    wsprintf(szUserAgent, L"%s/%d.%d.%d", USERAGENT_NAME, dwVerMaj, dwVerMin, dwVerRev);
+}
 
-    return NULL;
+// Creates the Agent client (WinHTTP)
+VOID CreateAgentClient(DWORD dwVerMaj, DWORD dwVerMin, DWORD dwVerRev)
+{
+    WCHAR szUserAgent[64];
+    FormatUserAgent(szUserAgent, dwVerMaj, dwVerMin, dwVerRev);
+    AgentClientInit(CreateWinHttpTransport(szUserAgent, dwAgentPort));
 }
 
+// Runs the Monitor in headless mode, until interrupted or its output is closed.
+// The status is written to the standard output if redirected (i.e. to a pipe),
+// or to the console the Monitor was started from.
+int RunHeadless(LONG lAgentSettingsRes, UINT uAgentSettingsErrResId)
+{
+    bHeadless = TRUE;
+    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (hOut == NULL || hOut == INVALID_HANDLE_VALUE)
+    {
+        if (!AttachConsole(ATTACH_PARENT_PROCESS))
+            return GetLastError();
+        hOut = CreateFile(L"CONOUT$", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+        if (hOut == INVALID_HANDLE_VALUE)
+            return GetLastError();
+        SetConsoleOutputCP(CP_UTF8);
+    }
+    HeadlessStreamInit(&headlessStream, hOut, GetString);
+
+    if (lAgentSettingsRes != ERROR_SUCCESS) {
+        HeadlessWriteError(&headlessStream, uAgentSettingsErrResId, lAgentSettingsRes);
+        return lAgentSettingsRes;
+    }
+
+    DWORD dwVerMaj, dwVerMin, dwVerRev;
+    ReadMonitorVersion(&dwVerMaj, &dwVerMin, &dwVerRev);
+    CreateAgentClient(dwVerMaj, dwVerMin, dwVerRev);
+
+    // The probe worker publishes the statuses to a message-only window
+    WNDCLASSEX wcex = { sizeof(WNDCLASSEX) };
+    wcex.lpfnWndProc = HeadlessWndProc;
+    wcex.hInstance = hInst;
+    wcex.lpszClassName = HEADLESS_WNDCLASS;
+    RegisterClassEx(&wcex);
+    HWND hWnd = CreateWindowEx(0, HEADLESS_WNDCLASS, NULL, 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, hInst, NULL);
+    if (hWnd == NULL || !StartProbeWorker(hWnd)) {
+        DWORD dwErr = GetLastError();
+        HeadlessWriteError(&headlessStream, IDS_ERR_MAINWINDOW, dwErr);
+        return dwErr;
+    }
+    SetConsoleCtrlHandler(HeadlessCtrlHandler, TRUE);
+
+    // Headless message loop
+    MSG msg;
+    while (GetMessage(&msg, nullptr, 0, 0))
+        DispatchMessage(&msg);
+
+    return (int)msg.wParam;
+}
 
 //-[MAIN FUNCTIONS]------------------------------------------------------------
 
+// Builds the main window content when it's first shown: window icons, logo
+// (GDI+ is started to decode it), version and strings. The status values are
+// only set to "Loading" if no snapshot was shown yet.
+VOID InitMainWindowContent(HWND hWnd)
+{
+    static BOOL bInitialized = FALSE;
+    if (bInitialized)
+        return;
+    bInitialized = TRUE;
+    LONGLONG llStart = MetricsNow();
+
+    HICON icon = (HICON)LoadImage(hInst, MAKEINTRESOURCE(IDI_GLPIOK), IMAGE_ICON, 0, 0, LR_DEFAULTCOLOR | LR_DEFAULTSIZE);
+    SendMessage(hWnd, WM_SETICON, ICON_SMALL, (LPARAM)icon);
+    SendMessage(hWnd, WM_SETICON, ICON_BIG, (LPARAM)icon);
+
+    if (gdiplusToken == 0)
+        GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
+    HBITMAP hLogo = nullptr;
+    LoadPNGAsBitmap(hInst, MAKEINTRESOURCE(IDB_LOGO), L"PNG", &hLogo);
+    SendMessage(GetDlgItem(hWnd, IDC_PCLOGO), STM_SETIMAGE, IMAGE_BITMAP, (LPARAM)hLogo);
+
+    DWORD dwVerMaj, dwVerMin, dwVerRev;
+    ReadMonitorVersion(&dwVerMaj, &dwVerMin, &dwVerRev);
+    WCHAR szVer[20];
+    wsprintf(szVer, L"v%d.%d.%d", dwVerMaj, dwVerMin, dwVerRev);
+    SetDlgItemText(hWnd, IDC_VERSION, szVer);
+
+    LoadCachedString(IDS_APP_TITLE, szBuffer, dwBufferLen);
+    SetWindowText(hWnd, szBuffer);
+    SetDlgItemText(hWnd, IDC_STATIC_TITLE, szBuffer);
+
+    LoadCachedString(IDS_STATIC_INFO, szBuffer, dwBufferLen);
+    SetDlgItemText(hWnd, IDC_GBMAIN, szBuffer);
+
+    LoadCachedString(IDS_STATIC_AGENTVER, szBuffer, dwBufferLen);
+    SetDlgItemText(hWnd, IDC_STATIC_AGENTVER, szBuffer);
+    LoadCachedString(IDS_STATIC_SERVICESTATUS, szBuffer, dwBufferLen);
+    SetDlgItemText(hWnd, IDC_STATIC_SERVICESTATUS, szBuffer);
+    LoadCachedString(IDS_STATIC_STARTTYPE, szBuffer, dwBufferLen);
+    SetDlgItemText(hWnd, IDC_STATIC_STARTTYPE, szBuffer);
+
+    if (!bSnapshotShown) {
+        LoadCachedString(IDS_LOADING, szBuffer, dwBufferLen);
+        SetDlgItemText(hWnd, IDC_AGENTVER, szBuffer);
+        SetDlgItemText(hWnd, IDC_SERVICESTATUS, szBuffer);
+        SetDlgItemText(hWnd, IDC_STARTTYPE, szBuffer);
+        SetDlgItemText(hWnd, IDC_AGENTSTATUS, szBuffer);
+        SetDlgItemText(hWnd, IDC_LASTINVENTORY, L"");
+        LoadCachedString(IDS_STARTSVC, szBuffer, dwBufferLen);
+        SetDlgItemText(hWnd, IDC_BTN_STARTSTOPSVC, szBuffer);
+    }
+
+    LoadCachedString(IDS_STATIC_AGENTSTATUS, szBuffer, dwBufferLen);
+    SetDlgItemText(hWnd, IDC_GBSTATUS, szBuffer);
+
+    LoadCachedString(IDS_FORCEINV, szBuffer, dwBufferLen);
+    SetDlgItemText(hWnd, IDC_BTN_FORCE, szBuffer);
+    LoadCachedString(IDS_VIEWLOGS, szBuffer, dwBufferLen);
+    SetDlgItemText(hWnd, IDC_BTN_VIEWLOGS, szBuffer);
+    LoadCachedString(IDS_NEWTICKET, szBuffer, dwBufferLen);
+    SetDlgItemText(hWnd, IDC_BTN_NEWTICKET, szBuffer);
+    LoadCachedString(IDS_BTN_SETTINGS, szBuffer, dwBufferLen);
+    SetDlgItemText(hWnd, IDC_BTN_SETTINGS, szBuffer);
+    LoadCachedString(IDS_CLOSE, szBuffer, dwBufferLen);
+    SetDlgItemText(hWnd, IDC_BTN_CLOSE, szBuffer);
+    LoadCachedString(IDS_HISTORY, szBuffer, dwBufferLen);
+    SetDlgItemText(hWnd, IDC_BTN_HISTORY, szBuffer);
+
+    // Set UAC shields
+    SendMessage(GetDlgItem(hWnd, IDC_BTN_STARTSTOPSVC), BCM_SETSHIELD, 0, 1);
+    SendMessage(GetDlgItem(hWnd, IDC_BTN_SETTINGS), BCM_SETSHIELD, 0, 1);
+
+    MetricsStartupPhase(STARTUP_WINDOWCONTENT, llStart);
+}
+
 // Entry point
 int APIENTRY wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPWSTR lpCmdLine, _In_ int nCmdShow)
 {
+    MetricsStartupBegin();
+    ServiceWatchInit(&svcWatch, CreateScmBackend(SERVICE_NAME));
+    RegConfigInit(&regConfig, CreateHklmBackend(), SERVICE_NAME);
     wsprintf(szCmdLine, L"%s", lpCmdLine);
     hInst = hInstance;
     DWORD dwErr = NULL;
 
-    // Process service operations
-    if (wcsstr(szCmdLine, L"/startSvc") != nullptr || wcsstr(szCmdLine, L"/stopSvc") != nullptr ||
-        wcsstr(szCmdLine, L"/continueSvc") != nullptr) {
-        SC_HANDLE hSc = OpenSCManager(NULL, SERVICES_ACTIVE_DATABASE, SC_MANAGER_CONNECT);
-        if (!hSc) {
-            dwErr = GetLastError();
-            LoadStringAndMessageBox(hInst, NULL, IDS_ERR_SCHANDLE, IDS_ERROR, MB_OK | MB_ICONERROR, dwErr);
-            return dwErr;
-        }
-        SC_HANDLE hAgentSvc = OpenService(hSc, SERVICE_NAME, SERVICE_START | SERVICE_PAUSE_CONTINUE | SERVICE_STOP);
-        if (!hAgentSvc) {
-            dwErr = GetLastError();
-            LoadStringAndMessageBox(hInst, NULL, IDS_ERR_SVCHANDLE, IDS_ERROR, MB_OK | MB_ICONERROR, dwErr);
+    // Process service operations. They're handed to the running Monitor first,
+    // and only done by this instance if it isn't allowed to (this instance
+    // being elevated, i.e. started by the "Start service" button). Once handed,
+    // the operation isn't done again if its reply is late, it's still running.
+    HandoffRequest handoffReq;
+    BOOL bHandoffAction = HandoffParseCommandLine(szCmdLine, &handoffReq);
+    if (bHandoffAction && handoffReq.wCommand == HANDOFF_CMD_SERVICE) {
+        DWORD dwResult = ERROR_SUCCESS;
+        int nHandoffRes = HandoffSend(&handoffReq, 0, &dwResult);
+        if (nHandoffRes == HANDOFF_NO_REPLY ||
+            (nHandoffRes == HANDOFF_REPLIED && (dwResult == ERROR_SUCCESS || dwResult == ERROR_TIMEOUT)))
+            return 0;
+        UINT uErrResId;
+        dwErr = ControlAgentService(handoffReq.dwArg, &uErrResId);
+        ServiceWatchClose(&svcWatch);
+        if (dwErr != ERROR_SUCCESS) {
+            LoadStringAndMessageBox(hInst, NULL, uErrResId, IDS_ERROR, MB_OK | MB_ICONERROR, dwErr);
             return dwErr;
         }
-        if (wcsstr(szCmdLine, L"/startSvc") != nullptr)
-            StartService(hAgentSvc, NULL, NULL);
-        else if (wcsstr(szCmdLine, L"/stopSvc") != nullptr)
-            ControlService(hAgentSvc, SERVICE_CONTROL_STOP, &svcStatus);
-        else if (wcsstr(szCmdLine, L"/continueSvc") != nullptr)
-            ControlService(hAgentSvc, SERVICE_CONTROL_CONTINUE, &svcStatus);
-        dwErr = GetLastError();
-        if (dwErr != NULL) {
-            LoadStringAndMessageBox(hInst, NULL, IDS_ERR_SVCOPERATION, IDS_ERROR, MB_OK | MB_ICONERROR, dwErr);
-            return dwErr;
-        }
-        CloseServiceHandle(hAgentSvc);
-        CloseServiceHandle(hSc);
         return 0;
     }
 
-    // Load GLPI Agent Monitor settings from the registry
+    // Run the elevated broker of the Monitor instance that started it. It exits
+    // along with that instance.
+    if (wcsstr(szCmdLine, L"/broker") != nullptr) {
+        MonitorBrokerBackend backend;
+        return BrokerRun(szCmdLine, &backend);
+    }
+
+    // Store (or remove, without a token) the GLPI REST API user token of the
+    // current user. The Monitor itself won't be loaded.
+    LPCWSTR szSetToken = wcsstr(szCmdLine, L"/setTicketToken");
+    if (szSetToken != nullptr) {
+        WCHAR szToken[ARRAYSIZE(ticketApiConfig.szUserToken)] = {};
+        szSetToken += wcslen(L"/setTicketToken");
+        while (*szSetToken == ' ')
+            szSetToken++;
+        size_t cchToken = wcscspn(szSetToken, L" ");
+        if (cchToken >= ARRAYSIZE(szToken))
+            return ERROR_INVALID_PARAMETER;
+        wcsncpy_s(szToken, szSetToken, cchToken);
+        dwErr = SaveTicketUserToken(szToken);
+        SecureZeroMemory(szToken, sizeof(szToken));
+        return dwErr;
+    }
+
+    // Load GLPI Agent and Monitor settings from the registry
+    // (Agent settings errors are only reported when loading the Monitor)
+    LONGLONG llPhaseStart = MetricsNow();
+    UINT uAgentSettingsErrResId = 0;
+    LONG lAgentSettingsRes = LoadAgentSettings(&uAgentSettingsErrResId);
     LoadMonitorSettings();
+    MetricsStartupPhase(STARTUP_SETTINGS, llPhaseStart);
 
     // Show the settings dialog in a new elevated instance if requested.
     // This instance will close as soon as the settings dialog is closed.
@@ -743,197 +2656,79 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance
         return (int)msg.wParam;
     }
 
+    // Run without any window if requested, writing the statuses to the
+    // standard output. It doesn't prevent the Monitor from being loaded.
+    if (wcsstr(szCmdLine, L"/headless") != nullptr)
+        return RunHeadless(lAgentSettingsRes, uAgentSettingsErrResId);
+
     // Create app mutex to keep only one instance running
     hMutex = CreateMutex(NULL, TRUE, L"GLPI-AgentMonitor");
     if (GetLastError() == ERROR_ALREADY_EXISTS)
     {
-        // Show running agent window
-        HWND runningMonitorHwnd = GetRunningMonitorHwnd();
-        if (runningMonitorHwnd != NULL) {
-            ShowWindowFront(runningMonitorHwnd, SW_SHOW);
-            UpdateStatus(runningMonitorHwnd, NULL, NULL, NULL);
-        }
+        // Hand the command line action (showing the main window by default) to
+        // the running Monitor, whose pipe may not be created yet if it's starting
+        DWORD dwResult;
+        HandoffSend(&handoffReq, HANDOFF_TIMEOUT, &dwResult);
         return 0;
     }
 
-    // Read app version
-    WCHAR szFileName[MAX_PATH];
-    GetModuleFileName(NULL, szFileName, MAX_PATH);
-    DWORD dwSize = GetFileVersionInfoSize(szFileName, 0);
-    VS_FIXEDFILEINFO* lpFfi = NULL;
-    UINT uFfiLen = 0;
-    WCHAR* szVerBuffer = new WCHAR[dwSize];
-    GetFileVersionInfo(szFileName, 0, dwSize, szVerBuffer);
-    VerQueryValue(szVerBuffer, L"\\", (LPVOID*)&lpFfi, &uFfiLen);
-    DWORD dwVerMaj = HIWORD(lpFfi->dwFileVersionMS);
-    DWORD dwVerMin = LOWORD(lpFfi->dwFileVersionMS);
-    DWORD dwVerRev = HIWORD(lpFfi->dwFileVersionLS);
-
-    GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
-
-    // Load agent settings
-    HKEY hk;
-    WCHAR szKey[MAX_PATH];
-    WCHAR szValueBuf[MAX_PATH] = {};
-    DWORD szValueBufLen = sizeof(szValueBuf);
-    DWORD szServerLen = sizeof(szServer);
-    DWORD dwPort = 62354;
-
-    wsprintf(szKey, L"SOFTWARE\\%s", SERVICE_NAME);
-    LONG lRes = RegOpenKeyEx(HKEY_LOCAL_MACHINE, szKey, 0, KEY_READ | KEY_WOW64_64KEY, &hk);
-    if (lRes != ERROR_SUCCESS)
-    {
-        wsprintf(szKey, L"SOFTWARE\\WOW6432Node\\%s", SERVICE_NAME);
-        lRes = RegOpenKeyEx(HKEY_LOCAL_MACHINE, szKey, 0, KEY_READ | KEY_WOW64_64KEY, &hk);
-        if (lRes != ERROR_SUCCESS) {
-            LoadStringAndMessageBox(hInst, NULL, IDS_ERR_AGENTSETTINGS, IDS_ERROR, MB_OK | MB_ICONERROR, lRes);
-            return lRes;
-        }
-    }
-    else
-    {   
-        // Get HTTPD port
-        lRes = RegQueryValueEx(hk, L"httpd-port", 0, NULL, (LPBYTE)szValueBuf, &szValueBufLen);
-        if (lRes != ERROR_SUCCESS) {
-            LoadStringAndMessageBox(hInst, NULL, IDS_ERR_HTTPDPORT, IDS_ERROR, MB_OK | MB_ICONERROR, lRes);
-            return lRes;
-        }
-        else
-            dwPort = _wtoi(szValueBuf);
-
-        // Get server URL
-        lRes = RegQueryValueEx(hk, L"server", 0, NULL, (LPBYTE)szServer, &szServerLen);
-        if (lRes == ERROR_SUCCESS) {
-            // Strip any quotes from the "server" value
-            wstring strServer = szServer;
-            strServer.erase(remove(strServer.begin(), strServer.end(), '\''), strServer.end());
-            strServer.erase(remove(strServer.begin(), strServer.end(), '\"'), strServer.end());
-            wcscpy_s(szServer, strServer.c_str());
-
-            if (wcscmp(L"", szServer) != 0) {
-                // Get only the first URL if more than one is configured
-                LPWSTR szSubstr = wcsstr(szServer, L",");
-                if (szSubstr != nullptr)
-                    szSubstr[0] = '\0';
-                // Get GLPI server base URL (as GLPI may be located in a subfolder,
-                // we can't guess the exact location just by stripping the domain
-                // from the "server" parameter).
-                szSubstr = wcsstr(szServer, L"/plugins/");
-                if (szSubstr == nullptr) {
-                    szSubstr = wcsstr(szServer, L"/marketplace/");
-                    if (szSubstr == nullptr)
-                        szSubstr = wcsstr(szServer, L"/front/inventory.php");
-                }
-                if (szSubstr != nullptr) {
-                    // As szSubstr points to where the first character of the substring
-                    // was found in the string itself, replacing it with a null character
-                    // effectively cuts the string.
-                    szSubstr[0] = '\0';
-                }
-                // Strip any trailing slash
-                size_t lServerLen = wcslen(szServer);
-                while (--lServerLen >= 0 && szServer[lServerLen] == '/') {
-                    szServer[lServerLen] = '\0';
-                }
-                // In case we didn't find the substrings, assume the "server" value
-                // in the registry is the base GLPI url itself.
-            }
-        }
-
-        // Get agent logfile path
-        DWORD szLogfileLen = sizeof(szLogfile);
-        lRes = RegQueryValueEx(hk, L"logfile", 0, NULL, (LPBYTE)szLogfile, &szLogfileLen);
-        if (lRes != ERROR_SUCCESS)
-            szLogfile[0] = '\0';
+    if (lAgentSettingsRes != ERROR_SUCCESS) {
+        LoadStringAndMessageBox(hInst, NULL, uAgentSettingsErrResId, IDS_ERROR, MB_OK | MB_ICONERROR, lAgentSettingsRes);
+        return lAgentSettingsRes;
     }
 
-    RegCloseKey(hk);
-
-    // Create WinHTTP handles
-    WCHAR szUserAgent[64];
-    wsprintf(szUserAgent, L"%s/%d.%d.%d", USERAGENT_NAME, dwVerMaj, dwVerMin, dwVerRev);
-
-    hSession = WinHttpOpen(szUserAgent, WINHTTP_ACCESS_TYPE_NO_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, WINHTTP_FLAG_ASYNC);
-    WinHttpSetTimeouts(hSession, 100, 10000, 10000, 10000);
-    hConn = WinHttpConnect(hSession, L"127.0.0.1", (INTERNET_PORT)dwPort, 0);
-
     //-------------------------------------------------------------------------
 
+    // The main window is created hidden and its content is only built when
+    // it's first shown (see InitMainWindowContent), the taskbar icon comes first
+    llPhaseStart = MetricsNow();
     HWND hWnd = CreateDialog(hInst, MAKEINTRESOURCE(IDD_MAIN), NULL, (DLGPROC)DlgProc);
     if (!hWnd) {
         dwErr = GetLastError();
         LoadStringAndMessageBox(hInst, NULL, IDS_ERR_MAINWINDOW, IDS_ERROR, MB_OK | MB_ICONERROR, dwErr);
         return dwErr;
     }
-
-    HICON icon = (HICON)LoadImage(hInst, MAKEINTRESOURCE(IDI_GLPIOK), IMAGE_ICON, 0, 0, LR_DEFAULTCOLOR | LR_DEFAULTSIZE);
-    SendMessage(hWnd, WM_SETICON, ICON_SMALL, (LPARAM)icon);
-    SendMessage(hWnd, WM_SETICON, ICON_BIG, (LPARAM)icon);
+    MetricsStartupPhase(STARTUP_MAINWINDOW, llPhaseStart);
 
     // Taskbar icon
+    llPhaseStart = MetricsNow();
     nid.hWnd = hWnd;
     nid.uFlags = NIF_ICON | NIF_TIP | NIF_MESSAGE | NIF_SHOWTIP;
     nid.uCallbackMessage = WMAPP_NOTIFYCALLBACK;
     LoadIconMetric(hInst, MAKEINTRESOURCE(IDI_GLPIOK), LIM_LARGE, &nid.hIcon);
-    LoadString(hInst, IDS_GLPINOTIFY, nid.szTip, ARRAYSIZE(nid.szTip));
+    LoadCachedString(IDS_GLPINOTIFY, nid.szTip, ARRAYSIZE(nid.szTip));
     Shell_NotifyIcon(NIM_ADD, &nid);
     nid.uVersion = NOTIFYICON_VERSION_4;
     Shell_NotifyIcon(NIM_SETVERSION, &nid);
-
-    HBITMAP hLogo = nullptr;
-    LoadPNGAsBitmap(hInst, MAKEINTRESOURCE(IDB_LOGO), L"PNG", &hLogo);
-    SendMessage(GetDlgItem(hWnd, IDC_PCLOGO), STM_SETIMAGE, IMAGE_BITMAP, (LPARAM)hLogo);
-
-    WCHAR szVer[20];
-    wsprintf(szVer, L"v%d.%d.%d", dwVerMaj, dwVerMin, dwVerRev);
-    SetDlgItemText(hWnd, IDC_VERSION, szVer);
-
-    LoadString(hInst, IDS_APP_TITLE, szBuffer, dwBufferLen);
-    SetWindowText(hWnd, szBuffer);
-    SetDlgItemText(hWnd, IDC_STATIC_TITLE, szBuffer);
-
-    LoadString(hInst, IDS_STATIC_INFO, szBuffer, dwBufferLen);
-    SetDlgItemText(hWnd, IDC_GBMAIN, szBuffer);
-
-    LoadString(hInst, IDS_STATIC_AGENTVER, szBuffer, dwBufferLen);
-    SetDlgItemText(hWnd, IDC_STATIC_AGENTVER, szBuffer);
-    LoadString(hInst, IDS_STATIC_SERVICESTATUS, szBuffer, dwBufferLen);
-    SetDlgItemText(hWnd, IDC_STATIC_SERVICESTATUS, szBuffer);
-    LoadString(hInst, IDS_STATIC_STARTTYPE, szBuffer, dwBufferLen);
-    SetDlgItemText(hWnd, IDC_STATIC_STARTTYPE, szBuffer);
-
-    LoadString(hInst, IDS_LOADING, szBuffer, dwBufferLen);
-    SetDlgItemText(hWnd, IDC_AGENTVER, szBuffer);
-    SetDlgItemText(hWnd, IDC_SERVICESTATUS, szBuffer);
-    SetDlgItemText(hWnd, IDC_STARTTYPE, szBuffer);
-    SetDlgItemText(hWnd, IDC_AGENTSTATUS, szBuffer);
-
-    LoadString(hInst, IDS_STATIC_AGENTSTATUS, szBuffer, dwBufferLen);
-    SetDlgItemText(hWnd, IDC_GBSTATUS, szBuffer);
-
-    LoadString(hInst, IDS_FORCEINV, szBuffer, dwBufferLen);
-    SetDlgItemText(hWnd, IDC_BTN_FORCE, szBuffer);
-    LoadString(hInst, IDS_VIEWLOGS, szBuffer, dwBufferLen);
-    SetDlgItemText(hWnd, IDC_BTN_VIEWLOGS, szBuffer);
-    LoadString(hInst, IDS_NEWTICKET, szBuffer, dwBufferLen);
-    SetDlgItemText(hWnd, IDC_BTN_NEWTICKET, szBuffer);
-    LoadString(hInst, IDS_BTN_SETTINGS, szBuffer, dwBufferLen);
-    SetDlgItemText(hWnd, IDC_BTN_SETTINGS, szBuffer);
-    LoadString(hInst, IDS_CLOSE, szBuffer, dwBufferLen);
-    SetDlgItemText(hWnd, IDC_BTN_CLOSE, szBuffer);
-    LoadString(hInst, IDS_STARTSVC, szBuffer, dwBufferLen);
-    SetDlgItemText(hWnd, IDC_BTN_STARTSTOPSVC, szBuffer);
-
-    // Set UAC shields
-    SendMessage(GetDlgItem(hWnd, IDC_BTN_STARTSTOPSVC), BCM_SETSHIELD, 0, 1);
-    SendMessage(GetDlgItem(hWnd, IDC_BTN_SETTINGS), BCM_SETSHIELD, 0, 1);
+    MetricsStartupPhase(STARTUP_TRAYICON, llPhaseStart);
+
+    // Create the Agent client (WinHTTP) and the ticket queue (the tickets
+    // left queued are sent now)
+    llPhaseStart = MetricsNow();
+    DWORD dwVerMaj, dwVerMin, dwVerRev;
+    ReadMonitorVersion(&dwVerMaj, &dwVerMin, &dwVerRev);
+    CreateAgentClient(dwVerMaj, dwVerMin, dwVerRev);
+    WCHAR szUserAgent[64];
+    FormatUserAgent(szUserAgent, dwVerMaj, dwVerMin, dwVerRev);
+    TicketQueueInit(szUserAgent, hWnd, WMAPP_TICKETQUEUE);
+    SubmitTicket(NULL);
+    MetricsStartupPhase(STARTUP_CLIENTS, llPhaseStart);
 
     //-------------------------------------------------------------------------
 
-    UpdateStatus(hWnd, NULL, NULL, NULL);
-    UpdateServiceStatus(hWnd, NULL, NULL, NULL);
-    SetTimer(hWnd, IDT_UPDSTATUS, 2000, (TIMERPROC)UpdateStatus);
-    SetTimer(hWnd, IDT_UPDSVCSTATUS, 500, (TIMERPROC)UpdateServiceStatus);
+    // Start the probe worker, it publishes the statuses to this window
+    llPhaseStart = MetricsNow();
+    if (!StartProbeWorker(hWnd)) {
+        dwErr = GetLastError();
+        LoadStringAndMessageBox(hInst, NULL, IDS_ERR_MAINWINDOW, IDS_ERROR, MB_OK | MB_ICONERROR, dwErr);
+        return dwErr;
+    }
+    MetricsStartupPhase(STARTUP_PROBEWORKER, llPhaseStart);
+
+    // Serve the requests of the next instances started in this session
+    HandoffServerStart(OnHandoffRequest, hWnd);
+    if (bHandoffAction && handoffReq.wCommand == HANDOFF_CMD_FORCEINV)
+        PostMessage(hProbeWnd, WMAPP_FORCEINVENTORY, 0, 0);
 
     //-------------------------------------------------------------------------
 
@@ -950,6 +2745,44 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance
     return (int) msg.wParam;
 }
 
+// Enables or disables the settings dialog controls (while the settings are
+// being written by the elevated broker)
+VOID EnableSettingsDlg(HWND hWnd, BOOL bEnable)
+{
+    static const int nControls[] = { IDC_SETTINGS_EDIT_NEWTICKET_URL, IDC_SETTINGS_CHECKBOX_NEWTICKET_SCREENSHOT,
+        IDC_SETTINGS_BTN_SAVE, IDC_SETTINGS_BTN_CANCEL };
+    for (int nControl : nControls)
+        EnableWindow(GetDlgItem(hWnd, nControl), bEnable);
+}
+
+// Uses the settings saved by the settings dialog (lRes being the result of
+// their write) and closes it. The dialog is kept open if the write failed, or
+// if the user declined the UAC prompt.
+VOID OnSettingsSaved(HWND hWnd, const BrokerSettingsBody* pSettings, LONG lRes)
+{
+    if (lRes == ERROR_CANCELLED)
+        return;
+    if (lRes != ERROR_SUCCESS)
+    {
+        LoadStringAndMessageBox(hInst, hWnd, IDS_ERR_SAVE_SETTINGS, IDS_ERROR, MB_OK | MB_ICONERROR, lRes);
+        return;
+    }
+
+    // Use the default new ticket URL if the provided one is empty
+    AcquireSRWLockExclusive(&srwSettings);
+    if (!wcscmp(pSettings->szNewTicketURL, L"")) {
+        SetDefaultNewTicketURL();
+    }
+    else {
+        // Store new ticket URL in memory
+        wcscpy_s(szNewTicketURL, pSettings->szNewTicketURL);
+    }
+    bNewTicketScreenshot = pSettings->dwNewTicketScreenshot;
+    ReleaseSRWLockExclusive(&srwSettings);
+
+    PostMessage(hWnd, WM_CLOSE, 0, 0);
+}
+
 LRESULT CALLBACK SettingsDlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
     switch (message)
@@ -957,25 +2790,37 @@ LRESULT CALLBACK SettingsDlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM
         case WM_INITDIALOG:
         {
             // Initialize dialog strings
-            LoadString(hInst, IDS_SETTINGS, szBuffer, dwBufferLen);
+            LoadCachedString(IDS_SETTINGS, szBuffer, dwBufferLen);
             SetWindowText(hWnd, szBuffer);
-            LoadString(hInst, IDS_SETTINGS_NEWTICKET, szBuffer, dwBufferLen);
+            LoadCachedString(IDS_SETTINGS_NEWTICKET, szBuffer, dwBufferLen);
             SetDlgItemText(hWnd, IDC_SETTINGS_GROUPBOX_NEWTICKET, szBuffer);
-            LoadString(hInst, IDS_SETTINGS_NEWTICKET_URL, szBuffer, dwBufferLen);
+            LoadCachedString(IDS_SETTINGS_NEWTICKET_URL, szBuffer, dwBufferLen);
             SetDlgItemText(hWnd, IDC_SETTINGS_TEXT_NEWTICKET_URL, szBuffer);
-            LoadString(hInst, IDS_SETTINGS_NEWTICKET_SCREENSHOT, szBuffer, dwBufferLen);
+            LoadCachedString(IDS_SETTINGS_NEWTICKET_SCREENSHOT, szBuffer, dwBufferLen);
             SetDlgItemText(hWnd, IDC_SETTINGS_CHECKBOX_NEWTICKET_SCREENSHOT, szBuffer);
-            LoadString(hInst, IDS_CANCEL, szBuffer, dwBufferLen);
+            LoadCachedString(IDS_CANCEL, szBuffer, dwBufferLen);
             SetDlgItemText(hWnd, IDC_SETTINGS_BTN_CANCEL, szBuffer);
-            LoadString(hInst, IDS_SAVE, szBuffer, dwBufferLen);
+            LoadCachedString(IDS_SAVE, szBuffer, dwBufferLen);
             SetDlgItemText(hWnd, IDC_SETTINGS_BTN_SAVE, szBuffer);
 
             // Fill values
+            AcquireSRWLockShared(&srwSettings);
             SendDlgItemMessage(hWnd, IDC_SETTINGS_EDIT_NEWTICKET_URL, WM_SETTEXT, 0, (LPARAM)szNewTicketURL);
             SendDlgItemMessage(hWnd, IDC_SETTINGS_CHECKBOX_NEWTICKET_SCREENSHOT, BM_SETCHECK, (bNewTicketScreenshot ? BST_CHECKED : BST_UNCHECKED), 0);
+            ReleaseSRWLockShared(&srwSettings);
 
             return TRUE;
         }
+        // Settings written by the elevated broker
+        case WMAPP_BROKERRESULT:
+        {
+            if (wParam == BROKER_CMD_SETTINGS && bBrokerSettingsPending) {
+                bBrokerSettingsPending = FALSE;
+                EnableSettingsDlg(hWnd, TRUE);
+                OnSettingsSaved(hWnd, &brokerSettings, (LONG)lParam);
+            }
+            return TRUE;
+        }
         case WM_COMMAND:
         {
             switch (LOWORD(wParam))
@@ -986,88 +2831,38 @@ LRESULT CALLBACK SettingsDlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM
                     return TRUE;
                 case IDC_SETTINGS_BTN_SAVE:
                 {
-                    HKEY hk, hkMonitor;
-                    LONG lRes;
-                    WCHAR szKey[MAX_PATH];
-
                     // Get settings from dialog
-                    WCHAR szTempNewTicketURL[300];
+                    BrokerSettingsBody settings = {};
                     LRESULT copiedChars = SendMessage(GetDlgItem(hWnd, IDC_SETTINGS_EDIT_NEWTICKET_URL), WM_GETTEXT,
-                        sizeof(szTempNewTicketURL), (LPARAM)szTempNewTicketURL);
-                    szTempNewTicketURL[copiedChars] = '\0';
-                    BOOL bTempNewTicketScreenshot = IsDlgButtonChecked(hWnd, IDC_SETTINGS_CHECKBOX_NEWTICKET_SCREENSHOT);
-
-                    // Save settings in registry
-                    wsprintf(szKey, L"SOFTWARE\\%s", SERVICE_NAME);
-                    lRes = RegOpenKeyEx(HKEY_LOCAL_MACHINE, szKey, 0, KEY_WRITE | KEY_WOW64_64KEY, &hk);
-                    if (lRes != ERROR_SUCCESS)
-                    {
-                        if (lRes == ERROR_FILE_NOT_FOUND)
-                        {
-                            wsprintf(szKey, L"SOFTWARE\\WOW6432Node\\%s", SERVICE_NAME);
-                            lRes = RegOpenKeyEx(HKEY_LOCAL_MACHINE, szKey, 0, KEY_WRITE | KEY_WOW64_64KEY, &hk);
-                            if (lRes != ERROR_SUCCESS)
-                            {
-                                LoadStringAndMessageBox(hInst, hWnd, IDS_ERR_SAVE_SETTINGS, IDS_ERROR, MB_OK | MB_ICONERROR, lRes);
-                                return FALSE;
-                            }
-                        }
-                        else {
-                            LoadStringAndMessageBox(hInst, hWnd, IDS_ERR_SAVE_SETTINGS, IDS_ERROR, MB_OK | MB_ICONERROR, lRes);
-                            return FALSE;
-                        }
-                    }
-                    wsprintf(szKey, L"%s\\Monitor", szKey);
-                    lRes = RegOpenKeyEx(HKEY_LOCAL_MACHINE, szKey, 0, KEY_WRITE | KEY_WOW64_64KEY, &hkMonitor);
-                    if (lRes != ERROR_SUCCESS)
-                    {
-                        lRes = RegCreateKeyEx(hk, L"Monitor", 0, NULL, REG_OPTION_NON_VOLATILE, KEY_WRITE, NULL, &hkMonitor, NULL);
-                        if (lRes != ERROR_SUCCESS)
-                        {
-                            LoadStringAndMessageBox(hInst, hWnd, IDS_ERR_SAVE_SETTINGS, IDS_ERROR, MB_OK | MB_ICONERROR, lRes);
-                            return FALSE;
-                        }
-                    }
-
-                    // Save new ticket URL if it was changed
-                    if (wcscmp(szTempNewTicketURL, szNewTicketURL) != 0)
-                    {
-                        size_t szTempNewTicketURLLen = wcslen(szTempNewTicketURL) * sizeof(WCHAR);
-                        lRes = RegSetValueEx(hkMonitor, L"NewTicket-URL", 0, REG_SZ, (LPBYTE)szTempNewTicketURL, (DWORD)szTempNewTicketURLLen);
-                        if (lRes != ERROR_SUCCESS)
-                        {
-                            LoadStringAndMessageBox(hInst, hWnd, IDS_ERR_SAVE_SETTINGS, IDS_ERROR, MB_OK | MB_ICONERROR, lRes);
-                            return FALSE;
-                        }
-                    }
-
-                    // Save new ticket screenshot setting if it was changed
-                    // Save new ticket URL if it was changed
-                    if (bTempNewTicketScreenshot != bNewTicketScreenshot)
-                    {
-                        lRes = RegSetValueEx(hkMonitor, L"NewTicket-Screenshot", 0, REG_DWORD,
-                            (LPBYTE)&bTempNewTicketScreenshot, sizeof(bTempNewTicketScreenshot));
-                        if (lRes != ERROR_SUCCESS)
-                        {
-                            LoadStringAndMessageBox(hInst, hWnd, IDS_ERR_SAVE_SETTINGS, IDS_ERROR, MB_OK | MB_ICONERROR, lRes);
-                            return FALSE;
+                        ARRAYSIZE(settings.szNewTicketURL), (LPARAM)settings.szNewTicketURL);
+                    settings.szNewTicketURL[copiedChars] = '\0';
+                    settings.dwNewTicketScreenshot = (IsDlgButtonChecked(hWnd, IDC_SETTINGS_CHECKBOX_NEWTICKET_SCREENSHOT) == BST_CHECKED);
+
+                    // Only the changed settings are saved
+                    AcquireSRWLockShared(&srwSettings);
+                    if (wcscmp(settings.szNewTicketURL, szNewTicketURL) != 0)
+                        settings.dwMask |= BROKER_SETTINGS_NEWTICKET_URL;
+                    if (settings.dwNewTicketScreenshot != (DWORD)bNewTicketScreenshot)
+                        settings.dwMask |= BROKER_SETTINGS_NEWTICKET_SCREENSHOT;
+                    ReleaseSRWLockShared(&srwSettings);
+
+                    // Save settings in registry, through the elevated broker if
+                    // this instance isn't elevated (off the UI thread, as the
+                    // first write waits for the UAC prompt)
+                    LONG lRes = ERROR_SUCCESS;
+                    if (settings.dwMask != 0 && bElevationBroker && !IsUserAnAdmin()) {
+                        brokerSettings = settings;
+                        if (TrySubmitThreadpoolCallback(RunBrokerSettingsWrite, hWnd, NULL)) {
+                            bBrokerSettingsPending = TRUE;
+                            EnableSettingsDlg(hWnd, FALSE);
+                            return TRUE;
                         }
+                        lRes = GetLastError();
                     }
-
-                    RegCloseKey(hkMonitor);
-                    RegCloseKey(hk);
-
-                    // Use the default new ticket URL if the provided one is empty
-                    if (!wcscmp(szTempNewTicketURL, L"")) {
-                        wsprintf(szNewTicketURL, L"%s/front/ticket.form.php", szServer);
-                    }
-                    else {
-                        // Store new ticket URL in memory
-                        wcscpy_s(szNewTicketURL, szTempNewTicketURL);
+                    else if (settings.dwMask != 0) {
+                        lRes = WriteMonitorSettings(&settings);
                     }
-                    bNewTicketScreenshot = bTempNewTicketScreenshot;
-
-                    PostMessage(hWnd, WM_CLOSE, 0, 0);
+                    OnSettingsSaved(hWnd, &settings, lRes);
                     return TRUE;
                 }
                 case IDC_SETTINGS_BTN_CANCEL:
@@ -1077,6 +2872,9 @@ LRESULT CALLBACK SettingsDlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM
         }
         case WM_CLOSE:
         {
+            // Kept open until the settings being written are reported
+            if (bBrokerSettingsPending)
+                return TRUE;
             if (wcsstr(szCmdLine, L"/openSettings") != nullptr)
             {
                 DestroyWindow(hWnd);
@@ -1091,6 +2889,200 @@ LRESULT CALLBACK SettingsDlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM
     return FALSE;
 }
 
+LRESULT CALLBACK HistoryDlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    switch (message)
+    {
+        case WM_INITDIALOG:
+        {
+            // Initialize dialog strings
+            LoadCachedString(IDS_HISTORY_TITLE, szBuffer, dwBufferLen);
+            SetWindowText(hWnd, szBuffer);
+            LoadCachedString(IDS_CLOSE, szBuffer, dwBufferLen);
+            SetDlgItemText(hWnd, IDC_HISTORY_BTN_CLOSE, szBuffer);
+
+            // Timeline columns (the event one takes the remaining width)
+            HWND hList = GetDlgItem(hWnd, IDC_HISTORY_LIST);
+            ListView_SetExtendedListViewStyle(hList, LVS_EX_FULLROWSELECT | LVS_EX_DOUBLEBUFFER);
+            RECT rcTime = { 0, 0, 90, 0 };
+            MapDialogRect(hWnd, &rcTime);
+            LVCOLUMN lvc = {};
+            lvc.mask = LVCF_TEXT | LVCF_WIDTH;
+            lvc.pszText = szBuffer;
+            LoadCachedString(IDS_HISTORY_TIME, szBuffer, dwBufferLen);
+            lvc.cx = rcTime.right;
+            ListView_InsertColumn(hList, 0, &lvc);
+            LoadCachedString(IDS_HISTORY_EVENT, szBuffer, dwBufferLen);
+            ListView_InsertColumn(hList, 1, &lvc);
+            ListView_SetColumnWidth(hList, 1, LVSCW_AUTOSIZE_USEHEADER);
+
+            // Decode the history once, the list only formats the visible entries
+            DWORD dwCount = HistoryGetCount();
+            pHistoryEntries = new HistoryEntry[max(dwCount, (DWORD)1)];
+            dwHistoryEntries = HistoryCopy(pHistoryEntries, dwCount);
+            ListView_SetItemCountEx(hList, dwHistoryEntries, 0);
+            return TRUE;
+        }
+        case WM_NOTIFY:
+        {
+            // Timeline entries, newest first
+            NMLVDISPINFO* pDispInfo = (NMLVDISPINFO*)lParam;
+            if (pDispInfo->hdr.idFrom != IDC_HISTORY_LIST || pDispInfo->hdr.code != LVN_GETDISPINFO)
+                break;
+            if ((pDispInfo->item.mask & LVIF_TEXT) && (DWORD)pDispInfo->item.iItem < dwHistoryEntries)
+            {
+                const HistoryEntry* pEntry = &pHistoryEntries[dwHistoryEntries - 1 - pDispInfo->item.iItem];
+                if (pDispInfo->item.iSubItem == 0)
+                    FormatHistoryTime(pEntry, pDispInfo->item.pszText, pDispInfo->item.cchTextMax);
+                else
+                    FormatHistoryEvent(pEntry, pDispInfo->item.pszText, pDispInfo->item.cchTextMax);
+            }
+            return TRUE;
+        }
+        case WM_COMMAND:
+        {
+            switch (LOWORD(wParam))
+            {
+                case IDC_HISTORY_BTN_CLOSE:
+                case IDCANCEL:
+                    EndDialog(hWnd, 0);
+                    return TRUE;
+            }
+            break;
+        }
+        case WM_DESTROY:
+            delete[] pHistoryEntries;
+            pHistoryEntries = NULL;
+            dwHistoryEntries = 0;
+            break;
+    }
+    return FALSE;
+}
+
+LRESULT CALLBACK LogsDlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    switch (message)
+    {
+        case WM_INITDIALOG:
+        {
+            if (!StartLogTailer(hWnd)) {
+                LoadStringAndMessageBox(hInst, hWnd, IDS_ERR_LOGFILE, IDS_ERROR, MB_OK | MB_ICONERROR, GetLastError());
+                EndDialog(hWnd, 0);
+                return TRUE;
+            }
+
+            // Initialize dialog strings
+            LoadCachedString(IDS_LOGS_TITLE, szBuffer, dwBufferLen);
+            SetWindowText(hWnd, szBuffer);
+            LoadCachedString(IDS_LOGS_SEVERITY, szBuffer, dwBufferLen);
+            SetDlgItemText(hWnd, IDC_LOGS_STATIC_SEVERITY, szBuffer);
+            LoadCachedString(IDS_LOGS_PERIOD, szBuffer, dwBufferLen);
+            SetDlgItemText(hWnd, IDC_LOGS_STATIC_PERIOD, szBuffer);
+            LoadCachedString(IDS_LOGS_OPENFILE, szBuffer, dwBufferLen);
+            SetDlgItemText(hWnd, IDC_LOGS_BTN_OPEN, szBuffer);
+            LoadCachedString(IDS_CLOSE, szBuffer, dwBufferLen);
+            SetDlgItemText(hWnd, IDC_LOGS_BTN_CLOSE, szBuffer);
+
+            // Filters (in the order of UpdateLogView tables)
+            for (UINT uResId = IDS_LOGS_SEV_ALL; uResId <= IDS_LOGS_SEV_DEBUG; uResId++) {
+                LoadCachedString(uResId, szBuffer, dwBufferLen);
+                SendDlgItemMessage(hWnd, IDC_LOGS_SEVERITY, CB_ADDSTRING, 0, (LPARAM)szBuffer);
+            }
+            for (UINT uResId = IDS_LOGS_PERIOD_ALL; uResId <= IDS_LOGS_PERIOD_WEEK; uResId++) {
+                LoadCachedString(uResId, szBuffer, dwBufferLen);
+                SendDlgItemMessage(hWnd, IDC_LOGS_PERIOD, CB_ADDSTRING, 0, (LPARAM)szBuffer);
+            }
+            SendDlgItemMessage(hWnd, IDC_LOGS_SEVERITY, CB_SETCURSEL, 0, 0);
+            SendDlgItemMessage(hWnd, IDC_LOGS_PERIOD, CB_SETCURSEL, 0, 0);
+
+            // Single column, as wide as the list
+            HWND hList = GetDlgItem(hWnd, IDC_LOGS_LIST);
+            ListView_SetExtendedListViewStyle(hList, LVS_EX_FULLROWSELECT | LVS_EX_DOUBLEBUFFER);
+            LVCOLUMN lvc = {};
+            lvc.mask = LVCF_WIDTH;
+            ListView_InsertColumn(hList, 0, &lvc);
+            ListView_SetColumnWidth(hList, 0, LVSCW_AUTOSIZE_USEHEADER);
+
+            UpdateLogView(hWnd, TRUE);
+            return TRUE;
+        }
+        case WMAPP_LOGINDEXED:
+        {
+            // The logfile was rotated or truncated: read the new one from the start
+            InterlockedExchange(&lLogIndexPosted, 0);
+            BOOL bReset = InterlockedExchange(&lLogIndexReset, 0);
+            if (bReset) {
+                HANDLE hFile = OpenLogfile();
+                if (hFile != INVALID_HANDLE_VALUE) {
+                    CloseHandle(hLogReadFile);
+                    hLogReadFile = hFile;
+                }
+            }
+            UpdateLogView(hWnd, bReset);
+            return TRUE;
+        }
+        case WM_NOTIFY:
+        {
+            LPNMHDR pHdr = (LPNMHDR)lParam;
+            if (pHdr->idFrom != IDC_LOGS_LIST)
+                break;
+            if (pHdr->code == LVN_GETDISPINFO) {
+                NMLVDISPINFO* pDispInfo = (NMLVDISPINFO*)lParam;
+                if (pDispInfo->item.mask & LVIF_TEXT)
+                    ReadLogLine(GetLogViewLine(pDispInfo->item.iItem), pDispInfo->item.pszText, pDispInfo->item.cchTextMax);
+                return TRUE;
+            }
+            if (pHdr->code == NM_CUSTOMDRAW) {
+                // Errors, warnings and debug lines colors
+                LPNMLVCUSTOMDRAW pCustomDraw = (LPNMLVCUSTOMDRAW)lParam;
+                LRESULT lRes = CDRF_DODEFAULT;
+                if (pCustomDraw->nmcd.dwDrawStage == CDDS_PREPAINT)
+                    lRes = CDRF_NOTIFYITEMDRAW;
+                else if (pCustomDraw->nmcd.dwDrawStage == CDDS_ITEMPREPAINT) {
+                    ULONGLONG ullStart, ullEnd;
+                    BYTE bSeverity = LOGSEV_NONE;
+                    AcquireSRWLockShared(&srwLogIndex);
+                    LogIndexGetLine(&logIndex, GetLogViewLine((int)pCustomDraw->nmcd.dwItemSpec), &ullStart, &ullEnd, &bSeverity);
+                    ReleaseSRWLockShared(&srwLogIndex);
+                    if (bSeverity == LOGSEV_ERROR)
+                        pCustomDraw->clrText = RGB(255, 0, 0);
+                    else if (bSeverity == LOGSEV_WARNING)
+                        pCustomDraw->clrText = RGB(255, 165, 0);
+                    else if (bSeverity >= LOGSEV_DEBUG)
+                        pCustomDraw->clrText = RGB(128, 128, 128);
+                }
+                SetWindowLongPtr(hWnd, DWLP_MSGRESULT, lRes);
+                return TRUE;
+            }
+            break;
+        }
+        case WM_COMMAND:
+        {
+            switch (LOWORD(wParam))
+            {
+                case IDC_LOGS_SEVERITY:
+                case IDC_LOGS_PERIOD:
+                    if (HIWORD(wParam) == CBN_SELCHANGE)
+                        UpdateLogView(hWnd, TRUE);
+                    return TRUE;
+                // Open in the default viewer anyway
+                case IDC_LOGS_BTN_OPEN:
+                    ShellExecute(NULL, L"open", szLogViewFile, NULL, NULL, SW_SHOWNORMAL);
+                    return TRUE;
+                case IDC_LOGS_BTN_CLOSE:
+                case IDCANCEL:
+                    EndDialog(hWnd, 0);
+                    return TRUE;
+            }
+            break;
+        }
+        case WM_DESTROY:
+            StopLogTailer();
+            break;
+    }
+    return FALSE;
+}
+
 LRESULT CALLBACK DlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
     switch (message)
@@ -1101,28 +3093,39 @@ LRESULT CALLBACK DlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
             {
                 // Start/stop/resume service
                 case IDC_BTN_STARTSTOPSVC:
-                    WCHAR szFilename[MAX_PATH];
-                    WCHAR szOperation[16];
-                    GetModuleFileName(NULL, szFilename, MAX_PATH);
-                    switch(svcStatus.dwCurrentState) {
+                {
+                    DWORD dwOperation;
+                    LPCWSTR szOperation;
+                    switch(shownSnapshot.dwSvcState) {
                         case SERVICE_RUNNING:
-                            wsprintf(szOperation, L"/stopSvc");
+                            dwOperation = HANDOFF_SVC_STOP;
+                            szOperation = L"/stopSvc";
                             break;
                         case SERVICE_PAUSED:
-                            wsprintf(szOperation, L"/continueSvc");
+                            dwOperation = HANDOFF_SVC_CONTINUE;
+                            szOperation = L"/continueSvc";
                             break;
                         case SERVICE_STOPPED:
-                            wsprintf(szOperation, L"/startSvc");
+                            dwOperation = HANDOFF_SVC_START;
+                            szOperation = L"/startSvc";
                             break;
                         default:
                             return FALSE;
                     }
+                    if (bElevationBroker) {
+                        if (!TrySubmitThreadpoolCallback(RunBrokerServiceOperation, (PVOID)(ULONG_PTR)dwOperation, NULL))
+                            LoadStringAndMessageBox(hInst, hWnd, IDS_ERR_SVCOPERATION, IDS_ERROR, MB_OK | MB_ICONERROR, GetLastError());
+                        return TRUE;
+                    }
+                    WCHAR szFilename[MAX_PATH];
+                    GetModuleFileName(NULL, szFilename, MAX_PATH);
                     ShellExecute(hWnd, L"runas", szFilename, szOperation, NULL, SW_HIDE);
                     return TRUE;
+                }
                 // Force inventory
                 case IDC_BTN_FORCE:
                 case ID_RMENU_FORCE:
-                    ForceInventory(hWnd);
+                    RequestInventory(hWnd);
                     return TRUE;
                 // Close
                 case IDCANCEL:  // This handles ESC key pressing via IsDialogMessage
@@ -1132,37 +3135,68 @@ LRESULT CALLBACK DlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
                 // Open
                 case ID_RMENU_OPEN:
                     ShowWindowFront(hWnd, SW_SHOW);
-                    UpdateStatus(hWnd, NULL, NULL, NULL);
+                    RefreshStatus();
                     return TRUE;
                 // View logs
                 case IDC_BTN_VIEWLOGS:
                 case ID_RMENU_VIEWLOGS:
-                    ShellExecute(NULL, L"open", szLogfile, NULL, NULL, SW_SHOWNORMAL);
+                {
+                    INITCOMMONCONTROLSEX icc = { sizeof(icc), ICC_LISTVIEW_CLASSES };
+                    InitCommonControlsEx(&icc);
+                    DialogBox(hInst, MAKEINTRESOURCE(IDD_DLG_LOGS), hWnd, (DLGPROC)LogsDlgProc);
+                    return TRUE;
+                }
+                // Status history
+                case IDC_BTN_HISTORY:
+                {
+                    INITCOMMONCONTROLSEX icc = { sizeof(icc), ICC_LISTVIEW_CLASSES };
+                    InitCommonControlsEx(&icc);
+                    DialogBox(hInst, MAKEINTRESOURCE(IDD_DLG_HISTORY), hWnd, (DLGPROC)HistoryDlgProc);
                     return TRUE;
+                }
                 // New ticket
                 case IDC_BTN_NEWTICKET:
                     EndDialog(hWnd, NULL);
                 case ID_RMENU_NEWTICKET: {
-                    if (bNewTicketScreenshot) {
-                        // Take screenshot to clipboard (simulating PrintScreen)
-                        INPUT ipInput[2] = { 0 };
-                        Sleep(300);
-                        ipInput[0].type = INPUT_KEYBOARD;
-                        ipInput[0].ki.wVk = VK_SNAPSHOT;
-                        ipInput[1] = ipInput[0];
-                        ipInput[1].ki.dwFlags |= KEYEVENTF_KEYUP;
-                        SendInput(2, ipInput, sizeof(INPUT));
-                    }
-                    // Open the new ticket URL
-                    ShellExecute(NULL, L"open", szNewTicketURL, NULL, NULL, SW_SHOWNORMAL);
-
-                    if (bNewTicketScreenshot) {
-                        // Notify user that a screenshot is in the clipboard
-                        nid.uFlags |= NIF_INFO;
-                        LoadString(hInst, IDS_NOTIF_NEWTICKET_TITLE, nid.szInfoTitle, sizeof(nid.szInfoTitle) / sizeof(WCHAR));
-                        LoadString(hInst, IDS_NOTIF_NEWTICKET, nid.szInfo, sizeof(nid.szInfo) / sizeof(WCHAR));
-                        Shell_NotifyIcon(NIM_MODIFY, &nid);
+                    WCHAR szNewTicketURLBuf[300];
+                    AcquireSRWLockShared(&srwSettings);
+                    wcscpy_s(szNewTicketURLBuf, szNewTicketURL);
+                    BOOL bScreenshot = bNewTicketScreenshot;
+                    BOOL bTicketApi = (ticketApiConfig.szApiUrl[0] != '\0');
+                    ReleaseSRWLockShared(&srwSettings);
+
+                    // Capture the screen before the browser shows up, it's saved
+                    // in the background (see WMAPP_SCREENSHOT)
+                    Screenshot* pShot = (bScreenshot ? ScreenshotCapture() : NULL);
+
+                    // Create the ticket through the GLPI REST API (once its
+                    // screenshot is saved), or open the new ticket URL
+                    // (the registry value may have been set by other means than the
+                    // settings dialog, only a web URL is opened)
+                    TicketDraft* pDraft = NULL;
+                    if (bTicketApi)
+                        pDraft = CreateTicketDraft(hWnd);
+                    else if (BrokerIsWebUrl(szNewTicketURLBuf))
+                        ShellExecute(NULL, L"open", szNewTicketURLBuf, NULL, NULL, SW_SHOWNORMAL);
+                    else
+                        LoadStringAndShowNotification(IDS_RMENU_NEWTICKET, IDS_ERR_TICKET, NIIF_ERROR, ERROR_INVALID_PARAMETER);
+
+                    if (bScreenshot) {
+                        WCHAR szFile[MAX_PATH];
+                        if (pShot == NULL || !GetScreenshotPath(szFile, ARRAYSIZE(szFile)) ||
+                            !ScreenshotSave(pShot, szFile, hWnd, WMAPP_SCREENSHOT)) {
+                            if (pShot != NULL)
+                                ScreenshotFree(pShot);
+                            LoadStringAndShowNotification(IDS_RMENU_NEWTICKET, IDS_ERR_SCREENSHOT, NIIF_ERROR);
+                        }
+                        else if (pDraft != NULL) {
+                            wcscpy_s(pDraft->szScreenshot, szFile);
+                            screenshotDrafts.push_back(pDraft);
+                            pDraft = NULL;
+                        }
                     }
+                    if (pDraft != NULL)
+                        SubmitTicket(pDraft);
 
                     return TRUE;
                 }
@@ -1170,12 +3204,12 @@ LRESULT CALLBACK DlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
                 case ID_RMENU_SETTINGS:
                 case IDC_BTN_SETTINGS:
                 {
-                    if(IsUserAnAdmin()) 
+                    if(IsUserAnAdmin() || bElevationBroker) 
                     {
                         if (LOWORD(wParam) == ID_RMENU_SETTINGS)
                         {
                             ShowWindowFront(hWnd, SW_SHOW);
-                            UpdateStatus(hWnd, NULL, NULL, NULL);
+                            RefreshStatus();
                         }
                         DialogBox(hInst, MAKEINTRESOURCE(IDD_DLG_SETTINGS), hWnd, (DLGPROC)SettingsDlgProc);
                     }
@@ -1193,11 +3227,12 @@ LRESULT CALLBACK DlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
                         sei.lpVerb = L"runas";
                         sei.nShow = SW_SHOWNORMAL;
 
-                        // Execute, wait for the window to close and reload settings
+                        // Execute, wait for the window to close and let the probe worker reload
+                        // the settings (if the registry change couldn't be notified)
                         if (ShellExecuteEx(&sei) && sei.hProcess != 0) {
                             WaitForSingleObject(sei.hProcess, INFINITE);
                             CloseHandle(sei.hProcess);
-                            LoadMonitorSettings();
+                            RefreshStatus();
                         }
                     }
                     return TRUE;
@@ -1217,7 +3252,7 @@ LRESULT CALLBACK DlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
             switch(GetDlgCtrlID((HWND)lParam))
             {
                 case IDC_SERVICESTATUS:
-                    SetTextColor(hdc, colorSvcStatus);
+                    SetTextColor(hdc, bSnapshotShown ? GetSvcStateDisplay(&shownSnapshot)->color : RGB(0, 0, 0));
                     return (LRESULT)GetSysColorBrush(COLOR_MENU);
             }
             break;
@@ -1230,7 +3265,15 @@ LRESULT CALLBACK DlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
                 // Left click
                 case NIN_SELECT:
                     ShowWindowFront(hWnd, SW_SHOW);
-                    UpdateStatus(hWnd, NULL, NULL, NULL);
+                    RefreshStatus();
+                    return TRUE;
+                // Notification click (shows the screenshot saved or the ticket
+                // created, if it's the notification clicked)
+                case NIN_BALLOONUSERCLICK:
+                    if (notifyClickAction == NOTIFYCLICK_SCREENSHOT)
+                        ShowScreenshotFile();
+                    else if (notifyClickAction == NOTIFYCLICK_TICKET)
+                        ShowTicket(dwNotifiedTicketId);
                     return TRUE;
                 // Right click
                 case WM_CONTEXTMENU:
@@ -1243,23 +3286,17 @@ LRESULT CALLBACK DlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
                         GetMenuItemInfo(hMenu, ID_RMENU_OPEN, false, &mi);
                         mi.fMask = MIIM_TYPE | MIIM_DATA;
 
-                        LoadString(hInst, IDS_RMENU_OPEN, szBuffer, dwBufferLen);
-                        mi.dwTypeData = szBuffer;
+                        mi.dwTypeData = (LPWSTR)GetString(IDS_RMENU_OPEN);
                         SetMenuItemInfo(hMenu, ID_RMENU_OPEN, false, &mi);
-                        LoadString(hInst, IDS_RMENU_FORCE, szBuffer, dwBufferLen);
-                        mi.dwTypeData = szBuffer;
+                        mi.dwTypeData = (LPWSTR)GetString(IDS_RMENU_FORCE);
                         SetMenuItemInfo(hMenu, ID_RMENU_FORCE, false, &mi);
-                        LoadString(hInst, IDS_RMENU_VIEWLOGS, szBuffer, dwBufferLen);
-                        mi.dwTypeData = szBuffer;
+                        mi.dwTypeData = (LPWSTR)GetString(IDS_RMENU_VIEWLOGS);
                         SetMenuItemInfo(hMenu, ID_RMENU_VIEWLOGS, false, &mi);
-                        LoadString(hInst, IDS_RMENU_NEWTICKET, szBuffer, dwBufferLen);
-                        mi.dwTypeData = szBuffer;
+                        mi.dwTypeData = (LPWSTR)GetString(IDS_RMENU_NEWTICKET);
                         SetMenuItemInfo(hMenu, ID_RMENU_NEWTICKET, false, &mi);
-                        LoadString(hInst, IDS_RMENU_SETTINGS, szBuffer, dwBufferLen);
-                        mi.dwTypeData = szBuffer;
+                        mi.dwTypeData = (LPWSTR)GetString(IDS_RMENU_SETTINGS);
                         SetMenuItemInfo(hMenu, ID_RMENU_SETTINGS, false, &mi);
-                        LoadString(hInst, IDS_RMENU_EXIT, szBuffer, dwBufferLen);
-                        mi.dwTypeData = szBuffer;
+                        mi.dwTypeData = (LPWSTR)GetString(IDS_RMENU_EXIT);
                         SetMenuItemInfo(hMenu, ID_RMENU_EXIT, false, &mi);
 
                         // Set UAC shield (a bit ugly, especially in Windows 11)
@@ -1295,6 +3332,58 @@ LRESULT CALLBACK DlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
             }
             break;
         }
+        // Main window content, built when it's first shown
+        case WM_SHOWWINDOW:
+            if (wParam)
+                InitMainWindowContent(hWnd);
+            break;
+        // Status published by the probe worker
+        case WMAPP_STATUS:
+            OnStatusPublished(hWnd);
+            return TRUE;
+        // New ticket screenshot saved
+        case WMAPP_SCREENSHOT:
+        {
+            Screenshot* pShot = (Screenshot*)lParam;
+            // Ticket draft waiting for this screenshot, if created through the API
+            TicketDraft* pDraft = NULL;
+            for (auto it = screenshotDrafts.begin(); it != screenshotDrafts.end(); it++) {
+                if (_wcsicmp((*it)->szScreenshot, pShot->szFile) == 0) {
+                    pDraft = *it;
+                    screenshotDrafts.erase(it);
+                    break;
+                }
+            }
+
+            if (pShot->dwError != ERROR_SUCCESS) {
+                LoadStringAndShowNotification(IDS_RMENU_NEWTICKET, IDS_ERR_SCREENSHOT, NIIF_ERROR);
+                if (pDraft != NULL)
+                    pDraft->szScreenshot[0] = '\0';
+            }
+            else if (pDraft == NULL) {
+                LoadStringAndShowNotification(IDS_NOTIF_NEWTICKET_TITLE, IDS_NOTIF_NEWTICKET, NIIF_NONE);
+                wcscpy_s(szScreenshotFile, pShot->szFile);
+                notifyClickAction = NOTIFYCLICK_SCREENSHOT;
+            }
+            if (pDraft != NULL)
+                SubmitTicket(pDraft);
+            ScreenshotFree(pShot);
+            return TRUE;
+        }
+        // Elevated broker service operation done (errors are reported, but
+        // not the UAC prompt being declined)
+        case WMAPP_BROKERRESULT:
+            if (wParam == BROKER_CMD_SERVICE && lParam != ERROR_SUCCESS && lParam != ERROR_CANCELLED)
+                LoadStringAndMessageBox(hInst, hWnd, IDS_ERR_SVCOPERATION, IDS_ERROR, MB_OK | MB_ICONERROR, (DWORD)lParam);
+            return TRUE;
+        // Ticket queue run done
+        case WMAPP_TICKETQUEUE:
+        {
+            TicketQueueResult* pResult = (TicketQueueResult*)lParam;
+            OnTicketQueueResult(pResult);
+            delete pResult;
+            return TRUE;
+        }
         // Restart Manager
         case WM_QUERYENDSESSION:
         {
@@ -1323,10 +3412,17 @@ LRESULT CALLBACK DlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
         }
         case WM_DESTROY:
         {
-            WinHttpCloseHandle(hConn);
-            WinHttpCloseHandle(hSession);
-
-            Gdiplus::GdiplusShutdown(gdiplusToken);
+            HandoffServerStop();
+            BrokerClientStop();
+            StopProbeWorker();
+            AgentClientClose();
+            TicketQueueClose();
+            for (TicketDraft* pDraft : screenshotDrafts)
+                delete pDraft;
+            screenshotDrafts.clear();
+
+            if (gdiplusToken != 0)
+                Gdiplus::GdiplusShutdown(gdiplusToken);
 
             // Remove taskbar icon
             Shell_NotifyIcon(NIM_DELETE, &nid);
@@ -1342,3 +3438,95 @@ LRESULT CALLBACK DlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
     return FALSE;
 }
 
+LRESULT CALLBACK ProbeWndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    switch (message)
+    {
+        // Agent service status change (SCM notification)
+        case WMAPP_SVCNOTIFY:
+            OnServiceNotify(hWnd, (DWORD)wParam, lParam);
+            break;
+        // Registry change notification
+        case WMAPP_REGNOTIFY:
+            OnRegistryChange(hWnd, (int)wParam);
+            break;
+        // Agent response
+        case WMAPP_AGENTRESPONSE:
+        {
+            AgentResponse* pResp = (AgentResponse*)lParam;
+            OnAgentResponse(hWnd, pResp);
+            delete pResp;
+            break;
+        }
+        // Status refresh requested by the main window
+        case WMAPP_REFRESH:
+            UpdateStatus(hWnd);
+            break;
+        // Forced inventory requested by the main window
+        case WMAPP_FORCEINVENTORY:
+            ForceInventory(hWnd);
+            break;
+        // Outbox action done by the main window (ticket queue run)
+        case WMAPP_OUTBOXRESULT:
+            if (wParam == OUTBOX_ACTION_TICKETS)
+                OnTicketsResult(hWnd, (OutboxResult)lParam);
+            break;
+        // Service operation handed by a new Monitor instance (sent by the
+        // handoff server thread, which gets its result)
+        case WMAPP_SERVICEOPERATION:
+        {
+            UINT uErrResId;
+            DWORD dwErr = ControlAgentService((DWORD)wParam, &uErrResId);
+            UpdateServiceStatus(hWnd);
+            PublishStatus();
+            return dwErr;
+        }
+        // Status publishing retry (the scheduler timer has its own callback)
+        case WM_TIMER:
+            if (wParam != IDT_PUBLISH)
+                return DefWindowProc(hWnd, message, wParam, lParam);
+            KillTimer(hWnd, IDT_PUBLISH);
+            break;
+        case WM_DESTROY:
+            PostQuitMessage(0);
+            return 0;
+        default:
+            return DefWindowProc(hWnd, message, wParam, lParam);
+    }
+
+    // Anything handled above may have changed the status
+    PublishStatus();
+    return 0;
+}
+
+LRESULT CALLBACK HeadlessWndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    switch (message)
+    {
+        // Snapshots published by the probe worker
+        case WMAPP_STATUS:
+        {
+            // Same as OnStatusPublished, a JSON line is written for each snapshot
+            InterlockedExchange(&lStatusPosted, 0);
+
+            MonitorSnapshot snapshot;
+            while (snapshotChannel.Pop(&snapshot))
+            {
+                SYSTEMTIME st;
+                GetSystemTime(&st);
+                if (!HeadlessWriteSnapshot(&headlessStream, &snapshot, &st)) {
+                    // Nobody is reading anymore
+                    DestroyWindow(hWnd);
+                    break;
+                }
+            }
+            return 0;
+        }
+        case WM_DESTROY:
+            StopProbeWorker();
+            AgentClientClose();
+            PostQuitMessage(0);
+            return 0;
+    }
+    return DefWindowProc(hWnd, message, wParam, lParam);
+}
@@ -0,0 +1,234 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  GlpiApi.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include "framework.h"
+#include "GlpiApi.h"
+
+
+//-[REQUESTS]------------------------------------------------------------------
+
+// Length of the UTF-8 sequence at pText, 0 if invalid
+static size_t Utf8SequenceLength(const BYTE* pText, size_t cchLeft)
+{
+    size_t cchSeq;
+    if (pText[0] < 0x80)
+        return 1;
+    else if (pText[0] >= 0xC2 && pText[0] <= 0xDF)
+        cchSeq = 2;
+    else if (pText[0] >= 0xE0 && pText[0] <= 0xEF)
+        cchSeq = 3;
+    else if (pText[0] >= 0xF0 && pText[0] <= 0xF4)
+        cchSeq = 4;
+    else
+        return 0;
+    if (cchSeq > cchLeft)
+        return 0;
+    for (size_t i = 1; i < cchSeq; i++) {
+        if ((pText[i] & 0xC0) != 0x80)
+            return 0;
+    }
+    // Overlong forms, surrogates and code points above U+10FFFF
+    if ((pText[0] == 0xE0 && pText[1] < 0xA0) || (pText[0] == 0xED && pText[1] >= 0xA0) ||
+        (pText[0] == 0xF0 && pText[1] < 0x90) || (pText[0] == 0xF4 && pText[1] >= 0x90))
+        return 0;
+    return cchSeq;
+}
+
+// Appends a JSON string (quoted and escaped). Invalid UTF-8 bytes, which the
+// server would reject the whole request for, are replaced with U+FFFD.
+VOID GlpiAppendJsonString(std::string& str, const CHAR* pText, size_t cchText)
+{
+    str += '"';
+    for (size_t i = 0; i < cchText; i++) {
+        CHAR ch = pText[i];
+        if ((BYTE)ch >= 0x80) {
+            size_t cchSeq = Utf8SequenceLength((const BYTE*)pText + i, cchText - i);
+            if (cchSeq == 0) {
+                str += "\\ufffd";
+            }
+            else {
+                str.append(pText + i, cchSeq);
+                i += cchSeq - 1;
+            }
+            continue;
+        }
+        switch (ch) {
+        case '"': str += "\\\""; break;
+        case '\\': str += "\\\\"; break;
+        case '\n': str += "\\n"; break;
+        case '\r': str += "\\r"; break;
+        case '\t': str += "\\t"; break;
+        default:
+            if ((BYTE)ch < 0x20) {
+                CHAR szEscape[8];
+                sprintf_s(szEscape, "\\u%04x", (BYTE)ch);
+                str += szEscape;
+            }
+            else {
+                str += ch;
+            }
+        }
+    }
+    str += '"';
+}
+
+// Appends text to HTML content (the ticket content is rich text)
+VOID GlpiAppendHtml(std::string& str, const CHAR* pText, size_t cchText)
+{
+    for (size_t i = 0; i < cchText; i++) {
+        switch (pText[i]) {
+        case '<': str += "&lt;"; break;
+        case '>': str += "&gt;"; break;
+        case '&': str += "&amp;"; break;
+        case '"': str += "&quot;"; break;
+        case '\r': break;
+        default: str += pText[i];
+        }
+    }
+}
+
+// Ticket creation request body
+std::string GlpiTicketInput(const CHAR* szName, const std::string& content)
+{
+    std::string str = "{\"input\":{\"name\":";
+    GlpiAppendJsonString(str, szName, strlen(szName));
+    str += ",\"content\":";
+    GlpiAppendJsonString(str, content.c_str(), content.size());
+    str += "}}";
+    return str;
+}
+
+// Document upload manifest, linking the document to a ticket
+std::string GlpiDocumentManifest(const CHAR* szFilename, DWORD dwTicketId)
+{
+    std::string str = "{\"input\":{\"name\":";
+    GlpiAppendJsonString(str, szFilename, strlen(szFilename));
+    str += ",\"_filename\":[";
+    GlpiAppendJsonString(str, szFilename, strlen(szFilename));
+    CHAR szItem[64];
+    sprintf_s(szItem, "],\"itemtype\":\"Ticket\",\"items_id\":%u}}", dwTicketId);
+    str += szItem;
+    return str;
+}
+
+// Builds the multipart/form-data parts of a document upload, around the file
+// contents (which are streamed between them)
+VOID GlpiMultipart(const CHAR* szBoundary, const std::string& manifest, const CHAR* szFilename,
+    const CHAR* szMimeType, std::string& head, std::string& tail)
+{
+    head = "--";
+    head += szBoundary;
+    head += "\r\nContent-Disposition: form-data; name=\"uploadManifest\"\r\n"
+        "Content-Type: application/json\r\n\r\n";
+    head += manifest;
+    head += "\r\n--";
+    head += szBoundary;
+    head += "\r\nContent-Disposition: form-data; name=\"filename[0]\"; filename=\"";
+    head += szFilename;
+    head += "\"\r\nContent-Type: ";
+    head += szMimeType;
+    head += "\r\n\r\n";
+
+    tail = "\r\n--";
+    tail += szBoundary;
+    tail += "--\r\n";
+}
+
+
+//-[RESPONSES]-----------------------------------------------------------------
+
+// Finds the value of a key, returns its position (or NULL)
+static const CHAR* FindValue(const CHAR* pJson, size_t cbJson, const CHAR* szKey)
+{
+    size_t cchKey = strlen(szKey);
+    const CHAR* pEnd = pJson + cbJson;
+    for (const CHAR* p = pJson; p + cchKey + 2 <= pEnd; p++) {
+        if (*p != '"' || p[cchKey + 1] != '"' || memcmp(p + 1, szKey, cchKey) != 0)
+            continue;
+        const CHAR* q = p + cchKey + 2;
+        while (q < pEnd && (*q == ' ' || *q == '\t' || *q == '\r' || *q == '\n'))
+            q++;
+        if (q >= pEnd || *q != ':')
+            continue;
+        q++;
+        while (q < pEnd && (*q == ' ' || *q == '\t' || *q == '\r' || *q == '\n'))
+            q++;
+        return (q < pEnd ? q : NULL);
+    }
+    return NULL;
+}
+
+// Gets a string value (escaped characters are kept as is, but for \" and \\)
+BOOL GlpiJsonGetString(const CHAR* pJson, size_t cbJson, const CHAR* szKey, CHAR* szValue, size_t cchValue)
+{
+    const CHAR* p = FindValue(pJson, cbJson, szKey);
+    const CHAR* pEnd = pJson + cbJson;
+    if (p == NULL || *p != '"' || cchValue == 0)
+        return FALSE;
+    size_t cch = 0;
+    for (p++; p < pEnd && *p != '"'; p++) {
+        if (*p == '\\' && p + 1 < pEnd)
+            p++;
+        if (cch + 1 >= cchValue)
+            return FALSE;
+        szValue[cch++] = *p;
+    }
+    szValue[cch] = '\0';
+    return (p < pEnd);
+}
+
+// Gets a number value (or a number in a string)
+BOOL GlpiJsonGetNumber(const CHAR* pJson, size_t cbJson, const CHAR* szKey, DWORD* pdwValue)
+{
+    const CHAR* p = FindValue(pJson, cbJson, szKey);
+    const CHAR* pEnd = pJson + cbJson;
+    if (p != NULL && *p == '"')
+        p++;
+    if (p == NULL || p >= pEnd || *p < '0' || *p > '9')
+        return FALSE;
+    ULONGLONG ullValue = 0;
+    for (; p < pEnd && *p >= '0' && *p <= '9'; p++) {
+        ullValue = ullValue * 10 + (*p - '0');
+        if (ullValue > MAXDWORD)
+            return FALSE;
+    }
+    *pdwValue = (DWORD)ullValue;
+    return TRUE;
+}
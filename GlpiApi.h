@@ -0,0 +1,66 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  GlpiApi.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include "framework.h"
+#include <string>
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// GLPI REST API endpoints (relative to the apirest.php URL)
+#define GLPIAPI_INIT_SESSION    L"/initSession"
+#define GLPIAPI_KILL_SESSION    L"/killSession"
+#define GLPIAPI_TICKET          L"/Ticket"
+#define GLPIAPI_DOCUMENT        L"/Document"
+
+// Longest session token kept
+#define GLPIAPI_MAX_TOKEN       128
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Request bodies (UTF-8)
+VOID GlpiAppendJsonString(std::string& str, const CHAR* pText, size_t cchText);
+VOID GlpiAppendHtml(std::string& str, const CHAR* pText, size_t cchText);
+std::string GlpiTicketInput(const CHAR* szName, const std::string& content);
+std::string GlpiDocumentManifest(const CHAR* szFilename, DWORD dwTicketId);
+VOID GlpiMultipart(const CHAR* szBoundary, const std::string& manifest, const CHAR* szFilename,
+    const CHAR* szMimeType, std::string& head, std::string& tail);
+
+// Responses (flat JSON objects)
+BOOL GlpiJsonGetString(const CHAR* pJson, size_t cbJson, const CHAR* szKey, CHAR* szValue, size_t cchValue);
+BOOL GlpiJsonGetNumber(const CHAR* pJson, size_t cbJson, const CHAR* szKey, DWORD* pdwValue);
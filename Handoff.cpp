@@ -0,0 +1,352 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  Handoff.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <wchar.h>
+#include <sddl.h>
+#include "framework.h"
+#include "Handoff.h"
+
+
+//-[PIPE]----------------------------------------------------------------------
+
+// Named pipe stream. Each read or write waits up to dwTimeout, and is aborted
+// once the stop event (if any) is set.
+class PipeStream : public HandoffStream
+{
+public:
+    PipeStream(HANDLE hPipe, HANDLE hStop, DWORD dwTimeout = HANDOFF_TIMEOUT) : hPipe(hPipe), hStop(hStop), dwTimeout(dwTimeout)
+    {
+        hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    }
+
+    ~PipeStream()
+    {
+        if (hEvent != NULL)
+            CloseHandle(hEvent);
+    }
+
+    BOOL Read(PVOID pv, DWORD cb)
+    {
+        return Transfer((BYTE*)pv, cb, FALSE);
+    }
+
+    BOOL Write(const VOID* pv, DWORD cb)
+    {
+        return Transfer((BYTE*)pv, cb, TRUE);
+    }
+
+private:
+    HANDLE hPipe;
+    HANDLE hStop;
+    HANDLE hEvent;
+    DWORD dwTimeout;
+
+    BOOL Transfer(BYTE* pb, DWORD cb, BOOL bWrite)
+    {
+        if (hEvent == NULL)
+            return FALSE;
+
+        while (cb > 0)
+        {
+            OVERLAPPED ov = {};
+            ov.hEvent = hEvent;
+            BOOL bDone = (bWrite ? WriteFile(hPipe, pb, cb, NULL, &ov) : ReadFile(hPipe, pb, cb, NULL, &ov));
+            if (!bDone && GetLastError() != ERROR_IO_PENDING)
+                return FALSE;
+
+            HANDLE hWaitHandles[2] = { hEvent, hStop };
+            DWORD cbDone = 0;
+            if (WaitForMultipleObjects((hStop != NULL ? 2 : 1), hWaitHandles, FALSE, dwTimeout) != WAIT_OBJECT_0) {
+                CancelIoEx(hPipe, &ov);
+                GetOverlappedResult(hPipe, &ov, &cbDone, TRUE);
+                return FALSE;
+            }
+            if (!GetOverlappedResult(hPipe, &ov, &cbDone, FALSE) || cbDone == 0)
+                return FALSE;
+            pb += cbDone;
+            cb -= cbDone;
+        }
+        return TRUE;
+    }
+};
+
+// Pipe server state
+static HANDLE hServerPipe = NULL;
+static HANDLE hServerStop = NULL;
+static HANDLE hServerThread = NULL;
+static HandoffHandler pfnServerHandler = NULL;
+static PVOID pvServerContext = NULL;
+static DWORD dwServerIntegrity = 0;
+
+// Builds the name of the pipe of the current session
+static BOOL GetPipeName(WCHAR (&szName)[64], DWORD* pdwSession)
+{
+    if (!ProcessIdToSessionId(GetCurrentProcessId(), pdwSession))
+        return FALSE;
+    return swprintf_s(szName, L"%s%lu", HANDOFF_PIPE_PREFIX, *pdwSession) > 0;
+}
+
+// Creates a stream over a connected pipe (opened with FILE_FLAG_OVERLAPPED),
+// to be freed with delete
+HandoffStream* HandoffCreatePipeStream(HANDLE hPipe, HANDLE hStop, DWORD dwTimeout)
+{
+    return new PipeStream(hPipe, hStop, dwTimeout);
+}
+
+// Builds a pipe security descriptor: only the user of the process (elevated or
+// not) and the system can connect. It must be freed with LocalFree.
+BOOL HandoffGetPipeSecurity(HANDLE hProcess, PSECURITY_DESCRIPTOR* ppSd)
+{
+    HANDLE hToken;
+    if (!OpenProcessToken(hProcess, TOKEN_QUERY, &hToken))
+        return FALSE;
+    union {
+        TOKEN_USER user;
+        BYTE buf[sizeof(TOKEN_USER) + SECURITY_MAX_SID_SIZE];
+    } tokenUser;
+    DWORD cbTokenUser = 0;
+    BOOL bOk = GetTokenInformation(hToken, TokenUser, &tokenUser, sizeof(tokenUser), &cbTokenUser);
+    CloseHandle(hToken);
+
+    LPWSTR szSid = NULL;
+    if (!bOk || !ConvertSidToStringSid(tokenUser.user.User.Sid, &szSid))
+        return FALSE;
+    WCHAR szSddl[256];
+    swprintf_s(szSddl, L"D:P(A;;GA;;;SY)(A;;GRGW;;;%s)", szSid);
+    LocalFree(szSid);
+    return ConvertStringSecurityDescriptorToSecurityDescriptor(szSddl, SDDL_REVISION_1, ppSd, NULL);
+}
+
+// Gets the integrity level (SECURITY_MANDATORY_*_RID) of a token
+static BOOL GetTokenIntegrity(HANDLE hToken, DWORD* pdwIntegrity)
+{
+    union {
+        TOKEN_MANDATORY_LABEL label;
+        BYTE buf[sizeof(TOKEN_MANDATORY_LABEL) + SECURITY_MAX_SID_SIZE];
+    } tokenLabel;
+    DWORD cbTokenLabel = 0;
+    if (!GetTokenInformation(hToken, TokenIntegrityLevel, &tokenLabel, sizeof(tokenLabel), &cbTokenLabel))
+        return FALSE;
+    PSID pSid = tokenLabel.label.Label.Sid;
+    *pdwIntegrity = *GetSidSubAuthority(pSid, *GetSidSubAuthorityCount(pSid) - 1);
+    return TRUE;
+}
+
+// Returns whether the connected client runs at the integrity level of the
+// server or above. Its request must have been read: the client is
+// impersonated (at the identification level it allows) to query its token.
+static BOOL IsClientTrusted(HANDLE hPipe)
+{
+    if (!ImpersonateNamedPipeClient(hPipe))
+        return FALSE;
+    HANDLE hToken;
+    BOOL bOk = OpenThreadToken(GetCurrentThread(), TOKEN_QUERY, TRUE, &hToken);
+    RevertToSelf();
+    if (!bOk)
+        return FALSE;
+
+    DWORD dwIntegrity = 0;
+    bOk = GetTokenIntegrity(hToken, &dwIntegrity);
+    CloseHandle(hToken);
+    return bOk && dwIntegrity >= dwServerIntegrity;
+}
+
+// Runs a request read by the pipe server. Service operations run with the
+// rights of the server, so a client of a lower integrity level (e.g. not
+// elevated, while the server is) can't request them: it runs them itself,
+// with its own rights.
+static DWORD ServerHandler(const HandoffRequest* pReq, PVOID pvContext)
+{
+    if (pReq->wCommand == HANDOFF_CMD_SERVICE && !IsClientTrusted(hServerPipe))
+        return ERROR_ACCESS_DENIED;
+    return pfnServerHandler(pReq, pvContext);
+}
+
+// Pipe server thread: serves the clients one at a time
+static DWORD WINAPI HandoffServerThread(LPVOID lpParam)
+{
+    DWORD dwSession = (DWORD)(ULONG_PTR)lpParam;
+    HANDLE hConnected = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (hConnected == NULL)
+        return GetLastError();
+
+    while (WaitForSingleObject(hServerStop, 0) == WAIT_TIMEOUT)
+    {
+        OVERLAPPED ov = {};
+        ov.hEvent = hConnected;
+        DWORD cbDone = 0;
+        BOOL bConnected = ConnectNamedPipe(hServerPipe, &ov);
+        if (!bConnected) {
+            DWORD dwErr = GetLastError();
+            if (dwErr == ERROR_IO_PENDING) {
+                HANDLE hWaitHandles[2] = { hServerStop, hConnected };
+                if (WaitForMultipleObjects(2, hWaitHandles, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) {
+                    CancelIoEx(hServerPipe, &ov);
+                    GetOverlappedResult(hServerPipe, &ov, &cbDone, TRUE);
+                    break;
+                }
+                bConnected = GetOverlappedResult(hServerPipe, &ov, &cbDone, FALSE);
+            }
+            else if (dwErr == ERROR_PIPE_CONNECTED) {
+                bConnected = TRUE;
+            }
+            else if (dwErr != ERROR_NO_DATA) {
+                break;
+            }
+        }
+
+        // Only clients from this session are served (the pipe DACL already
+        // restricts them to the current user, ServerHandler the service
+        // operations to its integrity level)
+        ULONG ulClientSession = 0;
+        if (bConnected && GetNamedPipeClientSessionId(hServerPipe, &ulClientSession) && ulClientSession == dwSession) {
+            // The reply would be discarded if the pipe was disconnected
+            // before the client read it, so the client closes it first
+            PipeStream stream(hServerPipe, hServerStop);
+            BYTE bEnd;
+            if (HandoffServe(&stream, ServerHandler, pvServerContext))
+                stream.Read(&bEnd, 1);
+        }
+        DisconnectNamedPipe(hServerPipe);
+    }
+
+    CloseHandle(hConnected);
+    return 0;
+}
+
+// Creates the pipe of the current session and serves it on a thread. It fails
+// if the pipe already exists (i.e. created by another process to intercept
+// the requests).
+BOOL HandoffServerStart(HandoffHandler pfnHandler, PVOID pvContext)
+{
+    WCHAR szName[64];
+    DWORD dwSession;
+    PSECURITY_DESCRIPTOR pSd = NULL;
+    HANDLE hToken;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &hToken))
+        return FALSE;
+    BOOL bOk = GetTokenIntegrity(hToken, &dwServerIntegrity);
+    CloseHandle(hToken);
+    if (!bOk || !GetPipeName(szName, &dwSession) || !HandoffGetPipeSecurity(GetCurrentProcess(), &pSd))
+        return FALSE;
+
+    SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), pSd, FALSE };
+    hServerPipe = CreateNamedPipe(szName, PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1,
+        sizeof(HandoffReply), sizeof(HandoffRequest), 0, &sa);
+    LocalFree(pSd);
+    if (hServerPipe == INVALID_HANDLE_VALUE) {
+        hServerPipe = NULL;
+        return FALSE;
+    }
+
+    pfnServerHandler = pfnHandler;
+    pvServerContext = pvContext;
+    hServerStop = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (hServerStop != NULL)
+        hServerThread = CreateThread(NULL, 0, HandoffServerThread, (LPVOID)(ULONG_PTR)dwSession, 0, NULL);
+    if (hServerThread == NULL) {
+        HandoffServerStop();
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Stops the pipe server (a request being handled is aborted)
+VOID HandoffServerStop()
+{
+    if (hServerThread != NULL) {
+        SetEvent(hServerStop);
+        WaitForSingleObject(hServerThread, HANDOFF_STOP_TIMEOUT);
+        CloseHandle(hServerThread);
+        hServerThread = NULL;
+    }
+    if (hServerStop != NULL) {
+        CloseHandle(hServerStop);
+        hServerStop = NULL;
+    }
+    if (hServerPipe != NULL) {
+        CloseHandle(hServerPipe);
+        hServerPipe = NULL;
+    }
+}
+
+// Hands a request to the Monitor running in the current session. The pipe is
+// waited for up to dwWait ms, while busy or not created yet (i.e. the running
+// Monitor is starting). Returns HANDOFF_* (see HandoffCall).
+int HandoffSend(const HandoffRequest* pReq, DWORD dwWait, DWORD* pdwResult)
+{
+    WCHAR szName[64];
+    DWORD dwSession;
+    if (!GetPipeName(szName, &dwSession))
+        return HANDOFF_NOT_SENT;
+
+    ULONGLONG ullDeadline = GetTickCount64() + dwWait;
+    HANDLE hPipe;
+    for (;;)
+    {
+        // The server can't impersonate the client
+        hPipe = CreateFile(szName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING,
+            FILE_FLAG_OVERLAPPED | SECURITY_SQOS_PRESENT | SECURITY_IDENTIFICATION, NULL);
+        if (hPipe != INVALID_HANDLE_VALUE)
+            break;
+        DWORD dwErr = GetLastError();
+        ULONGLONG ullNow = GetTickCount64();
+        if (ullNow >= ullDeadline || (dwErr != ERROR_PIPE_BUSY && dwErr != ERROR_FILE_NOT_FOUND))
+            return HANDOFF_NOT_SENT;
+        if (dwErr == ERROR_PIPE_BUSY)
+            WaitNamedPipe(szName, (DWORD)(ullDeadline - ullNow));
+        else
+            Sleep(50);
+    }
+
+    // The server must run in this session, and may bring its window to the
+    // foreground (this process just got started by the user). Service
+    // operations are replied once done, which may take longer.
+    ULONG ulServerSession = 0, ulServerPid = 0;
+    int nRes = HANDOFF_NOT_SENT;
+    if (GetNamedPipeServerSessionId(hPipe, &ulServerSession) && ulServerSession == dwSession &&
+        GetNamedPipeServerProcessId(hPipe, &ulServerPid))
+    {
+        AllowSetForegroundWindow(ulServerPid);
+        PipeStream stream(hPipe, NULL, (pReq->wCommand == HANDOFF_CMD_SERVICE ? HANDOFF_SERVICE_TIMEOUT : HANDOFF_TIMEOUT));
+        nRes = HandoffCall(&stream, pReq, pdwResult);
+    }
+    CloseHandle(hPipe);
+    return nRes;
+}
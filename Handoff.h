@@ -0,0 +1,121 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  Handoff.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include "framework.h"
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// Requests a new Monitor instance hands to the running one (one per connection)
+#define HANDOFF_MAGIC           0x46484D47  // "GMHF"
+#define HANDOFF_VERSION         1
+
+// Commands
+#define HANDOFF_CMD_SHOW        1           // Show the main window
+#define HANDOFF_CMD_FORCEINV    2           // Force an inventory
+#define HANDOFF_CMD_SERVICE     3           // Service operation (HANDOFF_SVC_*)
+#define HANDOFF_CMD_MAX         3
+
+// Service operations
+#define HANDOFF_SVC_START       1
+#define HANDOFF_SVC_STOP        2
+#define HANDOFF_SVC_CONTINUE    3
+
+// Longest wait for each read or write (ms), and for the pipe server to stop
+#define HANDOFF_TIMEOUT         2000
+#define HANDOFF_STOP_TIMEOUT    5000
+
+// Longest wait for the reply to a service operation (ms), the SCM itself
+// waiting up to 30 s for the service to start
+#define HANDOFF_SERVICE_TIMEOUT 35000
+
+// Request delivery (HandoffCall and HandoffSend results)
+#define HANDOFF_NOT_SENT        0           // Not written (i.e. no running Monitor)
+#define HANDOFF_REPLIED         1           // Run, *pdwResult is its result
+#define HANDOFF_NO_REPLY        2           // Written but not replied (maybe still running)
+
+// Pipe name prefix (followed by the session ID, pipe names are global)
+#define HANDOFF_PIPE_PREFIX     L"\\\\.\\pipe\\GLPI-AgentMonitor-"
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// Request and reply (fixed size, any other size is rejected)
+#pragma pack(push, 1)
+struct HandoffRequest {
+    DWORD dwMagic;
+    WORD wVersion;
+    WORD wCommand;              // HANDOFF_CMD_*
+    DWORD dwArg;                // Command argument
+    DWORD dwReserved;           // 0
+};
+struct HandoffReply {
+    DWORD dwMagic;
+    DWORD dwResult;             // ERROR_SUCCESS or error code
+};
+#pragma pack(pop)
+
+// Runs a request in the running Monitor, returns its result
+typedef DWORD (*HandoffHandler)(const HandoffRequest* pReq, PVOID pvContext);
+
+// Byte stream the requests go through (a named pipe, or in memory in tests)
+class HandoffStream
+{
+public:
+    virtual ~HandoffStream() {}
+    // Reads or writes exactly cb bytes (FALSE on error, timeout or end of stream)
+    virtual BOOL Read(PVOID pv, DWORD cb) = 0;
+    virtual BOOL Write(const VOID* pv, DWORD cb) = 0;
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Protocol
+VOID HandoffInitRequest(HandoffRequest* pReq, WORD wCommand, DWORD dwArg);
+BOOL HandoffParseCommandLine(LPCWSTR szCmdLine, HandoffRequest* pReq);
+int HandoffCall(HandoffStream* pStream, const HandoffRequest* pReq, DWORD* pdwResult);
+BOOL HandoffServe(HandoffStream* pStream, HandoffHandler pfnHandler, PVOID pvContext);
+
+// Named pipe (per session)
+BOOL HandoffServerStart(HandoffHandler pfnHandler, PVOID pvContext);
+VOID HandoffServerStop();
+int HandoffSend(const HandoffRequest* pReq, DWORD dwWait, DWORD* pdwResult);
+
+// Named pipe helpers (also used by the elevated broker)
+HandoffStream* HandoffCreatePipeStream(HANDLE hPipe, HANDLE hStop, DWORD dwTimeout);
+BOOL HandoffGetPipeSecurity(HANDLE hProcess, PSECURITY_DESCRIPTOR* ppSd);
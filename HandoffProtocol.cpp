@@ -0,0 +1,110 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  HandoffProtocol.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <wchar.h>
+#include "framework.h"
+#include "Handoff.h"
+
+
+//-[PROTOCOL]------------------------------------------------------------------
+
+// Fills a request
+VOID HandoffInitRequest(HandoffRequest* pReq, WORD wCommand, DWORD dwArg)
+{
+    pReq->dwMagic = HANDOFF_MAGIC;
+    pReq->wVersion = HANDOFF_VERSION;
+    pReq->wCommand = wCommand;
+    pReq->dwArg = dwArg;
+    pReq->dwReserved = 0;
+}
+
+// Builds the request for the command line actions the running Monitor can do.
+// Returns FALSE if there's none (the request then shows the main window).
+BOOL HandoffParseCommandLine(LPCWSTR szCmdLine, HandoffRequest* pReq)
+{
+    static const struct {
+        LPCWSTR szAction;
+        WORD wCommand;
+        DWORD dwArg;
+    } actions[] = {
+        { L"/startSvc", HANDOFF_CMD_SERVICE, HANDOFF_SVC_START },
+        { L"/stopSvc", HANDOFF_CMD_SERVICE, HANDOFF_SVC_STOP },
+        { L"/continueSvc", HANDOFF_CMD_SERVICE, HANDOFF_SVC_CONTINUE },
+        { L"/forceInventory", HANDOFF_CMD_FORCEINV, 0 }
+    };
+
+    for (size_t i = 0; i < ARRAYSIZE(actions); i++) {
+        if (wcsstr(szCmdLine, actions[i].szAction) != nullptr) {
+            HandoffInitRequest(pReq, actions[i].wCommand, actions[i].dwArg);
+            return TRUE;
+        }
+    }
+    HandoffInitRequest(pReq, HANDOFF_CMD_SHOW, 0);
+    return FALSE;
+}
+
+// Sends a request and reads its result (client side). Returns HANDOFF_*: once
+// written, the request is run even if its reply isn't read.
+int HandoffCall(HandoffStream* pStream, const HandoffRequest* pReq, DWORD* pdwResult)
+{
+    if (!pStream->Write(pReq, sizeof(HandoffRequest)))
+        return HANDOFF_NOT_SENT;
+    HandoffReply reply;
+    if (!pStream->Read(&reply, sizeof(reply)) || reply.dwMagic != HANDOFF_MAGIC)
+        return HANDOFF_NO_REPLY;
+    *pdwResult = reply.dwResult;
+    return HANDOFF_REPLIED;
+}
+
+// Reads a request, runs it and writes its result (server side). Anything but a
+// request is dropped without reply; requests from another protocol version, or
+// with an unknown command, are answered with ERROR_NOT_SUPPORTED.
+BOOL HandoffServe(HandoffStream* pStream, HandoffHandler pfnHandler, PVOID pvContext)
+{
+    HandoffRequest req;
+    if (!pStream->Read(&req, sizeof(req)) || req.dwMagic != HANDOFF_MAGIC)
+        return FALSE;
+
+    HandoffReply reply;
+    reply.dwMagic = HANDOFF_MAGIC;
+    if (req.wVersion != HANDOFF_VERSION || req.wCommand == 0 || req.wCommand > HANDOFF_CMD_MAX || req.dwReserved != 0)
+        reply.dwResult = ERROR_NOT_SUPPORTED;
+    else
+        reply.dwResult = pfnHandler(&req, pvContext);
+    return pStream->Write(&reply, sizeof(reply));
+}
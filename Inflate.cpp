@@ -0,0 +1,491 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  Inflate.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <string.h>
+#include "framework.h"
+#include "Inflate.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// Deflate (RFC 1951) decoder, for gzip (RFC 1952) files. It's a canonical
+// Huffman decoder, with a lookup table for the short codes. The input is in
+// memory, and the output goes through a caller buffer, flushed to the output
+// callback, and the window kept for the back-references.
+
+#define MAX_BITS        15      // Longest code
+#define MAX_LCODES      286     // Literal/length codes
+#define MAX_DCODES      30      // Distance codes
+#define FIXED_LCODES    288
+#define FAST_BITS       9       // Codes decoded with a single lookup
+
+struct Huffman {
+    short count[MAX_BITS + 1];  // Number of codes of each length
+    short symbol[FIXED_LCODES]; // Symbols, ordered by code
+    short fast[1 << FAST_BITS]; // Next FAST_BITS input bits -> code length << 9 | symbol
+                                // (0 for longer codes)
+};
+
+struct InflateState {
+    const BYTE* pIn;
+    size_t cbIn;
+    size_t iIn;
+    DWORD dwBitBuf;
+    int nBitCount;
+    BOOL bTruncated;            // Read past the input end
+    BYTE window[INFLATE_WINDOW_SIZE];
+    ULONGLONG ullOut;           // Bytes output (in the current gzip member)
+    BYTE* pOut;
+    size_t cbOut;
+    size_t iOut;
+    DWORD dwCrc;
+    InflateOutput pfnOutput;
+    PVOID pContext;
+    BOOL bAborted;
+};
+
+static const short lengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const short lengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const short distBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+    4097, 6145, 8193, 12289, 16385, 24577 };
+static const short distExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+// Order of the code length code lengths
+static const short codeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+
+//-[CRC]-----------------------------------------------------------------------
+
+static BOOL BuildCrcTable(DWORD* pTable)
+{
+    for (DWORD n = 0; n < 256; n++) {
+        DWORD c = n;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+        pTable[n] = c;
+    }
+    return TRUE;
+}
+
+// CRC-32 (ISO 3309), as used by gzip and PNG
+DWORD Crc32Update(DWORD dwCrc, const BYTE* pData, size_t cbData)
+{
+    // Built once, on first use
+    static DWORD crcTable[256];
+    static const BOOL bCrcTable = BuildCrcTable(crcTable);
+    UNREFERENCED_PARAMETER(bCrcTable);
+
+    dwCrc = ~dwCrc;
+    for (size_t i = 0; i < cbData; i++)
+        dwCrc = crcTable[(dwCrc ^ pData[i]) & 0xFF] ^ (dwCrc >> 8);
+    return ~dwCrc;
+}
+
+
+//-[DEFLATE]-------------------------------------------------------------------
+
+// Reads n bits (0 past the input end, which is reported once the block is done)
+static inline int Bits(InflateState* s, int n)
+{
+    DWORD dwVal = s->dwBitBuf;
+    while (s->nBitCount < n) {
+        if (s->iIn == s->cbIn) {
+            s->bTruncated = TRUE;
+            return 0;
+        }
+        dwVal |= (DWORD)s->pIn[s->iIn++] << s->nBitCount;
+        s->nBitCount += 8;
+    }
+    s->dwBitBuf = dwVal >> n;
+    s->nBitCount -= n;
+    return (int)(dwVal & ((1UL << n) - 1));
+}
+
+// Makes sure n bits are buffered (FALSE near the input end)
+static inline BOOL FillBits(InflateState* s, int n)
+{
+    while (s->nBitCount < n) {
+        if (s->iIn == s->cbIn)
+            return FALSE;
+        s->dwBitBuf |= (DWORD)s->pIn[s->iIn++] << s->nBitCount;
+        s->nBitCount += 8;
+    }
+    return TRUE;
+}
+
+// Skips to a byte boundary. The whole bytes already buffered (prefetched by
+// Decode) are given back to the input.
+static inline VOID AlignToByte(InflateState* s)
+{
+    s->iIn -= s->nBitCount / 8;
+    s->dwBitBuf = 0;
+    s->nBitCount = 0;
+}
+
+// Hands the output buffer to the callback
+static BOOL FlushOutput(InflateState* s)
+{
+    if (s->iOut == 0)
+        return TRUE;
+    s->dwCrc = Crc32Update(s->dwCrc, s->pOut, s->iOut);
+    if (!s->pfnOutput(s->pContext, s->pOut, s->iOut))
+        s->bAborted = TRUE;
+    s->iOut = 0;
+    return !s->bAborted;
+}
+
+static inline BOOL PutByte(InflateState* s, BYTE b)
+{
+    s->window[s->ullOut++ & (INFLATE_WINDOW_SIZE - 1)] = b;
+    s->pOut[s->iOut++] = b;
+    return (s->iOut < s->cbOut || FlushOutput(s));
+}
+
+// Decodes a symbol, with the lookup table or else one code bit at a time
+static int Decode(InflateState* s, const Huffman* h)
+{
+    if (FillBits(s, FAST_BITS)) {
+        int entry = h->fast[s->dwBitBuf & ((1 << FAST_BITS) - 1)];
+        if (entry != 0) {
+            s->dwBitBuf >>= (entry >> 9);
+            s->nBitCount -= (entry >> 9);
+            return entry & 0x1FF;
+        }
+    }
+
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len <= MAX_BITS; len++) {
+        code |= Bits(s, 1);
+        int count = h->count[len];
+        if (code - count < first)
+            return h->symbol[index + (code - first)];
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+// Builds a Huffman code from the code lengths. Returns 0 for a complete code,
+// a negative value if it's over-subscribed, and a positive one if incomplete.
+static int Construct(Huffman* h, const short* pLengths, int n)
+{
+    short offsets[MAX_BITS + 1];
+
+    memset(h->count, 0, sizeof(h->count));
+    memset(h->fast, 0, sizeof(h->fast));
+    for (int symbol = 0; symbol < n; symbol++)
+        h->count[pLengths[symbol]]++;
+    if (h->count[0] == n)
+        return 0;
+
+    int left = 1;
+    for (int len = 1; len <= MAX_BITS; len++) {
+        left <<= 1;
+        left -= h->count[len];
+        if (left < 0)
+            return left;
+    }
+
+    offsets[1] = 0;
+    for (int len = 1; len < MAX_BITS; len++)
+        offsets[len + 1] = offsets[len] + h->count[len];
+    for (int symbol = 0; symbol < n; symbol++) {
+        if (pLengths[symbol] != 0)
+            h->symbol[offsets[pLengths[symbol]]++] = (short)symbol;
+    }
+
+    // Lookup table: the codes are read from their first bit, so their bits
+    // are reversed, and the entries for the bits following a code are filled
+    int code = 0, index = 0;
+    for (int len = 1; len <= FAST_BITS; len++) {
+        for (int i = 0; i < h->count[len]; i++, code++, index++) {
+            int reversed = 0;
+            for (int bit = 0; bit < len; bit++) {
+                if (code & (1 << bit))
+                    reversed |= 1 << (len - 1 - bit);
+            }
+            for (int fill = reversed; fill < (1 << FAST_BITS); fill += 1 << len)
+                h->fast[fill] = (short)((len << 9) | h->symbol[index]);
+        }
+        code <<= 1;
+    }
+    return left;
+}
+
+// Decodes the literals and length/distance pairs of a block
+static BOOL Codes(InflateState* s, const Huffman* pLenCode, const Huffman* pDistCode)
+{
+    for (;;)
+    {
+        int symbol = Decode(s, pLenCode);
+        if (symbol < 0 || s->bTruncated)
+            return FALSE;
+        if (symbol < 256) {
+            if (!PutByte(s, (BYTE)symbol))
+                return FALSE;
+            continue;
+        }
+        if (symbol == 256)
+            return TRUE;
+
+        symbol -= 257;
+        if (symbol >= 29)
+            return FALSE;
+        int len = lengthBase[symbol] + Bits(s, lengthExtra[symbol]);
+        symbol = Decode(s, pDistCode);
+        if (symbol < 0 || symbol >= 30)
+            return FALSE;
+        DWORD dwDist = distBase[symbol] + Bits(s, distExtra[symbol]);
+        if (s->bTruncated || dwDist > s->ullOut)
+            return FALSE;
+        while (len-- > 0) {
+            if (!PutByte(s, s->window[(s->ullOut - dwDist) & (INFLATE_WINDOW_SIZE - 1)]))
+                return FALSE;
+        }
+    }
+}
+
+static BOOL Stored(InflateState* s)
+{
+    AlignToByte(s);
+    if (s->cbIn - s->iIn < 4)
+        return FALSE;
+    const BYTE* p = s->pIn + s->iIn;
+    unsigned len = p[0] | (p[1] << 8);
+    if ((unsigned)(p[2] | (p[3] << 8)) != (~len & 0xFFFF))
+        return FALSE;
+    s->iIn += 4;
+    if (s->cbIn - s->iIn < len)
+        return FALSE;
+    while (len-- > 0) {
+        if (!PutByte(s, s->pIn[s->iIn++]))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+static BOOL Fixed(InflateState* s)
+{
+    // Built once, on first use
+    static Huffman lenCode, distCode;
+    static const BOOL bBuilt = [] {
+        short lengths[FIXED_LCODES];
+        int symbol = 0;
+        for (; symbol < 144; symbol++) lengths[symbol] = 8;
+        for (; symbol < 256; symbol++) lengths[symbol] = 9;
+        for (; symbol < 280; symbol++) lengths[symbol] = 7;
+        for (; symbol < FIXED_LCODES; symbol++) lengths[symbol] = 8;
+        Construct(&lenCode, lengths, FIXED_LCODES);
+        for (symbol = 0; symbol < MAX_DCODES; symbol++) lengths[symbol] = 5;
+        Construct(&distCode, lengths, MAX_DCODES);
+        return TRUE;
+    }();
+    UNREFERENCED_PARAMETER(bBuilt);
+    return Codes(s, &lenCode, &distCode);
+}
+
+static BOOL Dynamic(InflateState* s)
+{
+    short lengths[MAX_LCODES + MAX_DCODES];
+    Huffman lenCode, distCode;
+
+    int nLen = Bits(s, 5) + 257;
+    int nDist = Bits(s, 5) + 1;
+    int nCode = Bits(s, 4) + 4;
+    if (nLen > MAX_LCODES || nDist > MAX_DCODES)
+        return FALSE;
+
+    // Code length code
+    int index;
+    for (index = 0; index < nCode; index++)
+        lengths[codeLengthOrder[index]] = (short)Bits(s, 3);
+    for (; index < 19; index++)
+        lengths[codeLengthOrder[index]] = 0;
+    if (s->bTruncated || Construct(&lenCode, lengths, 19) != 0)
+        return FALSE;
+
+    // Literal/length and distance code lengths
+    index = 0;
+    while (index < nLen + nDist)
+    {
+        int symbol = Decode(s, &lenCode);
+        if (symbol < 0 || s->bTruncated)
+            return FALSE;
+        if (symbol < 16) {
+            lengths[index++] = (short)symbol;
+            continue;
+        }
+        short len = 0;
+        if (symbol == 16) {
+            if (index == 0)
+                return FALSE;
+            len = lengths[index - 1];
+            symbol = 3 + Bits(s, 2);
+        }
+        else if (symbol == 17)
+            symbol = 3 + Bits(s, 3);
+        else
+            symbol = 11 + Bits(s, 7);
+        if (index + symbol > nLen + nDist)
+            return FALSE;
+        while (symbol-- > 0)
+            lengths[index++] = len;
+    }
+    if (lengths[256] == 0)
+        return FALSE;
+
+    // Incomplete codes are only allowed for a single length
+    int err = Construct(&lenCode, lengths, nLen);
+    if (err < 0 || (err > 0 && nLen - lenCode.count[0] != 1))
+        return FALSE;
+    err = Construct(&distCode, lengths + nLen, nDist);
+    if (err < 0 || (err > 0 && nDist - distCode.count[0] != 1))
+        return FALSE;
+
+    return Codes(s, &lenCode, &distCode);
+}
+
+static BOOL Inflate(InflateState* s)
+{
+    int nLast;
+    do {
+        nLast = Bits(s, 1);
+        int nType = Bits(s, 2);
+        BOOL bOk;
+        if (s->bTruncated)
+            return FALSE;
+        if (nType == 0)
+            bOk = Stored(s);
+        else if (nType == 1)
+            bOk = Fixed(s);
+        else if (nType == 2)
+            bOk = Dynamic(s);
+        else
+            bOk = FALSE;
+        if (!bOk)
+            return FALSE;
+    } while (!nLast);
+    return TRUE;
+}
+
+
+//-[GZIP]----------------------------------------------------------------------
+
+// Skips a gzip member header. Returns FALSE if it isn't valid.
+static BOOL SkipGzipHeader(InflateState* s)
+{
+    const BYTE* p = s->pIn + s->iIn;
+    size_t cbLeft = s->cbIn - s->iIn;
+    if (cbLeft < 10 || p[0] != 0x1F || p[1] != 0x8B || p[2] != 8)
+        return FALSE;
+    BYTE bFlags = p[3];
+    size_t i = 10;
+    if (bFlags & 0x04) {            // FEXTRA
+        if (cbLeft < i + 2)
+            return FALSE;
+        i += 2 + (p[i] | (p[i + 1] << 8));
+    }
+    for (BYTE bFlag = 0x08; bFlag <= 0x10; bFlag <<= 1) {    // FNAME, FCOMMENT
+        if (bFlags & bFlag) {
+            while (i < cbLeft && p[i] != 0)
+                i++;
+            i++;
+        }
+    }
+    if (bFlags & 0x02)              // FHCRC
+        i += 2;
+    if (i > cbLeft)
+        return FALSE;
+    s->iIn += i;
+    return TRUE;
+}
+
+// Decompresses gzip data (all its members), through the pOut buffer, which is
+// handed to pfnOutput each time it's full. Returns INFLATE_OK or an error.
+int GzipInflate(const BYTE* pIn, size_t cbIn, BYTE* pOut, size_t cbOut, InflateOutput pfnOutput, PVOID pContext)
+{
+    InflateState* s = new InflateState();
+    s->pIn = pIn;
+    s->cbIn = cbIn;
+    s->pOut = pOut;
+    s->cbOut = cbOut;
+    s->pfnOutput = pfnOutput;
+    s->pContext = pContext;
+
+    int nRes = INFLATE_OK;
+    do {
+        if (!SkipGzipHeader(s)) {
+            nRes = INFLATE_BAD_DATA;
+            break;
+        }
+        s->dwBitBuf = 0;
+        s->nBitCount = 0;
+        s->ullOut = 0;
+        s->dwCrc = 0;
+        if (!Inflate(s) || !FlushOutput(s)) {
+            nRes = (s->bAborted ? INFLATE_ABORTED : INFLATE_BAD_DATA);
+            break;
+        }
+
+        // Trailer: CRC-32 and size (modulo 2^32), after the last block byte
+        AlignToByte(s);
+        if (s->cbIn - s->iIn < 8) {
+            nRes = INFLATE_BAD_DATA;
+            break;
+        }
+        const BYTE* p = s->pIn + s->iIn;
+        DWORD dwCrc = p[0] | (p[1] << 8) | (p[2] << 16) | ((DWORD)p[3] << 24);
+        DWORD dwSize = p[4] | (p[5] << 8) | (p[6] << 16) | ((DWORD)p[7] << 24);
+        s->iIn += 8;
+        if (dwCrc != s->dwCrc || dwSize != (DWORD)s->ullOut) {
+            nRes = INFLATE_BAD_CHECKSUM;
+            break;
+        }
+        // Padding after the last member is ignored
+        while (s->iIn < s->cbIn && s->pIn[s->iIn] == 0)
+            s->iIn++;
+    } while (s->iIn < s->cbIn);
+
+    delete s;
+    return nRes;
+}
@@ -0,0 +1,63 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  Inflate.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include "framework.h"
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// Deflate window (longest back-reference distance)
+#define INFLATE_WINDOW_SIZE     32768
+
+// Results
+#define INFLATE_OK              0
+#define INFLATE_ABORTED         1       // The output callback returned FALSE
+#define INFLATE_BAD_DATA        2       // Invalid or truncated data
+#define INFLATE_BAD_CHECKSUM    3       // gzip member CRC or size mismatch
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// Output callback, called each time the output buffer is full and at the end
+// of the data (returns FALSE to abort)
+typedef BOOL (*InflateOutput)(PVOID pContext, const BYTE* pData, size_t cbData);
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+int GzipInflate(const BYTE* pIn, size_t cbIn, BYTE* pOut, size_t cbOut, InflateOutput pfnOutput, PVOID pContext);
+DWORD Crc32Update(DWORD dwCrc, const BYTE* pData, size_t cbData);
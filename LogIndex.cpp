@@ -0,0 +1,269 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  LogIndex.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <string.h>
+#include <algorithm>
+#include "framework.h"
+#include "LogIndex.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// Agent log levels (longest prefixes first, "debug2" and above are shown as
+// LOGSEV_DEBUG2)
+static const struct {
+    const CHAR* szName;
+    size_t cchName;
+    BYTE bSeverity;
+} logLevels[] = {
+    { "error",   5, LOGSEV_ERROR },
+    { "warning", 7, LOGSEV_WARNING },
+    { "info",    4, LOGSEV_INFO },
+    { "debug",   5, LOGSEV_DEBUG }
+};
+
+static const CHAR* szMonths = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+
+//-[PARSING]-------------------------------------------------------------------
+
+// Returns a local time as a number of seconds (only used to compare times)
+ULONGLONG LogMakeTime(int nYear, int nMonth, int nDay, int nHour, int nMinute, int nSecond)
+{
+    // Days since 0000-03-01 (the leap day is the last day of the year)
+    ULONGLONG y = nYear - (nMonth <= 2 ? 1 : 0);
+    ULONGLONG era = y / 400;
+    ULONGLONG yoe = y - era * 400;
+    ULONGLONG doy = (153 * (nMonth + (nMonth > 2 ? -3 : 9)) + 2) / 5 + nDay - 1;
+    ULONGLONG days = era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return days * 86400 + nHour * 3600 + nMinute * 60 + nSecond;
+}
+
+// Parses a number of up to cch digits (leading spaces allowed)
+static BOOL ParseNumber(const CHAR* p, size_t cch, int* pnValue)
+{
+    int nValue = 0;
+    BOOL bDigits = FALSE;
+    for (size_t i = 0; i < cch; i++) {
+        if (p[i] >= '0' && p[i] <= '9') {
+            nValue = nValue * 10 + (p[i] - '0');
+            bDigits = TRUE;
+        }
+        else if (p[i] != ' ' || bDigits)
+            return FALSE;
+    }
+    *pnValue = nValue;
+    return bDigits;
+}
+
+// Parses a "Thu Mar  7 10:00:00 2024" time (24 chars)
+static BOOL ParseLogTime(const CHAR* p, ULONGLONG* pullTime)
+{
+    int nDay, nHour, nMinute, nSecond, nYear;
+    if (p[3] != ' ' || p[7] != ' ' || p[10] != ' ' || p[13] != ':' || p[16] != ':' || p[19] != ' ')
+        return FALSE;
+    const CHAR* pMonth = szMonths;
+    while (*pMonth != '\0' && strncmp(pMonth, p + 4, 3) != 0)
+        pMonth += 3;
+    if (*pMonth == '\0')
+        return FALSE;
+    if (!ParseNumber(p + 8, 2, &nDay) || !ParseNumber(p + 11, 2, &nHour) || !ParseNumber(p + 14, 2, &nMinute) ||
+        !ParseNumber(p + 17, 2, &nSecond) || !ParseNumber(p + 20, 4, &nYear))
+        return FALSE;
+    *pullTime = LogMakeTime(nYear, (int)((pMonth - szMonths) / 3) + 1, nDay, nHour, nMinute, nSecond);
+    return TRUE;
+}
+
+// Parses the "[time][level] " prefix of an Agent log line. Returns the line
+// severity (LOGSEV_NONE if it has no level) and its time (0 if it has none).
+BYTE LogParseLine(const CHAR* pLine, size_t cbLine, ULONGLONG* pullTime)
+{
+    *pullTime = 0;
+    if (cbLine >= 26 && pLine[0] == '[' && pLine[25] == ']' && ParseLogTime(pLine + 1, pullTime)) {
+        pLine += 26;
+        cbLine -= 26;
+    }
+    if (cbLine < 3 || pLine[0] != '[')
+        return LOGSEV_NONE;
+    pLine++;
+    cbLine--;
+    for (size_t i = 0; i < _countof(logLevels); i++) {
+        size_t cchName = logLevels[i].cchName;
+        if (cbLine > cchName && strncmp(pLine, logLevels[i].szName, cchName) == 0) {
+            if (pLine[cchName] == ']')
+                return logLevels[i].bSeverity;
+            if (logLevels[i].bSeverity == LOGSEV_DEBUG && pLine[cchName] >= '2' && pLine[cchName] <= '9')
+                return LOGSEV_DEBUG2;
+        }
+    }
+    return LOGSEV_NONE;
+}
+
+
+//-[INDEX]---------------------------------------------------------------------
+
+VOID LogIndexInit(LogIndex* pIndex)
+{
+    pIndex->dwLines = 0;
+    pIndex->ullIndexed = 0;
+    pIndex->bLastSeverity = LOGSEV_NONE;
+}
+
+VOID LogIndexFree(LogIndex* pIndex)
+{
+    for (LogIndexBlock* pBlock : pIndex->blocks)
+        delete pBlock;
+    pIndex->blocks.clear();
+    pIndex->blocks.shrink_to_fit();
+    pIndex->timeMarks.clear();
+    pIndex->timeMarks.shrink_to_fit();
+    LogIndexInit(pIndex);
+}
+
+// Indexes a complete line, starting at pIndex->ullIndexed
+static VOID AddLine(LogIndex* pIndex, const CHAR* pLine, size_t cbLine)
+{
+    ULONGLONG ullTime;
+    BYTE bSeverity = LogParseLine(pLine, cbLine, &ullTime);
+    if (bSeverity == LOGSEV_NONE)
+        bSeverity = pIndex->bLastSeverity;
+    else
+        pIndex->bLastSeverity = bSeverity;
+    if (ullTime != 0 && (pIndex->timeMarks.empty() || pIndex->timeMarks.back().ullTime != ullTime))
+        pIndex->timeMarks.push_back({ pIndex->dwLines, ullTime });
+
+    LogIndexBlock* pBlock = pIndex->blocks.empty() ? NULL : pIndex->blocks.back();
+    if (pBlock == NULL || pBlock->dwLines == LOGINDEX_BLOCK_LINES || pIndex->ullIndexed - pBlock->ullBase > LOGINDEX_OFFSET_MASK) {
+        pBlock = new LogIndexBlock;
+        pBlock->ullBase = pIndex->ullIndexed;
+        pBlock->dwFirstLine = pIndex->dwLines;
+        pBlock->dwLines = 0;
+        pIndex->blocks.push_back(pBlock);
+    }
+    pBlock->dwEntries[pBlock->dwLines++] = (DWORD)(pIndex->ullIndexed - pBlock->ullBase) | ((DWORD)bSeverity << LOGINDEX_OFFSET_BITS);
+    pIndex->dwLines++;
+    pIndex->ullIndexed += cbLine;
+}
+
+// Indexes the data following the last complete line indexed. Returns the
+// number of bytes indexed: a last incomplete line is left for the next call,
+// unless bEndLine is set (i.e. the line is longer than what can be fed).
+size_t LogIndexFeed(LogIndex* pIndex, const CHAR* pData, size_t cbData, BOOL bEndLine)
+{
+    const CHAR* pEnd = pData + cbData;
+    const CHAR* pLine = pData;
+
+    while (pLine < pEnd)
+    {
+        const CHAR* pNewLine = (const CHAR*)memchr(pLine, '\n', pEnd - pLine);
+        if (pNewLine == NULL) {
+            if (!bEndLine)
+                break;
+            pNewLine = pEnd - 1;
+        }
+        AddLine(pIndex, pLine, pNewLine + 1 - pLine);
+        pLine = pNewLine + 1;
+    }
+    return pLine - pData;
+}
+
+// Returns the block holding a line
+static const LogIndexBlock* FindBlock(const LogIndex* pIndex, DWORD dwLine, size_t* piBlock)
+{
+    auto it = std::upper_bound(pIndex->blocks.begin(), pIndex->blocks.end(), dwLine,
+        [](DWORD dwLine, const LogIndexBlock* pBlock) { return dwLine < pBlock->dwFirstLine; });
+    *piBlock = (it - pIndex->blocks.begin()) - 1;
+    return *(it - 1);
+}
+
+// Gets a line range (the end includes the line break) and severity
+BOOL LogIndexGetLine(const LogIndex* pIndex, DWORD dwLine, ULONGLONG* pullStart, ULONGLONG* pullEnd, BYTE* pbSeverity)
+{
+    if (dwLine >= pIndex->dwLines)
+        return FALSE;
+
+    size_t iBlock;
+    const LogIndexBlock* pBlock = FindBlock(pIndex, dwLine, &iBlock);
+    DWORD dwEntry = pBlock->dwEntries[dwLine - pBlock->dwFirstLine];
+    *pullStart = pBlock->ullBase + (dwEntry & LOGINDEX_OFFSET_MASK);
+    *pbSeverity = (BYTE)(dwEntry >> LOGINDEX_OFFSET_BITS);
+    if (dwLine + 1 == pIndex->dwLines)
+        *pullEnd = pIndex->ullIndexed;
+    else if (dwLine + 1 - pBlock->dwFirstLine < pBlock->dwLines)
+        *pullEnd = pBlock->ullBase + (pBlock->dwEntries[dwLine + 1 - pBlock->dwFirstLine] & LOGINDEX_OFFSET_MASK);
+    else
+        *pullEnd = pIndex->blocks[iBlock + 1]->ullBase;
+    return TRUE;
+}
+
+// Returns the first line of the last run of lines logged at or after a time
+// (earlier lines logged after a clock change are ignored)
+DWORD LogIndexFindTime(const LogIndex* pIndex, ULONGLONG ullTime)
+{
+    DWORD dwLine = pIndex->dwLines;
+    for (auto it = pIndex->timeMarks.rbegin(); it != pIndex->timeMarks.rend() && it->ullTime >= ullTime; ++it)
+        dwLine = it->dwLine;
+    return dwLine;
+}
+
+// Appends the lines matching a filter, from dwFromLine to the last line
+// indexed. Returns the line to continue from when more lines are indexed.
+DWORD LogIndexFilter(const LogIndex* pIndex, const LogFilter* pFilter, DWORD dwFromLine, std::vector<DWORD>& lines)
+{
+    if (pFilter->ullFromTime != 0) {
+        DWORD dwTimeLine = LogIndexFindTime(pIndex, pFilter->ullFromTime);
+        if (dwTimeLine > dwFromLine)
+            dwFromLine = dwTimeLine;
+    }
+    if (dwFromLine >= pIndex->dwLines)
+        return pIndex->dwLines;
+
+    size_t iBlock;
+    FindBlock(pIndex, dwFromLine, &iBlock);
+    for (; iBlock < pIndex->blocks.size(); iBlock++)
+    {
+        const LogIndexBlock* pBlock = pIndex->blocks[iBlock];
+        for (DWORD i = dwFromLine - pBlock->dwFirstLine; i < pBlock->dwLines; i++) {
+            BYTE bSeverity = (BYTE)(pBlock->dwEntries[i] >> LOGINDEX_OFFSET_BITS);
+            if (pFilter->bMaxSeverity == LOGSEV_NONE || (bSeverity != LOGSEV_NONE && bSeverity <= pFilter->bMaxSeverity))
+                lines.push_back(pBlock->dwFirstLine + i);
+        }
+        dwFromLine = pBlock->dwFirstLine + pBlock->dwLines;
+    }
+    return pIndex->dwLines;
+}
@@ -0,0 +1,105 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  LogIndex.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include "framework.h"
+#include <vector>
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// Line severities, from the "[level]" prefix of the Agent log lines. Lines
+// without a level (i.e. continuation lines) get the previous line one.
+#define LOGSEV_NONE             0
+#define LOGSEV_ERROR            1
+#define LOGSEV_WARNING          2
+#define LOGSEV_INFO             3
+#define LOGSEV_DEBUG            4
+#define LOGSEV_DEBUG2           5
+
+// Lines are indexed by blocks. A line is stored on 4 bytes, as its offset
+// from the block start and its severity, so a block can't span more than
+// 256 MB (a new block is started earlier if needed).
+#define LOGINDEX_BLOCK_LINES    4096
+#define LOGINDEX_OFFSET_BITS    28
+#define LOGINDEX_OFFSET_MASK    ((1UL << LOGINDEX_OFFSET_BITS) - 1)
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// Block of indexed lines
+struct LogIndexBlock {
+    ULONGLONG ullBase;          // File offset the line offsets are relative to
+    DWORD dwFirstLine;
+    DWORD dwLines;
+    DWORD dwEntries[LOGINDEX_BLOCK_LINES];
+};
+
+// First line logged at a given time (log times are mostly increasing, so only
+// their changes are kept)
+struct LogTimeMark {
+    DWORD dwLine;
+    ULONGLONG ullTime;          // Local time, as returned by LogMakeTime
+};
+
+// Log line index. It's built incrementally: the data following the last
+// complete line indexed is fed as the file grows. The index only uses plain
+// memory and doesn't depend on how the file is read.
+struct LogIndex {
+    std::vector<LogIndexBlock*> blocks;
+    std::vector<LogTimeMark> timeMarks;
+    DWORD dwLines;
+    ULONGLONG ullIndexed;       // Bytes indexed (up to the end of the last complete line)
+    BYTE bLastSeverity;
+};
+
+// Index filter
+struct LogFilter {
+    BYTE bMaxSeverity;          // Most detailed severity shown (LOGSEV_NONE = all)
+    ULONGLONG ullFromTime;      // Oldest time shown (0 = all)
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+VOID LogIndexInit(LogIndex* pIndex);
+VOID LogIndexFree(LogIndex* pIndex);
+size_t LogIndexFeed(LogIndex* pIndex, const CHAR* pData, size_t cbData, BOOL bEndLine);
+BOOL LogIndexGetLine(const LogIndex* pIndex, DWORD dwLine, ULONGLONG* pullStart, ULONGLONG* pullEnd, BYTE* pbSeverity);
+DWORD LogIndexFindTime(const LogIndex* pIndex, ULONGLONG ullTime);
+DWORD LogIndexFilter(const LogIndex* pIndex, const LogFilter* pFilter, DWORD dwFromLine, std::vector<DWORD>& lines);
+BYTE LogParseLine(const CHAR* pLine, size_t cbLine, ULONGLONG* pullTime);
+ULONGLONG LogMakeTime(int nYear, int nMonth, int nDay, int nHour, int nMinute, int nSecond);
@@ -0,0 +1,331 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  LogScan.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// The SIMD kernels are only built for x86/x64 (with GCC or Clang, the AVX2
+// kernel is built for AVX2 on its own, the rest of the file isn't)
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define LOGSCAN_X86
+#endif
+
+#if defined(_MSC_VER)
+#define LOGSCAN_TARGET_AVX2
+#else
+#define LOGSCAN_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <string.h>
+#include "framework.h"
+#include "LogScan.h"
+#ifdef LOGSCAN_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// Marker events
+enum LogScanEvent {
+    LOGEVENT_ERROR,
+    LOGEVENT_WARNING,
+    LOGEVENT_TASK,              // Task start (followed by the task name)
+    LOGEVENT_TARGET             // Run start, for a target (ends the last task)
+};
+
+// Markers. They all start with the "]" ending the prefix before them, so they
+// aren't matched in the middle of a message. The candidate positions are the
+// "]" followed by the probe byte of a marker at its offset (a rare pair, so
+// that few candidates have to be checked in full).
+struct LogScanMarker {
+    const CHAR* szText;
+    size_t cchText;
+    size_t iProbe;
+    LogScanEvent event;
+};
+static const LogScanMarker logMarkers[] = {
+    { "][error] ",      9,  2,  LOGEVENT_ERROR },
+    { "][warning] ",    11, 2,  LOGEVENT_WARNING },
+    { "] running task ", 15, 13, LOGEVENT_TASK },
+    { "] target ",      9,  5,  LOGEVENT_TARGET }
+};
+#define LOGSCAN_MARKERS     (sizeof(logMarkers) / sizeof(logMarkers[0]))
+#define LOGSCAN_MAX_PROBE   13
+
+// Inventory task name
+static const CHAR szInventoryTask[] = "Inventory";
+
+// Scan kernel: looks for the markers at the positions from iStart to cbLimit,
+// reading up to cbData. Returns the position it stopped at (the rest is
+// scanned by the scalar kernel).
+typedef size_t (*LogScanKernel)(LogScanState* pState, const CHAR* pData, size_t cbData, size_t iStart, size_t cbLimit);
+
+static LogScanKernel pfnScanKernel = NULL;
+static DWORD dwScanKernel = LOGSCAN_KERNEL_SCALAR;
+
+
+//-[MARKERS]-------------------------------------------------------------------
+
+// Handles a task start: only the inventory runs are tracked
+static VOID OnTaskStart(LogScanState* pState, const CHAR* pName, const CHAR* pEnd, ULONGLONG ullOffset)
+{
+    const size_t cchInventory = sizeof(szInventoryTask) - 1;
+    BOOL bInventory = ((size_t)(pEnd - pName) > cchInventory && memcmp(pName, szInventoryTask, cchInventory) == 0 &&
+        (pName[cchInventory] == '\r' || pName[cchInventory] == '\n' || pName[cchInventory] == ' '));
+    pState->bInInventory = bInventory;
+    if (bInventory) {
+        pState->bInventoryFound = TRUE;
+        pState->ullInventoryStart = ullOffset;
+        pState->dwInventoryErrors = 0;
+        pState->dwInventoryWarnings = 0;
+    }
+}
+
+// Checks a candidate position against the markers
+static inline VOID CheckCandidate(LogScanState* pState, const CHAR* pData, size_t cbData, size_t iPos)
+{
+    for (size_t i = 0; i < LOGSCAN_MARKERS; i++)
+    {
+        const LogScanMarker* pMarker = &logMarkers[i];
+        if (iPos + pMarker->cchText > cbData || memcmp(pData + iPos, pMarker->szText, pMarker->cchText) != 0)
+            continue;
+        switch (pMarker->event)
+        {
+            case LOGEVENT_ERROR:
+                pState->dwErrors++;
+                if (pState->bInInventory)
+                    pState->dwInventoryErrors++;
+                break;
+            case LOGEVENT_WARNING:
+                pState->dwWarnings++;
+                if (pState->bInInventory)
+                    pState->dwInventoryWarnings++;
+                break;
+            case LOGEVENT_TASK:
+                OnTaskStart(pState, pData + iPos + pMarker->cchText, pData + cbData, pState->ullScanned + iPos);
+                break;
+            case LOGEVENT_TARGET:
+                pState->bInInventory = FALSE;
+                break;
+        }
+        return;
+    }
+}
+
+
+//-[KERNELS]-------------------------------------------------------------------
+
+static size_t ScanScalar(LogScanState* pState, const CHAR* pData, size_t cbData, size_t iStart, size_t cbLimit)
+{
+    for (size_t iPos = iStart; iPos < cbLimit; iPos++) {
+        for (size_t i = 0; i < LOGSCAN_MARKERS; i++) {
+            const LogScanMarker* pMarker = &logMarkers[i];
+            if (iPos + pMarker->cchText <= cbData && pData[iPos] == ']' && pData[iPos + pMarker->iProbe] == pMarker->szText[pMarker->iProbe]) {
+                CheckCandidate(pState, pData, cbData, iPos);
+                break;
+            }
+        }
+    }
+    return cbLimit;
+}
+
+#ifdef LOGSCAN_X86
+
+// Returns the index of the lowest bit set
+static inline DWORD LowestBit(DWORD dwMask)
+{
+#if defined(_MSC_VER)
+    unsigned long iBit;
+    _BitScanForward(&iBit, dwMask);
+    return iBit;
+#else
+    return __builtin_ctz(dwMask);
+#endif
+}
+
+// Compares 16 positions at once: the bytes are compared with "]", and the
+// bytes at each marker probe offset with its probe byte
+static size_t ScanSse2(LogScanState* pState, const CHAR* pData, size_t cbData, size_t iStart, size_t cbLimit)
+{
+    const __m128i bracket = _mm_set1_epi8(']');
+    __m128i probes[LOGSCAN_MARKERS];
+    for (size_t i = 0; i < LOGSCAN_MARKERS; i++)
+        probes[i] = _mm_set1_epi8(logMarkers[i].szText[logMarkers[i].iProbe]);
+
+    size_t iPos = iStart;
+    for (; iPos + 16 <= cbLimit && iPos + 16 + LOGSCAN_MAX_PROBE <= cbData; iPos += 16)
+    {
+        __m128i vProbes = _mm_setzero_si128();
+        for (size_t i = 0; i < LOGSCAN_MARKERS; i++) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(pData + iPos + logMarkers[i].iProbe));
+            vProbes = _mm_or_si128(vProbes, _mm_cmpeq_epi8(v, probes[i]));
+        }
+        __m128i v = _mm_loadu_si128((const __m128i*)(pData + iPos));
+        DWORD dwMask = (DWORD)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(v, bracket), vProbes));
+        while (dwMask != 0) {
+            CheckCandidate(pState, pData, cbData, iPos + LowestBit(dwMask));
+            dwMask &= dwMask - 1;
+        }
+    }
+    return iPos;
+}
+
+// Same as ScanSse2, 32 positions at once
+LOGSCAN_TARGET_AVX2 static size_t ScanAvx2(LogScanState* pState, const CHAR* pData, size_t cbData, size_t iStart, size_t cbLimit)
+{
+    const __m256i bracket = _mm256_set1_epi8(']');
+    __m256i probes[LOGSCAN_MARKERS];
+    for (size_t i = 0; i < LOGSCAN_MARKERS; i++)
+        probes[i] = _mm256_set1_epi8(logMarkers[i].szText[logMarkers[i].iProbe]);
+
+    size_t iPos = iStart;
+    for (; iPos + 32 <= cbLimit && iPos + 32 + LOGSCAN_MAX_PROBE <= cbData; iPos += 32)
+    {
+        __m256i vProbes = _mm256_setzero_si256();
+        for (size_t i = 0; i < LOGSCAN_MARKERS; i++) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(pData + iPos + logMarkers[i].iProbe));
+            vProbes = _mm256_or_si256(vProbes, _mm256_cmpeq_epi8(v, probes[i]));
+        }
+        __m256i v = _mm256_loadu_si256((const __m256i*)(pData + iPos));
+        DWORD dwMask = (DWORD)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(v, bracket), vProbes));
+        while (dwMask != 0) {
+            CheckCandidate(pState, pData, cbData, iPos + LowestBit(dwMask));
+            dwMask &= dwMask - 1;
+        }
+    }
+    _mm256_zeroupper();
+    return iPos;
+}
+
+// Returns the best kernel the CPU (and the OS, for the AVX registers) supports
+static DWORD DetectKernel()
+{
+    int regs[4];
+#if defined(_MSC_VER)
+    __cpuidex(regs, 0, 0);
+    int nMaxLeaf = regs[0];
+    __cpuidex(regs, 1, 0);
+#else
+    int nMaxLeaf = (int)__get_cpuid_max(0, NULL);
+    __cpuid_count(1, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    BOOL bSse2 = (regs[3] & (1 << 26)) != 0;
+    BOOL bOsAvx = FALSE;
+    if ((regs[2] & (1 << 27)) && (regs[2] & (1 << 28))) {
+#if defined(_MSC_VER)
+        bOsAvx = ((_xgetbv(0) & 6) == 6);
+#else
+        unsigned int uEax, uEdx;
+        __asm__ ("xgetbv" : "=a"(uEax), "=d"(uEdx) : "c"(0));
+        bOsAvx = ((uEax & 6) == 6);
+#endif
+    }
+    if (bOsAvx && nMaxLeaf >= 7) {
+#if defined(_MSC_VER)
+        __cpuidex(regs, 7, 0);
+#else
+        __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+        if (regs[1] & (1 << 5))
+            return LOGSCAN_KERNEL_AVX2;
+    }
+    return (bSse2 ? LOGSCAN_KERNEL_SSE2 : LOGSCAN_KERNEL_SCALAR);
+}
+
+#else
+
+static DWORD DetectKernel()
+{
+    return LOGSCAN_KERNEL_SCALAR;
+}
+
+#endif
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Returns the kernel used
+DWORD LogScanGetKernel()
+{
+    if (pfnScanKernel == NULL)
+        LogScanSetKernel(DetectKernel());
+    return dwScanKernel;
+}
+
+// Selects the kernel used (i.e. to compare them). Returns FALSE if the CPU
+// doesn't support it.
+BOOL LogScanSetKernel(DWORD dwKernel)
+{
+    DWORD dwSupported = DetectKernel();
+    if (dwKernel > dwSupported)
+        return FALSE;
+#ifdef LOGSCAN_X86
+    if (dwKernel == LOGSCAN_KERNEL_AVX2)
+        pfnScanKernel = ScanAvx2;
+    else if (dwKernel == LOGSCAN_KERNEL_SSE2)
+        pfnScanKernel = ScanSse2;
+    else
+#endif
+        pfnScanKernel = ScanScalar;
+    dwScanKernel = dwKernel;
+    return TRUE;
+}
+
+// Scans a log chunk, starting at pState->ullScanned. Returns the bytes scanned:
+// the last LOGSCAN_LOOKAHEAD bytes are left for the next chunk, unless bEnd is
+// set (the chunk ends the log, which the Agent only writes by whole lines).
+size_t LogScanFeed(LogScanState* pState, const CHAR* pData, size_t cbData, BOOL bEnd)
+{
+    if (pfnScanKernel == NULL)
+        LogScanSetKernel(DetectKernel());
+
+    size_t cbLimit = cbData;
+    if (!bEnd)
+        cbLimit = (cbData > LOGSCAN_LOOKAHEAD ? cbData - LOGSCAN_LOOKAHEAD : 0);
+
+    size_t iPos = pfnScanKernel(pState, pData, cbData, 0, cbLimit);
+    ScanScalar(pState, pData, cbData, iPos, cbLimit);
+    pState->ullScanned += cbLimit;
+    return cbLimit;
+}
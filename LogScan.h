@@ -0,0 +1,75 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  LogScan.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include "framework.h"
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// Scan kernels (the best one the CPU supports is used by default)
+#define LOGSCAN_KERNEL_SCALAR   0
+#define LOGSCAN_KERNEL_SSE2     1
+#define LOGSCAN_KERNEL_AVX2     2
+
+// Bytes left at the end of a chunk for the next one (unless it's the last
+// one), so a marker and the task name following it are never split
+#define LOGSCAN_LOOKAHEAD       64
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// Agent log scan state. The log is fed by chunks, in order, and only the
+// markers are looked at: "[error]", "[warning]", the task starts ("running
+// task <name>") and the run starts ("target <id>: ..."). A zero-initialized
+// state is ready to be fed.
+struct LogScanState {
+    ULONGLONG ullScanned;       // Bytes scanned
+    DWORD dwErrors;             // Whole log
+    DWORD dwWarnings;
+    BOOL bInventoryFound;       // An inventory task start was found
+    BOOL bInInventory;          // The inventory is the last task started (in the current run)
+    ULONGLONG ullInventoryStart; // Offset of the last inventory task start
+    DWORD dwInventoryErrors;    // Errors and warnings logged by the last inventory
+    DWORD dwInventoryWarnings;
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+size_t LogScanFeed(LogScanState* pState, const CHAR* pData, size_t cbData, BOOL bEnd);
+DWORD LogScanGetKernel();
+BOOL LogScanSetKernel(DWORD dwKernel);
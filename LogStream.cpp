@@ -0,0 +1,310 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  LogStream.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <stdio.h>
+#include "framework.h"
+#include "Inflate.h"
+#include "LogStream.h"
+
+
+//-[DECOMPRESSION]-------------------------------------------------------------
+
+// Queues a decompressed block, waiting while the queue is full. Returns FALSE
+// if the decompression was cancelled.
+static BOOL QueueBlock(PVOID pContext, const BYTE* pData, size_t cbData)
+{
+    LogSegment* pSeg = (LogSegment*)pContext;
+    LogStreamBlock* pBlock = new LogStreamBlock;
+    pBlock->pNext = NULL;
+    pBlock->cbData = cbData;
+    memcpy(pBlock->data, pData, cbData);
+
+    AcquireSRWLockExclusive(&pSeg->srwQueue);
+    while (pSeg->dwQueued >= LOGSTREAM_QUEUE_BLOCKS && !pSeg->bCancelled)
+        SleepConditionVariableSRW(&pSeg->cvQueue, &pSeg->srwQueue, INFINITE, 0);
+    BOOL bQueued = !pSeg->bCancelled;
+    if (bQueued) {
+        if (pSeg->pTail != NULL)
+            pSeg->pTail->pNext = pBlock;
+        else
+            pSeg->pHead = pBlock;
+        pSeg->pTail = pBlock;
+        pSeg->dwQueued++;
+        WakeAllConditionVariable(&pSeg->cvQueue);
+    }
+    ReleaseSRWLockExclusive(&pSeg->srwQueue);
+
+    if (!bQueued)
+        delete pBlock;
+    return bQueued;
+}
+
+// Decompresses a mapped segment. The file may be deleted or truncated while
+// it's mapped, in which case the pages gone can't be read anymore.
+static int InflateMappedSegment(LogSegment* pSeg, const BYTE* pData, size_t cbData, BYTE* pOut)
+{
+    __try {
+        return GzipInflate(pData, cbData, pOut, LOGSTREAM_BLOCK_SIZE, QueueBlock, pSeg);
+    }
+    __except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH) {
+        return INFLATE_BAD_DATA;
+    }
+}
+
+// Thread pool work item, decompresses a segment into its blocks queue. The
+// segments are submitted together when the stream is opened, so they're
+// decompressed in parallel, each one up to LOGSTREAM_QUEUE_BLOCKS ahead.
+static VOID CALLBACK DecompressSegment(PTP_CALLBACK_INSTANCE pInstance, PVOID pContext, PTP_WORK pWork)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pWork);
+    LogSegment* pSeg = (LogSegment*)pContext;
+    int nRes = INFLATE_BAD_DATA;
+
+    LARGE_INTEGER liSize;
+    if (GetFileSizeEx(pSeg->hFile, &liSize) && liSize.QuadPart > 0 && (ULONGLONG)liSize.QuadPart <= SIZE_MAX)
+    {
+        HANDLE hMapping = CreateFileMapping(pSeg->hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (hMapping != NULL) {
+            const BYTE* pData = (const BYTE*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+            if (pData != NULL) {
+                BYTE* pOut = new BYTE[LOGSTREAM_BLOCK_SIZE];
+                nRes = InflateMappedSegment(pSeg, pData, (size_t)liSize.QuadPart, pOut);
+                delete[] pOut;
+                UnmapViewOfFile(pData);
+            }
+            CloseHandle(hMapping);
+        }
+    }
+
+    AcquireSRWLockExclusive(&pSeg->srwQueue);
+    pSeg->nInflateRes = nRes;
+    pSeg->bDone = TRUE;
+    WakeAllConditionVariable(&pSeg->cvQueue);
+    ReleaseSRWLockExclusive(&pSeg->srwQueue);
+}
+
+// Returns the head block of a compressed segment, waiting for it (NULL once
+// the whole segment was read)
+static LogStreamBlock* PeekBlock(LogSegment* pSeg)
+{
+    AcquireSRWLockExclusive(&pSeg->srwQueue);
+    while (pSeg->pHead == NULL && !pSeg->bDone)
+        SleepConditionVariableSRW(&pSeg->cvQueue, &pSeg->srwQueue, INFINITE, 0);
+    LogStreamBlock* pBlock = pSeg->pHead;
+    ReleaseSRWLockExclusive(&pSeg->srwQueue);
+    return pBlock;
+}
+
+// Drops the head block of a compressed segment, once read
+static VOID PopBlock(LogSegment* pSeg)
+{
+    AcquireSRWLockExclusive(&pSeg->srwQueue);
+    LogStreamBlock* pBlock = pSeg->pHead;
+    pSeg->pHead = pBlock->pNext;
+    if (pSeg->pHead == NULL)
+        pSeg->pTail = NULL;
+    pSeg->dwQueued--;
+    pSeg->iBlockPos = 0;
+    WakeAllConditionVariable(&pSeg->cvQueue);
+    ReleaseSRWLockExclusive(&pSeg->srwQueue);
+    delete pBlock;
+}
+
+// Stops decompressing a segment (i.e. skipped or closed) and frees its blocks
+static VOID CancelSegment(LogSegment* pSeg)
+{
+    AcquireSRWLockExclusive(&pSeg->srwQueue);
+    pSeg->bCancelled = TRUE;
+    LogStreamBlock* pBlock = pSeg->pHead;
+    pSeg->pHead = pSeg->pTail = NULL;
+    pSeg->dwQueued = 0;
+    WakeAllConditionVariable(&pSeg->cvQueue);
+    ReleaseSRWLockExclusive(&pSeg->srwQueue);
+
+    while (pBlock != NULL) {
+        LogStreamBlock* pNext = pBlock->pNext;
+        delete pBlock;
+        pBlock = pNext;
+    }
+}
+
+
+//-[SEGMENTS]------------------------------------------------------------------
+
+static VOID AddSegment(LogStream* pStream, LPCWSTR szPath, BOOL bCompressed)
+{
+    HANDLE hFile = CreateFile(szPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return;
+
+    LogSegment* pSeg = new LogSegment();
+    wcscpy_s(pSeg->szPath, szPath);
+    pSeg->bCompressed = bCompressed;
+    pSeg->hFile = hFile;
+    InitializeSRWLock(&pSeg->srwQueue);
+    InitializeConditionVariable(&pSeg->cvQueue);
+    if (bCompressed) {
+        pSeg->pWork = CreateThreadpoolWork(DecompressSegment, pSeg, NULL);
+        if (pSeg->pWork != NULL) {
+            SubmitThreadpoolWork(pSeg->pWork);
+        }
+        else {
+            pSeg->nInflateRes = INFLATE_ABORTED;
+            pSeg->bDone = TRUE;
+        }
+    }
+    pStream->segments.push_back(pSeg);
+}
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Opens the rotated segments of a logfile (<logfile>.N or <logfile>.N.gz, the
+// compressed ones start being decompressed right away), and the logfile
+// itself if bActive is set
+LogStream* LogStreamOpen(LPCWSTR szLogfile, BOOL bActive)
+{
+    LogStream* pStream = new LogStream();
+    pStream->iSegment = 0;
+    pStream->chLast = '\n';
+
+    for (int n = LOGSTREAM_MAX_SEGMENTS; n >= 1; n--)
+    {
+        WCHAR szPath[MAX_PATH];
+        if (_snwprintf_s(szPath, _TRUNCATE, L"%s.%d.gz", szLogfile, n) < 0)
+            continue;
+        if (GetFileAttributes(szPath) != INVALID_FILE_ATTRIBUTES) {
+            AddSegment(pStream, szPath, TRUE);
+            continue;
+        }
+        szPath[wcslen(szPath) - 3] = '\0';
+        if (GetFileAttributes(szPath) != INVALID_FILE_ATTRIBUTES)
+            AddSegment(pStream, szPath, FALSE);
+    }
+    if (bActive)
+        AddSegment(pStream, szLogfile, FALSE);
+    return pStream;
+}
+
+VOID LogStreamClose(LogStream* pStream)
+{
+    for (LogSegment* pSeg : pStream->segments)
+    {
+        if (pSeg->pWork != NULL) {
+            CancelSegment(pSeg);
+            WaitForThreadpoolWorkCallbacks(pSeg->pWork, FALSE);
+            CloseThreadpoolWork(pSeg->pWork);
+            CancelSegment(pSeg);
+        }
+        CloseHandle(pSeg->hFile);
+        delete pSeg;
+    }
+    delete pStream;
+}
+
+// Reads the current segment, up to cbBuf bytes. Returns the bytes read, and 0
+// once the segment was read to its end (see LogStreamNextSegment). A line
+// break is added at the end of a segment if it doesn't end with one.
+size_t LogStreamRead(LogStream* pStream, CHAR* pBuf, size_t cbBuf)
+{
+    if (pStream->iSegment >= pStream->segments.size() || cbBuf == 0)
+        return 0;
+
+    LogSegment* pSeg = pStream->segments[pStream->iSegment];
+    size_t cbRead = 0;
+    while (cbRead < cbBuf)
+    {
+        size_t cbChunk = 0;
+        if (pSeg->bCompressed) {
+            LogStreamBlock* pBlock = PeekBlock(pSeg);
+            if (pBlock != NULL) {
+                cbChunk = min(pBlock->cbData - pSeg->iBlockPos, cbBuf - cbRead);
+                memcpy(pBuf + cbRead, pBlock->data + pSeg->iBlockPos, cbChunk);
+                pSeg->iBlockPos += cbChunk;
+                if (pSeg->iBlockPos == pBlock->cbData)
+                    PopBlock(pSeg);
+            }
+        }
+        else {
+            OVERLAPPED ov = {};
+            ov.Offset = (DWORD)pSeg->ullOffset;
+            ov.OffsetHigh = (DWORD)(pSeg->ullOffset >> 32);
+            DWORD cbToRead = (DWORD)min(cbBuf - cbRead, (size_t)LOGSTREAM_BLOCK_SIZE);
+            DWORD cbFileRead;
+            if (ReadFile(pSeg->hFile, pBuf + cbRead, cbToRead, &cbFileRead, &ov))
+                cbChunk = cbFileRead;
+            pSeg->ullOffset += cbChunk;
+        }
+        if (cbChunk == 0)
+            break;
+        cbRead += cbChunk;
+    }
+
+    if (cbRead > 0) {
+        pStream->chLast = pBuf[cbRead - 1];
+    }
+    else if (pStream->chLast != '\n') {
+        pBuf[cbRead++] = '\n';
+        pStream->chLast = '\n';
+    }
+    return cbRead;
+}
+
+// Moves to the next segment, once the current one was read to its end (or to
+// skip it). *pnRes is set to the result of the current segment decompression
+// (INFLATE_OK for a plain segment): if it failed, the data read from it stops
+// where the error was found, and may be garbage. Returns FALSE at the end of
+// the stream.
+BOOL LogStreamNextSegment(LogStream* pStream, int* pnRes)
+{
+    *pnRes = INFLATE_OK;
+    if (pStream->iSegment >= pStream->segments.size())
+        return FALSE;
+
+    LogSegment* pSeg = pStream->segments[pStream->iSegment++];
+    if (pSeg->bCompressed) {
+        AcquireSRWLockExclusive(&pSeg->srwQueue);
+        *pnRes = (pSeg->bDone ? pSeg->nInflateRes : INFLATE_ABORTED);
+        ReleaseSRWLockExclusive(&pSeg->srwQueue);
+        CancelSegment(pSeg);
+    }
+    pStream->chLast = '\n';
+    return pStream->iSegment < pStream->segments.size();
+}
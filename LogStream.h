@@ -0,0 +1,101 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  LogStream.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include "framework.h"
+#include "Inflate.h"
+#include <vector>
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// Rotated segments looked for, from <logfile>.1 (newest) to <logfile>.9,
+// each either plain or gzip-compressed (<logfile>.N.gz)
+#define LOGSTREAM_MAX_SEGMENTS  9
+
+// Compressed segments are decompressed ahead by blocks, and at most
+// LOGSTREAM_QUEUE_BLOCKS blocks are buffered per segment
+#define LOGSTREAM_BLOCK_SIZE    (256 * 1024)
+#define LOGSTREAM_QUEUE_BLOCKS  4
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// Decompressed block
+struct LogStreamBlock {
+    LogStreamBlock* pNext;
+    size_t cbData;
+    BYTE data[LOGSTREAM_BLOCK_SIZE];
+};
+
+// Log segment (a rotated log or the active one)
+struct LogSegment {
+    WCHAR szPath[MAX_PATH];
+    BOOL bCompressed;
+    HANDLE hFile;
+    // Plain segments: read offset
+    ULONGLONG ullOffset;
+    // Compressed segments: blocks queue, filled by a thread pool work item
+    // and consumed by the reader
+    PTP_WORK pWork;
+    SRWLOCK srwQueue;
+    CONDITION_VARIABLE cvQueue;
+    LogStreamBlock* pHead;
+    LogStreamBlock* pTail;
+    DWORD dwQueued;
+    BOOL bDone;                 // Decompression finished (or failed)
+    BOOL bCancelled;            // Decompression stopped by the reader
+    int nInflateRes;            // Decompression result (INFLATE_*)
+    size_t iBlockPos;           // Read position in the head block
+};
+
+// Logical stream over the rotated segments of a logfile (oldest first) and,
+// optionally, the logfile itself. It's read sequentially, one segment after
+// the other.
+struct LogStream {
+    std::vector<LogSegment*> segments;
+    size_t iSegment;            // Segment being read
+    CHAR chLast;                // Last byte read (a line break is added at the end
+                                // of a segment if it doesn't end with one)
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+LogStream* LogStreamOpen(LPCWSTR szLogfile, BOOL bActive);
+VOID LogStreamClose(LogStream* pStream);
+size_t LogStreamRead(LogStream* pStream, CHAR* pBuf, size_t cbBuf);
+BOOL LogStreamNextSegment(LogStream* pStream, int* pnRes);
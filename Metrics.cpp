@@ -0,0 +1,250 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  Metrics.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <intrin.h>
+#include <stdio.h>
+#include "framework.h"
+#include "Metrics.h"
+
+using namespace std;
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// Latency histogram. Recording a value only updates its bucket and the sum
+// with interlocked operations, so it never waits on a lock.
+struct MetricsHistogram {
+    volatile LONG64 llBuckets[METRICS_BUCKETS];
+    volatile LONG64 llSumUs;
+};
+
+// Counter and gauge descriptions
+struct MetricsInfo {
+    LPCSTR szName;
+    LPCSTR szHelp;
+};
+
+static MetricsHistogram metricsHistograms[HIST_COUNT];
+static volatile LONG64 llMetricsCounters[CNT_COUNT];
+static volatile LONG64 llMetricsGauges[GAUGE_COUNT];
+
+// Startup phases: start reference, and durations and ends (us, -1 until recorded)
+static LONGLONG llStartupBegin = 0;
+static volatile LONG64 llStartupDurationUs[STARTUP_COUNT] = { -1, -1, -1, -1, -1, -1, -1, -1, -1 };
+static volatile LONG64 llStartupEndUs[STARTUP_COUNT] = { -1, -1, -1, -1, -1, -1, -1, -1, -1 };
+
+// Histogram "probe" label values, by HIST_* index
+static const LPCSTR szMetricsProbes[HIST_COUNT] = {
+    "agent_status",
+    "agent_now",
+    "service_query",
+    "registry_read",
+    "probe_run"
+};
+
+// Startup "phase" label values, by STARTUP_* index
+static const LPCSTR szStartupPhases[STARTUP_COUNT] = {
+    "strings",
+    "settings",
+    "main_window",
+    "tray_icon",
+    "clients",
+    "probe_worker",
+    "probe_stores",
+    "first_status",
+    "window_content"
+};
+
+// By CNT_* index
+static const MetricsInfo metricsCounters[CNT_COUNT] = {
+    { "glpi_agentmonitor_agent_errors_total",           "Failed Agent status requests." },
+    { "glpi_agentmonitor_agent_notresponding_total",    "Times the Agent stopped responding." },
+    { "glpi_agentmonitor_service_changes_total",        "Agent service state changes." },
+    { "glpi_agentmonitor_forced_inventories_total",     "Forced inventory requests sent." },
+    { "glpi_agentmonitor_endpoints_down_total",         "Times a remote Agent stopped responding." },
+    { "glpi_agentmonitor_snapshots_total",              "Status snapshots published." }
+};
+
+// By GAUGE_* index
+static const MetricsInfo metricsGauges[GAUGE_COUNT] = {
+    { "glpi_agentmonitor_service_state",                "Agent service state (SERVICE_* value, 0 if unknown)." },
+    { "glpi_agentmonitor_agent_ok",                     "Agent service running." },
+    { "glpi_agentmonitor_endpoints",                    "Remote Agents monitored." },
+    { "glpi_agentmonitor_endpoints_responding",         "Remote Agents responding." },
+    { "glpi_agentmonitor_status_leader",                "Polling the local Agent for the other sessions." }
+};
+
+// Performance counter frequency, read once
+static LONGLONG MetricsQueryFrequency()
+{
+    LARGE_INTEGER liFreq;
+    QueryPerformanceFrequency(&liFreq);
+    return liFreq.QuadPart;
+}
+static const LONGLONG llMetricsFreq = MetricsQueryFrequency();
+
+
+//-[METRICS]-------------------------------------------------------------------
+
+// Returns the current time, to be passed to MetricsObserveSince
+LONGLONG MetricsNow()
+{
+    LARGE_INTEGER liNow;
+    QueryPerformanceCounter(&liNow);
+    return liNow.QuadPart;
+}
+
+// Returns the histogram bucket of a value (the smallest i for which it's up to 2^i)
+static int MetricsBucket(ULONGLONG ullUs)
+{
+    if (ullUs <= 1)
+        return 0;
+
+    ULONGLONG ullBits = ullUs - 1;
+    unsigned long ulBit;
+    if (ullBits >> 32) {
+        _BitScanReverse(&ulBit, (unsigned long)(ullBits >> 32));
+        ulBit += 32;
+    }
+    else
+        _BitScanReverse(&ulBit, (unsigned long)ullBits);
+    return min((int)ulBit + 1, METRICS_BUCKETS - 1);
+}
+
+// Records a latency (us)
+VOID MetricsObserve(int nHist, ULONGLONG ullUs)
+{
+    MetricsHistogram* pHist = &metricsHistograms[nHist];
+    InterlockedIncrement64(&pHist->llBuckets[MetricsBucket(ullUs)]);
+    InterlockedExchangeAdd64(&pHist->llSumUs, (LONG64)ullUs);
+}
+
+// Records the latency elapsed since MetricsNow returned llStart
+VOID MetricsObserveSince(int nHist, LONGLONG llStart)
+{
+    LONGLONG llElapsed = MetricsNow() - llStart;
+    MetricsObserve(nHist, (ULONGLONG)(llElapsed * 1000000 / llMetricsFreq));
+}
+
+VOID MetricsIncrement(int nCounter)
+{
+    InterlockedIncrement64(&llMetricsCounters[nCounter]);
+}
+
+VOID MetricsSetGauge(int nGauge, LONGLONG llValue)
+{
+    InterlockedExchange64(&llMetricsGauges[nGauge], llValue);
+}
+
+// Records the start of the Monitor, the startup phases ends are relative to
+VOID MetricsStartupBegin()
+{
+    llStartupBegin = MetricsNow();
+}
+
+// Records a startup phase that began when MetricsNow returned llStart. Only
+// its first run is kept (i.e. the main window content is built once).
+VOID MetricsStartupPhase(int nPhase, LONGLONG llStart)
+{
+    LONGLONG llNow = MetricsNow();
+    if (InterlockedCompareExchange64(&llStartupDurationUs[nPhase], (llNow - llStart) * 1000000 / llMetricsFreq, -1) == -1)
+        InterlockedExchange64(&llStartupEndUs[nPhase], (llNow - llStartupBegin) * 1000000 / llMetricsFreq);
+}
+
+// Appends a counter or gauge to the exposition
+static VOID MetricsFormatValue(string& strOut, const MetricsInfo* pInfo, LPCSTR szType, LONG64 llValue)
+{
+    CHAR szLine[256];
+    sprintf_s(szLine, "# HELP %s %s\n# TYPE %s %s\n%s %lld\n",
+        pInfo->szName, pInfo->szHelp, pInfo->szName, szType, pInfo->szName, llValue);
+    strOut += szLine;
+}
+
+// Formats all the metrics in the Prometheus text exposition format. The values are
+// read without stopping the recording, so a histogram may be a few values behind.
+VOID MetricsFormat(string& strOut)
+{
+    CHAR szLine[256];
+
+    strOut += "# HELP glpi_agentmonitor_probe_duration_seconds Probe duration.\n"
+        "# TYPE glpi_agentmonitor_probe_duration_seconds histogram\n";
+    for (int nHist = 0; nHist < HIST_COUNT; nHist++)
+    {
+        // The count is the sum of the buckets, so it matches the +Inf one
+        LONG64 llCumulative = 0;
+        for (int i = 0; i < METRICS_BUCKETS - 1; i++) {
+            llCumulative += metricsHistograms[nHist].llBuckets[i];
+            sprintf_s(szLine, "glpi_agentmonitor_probe_duration_seconds_bucket{probe=\"%s\",le=\"%g\"} %lld\n",
+                szMetricsProbes[nHist], (double)(1ULL << i) / 1000000, llCumulative);
+            strOut += szLine;
+        }
+        llCumulative += metricsHistograms[nHist].llBuckets[METRICS_BUCKETS - 1];
+        sprintf_s(szLine, "glpi_agentmonitor_probe_duration_seconds_bucket{probe=\"%s\",le=\"+Inf\"} %lld\n"
+            "glpi_agentmonitor_probe_duration_seconds_sum{probe=\"%s\"} %.6f\n"
+            "glpi_agentmonitor_probe_duration_seconds_count{probe=\"%s\"} %lld\n",
+            szMetricsProbes[nHist], llCumulative,
+            szMetricsProbes[nHist], (double)metricsHistograms[nHist].llSumUs / 1000000,
+            szMetricsProbes[nHist], llCumulative);
+        strOut += szLine;
+    }
+
+    for (int nCounter = 0; nCounter < CNT_COUNT; nCounter++)
+        MetricsFormatValue(strOut, &metricsCounters[nCounter], "counter", llMetricsCounters[nCounter]);
+    for (int nGauge = 0; nGauge < GAUGE_COUNT; nGauge++)
+        MetricsFormatValue(strOut, &metricsGauges[nGauge], "gauge", llMetricsGauges[nGauge]);
+
+    // Startup phases not run yet are left out
+    strOut += "# HELP glpi_agentmonitor_startup_phase_duration_seconds Startup phase duration.\n"
+        "# TYPE glpi_agentmonitor_startup_phase_duration_seconds gauge\n";
+    for (int nPhase = 0; nPhase < STARTUP_COUNT; nPhase++) {
+        if (llStartupEndUs[nPhase] < 0)
+            continue;
+        sprintf_s(szLine, "glpi_agentmonitor_startup_phase_duration_seconds{phase=\"%s\"} %.6f\n",
+            szStartupPhases[nPhase], (double)llStartupDurationUs[nPhase] / 1000000);
+        strOut += szLine;
+    }
+    strOut += "# HELP glpi_agentmonitor_startup_phase_end_seconds Startup phase end, since the Monitor started.\n"
+        "# TYPE glpi_agentmonitor_startup_phase_end_seconds gauge\n";
+    for (int nPhase = 0; nPhase < STARTUP_COUNT; nPhase++) {
+        if (llStartupEndUs[nPhase] < 0)
+            continue;
+        sprintf_s(szLine, "glpi_agentmonitor_startup_phase_end_seconds{phase=\"%s\"} %.6f\n",
+            szStartupPhases[nPhase], (double)llStartupEndUs[nPhase] / 1000000);
+        strOut += szLine;
+    }
+}
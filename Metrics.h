@@ -0,0 +1,102 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  Metrics.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include "framework.h"
+#include <string>
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// Latency histograms (log2 buckets, in microseconds)
+#define HIST_AGENT_STATUS       0   // Agent /status request
+#define HIST_AGENT_NOW          1   // Agent /now request (forced inventory)
+#define HIST_SERVICE_QUERY      2   // Agent service status query (SCM)
+#define HIST_REGISTRY_READ      3   // Settings reload after a registry change
+#define HIST_PROBE_RUN          4   // Scheduled probes run (synchronous part)
+#define HIST_COUNT              5
+
+// Counters
+#define CNT_AGENT_ERRORS        0   // Failed /status requests (local Agent)
+#define CNT_AGENT_NOTRESPONDING 1   // Local Agent going from responding to not responding
+#define CNT_SERVICE_CHANGES     2   // Agent service state changes
+#define CNT_FORCED_INVENTORIES  3   // Forced inventory requests sent
+#define CNT_ENDPOINTS_DOWN      4   // Remote Agents going from responding to not responding
+#define CNT_SNAPSHOTS           5   // Status snapshots published
+#define CNT_COUNT               6
+
+// Gauges
+#define GAUGE_SERVICE_STATE     0   // Agent service state (SERVICE_*, 0 = unknown)
+#define GAUGE_AGENT_OK          1   // Taskbar icon state
+#define GAUGE_ENDPOINTS         2   // Remote Agents monitored
+#define GAUGE_ENDPOINTS_UP      3   // Remote Agents responding
+#define GAUGE_STATUS_LEADER     4   // Polling the local Agent for the other sessions
+#define GAUGE_COUNT             5
+
+// Startup phases (recorded once, relative to MetricsStartupBegin)
+#define STARTUP_STRINGS         0   // Localized strings load (on first use)
+#define STARTUP_SETTINGS        1   // Agent and Monitor settings load
+#define STARTUP_MAINWINDOW      2   // Main window creation (hidden, without its content)
+#define STARTUP_TRAYICON        3   // Taskbar icon added
+#define STARTUP_CLIENTS         4   // Agent client and ticket queue creation
+#define STARTUP_PROBEWORKER     5   // Probe worker start
+#define STARTUP_PROBESTORES     6   // Status history, outbox and shared status open (probe worker)
+#define STARTUP_FIRSTSTATUS     7   // First statuses read and published (probe worker)
+#define STARTUP_WINDOWCONTENT   8   // Main window content (GDI+, logo and strings), when first shown
+#define STARTUP_COUNT           9
+
+// Histogram buckets: bucket i counts the values up to 2^i us, the
+// last one the larger values (2^22 us is about 4 s)
+#define METRICS_BUCKETS         24
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Recording (lock-free, callable from any thread)
+LONGLONG MetricsNow();
+VOID MetricsObserve(int nHist, ULONGLONG ullUs);
+VOID MetricsObserveSince(int nHist, LONGLONG llStart);
+VOID MetricsIncrement(int nCounter);
+VOID MetricsSetGauge(int nGauge, LONGLONG llValue);
+VOID MetricsStartupBegin();
+VOID MetricsStartupPhase(int nPhase, LONGLONG llStart);
+
+// Prometheus text exposition format
+VOID MetricsFormat(std::string& strOut);
+
+// Loopback HTTP endpoint (GET /metrics, MetricsServer.cpp)
+BOOL MetricsServerStart(DWORD dwPort);
+VOID MetricsServerStop();
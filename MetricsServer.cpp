@@ -0,0 +1,194 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  MetricsServer.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// Metrics server socket timeouts (ms) and largest request read (bytes)
+#define METRICS_SOCKET_TIMEOUT  2000
+#define METRICS_MAX_REQUEST     2048
+// Time given to the metrics server to stop (ms)
+#define METRICS_STOP_TIMEOUT    5000
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <stdio.h>
+#include <limits.h>
+#include "framework.h"
+#include "Metrics.h"
+
+using namespace std;
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// Metrics server (only started and stopped by a single thread)
+static BOOL bMetricsWsaStarted = FALSE;
+static SOCKET sockMetricsListen = INVALID_SOCKET;
+static HANDLE hMetricsThread = NULL;
+static DWORD dwMetricsServerPort = 0;
+
+
+//-[METRICS SERVER]------------------------------------------------------------
+
+// Sends a whole buffer
+static BOOL MetricsSend(SOCKET sock, const CHAR* pData, size_t cbData)
+{
+    while (cbData > 0)
+    {
+        int cbSent = send(sock, pData, (int)min(cbData, (size_t)INT_MAX), 0);
+        if (cbSent <= 0)
+            return FALSE;
+        pData += cbSent;
+        cbData -= cbSent;
+    }
+    return TRUE;
+}
+
+// Serves a single request (one per connection, only GET /metrics is found)
+static VOID MetricsServeRequest(SOCKET sock)
+{
+    DWORD dwTimeout = METRICS_SOCKET_TIMEOUT;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&dwTimeout, sizeof(dwTimeout));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (const char*)&dwTimeout, sizeof(dwTimeout));
+
+    // Read up to the end of the headers (the request has no body)
+    CHAR szRequest[METRICS_MAX_REQUEST + 1];
+    int cbRequest = 0;
+    szRequest[0] = '\0';
+    while (cbRequest < METRICS_MAX_REQUEST && strstr(szRequest, "\r\n\r\n") == NULL)
+    {
+        int cbRecv = recv(sock, szRequest + cbRequest, METRICS_MAX_REQUEST - cbRequest, 0);
+        if (cbRecv <= 0)
+            return;
+        cbRequest += cbRecv;
+        szRequest[cbRequest] = '\0';
+    }
+
+    string strBody;
+    LPCSTR szStatus = "404 Not Found";
+    if (strncmp(szRequest, "GET /metrics ", 13) == 0 || strncmp(szRequest, "GET /metrics?", 13) == 0) {
+        MetricsFormat(strBody);
+        szStatus = "200 OK";
+    }
+    else
+        strBody = "Not found\n";
+
+    CHAR szHeaders[256];
+    sprintf_s(szHeaders, "HTTP/1.1 %s\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+        "Content-Length: %zu\r\nConnection: close\r\n\r\n", szStatus, strBody.size());
+    if (MetricsSend(sock, szHeaders, strlen(szHeaders)))
+        MetricsSend(sock, strBody.data(), strBody.size());
+    shutdown(sock, SD_SEND);
+}
+
+// Metrics server thread, until the listening socket is closed by MetricsServerStop
+static DWORD WINAPI MetricsServerThreadProc(LPVOID lpParam)
+{
+    SOCKET sockListen = (SOCKET)lpParam;
+    for (;;)
+    {
+        SOCKET sock = accept(sockListen, NULL, NULL);
+        if (sock == INVALID_SOCKET) {
+            if (WSAGetLastError() == WSAECONNRESET)
+                continue;
+            break;
+        }
+        MetricsServeRequest(sock);
+        closesocket(sock);
+    }
+    return 0;
+}
+
+// Serves the metrics on a loopback port (0 stops serving them). Does nothing if
+// they are already served on that port. Must always be called from the same thread.
+BOOL MetricsServerStart(DWORD dwPort)
+{
+    if (dwPort == dwMetricsServerPort && (dwPort == 0 || hMetricsThread != NULL))
+        return TRUE;
+    MetricsServerStop();
+    if (dwPort == 0 || dwPort > 65535)
+        return dwPort == 0;
+
+    if (!bMetricsWsaStarted) {
+        WSADATA wsaData;
+        if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+            return FALSE;
+        bMetricsWsaStarted = TRUE;
+    }
+
+    SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == INVALID_SOCKET)
+        return FALSE;
+
+    // Loopback only, and no other process may bind the same port meanwhile
+    BOOL bExclusive = TRUE;
+    setsockopt(sock, SOL_SOCKET, SO_EXCLUSIVEADDRUSE, (const char*)&bExclusive, sizeof(bExclusive));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((u_short)dwPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(sock, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR || listen(sock, SOMAXCONN) == SOCKET_ERROR) {
+        closesocket(sock);
+        return FALSE;
+    }
+
+    hMetricsThread = CreateThread(NULL, 0, MetricsServerThreadProc, (LPVOID)sock, 0, NULL);
+    if (hMetricsThread == NULL) {
+        closesocket(sock);
+        return FALSE;
+    }
+    sockMetricsListen = sock;
+    dwMetricsServerPort = dwPort;
+    return TRUE;
+}
+
+// Stops serving the metrics
+VOID MetricsServerStop()
+{
+    if (hMetricsThread == NULL)
+        return;
+
+    // Closing the listening socket makes accept fail
+    closesocket(sockMetricsListen);
+    WaitForSingleObject(hMetricsThread, METRICS_STOP_TIMEOUT);
+    CloseHandle(hMetricsThread);
+    hMetricsThread = NULL;
+    sockMetricsListen = INVALID_SOCKET;
+    dwMetricsServerPort = 0;
+}
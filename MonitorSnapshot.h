@@ -0,0 +1,167 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  MonitorSnapshot.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include <wchar.h>
+#include <string>
+#include "framework.h"
+#include "AgentClient.h"
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// Snapshot fields, as reported by MonitorSnapshotDiff
+#define SNAPSHOT_SERVICE        0x0001  // Service status (bSvcQueryOk, dwSvcState)
+#define SNAPSHOT_AGENTOK        0x0002  // Taskbar icon state (bAgentOk)
+#define SNAPSHOT_AGENTSTATUS    0x0004  // Agent status
+#define SNAPSHOT_AGENTVERSION   0x0008  // Agent installation and version
+#define SNAPSHOT_STARTTYPE      0x0010  // Service startup type
+#define SNAPSHOT_NOTIFICATION   0x0020  // Notification to show
+#define SNAPSHOT_ENDPOINTS      0x0040  // Remote Agents summary
+#define SNAPSHOT_LASTINVENTORY  0x0080  // Last inventory run, from the Agent log
+#define SNAPSHOT_ALL            0x00FF
+
+// Last inventory run states
+#define LASTINV_UNKNOWN         0       // Not found in the Agent log (or not scanned yet)
+#define LASTINV_OK              1
+#define LASTINV_FAILED          2       // Errors logged
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// Agent installation and service startup type, as read from the registry
+struct AgentConfig {
+    BOOL bInstalled;            // Installer key found
+    BOOL bVersionFound;         // Installer "Version" value found
+    WCHAR szVersion[128];
+    UINT uStartTypeResId;       // Startup type string resource ID
+};
+
+// Monitor status snapshot. Snapshots are plain values: the probe worker publishes
+// a copy of its state for each change, and consumers only redraw the fields
+// reported by MonitorSnapshotDiff against the snapshot they last handled.
+struct MonitorSnapshot {
+    DWORD dwVersion;            // Incremented for each snapshot published
+    BOOL bSvcQueryOk;           // Service status queried (and the Agent installed)
+    DWORD dwSvcState;           // Last service state queried (0 = never)
+    BOOL bAgentOk;              // Service running (taskbar icon)
+    WCHAR szAgStatus[AGENTSTATUS_MAX_VALUE];
+    AgentConfig config;
+    DWORD dwNotifySeq;          // Incremented for each notification to show
+    UINT uNotifyTitleResId;
+    UINT uNotifyMsgResId;
+    DWORD dwNotifyFlags;
+    DWORD dwEndpoints;          // Remote Agents monitored
+    DWORD dwEndpointsResponding;
+    DWORD dwLastInvState;       // Last inventory run (LASTINV_*)
+    DWORD dwLastInvErrors;
+};
+
+// String lookup by resource ID (e.g. GetString), for the snapshot output
+typedef LPCWSTR (*SnapshotStringProc)(UINT uId);
+
+// Headless output: the published snapshots written as JSON lines
+struct HeadlessStream {
+    HANDLE hOut;                // Standard output, a pipe or the console
+    SnapshotStringProc pfnGetString;
+    MonitorSnapshot lastSnapshot;   // Last one written, the changes are relative to
+    BOOL bSnapshotWritten;
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Returns the SNAPSHOT_* fields that differ between two snapshots
+// (all of them if there's no previous snapshot)
+inline DWORD MonitorSnapshotDiff(const MonitorSnapshot* pOld, const MonitorSnapshot* pNew)
+{
+    if (pOld == NULL)
+        return SNAPSHOT_ALL;
+
+    DWORD dwChanged = 0;
+    if (pOld->bSvcQueryOk != pNew->bSvcQueryOk || pOld->dwSvcState != pNew->dwSvcState)
+        dwChanged |= SNAPSHOT_SERVICE;
+    if (pOld->bAgentOk != pNew->bAgentOk)
+        dwChanged |= SNAPSHOT_AGENTOK;
+    if (wcscmp(pOld->szAgStatus, pNew->szAgStatus) != 0)
+        dwChanged |= SNAPSHOT_AGENTSTATUS;
+    if (pOld->config.bInstalled != pNew->config.bInstalled ||
+        pOld->config.bVersionFound != pNew->config.bVersionFound ||
+        wcscmp(pOld->config.szVersion, pNew->config.szVersion) != 0)
+        dwChanged |= SNAPSHOT_AGENTVERSION;
+    if (pOld->config.uStartTypeResId != pNew->config.uStartTypeResId)
+        dwChanged |= SNAPSHOT_STARTTYPE;
+    if (pOld->dwNotifySeq != pNew->dwNotifySeq)
+        dwChanged |= SNAPSHOT_NOTIFICATION;
+    if (pOld->dwEndpoints != pNew->dwEndpoints || pOld->dwEndpointsResponding != pNew->dwEndpointsResponding)
+        dwChanged |= SNAPSHOT_ENDPOINTS;
+    if (pOld->dwLastInvState != pNew->dwLastInvState || pOld->dwLastInvErrors != pNew->dwLastInvErrors)
+        dwChanged |= SNAPSHOT_LASTINVENTORY;
+    return dwChanged;
+}
+
+// Updates the service status of a snapshot from a queried service state, and the
+// taskbar icon state along with it (returns TRUE if the service changed its state)
+inline BOOL MonitorSnapshotSetService(MonitorSnapshot* pSnapshot, BOOL bQueryOk, DWORD dwState)
+{
+    BOOL bChanged = FALSE;
+
+    pSnapshot->bSvcQueryOk = bQueryOk;
+    if (bQueryOk && dwState != pSnapshot->dwSvcState) {
+        pSnapshot->dwSvcState = dwState;
+        bChanged = TRUE;
+    }
+    pSnapshot->bAgentOk = (bQueryOk && pSnapshot->dwSvcState == SERVICE_RUNNING);
+    return bChanged;
+}
+
+// Queues a notification, shown once by the consumers of the snapshot
+inline VOID MonitorSnapshotNotify(MonitorSnapshot* pSnapshot, UINT titleResId, UINT msgResId, DWORD dwInfoFlags)
+{
+    pSnapshot->uNotifyTitleResId = titleResId;
+    pSnapshot->uNotifyMsgResId = msgResId;
+    pSnapshot->dwNotifyFlags = dwInfoFlags;
+    pSnapshot->dwNotifySeq++;
+}
+
+// Headless output (SnapshotJson.cpp)
+VOID JsonAppendString(std::string& strJson, LPCWSTR szValue);
+LPCSTR SnapshotJsonServiceName(const MonitorSnapshot* pSnapshot);
+VOID SnapshotJsonFormat(std::string& strJson, const MonitorSnapshot* pSnapshot, DWORD dwChanged,
+    const SYSTEMTIME* pst, SnapshotStringProc pfnGetString);
+VOID HeadlessStreamInit(HeadlessStream* pStream, HANDLE hOut, SnapshotStringProc pfnGetString);
+BOOL HeadlessWriteError(HeadlessStream* pStream, UINT msgResId, DWORD dwErr);
+BOOL HeadlessWriteSnapshot(HeadlessStream* pStream, const MonitorSnapshot* pSnapshot, const SYSTEMTIME* pst);
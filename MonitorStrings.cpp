@@ -0,0 +1,116 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  MonitorStrings.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include "framework.h"
+#include "Metrics.h"
+#include "StringTable.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// Monitor strings, loaded on first use
+static StringTable monitorStrings;
+static INIT_ONCE initMonitorStrings = INIT_ONCE_STATIC_INIT;
+
+
+//-[RESOURCES]-----------------------------------------------------------------
+
+// EnumResourceNames callback: adds the 16 strings of a string table block
+static BOOL CALLBACK AddStringBlock(HMODULE hModule, LPCWSTR lpType, LPWSTR lpName, LONG_PTR lParam)
+{
+    StringTable* pTable = (StringTable*)lParam;
+    if (!IS_INTRESOURCE(lpName))
+        return TRUE;
+
+    // Block n holds the strings (n - 1) * 16 to (n - 1) * 16 + 15. LoadString
+    // picks the language, and returns a pointer to the resource with a zero
+    // buffer size (the string isn't NUL-terminated).
+    UINT uFirstId = ((UINT)(ULONG_PTR)lpName - 1) * 16;
+    for (UINT uId = uFirstId; uId < uFirstId + 16; uId++)
+    {
+        const WCHAR* pch = NULL;
+        int cch = LoadString(hModule, uId, (LPWSTR)&pch, 0);
+        if (cch > 0 && pch != NULL)
+            StringTableAdd(pTable, uId, pch, cch);
+    }
+    return TRUE;
+}
+
+// Loads all the resource strings, in the thread UI language
+BOOL StringTableLoad(StringTable* pTable, HINSTANCE hInstance)
+{
+    StringTableClear(pTable);
+    pTable->langId = GetThreadUILanguage();
+    return EnumResourceNames(hInstance, RT_STRING, AddStringBlock, (LONG_PTR)pTable);
+}
+
+
+//-[MONITOR STRINGS]-----------------------------------------------------------
+
+// InitOnceExecuteOnce callback: loads the Monitor strings from the executable
+static BOOL CALLBACK LoadMonitorStrings(PINIT_ONCE pInitOnce, PVOID pParameter, PVOID* ppContext)
+{
+    UNREFERENCED_PARAMETER(pInitOnce);
+    UNREFERENCED_PARAMETER(pParameter);
+    UNREFERENCED_PARAMETER(ppContext);
+    LONGLONG llStart = MetricsNow();
+    StringTableLoad(&monitorStrings, GetModuleHandle(NULL));
+    MetricsStartupPhase(STARTUP_STRINGS, llStart);
+    return TRUE;
+}
+
+// Returns the Monitor strings. The UI language doesn't change while the
+// Monitor runs, so they're loaded once, by the first lookup (from any thread,
+// the others waiting for it).
+static const StringTable* GetMonitorStrings()
+{
+    InitOnceExecuteOnce(&initMonitorStrings, LoadMonitorStrings, NULL, NULL);
+    return &monitorStrings;
+}
+
+// Returns a Monitor string (an empty string if not found)
+LPCWSTR GetString(UINT uId)
+{
+    return StringTableGet(GetMonitorStrings(), uId);
+}
+
+// Copies a Monitor string, as LoadString does
+int LoadCachedString(UINT uId, LPWSTR szBuf, int cchBuf)
+{
+    return StringTableCopy(GetMonitorStrings(), uId, szBuf, cchBuf);
+}
@@ -0,0 +1,376 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  Outbox.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <stddef.h>
+#include <string.h>
+#include "framework.h"
+#include "Inflate.h"
+#include "Outbox.h"
+
+
+//-[JOURNAL]-------------------------------------------------------------------
+
+// Appends a record to a journal buffer
+static VOID AppendRecord(std::string& journal, DWORD dwSeq, WORD wType, WORD wAction, const std::string& payload)
+{
+    OutboxRecord rec;
+    rec.dwMagic = OUTBOX_MAGIC;
+    rec.dwSeq = dwSeq;
+    rec.wType = wType;
+    rec.wAction = wAction;
+    rec.cbPayload = (DWORD)payload.size();
+    const size_t cbCovered = sizeof(rec) - offsetof(OutboxRecord, dwSeq);
+    rec.dwCrc = Crc32Update(0, (const BYTE*)&rec.dwSeq, cbCovered);
+    rec.dwCrc = Crc32Update(rec.dwCrc, (const BYTE*)payload.data(), payload.size());
+    journal.append((const CHAR*)&rec, sizeof(rec));
+    journal.append(payload);
+}
+
+// Finds a pending action by sequence number
+static std::vector<OutboxAction>::iterator FindPending(Outbox* pOutbox, DWORD dwSeq)
+{
+    std::vector<OutboxAction>::iterator it = pOutbox->pending.begin();
+    while (it != pOutbox->pending.end() && it->dwSeq != dwSeq)
+        it++;
+    return it;
+}
+
+// Default outbox clock
+static ULONGLONG OutboxDefaultClock()
+{
+    return GetTickCount64();
+}
+
+// Initializes an empty outbox, without journal file
+// (pfnClock may be NULL to use GetTickCount64)
+VOID OutboxInit(Outbox* pOutbox, OutboxClock pfnClock)
+{
+    pOutbox->pfnClock = (pfnClock != NULL ? pfnClock : OutboxDefaultClock);
+    pOutbox->pending.clear();
+    pOutbox->dwNextSeq = 1;
+    for (int i = 0; i < OUTBOX_ACTION_COUNT; i++) {
+        pOutbox->ullNextReplay[i] = 0;
+        pOutbox->uBackoff[i] = 0;
+    }
+    pOutbox->cbJournal = 0;
+    pOutbox->dwCoalesced = 0;
+    pOutbox->dwReplayed = 0;
+    pOutbox->hFile = NULL;
+    pOutbox->szPath[0] = '\0';
+}
+
+// Loads a journal, replaying its records up to the first invalid one (a
+// record torn by a crash, or garbage). Returns the size of the valid records,
+// the journal should be truncated to.
+size_t OutboxLoad(Outbox* pOutbox, const BYTE* pData, size_t cbData)
+{
+    size_t iPos = 0;
+    while (cbData - iPos >= sizeof(OutboxRecord))
+    {
+        OutboxRecord rec;
+        memcpy(&rec, pData + iPos, sizeof(rec));
+        if (rec.dwMagic != OUTBOX_MAGIC || rec.cbPayload > OUTBOX_MAX_PAYLOAD ||
+            rec.cbPayload > cbData - iPos - sizeof(rec) || rec.wAction >= OUTBOX_ACTION_COUNT)
+            break;
+        const BYTE* pPayload = pData + iPos + sizeof(rec);
+        const size_t cbCovered = sizeof(rec) - offsetof(OutboxRecord, dwSeq);
+        DWORD dwCrc = Crc32Update(0, pData + iPos + offsetof(OutboxRecord, dwSeq), cbCovered);
+        if (Crc32Update(dwCrc, pPayload, rec.cbPayload) != rec.dwCrc)
+            break;
+
+        if (rec.wType == OUTBOX_RECORD_ADD) {
+            OutboxAction action;
+            action.dwSeq = rec.dwSeq;
+            action.wAction = rec.wAction;
+            action.payload.assign((const CHAR*)pPayload, rec.cbPayload);
+            action.bInFlight = FALSE;
+            pOutbox->pending.push_back(action);
+        }
+        else if (rec.wType == OUTBOX_RECORD_DONE) {
+            std::vector<OutboxAction>::iterator it = FindPending(pOutbox, rec.dwSeq);
+            if (it != pOutbox->pending.end())
+                pOutbox->pending.erase(it);
+        }
+        else {
+            break;
+        }
+        if (rec.dwSeq >= pOutbox->dwNextSeq)
+            pOutbox->dwNextSeq = rec.dwSeq + 1;
+        iPos += sizeof(rec) + rec.cbPayload;
+    }
+    pOutbox->cbJournal = iPos;
+    return iPos;
+}
+
+// Adds an action, unless an equal one is already pending (repeated requests
+// are coalesced). Returns whether it was added, and its record to append to
+// the journal.
+BOOL OutboxAdd(Outbox* pOutbox, WORD wAction, const std::string& payload, std::string& record)
+{
+    record.clear();
+    if (wAction >= OUTBOX_ACTION_COUNT || payload.size() > OUTBOX_MAX_PAYLOAD)
+        return FALSE;
+    for (const OutboxAction& action : pOutbox->pending) {
+        if (action.wAction == wAction && action.payload == payload) {
+            pOutbox->dwCoalesced++;
+            return FALSE;
+        }
+    }
+
+    OutboxAction action;
+    action.dwSeq = pOutbox->dwNextSeq++;
+    action.wAction = wAction;
+    action.payload = payload;
+    action.bInFlight = FALSE;
+    pOutbox->pending.push_back(action);
+    AppendRecord(record, action.dwSeq, OUTBOX_RECORD_ADD, wAction, payload);
+    pOutbox->cbJournal += record.size();
+    return TRUE;
+}
+
+// Hands out the oldest pending actions that can be replayed now: their type
+// is in the mask (i.e. the Agent or server they need is reachable) and isn't
+// backing off after a failure. Returns the number of actions in the batch.
+DWORD OutboxTakeBatch(Outbox* pOutbox, DWORD dwActionMask, std::vector<OutboxAction>& batch)
+{
+    batch.clear();
+    ULONGLONG ullNow = pOutbox->pfnClock();
+    for (OutboxAction& action : pOutbox->pending) {
+        if (batch.size() >= OUTBOX_BATCH_SIZE)
+            break;
+        if (action.bInFlight || !(dwActionMask & (1 << action.wAction)) || ullNow < pOutbox->ullNextReplay[action.wAction])
+            continue;
+        action.bInFlight = TRUE;
+        batch.push_back(action);
+    }
+    pOutbox->dwReplayed += (DWORD)batch.size();
+    return (DWORD)batch.size();
+}
+
+// Completes an action handed out. A failed action is kept, and the actions of
+// its type are only replayed after a delay doubled on each failure. Returns
+// whether the journal has to be updated with the record.
+BOOL OutboxComplete(Outbox* pOutbox, DWORD dwSeq, OutboxResult result, std::string& record)
+{
+    record.clear();
+    std::vector<OutboxAction>::iterator it = FindPending(pOutbox, dwSeq);
+    if (it == pOutbox->pending.end() || !it->bInFlight)
+        return FALSE;
+
+    WORD wAction = it->wAction;
+    if (result == OUTBOX_RETRY) {
+        it->bInFlight = FALSE;
+        UINT uBackoff = pOutbox->uBackoff[wAction];
+        uBackoff = (uBackoff == 0 ? OUTBOX_BACKOFF_MIN : min(uBackoff * 2, (UINT)OUTBOX_BACKOFF_MAX));
+        pOutbox->uBackoff[wAction] = uBackoff;
+        pOutbox->ullNextReplay[wAction] = pOutbox->pfnClock() + uBackoff;
+        return FALSE;
+    }
+
+    if (result == OUTBOX_DONE) {
+        pOutbox->uBackoff[wAction] = 0;
+        pOutbox->ullNextReplay[wAction] = 0;
+    }
+    pOutbox->pending.erase(it);
+    AppendRecord(record, dwSeq, OUTBOX_RECORD_DONE, wAction, std::string());
+    pOutbox->cbJournal += record.size();
+    return TRUE;
+}
+
+// Returns the sequence number of the action of a type being replayed (0 if none)
+DWORD OutboxFindInFlight(const Outbox* pOutbox, WORD wAction)
+{
+    for (const OutboxAction& action : pOutbox->pending) {
+        if (action.wAction == wAction && action.bInFlight)
+            return action.dwSeq;
+    }
+    return 0;
+}
+
+// Ends the backoff of an action type (i.e. the Agent it needs responds again)
+VOID OutboxWake(Outbox* pOutbox, WORD wAction)
+{
+    if (wAction < OUTBOX_ACTION_COUNT) {
+        pOutbox->uBackoff[wAction] = 0;
+        pOutbox->ullNextReplay[wAction] = 0;
+    }
+}
+
+// Returns the delay before the next action of the mask can be replayed (ms,
+// INFINITE if there's none)
+DWORD OutboxGetWait(const Outbox* pOutbox, DWORD dwActionMask)
+{
+    ULONGLONG ullNow = pOutbox->pfnClock();
+    DWORD dwWait = INFINITE;
+    for (const OutboxAction& action : pOutbox->pending) {
+        if (action.bInFlight || !(dwActionMask & (1 << action.wAction)))
+            continue;
+        ULONGLONG ullDue = pOutbox->ullNextReplay[action.wAction];
+        dwWait = min(dwWait, (DWORD)(ullDue > ullNow ? min(ullDue - ullNow, (ULONGLONG)OUTBOX_BACKOFF_MAX) : 0));
+    }
+    return dwWait;
+}
+
+// Builds a journal holding the pending actions only, to replace the current one
+VOID OutboxSnapshot(Outbox* pOutbox, std::string& journal)
+{
+    journal.clear();
+    for (const OutboxAction& action : pOutbox->pending)
+        AppendRecord(journal, action.dwSeq, OUTBOX_RECORD_ADD, action.wAction, action.payload);
+    pOutbox->cbJournal = journal.size();
+}
+
+
+//-[JOURNAL FILE]--------------------------------------------------------------
+
+// Opens the journal file for appending (not shared for writing: only one
+// Monitor replays the outbox at a time)
+static HANDLE OpenJournal(LPCWSTR szPath, LARGE_INTEGER* pliSize)
+{
+    HANDLE hFile = CreateFile(szPath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return NULL;
+    if (!GetFileSizeEx(hFile, pliSize)) {
+        CloseHandle(hFile);
+        return NULL;
+    }
+    return hFile;
+}
+
+// Writes to the journal file, and flushes it
+static BOOL WriteJournal(HANDLE hFile, const std::string& data)
+{
+    DWORD cbWritten = 0;
+    if (!data.empty() && (!WriteFile(hFile, data.data(), (DWORD)data.size(), &cbWritten, NULL) || cbWritten != data.size()))
+        return FALSE;
+    return FlushFileBuffers(hFile);
+}
+
+// Rewrites the journal with the pending actions only. The new journal is
+// written aside then renamed, so that either journal is whole after a crash.
+static BOOL CompactJournal(Outbox* pOutbox)
+{
+    WCHAR szTemp[ARRAYSIZE(pOutbox->szPath) + 4];
+    swprintf_s(szTemp, L"%s.tmp", pOutbox->szPath);
+    HANDLE hTemp = CreateFile(szTemp, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hTemp == INVALID_HANDLE_VALUE)
+        return FALSE;
+    std::string journal;
+    size_t cbJournal = pOutbox->cbJournal;
+    OutboxSnapshot(pOutbox, journal);
+    BOOL bWritten = WriteJournal(hTemp, journal);
+    CloseHandle(hTemp);
+
+    // The journal handle must be closed to be replaced, it's reopened either way
+    CloseHandle(pOutbox->hFile);
+    BOOL bReplaced = bWritten && MoveFileEx(szTemp, pOutbox->szPath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+    if (!bReplaced) {
+        DeleteFile(szTemp);
+        pOutbox->cbJournal = cbJournal;
+    }
+    LARGE_INTEGER liSize;
+    pOutbox->hFile = OpenJournal(pOutbox->szPath, &liSize);
+    if (pOutbox->hFile != NULL && !SetFilePointerEx(pOutbox->hFile, liSize, NULL, FILE_BEGIN)) {
+        CloseHandle(pOutbox->hFile);
+        pOutbox->hFile = NULL;
+    }
+    return (bReplaced && pOutbox->hFile != NULL);
+}
+
+// Opens the journal file and loads it (a torn tail is truncated). The outbox
+// is still usable, though not durable, if the file can't be opened.
+BOOL OutboxOpen(Outbox* pOutbox, LPCWSTR szPath)
+{
+    if (wcslen(szPath) >= ARRAYSIZE(pOutbox->szPath))
+        return FALSE;
+    LARGE_INTEGER liSize;
+    HANDLE hFile = OpenJournal(szPath, &liSize);
+    if (hFile == NULL)
+        return FALSE;
+
+    DWORD cbData = (DWORD)min(liSize.QuadPart, (LONGLONG)OUTBOX_MAX_JOURNAL);
+    BYTE* pData = new BYTE[cbData + 1];
+    DWORD cbRead = 0;
+    if (cbData > 0 && !ReadFile(hFile, pData, cbData, &cbRead, NULL))
+        cbRead = 0;
+    size_t cbValid = OutboxLoad(pOutbox, pData, cbRead);
+    delete[] pData;
+
+    // Appends go after the last valid record
+    LARGE_INTEGER liPos;
+    liPos.QuadPart = (LONGLONG)cbValid;
+    if (!SetFilePointerEx(hFile, liPos, NULL, FILE_BEGIN) || (cbValid < (size_t)liSize.QuadPart && !SetEndOfFile(hFile))) {
+        CloseHandle(hFile);
+        return FALSE;
+    }
+    wcscpy_s(pOutbox->szPath, szPath);
+    pOutbox->hFile = hFile;
+    return TRUE;
+}
+
+// Appends a record to the journal file, flushed so that it survives a crash.
+// Once no action is pending the journal is emptied, and it's rewritten with
+// the pending actions when too large.
+BOOL OutboxWrite(Outbox* pOutbox, const std::string& record)
+{
+    if (pOutbox->hFile == NULL)
+        return FALSE;
+
+    if (pOutbox->pending.empty()) {
+        LARGE_INTEGER liStart = {};
+        pOutbox->cbJournal = 0;
+        return SetFilePointerEx(pOutbox->hFile, liStart, NULL, FILE_BEGIN) && SetEndOfFile(pOutbox->hFile) &&
+            FlushFileBuffers(pOutbox->hFile);
+    }
+    // Only rewritten if mostly made of the records of actions already done
+    size_t cbLive = 0;
+    for (const OutboxAction& action : pOutbox->pending)
+        cbLive += sizeof(OutboxRecord) + action.payload.size();
+    if (pOutbox->cbJournal > OUTBOX_COMPACT_SIZE && pOutbox->cbJournal > 2 * cbLive && CompactJournal(pOutbox))
+        return TRUE;
+    return (pOutbox->hFile != NULL && WriteJournal(pOutbox->hFile, record));
+}
+
+// Closes the journal file (the pending actions are kept in memory)
+VOID OutboxClose(Outbox* pOutbox)
+{
+    if (pOutbox->hFile != NULL) {
+        CloseHandle(pOutbox->hFile);
+        pOutbox->hFile = NULL;
+    }
+}
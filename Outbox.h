@@ -0,0 +1,134 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  Outbox.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include "framework.h"
+#include <string>
+#include <vector>
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// Actions the outbox holds until they can be done
+#define OUTBOX_ACTION_INVENTORY 0           // Force an inventory (local Agent /now)
+#define OUTBOX_ACTION_TICKETS   1           // Send the ticket queue
+#define OUTBOX_ACTION_COUNT     2
+
+// Journal records: an action added, then done (or dropped)
+#define OUTBOX_MAGIC            0x584F4247  // "GBOX"
+#define OUTBOX_RECORD_ADD       1
+#define OUTBOX_RECORD_DONE      2
+#define OUTBOX_MAX_PAYLOAD      4096
+
+// Actions handed out per replay batch
+#define OUTBOX_BATCH_SIZE       16
+
+// Replay delays after a failed attempt (ms), doubled on each failure
+#define OUTBOX_BACKOFF_MIN      60000
+#define OUTBOX_BACKOFF_MAX      3600000
+
+// Largest journal loaded, and journal size over which it's rewritten with
+// the pending actions only
+#define OUTBOX_MAX_JOURNAL      (1024 * 1024)
+#define OUTBOX_COMPACT_SIZE     (64 * 1024)
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// Clock used for the replay delays (ms, monotonic)
+typedef ULONGLONG (*OutboxClock)();
+
+// Journal record header, followed by its payload. The CRC-32 covers the
+// fields after it and the payload, so a record torn by a crash is detected.
+#pragma pack(push, 1)
+struct OutboxRecord {
+    DWORD dwMagic;
+    DWORD dwCrc;
+    DWORD dwSeq;                // Action sequence number (from 1)
+    WORD wType;                 // OUTBOX_RECORD_*
+    WORD wAction;               // OUTBOX_ACTION_*
+    DWORD cbPayload;
+};
+#pragma pack(pop)
+
+// Outcome of an action replayed
+enum OutboxResult {
+    OUTBOX_DONE,                // Done, removed from the outbox
+    OUTBOX_RETRY,               // Failed, replayed later (with a backoff)
+    OUTBOX_DROP                 // Can't be done, removed from the outbox
+};
+
+// Pending action
+struct OutboxAction {
+    DWORD dwSeq;
+    WORD wAction;
+    std::string payload;        // Actions with the same type and payload are coalesced
+    BOOL bInFlight;             // Handed out by OutboxTakeBatch, not completed yet
+};
+
+// Outbox: the pending actions, and their append-only journal. The journal
+// and replay functions don't depend on the journal file.
+struct Outbox {
+    OutboxClock pfnClock;
+    std::vector<OutboxAction> pending;  // Oldest first
+    DWORD dwNextSeq;
+    ULONGLONG ullNextReplay[OUTBOX_ACTION_COUNT];
+    UINT uBackoff[OUTBOX_ACTION_COUNT];
+    size_t cbJournal;           // Journal size, as loaded and appended to
+    DWORD dwCoalesced;          // Actions added while an equal one was pending
+    DWORD dwReplayed;           // Actions handed out for replay
+    HANDLE hFile;               // Journal file (NULL if not durable)
+    WCHAR szPath[MAX_PATH];
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Journal and replay
+VOID OutboxInit(Outbox* pOutbox, OutboxClock pfnClock);
+size_t OutboxLoad(Outbox* pOutbox, const BYTE* pData, size_t cbData);
+BOOL OutboxAdd(Outbox* pOutbox, WORD wAction, const std::string& payload, std::string& record);
+DWORD OutboxTakeBatch(Outbox* pOutbox, DWORD dwActionMask, std::vector<OutboxAction>& batch);
+BOOL OutboxComplete(Outbox* pOutbox, DWORD dwSeq, OutboxResult result, std::string& record);
+DWORD OutboxFindInFlight(const Outbox* pOutbox, WORD wAction);
+VOID OutboxWake(Outbox* pOutbox, WORD wAction);
+DWORD OutboxGetWait(const Outbox* pOutbox, DWORD dwActionMask);
+VOID OutboxSnapshot(Outbox* pOutbox, std::string& journal);
+
+// Journal file
+BOOL OutboxOpen(Outbox* pOutbox, LPCWSTR szPath);
+BOOL OutboxWrite(Outbox* pOutbox, const std::string& record);
+VOID OutboxClose(Outbox* pOutbox);
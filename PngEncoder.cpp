@@ -0,0 +1,691 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  PngEncoder.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "framework.h"
+#include "Inflate.h"
+#include "PngEncoder.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// Deflate (RFC 1951) encoder, for the PNG image data: greedy LZ77 matching on
+// hash chains, and a dynamic Huffman block (or a stored one, if smaller) every
+// BLOCK_SYMBOLS symbols. Each strip is ended by an empty stored block, so that
+// the strips compressed separately can be concatenated.
+
+#define WINDOW_SIZE     32768
+#define WINDOW_MASK     (WINDOW_SIZE - 1)
+#define HASH_BITS       15
+#define HASH_SIZE       (1 << HASH_BITS)
+#define MIN_MATCH       3
+#define MAX_MATCH       258
+#define MAX_CHAIN       16      // Hash chain positions tried per match
+#define NICE_MATCH      128     // Match long enough to stop looking
+#define BLOCK_SYMBOLS   16384
+#define MAX_BITS        15      // Longest literal/length and distance code
+#define MAX_CL_BITS     7       // Longest code length code
+#define LCODES          286
+#define DCODES          30
+#define CLCODES         19
+#define END_BLOCK       256
+#define ADLER_BASE      65521
+
+struct DeflateTables {
+    BYTE lengthCode[MAX_MATCH + 1]; // Match length -> length code - 257
+    BYTE distCode[512];             // Distance - 1 -> distance code (below 256),
+                                    // then 256 + (distance - 1) / 128
+    WORD lengthBase[29];
+    BYTE lengthExtra[29];
+    WORD distBase[30];
+    BYTE distExtra[30];
+};
+
+struct DeflateState {
+    const BYTE* pIn;
+    size_t cbIn;
+    BYTE* pOut;
+    size_t iOut;
+    ULONGLONG ullBitBuf;
+    int nBitCount;
+    int head[HASH_SIZE];        // Last position of each hash
+    int prev[WINDOW_SIZE];      // Previous position with the same hash
+    DWORD syms[BLOCK_SYMBOLS];  // Literal, or distance << 9 | length
+    DWORD dwSyms;
+    size_t iBlockStart;         // Input offset of the current block
+};
+
+// Order of the code length code lengths
+static const BYTE codeLengthOrder[CLCODES] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+static const BYTE codeLengthExtra[CLCODES] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 3, 7 };
+
+static const BYTE pngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+
+//-[CHECKSUMS]-----------------------------------------------------------------
+
+static DWORD UpdateAdler(DWORD dwAdler, const BYTE* pData, size_t cbData)
+{
+    DWORD a = dwAdler & 0xFFFF;
+    DWORD b = dwAdler >> 16;
+    while (cbData > 0) {
+        // Largest run without overflowing b
+        size_t n = min(cbData, (size_t)5552);
+        cbData -= n;
+        while (n-- > 0) {
+            a += *pData++;
+            b += a;
+        }
+        a %= ADLER_BASE;
+        b %= ADLER_BASE;
+    }
+    return (b << 16) | a;
+}
+
+// Returns the Adler-32 of two concatenated data, from their own ones (and the
+// second one size)
+DWORD PngAdlerCombine(DWORD dwAdler1, DWORD dwAdler2, size_t cb2)
+{
+    DWORD dwRem = (DWORD)(cb2 % ADLER_BASE);
+    DWORD a = dwAdler1 & 0xFFFF;
+    DWORD b = (DWORD)(((ULONGLONG)dwRem * a) % ADLER_BASE);
+    a += (dwAdler2 & 0xFFFF) + ADLER_BASE - 1;
+    b += (dwAdler1 >> 16) + (dwAdler2 >> 16) + ADLER_BASE - dwRem;
+    if (a >= ADLER_BASE)
+        a -= ADLER_BASE;
+    if (a >= ADLER_BASE)
+        a -= ADLER_BASE;
+    if (b >= ADLER_BASE * 2)
+        b -= ADLER_BASE * 2;
+    if (b >= ADLER_BASE)
+        b -= ADLER_BASE;
+    return (b << 16) | a;
+}
+
+
+//-[DEFLATE]-------------------------------------------------------------------
+
+static BOOL BuildTables(DeflateTables* t)
+{
+    int nLength = MIN_MATCH;
+    for (int nCode = 0; nCode < 28; nCode++) {
+        t->lengthExtra[nCode] = (BYTE)(nCode < 8 ? 0 : (nCode - 4) / 4);
+        t->lengthBase[nCode] = (WORD)nLength;
+        for (int i = 0; i < (1 << t->lengthExtra[nCode]); i++)
+            t->lengthCode[nLength++] = (BYTE)nCode;
+    }
+    // 258 has its own code (without extra bits)
+    t->lengthExtra[28] = 0;
+    t->lengthBase[28] = MAX_MATCH;
+    t->lengthCode[MAX_MATCH] = 28;
+
+    int nDist = 1;
+    for (int nCode = 0; nCode < DCODES; nCode++) {
+        t->distExtra[nCode] = (BYTE)(nCode < 4 ? 0 : (nCode - 2) / 2);
+        t->distBase[nCode] = (WORD)nDist;
+        for (int i = 0; i < (1 << t->distExtra[nCode]); i++, nDist++) {
+            int d = nDist - 1;
+            t->distCode[d < 256 ? d : 256 + (d >> 7)] = (BYTE)nCode;
+        }
+    }
+    return TRUE;
+}
+
+static const DeflateTables* GetTables()
+{
+    // Built once, on first use
+    static DeflateTables tables;
+    static const BOOL bTables = BuildTables(&tables);
+    UNREFERENCED_PARAMETER(bTables);
+    return &tables;
+}
+
+static inline int DistCode(const DeflateTables* t, DWORD dwDist)
+{
+    return (dwDist <= 256 ? t->distCode[dwDist - 1] : t->distCode[256 + ((dwDist - 1) >> 7)]);
+}
+
+static inline VOID PutBits(DeflateState* s, DWORD dwBits, int nBits)
+{
+    s->ullBitBuf |= (ULONGLONG)dwBits << s->nBitCount;
+    s->nBitCount += nBits;
+    if (s->nBitCount >= 32) {
+        for (int i = 0; i < 4; i++) {
+            s->pOut[s->iOut++] = (BYTE)s->ullBitBuf;
+            s->ullBitBuf >>= 8;
+        }
+        s->nBitCount -= 32;
+    }
+}
+
+// Writes the pending bits, padded to a byte boundary
+static VOID AlignBits(DeflateState* s)
+{
+    while (s->nBitCount > 0) {
+        s->pOut[s->iOut++] = (BYTE)s->ullBitBuf;
+        s->ullBitBuf >>= 8;
+        s->nBitCount -= 8;
+    }
+    s->ullBitBuf = 0;
+    s->nBitCount = 0;
+}
+
+// Computes the Huffman code lengths of symbols from their frequencies, limited
+// to nMaxBits (unused symbols get no code)
+static VOID BuildLengths(const DWORD* pFreq, int nSyms, int nMaxBits, BYTE* pLen)
+{
+    int syms[LCODES];
+    int n = 0;
+    for (int i = 0; i < nSyms; i++) {
+        pLen[i] = 0;
+        if (pFreq[i] > 0)
+            syms[n++] = i;
+    }
+    if (n == 0)
+        return;
+    if (n == 1) {
+        pLen[syms[0]] = 1;
+        return;
+    }
+    std::sort(syms, syms + n, [pFreq](int a, int b) { return pFreq[a] < pFreq[b] || (pFreq[a] == pFreq[b] && a < b); });
+
+    // Huffman tree, built from two queues (the sorted leaves and the nodes,
+    // created in increasing weight order): leaves are 0 to n - 1 and nodes
+    // n to 2n - 2 (the root)
+    ULONGLONG weight[2 * LCODES];
+    int parent[2 * LCODES];
+    for (int i = 0; i < n; i++)
+        weight[i] = pFreq[syms[i]];
+    int iLeaf = 0;
+    int iNode = n;
+    for (int k = n; k < 2 * n - 1; k++) {
+        weight[k] = 0;
+        for (int c = 0; c < 2; c++) {
+            int m = (iLeaf < n && (iNode >= k || weight[iLeaf] <= weight[iNode]) ? iLeaf++ : iNode++);
+            parent[m] = k;
+            weight[k] += weight[m];
+        }
+    }
+    int depth[2 * LCODES];
+    depth[2 * n - 2] = 0;
+    for (int k = 2 * n - 3; k >= 0; k--)
+        depth[k] = depth[parent[k]] + 1;
+
+    // Codes longer than nMaxBits are shortened, and codes split until the
+    // code is complete again
+    int count[MAX_BITS + 1] = {};
+    for (int i = 0; i < n; i++)
+        count[min(depth[i], nMaxBits)]++;
+    ULONGLONG ullKraft = 0;
+    for (int l = 1; l <= nMaxBits; l++)
+        ullKraft += (ULONGLONG)count[l] << (nMaxBits - l);
+    while (ullKraft > (1ULL << nMaxBits)) {
+        count[nMaxBits]--;
+        for (int l = nMaxBits - 1; l > 0; l--) {
+            if (count[l] > 0) {
+                count[l]--;
+                count[l + 1] += 2;
+                break;
+            }
+        }
+        ullKraft--;
+    }
+
+    // The least frequent symbols get the longest codes
+    int iSym = 0;
+    for (int l = nMaxBits; l > 0; l--) {
+        for (int c = 0; c < count[l]; c++)
+            pLen[syms[iSym++]] = (BYTE)l;
+    }
+}
+
+// Computes the canonical codes from their lengths (bit-reversed, as they're
+// written LSB first)
+static VOID BuildCodes(const BYTE* pLen, int nSyms, WORD* pCode)
+{
+    int count[MAX_BITS + 1] = {};
+    for (int i = 0; i < nSyms; i++)
+        count[pLen[i]]++;
+    count[0] = 0;
+    int next[MAX_BITS + 1];
+    int nCode = 0;
+    for (int l = 1; l <= MAX_BITS; l++) {
+        nCode = (nCode + count[l - 1]) << 1;
+        next[l] = nCode;
+    }
+    for (int i = 0; i < nSyms; i++) {
+        if (pLen[i] == 0)
+            continue;
+        int c = next[pLen[i]]++;
+        int r = 0;
+        for (int b = 0; b < pLen[i]; b++, c >>= 1)
+            r = (r << 1) | (c & 1);
+        pCode[i] = (WORD)r;
+    }
+}
+
+// Writes stored blocks (at least one, even if empty)
+static VOID WriteStored(DeflateState* s, const BYTE* pData, size_t cbData)
+{
+    do {
+        size_t cbPiece = min(cbData, (size_t)65535);
+        PutBits(s, 0, 3);
+        AlignBits(s);
+        s->pOut[s->iOut++] = (BYTE)cbPiece;
+        s->pOut[s->iOut++] = (BYTE)(cbPiece >> 8);
+        s->pOut[s->iOut++] = (BYTE)~cbPiece;
+        s->pOut[s->iOut++] = (BYTE)(~cbPiece >> 8);
+        if (cbPiece > 0)
+            memcpy(s->pOut + s->iOut, pData, cbPiece);
+        s->iOut += cbPiece;
+        pData += cbPiece;
+        cbData -= cbPiece;
+    } while (cbData > 0);
+}
+
+// Writes the symbols found since the last block, as a dynamic Huffman block or
+// as stored blocks, whichever is smaller
+static VOID WriteBlock(DeflateState* s, size_t iBlockEnd)
+{
+    const DeflateTables* t = GetTables();
+    DWORD litFreq[LCODES] = {};
+    DWORD distFreq[DCODES] = {};
+    for (DWORD i = 0; i < s->dwSyms; i++) {
+        DWORD dwSym = s->syms[i];
+        if (dwSym < 256) {
+            litFreq[dwSym]++;
+        }
+        else {
+            litFreq[257 + t->lengthCode[dwSym & 0x1FF]]++;
+            distFreq[DistCode(t, dwSym >> 9)]++;
+        }
+    }
+    litFreq[END_BLOCK] = 1;
+
+    BYTE litLen[LCODES];
+    BYTE distLen[DCODES];
+    BuildLengths(litFreq, LCODES, MAX_BITS, litLen);
+    BuildLengths(distFreq, DCODES, MAX_BITS, distLen);
+    int nLit = LCODES;
+    while (nLit > 257 && litLen[nLit - 1] == 0)
+        nLit--;
+    int nDist = DCODES;
+    while (nDist > 1 && distLen[nDist - 1] == 0)
+        nDist--;
+    // Without matches, a single unused distance code is still sent
+    if (distLen[0] == 0 && nDist == 1)
+        distLen[0] = 1;
+
+    // Code lengths, run-length encoded
+    BYTE lens[LCODES + DCODES];
+    memcpy(lens, litLen, nLit);
+    memcpy(lens + nLit, distLen, nDist);
+    int nLens = nLit + nDist;
+    BYTE clSyms[LCODES + DCODES];
+    BYTE clExtra[LCODES + DCODES];
+    int nClSyms = 0;
+    DWORD clFreq[CLCODES] = {};
+    for (int i = 0; i < nLens; ) {
+        int nRun = 1;
+        while (i + nRun < nLens && lens[i + nRun] == lens[i])
+            nRun++;
+        if (lens[i] == 0 && nRun >= 3) {
+            nRun = min(nRun, 138);
+            clSyms[nClSyms] = (nRun >= 11 ? 18 : 17);
+            clExtra[nClSyms] = (BYTE)(nRun - (nRun >= 11 ? 11 : 3));
+            i += nRun;
+        }
+        else if (lens[i] != 0 && nRun >= 4) {
+            // Sent once, then repeated
+            clSyms[nClSyms] = lens[i];
+            clExtra[nClSyms++] = 0;
+            clFreq[lens[i]]++;
+            nRun = min(nRun - 1, 6);
+            clSyms[nClSyms] = 16;
+            clExtra[nClSyms] = (BYTE)(nRun - 3);
+            i += 1 + nRun;
+        }
+        else {
+            clSyms[nClSyms] = lens[i];
+            clExtra[nClSyms] = 0;
+            i++;
+        }
+        clFreq[clSyms[nClSyms++]]++;
+    }
+    BYTE clLen[CLCODES];
+    BuildLengths(clFreq, CLCODES, MAX_CL_BITS, clLen);
+    int nClCodes = CLCODES;
+    while (nClCodes > 4 && clLen[codeLengthOrder[nClCodes - 1]] == 0)
+        nClCodes--;
+
+    // Dynamic block size, compared to the stored blocks one (counting the
+    // headers and the padding of every stored block)
+    ULONGLONG ullDynBits = 3 + 5 + 5 + 4 + 3 * nClCodes;
+    for (int i = 0; i < CLCODES; i++)
+        ullDynBits += (ULONGLONG)clFreq[i] * (clLen[i] + codeLengthExtra[i]);
+    for (int i = 0; i < LCODES; i++)
+        ullDynBits += (ULONGLONG)litFreq[i] * (litLen[i] + (i > END_BLOCK ? t->lengthExtra[i - 257] : 0));
+    for (int i = 0; i < DCODES; i++)
+        ullDynBits += (ULONGLONG)distFreq[i] * (distLen[i] + t->distExtra[i]);
+    size_t cbRaw = iBlockEnd - s->iBlockStart;
+    ULONGLONG ullStoredBits = (ULONGLONG)cbRaw * 8 + (cbRaw / 65535 + 1) * 48;
+
+    if (ullDynBits >= ullStoredBits) {
+        WriteStored(s, s->pIn + s->iBlockStart, cbRaw);
+    }
+    else {
+        WORD litCode[LCODES];
+        WORD distCode[DCODES];
+        WORD clCode[CLCODES];
+        BuildCodes(litLen, LCODES, litCode);
+        BuildCodes(distLen, DCODES, distCode);
+        BuildCodes(clLen, CLCODES, clCode);
+
+        PutBits(s, 2 << 1, 3);
+        PutBits(s, nLit - 257, 5);
+        PutBits(s, nDist - 1, 5);
+        PutBits(s, nClCodes - 4, 4);
+        for (int i = 0; i < nClCodes; i++)
+            PutBits(s, clLen[codeLengthOrder[i]], 3);
+        for (int i = 0; i < nClSyms; i++) {
+            PutBits(s, clCode[clSyms[i]], clLen[clSyms[i]]);
+            if (codeLengthExtra[clSyms[i]] > 0)
+                PutBits(s, clExtra[i], codeLengthExtra[clSyms[i]]);
+        }
+
+        for (DWORD i = 0; i < s->dwSyms; i++) {
+            DWORD dwSym = s->syms[i];
+            if (dwSym < 256) {
+                PutBits(s, litCode[dwSym], litLen[dwSym]);
+                continue;
+            }
+            DWORD dwLength = dwSym & 0x1FF;
+            DWORD dwDist = dwSym >> 9;
+            int nCode = t->lengthCode[dwLength];
+            PutBits(s, litCode[257 + nCode], litLen[257 + nCode]);
+            if (t->lengthExtra[nCode] > 0)
+                PutBits(s, dwLength - t->lengthBase[nCode], t->lengthExtra[nCode]);
+            nCode = DistCode(t, dwDist);
+            PutBits(s, distCode[nCode], distLen[nCode]);
+            if (t->distExtra[nCode] > 0)
+                PutBits(s, dwDist - t->distBase[nCode], t->distExtra[nCode]);
+        }
+        PutBits(s, litCode[END_BLOCK], litLen[END_BLOCK]);
+    }
+    s->iBlockStart = iBlockEnd;
+    s->dwSyms = 0;
+}
+
+static inline DWORD Hash(const BYTE* p)
+{
+    return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static inline size_t MatchLength(const BYTE* pA, const BYTE* pB, size_t cbMax)
+{
+    size_t n = 0;
+    while (n + 8 <= cbMax) {
+        ULONGLONG a, b;
+        memcpy(&a, pA + n, 8);
+        memcpy(&b, pB + n, 8);
+        if (a != b)
+            break;
+        n += 8;
+    }
+    while (n < cbMax && pA[n] == pB[n])
+        n++;
+    return n;
+}
+
+// Compresses the whole input, ended by an empty stored block (the stream is
+// left open and byte-aligned)
+static VOID Deflate(DeflateState* s)
+{
+    memset(s->head, 0xFF, sizeof(s->head));
+    const BYTE* p = s->pIn;
+    size_t cb = s->cbIn;
+    size_t i = 0;
+    while (i < cb)
+    {
+        size_t cbBest = 0;
+        size_t cbBestDist = 0;
+        if (i + MIN_MATCH <= cb) {
+            DWORD h = Hash(p + i);
+            int nCand = s->head[h];
+            s->prev[i & WINDOW_MASK] = nCand;
+            s->head[h] = (int)i;
+
+            size_t cbMax = min(cb - i, (size_t)MAX_MATCH);
+            for (int nChain = MAX_CHAIN; nCand >= 0 && i - nCand <= WINDOW_SIZE && nChain > 0; nChain--) {
+                const BYTE* q = p + nCand;
+                if (q[cbBest] == p[i + cbBest]) {
+                    size_t cbMatch = MatchLength(p + i, q, cbMax);
+                    if (cbMatch > cbBest) {
+                        cbBest = cbMatch;
+                        cbBestDist = i - nCand;
+                        if (cbBest >= NICE_MATCH || cbBest == cbMax)
+                            break;
+                    }
+                }
+                nCand = s->prev[nCand & WINDOW_MASK];
+            }
+        }
+
+        if (cbBest >= MIN_MATCH) {
+            s->syms[s->dwSyms++] = (DWORD)(cbBestDist << 9 | cbBest);
+            // Positions inside the match are still hashed
+            for (size_t j = i + 1; j < i + cbBest && j + MIN_MATCH <= cb; j++) {
+                DWORD h = Hash(p + j);
+                s->prev[j & WINDOW_MASK] = s->head[h];
+                s->head[h] = (int)j;
+            }
+            i += cbBest;
+        }
+        else {
+            s->syms[s->dwSyms++] = p[i];
+            i++;
+        }
+        if (s->dwSyms == BLOCK_SYMBOLS)
+            WriteBlock(s, i);
+    }
+    if (s->dwSyms > 0)
+        WriteBlock(s, cb);
+    WriteStored(s, NULL, 0);
+}
+
+
+//-[PNG]-----------------------------------------------------------------------
+
+static inline VOID PutBigEndian(BYTE* p, DWORD dwValue)
+{
+    p[0] = (BYTE)(dwValue >> 24);
+    p[1] = (BYTE)(dwValue >> 16);
+    p[2] = (BYTE)(dwValue >> 8);
+    p[3] = (BYTE)dwValue;
+}
+
+// Completes a chunk whose data was written at pChunk + 8. Returns its size.
+static size_t EndChunk(BYTE* pChunk, const CHAR* szType, size_t cbData)
+{
+    PutBigEndian(pChunk, (DWORD)cbData);
+    memcpy(pChunk + 4, szType, 4);
+    PutBigEndian(pChunk + 8 + cbData, Crc32Update(0, pChunk + 4, 4 + cbData));
+    return 12 + cbData;
+}
+
+// Converts a BGRX row to RGB
+static VOID ConvertRow(const BYTE* pPixels, DWORD dwWidth, BYTE* pRgb)
+{
+    for (DWORD x = 0; x < dwWidth; x++, pPixels += 4, pRgb += 3) {
+        pRgb[0] = pPixels[2];
+        pRgb[1] = pPixels[1];
+        pRgb[2] = pPixels[0];
+    }
+}
+
+static inline BYTE Paeth(BYTE a, BYTE b, BYTE c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+    return (pa <= pb && pa <= pc ? a : (pb <= pc ? b : c));
+}
+
+// Filters a RGB row, with the filter whose output has the smallest sum of
+// absolute (signed) values: None, Sub, Up or Paeth
+static VOID FilterRow(const BYTE* pCur, const BYTE* pPrev, size_t cbRow, BYTE* pOut)
+{
+    ULONGLONG cost[5] = {};
+    for (size_t i = 0; i < cbRow; i++) {
+        BYTE a = (i >= 3 ? pCur[i - 3] : 0);
+        BYTE c = (i >= 3 ? pPrev[i - 3] : 0);
+        BYTE b = pPrev[i];
+        BYTE x = pCur[i];
+        BYTE v[5] = { x, (BYTE)(x - a), (BYTE)(x - b), 0, (BYTE)(x - Paeth(a, b, c)) };
+        for (int f = 0; f < 5; f++)
+            cost[f] += (v[f] < 128 ? v[f] : 256 - v[f]);
+    }
+    int nFilter = 0;
+    for (int f = 1; f < 5; f++) {
+        if (f != 3 && cost[f] < cost[nFilter])
+            nFilter = f;
+    }
+
+    pOut[0] = (BYTE)nFilter;
+    pOut++;
+    for (size_t i = 0; i < cbRow; i++) {
+        BYTE a = (i >= 3 ? pCur[i - 3] : 0);
+        BYTE c = (i >= 3 ? pPrev[i - 3] : 0);
+        BYTE b = pPrev[i];
+        switch (nFilter) {
+        case 0: pOut[i] = pCur[i]; break;
+        case 1: pOut[i] = (BYTE)(pCur[i] - a); break;
+        case 2: pOut[i] = (BYTE)(pCur[i] - b); break;
+        default: pOut[i] = (BYTE)(pCur[i] - Paeth(a, b, c)); break;
+        }
+    }
+}
+
+DWORD PngStripCount(const PngImage* pImage)
+{
+    return (pImage->dwHeight + PNG_STRIP_ROWS - 1) / PNG_STRIP_ROWS;
+}
+
+// Returns the largest encoded strip size (when stored)
+size_t PngStripBound(const PngImage* pImage)
+{
+    size_t cbRaw = (size_t)PNG_STRIP_ROWS * (1 + 3 * (size_t)pImage->dwWidth);
+    return cbRaw + 16 * (cbRaw / BLOCK_SYMBOLS + 2) + 32;
+}
+
+// Encodes a strip (thread-safe, strips can be encoded in any order)
+VOID PngEncodeStrip(const PngImage* pImage, DWORD dwStrip, PngStrip* pStrip)
+{
+    DWORD dwFirstRow = dwStrip * PNG_STRIP_ROWS;
+    DWORD dwRows = min((DWORD)PNG_STRIP_ROWS, pImage->dwHeight - dwFirstRow);
+    size_t cbRow = 3 * (size_t)pImage->dwWidth;
+    size_t cbRaw = dwRows * (1 + cbRow);
+
+    // Filtered rows (the first one is filtered against the previous strip
+    // last one)
+    BYTE* pRaw = new BYTE[cbRaw];
+    BYTE* pPrev = new BYTE[cbRow];
+    BYTE* pCur = new BYTE[cbRow];
+    if (dwFirstRow > 0)
+        ConvertRow(pImage->pPixels + (dwFirstRow - 1) * pImage->cbStride, pImage->dwWidth, pPrev);
+    else
+        memset(pPrev, 0, cbRow);
+    for (DWORD r = 0; r < dwRows; r++) {
+        ConvertRow(pImage->pPixels + (dwFirstRow + r) * pImage->cbStride, pImage->dwWidth, pCur);
+        FilterRow(pCur, pPrev, cbRow, pRaw + r * (1 + cbRow));
+        std::swap(pCur, pPrev);
+    }
+    delete[] pPrev;
+    delete[] pCur;
+    pStrip->cbRaw = cbRaw;
+    pStrip->dwAdler = UpdateAdler(1, pRaw, cbRaw);
+
+    // IDAT chunk, starting with the zlib header for the first strip
+    DeflateState* s = new DeflateState;
+    s->pIn = pRaw;
+    s->cbIn = cbRaw;
+    s->pOut = pStrip->pData + 8;
+    s->iOut = 0;
+    s->ullBitBuf = 0;
+    s->nBitCount = 0;
+    s->dwSyms = 0;
+    s->iBlockStart = 0;
+    if (dwStrip == 0) {
+        s->pOut[s->iOut++] = 0x78;
+        s->pOut[s->iOut++] = 0x01;
+    }
+    Deflate(s);
+    pStrip->cbData = EndChunk(pStrip->pData, "IDAT", s->iOut);
+    delete s;
+    delete[] pRaw;
+}
+
+// Writes the PNG signature and the IHDR chunk (8-bit RGB)
+size_t PngWriteHeader(const PngImage* pImage, BYTE* pOut)
+{
+    memcpy(pOut, pngSignature, sizeof(pngSignature));
+    BYTE* pChunk = pOut + sizeof(pngSignature);
+    PutBigEndian(pChunk + 8, pImage->dwWidth);
+    PutBigEndian(pChunk + 12, pImage->dwHeight);
+    pChunk[16] = 8;             // Bit depth
+    pChunk[17] = 2;             // RGB
+    pChunk[18] = 0;             // Deflate
+    pChunk[19] = 0;             // Adaptive filtering
+    pChunk[20] = 0;             // Not interlaced
+    return sizeof(pngSignature) + EndChunk(pChunk, "IHDR", 13);
+}
+
+// Writes the last IDAT chunk, ending the zlib stream (given the Adler-32 of
+// all the strips), and the IEND chunk
+size_t PngWriteTrailer(DWORD dwAdler, BYTE* pOut)
+{
+    // Final fixed Huffman block, only holding the end of block code
+    pOut[8] = 0x03;
+    pOut[9] = 0x00;
+    PutBigEndian(pOut + 10, dwAdler);
+    size_t cbIdat = EndChunk(pOut, "IDAT", 6);
+    return cbIdat + EndChunk(pOut + cbIdat, "IEND", 0);
+}
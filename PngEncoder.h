@@ -0,0 +1,79 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  PngEncoder.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include "framework.h"
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// Image rows per strip. The strips are encoded independently (the deflate
+// back-references don't cross strips), so they can be encoded in parallel.
+#define PNG_STRIP_ROWS          64
+
+// PNG signature and IHDR chunk, and IEND chunk preceded by the last IDAT one
+// (final deflate block and zlib checksum)
+#define PNG_HEADER_SIZE         33
+#define PNG_TRAILER_SIZE        30
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// 32 bpp BGRX image (i.e. a top-down DIB section), encoded as 24 bpp RGB
+struct PngImage {
+    const BYTE* pPixels;
+    size_t cbStride;
+    DWORD dwWidth;
+    DWORD dwHeight;
+};
+
+// Encoded strip: an IDAT chunk holding the strip part of the zlib stream
+struct PngStrip {
+    BYTE* pData;                // PngStripBound bytes, allocated by the caller
+    size_t cbData;
+    DWORD dwAdler;              // Adler-32 of the strip filtered rows
+    size_t cbRaw;               // Size of the strip filtered rows
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+DWORD PngStripCount(const PngImage* pImage);
+size_t PngStripBound(const PngImage* pImage);
+VOID PngEncodeStrip(const PngImage* pImage, DWORD dwStrip, PngStrip* pStrip);
+size_t PngWriteHeader(const PngImage* pImage, BYTE* pOut);
+size_t PngWriteTrailer(DWORD dwAdler, BYTE* pOut);
+DWORD PngAdlerCombine(DWORD dwAdler1, DWORD dwAdler2, size_t cb2);
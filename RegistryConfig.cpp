@@ -0,0 +1,273 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  RegistryConfig.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <algorithm>
+#include <string>
+#include "framework.h"
+#include "resource.h"
+#include "RegistryConfig.h"
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Sets the backend of a registry config, with no key watched yet
+VOID RegConfigInit(RegistryConfig* pCfg, RegistryBackend* pBackend, LPCWSTR szServiceName)
+{
+    *pCfg = {};
+    pCfg->pBackend = pBackend;
+    pCfg->szServiceName = szServiceName;
+}
+
+// Opens a key, falling back to the 32-bit software key (WOW6432Node)
+static LONG OpenSoftwareKey(RegistryConfig* pCfg, LPCWSTR szSubkey, HKEY* phKey, WCHAR szKey[MAX_PATH])
+{
+    wsprintf(szKey, L"SOFTWARE\\%s", szSubkey);
+    LONG lRes = pCfg->pBackend->OpenKey(szKey, KEY_READ, phKey);
+    if (lRes != ERROR_SUCCESS) {
+        wsprintf(szKey, L"SOFTWARE\\WOW6432Node\\%s", szSubkey);
+        lRes = pCfg->pBackend->OpenKey(szKey, KEY_READ, phKey);
+    }
+    return lRes;
+}
+
+// Reduces the Agent "server" value to the GLPI server base URL
+static VOID ParseServerUrl(LPCWSTR szValue, LPWSTR szServer, size_t cchServer)
+{
+    // Strip any quotes from the "server" value
+    std::wstring strServer = szValue;
+    strServer.erase(std::remove(strServer.begin(), strServer.end(), '\''), strServer.end());
+    strServer.erase(std::remove(strServer.begin(), strServer.end(), '\"'), strServer.end());
+    wcscpy_s(szServer, cchServer, strServer.c_str());
+
+    if (wcscmp(L"", szServer) != 0) {
+        // Get only the first URL if more than one is configured
+        LPWSTR szSubstr = wcsstr(szServer, L",");
+        if (szSubstr != nullptr)
+            szSubstr[0] = '\0';
+        // Get GLPI server base URL (as GLPI may be located in a subfolder,
+        // we can't guess the exact location just by stripping the domain
+        // from the "server" parameter).
+        szSubstr = wcsstr(szServer, L"/plugins/");
+        if (szSubstr == nullptr) {
+            szSubstr = wcsstr(szServer, L"/marketplace/");
+            if (szSubstr == nullptr)
+                szSubstr = wcsstr(szServer, L"/front/inventory.php");
+        }
+        if (szSubstr != nullptr) {
+            // As szSubstr points to where the first character of the substring
+            // was found in the string itself, replacing it with a null character
+            // effectively cuts the string.
+            szSubstr[0] = '\0';
+        }
+        // Strip any trailing slash
+        size_t lServerLen = wcslen(szServer);
+        while (lServerLen > 0 && szServer[lServerLen - 1] == '/') {
+            szServer[--lServerLen] = '\0';
+        }
+        // In case we didn't find the substrings, assume the "server" value
+        // in the registry is the base GLPI url itself.
+    }
+}
+
+// Reads the Agent settings (HTTPD port, server URL and logfile)
+// On error, returns the error code and sets the error message resource ID
+LONG RegConfigReadAgentSettings(RegistryConfig* pCfg, AgentSettings* pSettings, UINT* puErrResId)
+{
+    RegistryBackend* pBackend = pCfg->pBackend;
+    HKEY hk;
+    WCHAR szKey[MAX_PATH];
+
+    LONG lRes = OpenSoftwareKey(pCfg, pCfg->szServiceName, &hk, szKey);
+    if (lRes != ERROR_SUCCESS) {
+        *puErrResId = IDS_ERR_AGENTSETTINGS;
+        return lRes;
+    }
+    wcscpy_s(pCfg->szAgentKey, szKey);
+    *pSettings = {};
+
+    // Get HTTPD port
+    WCHAR szValueBuf[MAX_PATH] = {};
+    DWORD szValueBufLen = sizeof(szValueBuf) - sizeof(WCHAR);
+    lRes = pBackend->QueryValue(hk, L"httpd-port", szValueBuf, &szValueBufLen);
+    if (lRes != ERROR_SUCCESS) {
+        pBackend->CloseKey(hk);
+        *puErrResId = IDS_ERR_HTTPDPORT;
+        return lRes;
+    }
+    pSettings->dwPort = _wtoi(szValueBuf);
+
+    // Get server URL
+    WCHAR szServerBuf[256] = {};
+    DWORD szServerBufLen = sizeof(szServerBuf) - sizeof(WCHAR);
+    if (pBackend->QueryValue(hk, L"server", szServerBuf, &szServerBufLen) == ERROR_SUCCESS)
+        ParseServerUrl(szServerBuf, pSettings->szServer, ARRAYSIZE(pSettings->szServer));
+
+    // Get agent logfile path
+    DWORD szLogfileLen = sizeof(pSettings->szLogfile) - sizeof(WCHAR);
+    if (pBackend->QueryValue(hk, L"logfile", pSettings->szLogfile, &szLogfileLen) != ERROR_SUCCESS)
+        ZeroMemory(pSettings->szLogfile, sizeof(pSettings->szLogfile));
+
+    pBackend->CloseKey(hk);
+    return ERROR_SUCCESS;
+}
+
+// Reads the Agent version into the config snapshot
+VOID RegConfigReadVersion(RegistryConfig* pCfg, AgentConfig* pAgentCfg)
+{
+    HKEY hk;
+    WCHAR szKey[MAX_PATH];
+
+    ZeroMemory(pAgentCfg->szVersion, sizeof(pAgentCfg->szVersion));
+    pAgentCfg->bVersionFound = FALSE;
+
+    // We can find the agent version under the Installer subkey, value "Version"
+    LONG lRes = OpenSoftwareKey(pCfg, L"GLPI-Agent\\Installer", &hk, szKey);
+    pAgentCfg->bInstalled = (lRes == ERROR_SUCCESS);
+    if (lRes == ERROR_SUCCESS)
+    {
+        DWORD szVersionLen = sizeof(pAgentCfg->szVersion) - sizeof(WCHAR);
+        lRes = pCfg->pBackend->QueryValue(hk, L"Version", pAgentCfg->szVersion, &szVersionLen);
+        pAgentCfg->bVersionFound = (lRes == ERROR_SUCCESS);
+        if (!pAgentCfg->bVersionFound)
+            ZeroMemory(pAgentCfg->szVersion, sizeof(pAgentCfg->szVersion));
+        pCfg->pBackend->CloseKey(hk);
+    }
+}
+
+// Reads the Agent service startup type into the config snapshot
+VOID RegConfigReadStartType(RegistryConfig* pCfg, AgentConfig* pAgentCfg)
+{
+    RegistryBackend* pBackend = pCfg->pBackend;
+    HKEY hk;
+    WCHAR szKey[MAX_PATH];
+    DWORD dwValue = (DWORD)-1;
+    DWORD dwValueLen = sizeof(dwValue);
+
+    wsprintf(szKey, L"SYSTEM\\CurrentControlSet\\Services\\%s", pCfg->szServiceName);
+    if (pBackend->OpenKey(szKey, KEY_READ, &hk) != ERROR_SUCCESS) {
+        pAgentCfg->uStartTypeResId = IDS_ERR_REGFAIL;
+        return;
+    }
+
+    if (pBackend->QueryValue(hk, L"Start", &dwValue, &dwValueLen) != ERROR_SUCCESS) {
+        pAgentCfg->uStartTypeResId = IDS_ERR_UNKSVCSTART;
+    }
+    else {
+        switch (dwValue)
+        {
+            case SERVICE_BOOT_START:
+                pAgentCfg->uStartTypeResId = IDS_SVCSTART_BOOT;
+                break;
+            case SERVICE_SYSTEM_START:
+                pAgentCfg->uStartTypeResId = IDS_SVCSTART_SYSTEM;
+                break;
+            case SERVICE_AUTO_START:
+            {
+                dwValueLen = sizeof(dwValue);
+                if (pBackend->QueryValue(hk, L"DelayedAutostart", &dwValue, &dwValueLen) == ERROR_SUCCESS && dwValue != 0)
+                    pAgentCfg->uStartTypeResId = IDS_SVCSTART_DELAYEDAUTO;
+                else
+                    pAgentCfg->uStartTypeResId = IDS_SVCSTART_AUTO;
+                break;
+            }
+            case SERVICE_DEMAND_START:
+                pAgentCfg->uStartTypeResId = IDS_SVCSTART_MANUAL;
+                break;
+            case SERVICE_DISABLED:
+                pAgentCfg->uStartTypeResId = IDS_SVCSTART_DISABLED;
+                break;
+            default:
+                pAgentCfg->uStartTypeResId = IDS_ERR_UNKSVCSTART;
+        }
+    }
+
+    pBackend->CloseKey(hk);
+}
+
+// Arms (or re-arms) a registry change notification. If the watched key
+// can't be opened, its values must be polled until it can be watched.
+BOOL RegConfigArmWatch(RegistryConfig* pCfg, int nWatch)
+{
+    RegistryBackend* pBackend = pCfg->pBackend;
+    if (pCfg->hWatchEvents[nWatch] == NULL) {
+        pCfg->hWatchEvents[nWatch] = pBackend->CreateWatchEvent();
+        if (pCfg->hWatchEvents[nWatch] == NULL)
+            return FALSE;
+    }
+
+    if (pCfg->hWatchKeys[nWatch] == NULL) {
+        WCHAR szKey[MAX_PATH];
+        if (nWatch == REGWATCH_AGENT)
+            wcscpy_s(szKey, pCfg->szAgentKey);
+        else
+            wsprintf(szKey, L"SYSTEM\\CurrentControlSet\\Services\\%s", pCfg->szServiceName);
+        if (szKey[0] == '\0' || pBackend->OpenKey(szKey, KEY_NOTIFY, &pCfg->hWatchKeys[nWatch]) != ERROR_SUCCESS) {
+            pCfg->hWatchKeys[nWatch] = NULL;
+            return FALSE;
+        }
+    }
+
+    // The Agent key is watched with its subkeys (Installer and Monitor)
+    if (pBackend->NotifyChange(pCfg->hWatchKeys[nWatch], nWatch == REGWATCH_AGENT, pCfg->hWatchEvents[nWatch]) != ERROR_SUCCESS) {
+        // i.e. the key was deleted
+        pBackend->CloseKey(pCfg->hWatchKeys[nWatch]);
+        pCfg->hWatchKeys[nWatch] = NULL;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Checks if a key is watched (otherwise its values must be polled)
+BOOL RegConfigIsWatched(const RegistryConfig* pCfg, int nWatch)
+{
+    return pCfg->hWatchKeys[nWatch] != NULL;
+}
+
+// Closes the registry change notifications
+VOID RegConfigCloseWatches(RegistryConfig* pCfg)
+{
+    for (int nWatch = 0; nWatch < REGWATCH_COUNT; nWatch++) {
+        if (pCfg->hWatchKeys[nWatch] != NULL) {
+            pCfg->pBackend->CloseKey(pCfg->hWatchKeys[nWatch]);
+            pCfg->hWatchKeys[nWatch] = NULL;
+        }
+        if (pCfg->hWatchEvents[nWatch] != NULL) {
+            pCfg->pBackend->CloseWatchEvent(pCfg->hWatchEvents[nWatch]);
+            pCfg->hWatchEvents[nWatch] = NULL;
+        }
+    }
+}
@@ -0,0 +1,104 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  RegistryConfig.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include "framework.h"
+#include "MonitorSnapshot.h"
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// Registry change notifications (the Agent settings key and its
+// subkeys, and the Agent service key)
+#define REGWATCH_AGENT      0
+#define REGWATCH_SERVICE    1
+#define REGWATCH_COUNT      2
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// Access to the HKEY_LOCAL_MACHINE keys, in the 64-bit registry view (the
+// registry itself, or a fake in tests). Returns the registry error codes.
+class RegistryBackend
+{
+public:
+    virtual ~RegistryBackend() {}
+    virtual LONG OpenKey(LPCWSTR szKey, REGSAM samDesired, HKEY* phKey) = 0;
+    virtual LONG QueryValue(HKEY hKey, LPCWSTR szName, LPVOID pData, DWORD* pcbData) = 0;
+    virtual VOID CloseKey(HKEY hKey) = 0;
+    // Auto-reset events signaled by the change notifications
+    virtual HANDLE CreateWatchEvent() = 0;
+    virtual VOID CloseWatchEvent(HANDLE hEvent) = 0;
+    // Signals hEvent at the next change of a value (or subkey) of hKey.
+    // A notification is only signaled once, and must be armed again.
+    virtual LONG NotifyChange(HKEY hKey, BOOL bSubtree, HANDLE hEvent) = 0;
+};
+
+// Agent settings (from the Agent key)
+struct AgentSettings {
+    DWORD dwPort;               // HTTPD port
+    WCHAR szServer[256];        // GLPI server base URL (empty if not set)
+    WCHAR szLogfile[MAX_PATH];  // Agent logfile (empty if not set)
+};
+
+// Agent registry config: reads the values shown by the Monitor, and watches
+// their keys so they're only read again once changed. Keys that can't be
+// watched (i.e. not installed yet) must be polled. It's owned by a single
+// thread.
+struct RegistryConfig {
+    RegistryBackend* pBackend;
+    LPCWSTR szServiceName;
+    WCHAR szAgentKey[MAX_PATH]; // Agent key found by RegConfigReadAgentSettings
+    HKEY hWatchKeys[REGWATCH_COUNT];
+    HANDLE hWatchEvents[REGWATCH_COUNT];
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+VOID RegConfigInit(RegistryConfig* pCfg, RegistryBackend* pBackend, LPCWSTR szServiceName);
+
+// Values
+LONG RegConfigReadAgentSettings(RegistryConfig* pCfg, AgentSettings* pSettings, UINT* puErrResId);
+VOID RegConfigReadVersion(RegistryConfig* pCfg, AgentConfig* pAgentCfg);
+VOID RegConfigReadStartType(RegistryConfig* pCfg, AgentConfig* pAgentCfg);
+
+// Change notifications
+BOOL RegConfigArmWatch(RegistryConfig* pCfg, int nWatch);
+BOOL RegConfigIsWatched(const RegistryConfig* pCfg, int nWatch);
+VOID RegConfigCloseWatches(RegistryConfig* pCfg);
+
+// Registry backend (RegistryHklm.cpp)
+RegistryBackend* CreateHklmBackend();
@@ -0,0 +1,82 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  RegistryHklm.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include "framework.h"
+#include "RegistryConfig.h"
+
+
+//-[REGISTRY BACKEND]----------------------------------------------------------
+
+class HklmBackend : public RegistryBackend
+{
+public:
+    LONG OpenKey(LPCWSTR szKey, REGSAM samDesired, HKEY* phKey)
+    {
+        return RegOpenKeyEx(HKEY_LOCAL_MACHINE, szKey, 0, samDesired | KEY_WOW64_64KEY, phKey);
+    }
+
+    LONG QueryValue(HKEY hKey, LPCWSTR szName, LPVOID pData, DWORD* pcbData)
+    {
+        return RegQueryValueEx(hKey, szName, 0, NULL, (LPBYTE)pData, pcbData);
+    }
+
+    VOID CloseKey(HKEY hKey)
+    {
+        RegCloseKey(hKey);
+    }
+
+    HANDLE CreateWatchEvent()
+    {
+        return CreateEvent(NULL, FALSE, FALSE, NULL);
+    }
+
+    VOID CloseWatchEvent(HANDLE hEvent)
+    {
+        CloseHandle(hEvent);
+    }
+
+    LONG NotifyChange(HKEY hKey, BOOL bSubtree, HANDLE hEvent)
+    {
+        return RegNotifyChangeKeyValue(hKey, bSubtree, REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET, hEvent, TRUE);
+    }
+};
+
+// Creates the HKEY_LOCAL_MACHINE backend of a registry config
+RegistryBackend* CreateHklmBackend()
+{
+    return new HklmBackend();
+}
@@ -0,0 +1,122 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  Scheduler.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include "framework.h"
+#include "Scheduler.h"
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Default scheduler clock
+static ULONGLONG SchedulerDefaultClock()
+{
+    return GetTickCount64();
+}
+
+// Initializes the scheduler with every probe disabled
+// (pfnClock may be NULL to use GetTickCount64)
+VOID SchedulerInit(ProbeScheduler* pSched, SchedulerClock pfnClock)
+{
+    ZeroMemory(pSched, sizeof(ProbeScheduler));
+    pSched->pfnClock = (pfnClock != NULL ? pfnClock : SchedulerDefaultClock);
+    for (int nProbe = 0; nProbe < PROBE_COUNT; nProbe++)
+        pSched->ullDue[nProbe] = MAXULONGLONG;
+}
+
+// Changes a probe interval (0 disables the probe). The next run is moved
+// relative to the last one, so shortening the interval may make it due now.
+VOID SchedulerSetInterval(ProbeScheduler* pSched, int nProbe, UINT uInterval)
+{
+    if (pSched->uIntervals[nProbe] == uInterval)
+        return;
+
+    pSched->uIntervals[nProbe] = uInterval;
+    if (uInterval == 0) {
+        pSched->ullDue[nProbe] = MAXULONGLONG;
+        return;
+    }
+
+    ULONGLONG ullNow = pSched->pfnClock();
+    ULONGLONG ullDue = pSched->ullLastRun[nProbe] + uInterval;
+    pSched->ullDue[nProbe] = (ullDue > ullNow ? ullDue : ullNow);
+}
+
+// Makes an enabled probe due now
+VOID SchedulerRunNow(ProbeScheduler* pSched, int nProbe)
+{
+    if (pSched->uIntervals[nProbe] != 0)
+        pSched->ullDue[nProbe] = pSched->pfnClock();
+}
+
+// Returns the probes to run now (bitmask of 1 << PROBE_*) and schedules their next run.
+// Probes due shortly are included, so they don't need a wakeup of their own.
+DWORD SchedulerTakeDueProbes(ProbeScheduler* pSched)
+{
+    ULONGLONG ullNow = pSched->pfnClock();
+    DWORD dwProbes = 0;
+
+    pSched->dwWakeups++;
+    for (int nProbe = 0; nProbe < PROBE_COUNT; nProbe++)
+    {
+        if (pSched->uIntervals[nProbe] == 0 || pSched->ullDue[nProbe] > ullNow + SCHEDULER_COALESCE_WINDOW)
+            continue;
+        dwProbes |= 1 << nProbe;
+        pSched->ullLastRun[nProbe] = ullNow;
+        pSched->ullDue[nProbe] = ullNow + pSched->uIntervals[nProbe];
+        pSched->dwProbeRuns++;
+    }
+    return dwProbes;
+}
+
+// Returns the time until the next probe is due (ms), or INFINITE if none is enabled
+DWORD SchedulerGetWait(ProbeScheduler* pSched)
+{
+    ULONGLONG ullNext = MAXULONGLONG;
+    for (int nProbe = 0; nProbe < PROBE_COUNT; nProbe++)
+    {
+        if (pSched->ullDue[nProbe] < ullNext)
+            ullNext = pSched->ullDue[nProbe];
+    }
+    if (ullNext == MAXULONGLONG)
+        return INFINITE;
+
+    ULONGLONG ullNow = pSched->pfnClock();
+    if (ullNext <= ullNow)
+        return 0;
+    return (DWORD)min(ullNext - ullNow, (ULONGLONG)(INFINITE - 1));
+}
@@ -0,0 +1,80 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  Scheduler.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include "framework.h"
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// Probes driven by the scheduler
+#define PROBE_SERVICE   0       // Agent service status (fallback for SCM notifications)
+#define PROBE_AGENT     1       // Agent status (/status)
+#define PROBE_REGISTRY  2       // Registry values (fallback for change notifications)
+#define PROBE_ENDPOINTS 3       // Remote Agents status (/status)
+#define PROBE_LOGSCAN   4       // Agent logfile scan (last inventory run)
+#define PROBE_OUTBOX    5       // Outbox replay (failed inventory and ticket requests)
+#define PROBE_SHARED    6       // Status shared between sessions (leader heartbeat, followers reads)
+#define PROBE_COUNT     7
+
+// Probes due within this delay are run along with the ones already due (ms)
+#define SCHEDULER_COALESCE_WINDOW 250
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// Clock used by the scheduler (ms, monotonic)
+typedef ULONGLONG (*SchedulerClock)();
+
+// Probe scheduler. Each probe has its own interval (0 = disabled), and all the
+// probes due at about the same time are run in a single wakeup.
+struct ProbeScheduler {
+    SchedulerClock pfnClock;
+    UINT uIntervals[PROBE_COUNT];
+    ULONGLONG ullLastRun[PROBE_COUNT];
+    ULONGLONG ullDue[PROBE_COUNT];
+    DWORD dwWakeups;            // Calls to SchedulerTakeDueProbes
+    DWORD dwProbeRuns;          // Probes run
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+VOID SchedulerInit(ProbeScheduler* pSched, SchedulerClock pfnClock);
+VOID SchedulerSetInterval(ProbeScheduler* pSched, int nProbe, UINT uInterval);
+VOID SchedulerRunNow(ProbeScheduler* pSched, int nProbe);
+DWORD SchedulerTakeDueProbes(ProbeScheduler* pSched);
+DWORD SchedulerGetWait(ProbeScheduler* pSched);
@@ -0,0 +1,260 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  Screenshot.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <dwmapi.h>
+#include "framework.h"
+#include "PngEncoder.h"
+#include "Screenshot.h"
+
+
+//-[CAPTURE]-------------------------------------------------------------------
+
+// Creates a top-down 32 bpp DIB section
+static HBITMAP CreateDib(int nWidth, int nHeight, BYTE** ppBits)
+{
+    BITMAPINFO bmi = {};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = nWidth;
+    bmi.bmiHeader.biHeight = -nHeight;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    return CreateDIBSection(NULL, &bmi, DIB_RGB_COLORS, (PVOID*)ppBits, NULL, 0);
+}
+
+static VOID SetImage(Screenshot* pShot, HBITMAP hBitmap, BYTE* pBits, int nWidth, int nHeight)
+{
+    pShot->hBitmap = hBitmap;
+    pShot->image.pPixels = pBits;
+    pShot->image.cbStride = (size_t)nWidth * 4;
+    pShot->image.dwWidth = nWidth;
+    pShot->image.dwHeight = nHeight;
+}
+
+// Captures the virtual screen (all the monitors). The windows just hidden
+// (i.e. the taskbar icon menu) are first left a frame to disappear.
+Screenshot* ScreenshotCapture()
+{
+    DwmFlush();
+
+    int x = GetSystemMetrics(SM_XVIRTUALSCREEN);
+    int y = GetSystemMetrics(SM_YVIRTUALSCREEN);
+    int nWidth = GetSystemMetrics(SM_CXVIRTUALSCREEN);
+    int nHeight = GetSystemMetrics(SM_CYVIRTUALSCREEN);
+    if (nWidth <= 0 || nHeight <= 0)
+        return NULL;
+
+    Screenshot* pShot = NULL;
+    HDC hdcScreen = GetDC(NULL);
+    HDC hdcMem = CreateCompatibleDC(hdcScreen);
+    BYTE* pBits;
+    HBITMAP hBitmap = CreateDib(nWidth, nHeight, &pBits);
+    if (hdcMem != NULL && hBitmap != NULL) {
+        HGDIOBJ hOldBitmap = SelectObject(hdcMem, hBitmap);
+        BOOL bCaptured = BitBlt(hdcMem, 0, 0, nWidth, nHeight, hdcScreen, x, y, SRCCOPY | CAPTUREBLT);
+        GdiFlush();
+        SelectObject(hdcMem, hOldBitmap);
+        if (bCaptured) {
+            pShot = new Screenshot();
+            SetImage(pShot, hBitmap, pBits, nWidth, nHeight);
+            hBitmap = NULL;
+        }
+    }
+    if (hBitmap != NULL)
+        DeleteObject(hBitmap);
+    if (hdcMem != NULL)
+        DeleteDC(hdcMem);
+    ReleaseDC(NULL, hdcScreen);
+    return pShot;
+}
+
+// Downscales a capture larger than SCREENSHOT_MAX_WIDTH x SCREENSHOT_MAX_HEIGHT
+// to fit, keeping its aspect ratio (it's kept as is if it fails)
+static VOID DownscaleScreenshot(Screenshot* pShot)
+{
+    int nWidth = pShot->image.dwWidth;
+    int nHeight = pShot->image.dwHeight;
+    if (nWidth <= SCREENSHOT_MAX_WIDTH && nHeight <= SCREENSHOT_MAX_HEIGHT)
+        return;
+    int nNewWidth, nNewHeight;
+    if ((LONGLONG)nWidth * SCREENSHOT_MAX_HEIGHT > (LONGLONG)nHeight * SCREENSHOT_MAX_WIDTH) {
+        nNewWidth = SCREENSHOT_MAX_WIDTH;
+        nNewHeight = max(1, MulDiv(nHeight, SCREENSHOT_MAX_WIDTH, nWidth));
+    }
+    else {
+        nNewHeight = SCREENSHOT_MAX_HEIGHT;
+        nNewWidth = max(1, MulDiv(nWidth, SCREENSHOT_MAX_HEIGHT, nHeight));
+    }
+
+    BYTE* pBits;
+    HBITMAP hBitmap = CreateDib(nNewWidth, nNewHeight, &pBits);
+    if (hBitmap == NULL)
+        return;
+    HDC hdcSrc = CreateCompatibleDC(NULL);
+    HDC hdcDst = CreateCompatibleDC(NULL);
+    BOOL bScaled = FALSE;
+    if (hdcSrc != NULL && hdcDst != NULL) {
+        HGDIOBJ hOldSrc = SelectObject(hdcSrc, pShot->hBitmap);
+        HGDIOBJ hOldDst = SelectObject(hdcDst, hBitmap);
+        SetStretchBltMode(hdcDst, HALFTONE);
+        SetBrushOrgEx(hdcDst, 0, 0, NULL);
+        bScaled = StretchBlt(hdcDst, 0, 0, nNewWidth, nNewHeight, hdcSrc, 0, 0, nWidth, nHeight, SRCCOPY);
+        GdiFlush();
+        SelectObject(hdcSrc, hOldSrc);
+        SelectObject(hdcDst, hOldDst);
+    }
+    if (hdcSrc != NULL)
+        DeleteDC(hdcSrc);
+    if (hdcDst != NULL)
+        DeleteDC(hdcDst);
+
+    if (bScaled) {
+        DeleteObject(pShot->hBitmap);
+        SetImage(pShot, hBitmap, pBits, nNewWidth, nNewHeight);
+    }
+    else {
+        DeleteObject(hBitmap);
+    }
+}
+
+
+//-[ENCODING]------------------------------------------------------------------
+
+// Thread pool work item, encodes the strips of the current batch left
+static VOID CALLBACK EncodeStrips(PTP_CALLBACK_INSTANCE pInstance, PVOID pContext, PTP_WORK pWork)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pWork);
+    Screenshot* pShot = (Screenshot*)pContext;
+    DWORD dwStrip;
+    while ((dwStrip = (DWORD)InterlockedIncrement(&pShot->lNextStrip) - 1) < pShot->dwBatchEnd)
+        PngEncodeStrip(&pShot->image, dwStrip, &pShot->strips[dwStrip - pShot->dwBatchStart]);
+}
+
+static DWORD WriteAll(HANDLE hFile, const BYTE* pData, size_t cbData)
+{
+    DWORD cbWritten;
+    if (!WriteFile(hFile, pData, (DWORD)cbData, &cbWritten, NULL))
+        return GetLastError();
+    return (cbWritten == cbData ? ERROR_SUCCESS : ERROR_WRITE_FAULT);
+}
+
+// Writes a capture as PNG. The strips are encoded by batches of
+// SCREENSHOT_BATCH_STRIPS, in parallel, and written in order.
+static DWORD WriteScreenshot(Screenshot* pShot, HANDLE hFile)
+{
+    pShot->pStripWork = CreateThreadpoolWork(EncodeStrips, pShot, NULL);
+    if (pShot->pStripWork == NULL)
+        return GetLastError();
+
+    size_t cbBound = PngStripBound(&pShot->image);
+    BYTE* pStripBuf = new BYTE[cbBound * SCREENSHOT_BATCH_STRIPS];
+    for (int i = 0; i < SCREENSHOT_BATCH_STRIPS; i++)
+        pShot->strips[i].pData = pStripBuf + i * cbBound;
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    DWORD dwWorkers = min(si.dwNumberOfProcessors, (DWORD)SCREENSHOT_BATCH_STRIPS);
+
+    BYTE header[PNG_HEADER_SIZE];
+    DWORD dwError = WriteAll(hFile, header, PngWriteHeader(&pShot->image, header));
+    DWORD dwStrips = PngStripCount(&pShot->image);
+    DWORD dwAdler = 1;
+    for (DWORD dwStart = 0; dwStart < dwStrips && dwError == ERROR_SUCCESS; dwStart += SCREENSHOT_BATCH_STRIPS)
+    {
+        pShot->dwBatchStart = dwStart;
+        pShot->dwBatchEnd = min(dwStrips, dwStart + SCREENSHOT_BATCH_STRIPS);
+        pShot->lNextStrip = dwStart;
+        for (DWORD i = 0; i < dwWorkers; i++)
+            SubmitThreadpoolWork(pShot->pStripWork);
+        WaitForThreadpoolWorkCallbacks(pShot->pStripWork, FALSE);
+
+        for (DWORD i = 0; i < pShot->dwBatchEnd - dwStart && dwError == ERROR_SUCCESS; i++) {
+            const PngStrip* pStrip = &pShot->strips[i];
+            dwError = WriteAll(hFile, pStrip->pData, pStrip->cbData);
+            dwAdler = PngAdlerCombine(dwAdler, pStrip->dwAdler, pStrip->cbRaw);
+        }
+    }
+    if (dwError == ERROR_SUCCESS) {
+        BYTE trailer[PNG_TRAILER_SIZE];
+        dwError = WriteAll(hFile, trailer, PngWriteTrailer(dwAdler, trailer));
+    }
+
+    CloseThreadpoolWork(pShot->pStripWork);
+    pShot->pStripWork = NULL;
+    delete[] pStripBuf;
+    return dwError;
+}
+
+// Thread pool callback, downscales and saves a capture, then posts it back
+static VOID CALLBACK SaveScreenshot(PTP_CALLBACK_INSTANCE pInstance, PVOID pContext)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+    Screenshot* pShot = (Screenshot*)pContext;
+
+    DownscaleScreenshot(pShot);
+    HANDLE hFile = CreateFile(pShot->szFile, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        pShot->dwError = GetLastError();
+    }
+    else {
+        pShot->dwError = WriteScreenshot(pShot, hFile);
+        CloseHandle(hFile);
+        if (pShot->dwError != ERROR_SUCCESS)
+            DeleteFile(pShot->szFile);
+    }
+
+    if (!PostMessage(pShot->hWnd, pShot->uMsg, 0, (LPARAM)pShot))
+        ScreenshotFree(pShot);
+}
+
+// Saves a capture as a PNG file on the thread pool. Once saved (or failed), the
+// capture is posted to hWnd with uMsg.
+BOOL ScreenshotSave(Screenshot* pShot, LPCWSTR szFile, HWND hWnd, UINT uMsg)
+{
+    if (wcscpy_s(pShot->szFile, szFile) != 0)
+        return FALSE;
+    pShot->hWnd = hWnd;
+    pShot->uMsg = uMsg;
+    return TrySubmitThreadpoolCallback(SaveScreenshot, pShot, NULL);
+}
+
+VOID ScreenshotFree(Screenshot* pShot)
+{
+    DeleteObject(pShot->hBitmap);
+    delete pShot;
+}
@@ -0,0 +1,79 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  Screenshot.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include "framework.h"
+#include "PngEncoder.h"
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// Largest screenshot saved (larger desktops, i.e. spanning several monitors,
+// are downscaled to fit)
+#define SCREENSHOT_MAX_WIDTH    3840
+#define SCREENSHOT_MAX_HEIGHT   2160
+
+// PNG strips encoded in parallel, and kept in memory, at a time
+#define SCREENSHOT_BATCH_STRIPS 8
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// Screen capture, saved as PNG on the thread pool. It's posted back to the
+// requesting window as the LPARAM of the requested message once saved, and
+// must be freed with ScreenshotFree.
+struct Screenshot {
+    HBITMAP hBitmap;            // Top-down 32 bpp DIB section
+    PngImage image;             // hBitmap pixels
+    WCHAR szFile[MAX_PATH];     // PNG file
+    HWND hWnd;                  // Window to post the capture to once saved
+    UINT uMsg;                  // Message to post the capture with
+    DWORD dwError;              // ERROR_SUCCESS or save error code
+    // Strips encoding (a batch of strips is encoded by the work item,
+    // submitted once per processor)
+    PTP_WORK pStripWork;
+    volatile LONG lNextStrip;
+    DWORD dwBatchStart;
+    DWORD dwBatchEnd;
+    PngStrip strips[SCREENSHOT_BATCH_STRIPS];
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+Screenshot* ScreenshotCapture();
+BOOL ScreenshotSave(Screenshot* pShot, LPCWSTR szFile, HWND hWnd, UINT uMsg);
+VOID ScreenshotFree(Screenshot* pShot);
@@ -0,0 +1,124 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  ServiceScm.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include "framework.h"
+#include "Metrics.h"
+#include "ServiceWatch.h"
+
+
+//-[SCM BACKEND]---------------------------------------------------------------
+
+class ScmBackend : public ServiceBackend
+{
+public:
+    ScmBackend(LPCWSTR szServiceName) : szServiceName(szServiceName), notify(), hWnd(NULL), uMsg(0) {}
+
+    SC_HANDLE OpenManager()
+    {
+        return OpenSCManager(NULL, SERVICES_ACTIVE_DATABASE, SC_MANAGER_CONNECT | SC_MANAGER_ENUMERATE_SERVICE);
+    }
+
+    SC_HANDLE OpenService(SC_HANDLE hSc, DWORD dwAccess)
+    {
+        return ::OpenService(hSc, szServiceName, dwAccess);
+    }
+
+    VOID Close(SC_HANDLE hHandle)
+    {
+        CloseServiceHandle(hHandle);
+    }
+
+    BOOL QueryStatus(SC_HANDLE hSvc, SERVICE_STATUS* pStatus)
+    {
+        LONGLONG llStart = MetricsNow();
+        BOOL bOk = QueryServiceStatus(hSvc, pStatus);
+        DWORD dwErr = GetLastError();
+        MetricsObserveSince(HIST_SERVICE_QUERY, llStart);
+        SetLastError(dwErr);
+        return bOk;
+    }
+
+    BOOL Start(SC_HANDLE hSvc)
+    {
+        return StartService(hSvc, 0, NULL);
+    }
+
+    BOOL Control(SC_HANDLE hSvc, DWORD dwControl)
+    {
+        SERVICE_STATUS status;
+        return ControlService(hSvc, dwControl, &status);
+    }
+
+    // The notification buffer is reused: a single notification is armed at a time
+    DWORD Notify(SC_HANDLE hSc, SC_HANDLE hSvc, DWORD dwMask, HWND hWnd, UINT uMsg)
+    {
+        notify = {};
+        notify.dwVersion = SERVICE_NOTIFY_STATUS_CHANGE;
+        notify.pfnNotifyCallback = NotifyCallback;
+        notify.pContext = this;
+        this->hWnd = hWnd;
+        this->uMsg = uMsg;
+        return NotifyServiceStatusChange((hSvc != NULL ? hSvc : hSc), dwMask, &notify);
+    }
+
+private:
+    LPCWSTR szServiceName;
+    SERVICE_NOTIFY notify;
+    HWND hWnd;
+    UINT uMsg;
+
+    // Queued as an APC to the thread that armed the notification, it only
+    // forwards it to the window, as it can't be armed again from inside
+    static VOID CALLBACK NotifyCallback(PVOID pParameter)
+    {
+        PSERVICE_NOTIFY pNotify = (PSERVICE_NOTIFY)pParameter;
+        ScmBackend* pBackend = (ScmBackend*)pNotify->pContext;
+        if (pNotify->pszServiceNames != NULL) {
+            LocalFree(pNotify->pszServiceNames);
+            pNotify->pszServiceNames = NULL;
+        }
+        PostMessage(pBackend->hWnd, pBackend->uMsg, pNotify->dwNotificationStatus,
+            MAKELPARAM(pNotify->dwNotificationTriggered, pNotify->ServiceStatus.dwCurrentState));
+    }
+};
+
+// Creates the SCM backend of a service watcher (the service name must stay valid)
+ServiceBackend* CreateScmBackend(LPCWSTR szServiceName)
+{
+    return new ScmBackend(szServiceName);
+}
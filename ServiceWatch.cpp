@@ -0,0 +1,281 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  ServiceWatch.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include "framework.h"
+#include "resource.h"
+#include "Handoff.h"
+#include "ServiceWatch.h"
+
+
+//-[HANDLES]-------------------------------------------------------------------
+
+// Sets the backend of a watcher, with no handle open yet
+VOID ServiceWatchInit(ServiceWatch* pWatch, ServiceBackend* pBackend)
+{
+    *pWatch = {};
+    pWatch->pBackend = pBackend;
+    pWatch->uPollInterval = SVCPOLL_MIN_INTERVAL;
+}
+
+// Releases the cached SCM and Agent service handles
+// (closing the service handle also cancels any pending notification)
+VOID ServiceWatchClose(ServiceWatch* pWatch)
+{
+    if (pWatch->hSvc != NULL) {
+        pWatch->pBackend->Close(pWatch->hSvc);
+        pWatch->hSvc = NULL;
+    }
+    pWatch->dwSvcAccess = 0;
+    if (pWatch->hSc != NULL) {
+        pWatch->pBackend->Close(pWatch->hSc);
+        pWatch->hSc = NULL;
+    }
+    pWatch->bWatchActive = FALSE;
+}
+
+// Returns the cached SCM handle, connecting to the SCM if needed
+SC_HANDLE ServiceWatchGetScm(ServiceWatch* pWatch)
+{
+    if (pWatch->hSc == NULL) {
+        pWatch->counters.dwOpens++;
+        pWatch->hSc = pWatch->pBackend->OpenManager();
+    }
+    return pWatch->hSc;
+}
+
+// Returns the cached Agent service handle with (at least) the requested access
+// rights. The handle is opened lazily and reopened if more rights are needed.
+SC_HANDLE ServiceWatchGetService(ServiceWatch* pWatch, DWORD dwAccess)
+{
+    if (pWatch->hSvc != NULL && (pWatch->dwSvcAccess & dwAccess) == dwAccess) {
+        pWatch->counters.dwHits++;
+        return pWatch->hSvc;
+    }
+
+    if (ServiceWatchGetScm(pWatch) == NULL)
+        return NULL;
+
+    if (pWatch->hSvc != NULL) {
+        pWatch->pBackend->Close(pWatch->hSvc);
+        pWatch->hSvc = NULL;
+        pWatch->bWatchActive = FALSE;
+        dwAccess |= pWatch->dwSvcAccess;
+    }
+
+    pWatch->counters.dwOpens++;
+    pWatch->hSvc = pWatch->pBackend->OpenService(pWatch->hSc, dwAccess);
+    pWatch->dwSvcAccess = (pWatch->hSvc != NULL ? dwAccess : 0);
+    return pWatch->hSvc;
+}
+
+// Checks if an error means the cached handles can't be used anymore
+// (i.e. the service was deleted or reinstalled during an Agent upgrade)
+BOOL ServiceWatchIsStaleError(DWORD dwErr)
+{
+    return dwErr == ERROR_INVALID_HANDLE || dwErr == ERROR_SERVICE_MARKED_FOR_DELETE ||
+        dwErr == ERROR_SERVICE_DOES_NOT_EXIST || dwErr == RPC_S_SERVER_UNAVAILABLE || dwErr == RPC_S_CALL_FAILED;
+}
+
+
+//-[STATUS AND OPERATIONS]-----------------------------------------------------
+
+// Queries the Agent service status
+BOOL ServiceWatchQuery(ServiceWatch* pWatch, SERVICE_STATUS* pStatus)
+{
+    ServiceBackend* pBackend = pWatch->pBackend;
+    BOOL bQueryOk = FALSE;
+
+    // Don't keep a handle open on a service pending deletion, as
+    // it wouldn't be deleted until all its handles are closed
+    if (pWatch->bDeletePending) {
+        SC_HANDLE hSc = ServiceWatchGetScm(pWatch);
+        if (hSc != NULL) {
+            pWatch->counters.dwOpens++;
+            SC_HANDLE hSvc = pBackend->OpenService(hSc, SVCWATCH_QUERY_ACCESS);
+            if (hSvc != NULL) {
+                bQueryOk = pBackend->QueryStatus(hSvc, pStatus);
+                pBackend->Close(hSvc);
+            }
+        }
+        return bQueryOk;
+    }
+
+    // Query using the cached handle, reopening it once if it went stale
+    BOOL bCached = (pWatch->hSvc != NULL);
+    SC_HANDLE hSvc = ServiceWatchGetService(pWatch, SVCWATCH_QUERY_ACCESS);
+    if (hSvc != NULL)
+        bQueryOk = pBackend->QueryStatus(hSvc, pStatus);
+
+    if (!bQueryOk && bCached && ServiceWatchIsStaleError(GetLastError())) {
+        ServiceWatchClose(pWatch);
+        pWatch->counters.dwReopens++;
+        hSvc = ServiceWatchGetService(pWatch, SVCWATCH_QUERY_ACCESS);
+        if (hSvc != NULL)
+            bQueryOk = pBackend->QueryStatus(hSvc, pStatus);
+    }
+    return bQueryOk;
+}
+
+// Does a service operation (HANDOFF_SVC_*) through the cached handles
+static DWORD RunServiceOperation(ServiceWatch* pWatch, DWORD dwOperation, UINT* puErrResId)
+{
+    *puErrResId = IDS_ERR_SCHANDLE;
+    if (ServiceWatchGetScm(pWatch) == NULL)
+        return GetLastError();
+
+    *puErrResId = IDS_ERR_SVCHANDLE;
+    SC_HANDLE hSvc = ServiceWatchGetService(pWatch, SVCWATCH_CONTROL_ACCESS);
+    if (hSvc == NULL)
+        return GetLastError();
+
+    *puErrResId = IDS_ERR_SVCOPERATION;
+    BOOL bDone;
+    if (dwOperation == HANDOFF_SVC_START)
+        bDone = pWatch->pBackend->Start(hSvc);
+    else
+        bDone = pWatch->pBackend->Control(hSvc, (dwOperation == HANDOFF_SVC_STOP ? SERVICE_CONTROL_STOP : SERVICE_CONTROL_CONTINUE));
+    return (bDone ? ERROR_SUCCESS : GetLastError());
+}
+
+// Does a service operation (HANDOFF_SVC_*), running it again once with new
+// handles if the cached ones went stale. Returns the error code, and the
+// resource ID of the error message to show.
+DWORD ServiceWatchControl(ServiceWatch* pWatch, DWORD dwOperation, UINT* puErrResId)
+{
+    *puErrResId = IDS_ERR_SVCOPERATION;
+    if (dwOperation < HANDOFF_SVC_START || dwOperation > HANDOFF_SVC_CONTINUE)
+        return ERROR_INVALID_PARAMETER;
+    if (pWatch->bDeletePending)
+        return ERROR_SERVICE_MARKED_FOR_DELETE;
+
+    BOOL bCached = (pWatch->hSc != NULL);
+    DWORD dwErr = RunServiceOperation(pWatch, dwOperation, puErrResId);
+    if (dwErr != ERROR_SUCCESS && bCached && ServiceWatchIsStaleError(dwErr)) {
+        ServiceWatchClose(pWatch);
+        pWatch->counters.dwReopens++;
+        dwErr = RunServiceOperation(pWatch, dwOperation, puErrResId);
+    }
+    return dwErr;
+}
+
+
+//-[NOTIFICATIONS AND POLLING]-------------------------------------------------
+
+// Arms a notification for the next Agent service state change (see
+// ServiceBackend::Notify). If the service doesn't exist (or is being deleted),
+// the SCM is watched for service creation instead.
+BOOL ServiceWatchArm(ServiceWatch* pWatch, DWORD dwKnownState, HWND hWnd, UINT uMsg)
+{
+    SC_HANDLE hSvc = (pWatch->bDeletePending ? NULL : ServiceWatchGetService(pWatch, SVCWATCH_QUERY_ACCESS));
+    if (hSvc == NULL && ServiceWatchGetScm(pWatch) == NULL)
+        return FALSE;
+
+    // Watch every state but the one currently known, so the notification is only
+    // posted immediately if the service changed its state in the meantime
+    DWORD dwMask = SERVICE_NOTIFY_CREATED;
+    if (hSvc != NULL) {
+        dwMask = SVCWATCH_NOTIFY_STATES | SERVICE_NOTIFY_DELETE_PENDING;
+        if (dwKnownState >= SERVICE_STOPPED && dwKnownState <= SERVICE_PAUSED)
+            dwMask &= ~(1 << (dwKnownState - 1));
+    }
+
+    if (pWatch->pBackend->Notify(pWatch->hSc, hSvc, dwMask, hWnd, uMsg) != ERROR_SUCCESS) {
+        ServiceWatchClose(pWatch);
+        return FALSE;
+    }
+    pWatch->bWatchActive = TRUE;
+    return TRUE;
+}
+
+// Handles a notification armed by ServiceWatchArm (which must be armed again
+// afterwards). Returns whether the service status is known, and its state.
+BOOL ServiceWatchOnNotify(ServiceWatch* pWatch, DWORD dwStatus, LPARAM lParam, DWORD* pdwState)
+{
+    DWORD dwTriggered = LOWORD(lParam);
+    pWatch->bWatchActive = FALSE;
+
+    // The notification holds the new service state
+    if (dwStatus == ERROR_SUCCESS && !(dwTriggered & (SERVICE_NOTIFY_DELETE_PENDING | SERVICE_NOTIFY_CREATED))) {
+        *pdwState = HIWORD(lParam);
+        return TRUE;
+    }
+
+    // The service is being deleted, was (re)created or the notification
+    // failed: release the handles and query the service status directly
+    if (dwTriggered & SERVICE_NOTIFY_DELETE_PENDING)
+        pWatch->bDeletePending = TRUE;
+    else if (dwTriggered & SERVICE_NOTIFY_CREATED)
+        pWatch->bDeletePending = FALSE;
+    ServiceWatchClose(pWatch);
+    SERVICE_STATUS status = {};
+    BOOL bQueryOk = ServiceWatchQuery(pWatch, &status);
+    *pdwState = status.dwCurrentState;
+    return bQueryOk;
+}
+
+// Queries the service status (polling fallback for the notifications).
+// Returns whether it's known, and its state.
+BOOL ServiceWatchPoll(ServiceWatch* pWatch, DWORD* pdwState)
+{
+    // While the service is pending deletion, its handle is only reopened
+    // at each poll, to check if it was deleted or reinstalled meanwhile
+    if (pWatch->bDeletePending) {
+        ServiceWatchClose(pWatch);
+        pWatch->bDeletePending = FALSE;
+    }
+
+    SERVICE_STATUS status = {};
+    BOOL bQueryOk = ServiceWatchQuery(pWatch, &status);
+    *pdwState = status.dwCurrentState;
+    return bQueryOk;
+}
+
+// Adjusts and returns the polling interval. While notifications are active,
+// polling is only a safety net. Otherwise, poll faster while the service is
+// changing its state and back off exponentially while it's steady.
+UINT ServiceWatchNextInterval(ServiceWatch* pWatch, BOOL bChanged, DWORD dwState, UINT uMaxInterval)
+{
+    if (pWatch->bWatchActive)
+        pWatch->uPollInterval = SVCPOLL_WATCH_INTERVAL;
+    else if (bChanged || pWatch->uPollInterval > uMaxInterval ||
+        (dwState != SERVICE_STOPPED && dwState != SERVICE_RUNNING && dwState != SERVICE_PAUSED))
+        pWatch->uPollInterval = SVCPOLL_MIN_INTERVAL;
+    else
+        pWatch->uPollInterval = (pWatch->uPollInterval * 2 < uMaxInterval ? pWatch->uPollInterval * 2 : uMaxInterval);
+    return pWatch->uPollInterval;
+}
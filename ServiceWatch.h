@@ -0,0 +1,127 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  ServiceWatch.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include "framework.h"
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// Service status polling intervals (ms), used when SCM notifications are unavailable
+// (the maximum is higher while the main window is hidden)
+#define SVCPOLL_MIN_INTERVAL        500
+#define SVCPOLL_MAX_INTERVAL        8000
+#define SVCPOLL_HIDDEN_MAX_INTERVAL 60000
+// Service status polling interval (ms) while SCM notifications are active
+#define SVCPOLL_WATCH_INTERVAL      30000
+
+// Access rights of the service handle used for the status queries and notifications
+#define SVCWATCH_QUERY_ACCESS       SERVICE_QUERY_STATUS
+// Access rights of the service handle used for the service operations
+#define SVCWATCH_CONTROL_ACCESS     (SERVICE_START | SERVICE_PAUSE_CONTINUE | SERVICE_STOP)
+
+// Service states watched by the notifications (SERVICE_NOTIFY_*), by state
+#define SVCWATCH_NOTIFY_STATES      (SERVICE_NOTIFY_STOPPED | SERVICE_NOTIFY_START_PENDING | \
+    SERVICE_NOTIFY_STOP_PENDING | SERVICE_NOTIFY_RUNNING | SERVICE_NOTIFY_CONTINUE_PENDING | \
+    SERVICE_NOTIFY_PAUSE_PENDING | SERVICE_NOTIFY_PAUSED)
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// Access to the SCM and the Agent service (the SCM itself, or a fake in tests).
+// Failed calls set the last error, as the SCM functions they stand for do.
+class ServiceBackend
+{
+public:
+    virtual ~ServiceBackend() {}
+    virtual SC_HANDLE OpenManager() = 0;
+    virtual SC_HANDLE OpenService(SC_HANDLE hSc, DWORD dwAccess) = 0;
+    virtual VOID Close(SC_HANDLE hHandle) = 0;
+    virtual BOOL QueryStatus(SC_HANDLE hSvc, SERVICE_STATUS* pStatus) = 0;
+    virtual BOOL Start(SC_HANDLE hSvc) = 0;
+    virtual BOOL Control(SC_HANDLE hSvc, DWORD dwControl) = 0;
+    // Arms a notification of the next service state change to one of dwMask
+    // (SERVICE_NOTIFY_*), or of a service creation without hSvc. It's posted
+    // to hWnd as the uMsg message, with the notification status as the
+    // WPARAM and MAKELPARAM(triggered SERVICE_NOTIFY_*, service state) as the
+    // LPARAM. Closing the handle watched cancels it. Returns an error code.
+    virtual DWORD Notify(SC_HANDLE hSc, SC_HANDLE hSvc, DWORD dwMask, HWND hWnd, UINT uMsg) = 0;
+};
+
+// Handle cache counters
+struct SvcHandleCounters {
+    DWORD dwOpens;              // OpenManager/OpenService calls
+    DWORD dwHits;               // Requests served by the already open service handle
+    DWORD dwReopens;            // Handles reopened after a stale handle error
+};
+
+// Agent service watcher: the SCM and service handles, kept open and reopened
+// lazily once stale (i.e. the service was reinstalled by an Agent upgrade),
+// the SCM notifications pushing the state changes, and the polling fallback.
+// It's owned by a single thread.
+struct ServiceWatch {
+    ServiceBackend* pBackend;
+    SC_HANDLE hSc;
+    SC_HANDLE hSvc;
+    DWORD dwSvcAccess;          // Access rights hSvc was opened with
+    SvcHandleCounters counters;
+    BOOL bWatchActive;          // A notification is armed
+    BOOL bDeletePending;        // The service is marked for deletion
+    UINT uPollInterval;         // Polling interval (ms)
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Handles
+VOID ServiceWatchInit(ServiceWatch* pWatch, ServiceBackend* pBackend);
+VOID ServiceWatchClose(ServiceWatch* pWatch);
+SC_HANDLE ServiceWatchGetScm(ServiceWatch* pWatch);
+SC_HANDLE ServiceWatchGetService(ServiceWatch* pWatch, DWORD dwAccess);
+BOOL ServiceWatchIsStaleError(DWORD dwErr);
+
+// Status and operations
+BOOL ServiceWatchQuery(ServiceWatch* pWatch, SERVICE_STATUS* pStatus);
+DWORD ServiceWatchControl(ServiceWatch* pWatch, DWORD dwOperation, UINT* puErrResId);
+
+// Notifications and polling
+BOOL ServiceWatchArm(ServiceWatch* pWatch, DWORD dwKnownState, HWND hWnd, UINT uMsg);
+BOOL ServiceWatchOnNotify(ServiceWatch* pWatch, DWORD dwStatus, LPARAM lParam, DWORD* pdwState);
+BOOL ServiceWatchPoll(ServiceWatch* pWatch, DWORD* pdwState);
+UINT ServiceWatchNextInterval(ServiceWatch* pWatch, BOOL bChanged, DWORD dwState, UINT uMaxInterval);
+
+// SCM backend (ServiceScm.cpp)
+ServiceBackend* CreateScmBackend(LPCWSTR szServiceName);
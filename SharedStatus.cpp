@@ -0,0 +1,144 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  SharedStatus.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <sddl.h>
+#include "framework.h"
+#include "SharedStatus.h"
+
+static_assert(sizeof(SharedStatusBlock) <= SHAREDSTATUS_LOCK_OFFSET, "The leader lock must be past the block");
+
+
+//-[FILE]----------------------------------------------------------------------
+
+// Maps a file shared with the other sessions, creating it with a DACL (see
+// SHAREDSTATUS_SDDL). It's mapped read-only if this user can't write it.
+static PVOID MapSharedFile(LPCWSTR szPath, LPCWSTR szSddl, DWORD cbView, HANDLE* phFile, HANDLE* phMapping, BOOL* pbWritable)
+{
+    SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES) };
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptor(szSddl, SDDL_REVISION_1, &sa.lpSecurityDescriptor, NULL))
+        return NULL;
+    *pbWritable = TRUE;
+    HANDLE hFile = CreateFile(szPath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        &sa, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE && GetLastError() == ERROR_ACCESS_DENIED) {
+        *pbWritable = FALSE;
+        hFile = CreateFile(szPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    }
+    LocalFree(sa.lpSecurityDescriptor);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    // The file is extended to the view size if needed (a new file reads as
+    // zeros). A file mapped read-only must have been extended already.
+    HANDLE hMapping = CreateFileMapping(hFile, NULL, (*pbWritable ? PAGE_READWRITE : PAGE_READONLY), 0, cbView, NULL);
+    if (hMapping == NULL) {
+        CloseHandle(hFile);
+        return NULL;
+    }
+    PVOID pView = MapViewOfFile(hMapping, (*pbWritable ? FILE_MAP_READ | FILE_MAP_WRITE : FILE_MAP_READ), 0, 0, cbView);
+    if (pView == NULL) {
+        CloseHandle(hMapping);
+        CloseHandle(hFile);
+        return NULL;
+    }
+
+    *phFile = hFile;
+    *phMapping = hMapping;
+    return pView;
+}
+
+// Opens the shared status files, so that every signed in user can map them
+// (i.e. from other terminal server sessions). The Monitor isn't the leader
+// until SharedStatusTryLead succeeds. Without the demand file, the leader
+// polls the Agent as if the status was always shown.
+BOOL SharedStatusOpen(SharedStatus* pShared, LPCWSTR szPath, LPCWSTR szDemandPath)
+{
+    ZeroMemory(pShared, sizeof(SharedStatus));
+
+    pShared->pBlock = (SharedStatusBlock*)MapSharedFile(szPath, SHAREDSTATUS_SDDL, sizeof(SharedStatusBlock),
+        &pShared->hFile, &pShared->hMapping, &pShared->bWritable);
+    if (pShared->pBlock == NULL)
+        return FALSE;
+
+    BOOL bDemandWritable;
+    pShared->pDemand = (SharedStatusDemand*)MapSharedFile(szDemandPath, SHAREDSTATUS_DEMAND_SDDL, sizeof(SharedStatusDemand),
+        &pShared->hDemandFile, &pShared->hDemandMapping, &bDemandWritable);
+    if (pShared->pDemand != NULL && !bDemandWritable) {
+        UnmapViewOfFile(pShared->pDemand);
+        CloseHandle(pShared->hDemandMapping);
+        CloseHandle(pShared->hDemandFile);
+        pShared->pDemand = NULL;
+        pShared->hDemandMapping = pShared->hDemandFile = NULL;
+    }
+    return TRUE;
+}
+
+// Tries to become the leader, if this Monitor can write the block. The lock is
+// released by the system when the leader exits (or crashes), so that another
+// Monitor takes over.
+BOOL SharedStatusTryLead(SharedStatus* pShared)
+{
+    if (pShared->pBlock == NULL || !pShared->bWritable)
+        return FALSE;
+    if (pShared->bLeader)
+        return TRUE;
+
+    OVERLAPPED ov = {};
+    ov.Offset = SHAREDSTATUS_LOCK_OFFSET;
+    pShared->bLeader = LockFileEx(pShared->hFile, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &ov);
+    return pShared->bLeader;
+}
+
+// Unmaps the shared status files, and releases the leader lock if held
+VOID SharedStatusClose(SharedStatus* pShared)
+{
+    if (pShared->pDemand != NULL)
+        UnmapViewOfFile(pShared->pDemand);
+    if (pShared->hDemandMapping != NULL)
+        CloseHandle(pShared->hDemandMapping);
+    if (pShared->hDemandFile != NULL)
+        CloseHandle(pShared->hDemandFile);
+    if (pShared->pBlock != NULL)
+        UnmapViewOfFile(pShared->pBlock);
+    if (pShared->hMapping != NULL)
+        CloseHandle(pShared->hMapping);
+    if (pShared->hFile != NULL)
+        CloseHandle(pShared->hFile);
+    ZeroMemory(pShared, sizeof(SharedStatus));
+}
@@ -0,0 +1,126 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  SharedStatus.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include "framework.h"
+#include "AgentClient.h"
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// Shared status file layout (a single block, mapped by every Monitor)
+#define SHAREDSTATUS_MAGIC      0x53534D47  // "GMSS"
+#define SHAREDSTATUS_VERSION    2
+
+// Shared status files DACLs. Both can be written by every user, so that the
+// lead can go to any session: the followers validate the status published (see
+// SharedStatusValidate), and only show it once confirmed by their own request.
+// A forged demand only makes the leader poll the local Agent.
+#define SHAREDSTATUS_SDDL       L"D:P(A;;FA;;;SY)(A;;FA;;;BA)(A;;FRFW;;;AU)"
+#define SHAREDSTATUS_DEMAND_SDDL L"D:P(A;;FA;;;SY)(A;;FA;;;BA)(A;;FRFW;;;AU)"
+
+// Byte locked by the leader in the shared status file. It's past the block,
+// so that the lock doesn't get in the way of the mapped views.
+#define SHAREDSTATUS_LOCK_OFFSET 0x10000
+
+// Reads retried while the leader is writing the block
+#define SHAREDSTATUS_READ_RETRIES 64
+
+// Heartbeat ahead of the reader's clock that's still valid (written after
+// the reader read its clock)
+#define SHAREDSTATUS_MAX_SKEW   1000
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// Status published by the leader: the last local Agent /status response
+struct SharedStatusData {
+    ULONGLONG ullHeartbeat;     // Last write (GetTickCount64, the same in every session)
+    ULONGLONG ullResponse;      // Last response received (GetTickCount64)
+    DWORD dwResponseSeq;        // Incremented for each response (0 = none yet)
+    DWORD dwError;              // Response, as in AgentResponse
+    DWORD dwStatusCode;
+    BOOL bStatusFound;
+    WCHAR szStatus[AGENTSTATUS_MAX_VALUE];
+};
+
+// Shared status block. The data is written by the leader only, and guarded
+// by a sequence lock: the sequence is odd while the data is being written,
+// and a read is only valid if the sequence didn't change meanwhile.
+struct SharedStatusBlock {
+    DWORD dwMagic;
+    DWORD dwVersion;
+    DWORD cbBlock;              // sizeof(SharedStatusBlock)
+    std::atomic<DWORD> dwSeq;
+    SharedStatusData data;
+};
+
+// Status demand, in its own file: the other Monitors record when they last
+// showed the status, so that the leader only polls the Agent while a status
+// is shown somewhere
+struct SharedStatusDemand {
+    std::atomic<ULONGLONG> ullDemand;   // Last time a follower showed the status (GetTickCount64)
+};
+
+// Shared status files, mapped by this Monitor. Only a Monitor that can write
+// the block may lead (its file may have been created with another DACL).
+struct SharedStatus {
+    HANDLE hFile;
+    HANDLE hMapping;
+    SharedStatusBlock* pBlock;
+    BOOL bWritable;             // The block is mapped read-write
+    HANDLE hDemandFile;
+    HANDLE hDemandMapping;
+    SharedStatusDemand* pDemand; // NULL if it couldn't be mapped
+    BOOL bLeader;               // This Monitor holds the leader lock
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Block access (lock-free, the block may be mapped by other processes)
+VOID SharedStatusWrite(SharedStatusBlock* pBlock, const SharedStatusData* pData);
+BOOL SharedStatusRead(const SharedStatusBlock* pBlock, SharedStatusData* pData);
+VOID SharedStatusSetDemand(SharedStatusDemand* pDemand, ULONGLONG ullNow);
+ULONGLONG SharedStatusGetDemand(const SharedStatusDemand* pDemand);
+BOOL SharedStatusValidate(const SharedStatusData* pData, ULONGLONG ullNow);
+BOOL SharedStatusSameResponse(const SharedStatusData* pData, const SharedStatusData* pOther);
+
+// Shared status files
+BOOL SharedStatusOpen(SharedStatus* pShared, LPCWSTR szPath, LPCWSTR szDemandPath);
+BOOL SharedStatusTryLead(SharedStatus* pShared);
+VOID SharedStatusClose(SharedStatus* pShared);
@@ -0,0 +1,124 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  SharedStatusBlock.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <string.h>
+#include "framework.h"
+#include "SharedStatus.h"
+
+// The block is shared between processes, its atomics can't rely on a lock
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LONG_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+    "The shared status atomics must be lock-free");
+
+
+//-[BLOCK]---------------------------------------------------------------------
+
+// Writes the block data (leader only). The block header is written along, so
+// that a new or outdated block becomes valid.
+VOID SharedStatusWrite(SharedStatusBlock* pBlock, const SharedStatusData* pData)
+{
+    // A leader that died while writing left the sequence odd
+    DWORD dwSeq = pBlock->dwSeq.load(std::memory_order_relaxed);
+    if (dwSeq & 1)
+        dwSeq++;
+
+    pBlock->dwSeq.store(dwSeq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    pBlock->dwMagic = SHAREDSTATUS_MAGIC;
+    pBlock->dwVersion = SHAREDSTATUS_VERSION;
+    pBlock->cbBlock = sizeof(SharedStatusBlock);
+    memcpy(&pBlock->data, pData, sizeof(SharedStatusData));
+    pBlock->dwSeq.store(dwSeq + 2, std::memory_order_release);
+}
+
+// Reads the block data. Returns FALSE if the block isn't valid (not written
+// yet, or by a Monitor with another layout), or kept changing while read.
+BOOL SharedStatusRead(const SharedStatusBlock* pBlock, SharedStatusData* pData)
+{
+    for (int nTry = 0; nTry < SHAREDSTATUS_READ_RETRIES; nTry++)
+    {
+        DWORD dwSeq = pBlock->dwSeq.load(std::memory_order_acquire);
+        if (dwSeq & 1)
+            continue;
+        BOOL bValid = (pBlock->dwMagic == SHAREDSTATUS_MAGIC && pBlock->dwVersion == SHAREDSTATUS_VERSION &&
+            pBlock->cbBlock == sizeof(SharedStatusBlock));
+        memcpy(pData, &pBlock->data, sizeof(SharedStatusData));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (pBlock->dwSeq.load(std::memory_order_relaxed) != dwSeq)
+            continue;
+
+        // The block may be written by another Monitor version, or by the
+        // user who created it, so it's never trusted
+        pData->szStatus[ARRAYSIZE(pData->szStatus) - 1] = '\0';
+        return bValid;
+    }
+    return FALSE;
+}
+
+// Records that a follower shows the status
+VOID SharedStatusSetDemand(SharedStatusDemand* pDemand, ULONGLONG ullNow)
+{
+    pDemand->ullDemand.store(ullNow, std::memory_order_relaxed);
+}
+
+// Returns when a follower last showed the status
+ULONGLONG SharedStatusGetDemand(const SharedStatusDemand* pDemand)
+{
+    return pDemand->ullDemand.load(std::memory_order_relaxed);
+}
+
+// Returns whether data read from the block is consistent: timestamps that
+// aren't ahead of the reader's clock, and a status made of printable characters
+BOOL SharedStatusValidate(const SharedStatusData* pData, ULONGLONG ullNow)
+{
+    if (pData->ullHeartbeat > ullNow + SHAREDSTATUS_MAX_SKEW || pData->ullResponse > pData->ullHeartbeat)
+        return FALSE;
+    if (pData->dwStatusCode != 0 && (pData->dwStatusCode < 100 || pData->dwStatusCode > 599))
+        return FALSE;
+    for (LPCWSTR p = pData->szStatus; *p != '\0'; p++) {
+        if (*p < 0x20 || *p == 0x7F)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+// Returns whether two responses are the same (heartbeats and numbering aside)
+BOOL SharedStatusSameResponse(const SharedStatusData* pData, const SharedStatusData* pOther)
+{
+    return pData->dwError == pOther->dwError && pData->dwStatusCode == pOther->dwStatusCode &&
+        pData->bStatusFound == pOther->bStatusFound && wcscmp(pData->szStatus, pOther->szStatus) == 0;
+}
@@ -0,0 +1,245 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  SnapshotJson.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <string>
+#include <stdio.h>
+#include <windows.h>
+#include <shellapi.h>
+#include "framework.h"
+#include "resource.h"
+#include "MonitorSnapshot.h"
+
+using namespace std;
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// Service state output names
+struct SvcStateName {
+    DWORD dwState;
+    LPCSTR szName;
+};
+static const SvcStateName svcStateNames[] = {
+    { SERVICE_STOPPED,          "stopped" },
+    { SERVICE_RUNNING,          "running" },
+    { SERVICE_PAUSED,           "paused" },
+    { SERVICE_CONTINUE_PENDING, "continue_pending" },
+    { SERVICE_PAUSE_PENDING,    "pause_pending" },
+    { SERVICE_START_PENDING,    "start_pending" },
+    { SERVICE_STOP_PENDING,     "stop_pending" }
+};
+
+// Service startup type output names, by string resource ID
+struct StartTypeName {
+    UINT uResId;
+    LPCSTR szName;
+};
+static const StartTypeName startTypeNames[] = {
+    { IDS_SVCSTART_BOOT,        "boot" },
+    { IDS_SVCSTART_SYSTEM,      "system" },
+    { IDS_SVCSTART_AUTO,        "auto" },
+    { IDS_SVCSTART_DELAYEDAUTO, "delayed_auto" },
+    { IDS_SVCSTART_MANUAL,      "manual" },
+    { IDS_SVCSTART_DISABLED,    "disabled" }
+};
+
+
+//-[JSON]----------------------------------------------------------------------
+
+// Appends a string to a JSON line, UTF-8 encoded and escaped
+VOID JsonAppendString(string& strJson, LPCWSTR szValue)
+{
+    string strUtf8;
+    int cbUtf8 = WideCharToMultiByte(CP_UTF8, 0, szValue, -1, NULL, 0, NULL, NULL);
+    if (cbUtf8 > 1) {
+        strUtf8.resize(cbUtf8);
+        if (WideCharToMultiByte(CP_UTF8, 0, szValue, -1, &strUtf8[0], cbUtf8, NULL, NULL) == 0)
+            cbUtf8 = 1;
+        strUtf8.resize(cbUtf8 - 1);
+    }
+
+    strJson += '"';
+    for (size_t i = 0; i < strUtf8.size(); i++)
+    {
+        CHAR c = strUtf8[i];
+        switch (c)
+        {
+            case '"':
+                strJson += "\\\"";
+                break;
+            case '\\':
+                strJson += "\\\\";
+                break;
+            case '\n':
+                strJson += "\\n";
+                break;
+            case '\r':
+                strJson += "\\r";
+                break;
+            case '\t':
+                strJson += "\\t";
+                break;
+            default:
+                if ((BYTE)c < 0x20) {
+                    CHAR szEscape[8];
+                    sprintf_s(szEscape, "\\u%04x", (BYTE)c);
+                    strJson += szEscape;
+                }
+                else
+                    strJson += c;
+        }
+    }
+    strJson += '"';
+}
+
+// Returns the output name of a snapshot service status
+LPCSTR SnapshotJsonServiceName(const MonitorSnapshot* pSnapshot)
+{
+    if (pSnapshot->bSvcQueryOk) {
+        for (size_t i = 0; i < ARRAYSIZE(svcStateNames); i++) {
+            if (svcStateNames[i].dwState == pSnapshot->dwSvcState)
+                return svcStateNames[i].szName;
+        }
+    }
+    return "error";
+}
+
+// Formats a snapshot as a JSON object (the whole status, and the SNAPSHOT_*
+// fields changed since the previous one). The notification strings are
+// looked up by resource ID with the given function.
+VOID SnapshotJsonFormat(string& strJson, const MonitorSnapshot* pSnapshot, DWORD dwChanged,
+    const SYSTEMTIME* pst, SnapshotStringProc pfnGetString)
+{
+    CHAR szNum[128];
+    sprintf_s(szNum, "{\"seq\":%lu,\"time\":\"%04u-%02u-%02uT%02u:%02u:%02u.%03uZ\",\"changed\":%lu",
+        pSnapshot->dwVersion, pst->wYear, pst->wMonth, pst->wDay, pst->wHour, pst->wMinute, pst->wSecond,
+        pst->wMilliseconds, dwChanged);
+    strJson += szNum;
+
+    strJson += ",\"service\":\"";
+    strJson += SnapshotJsonServiceName(pSnapshot);
+    strJson += "\",\"agentOk\":";
+    strJson += (pSnapshot->bAgentOk ? "true" : "false");
+    strJson += ",\"agentStatus\":";
+    JsonAppendString(strJson, pSnapshot->szAgStatus);
+    strJson += ",\"agentInstalled\":";
+    strJson += (pSnapshot->config.bInstalled ? "true" : "false");
+    strJson += ",\"agentVersion\":";
+    if (pSnapshot->config.bVersionFound)
+        JsonAppendString(strJson, pSnapshot->config.szVersion);
+    else
+        strJson += "null";
+
+    LPCSTR szStartType = "unknown";
+    for (size_t i = 0; i < ARRAYSIZE(startTypeNames); i++) {
+        if (startTypeNames[i].uResId == pSnapshot->config.uStartTypeResId)
+            szStartType = startTypeNames[i].szName;
+    }
+    strJson += ",\"startType\":\"";
+    strJson += szStartType;
+    strJson += '"';
+
+    if (pSnapshot->dwEndpoints > 0) {
+        sprintf_s(szNum, ",\"endpoints\":{\"total\":%lu,\"responding\":%lu}",
+            pSnapshot->dwEndpoints, pSnapshot->dwEndpointsResponding);
+        strJson += szNum;
+    }
+
+    if (pSnapshot->dwLastInvState != LASTINV_UNKNOWN) {
+        sprintf_s(szNum, ",\"lastInventory\":{\"result\":\"%s\",\"errors\":%lu}",
+            (pSnapshot->dwLastInvState == LASTINV_OK ? "ok" : "failed"), pSnapshot->dwLastInvErrors);
+        strJson += szNum;
+    }
+
+    // Notification queued by the probe worker
+    if ((dwChanged & SNAPSHOT_NOTIFICATION) && pSnapshot->dwNotifySeq != 0)
+    {
+        DWORD dwIcon = pSnapshot->dwNotifyFlags & NIIF_ICON_MASK;
+        strJson += ",\"notification\":{\"level\":\"";
+        strJson += (dwIcon == NIIF_ERROR ? "error" : (dwIcon == NIIF_WARNING ? "warning" : "info"));
+        strJson += "\",\"title\":";
+        JsonAppendString(strJson, pfnGetString(pSnapshot->uNotifyTitleResId));
+        strJson += ",\"message\":";
+        JsonAppendString(strJson, pfnGetString(pSnapshot->uNotifyMsgResId));
+        strJson += '}';
+    }
+
+    strJson += '}';
+}
+
+
+//-[HEADLESS STREAM]-----------------------------------------------------------
+
+VOID HeadlessStreamInit(HeadlessStream* pStream, HANDLE hOut, SnapshotStringProc pfnGetString)
+{
+    pStream->hOut = hOut;
+    pStream->pfnGetString = pfnGetString;
+    pStream->bSnapshotWritten = FALSE;
+}
+
+// Ends a JSON line and writes it to the headless output. Returns FALSE
+// if the output was closed (i.e. the process reading it exited).
+static BOOL HeadlessWriteLine(HeadlessStream* pStream, string& strJson)
+{
+    strJson += '\n';
+    DWORD dwWritten;
+    return WriteFile(pStream->hOut, strJson.data(), (DWORD)strJson.size(), &dwWritten, NULL);
+}
+
+// Writes an error to the headless output
+BOOL HeadlessWriteError(HeadlessStream* pStream, UINT msgResId, DWORD dwErr)
+{
+    CHAR szCode[32];
+    string strJson = "{\"error\":";
+    JsonAppendString(strJson, pStream->pfnGetString(msgResId));
+    sprintf_s(szCode, ",\"code\":%lu}", dwErr);
+    strJson += szCode;
+    return HeadlessWriteLine(pStream, strJson);
+}
+
+// Writes a published snapshot to the headless output (the whole status, and
+// the SNAPSHOT_* fields changed since the previous line)
+BOOL HeadlessWriteSnapshot(HeadlessStream* pStream, const MonitorSnapshot* pSnapshot, const SYSTEMTIME* pst)
+{
+    DWORD dwChanged = MonitorSnapshotDiff(pStream->bSnapshotWritten ? &pStream->lastSnapshot : NULL, pSnapshot);
+    pStream->lastSnapshot = *pSnapshot;
+    pStream->bSnapshotWritten = TRUE;
+
+    string strJson;
+    SnapshotJsonFormat(strJson, pSnapshot, dwChanged, pst, pStream->pfnGetString);
+    return HeadlessWriteLine(pStream, strJson);
+}
@@ -0,0 +1,83 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  SpscChannel.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include "framework.h"
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// Single-producer single-consumer channel. Items are copied in by one thread and
+// out by another without any lock. N must be a power of 2, and the channel holds
+// up to N - 1 items.
+template <typename T, size_t N>
+class SpscChannel
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of 2");
+
+public:
+    SpscChannel() : head(0), tail(0) {}
+
+    // Producer: copies an item into the channel (returns FALSE if it's full)
+    BOOL Push(const T& item)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t next = (t + 1) & (N - 1);
+        if (next == head.load(std::memory_order_acquire))
+            return FALSE;
+        items[t] = item;
+        tail.store(next, std::memory_order_release);
+        return TRUE;
+    }
+
+    // Consumer: copies the oldest item out of the channel (returns FALSE if it's empty)
+    BOOL Pop(T* pItem)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return FALSE;
+        *pItem = items[h];
+        head.store((h + 1) & (N - 1), std::memory_order_release);
+        return TRUE;
+    }
+
+private:
+    // Each index is written by a single thread, so they are kept on separate cache lines
+    alignas(64) std::atomic<size_t> head;   // Next item to pop (consumer)
+    alignas(64) std::atomic<size_t> tail;   // Next slot to push to (producer)
+    alignas(64) T items[N];
+};
@@ -0,0 +1,296 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  StatusHistory.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include "framework.h"
+#include "StatusHistory.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// Mapped history file. Records are appended by a single writer, and the lock
+// keeps readers from seeing a half-written record.
+static SRWLOCK srwHistory = SRWLOCK_INIT;
+static HANDLE hHistoryFile = NULL;
+static HANDLE hHistoryMapping = NULL;
+static HistoryHeader* pHistoryHeader = NULL;
+static HistoryString* pHistoryStrings = NULL;
+static HistoryRecord* pHistoryRecords = NULL;
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Returns the current time (s since 1601, UTC)
+static ULONGLONG HistoryNow()
+{
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    return (((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime) / 10000000;
+}
+
+// Returns the record capacity of the history file
+static DWORD HistoryCapacity()
+{
+    return (DWORD)((HISTORY_FILE_SIZE - sizeof(HistoryHeader) - HISTORY_MAX_STRINGS * sizeof(HistoryString)) / sizeof(HistoryRecord));
+}
+
+// Returns whether a record type's value is an interned string index
+static BOOL HistoryIsStringType(WORD wType)
+{
+    return wType == HISTORY_AGENTSTATUS;
+}
+
+// Counts the records referring to each string again (the counts may be off if
+// the Monitor exited while appending). Invalid indexes are dropped.
+static VOID HistoryCountRefs(HistoryHeader* pHeader, HistoryString* pStrings, HistoryRecord* pRecords)
+{
+    for (DWORD i = 0; i < pHeader->dwStrings; i++)
+        pStrings[i].dwRefs = 0;
+    for (DWORD i = 0; i < pHeader->dwCount; i++) {
+        HistoryRecord* pRecord = &pRecords[(pHeader->dwFirst + i) % pHeader->dwCapacity];
+        if (!HistoryIsStringType(pRecord->wType) || pRecord->wValue == HISTORY_NO_STRING)
+            continue;
+        if (pRecord->wValue < pHeader->dwStrings)
+            pStrings[pRecord->wValue].dwRefs++;
+        else
+            pRecord->wValue = HISTORY_NO_STRING;
+    }
+}
+
+// Opens (or creates) the history file and maps it. A file that doesn't have the
+// expected layout (i.e. from another version, or truncated) is reset.
+BOOL HistoryOpen(LPCWSTR szPath)
+{
+    HistoryClose();
+
+    // Not shared for writing: only one Monitor records at a time
+    HANDLE hFile = CreateFile(szPath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    // The mapping extends the file to its full size if needed
+    HANDLE hMapping = CreateFileMapping(hFile, NULL, PAGE_READWRITE, 0, HISTORY_FILE_SIZE, NULL);
+    if (hMapping == NULL) {
+        CloseHandle(hFile);
+        return FALSE;
+    }
+    LPBYTE pView = (LPBYTE)MapViewOfFile(hMapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, HISTORY_FILE_SIZE);
+    if (pView == NULL) {
+        CloseHandle(hMapping);
+        CloseHandle(hFile);
+        return FALSE;
+    }
+
+    HistoryHeader* pHeader = (HistoryHeader*)pView;
+    DWORD dwCapacity = HistoryCapacity();
+    if (pHeader->dwMagic != HISTORY_MAGIC || pHeader->dwVersion != HISTORY_VERSION || pHeader->dwCapacity != dwCapacity ||
+        pHeader->dwStrings > HISTORY_MAX_STRINGS || pHeader->dwFirst >= dwCapacity || pHeader->dwCount > dwCapacity)
+    {
+        ZeroMemory(pView, HISTORY_FILE_SIZE);
+        pHeader->dwMagic = HISTORY_MAGIC;
+        pHeader->dwVersion = HISTORY_VERSION;
+        pHeader->dwCapacity = dwCapacity;
+    }
+    HistoryString* pStrings = (HistoryString*)(pView + sizeof(HistoryHeader));
+    HistoryRecord* pRecords = (HistoryRecord*)(pView + sizeof(HistoryHeader) + HISTORY_MAX_STRINGS * sizeof(HistoryString));
+    HistoryCountRefs(pHeader, pStrings, pRecords);
+
+    AcquireSRWLockExclusive(&srwHistory);
+    hHistoryFile = hFile;
+    hHistoryMapping = hMapping;
+    pHistoryHeader = pHeader;
+    pHistoryStrings = pStrings;
+    pHistoryRecords = pRecords;
+    ReleaseSRWLockExclusive(&srwHistory);
+    return TRUE;
+}
+
+// Writes the history back to its file and unmaps it
+VOID HistoryClose()
+{
+    AcquireSRWLockExclusive(&srwHistory);
+    if (pHistoryHeader != NULL) {
+        FlushViewOfFile(pHistoryHeader, 0);
+        UnmapViewOfFile(pHistoryHeader);
+        CloseHandle(hHistoryMapping);
+        CloseHandle(hHistoryFile);
+        pHistoryHeader = NULL;
+        pHistoryStrings = NULL;
+        pHistoryRecords = NULL;
+        hHistoryMapping = NULL;
+        hHistoryFile = NULL;
+    }
+    ReleaseSRWLockExclusive(&srwHistory);
+}
+
+// Returns the index of an interned string, adding it to the strings table if
+// needed, and counts the record referring to it (must be called with the lock
+// held exclusively)
+static WORD HistoryIntern(LPCWSTR szValue)
+{
+    WCHAR szTruncated[HISTORY_MAX_STRING];
+    wcsncpy_s(szTruncated, szValue, _TRUNCATE);
+
+    // FNV-1a
+    DWORD dwHash = 2166136261;
+    for (LPCWSTR p = szTruncated; *p != '\0'; p++)
+        dwHash = (dwHash ^ *p) * 16777619;
+
+    // A free string is still found, until its slot is reused
+    DWORD dwStrings = pHistoryHeader->dwStrings;
+    DWORD dwFree = HISTORY_MAX_STRINGS;
+    for (DWORD i = 0; i < dwStrings; i++) {
+        if (pHistoryStrings[i].dwHash == dwHash && wcscmp(pHistoryStrings[i].szValue, szTruncated) == 0) {
+            pHistoryStrings[i].dwRefs++;
+            return (WORD)i;
+        }
+        if (pHistoryStrings[i].dwRefs == 0 && dwFree == HISTORY_MAX_STRINGS)
+            dwFree = i;
+    }
+    if (dwFree == HISTORY_MAX_STRINGS) {
+        if (dwStrings == HISTORY_MAX_STRINGS)
+            return HISTORY_NO_STRING;
+        dwFree = pHistoryHeader->dwStrings++;
+    }
+
+    pHistoryStrings[dwFree].dwHash = dwHash;
+    pHistoryStrings[dwFree].dwRefs = 1;
+    wcscpy_s(pHistoryStrings[dwFree].szValue, szTruncated);
+    return (WORD)dwFree;
+}
+
+// Appends a record whose value is either dwValue, or szValue interned if it's
+// not NULL, dropping the oldest one if the ring is full (the strings only that
+// record referred to are reclaimed first)
+static VOID HistoryAppendRecord(WORD wType, DWORD dwValue, LPCWSTR szValue)
+{
+    AcquireSRWLockExclusive(&srwHistory);
+    if (pHistoryHeader == NULL) {
+        ReleaseSRWLockExclusive(&srwHistory);
+        return;
+    }
+
+    HistoryHeader* pHeader = pHistoryHeader;
+    ULONGLONG ullNow = HistoryNow();
+    if (pHeader->dwCount == 0) {
+        pHeader->ullFirstTime = ullNow;
+        pHeader->ullLastTime = ullNow;
+    }
+    else if (pHeader->dwCount == pHeader->dwCapacity) {
+        const HistoryRecord* pOldest = &pHistoryRecords[pHeader->dwFirst];
+        if (HistoryIsStringType(pOldest->wType) && pOldest->wValue < pHeader->dwStrings &&
+            pHistoryStrings[pOldest->wValue].dwRefs > 0)
+            pHistoryStrings[pOldest->wValue].dwRefs--;
+
+        // The next record becomes the oldest one
+        pHeader->dwFirst = (pHeader->dwFirst + 1) % pHeader->dwCapacity;
+        pHeader->dwCount--;
+        pHeader->ullFirstTime += pHistoryRecords[pHeader->dwFirst].dwDelta;
+    }
+    if (szValue != NULL)
+        dwValue = HistoryIntern(szValue);
+
+    // Keep the times ordered if the clock went back
+    if (ullNow < pHeader->ullLastTime)
+        ullNow = pHeader->ullLastTime;
+
+    HistoryRecord* pRecord = &pHistoryRecords[(pHeader->dwFirst + pHeader->dwCount) % pHeader->dwCapacity];
+    pRecord->dwDelta = (DWORD)min(ullNow - pHeader->ullLastTime, (ULONGLONG)MAXDWORD);
+    pRecord->wType = wType;
+    pRecord->wValue = (WORD)min(dwValue, (DWORD)0xFFFF);
+    if (pHeader->dwCount == 0)
+        pRecord->dwDelta = 0;
+    pHeader->ullLastTime = ullNow;
+    pHeader->dwCount++;
+
+    ReleaseSRWLockExclusive(&srwHistory);
+}
+
+// Appends a record
+VOID HistoryAppend(WORD wType, DWORD dwValue)
+{
+    HistoryAppendRecord(wType, dwValue, NULL);
+}
+
+// Appends a record whose value is a string
+VOID HistoryAppendString(WORD wType, LPCWSTR szValue)
+{
+    HistoryAppendRecord(wType, HISTORY_NO_STRING, szValue);
+}
+
+// Returns the number of records
+DWORD HistoryGetCount()
+{
+    AcquireSRWLockShared(&srwHistory);
+    DWORD dwCount = (pHistoryHeader != NULL ? pHistoryHeader->dwCount : 0);
+    ReleaseSRWLockShared(&srwHistory);
+    return dwCount;
+}
+
+// Decodes the oldest records, up to dwMax, and returns how many were decoded
+DWORD HistoryCopy(HistoryEntry* pEntries, DWORD dwMax)
+{
+    AcquireSRWLockShared(&srwHistory);
+    DWORD dwCopied = 0;
+    if (pHistoryHeader != NULL)
+    {
+        ULONGLONG ullTime = pHistoryHeader->ullFirstTime;
+        for (; dwCopied < pHistoryHeader->dwCount && dwCopied < dwMax; dwCopied++)
+        {
+            const HistoryRecord* pRecord = &pHistoryRecords[(pHistoryHeader->dwFirst + dwCopied) % pHistoryHeader->dwCapacity];
+            if (dwCopied > 0)
+                ullTime += pRecord->dwDelta;
+            pEntries[dwCopied].ullTime = ullTime;
+            pEntries[dwCopied].wType = pRecord->wType;
+            pEntries[dwCopied].wValue = pRecord->wValue;
+        }
+    }
+    ReleaseSRWLockShared(&srwHistory);
+    return dwCopied;
+}
+
+// Gets an interned string (a string records refer to isn't reclaimed until
+// they're dropped)
+BOOL HistoryGetString(WORD wIndex, LPWSTR szValue, DWORD cchValue)
+{
+    AcquireSRWLockShared(&srwHistory);
+    BOOL bFound = (pHistoryHeader != NULL && wIndex < pHistoryHeader->dwStrings);
+    if (bFound)
+        wcsncpy_s(szValue, cchValue, pHistoryStrings[wIndex].szValue, _TRUNCATE);
+    ReleaseSRWLockShared(&srwHistory);
+    return bFound;
+}
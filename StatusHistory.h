@@ -0,0 +1,108 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  StatusHistory.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include "framework.h"
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// History file layout: a header, the interned strings table, then the records
+// ring (about 57000 records, weeks of transitions even with a flapping Agent)
+#define HISTORY_MAGIC           0x48534D47  // "GMSH"
+#define HISTORY_VERSION         2
+#define HISTORY_FILE_SIZE       (512 * 1024)
+#define HISTORY_MAX_STRINGS     512
+#define HISTORY_MAX_STRING      64          // Longer strings are truncated
+
+// Record types
+#define HISTORY_SERVICE         1           // Service state changed (SERVICE_* state, 0 = query failed)
+#define HISTORY_AGENTSTATUS     2           // Agent status changed (interned string index)
+#define HISTORY_AGENTERROR      3           // Agent request failed (transport error code)
+#define HISTORY_AGENTHTTP       4           // Agent request failed (HTTP status code)
+
+// String index recorded when the strings table is full (of strings that records
+// still refer to: the others are reclaimed)
+#define HISTORY_NO_STRING       0xFFFF
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// History file header
+struct HistoryHeader {
+    DWORD dwMagic;
+    DWORD dwVersion;
+    DWORD dwCapacity;           // Records the ring can hold
+    DWORD dwStrings;            // Strings table slots used
+    DWORD dwFirst;              // Oldest record index
+    DWORD dwCount;              // Records in the ring
+    ULONGLONG ullFirstTime;     // Oldest record time (s since 1601, UTC)
+    ULONGLONG ullLastTime;      // Newest record time (s since 1601, UTC)
+};
+
+// Interned string (hashed to speed up lookups). A string no record refers to
+// anymore is free, its slot is reused for the next new string.
+struct HistoryString {
+    DWORD dwHash;
+    DWORD dwRefs;               // Records referring to the string
+    WCHAR szValue[HISTORY_MAX_STRING];
+};
+
+// Record. Its time is stored as a delta from the previous record (the first
+// record time is kept in the header), so a record only takes 8 bytes.
+struct HistoryRecord {
+    DWORD dwDelta;              // Seconds since the previous record
+    WORD wType;                 // HISTORY_* type
+    WORD wValue;                // Type-dependent value
+};
+
+// Decoded record
+struct HistoryEntry {
+    ULONGLONG ullTime;          // s since 1601, UTC
+    WORD wType;
+    WORD wValue;
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+BOOL HistoryOpen(LPCWSTR szPath);
+VOID HistoryClose();
+VOID HistoryAppend(WORD wType, DWORD dwValue);
+VOID HistoryAppendString(WORD wType, LPCWSTR szValue);
+DWORD HistoryGetCount();
+DWORD HistoryCopy(HistoryEntry* pEntries, DWORD dwMax);
+BOOL HistoryGetString(WORD wIndex, LPWSTR szValue, DWORD cchValue);
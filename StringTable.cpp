@@ -0,0 +1,112 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  StringTable.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <string.h>
+#include "framework.h"
+#include "StringTable.h"
+
+
+//-[TABLE]---------------------------------------------------------------------
+
+// Empties a table
+VOID StringTableClear(StringTable* pTable)
+{
+    pTable->langId = 0;
+    pTable->refs.clear();
+    pTable->arena.clear();
+    pTable->interned.clear();
+}
+
+// Adds a string (not NUL-terminated) to a table, sharing the storage of an
+// identical string already added. Returns FALSE if the ID is already used.
+BOOL StringTableAdd(StringTable* pTable, UINT uId, const WCHAR* pch, size_t cch)
+{
+    if (uId < pTable->refs.size() && pTable->refs[uId].bFound)
+        return FALSE;
+    if (uId >= pTable->refs.size())
+        pTable->refs.resize(uId + 1, StringRef());
+
+    std::wstring str(pch, cch);
+    auto it = pTable->interned.find(str);
+    DWORD dwOffset;
+    if (it != pTable->interned.end()) {
+        dwOffset = it->second;
+    }
+    else {
+        dwOffset = (DWORD)pTable->arena.size();
+        pTable->arena.insert(pTable->arena.end(), pch, pch + cch);
+        pTable->arena.push_back('\0');
+        pTable->interned.emplace(str, dwOffset);
+    }
+
+    StringRef* pRef = &pTable->refs[uId];
+    pRef->dwOffset = dwOffset;
+    pRef->cch = (DWORD)cch;
+    pRef->bFound = TRUE;
+    return TRUE;
+}
+
+// Returns a string of a table, and its length if requested (an empty string
+// if the ID isn't found). It's valid until the table is changed.
+LPCWSTR StringTableGet(const StringTable* pTable, UINT uId, DWORD* pcch)
+{
+    if (uId >= pTable->refs.size() || !pTable->refs[uId].bFound) {
+        if (pcch != NULL)
+            *pcch = 0;
+        return L"";
+    }
+    const StringRef* pRef = &pTable->refs[uId];
+    if (pcch != NULL)
+        *pcch = pRef->cch;
+    return pTable->arena.data() + pRef->dwOffset;
+}
+
+// Copies a string of a table, as LoadString does: truncated to fit (always
+// NUL-terminated). Returns the number of characters copied.
+int StringTableCopy(const StringTable* pTable, UINT uId, LPWSTR szBuf, int cchBuf)
+{
+    if (cchBuf <= 0)
+        return 0;
+    DWORD cch;
+    LPCWSTR szString = StringTableGet(pTable, uId, &cch);
+    if ((int)cch > cchBuf - 1)
+        cch = cchBuf - 1;
+    memcpy(szBuf, szString, cch * sizeof(WCHAR));
+    szBuf[cch] = '\0';
+    return (int)cch;
+}
@@ -0,0 +1,77 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  StringTable.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include "framework.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// Interned string: its position and length in the arena (a NUL follows it)
+struct StringRef {
+    DWORD dwOffset;
+    DWORD cch;
+    BOOL bFound;
+};
+
+// Localized strings of a language, interned into a single arena. Identical
+// strings share their storage. Lookups don't call the system, and once filled
+// the table can be read from any thread.
+struct StringTable {
+    LANGID langId;                      // UI language the table was loaded for
+    std::vector<StringRef> refs;        // By string ID
+    std::vector<WCHAR> arena;
+    std::unordered_map<std::wstring, DWORD> interned;   // Arena offsets, by string
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Table
+VOID StringTableClear(StringTable* pTable);
+BOOL StringTableAdd(StringTable* pTable, UINT uId, const WCHAR* pch, size_t cch);
+LPCWSTR StringTableGet(const StringTable* pTable, UINT uId, DWORD* pcch = NULL);
+int StringTableCopy(const StringTable* pTable, UINT uId, LPWSTR szBuf, int cchBuf);
+
+// Resource string tables of the thread UI language
+BOOL StringTableLoad(StringTable* pTable, HINSTANCE hInstance);
+
+// Monitor strings (loaded once, on first use)
+LPCWSTR GetString(UINT uId);
+int LoadCachedString(UINT uId, LPWSTR szBuf, int cchBuf);
@@ -0,0 +1,728 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  TicketQueue.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// Queued ticket files (any other file is attached to the ticket)
+#define TICKET_INPUT_FILE       L"ticket.json"
+#define TICKET_ID_FILE          L"ticket.id"
+#define TICKET_SCREENSHOT_FILE  L"screenshot.png"
+#define TICKET_LOG_FILE         L"agent-log.txt"
+#define TICKET_TEMP_SUFFIX      L".tmp"
+// Queued tickets the server refused, kept aside (never sent again)
+#define TICKET_REJECTED_SUFFIX  L".rejected"
+
+// Queued ticket send results
+#define ENTRY_SENT              0           // Created, with its files attached
+#define ENTRY_REJECTED          1           // Refused by the server
+#define ENTRY_FAILED            2           // To be sent again later
+
+// Files are streamed to the server by chunks of this size
+#define TICKET_UPLOAD_CHUNK     (64 * 1024)
+// Largest response read, and Agent log tail looked at for the content lines
+#define TICKET_MAX_RESPONSE     4096
+#define TICKET_LOG_TAIL_MAX     8192
+// Request timeouts (ms)
+#define TICKET_TIMEOUT          30000
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <winhttp.h>
+#include <ShlObj.h>
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+#include "framework.h"
+#include "GlpiApi.h"
+#include "TicketQueue.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// GLPI REST API connection, opened for a queue run
+struct ApiConnection {
+    HINTERNET hSession;
+    HINTERNET hConnect;
+    BOOL bSecure;
+    WCHAR szBasePath[1024];     // apirest.php path
+    WCHAR szAuthHeaders[512];   // App-Token and Session-Token headers
+};
+
+// Request body part: a buffer, or a file streamed by chunks
+struct RequestPart {
+    const CHAR* pData;
+    size_t cbData;
+    HANDLE hFile;
+    ULONGLONG cbFile;
+};
+
+static WCHAR szQueueUserAgent[64];
+static HWND hQueueWnd = NULL;
+static UINT uQueueMsg = 0;
+static PTP_WORK pQueueWork = NULL;
+
+// Drafts and settings submitted, taken by the next run
+static SRWLOCK srwQueueSubmit = SRWLOCK_INIT;
+static std::vector<TicketDraft*> queueDrafts;
+static TicketQueueConfig queueConfig = {};
+
+// Runs are serialized, each one queues the drafts then sends the whole queue
+static SRWLOCK srwQueueRun = SRWLOCK_INIT;
+
+
+//-[QUEUE FOLDER]--------------------------------------------------------------
+
+static BOOL JoinPath(LPWSTR szPath, LPCWSTR szFolder, LPCWSTR szName)
+{
+    return _snwprintf_s(szPath, MAX_PATH, _TRUNCATE, L"%s\\%s", szFolder, szName) > 0;
+}
+
+// Gets the queue folder path, created if needed
+static DWORD GetQueueFolder(LPWSTR szFolder)
+{
+    PWSTR szAppData = NULL;
+    HRESULT hr = SHGetKnownFolderPath(FOLDERID_LocalAppData, 0, NULL, &szAppData);
+    if (FAILED(hr)) {
+        CoTaskMemFree(szAppData);
+        return HRESULT_CODE(hr);
+    }
+    BOOL bJoined = JoinPath(szFolder, szAppData, TICKETQUEUE_FOLDER);
+    CoTaskMemFree(szAppData);
+    if (!bJoined)
+        return ERROR_BUFFER_OVERFLOW;
+    int nRes = SHCreateDirectoryEx(NULL, szFolder, NULL);
+    return (nRes == ERROR_ALREADY_EXISTS || nRes == ERROR_FILE_EXISTS ? ERROR_SUCCESS : nRes);
+}
+
+// Deletes a queued ticket folder and its files
+static VOID DeleteEntry(LPCWSTR szEntry)
+{
+    WCHAR szPath[MAX_PATH];
+    WIN32_FIND_DATA fd;
+    JoinPath(szPath, szEntry, L"*");
+    HANDLE hFind = FindFirstFile(szPath, &fd);
+    if (hFind != INVALID_HANDLE_VALUE) {
+        do {
+            if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && JoinPath(szPath, szEntry, fd.cFileName))
+                DeleteFile(szPath);
+        } while (FindNextFile(hFind, &fd));
+        FindClose(hFind);
+    }
+    RemoveDirectory(szEntry);
+}
+
+// Checks if a file name ends with a suffix
+static BOOL HasSuffix(LPCWSTR szName, LPCWSTR szSuffix)
+{
+    size_t cchName = wcslen(szName);
+    size_t cchSuffix = wcslen(szSuffix);
+    return cchName > cchSuffix && _wcsicmp(szName + cchName - cchSuffix, szSuffix) == 0;
+}
+
+// Lists the queued tickets, oldest first (the ones left half-written are
+// deleted, the rejected ones skipped)
+static std::vector<std::wstring> ListEntries(LPCWSTR szFolder)
+{
+    std::vector<std::wstring> entries;
+    WCHAR szPath[MAX_PATH];
+    WIN32_FIND_DATA fd;
+    JoinPath(szPath, szFolder, L"*");
+    HANDLE hFind = FindFirstFile(szPath, &fd);
+    if (hFind == INVALID_HANDLE_VALUE)
+        return entries;
+    do {
+        if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || fd.cFileName[0] == '.' ||
+            !JoinPath(szPath, szFolder, fd.cFileName))
+            continue;
+        if (HasSuffix(fd.cFileName, TICKET_TEMP_SUFFIX))
+            DeleteEntry(szPath);
+        else if (!HasSuffix(fd.cFileName, TICKET_REJECTED_SUFFIX))
+            entries.push_back(szPath);
+    } while (FindNextFile(hFind, &fd));
+    FindClose(hFind);
+    std::sort(entries.begin(), entries.end());
+    return entries;
+}
+
+// Moves aside a queued ticket the server refused, so that it doesn't hold up
+// the next ones (it's deleted if it can't be moved)
+static VOID RejectEntry(LPCWSTR szEntry)
+{
+    WCHAR szRejected[MAX_PATH];
+    if (_snwprintf_s(szRejected, _TRUNCATE, L"%s%s", szEntry, TICKET_REJECTED_SUFFIX) < 0 ||
+        !MoveFile(szEntry, szRejected))
+        DeleteEntry(szEntry);
+}
+
+static BOOL WriteSmallFile(LPCWSTR szPath, const CHAR* pData, size_t cbData)
+{
+    HANDLE hFile = CreateFile(szPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return FALSE;
+    DWORD cbWritten;
+    BOOL bWritten = WriteFile(hFile, pData, (DWORD)cbData, &cbWritten, NULL) && cbWritten == cbData;
+    CloseHandle(hFile);
+    if (!bWritten)
+        DeleteFile(szPath);
+    return bWritten;
+}
+
+// Reads the ID of a queued ticket already created (0 if not created yet)
+static DWORD ReadTicketId(LPCWSTR szEntry)
+{
+    WCHAR szPath[MAX_PATH];
+    if (!JoinPath(szPath, szEntry, TICKET_ID_FILE))
+        return 0;
+    HANDLE hFile = CreateFile(szPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return 0;
+    CHAR szId[16] = {};
+    DWORD cbRead;
+    if (!ReadFile(hFile, szId, sizeof(szId) - 1, &cbRead, NULL))
+        szId[0] = '\0';
+    CloseHandle(hFile);
+    return strtoul(szId, NULL, 10);
+}
+
+// Copies the Agent log tail (the last TICKETQUEUE_LOG_EXCERPT bytes, from a
+// line start) to a queued ticket, and gets its last TICKETQUEUE_LOG_LINES
+// lines
+static BOOL CopyLogExcerpt(LPCWSTR szLogfile, LPCWSTR szDest, std::string& lastLines)
+{
+    HANDLE hIn = CreateFile(szLogfile, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hIn == INVALID_HANDLE_VALUE)
+        return FALSE;
+    LARGE_INTEGER liSize;
+    HANDLE hOut = INVALID_HANDLE_VALUE;
+    if (GetFileSizeEx(hIn, &liSize))
+        hOut = CreateFile(szDest, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hOut == INVALID_HANDLE_VALUE) {
+        CloseHandle(hIn);
+        return FALSE;
+    }
+
+    ULONGLONG ullSize = liSize.QuadPart;
+    ULONGLONG ullPos = (ullSize > TICKETQUEUE_LOG_EXCERPT ? ullSize - TICKETQUEUE_LOG_EXCERPT : 0);
+    BOOL bSkipLine = (ullPos > 0);
+    BOOL bCopied = TRUE;
+    std::string tail;
+    CHAR* pBuf = new CHAR[TICKET_UPLOAD_CHUNK];
+    while (ullPos < ullSize && bCopied)
+    {
+        OVERLAPPED ov = {};
+        ov.Offset = (DWORD)ullPos;
+        ov.OffsetHigh = (DWORD)(ullPos >> 32);
+        DWORD cbRead;
+        if (!ReadFile(hIn, pBuf, (DWORD)min(ullSize - ullPos, (ULONGLONG)TICKET_UPLOAD_CHUNK), &cbRead, &ov) || cbRead == 0)
+            break;
+        ullPos += cbRead;
+
+        const CHAR* pData = pBuf;
+        if (bSkipLine) {
+            const CHAR* pNewLine = (const CHAR*)memchr(pData, '\n', cbRead);
+            if (pNewLine == NULL)
+                continue;
+            cbRead -= (DWORD)(pNewLine + 1 - pData);
+            pData = pNewLine + 1;
+            bSkipLine = FALSE;
+        }
+        DWORD cbWritten;
+        bCopied = WriteFile(hOut, pData, cbRead, &cbWritten, NULL) && cbWritten == cbRead;
+        tail.append(pData, cbRead);
+        if (tail.size() > TICKET_LOG_TAIL_MAX)
+            tail.erase(0, tail.size() - TICKET_LOG_TAIL_MAX);
+    }
+    delete[] pBuf;
+    CloseHandle(hOut);
+    CloseHandle(hIn);
+    if (!bCopied) {
+        DeleteFile(szDest);
+        return FALSE;
+    }
+
+    // Last lines (the trailing line break excluded)
+    size_t iStart = tail.size();
+    if (iStart > 0 && tail[iStart - 1] == '\n')
+        iStart--;
+    for (int nLines = 0; iStart > 0; iStart--) {
+        if (tail[iStart - 1] == '\n' && ++nLines == TICKETQUEUE_LOG_LINES)
+            break;
+    }
+    lastLines = tail.substr(iStart);
+    return TRUE;
+}
+
+// Writes a draft to the queue. It's written to a temporary folder first, so
+// that a ticket is only queued once complete.
+static BOOL QueueDraft(LPCWSTR szFolder, const TicketDraft* pDraft)
+{
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    ULONGLONG ullId = ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    WCHAR szName[32];
+    WCHAR szTemp[MAX_PATH];
+    WCHAR szEntry[MAX_PATH];
+    for (;; ullId++) {
+        swprintf_s(szName, L"%016llx", ullId);
+        if (!JoinPath(szEntry, szFolder, szName) || wcslen(szEntry) + 4 >= MAX_PATH)
+            return FALSE;
+        swprintf_s(szTemp, L"%s%s", szEntry, TICKET_TEMP_SUFFIX);
+        if (GetFileAttributes(szEntry) != INVALID_FILE_ATTRIBUTES)
+            continue;
+        if (CreateDirectory(szTemp, NULL))
+            break;
+        if (GetLastError() != ERROR_ALREADY_EXISTS)
+            return FALSE;
+    }
+
+    WCHAR szPath[MAX_PATH];
+    std::string content = pDraft->content;
+    std::string lastLines;
+    if (pDraft->szLogfile[0] != '\0' && JoinPath(szPath, szTemp, TICKET_LOG_FILE) &&
+        CopyLogExcerpt(pDraft->szLogfile, szPath, lastLines) && !lastLines.empty()) {
+        content += "<pre>";
+        GlpiAppendHtml(content, lastLines.c_str(), lastLines.size());
+        content += "</pre>";
+    }
+    // The screenshot is attached if it can still be moved
+    if (pDraft->szScreenshot[0] != '\0' && JoinPath(szPath, szTemp, TICKET_SCREENSHOT_FILE))
+        MoveFileEx(pDraft->szScreenshot, szPath, MOVEFILE_COPY_ALLOWED);
+
+    std::string input = GlpiTicketInput(pDraft->name.c_str(), content);
+    if (!JoinPath(szPath, szTemp, TICKET_INPUT_FILE) || !WriteSmallFile(szPath, input.c_str(), input.size()) ||
+        !MoveFile(szTemp, szEntry)) {
+        DeleteEntry(szTemp);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+
+//-[GLPI API]------------------------------------------------------------------
+
+static DWORD OpenApi(ApiConnection* pApi, const TicketQueueConfig* pCfg)
+{
+    WCHAR szHost[256];
+    URL_COMPONENTS uc = { sizeof(uc) };
+    uc.lpszHostName = szHost;
+    uc.dwHostNameLength = ARRAYSIZE(szHost);
+    uc.lpszUrlPath = pApi->szBasePath;
+    uc.dwUrlPathLength = ARRAYSIZE(pApi->szBasePath);
+    if (!WinHttpCrackUrl(pCfg->szApiUrl, 0, 0, &uc))
+        return GetLastError();
+    size_t cchPath = wcslen(pApi->szBasePath);
+    if (cchPath > 0 && pApi->szBasePath[cchPath - 1] == '/')
+        pApi->szBasePath[cchPath - 1] = '\0';
+    pApi->bSecure = (uc.nScheme == INTERNET_SCHEME_HTTPS);
+
+    // The server may only be reachable through the system proxy
+    pApi->hSession = WinHttpOpen(szQueueUserAgent, WINHTTP_ACCESS_TYPE_DEFAULT_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
+    if (pApi->hSession == NULL)
+        return GetLastError();
+    WinHttpSetTimeouts(pApi->hSession, TICKET_TIMEOUT, TICKET_TIMEOUT, TICKET_TIMEOUT, TICKET_TIMEOUT);
+    pApi->hConnect = WinHttpConnect(pApi->hSession, szHost, uc.nPort, 0);
+    if (pApi->hConnect == NULL)
+        return GetLastError();
+
+    pApi->szAuthHeaders[0] = '\0';
+    if (pCfg->szAppToken[0] != '\0')
+        swprintf_s(pApi->szAuthHeaders, L"App-Token: %s\r\n", pCfg->szAppToken);
+    return ERROR_SUCCESS;
+}
+
+static VOID CloseApi(ApiConnection* pApi)
+{
+    if (pApi->hConnect != NULL)
+        WinHttpCloseHandle(pApi->hConnect);
+    if (pApi->hSession != NULL)
+        WinHttpCloseHandle(pApi->hSession);
+}
+
+// Sends an API request, its body made of parts (the files are streamed, never
+// read whole), and reads the start of the response
+static DWORD SendApiRequest(ApiConnection* pApi, LPCWSTR szVerb, LPCWSTR szEndpoint, LPCWSTR szHeaders,
+    const RequestPart* pParts, DWORD dwParts, DWORD* pdwStatusCode, CHAR* pResponse, DWORD* pcbResponse)
+{
+    WCHAR szPath[ARRAYSIZE(pApi->szBasePath) + 32];
+    swprintf_s(szPath, L"%s%s", pApi->szBasePath, szEndpoint);
+    *pdwStatusCode = 0;
+    *pcbResponse = 0;
+
+    HINTERNET hRequest = WinHttpOpenRequest(pApi->hConnect, szVerb, szPath, NULL, WINHTTP_NO_REFERER,
+        WINHTTP_DEFAULT_ACCEPT_TYPES, (pApi->bSecure ? WINHTTP_FLAG_SECURE : 0));
+    if (hRequest == NULL)
+        return GetLastError();
+
+    ULONGLONG ullTotal = 0;
+    for (DWORD i = 0; i < dwParts; i++)
+        ullTotal += (pParts[i].hFile != NULL ? pParts[i].cbFile : pParts[i].cbData);
+    DWORD dwError = ERROR_SUCCESS;
+    if (ullTotal > MAXDWORD)
+        dwError = ERROR_FILE_TOO_LARGE;
+    else if (!WinHttpSendRequest(hRequest, szHeaders, (DWORD)-1L, WINHTTP_NO_REQUEST_DATA, 0, (DWORD)ullTotal, 0))
+        dwError = GetLastError();
+
+    CHAR* pChunk = NULL;
+    for (DWORD i = 0; i < dwParts && dwError == ERROR_SUCCESS; i++)
+    {
+        DWORD cbWritten;
+        if (pParts[i].hFile == NULL) {
+            if (!WinHttpWriteData(hRequest, pParts[i].pData, (DWORD)pParts[i].cbData, &cbWritten))
+                dwError = GetLastError();
+            continue;
+        }
+        if (pChunk == NULL)
+            pChunk = new CHAR[TICKET_UPLOAD_CHUNK];
+        for (ULONGLONG ullLeft = pParts[i].cbFile; ullLeft > 0 && dwError == ERROR_SUCCESS; ) {
+            DWORD cbRead;
+            if (!ReadFile(pParts[i].hFile, pChunk, (DWORD)min(ullLeft, (ULONGLONG)TICKET_UPLOAD_CHUNK), &cbRead, NULL))
+                dwError = GetLastError();
+            else if (cbRead == 0)
+                dwError = ERROR_HANDLE_EOF;
+            else if (!WinHttpWriteData(hRequest, pChunk, cbRead, &cbWritten))
+                dwError = GetLastError();
+            else
+                ullLeft -= cbRead;
+        }
+    }
+    delete[] pChunk;
+
+    if (dwError == ERROR_SUCCESS && !WinHttpReceiveResponse(hRequest, NULL))
+        dwError = GetLastError();
+    if (dwError == ERROR_SUCCESS) {
+        DWORD cbStatus = sizeof(*pdwStatusCode);
+        WinHttpQueryHeaders(hRequest, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER, WINHTTP_HEADER_NAME_BY_INDEX,
+            pdwStatusCode, &cbStatus, WINHTTP_NO_HEADER_INDEX);
+        DWORD cbRead;
+        while (*pcbResponse < TICKET_MAX_RESPONSE &&
+            WinHttpReadData(hRequest, pResponse + *pcbResponse, TICKET_MAX_RESPONSE - *pcbResponse, &cbRead) && cbRead > 0)
+            *pcbResponse += cbRead;
+    }
+    WinHttpCloseHandle(hRequest);
+    return dwError;
+}
+
+// Opens an API session with the user token
+static DWORD InitSession(ApiConnection* pApi, const TicketQueueConfig* pCfg, DWORD* pdwStatusCode)
+{
+    WCHAR szHeaders[ARRAYSIZE(pApi->szAuthHeaders) + 160];
+    swprintf_s(szHeaders, L"%sAuthorization: user_token %s\r\n", pApi->szAuthHeaders, pCfg->szUserToken);
+    CHAR response[TICKET_MAX_RESPONSE];
+    DWORD cbResponse;
+    DWORD dwError = SendApiRequest(pApi, L"GET", GLPIAPI_INIT_SESSION, szHeaders, NULL, 0, pdwStatusCode, response, &cbResponse);
+    if (dwError != ERROR_SUCCESS || *pdwStatusCode != HTTP_STATUS_OK)
+        return dwError;
+
+    // The next requests are sent with the session token
+    CHAR szToken[GLPIAPI_MAX_TOKEN];
+    if (!GlpiJsonGetString(response, cbResponse, "session_token", szToken, ARRAYSIZE(szToken)))
+        return ERROR_INVALID_DATA;
+    size_t cchHeaders = wcslen(pApi->szAuthHeaders);
+    swprintf_s(pApi->szAuthHeaders + cchHeaders, ARRAYSIZE(pApi->szAuthHeaders) - cchHeaders, L"Session-Token: %hs\r\n", szToken);
+    return ERROR_SUCCESS;
+}
+
+static VOID KillSession(ApiConnection* pApi)
+{
+    CHAR response[TICKET_MAX_RESPONSE];
+    DWORD cbResponse;
+    DWORD dwStatusCode;
+    SendApiRequest(pApi, L"GET", GLPIAPI_KILL_SESSION, pApi->szAuthHeaders, NULL, 0, &dwStatusCode, response, &cbResponse);
+}
+
+// Sends a request whose body is a file (the ticket creation request)
+static DWORD PostFile(ApiConnection* pApi, LPCWSTR szEndpoint, LPCWSTR szPath, DWORD* pdwStatusCode,
+    CHAR* pResponse, DWORD* pcbResponse)
+{
+    HANDLE hFile = CreateFile(szPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return GetLastError();
+    LARGE_INTEGER liSize;
+    DWORD dwError = ERROR_SUCCESS;
+    if (!GetFileSizeEx(hFile, &liSize)) {
+        dwError = GetLastError();
+    }
+    else {
+        WCHAR szHeaders[ARRAYSIZE(pApi->szAuthHeaders) + 64];
+        swprintf_s(szHeaders, L"%sContent-Type: application/json\r\n", pApi->szAuthHeaders);
+        RequestPart part = { NULL, 0, hFile, (ULONGLONG)liSize.QuadPart };
+        dwError = SendApiRequest(pApi, L"POST", szEndpoint, szHeaders, &part, 1, pdwStatusCode, pResponse, pcbResponse);
+    }
+    CloseHandle(hFile);
+    return dwError;
+}
+
+// Uploads a file as a document attached to a ticket (multipart/form-data,
+// the file being streamed between the manifest and the closing boundary)
+static DWORD UploadDocument(ApiConnection* pApi, DWORD dwTicketId, LPCWSTR szPath, LPCWSTR szFilename, DWORD* pdwStatusCode)
+{
+    HANDLE hFile = CreateFile(szPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return GetLastError();
+    LARGE_INTEGER liSize;
+    if (!GetFileSizeEx(hFile, &liSize)) {
+        DWORD dwError = GetLastError();
+        CloseHandle(hFile);
+        return dwError;
+    }
+
+    CHAR szFilenameUtf8[MAX_PATH * 3];
+    if (WideCharToMultiByte(CP_UTF8, 0, szFilename, -1, szFilenameUtf8, sizeof(szFilenameUtf8), NULL, NULL) == 0)
+        szFilenameUtf8[0] = '\0';
+    size_t cchFilename = strlen(szFilenameUtf8);
+    const CHAR* szMimeType = "application/octet-stream";
+    if (cchFilename > 4 && _stricmp(szFilenameUtf8 + cchFilename - 4, ".png") == 0)
+        szMimeType = "image/png";
+    else if (cchFilename > 4 && _stricmp(szFilenameUtf8 + cchFilename - 4, ".txt") == 0)
+        szMimeType = "text/plain";
+
+    // The boundary only has to be absent from the file
+    LARGE_INTEGER liCounter;
+    QueryPerformanceCounter(&liCounter);
+    CHAR szBoundary[64];
+    sprintf_s(szBoundary, "GLPIAgentMonitor%016llx%08lx", liCounter.QuadPart, GetCurrentThreadId());
+    std::string head;
+    std::string tail;
+    GlpiMultipart(szBoundary, GlpiDocumentManifest(szFilenameUtf8, dwTicketId), szFilenameUtf8, szMimeType, head, tail);
+
+    WCHAR szHeaders[ARRAYSIZE(pApi->szAuthHeaders) + 128];
+    swprintf_s(szHeaders, L"%sContent-Type: multipart/form-data; boundary=%hs\r\n", pApi->szAuthHeaders, szBoundary);
+    RequestPart parts[3] = {
+        { head.c_str(), head.size(), NULL, 0 },
+        { NULL, 0, hFile, (ULONGLONG)liSize.QuadPart },
+        { tail.c_str(), tail.size(), NULL, 0 }
+    };
+    CHAR response[TICKET_MAX_RESPONSE];
+    DWORD cbResponse;
+    DWORD dwError = SendApiRequest(pApi, L"POST", GLPIAPI_DOCUMENT, szHeaders, parts, ARRAYSIZE(parts),
+        pdwStatusCode, response, &cbResponse);
+    CloseHandle(hFile);
+    return dwError;
+}
+
+
+//-[QUEUE]---------------------------------------------------------------------
+
+// Whether a failed request can be sent again later (the server couldn't be
+// reached, or failed). Any other failure is final.
+static BOOL IsRetryable(DWORD dwError, DWORD dwStatusCode)
+{
+    if (dwError != ERROR_SUCCESS)
+        return (dwError >= WINHTTP_ERROR_BASE && dwError <= WINHTTP_ERROR_LAST);
+    return (dwStatusCode >= 500 || dwStatusCode == HTTP_STATUS_REQUEST_TIMEOUT || dwStatusCode == 429);
+}
+
+static VOID SetResultError(TicketQueueResult* pResult, DWORD dwError, DWORD dwStatusCode)
+{
+    if (pResult->dwError == ERROR_SUCCESS && pResult->dwStatusCode == 0) {
+        pResult->dwError = dwError;
+        pResult->dwStatusCode = (dwError == ERROR_SUCCESS ? dwStatusCode : 0);
+    }
+}
+
+// Sends a queued ticket: creates it, unless it was already, then attaches its
+// files (those the server refuses are dropped). Returns ENTRY_*, and the ticket
+// ID once sent.
+static int SendEntry(ApiConnection* pApi, LPCWSTR szEntry, TicketQueueResult* pResult, DWORD* pdwTicketId)
+{
+    WCHAR szPath[MAX_PATH];
+    CHAR response[TICKET_MAX_RESPONSE];
+    DWORD cbResponse;
+    DWORD dwStatusCode;
+    DWORD dwError;
+
+    DWORD dwTicketId = ReadTicketId(szEntry);
+    if (dwTicketId == 0)
+    {
+        if (!JoinPath(szPath, szEntry, TICKET_INPUT_FILE)) {
+            SetResultError(pResult, ERROR_BUFFER_OVERFLOW, 0);
+            return ENTRY_REJECTED;
+        }
+        dwError = PostFile(pApi, GLPIAPI_TICKET, szPath, &dwStatusCode, response, &cbResponse);
+        if (dwError == ERROR_SUCCESS && dwStatusCode == HTTP_STATUS_CREATED &&
+            !GlpiJsonGetNumber(response, cbResponse, "id", &dwTicketId))
+            dwError = ERROR_INVALID_DATA;
+        if (dwError != ERROR_SUCCESS || dwStatusCode != HTTP_STATUS_CREATED || dwTicketId == 0) {
+            SetResultError(pResult, dwError, dwStatusCode);
+            return (IsRetryable(dwError, dwStatusCode) ? ENTRY_FAILED : ENTRY_REJECTED);
+        }
+        // Remembered so that the ticket isn't created twice if the files
+        // can't be attached right now
+        CHAR szId[16];
+        int cchId = sprintf_s(szId, "%u", dwTicketId);
+        if (JoinPath(szPath, szEntry, TICKET_ID_FILE))
+            WriteSmallFile(szPath, szId, cchId);
+    }
+
+    WIN32_FIND_DATA fd;
+    JoinPath(szPath, szEntry, L"*");
+    HANDLE hFind = FindFirstFile(szPath, &fd);
+    int nRes = ENTRY_SENT;
+    if (hFind != INVALID_HANDLE_VALUE) {
+        do {
+            if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || _wcsicmp(fd.cFileName, TICKET_INPUT_FILE) == 0 ||
+                _wcsicmp(fd.cFileName, TICKET_ID_FILE) == 0 || !JoinPath(szPath, szEntry, fd.cFileName))
+                continue;
+            dwError = UploadDocument(pApi, dwTicketId, szPath, fd.cFileName, &dwStatusCode);
+            if (dwError == ERROR_SUCCESS && dwStatusCode == HTTP_STATUS_CREATED) {
+                DeleteFile(szPath);
+                continue;
+            }
+            SetResultError(pResult, dwError, dwStatusCode);
+            if (IsRetryable(dwError, dwStatusCode)) {
+                nRes = ENTRY_FAILED;
+                break;
+            }
+            DeleteFile(szPath);
+        } while (FindNextFile(hFind, &fd));
+        FindClose(hFind);
+    }
+    *pdwTicketId = dwTicketId;
+    return nRes;
+}
+
+// Thread pool work item: queues the drafts submitted, then sends the queued
+// tickets, oldest first. The ones the server refuses are moved aside, and the
+// run stops at the first one that can be sent again later.
+static VOID CALLBACK RunQueue(PTP_CALLBACK_INSTANCE pInstance, PVOID pContext, PTP_WORK pWork)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pContext);
+    UNREFERENCED_PARAMETER(pWork);
+    AcquireSRWLockExclusive(&srwQueueRun);
+
+    AcquireSRWLockExclusive(&srwQueueSubmit);
+    std::vector<TicketDraft*> drafts;
+    drafts.swap(queueDrafts);
+    TicketQueueConfig cfg = queueConfig;
+    ReleaseSRWLockExclusive(&srwQueueSubmit);
+
+    TicketQueueResult* pResult = new TicketQueueResult();
+    BOOL bRetry = FALSE;
+    WCHAR szFolder[MAX_PATH];
+    DWORD dwError = GetQueueFolder(szFolder);
+    for (TicketDraft* pDraft : drafts) {
+        if (dwError == ERROR_SUCCESS) {
+            if (QueueDraft(szFolder, pDraft))
+                pResult->dwQueued++;
+            else
+                SetResultError(pResult, GetLastError(), 0);
+        }
+        delete pDraft;
+    }
+
+    if (dwError != ERROR_SUCCESS) {
+        SetResultError(pResult, dwError, 0);
+    }
+    else {
+        std::vector<std::wstring> entries = ListEntries(szFolder);
+        if (!entries.empty())
+        {
+            ApiConnection api = {};
+            DWORD dwStatusCode = 0;
+            dwError = OpenApi(&api, &cfg);
+            if (dwError == ERROR_SUCCESS)
+                dwError = InitSession(&api, &cfg, &dwStatusCode);
+            if (dwError == ERROR_SUCCESS && dwStatusCode == HTTP_STATUS_OK) {
+                for (const std::wstring& entry : entries) {
+                    DWORD dwTicketId = 0;
+                    int nRes = SendEntry(&api, entry.c_str(), pResult, &dwTicketId);
+                    if (nRes == ENTRY_FAILED) {
+                        bRetry = TRUE;
+                        break;
+                    }
+                    if (nRes == ENTRY_REJECTED) {
+                        RejectEntry(entry.c_str());
+                        pResult->dwRejected++;
+                        continue;
+                    }
+                    DeleteEntry(entry.c_str());
+                    pResult->dwCreated++;
+                    pResult->dwTicketId = dwTicketId;
+                }
+                KillSession(&api);
+            }
+            else {
+                SetResultError(pResult, dwError, dwStatusCode);
+                bRetry = IsRetryable(dwError, dwStatusCode);
+            }
+            CloseApi(&api);
+        }
+        pResult->dwPending = (DWORD)entries.size() - pResult->dwCreated - pResult->dwRejected;
+    }
+    pResult->bRetry = (pResult->dwPending > 0 && bRetry);
+
+    ReleaseSRWLockExclusive(&srwQueueRun);
+    if (!PostMessage(hQueueWnd, uQueueMsg, 0, (LPARAM)pResult))
+        delete pResult;
+}
+
+// Initializes the queue. The result of each run is posted to hWnd with uMsg.
+VOID TicketQueueInit(LPCWSTR szUserAgent, HWND hWnd, UINT uMsg)
+{
+    wcscpy_s(szQueueUserAgent, szUserAgent);
+    hQueueWnd = hWnd;
+    uQueueMsg = uMsg;
+    pQueueWork = CreateThreadpoolWork(RunQueue, NULL, NULL);
+}
+
+// Queues a ticket draft (if any) and sends the queue, on the thread pool
+BOOL TicketQueueSubmit(const TicketQueueConfig* pCfg, TicketDraft* pDraft)
+{
+    if (pQueueWork == NULL) {
+        delete pDraft;
+        return FALSE;
+    }
+    AcquireSRWLockExclusive(&srwQueueSubmit);
+    queueConfig = *pCfg;
+    if (pDraft != NULL)
+        queueDrafts.push_back(pDraft);
+    ReleaseSRWLockExclusive(&srwQueueSubmit);
+    SubmitThreadpoolWork(pQueueWork);
+    return TRUE;
+}
+
+// Releases the queue. A run in progress isn't waited for: the queued tickets
+// are always left consistent on disk, and its result is dropped.
+VOID TicketQueueClose()
+{
+    if (pQueueWork != NULL) {
+        CloseThreadpoolWork(pQueueWork);
+        pQueueWork = NULL;
+    }
+}
@@ -0,0 +1,93 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  TicketQueue.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include "framework.h"
+#include <string>
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// Queued tickets folder, under the user local application data folder (next
+// to the status history). Each ticket is a subfolder holding the ticket
+// creation request body, the ticket ID once created, and the files left to
+// attach. The tickets the server refused are kept there with a ".rejected"
+// suffix.
+#define TICKETQUEUE_FOLDER      L"GLPI-Agent\\Monitor\\Tickets"
+
+// Agent log tail attached to the tickets, and lines of it added to the ticket
+// content
+#define TICKETQUEUE_LOG_EXCERPT (256 * 1024)
+#define TICKETQUEUE_LOG_LINES   20
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// GLPI REST API settings
+struct TicketQueueConfig {
+    WCHAR szApiUrl[300];        // apirest.php URL
+    WCHAR szAppToken[128];      // API client App-Token (optional)
+    WCHAR szUserToken[128];     // Remote access key of the account creating the tickets
+};
+
+// Ticket to queue (freed by the queue)
+struct TicketDraft {
+    std::string name;           // UTF-8
+    std::string content;        // UTF-8 HTML, the Agent log tail is appended to it
+    WCHAR szScreenshot[MAX_PATH]; // PNG file moved to the queue (empty if none)
+    WCHAR szLogfile[MAX_PATH];  // Agent logfile (empty if none)
+};
+
+// Queue run result, posted to the queue window as the LPARAM of the queue
+// message (must be freed with delete)
+struct TicketQueueResult {
+    DWORD dwQueued;             // Drafts queued by this run
+    DWORD dwCreated;            // Tickets created, with all their files attached
+    DWORD dwTicketId;           // Last ticket created
+    DWORD dwRejected;           // Tickets the server refused (moved aside)
+    DWORD dwPending;            // Tickets left in the queue
+    DWORD dwError;              // First error: WinHTTP or system error code,
+    DWORD dwStatusCode;         // or unexpected HTTP status code
+    BOOL bRetry;                // The tickets left can be retried later (the
+                                // server couldn't be reached or failed)
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+VOID TicketQueueInit(LPCWSTR szUserAgent, HWND hWnd, UINT uMsg);
+BOOL TicketQueueSubmit(const TicketQueueConfig* pCfg, TicketDraft* pDraft);
+VOID TicketQueueClose();
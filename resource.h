@@ -12,6 +12,8 @@
 #define IDB_LOGO                        152
 #define IDD_DIALOG2                     154
 #define IDD_DLG_SETTINGS                154
+#define IDD_DLG_HISTORY                 155
+#define IDD_DLG_LOGS                    156
 #define IDS_APP_TITLE                   200
 #define IDS_GLPINOTIFYERROR             201
 #define IDS_GLPINOTIFY                  202
@@ -47,7 +49,6 @@
 #define IDS_ERR_SERVICE                 232
 #define IDS_OK                          233
 #define IDS_ERROR                       234
-#define IDS_ERR_FORCEINV_NORESPONSE     235
 #define IDS_ERR_FORCEINV_NOTALLOWED     236
 #define IDS_MSG_FORCEINV_OK             237
 #define IDS_ERR_AGENTERR                238
@@ -82,6 +83,43 @@
 #define IDS_RMENU_SETTINGS              265
 #define IDS_SETTINGS_NEWTICKET          266
 #define IDS_SETTINGS_NEWTICKET_SCREENSHOT 267
+#define IDS_NOTIF_FORCEINV_DONE         268
+#define IDS_TIP_ENDPOINTS               269
+#define IDS_NOTIF_ENDPOINT_DOWN         270
+#define IDS_HISTORY                     271
+#define IDS_HISTORY_TITLE               272
+#define IDS_HISTORY_TIME                273
+#define IDS_HISTORY_EVENT               274
+#define IDS_HISTORY_SERVICE             275
+#define IDS_HISTORY_AGENTSTATUS         276
+#define IDS_HISTORY_AGENTERROR          277
+#define IDS_HISTORY_AGENTHTTP           278
+#define IDS_LOGS_TITLE                  279
+#define IDS_LOGS_SEVERITY               280
+#define IDS_LOGS_SEV_ALL                281
+#define IDS_LOGS_SEV_ERROR              282
+#define IDS_LOGS_SEV_WARNING            283
+#define IDS_LOGS_SEV_INFO               284
+#define IDS_LOGS_SEV_DEBUG              285
+#define IDS_LOGS_PERIOD                 286
+#define IDS_LOGS_PERIOD_ALL             287
+#define IDS_LOGS_PERIOD_HOUR            288
+#define IDS_LOGS_PERIOD_DAY             289
+#define IDS_LOGS_PERIOD_WEEK            290
+#define IDS_LOGS_LINES                  291
+#define IDS_LOGS_OPENFILE               292
+#define IDS_ERR_LOGFILE                 293
+#define IDS_LASTINV_UNKNOWN             294
+#define IDS_LASTINV_OK                  295
+#define IDS_LASTINV_FAILED              296
+#define IDS_ERR_SCREENSHOT              297
+#define IDS_TICKET_NAME                 298
+#define IDS_TICKET_CONTENT              299
+#define IDS_NOTIF_TICKET_CREATED        300
+#define IDS_NOTIF_TICKET_QUEUED         301
+#define IDS_ERR_TICKET                  302
+#define IDS_ERR_TICKET_HTTP             303
+#define IDS_NOTIF_FORCEINV_QUEUED       304
 #define IDC_BTN_VIEWLOGS                400
 #define IDD_DIALOG1                     401
 #define IDD_MAIN                        402
@@ -92,9 +130,10 @@
 #define IDC_AGENTVER                    605
 #define IDC_SERVICESTATUS               606
 #define IDC_STARTTYPE                   607
+#define IDC_LASTINVENTORY               608
 #define IDC_PCLOGO                      609
-#define IDT_UPDSTATUS                   610
-#define IDT_UPDSVCSTATUS                611
+#define IDT_SCHEDULER                   610
+#define IDT_PUBLISH                     611
 #define IDC_STATIC_AGENTVER             1004
 #define IDC_STATIC_SERVICESTATUS        1005
 #define IDC_STATIC_STARTTYPE            1006
@@ -109,6 +148,17 @@
 #define IDC_BTN_SAVE                    1014
 #define IDC_SETTINGS_BTN_SAVE           1014
 #define IDC_SETTINGS_GROUPBOX_NEWTICKET 1015
+#define IDC_HISTORY_LIST                1016
+#define IDC_HISTORY_BTN_CLOSE           1017
+#define IDC_BTN_HISTORY                 1018
+#define IDC_LOGS_LIST                   1019
+#define IDC_LOGS_SEVERITY               1020
+#define IDC_LOGS_PERIOD                 1021
+#define IDC_LOGS_STATIC_SEVERITY        1022
+#define IDC_LOGS_STATIC_PERIOD          1023
+#define IDC_LOGS_STATIC_LINES           1024
+#define IDC_LOGS_BTN_OPEN               1025
+#define IDC_LOGS_BTN_CLOSE              1026
 #define ID_RMENU_OPEN                   32760
 #define ID_RMENU_FORCE                  32761
 #define ID_RMENU_EXIT                   32762
@@ -126,9 +176,9 @@
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NO_MFC                     1
-#define _APS_NEXT_RESOURCE_VALUE        155
+#define _APS_NEXT_RESOURCE_VALUE        157
 #define _APS_NEXT_COMMAND_VALUE         32785
-#define _APS_NEXT_CONTROL_VALUE         1016
+#define _APS_NEXT_CONTROL_VALUE         1027
 #define _APS_NEXT_SYMED_VALUE           110
 #endif
 #endif
@@ -0,0 +1,307 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  AgentClientTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <string>
+#include <vector>
+#include "framework.h"
+#include "AgentClient.h"
+#include "Test.h"
+#include "TestAgent.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+#define TEST_WND                ((HWND)1)
+#define WMAPP_TEST_RESPONSE     (WM_APP + 1)
+
+// Longest wait for a response (ms)
+#define RESPONSE_TIMEOUT        5000
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Waits for the next response posted by the client (NULL on timeout)
+static AgentResponse* WaitResponse(DWORD dwTimeout = RESPONSE_TIMEOUT)
+{
+    ULONGLONG ullEnd = GetTickCount64() + dwTimeout;
+    do {
+        MSG msg;
+        if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+            TEST_CHECK(msg.hwnd == TEST_WND && msg.message == WMAPP_TEST_RESPONSE);
+            return (AgentResponse*)msg.lParam;
+        }
+        Sleep(1);
+    } while (GetTickCount64() < ullEnd);
+    return NULL;
+}
+
+// Sends a request and waits for its response
+static AgentResponse* Request(AgentRequestType type, DWORD dwEndpoint = AGENT_LOCAL_ENDPOINT)
+{
+    if (!AgentClientSend(TEST_WND, WMAPP_TEST_RESPONSE, type, dwEndpoint))
+        return NULL;
+    return WaitResponse();
+}
+
+// Checks a /status response, and frees it
+static BOOL CheckStatus(AgentResponse* pResp, LPCWSTR szStatus)
+{
+    BOOL bOk = pResp != NULL && pResp->type == AGENTREQ_STATUS && pResp->dwError == ERROR_SUCCESS &&
+        pResp->dwStatusCode == 200 && pResp->bStatusFound && wcscmp(pResp->szStatus, szStatus) == 0;
+    delete pResp;
+    return bOk;
+}
+
+// Client statistics changes since a previous copy
+static AgentClientStats StatsSince(const AgentClientStats& before)
+{
+    AgentClientStats stats = AgentClientGetStats();
+    stats.dwRequests -= before.dwRequests;
+    stats.dwErrors -= before.dwErrors;
+    stats.dwNewConnections -= before.dwNewConnections;
+    stats.dwReusedConnections -= before.dwReusedConnections;
+    stats.dwRetries -= before.dwRetries;
+    stats.dwRttSamples -= before.dwRttSamples;
+    return stats;
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+static VOID TestRequests()
+{
+    TestAgentHttpd agent;
+    TEST_CHECK(agent.Start());
+    AgentClientInit(new TestSocketTransport());
+    AgentClientSetPort(agent.GetPort());
+
+    // /status is parsed into its fields
+    agent.SetStatus("status: running task Inventory\nversion: 1.7.1\n");
+    AgentResponse* pResp = Request(AGENTREQ_STATUS);
+    TEST_CHECK(pResp != NULL && pResp->dwEndpoint == AGENT_LOCAL_ENDPOINT && pResp->dwFields == 2);
+    TEST_CHECK(pResp != NULL && wcscmp(pResp->fields[1].szKey, L"version") == 0 && wcscmp(pResp->fields[1].szValue, L"1.7.1") == 0);
+    TEST_CHECK(CheckStatus(pResp, L"running task Inventory"));
+
+    // UTF-8 values, and a response without status
+    agent.SetStatus("status: en cours d'ex\xC3\xA9" "cution\n");
+    TEST_CHECK(CheckStatus(Request(AGENTREQ_STATUS), L"en cours d'ex\u00E9cution"));
+    agent.SetStatus("version: 1.7.1\n");
+    pResp = Request(AGENTREQ_STATUS);
+    TEST_CHECK(pResp != NULL && pResp->dwError == ERROR_SUCCESS && !pResp->bStatusFound && pResp->dwFields == 1);
+    delete pResp;
+
+    // /now isn't parsed
+    pResp = Request(AGENTREQ_NOW);
+    TEST_CHECK(pResp != NULL && pResp->type == AGENTREQ_NOW && pResp->dwStatusCode == 200 && pResp->dwFields == 0);
+    delete pResp;
+
+    // A single request of each type is pending at a time
+    agent.SetStatus("status: waiting\n");
+    agent.dwStatusDelay = 200;
+    TEST_CHECK(AgentClientSend(TEST_WND, WMAPP_TEST_RESPONSE, AGENTREQ_STATUS));
+    TEST_CHECK(AgentClientIsPending(AGENTREQ_STATUS) && !AgentClientIsPending(AGENTREQ_NOW));
+    TEST_CHECK(!AgentClientSend(TEST_WND, WMAPP_TEST_RESPONSE, AGENTREQ_STATUS));
+    pResp = WaitResponse();
+    TEST_CHECK(pResp != NULL && pResp->ullElapsed >= 200 && pResp->ullElapsedUs >= 200000);
+    TEST_CHECK(CheckStatus(pResp, L"waiting") && !AgentClientIsPending(AGENTREQ_STATUS));
+
+    // The Agent isn't listening anymore
+    agent.Stop();
+    pResp = Request(AGENTREQ_STATUS);
+    TEST_CHECK(pResp != NULL && pResp->dwError != ERROR_SUCCESS && pResp->dwStatusCode == 0);
+    delete pResp;
+
+    // Closing the client drops the pending requests, and their responses
+    TestAgentHttpd slowAgent;
+    TEST_CHECK(slowAgent.Start());
+    slowAgent.dwStatusDelay = 10000;
+    AgentClientSetPort(slowAgent.GetPort());
+    TEST_CHECK(AgentClientSend(TEST_WND, WMAPP_TEST_RESPONSE, AGENTREQ_STATUS));
+    AgentClientClose();
+    TEST_CHECK(!AgentClientIsPending(AGENTREQ_STATUS) && WaitResponse(100) == NULL);
+    TEST_CHECK(!AgentClientSend(TEST_WND, WMAPP_TEST_RESPONSE, AGENTREQ_STATUS));
+}
+
+static VOID TestKeepAlive()
+{
+    TestAgentHttpd agent;
+    TEST_CHECK(agent.Start());
+    AgentClientInit(new TestSocketTransport());
+    AgentClientSetPort(agent.GetPort());
+    AgentClientStats before = AgentClientGetStats();
+
+    // The polls reuse a single connection
+    for (int i = 0; i < 20; i++)
+        TEST_CHECK(CheckStatus(Request(AGENTREQ_STATUS), L"waiting"));
+    AgentClientStats stats = StatsSince(before);
+    TEST_CHECK(agent.nConnections == 1 && agent.nRequests == 20);
+    TEST_CHECK(stats.dwRequests == 20 && stats.dwErrors == 0 && stats.dwRetries == 0);
+    TEST_CHECK(stats.dwNewConnections == 1 && stats.dwReusedConnections == 19 && stats.dwRttSamples == 20);
+    TEST_CHECK(stats.ullRttMinUs <= stats.ullRttMaxUs && stats.ullRttTotalUs >= stats.ullRttMaxUs);
+
+    // The Agent restarted: the request is retried once over a new connection
+    agent.CloseConnections();
+    TEST_CHECK(CheckStatus(Request(AGENTREQ_STATUS), L"waiting"));
+    stats = StatsSince(before);
+    TEST_CHECK(agent.nConnections == 2 && stats.dwRetries == 1);
+    TEST_CHECK(stats.dwRequests == 22 && stats.dwErrors == 1);
+
+    // The kept-alive connection is dropped before answering
+    agent.nDrops = 1;
+    TEST_CHECK(CheckStatus(Request(AGENTREQ_STATUS), L"waiting"));
+    TEST_CHECK(agent.nConnections == 3 && StatsSince(before).dwRetries == 2);
+
+    // Twice: the retry fails too, and isn't retried again
+    agent.nDrops = 2;
+    AgentResponse* pResp = Request(AGENTREQ_STATUS);
+    TEST_CHECK(pResp != NULL && pResp->dwError == ERROR_WINHTTP_CONNECTION_ERROR);
+    delete pResp;
+    TEST_CHECK(agent.nConnections == 4 && StatsSince(before).dwRetries == 3);
+
+    // A new connection failing isn't retried
+    agent.nDrops = 1;
+    pResp = Request(AGENTREQ_STATUS);
+    TEST_CHECK(pResp != NULL && pResp->dwError == ERROR_WINHTTP_CONNECTION_ERROR);
+    delete pResp;
+    TEST_CHECK(agent.nConnections == 5 && StatsSince(before).dwRetries == 3);
+
+    // Larger responses are drained, so their connection is kept alive
+    TEST_CHECK(CheckStatus(Request(AGENTREQ_STATUS), L"waiting"));
+    int nConnections = agent.nConnections;
+    agent.SetStatus("status: waiting\n" + std::string(32768, '#') + "\n");
+    TEST_CHECK(CheckStatus(Request(AGENTREQ_STATUS), L"waiting"));
+    TEST_CHECK(CheckStatus(Request(AGENTREQ_STATUS), L"waiting"));
+    TEST_CHECK(agent.nConnections == nConnections);
+
+    // But not too large ones
+    agent.SetStatus("status: waiting\n" + std::string(AGENT_MAX_DRAIN, '#') + "\n");
+    pResp = Request(AGENTREQ_STATUS);
+    TEST_CHECK(pResp != NULL && pResp->dwError == ERROR_INSUFFICIENT_BUFFER && pResp->dwStatusCode == 200);
+    delete pResp;
+    agent.SetStatus("status: waiting\n");
+    TEST_CHECK(CheckStatus(Request(AGENTREQ_STATUS), L"waiting"));
+    TEST_CHECK(agent.nConnections == nConnections + 1);
+    AgentClientClose();
+}
+
+static VOID TestCancel()
+{
+    TestAgentHttpd agent;
+    TEST_CHECK(agent.Start());
+    AgentClientInit(new TestSocketTransport());
+    AgentClientSetPort(agent.GetPort());
+    TEST_CHECK(!AgentClientCancel(AGENTREQ_NOW));
+
+    // A forced inventory taking long is cancelled: its response isn't posted,
+    // and the /status polls go on meanwhile
+    agent.dwNowDelay = 10000;
+    TEST_CHECK(AgentClientSend(TEST_WND, WMAPP_TEST_RESPONSE, AGENTREQ_NOW));
+    TEST_CHECK(CheckStatus(Request(AGENTREQ_STATUS), L"waiting"));
+    TEST_CHECK(AgentClientIsPending(AGENTREQ_NOW));
+    ULONGLONG ullStart = GetTickCount64();
+    TEST_CHECK(AgentClientCancel(AGENTREQ_NOW));
+    TEST_CHECK(!AgentClientIsPending(AGENTREQ_NOW) && !AgentClientCancel(AGENTREQ_NOW));
+    TEST_CHECK(WaitResponse(200) == NULL);
+
+    // Another one can be sent right away
+    agent.dwNowDelay = 100;
+    AgentResponse* pResp = Request(AGENTREQ_NOW);
+    TEST_CHECK(pResp != NULL && pResp->type == AGENTREQ_NOW && pResp->dwError == ERROR_SUCCESS && pResp->dwStatusCode == 200);
+    TEST_CHECK(pResp != NULL && pResp->ullElapsed >= 100 && GetTickCount64() - ullStart < 5000);
+    delete pResp;
+
+    // Cancelled right after being sent, while connecting or waiting
+    agent.dwNowDelay = 0;
+    TEST_CHECK(AgentClientSend(TEST_WND, WMAPP_TEST_RESPONSE, AGENTREQ_NOW) && AgentClientCancel(AGENTREQ_NOW));
+    TEST_CHECK(WaitResponse(100) == NULL);
+    TEST_CHECK(CheckStatus(Request(AGENTREQ_STATUS), L"waiting"));
+    AgentClientClose();
+}
+
+static VOID TestEndpoints()
+{
+    // Endpoint 0 is unused, the other ones are remote Agents
+    const DWORD dwAgents = AGENT_MAX_ENDPOINTS - 1;
+    std::vector<TestAgentHttpd> agents(dwAgents);
+    AgentClientInit(new TestSocketTransport());
+    for (DWORD i = 0; i < dwAgents; i++) {
+        TEST_CHECK(agents[i].Start());
+        agents[i].SetStatus("status: agent " + std::to_string(i + 1) + "\n");
+        AgentClientSetEndpoint(i + 1, L"127.0.0.1", agents[i].GetPort());
+    }
+    TEST_CHECK(!AgentClientSend(TEST_WND, WMAPP_TEST_RESPONSE, AGENTREQ_STATUS, AGENT_MAX_ENDPOINTS));
+
+    // All the endpoints are polled at once, a slow one not holding the others back
+    agents[0].dwStatusDelay = 500;
+    for (int nPoll = 0; nPoll < 3; nPoll++)
+    {
+        for (DWORD dwEndpoint = 1; dwEndpoint <= dwAgents; dwEndpoint++)
+            TEST_CHECK(AgentClientSend(TEST_WND, WMAPP_TEST_RESPONSE, AGENTREQ_STATUS, dwEndpoint));
+        std::vector<DWORD> order;
+        for (DWORD i = 0; i < dwAgents; i++) {
+            AgentResponse* pResp = WaitResponse();
+            if (pResp == NULL)
+                break;
+            order.push_back(pResp->dwEndpoint);
+            TEST_CHECK(CheckStatus(pResp, (L"agent " + std::to_wstring(order.back())).c_str()));
+        }
+        TEST_CHECK(order.size() == dwAgents && order.back() == 1);
+    }
+    for (DWORD i = 0; i < dwAgents; i++)
+        TEST_CHECK(agents[i].nConnections == 1 && agents[i].nRequests == 3);
+
+    // A removed endpoint isn't reached anymore, and can be set again
+    AgentClientSetEndpoint(2, NULL, 0);
+    AgentResponse* pResp = Request(AGENTREQ_STATUS, 2);
+    TEST_CHECK(pResp != NULL && pResp->dwEndpoint == 2 && pResp->dwError == ERROR_NOT_FOUND);
+    delete pResp;
+    AgentClientSetEndpoint(2, L"127.0.0.1", agents[2].GetPort());
+    TEST_CHECK(CheckStatus(Request(AGENTREQ_STATUS, 2), L"agent 3"));
+    TEST_CHECK(agents[1].nRequests == 3 && agents[2].nConnections == 2);
+    AgentClientClose();
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestRequests);
+    TEST_RUN(TestKeepAlive);
+    TEST_RUN(TestCancel);
+    TEST_RUN(TestEndpoints);
+    return TestResult();
+}
@@ -0,0 +1,260 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  AgentStatusParserTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "framework.h"
+#include "AgentClient.h"
+#include "Test.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// /status response bodies
+struct SampleBody {
+    const CHAR* szBody;
+    DWORD dwFields;
+    const CHAR* szStatus;       // NULL if there's no "status" field
+};
+static const SampleBody samples[] = {
+    { "status: waiting\n", 1, "waiting" },
+    { "status: waiting", 1, "waiting" },
+    { "status: running task Inventory\r\n", 1, "running task Inventory" },
+    { "  Status :\t waiting  \r\nversion: 1.7\r\n", 2, "waiting" },
+    { "no separator\nstatus: waiting\n\n: no key\n", 1, "waiting" },
+    { "version: 1.7\nstatus:\nstatus: waiting\n", 3, "" },
+    { "url: http://127.0.0.1:62354/now\nstatus: waiting\n", 2, "waiting" },
+    { "", 0, NULL },
+    { "\n\n\r\n", 0, NULL },
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Parses a body fed in chunks ending at the given offsets (in order)
+static VOID Parse(const std::string& body, const size_t* pcbSplits, size_t nSplits, AgentStatusParser* pParser)
+{
+    ZeroMemory(pParser, sizeof(AgentStatusParser));
+    size_t cbFed = 0;
+    for (size_t i = 0; i < nSplits; i++) {
+        AgentStatusParserFeed(pParser, body.data() + cbFed, pcbSplits[i] - cbFed);
+        cbFed = pcbSplits[i];
+    }
+    AgentStatusParserFeed(pParser, body.data() + cbFed, body.size() - cbFed);
+    AgentStatusParserEnd(pParser);
+}
+
+static BOOL SameFields(const AgentStatusParser* pParser, const AgentStatusParser* pOther)
+{
+    if (pParser->dwFields != pOther->dwFields || pParser->bTruncated != pOther->bTruncated)
+        return FALSE;
+    for (DWORD i = 0; i < pParser->dwFields; i++) {
+        if (strcmp(pParser->fields[i].szKey, pOther->fields[i].szKey) != 0 ||
+            strcmp(pParser->fields[i].szValue, pOther->fields[i].szValue) != 0)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+// Checks the parser limits: terminated keys and values, no empty key, no
+// leading or trailing spaces
+static BOOL CheckFields(const AgentStatusParser* pParser)
+{
+    if (pParser->dwFields > AGENTSTATUS_MAX_FIELDS)
+        return FALSE;
+    for (DWORD i = 0; i < pParser->dwFields; i++) {
+        const AgentStatusField* pField = &pParser->fields[i];
+        size_t cchKey = strnlen(pField->szKey, AGENTSTATUS_MAX_KEY);
+        size_t cchValue = strnlen(pField->szValue, AGENTSTATUS_MAX_VALUE);
+        if (cchKey == 0 || cchKey == AGENTSTATUS_MAX_KEY || cchValue == AGENTSTATUS_MAX_VALUE)
+            return FALSE;
+        if (pField->szKey[0] == ' ' || pField->szKey[0] == '\t' || pField->szKey[cchKey - 1] == ' ' ||
+            strchr(pField->szKey, ':') != NULL || strchr(pField->szKey, '\n') != NULL)
+            return FALSE;
+        if (cchValue > 0 && (pField->szValue[0] == ' ' || pField->szValue[cchValue - 1] == ' ' ||
+            pField->szValue[cchValue - 1] == '\r' || strchr(pField->szValue, '\n') != NULL))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+static VOID TestSamples()
+{
+    for (size_t i = 0; i < ARRAYSIZE(samples); i++) {
+        AgentStatusParser parser;
+        Parse(samples[i].szBody, NULL, 0, &parser);
+        const CHAR* szStatus = AgentStatusParserGet(&parser, "status");
+        TEST_CHECK(parser.dwFields == samples[i].dwFields && !parser.bTruncated && CheckFields(&parser));
+        TEST_CHECK(samples[i].szStatus == NULL ? szStatus == NULL : szStatus != NULL && strcmp(szStatus, samples[i].szStatus) == 0);
+    }
+
+    AgentStatusParser parser;
+    Parse(samples[3].szBody, NULL, 0, &parser);
+    TEST_CHECK(strcmp(parser.fields[0].szKey, "Status") == 0 && strcmp(parser.fields[1].szValue, "1.7") == 0);
+    TEST_CHECK(AgentStatusParserGet(&parser, "VERSION") != NULL && AgentStatusParserGet(&parser, "url") == NULL);
+
+    // NUL bytes are skipped
+    AgentStatusParser withNul;
+    static const CHAR bodyWithNul[] = "\0sta\0tus:\0 wait\0ing\0\n";
+    Parse(std::string(bodyWithNul, sizeof(bodyWithNul) - 1), NULL, 0, &withNul);
+    Parse("status: waiting\n", NULL, 0, &parser);
+    TEST_CHECK(SameFields(&parser, &withNul));
+}
+
+// Every sample split at every offset, then at every pair of offsets: the
+// fields are the same as parsed at once
+static VOID TestSplitEverywhere()
+{
+    DWORD dwMismatches = 0;
+    for (size_t i = 0; i < ARRAYSIZE(samples); i++) {
+        std::string body = samples[i].szBody;
+        AgentStatusParser whole, split;
+        Parse(body, NULL, 0, &whole);
+        for (size_t cbFirst = 0; cbFirst <= body.size(); cbFirst++) {
+            for (size_t cbSecond = cbFirst; cbSecond <= body.size(); cbSecond++) {
+                size_t cbSplits[2] = { cbFirst, cbSecond };
+                Parse(body, cbSplits, 2, &split);
+                if (!SameFields(&whole, &split))
+                    dwMismatches++;
+            }
+        }
+
+        // Byte by byte
+        std::vector<size_t> cbBytes;
+        for (size_t cb = 1; cb < body.size(); cb++)
+            cbBytes.push_back(cb);
+        Parse(body, cbBytes.data(), cbBytes.size(), &split);
+        if (!SameFields(&whole, &split))
+            dwMismatches++;
+    }
+    TEST_CHECK(dwMismatches == 0);
+}
+
+// Keys and values longer than AGENTSTATUS_MAX_KEY/AGENTSTATUS_MAX_VALUE are
+// truncated, fields past AGENTSTATUS_MAX_FIELDS dropped, wherever the body is split
+static VOID TestTruncation()
+{
+    std::string longKey(AGENTSTATUS_MAX_KEY + 10, 'k');
+    std::string longValue(AGENTSTATUS_MAX_VALUE * 3, 'v');
+    std::string fitKey(AGENTSTATUS_MAX_KEY - 1, 'k');
+    std::string fitValue(AGENTSTATUS_MAX_VALUE - 1, 'v');
+    struct {
+        std::string body;
+        BOOL bTruncated;
+    } cases[] = {
+        { fitKey + ": " + fitValue + "\n", FALSE },
+        { longKey + ": value\n", TRUE },
+        { "status: " + longValue + "\n", TRUE },
+        { "status: " + fitValue + "   \r\n", FALSE },
+        { "status: " + fitValue + "\r\n", FALSE },
+        { longKey + ":" + longValue, TRUE },
+    };
+
+    DWORD dwMismatches = 0;
+    for (size_t i = 0; i < ARRAYSIZE(cases); i++) {
+        AgentStatusParser whole, split;
+        Parse(cases[i].body, NULL, 0, &whole);
+        if (whole.dwFields != 1 || whole.bTruncated != cases[i].bTruncated || !CheckFields(&whole))
+            dwMismatches++;
+        for (size_t cbSplit = 0; cbSplit <= cases[i].body.size(); cbSplit++) {
+            Parse(cases[i].body, &cbSplit, 1, &split);
+            if (!SameFields(&whole, &split))
+                dwMismatches++;
+        }
+    }
+    TEST_CHECK(dwMismatches == 0);
+
+    AgentStatusParser parser;
+    Parse(cases[1].body, NULL, 0, &parser);
+    TEST_CHECK(parser.fields[0].szKey == fitKey && strcmp(parser.fields[0].szValue, "value") == 0);
+    Parse(cases[2].body, NULL, 0, &parser);
+    TEST_CHECK(AgentStatusParserGet(&parser, "status") == fitValue);
+
+    // Extra fields
+    std::string body;
+    for (int i = 0; i < AGENTSTATUS_MAX_FIELDS + 3; i++)
+        body += "field" + std::to_string(i) + ": " + std::to_string(i) + "\n";
+    Parse(body, NULL, 0, &parser);
+    TEST_CHECK(parser.dwFields == AGENTSTATUS_MAX_FIELDS && parser.bTruncated && CheckFields(&parser));
+    TEST_CHECK(strcmp(parser.fields[AGENTSTATUS_MAX_FIELDS - 1].szKey, "field7") == 0);
+    TEST_CHECK(AgentStatusParserGet(&parser, "field8") == NULL);
+}
+
+// Random bytes (separators and spaces being frequent), in random chunks: the
+// limits hold, and the fields don't depend on the chunks
+static VOID TestRandomBytes()
+{
+    static const CHAR frequent[] = { ':', '\n', '\r', ' ', '\t', 's', '\0' };
+    srand(6);
+    DWORD dwMismatches = 0, dwInvalid = 0;
+    for (int nBody = 0; nBody < 2000; nBody++) {
+        std::string body;
+        for (int cb = rand() % 700; cb > 0; cb--)
+            body += (rand() % 2 ? frequent[rand() % ARRAYSIZE(frequent)] : (CHAR)(rand() % 256));
+
+        AgentStatusParser whole, split;
+        Parse(body, NULL, 0, &whole);
+        if (!CheckFields(&whole))
+            dwInvalid++;
+
+        std::vector<size_t> cbSplits;
+        for (size_t cb = rand() % 16; cb < body.size(); cb += 1 + rand() % 64)
+            cbSplits.push_back(cb);
+        Parse(body, cbSplits.data(), cbSplits.size(), &split);
+        if (!SameFields(&whole, &split))
+            dwMismatches++;
+    }
+    TEST_CHECK(dwInvalid == 0);
+    TEST_CHECK(dwMismatches == 0);
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestSamples);
+    TEST_RUN(TestSplitEverywhere);
+    TEST_RUN(TestTruncation);
+    TEST_RUN(TestRandomBytes);
+    return TestResult();
+}
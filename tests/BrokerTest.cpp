@@ -0,0 +1,298 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  BrokerTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+#include "framework.h"
+#include "Broker.h"
+#include "Test.h"
+#include "TestStream.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+static_assert(sizeof(BrokerHeader) == 16 && sizeof(BrokerReply) == 12, "Broker messages layout");
+static_assert(sizeof(BrokerSettingsBody) == 8 + BROKER_MAX_URL * sizeof(WCHAR), "Broker settings layout");
+
+// Arbitrary results of the fake backend
+#define FAKE_ALREADY_RUNNING    1056
+#define FAKE_NOT_ACTIVE         1062
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// Service and settings kept in memory
+class FakeBackend : public BrokerBackend
+{
+public:
+    BOOL bRunning = FALSE;
+    int nCalls = 0;
+    BrokerSettingsBody settings = {};
+
+    DWORD ControlService(DWORD dwOperation)
+    {
+        nCalls++;
+        TEST_CHECK(dwOperation >= HANDOFF_SVC_START && dwOperation <= HANDOFF_SVC_CONTINUE);
+        if (dwOperation == HANDOFF_SVC_STOP) {
+            if (!bRunning)
+                return FAKE_NOT_ACTIVE;
+            bRunning = FALSE;
+            return ERROR_SUCCESS;
+        }
+        if (bRunning && dwOperation == HANDOFF_SVC_START)
+            return FAKE_ALREADY_RUNNING;
+        bRunning = TRUE;
+        return ERROR_SUCCESS;
+    }
+
+    DWORD WriteSettings(const BrokerSettingsBody* pSettings)
+    {
+        nCalls++;
+        TEST_CHECK(pSettings->dwMask != 0 && (pSettings->dwMask & ~BROKER_SETTINGS_ALL) == 0);
+        TEST_CHECK(wcsnlen(pSettings->szNewTicketURL, BROKER_MAX_URL) < BROKER_MAX_URL);
+        TEST_CHECK(!(pSettings->dwMask & BROKER_SETTINGS_NEWTICKET_URL) || pSettings->szNewTicketURL[0] == L'\0' ||
+            BrokerIsWebUrl(pSettings->szNewTicketURL));
+        if (pSettings->dwMask & BROKER_SETTINGS_NEWTICKET_URL)
+            wcscpy_s(settings.szNewTicketURL, pSettings->szNewTicketURL);
+        if (pSettings->dwMask & BROKER_SETTINGS_NEWTICKET_SCREENSHOT)
+            settings.dwNewTicketScreenshot = pSettings->dwNewTicketScreenshot;
+        return ERROR_SUCCESS;
+    }
+};
+
+// Broker serving a connection until it's closed
+struct TestBroker {
+    TestPipe pipe;
+    FakeBackend backend;
+    DWORD dwServed = 0;
+    std::thread server;
+
+    TestBroker() : server([this] { dwServed = BrokerServe(&pipe.server, &backend); pipe.server.Close(); }) {}
+    ~TestBroker() { Stop(); }
+
+    VOID Stop()
+    {
+        if (server.joinable()) {
+            pipe.client.Shutdown();
+            server.join();
+        }
+    }
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+static DWORD CallService(HandoffStream* pStream, DWORD dwSeq, DWORD dwOperation)
+{
+    BrokerServiceBody body = { dwOperation };
+    DWORD dwResult = MAXDWORD;
+    TEST_CHECK(BrokerCall(pStream, BROKER_CMD_SERVICE, dwSeq, &body, sizeof(body), &dwResult));
+    return dwResult;
+}
+
+static DWORD CallSettings(HandoffStream* pStream, DWORD dwSeq, const BrokerSettingsBody* pBody, DWORD cbBody = sizeof(BrokerSettingsBody))
+{
+    DWORD dwResult = MAXDWORD;
+    TEST_CHECK(BrokerCall(pStream, BROKER_CMD_SETTINGS, dwSeq, pBody, cbBody, &dwResult));
+    return dwResult;
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+// Many requests per connection
+static VOID TestSession()
+{
+    TestBroker broker;
+    HandoffStream* pClient = &broker.pipe.client;
+    TEST_CHECK(CallService(pClient, 1, HANDOFF_SVC_START) == ERROR_SUCCESS && broker.backend.bRunning);
+    TEST_CHECK(CallService(pClient, 2, HANDOFF_SVC_START) == FAKE_ALREADY_RUNNING);
+    TEST_CHECK(CallService(pClient, 3, HANDOFF_SVC_STOP) == ERROR_SUCCESS && !broker.backend.bRunning);
+    TEST_CHECK(CallService(pClient, 4, HANDOFF_SVC_STOP) == FAKE_NOT_ACTIVE);
+
+    BrokerSettingsBody body = {};
+    body.dwMask = BROKER_SETTINGS_ALL;
+    body.dwNewTicketScreenshot = 1;
+    wcscpy_s(body.szNewTicketURL, L"https://glpi/front/ticket.form.php");
+    TEST_CHECK(CallSettings(pClient, 5, &body) == ERROR_SUCCESS);
+    TEST_CHECK(broker.backend.settings.dwNewTicketScreenshot == 1);
+    TEST_CHECK(wcscmp(broker.backend.settings.szNewTicketURL, body.szNewTicketURL) == 0);
+    body.dwMask = BROKER_SETTINGS_NEWTICKET_SCREENSHOT;
+    body.dwNewTicketScreenshot = 0;
+    body.szNewTicketURL[0] = L'\0';
+    TEST_CHECK(CallSettings(pClient, 6, &body) == ERROR_SUCCESS);
+    TEST_CHECK(broker.backend.settings.dwNewTicketScreenshot == 0);
+    TEST_CHECK(wcscmp(broker.backend.settings.szNewTicketURL, L"https://glpi/front/ticket.form.php") == 0);
+
+    broker.Stop();
+    TEST_CHECK(broker.dwServed == 6 && broker.backend.nCalls == 6);
+}
+
+// Invalid bodies and unknown commands are answered without reaching the
+// backend, and the connection stays usable
+static VOID TestRejected()
+{
+    TestBroker broker;
+    HandoffStream* pClient = &broker.pipe.client;
+    TEST_CHECK(CallService(pClient, 1, 0) == ERROR_INVALID_PARAMETER);
+    TEST_CHECK(CallService(pClient, 2, HANDOFF_SVC_CONTINUE + 1) == ERROR_INVALID_PARAMETER);
+
+    BrokerSettingsBody body = {};
+    TEST_CHECK(CallSettings(pClient, 3, &body) == ERROR_INVALID_PARAMETER);
+    body.dwMask = BROKER_SETTINGS_ALL + 1;
+    TEST_CHECK(CallSettings(pClient, 4, &body) == ERROR_INVALID_PARAMETER);
+    body.dwMask = BROKER_SETTINGS_NEWTICKET_SCREENSHOT;
+    body.dwNewTicketScreenshot = 2;
+    TEST_CHECK(CallSettings(pClient, 5, &body) == ERROR_INVALID_PARAMETER);
+    body.dwNewTicketScreenshot = 0;
+    for (int i = 0; i < BROKER_MAX_URL; i++)
+        body.szNewTicketURL[i] = L'a';
+    TEST_CHECK(CallSettings(pClient, 6, &body) == ERROR_INVALID_PARAMETER);
+
+    // Only web new ticket URLs (the Monitor opens them with ShellExecute)
+    static const WCHAR* szBadUrls[] = { L"file:///C:/Windows/System32/calc.exe", L"C:\\Windows\\notepad.exe",
+        L"\\\\server\\share\\run.bat", L"javascript:alert(1)", L"ms-settings:", L"http:/glpi", L" https://glpi" };
+    body.dwMask = BROKER_SETTINGS_NEWTICKET_URL;
+    DWORD dwSeq = 7;
+    for (size_t i = 0; i < ARRAYSIZE(szBadUrls); i++) {
+        wcscpy_s(body.szNewTicketURL, szBadUrls[i]);
+        TEST_CHECK(CallSettings(pClient, dwSeq++, &body) == ERROR_INVALID_PARAMETER);
+    }
+
+    // Body sizes not matching their command
+    body.szNewTicketURL[0] = L'\0';
+    TEST_CHECK(CallSettings(pClient, dwSeq++, &body, 8) == ERROR_INVALID_PARAMETER);
+    BrokerServiceBody bodies[2] = { { HANDOFF_SVC_START }, { HANDOFF_SVC_START } };
+    DWORD dwResult = 0;
+    TEST_CHECK(BrokerCall(pClient, BROKER_CMD_SERVICE, dwSeq++, bodies, sizeof(bodies), &dwResult) && dwResult == ERROR_INVALID_PARAMETER);
+    TEST_CHECK(BrokerCall(pClient, BROKER_CMD_SERVICE, dwSeq++, NULL, 0, &dwResult) && dwResult == ERROR_INVALID_PARAMETER);
+
+    // Unknown commands, other version
+    TEST_CHECK(BrokerCall(pClient, 0, dwSeq++, NULL, 0, &dwResult) && dwResult == ERROR_NOT_SUPPORTED);
+    TEST_CHECK(BrokerCall(pClient, BROKER_CMD_MAX + 1, dwSeq++, bodies, sizeof(bodies[0]), &dwResult) && dwResult == ERROR_NOT_SUPPORTED);
+    BrokerHeader hdr = { BROKER_MAGIC, BROKER_VERSION + 1, BROKER_CMD_SERVICE, dwSeq, sizeof(bodies[0]) };
+    BrokerReply reply;
+    TEST_CHECK(pClient->Write(&hdr, sizeof(hdr)) && pClient->Write(bodies, sizeof(bodies[0])));
+    TEST_CHECK(pClient->Read(&reply, sizeof(reply)) && reply.dwSeq == dwSeq++ && reply.dwResult == ERROR_NOT_SUPPORTED);
+
+    TEST_CHECK(CallService(pClient, dwSeq, HANDOFF_SVC_START) == ERROR_SUCCESS);
+    broker.Stop();
+    TEST_CHECK(broker.dwServed == dwSeq && broker.backend.nCalls == 1);
+}
+
+static VOID TestWebUrl()
+{
+    TEST_CHECK(BrokerIsWebUrl(L"http://glpi/front/ticket.form.php"));
+    TEST_CHECK(BrokerIsWebUrl(L"https://glpi.example.com/front/ticket.form.php"));
+    TEST_CHECK(BrokerIsWebUrl(L"HTTPS://GLPI/"));
+    TEST_CHECK(!BrokerIsWebUrl(L""));
+    TEST_CHECK(!BrokerIsWebUrl(L"http:"));
+    TEST_CHECK(!BrokerIsWebUrl(L"https:/glpi"));
+    TEST_CHECK(!BrokerIsWebUrl(L"ftp://glpi/"));
+    TEST_CHECK(!BrokerIsWebUrl(L"file://glpi/share/x.exe"));
+}
+
+// Out of sync requests close the connection: bad magic, oversized body, torn
+// header or body
+static VOID TestOutOfSync()
+{
+    for (int nCase = 0; nCase < 4; nCase++) {
+        TestBroker broker;
+        HandoffStream* pClient = &broker.pipe.client;
+        BrokerHeader hdr = { BROKER_MAGIC, BROKER_VERSION, BROKER_CMD_SERVICE, 1, sizeof(BrokerServiceBody) };
+        if (nCase == 0)
+            hdr.dwMagic = 0xDEADBEEF;
+        else if (nCase == 1)
+            hdr.cbBody = sizeof(BrokerBody) + 1;
+        pClient->Write(&hdr, (nCase == 2 ? sizeof(hdr) - 1 : sizeof(hdr)));
+        if (nCase == 3)
+            pClient->Write("\1", 1);
+        broker.pipe.client.Shutdown();
+        BrokerReply reply;
+        TEST_CHECK(!pClient->Read(&reply, sizeof(reply)));
+        broker.Stop();
+        TEST_CHECK(broker.dwServed == 0 && broker.backend.nCalls == 0);
+    }
+}
+
+// Random streams, with some valid headers mixed in: the backend only gets
+// requests that were answered, and checked
+static VOID TestRandomStreams()
+{
+    srand(42);
+    for (int nStream = 0; nStream < 300; nStream++) {
+        std::string data;
+        for (int nRequests = rand() % 8; nRequests > 0; nRequests--) {
+            BrokerHeader hdr = { BROKER_MAGIC, BROKER_VERSION, (WORD)(rand() % 4), (DWORD)rand(), 0 };
+            if (rand() % 3 == 0)
+                hdr.wVersion = (WORD)rand();
+            if (rand() % 10 == 0)
+                hdr.dwMagic = (DWORD)rand();
+            switch (rand() % 3) {
+                case 0: hdr.cbBody = sizeof(BrokerServiceBody); break;
+                case 1: hdr.cbBody = sizeof(BrokerSettingsBody); break;
+                default: hdr.cbBody = rand() % (sizeof(BrokerBody) + 2); break;
+            }
+            data.append((const char*)&hdr, sizeof(hdr));
+            DWORD cbBody = (hdr.cbBody <= sizeof(BrokerBody) ? hdr.cbBody : rand() % 64);
+            for (DWORD i = 0; i < cbBody; i++)
+                data += (char)(rand() % 3 != 0 ? rand() : 0);
+        }
+
+        TestBroker broker;
+        broker.pipe.client.Write(data.data(), (DWORD)data.size());
+        broker.Stop();
+        TEST_CHECK((DWORD)broker.backend.nCalls <= broker.dwServed);
+        TEST_CHECK(broker.pipe.toClient.data.size() == broker.dwServed * sizeof(BrokerReply));
+    }
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestSession);
+    TEST_RUN(TestRejected);
+    TEST_RUN(TestWebUrl);
+    TEST_RUN(TestOutOfSync);
+    TEST_RUN(TestRandomStreams);
+    return TestResult();
+}
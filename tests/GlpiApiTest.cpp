@@ -0,0 +1,155 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  GlpiApiTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <string>
+#include <string.h>
+#include "framework.h"
+#include "GlpiApi.h"
+#include "Test.h"
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+static std::string JsonString(const std::string& text)
+{
+    std::string str;
+    GlpiAppendJsonString(str, text.data(), text.size());
+    return str;
+}
+
+static BOOL GetString(const std::string& json, const CHAR* szKey, std::string& value, size_t cchValue = 64)
+{
+    std::string buf(cchValue, '\0');
+    if (!GlpiJsonGetString(json.data(), json.size(), szKey, &buf[0], cchValue))
+        return FALSE;
+    value = buf.c_str();
+    return TRUE;
+}
+
+static BOOL GetNumber(const std::string& json, const CHAR* szKey, DWORD* pdwValue)
+{
+    return GlpiJsonGetNumber(json.data(), json.size(), szKey, pdwValue);
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+static VOID TestJsonString()
+{
+    TEST_CHECK(JsonString("") == "\"\"");
+    TEST_CHECK(JsonString("a \"b\" \\c") == "\"a \\\"b\\\" \\\\c\"");
+    TEST_CHECK(JsonString("1\n2\r\t3") == "\"1\\n2\\r\\t3\"");
+    TEST_CHECK(JsonString(std::string("\x01\x1F\0", 3)) == "\"\\u0001\\u001f\\u0000\"");
+
+    // Valid UTF-8 is kept, invalid bytes are replaced
+    TEST_CHECK(JsonString("\xC3\xA9t\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80") == "\"\xC3\xA9t\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80\"");
+    TEST_CHECK(JsonString("\xE9t\xE9") == "\"\\ufffdt\\ufffd\"");
+    TEST_CHECK(JsonString("\xC0\xAF") == "\"\\ufffd\\ufffd\"");             // Overlong
+    TEST_CHECK(JsonString("\xED\xA0\x80") == "\"\\ufffd\\ufffd\\ufffd\"");  // Surrogate
+    TEST_CHECK(JsonString("\xF4\x90\x80\x80") == "\"\\ufffd\\ufffd\\ufffd\\ufffd\"");
+    TEST_CHECK(JsonString("a\xE2\x82") == "\"a\\ufffd\\ufffd\"");           // Truncated
+}
+
+static VOID TestRequests()
+{
+    const CHAR* szText = "<b>\"a\" & b</b>\r\n";
+    std::string html;
+    GlpiAppendHtml(html, szText, strlen(szText));
+    TEST_CHECK(html == "&lt;b&gt;&quot;a&quot; &amp; b&lt;/b&gt;\n");
+
+    TEST_CHECK(GlpiTicketInput("Printer \"B\"", "line 1\nline 2") ==
+        "{\"input\":{\"name\":\"Printer \\\"B\\\"\",\"content\":\"line 1\\nline 2\"}}");
+    TEST_CHECK(GlpiDocumentManifest("shot.png", 42) ==
+        "{\"input\":{\"name\":\"shot.png\",\"_filename\":[\"shot.png\"],\"itemtype\":\"Ticket\",\"items_id\":42}}");
+
+    std::string head, tail;
+    GlpiMultipart("XyZ", "{}", "shot.png", "image/png", head, tail);
+    TEST_CHECK(head ==
+        "--XyZ\r\nContent-Disposition: form-data; name=\"uploadManifest\"\r\nContent-Type: application/json\r\n\r\n{}\r\n"
+        "--XyZ\r\nContent-Disposition: form-data; name=\"filename[0]\"; filename=\"shot.png\"\r\nContent-Type: image/png\r\n\r\n");
+    TEST_CHECK(tail == "\r\n--XyZ--\r\n");
+}
+
+static VOID TestJsonGetString()
+{
+    std::string value;
+    TEST_CHECK(GetString("{\"session_token\":\"83af7e620c83a50a18d3eac2f6ed05a3ca0bea62\"}", "session_token", value));
+    TEST_CHECK(value == "83af7e620c83a50a18d3eac2f6ed05a3ca0bea62");
+    TEST_CHECK(GetString("{ \"a\" : \"x\\\"y\\\\z\\n\" }", "a", value));
+    TEST_CHECK(value == "x\"y\\zn");
+    TEST_CHECK(GetString("{\"a\":\"\"}", "a", value) && value.empty());
+
+    // Keys are matched whole, and only as keys
+    TEST_CHECK(GetString("{\"xa\":\"1\",\"b\":\"a\",\"a\":\"2\"}", "a", value) && value == "2");
+    TEST_CHECK(!GetString("{\"b\":\"a\"}", "a", value));
+
+    // Not a string, unterminated, too long
+    TEST_CHECK(!GetString("{\"a\":1}", "a", value));
+    TEST_CHECK(!GetString("{\"a\":\"abc", "a", value));
+    TEST_CHECK(!GetString("{\"a\":", "a", value));
+    TEST_CHECK(!GetString("{\"a\":\"abcd\"}", "a", value, 4));
+    TEST_CHECK(GetString("{\"a\":\"abc\"}", "a", value, 4) && value == "abc");
+}
+
+static VOID TestJsonGetNumber()
+{
+    DWORD dwValue = 0;
+    TEST_CHECK(GetNumber("{\"id\":15,\"message\":\"Item successfully added\"}", "id", &dwValue) && dwValue == 15);
+    TEST_CHECK(GetNumber("{\"id\" : \"4294967295\"}", "id", &dwValue) && dwValue == 4294967295UL);
+    TEST_CHECK(!GetNumber("{\"id\":4294967296}", "id", &dwValue));
+    TEST_CHECK(!GetNumber("{\"id\":-1}", "id", &dwValue));
+    TEST_CHECK(!GetNumber("{\"id\":null}", "id", &dwValue));
+    TEST_CHECK(!GetNumber("{\"id\":", "id", &dwValue));
+    TEST_CHECK(!GetNumber("{\"ids\":1}", "id", &dwValue));
+
+    // Truncated responses aren't read past their end
+    std::string json = "{\"id\":12345}";
+    TEST_CHECK(GlpiJsonGetNumber(json.data(), 9, "id", &dwValue) && dwValue == 123);
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestJsonString);
+    TEST_RUN(TestRequests);
+    TEST_RUN(TestJsonGetString);
+    TEST_RUN(TestJsonGetNumber);
+    return TestResult();
+}
@@ -0,0 +1,179 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  HandoffTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <thread>
+#include "framework.h"
+#include "Handoff.h"
+#include "Test.h"
+#include "TestStream.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+static_assert(sizeof(HandoffRequest) == 16 && sizeof(HandoffReply) == 8, "Handoff messages layout");
+
+// Requests run by the test handler
+static int nHandled = 0;
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+static DWORD TestHandler(const HandoffRequest* pReq, PVOID pvContext)
+{
+    TEST_CHECK(pvContext == &nHandled);
+    nHandled++;
+    return pReq->wCommand * 1000 + pReq->dwArg;
+}
+
+// Serves one request of a client, returns the HandoffCall result
+static int CallServed(const HandoffRequest* pReq, DWORD* pdwResult, BOOL* pbServed)
+{
+    TestPipe pipe;
+    std::thread server([&] {
+        *pbServed = HandoffServe(&pipe.server, TestHandler, &nHandled);
+        pipe.server.Close();
+    });
+    int nSent = HandoffCall(&pipe.client, pReq, pdwResult);
+    server.join();
+    return nSent;
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+static VOID TestCommandLine()
+{
+    HandoffRequest req;
+    TEST_CHECK(!HandoffParseCommandLine(L"", &req));
+    TEST_CHECK(req.dwMagic == HANDOFF_MAGIC && req.wVersion == HANDOFF_VERSION && req.wCommand == HANDOFF_CMD_SHOW);
+    TEST_CHECK(HandoffParseCommandLine(L"/startSvc", &req));
+    TEST_CHECK(req.wCommand == HANDOFF_CMD_SERVICE && req.dwArg == HANDOFF_SVC_START && req.dwReserved == 0);
+    TEST_CHECK(HandoffParseCommandLine(L"/stopSvc", &req) && req.dwArg == HANDOFF_SVC_STOP);
+    TEST_CHECK(HandoffParseCommandLine(L"/headless /continueSvc", &req) && req.dwArg == HANDOFF_SVC_CONTINUE);
+    TEST_CHECK(HandoffParseCommandLine(L"/forceInventory", &req) && req.wCommand == HANDOFF_CMD_FORCEINV);
+    TEST_CHECK(!HandoffParseCommandLine(L"/headless", &req) && req.wCommand == HANDOFF_CMD_SHOW);
+}
+
+static VOID TestCall()
+{
+    HandoffRequest req;
+    HandoffInitRequest(&req, HANDOFF_CMD_SERVICE, HANDOFF_SVC_STOP);
+    DWORD dwResult = 0;
+    BOOL bServed = FALSE;
+    nHandled = 0;
+    TEST_CHECK(CallServed(&req, &dwResult, &bServed) == HANDOFF_REPLIED);
+    TEST_CHECK(bServed && nHandled == 1);
+    TEST_CHECK(dwResult == HANDOFF_CMD_SERVICE * 1000 + HANDOFF_SVC_STOP);
+}
+
+// Requests of another version, unknown commands and reserved fields set are
+// answered without being run
+static VOID TestUnsupported()
+{
+    HandoffRequest reqs[4];
+    for (HandoffRequest& req : reqs)
+        HandoffInitRequest(&req, HANDOFF_CMD_SHOW, 0);
+    reqs[0].wVersion = HANDOFF_VERSION + 1;
+    reqs[1].wCommand = 0;
+    reqs[2].wCommand = HANDOFF_CMD_MAX + 1;
+    reqs[3].dwReserved = 1;
+
+    nHandled = 0;
+    for (const HandoffRequest& req : reqs) {
+        DWORD dwResult = 0;
+        BOOL bServed = FALSE;
+        TEST_CHECK(CallServed(&req, &dwResult, &bServed) == HANDOFF_REPLIED);
+        TEST_CHECK(bServed && dwResult == ERROR_NOT_SUPPORTED);
+    }
+    TEST_CHECK(nHandled == 0);
+}
+
+// Anything but a request is dropped without reply
+static VOID TestDropped()
+{
+    HandoffRequest req;
+    HandoffInitRequest(&req, HANDOFF_CMD_SHOW, 0);
+    req.dwMagic = 0x12345678;
+    DWORD dwResult = 0;
+    BOOL bServed = TRUE;
+    nHandled = 0;
+    TEST_CHECK(CallServed(&req, &dwResult, &bServed) == HANDOFF_NO_REPLY);
+    TEST_CHECK(!bServed && nHandled == 0);
+
+    // Torn request
+    TestPipe pipe;
+    HandoffInitRequest(&req, HANDOFF_CMD_SHOW, 0);
+    TEST_CHECK(pipe.client.Write(&req, sizeof(req) - 1));
+    pipe.client.Shutdown();
+    TEST_CHECK(!HandoffServe(&pipe.server, TestHandler, &nHandled));
+    TEST_CHECK(nHandled == 0);
+}
+
+// A request that can't be written isn't run, one whose reply is lost may be
+static VOID TestDelivery()
+{
+    HandoffRequest req;
+    HandoffInitRequest(&req, HANDOFF_CMD_FORCEINV, 0);
+    DWORD dwResult = 0;
+
+    TestPipe closed;
+    closed.server.Close();
+    TEST_CHECK(HandoffCall(&closed.client, &req, &dwResult) == HANDOFF_NOT_SENT);
+
+    TestPipe pipe;
+    std::thread server([&] {
+        HandoffRequest received;
+        TEST_CHECK(pipe.server.Read(&received, sizeof(received)));
+        pipe.server.Close();
+    });
+    TEST_CHECK(HandoffCall(&pipe.client, &req, &dwResult) == HANDOFF_NO_REPLY);
+    server.join();
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestCommandLine);
+    TEST_RUN(TestCall);
+    TEST_RUN(TestUnsupported);
+    TEST_RUN(TestDropped);
+    TEST_RUN(TestDelivery);
+    return TestResult();
+}
@@ -0,0 +1,217 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  HeadlessTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <shellapi.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "framework.h"
+#include "resource.h"
+#include "AgentClient.h"
+#include "MonitorSnapshot.h"
+#include "SpscChannel.h"
+#include "Test.h"
+#include "TestAgent.h"
+
+using namespace std;
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+#define TEST_WND                ((HWND)1)
+#define WMAPP_TEST_RESPONSE     (WM_APP + 1)
+
+// Longest wait for a response (ms)
+#define RESPONSE_TIMEOUT        5000
+
+// Time of the lines written
+static const SYSTEMTIME stTest = { 2025, 3, 0, 9, 14, 5, 7, 42 };
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+static LPCWSTR TestGetString(UINT uId)
+{
+    switch (uId)
+    {
+        case IDS_ERR_NOTRESPONDING:
+            return L"Not responding";
+        case IDS_ERR_MAINWINDOW:
+            return L"No window";
+        default:
+            return L"";
+    }
+}
+
+// Returns the lines written to the output, without their ending
+static vector<string> SplitLines(const string& strOut)
+{
+    vector<string> lines;
+    size_t nStart = 0, nEnd;
+    while ((nEnd = strOut.find('\n', nStart)) != string::npos) {
+        lines.push_back(strOut.substr(nStart, nEnd - nStart));
+        nStart = nEnd + 1;
+    }
+    TEST_CHECK(nStart == strOut.size());
+    return lines;
+}
+
+// Polls the local Agent once and applies its status to a snapshot, as the
+// probe worker does
+static VOID PollAgent(MonitorSnapshot* pSnapshot)
+{
+    AgentResponse* pResp = NULL;
+    if (AgentClientSend(TEST_WND, WMAPP_TEST_RESPONSE, AGENTREQ_STATUS)) {
+        ULONGLONG ullEnd = GetTickCount64() + RESPONSE_TIMEOUT;
+        MSG msg;
+        while (pResp == NULL && GetTickCount64() < ullEnd) {
+            if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+                pResp = (AgentResponse*)msg.lParam;
+            else
+                Sleep(1);
+        }
+    }
+    TEST_CHECK(pResp != NULL);
+    if (pResp != NULL && pResp->dwError == ERROR_SUCCESS && pResp->dwStatusCode == 200 && pResp->bStatusFound)
+        wcscpy_s(pSnapshot->szAgStatus, pResp->szStatus);
+    else
+        wcscpy_s(pSnapshot->szAgStatus, TestGetString(IDS_ERR_NOTRESPONDING));
+    pSnapshot->dwVersion++;
+    delete pResp;
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+static VOID TestLines()
+{
+    const WCHAR* szPath = L"headless.ndjson";
+    HANDLE hOut = CreateFile(szPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    TEST_CHECK(hOut != INVALID_HANDLE_VALUE);
+    HeadlessStream stream;
+    HeadlessStreamInit(&stream, hOut, TestGetString);
+
+    // An error, then the whole status, then only its changes
+    TEST_CHECK(HeadlessWriteError(&stream, IDS_ERR_MAINWINDOW, 5));
+    MonitorSnapshot snapshot = {};
+    snapshot.dwVersion = 1;
+    MonitorSnapshotSetService(&snapshot, TRUE, SERVICE_RUNNING);
+    wcscpy_s(snapshot.szAgStatus, L"waiting");
+    TEST_CHECK(HeadlessWriteSnapshot(&stream, &snapshot, &stTest));
+    snapshot.dwVersion = 2;
+    wcscpy_s(snapshot.szAgStatus, L"running task Inventory");
+    TEST_CHECK(HeadlessWriteSnapshot(&stream, &snapshot, &stTest));
+    CloseHandle(hOut);
+
+    vector<string> lines = SplitLines(TestReadFile("headless.ndjson"));
+    TEST_CHECK(lines.size() == 3);
+    if (lines.size() == 3) {
+        TEST_CHECK(lines[0] == "{\"error\":\"No window\",\"code\":5}");
+        TEST_CHECK(lines[1].find("{\"seq\":1,\"time\":\"2025-03-09T14:05:07.042Z\",\"changed\":255,") == 0);
+        TEST_CHECK(lines[1].find("\"service\":\"running\",\"agentOk\":true,\"agentStatus\":\"waiting\"") != string::npos);
+        TEST_CHECK(lines[2].find("{\"seq\":2,\"time\":\"2025-03-09T14:05:07.042Z\",\"changed\":4,") == 0);
+        TEST_CHECK(lines[2].find("\"agentStatus\":\"running task Inventory\"") != string::npos);
+    }
+    DeleteFile(szPath);
+}
+
+static VOID TestStandInAgent()
+{
+    // The output is a pipe, as when the fleet tooling reads it. A closed pipe
+    // must fail the write rather than end the process.
+    signal(SIGPIPE, SIG_IGN);
+    int fds[2];
+    TEST_CHECK(pipe(fds) == 0);
+    HANDLE hOut = new CompatHandle{ fds[1] };
+    HeadlessStream stream;
+    HeadlessStreamInit(&stream, hOut, TestGetString);
+
+    TestAgentHttpd agent;
+    TEST_CHECK(agent.Start());
+    AgentClientInit(new TestSocketTransport());
+    AgentClientSetPort(agent.GetPort());
+
+    // Snapshots published through the channel by the probes, then written in order
+    SpscChannel<MonitorSnapshot, 16> channel;
+    MonitorSnapshot snapshot = {};
+    MonitorSnapshotSetService(&snapshot, TRUE, SERVICE_RUNNING);
+    agent.SetStatus("status: waiting\n");
+    PollAgent(&snapshot);
+    TEST_CHECK(channel.Push(snapshot));
+    agent.SetStatus("status: running task Inventory\n");
+    PollAgent(&snapshot);
+    TEST_CHECK(channel.Push(snapshot));
+    agent.Stop();
+    PollAgent(&snapshot);
+    TEST_CHECK(channel.Push(snapshot));
+
+    MonitorSnapshot published;
+    while (channel.Pop(&published))
+        TEST_CHECK(HeadlessWriteSnapshot(&stream, &published, &stTest));
+
+    string strOut;
+    CHAR buf[4096];
+    ssize_t cbRead;
+    while (count(strOut.begin(), strOut.end(), '\n') < 3 && (cbRead = read(fds[0], buf, sizeof(buf))) > 0)
+        strOut.append(buf, (size_t)cbRead);
+    vector<string> lines = SplitLines(strOut);
+    TEST_CHECK(lines.size() == 3);
+    if (lines.size() == 3) {
+        TEST_CHECK(lines[0].find("\"changed\":255,") != string::npos && lines[0].find("\"agentStatus\":\"waiting\"") != string::npos);
+        TEST_CHECK(lines[1].find("\"changed\":4,") != string::npos && lines[1].find("\"agentStatus\":\"running task Inventory\"") != string::npos);
+        TEST_CHECK(lines[2].find("\"changed\":4,") != string::npos && lines[2].find("\"agentStatus\":\"Not responding\"") != string::npos);
+    }
+
+    // Nobody reads anymore
+    close(fds[0]);
+    TEST_CHECK(!HeadlessWriteSnapshot(&stream, &snapshot, &stTest));
+    AgentClientClose();
+    CloseHandle(hOut);
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestLines);
+    TEST_RUN(TestStandInAgent);
+    return TestResult();
+}
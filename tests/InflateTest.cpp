@@ -0,0 +1,168 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  InflateTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <string>
+#include "framework.h"
+#include "Inflate.h"
+#include "Test.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// Test data (tests/data):
+// - members.gz: 60 gzip -9 members of a few log lines each, concatenated
+// - flushed.gz: 79 members of 4 parts each, separated by full flushes (empty
+//   stored blocks right after Huffman coded ones)
+// Small dynamic blocks end with short codes, which leave whole bytes in the
+// bit buffer before the stored blocks and the members trailers.
+#define MEMBERS_SIZE            30225
+#define MEMBERS_CRC             0xD901C686
+#define FLUSHED_SIZE            70518
+#define FLUSHED_CRC             0x159020AA
+
+// Output collected by the callback
+struct InflateSink {
+    std::string data;
+    size_t cbAbortAfter;        // Aborts once that much was output (0 = never)
+};
+
+static BOOL CollectOutput(PVOID pContext, const BYTE* pData, size_t cbData)
+{
+    InflateSink* pSink = (InflateSink*)pContext;
+    pSink->data.append((const char*)pData, cbData);
+    return (pSink->cbAbortAfter == 0 || pSink->data.size() < pSink->cbAbortAfter);
+}
+
+static int InflateString(const std::string& in, size_t cbOut, InflateSink* pSink)
+{
+    std::string out(cbOut, '\0');
+    return GzipInflate((const BYTE*)in.data(), in.size(), (BYTE*)&out[0], cbOut, CollectOutput, pSink);
+}
+
+static DWORD Crc32(const std::string& data)
+{
+    return Crc32Update(0, (const BYTE*)data.data(), data.size());
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+static VOID TestCrc32()
+{
+    TEST_CHECK(Crc32(std::string("123456789")) == 0xCBF43926);
+    TEST_CHECK(Crc32(std::string()) == 0);
+    DWORD dwCrc = Crc32Update(0, (const BYTE*)"1234", 4);
+    TEST_CHECK(Crc32Update(dwCrc, (const BYTE*)"56789", 5) == 0xCBF43926);
+}
+
+// Multi-member stream, through output buffers of different sizes
+static VOID TestMembers()
+{
+    std::string in = TestReadData("members.gz");
+    TEST_CHECK(!in.empty());
+    for (size_t cbOut : { (size_t)1, (size_t)100, (size_t)INFLATE_WINDOW_SIZE })
+    {
+        InflateSink sink = {};
+        TEST_CHECK(InflateString(in, cbOut, &sink) == INFLATE_OK);
+        TEST_CHECK(sink.data.size() == MEMBERS_SIZE);
+        TEST_CHECK(Crc32(sink.data) == MEMBERS_CRC);
+    }
+}
+
+// Stored blocks following Huffman coded ones
+static VOID TestStoredAfterHuffman()
+{
+    std::string in = TestReadData("flushed.gz");
+    TEST_CHECK(!in.empty());
+    InflateSink sink = {};
+    TEST_CHECK(InflateString(in, 4096, &sink) == INFLATE_OK);
+    TEST_CHECK(sink.data.size() == FLUSHED_SIZE);
+    TEST_CHECK(Crc32(sink.data) == FLUSHED_CRC);
+}
+
+// Padding after the last member is ignored
+static VOID TestPadding()
+{
+    std::string in = TestReadData("members.gz") + std::string(16, '\0');
+    InflateSink sink = {};
+    TEST_CHECK(InflateString(in, 4096, &sink) == INFLATE_OK);
+    TEST_CHECK(sink.data.size() == MEMBERS_SIZE);
+}
+
+static VOID TestBadData()
+{
+    std::string in = TestReadData("members.gz");
+    for (size_t cbCut : { (size_t)1, (size_t)4, (size_t)8, in.size() / 2, in.size() - 11 })
+    {
+        InflateSink sink = {};
+        TEST_CHECK(InflateString(in.substr(0, in.size() - cbCut), 4096, &sink) != INFLATE_OK);
+    }
+
+    InflateSink sink = {};
+    TEST_CHECK(InflateString(std::string("not gzip data"), 4096, &sink) == INFLATE_BAD_DATA);
+
+    // Last member CRC
+    std::string bad = in;
+    bad[bad.size() - 8] ^= 0x01;
+    sink = {};
+    TEST_CHECK(InflateString(bad, 4096, &sink) == INFLATE_BAD_CHECKSUM);
+    TEST_CHECK(sink.data.size() == MEMBERS_SIZE);
+}
+
+static VOID TestAbort()
+{
+    InflateSink sink = {};
+    sink.cbAbortAfter = 1000;
+    TEST_CHECK(InflateString(TestReadData("members.gz"), 100, &sink) == INFLATE_ABORTED);
+    // The output is also flushed at the end of each member
+    TEST_CHECK(sink.data.size() >= 1000 && sink.data.size() < 1100);
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestCrc32);
+    TEST_RUN(TestMembers);
+    TEST_RUN(TestStoredAfterHuffman);
+    TEST_RUN(TestPadding);
+    TEST_RUN(TestBadData);
+    TEST_RUN(TestAbort);
+    return TestResult();
+}
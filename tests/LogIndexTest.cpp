@@ -0,0 +1,273 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  LogIndexTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include "framework.h"
+#include "LogIndex.h"
+#include "Test.h"
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+static BYTE ParseLine(const CHAR* szLine, ULONGLONG* pullTime)
+{
+    return LogParseLine(szLine, strlen(szLine), pullTime);
+}
+
+// Log of dwLines lines, one second apart, whose severities cycle through
+// error, warning, info, debug, debug2 and a continuation line
+static std::string MakeLog(DWORD dwLines, DWORD dwFirstLine = 0)
+{
+    static const CHAR* levels[] = { "[error] ", "[warning] ", "[info] ", "[debug] ", "[debug2] ", "" };
+    std::string log;
+    CHAR szLine[128];
+    for (DWORD i = dwFirstLine; i < dwFirstLine + dwLines; i++) {
+        if (i % 6 == 5)
+            snprintf(szLine, sizeof(szLine), "  continuation of line %u\n", (unsigned)(i - 1));
+        else
+            snprintf(szLine, sizeof(szLine), "[Thu Mar  7 %02u:%02u:%02u 2024]%sline %u%.*s\n",
+                (unsigned)(i / 3600 % 24), (unsigned)(i / 60 % 60), (unsigned)(i % 60), levels[i % 6], (unsigned)i, (int)(i % 17), "................");
+        log += szLine;
+    }
+    return log;
+}
+
+// Feeds a log by chunks of up to cbChunk bytes from the last line indexed, as
+// the file is read (a full chunk without a line break is indexed as a line)
+static VOID FeedLog(LogIndex* pIndex, const std::string& log, size_t cbChunk)
+{
+    size_t iOffset = (size_t)pIndex->ullIndexed;
+    while (iOffset < log.size()) {
+        size_t cbData = log.size() - iOffset;
+        if (cbData > cbChunk)
+            cbData = cbChunk;
+        size_t cbIndexed = LogIndexFeed(pIndex, log.data() + iOffset, cbData, FALSE);
+        if (cbIndexed == 0 && cbData == cbChunk)
+            cbIndexed = LogIndexFeed(pIndex, log.data() + iOffset, cbData, TRUE);
+        else if (cbIndexed == 0)
+            break;
+        iOffset += cbIndexed;
+    }
+}
+
+// Checks the line ranges against the line breaks of the log
+static BOOL CheckLines(const LogIndex* pIndex, const std::string& log)
+{
+    ULONGLONG ullStart, ullEnd, ullExpected = 0;
+    BYTE bSeverity;
+    for (DWORD i = 0; i < pIndex->dwLines; i++) {
+        if (!LogIndexGetLine(pIndex, i, &ullStart, &ullEnd, &bSeverity) || ullStart != ullExpected || ullEnd <= ullStart ||
+            log[(size_t)ullEnd - 1] != '\n' || log.find('\n', (size_t)ullStart) != (size_t)ullEnd - 1)
+            return FALSE;
+        ullExpected = ullEnd;
+    }
+    return (ullExpected == pIndex->ullIndexed && !LogIndexGetLine(pIndex, pIndex->dwLines, &ullStart, &ullEnd, &bSeverity));
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+static VOID TestParseLine()
+{
+    ULONGLONG ullTime;
+    TEST_CHECK(ParseLine("[Thu Mar  7 10:00:00 2024][error] x", &ullTime) == LOGSEV_ERROR);
+    TEST_CHECK(ullTime == LogMakeTime(2024, 3, 7, 10, 0, 0));
+    TEST_CHECK(ParseLine("[Sun Dec 31 23:59:59 2023][warning] x", &ullTime) == LOGSEV_WARNING);
+    TEST_CHECK(ullTime == LogMakeTime(2023, 12, 31, 23, 59, 59));
+    TEST_CHECK(ParseLine("[Thu Feb 29 00:00:00 2024][info] x", &ullTime) == LOGSEV_INFO);
+    TEST_CHECK(ullTime + 86400 == LogMakeTime(2024, 3, 1, 0, 0, 0));
+    TEST_CHECK(ParseLine("[Thu Mar  7 10:00:00 2024][debug] x", &ullTime) == LOGSEV_DEBUG);
+    TEST_CHECK(ParseLine("[Thu Mar  7 10:00:00 2024][debug2] x", &ullTime) == LOGSEV_DEBUG2);
+    TEST_CHECK(ParseLine("[Thu Mar  7 10:00:00 2024][debug3] x", &ullTime) == LOGSEV_DEBUG2);
+
+    // Level without a time, and lines without a level
+    TEST_CHECK(ParseLine("[info] x", &ullTime) == LOGSEV_INFO && ullTime == 0);
+    TEST_CHECK(ParseLine("[Thu Mar  7 10:00:00 2024] x", &ullTime) == LOGSEV_NONE && ullTime != 0);
+    TEST_CHECK(ParseLine("[Thu Mar  7 10:00:00 2024][errors] x", &ullTime) == LOGSEV_NONE);
+    TEST_CHECK(ParseLine("[Thu Xyz  7 10:00:00 2024][error] x", &ullTime) == LOGSEV_NONE && ullTime == 0);
+    TEST_CHECK(ParseLine("  continuation", &ullTime) == LOGSEV_NONE && ullTime == 0);
+    TEST_CHECK(ParseLine("", &ullTime) == LOGSEV_NONE);
+}
+
+static VOID TestMakeTime()
+{
+    TEST_CHECK(LogMakeTime(2024, 3, 1, 0, 0, 0) - LogMakeTime(2024, 2, 28, 0, 0, 0) == 2 * 86400);
+    TEST_CHECK(LogMakeTime(2023, 3, 1, 0, 0, 0) - LogMakeTime(2023, 2, 28, 0, 0, 0) == 86400);
+    TEST_CHECK(LogMakeTime(2024, 1, 1, 0, 0, 0) - LogMakeTime(2023, 12, 31, 23, 59, 59) == 1);
+    TEST_CHECK(LogMakeTime(2001, 1, 1, 0, 0, 0) - LogMakeTime(2000, 1, 1, 0, 0, 0) == 366 * 86400);
+}
+
+// The index is the same whatever the chunks it's fed with (as long as they can
+// hold a line)
+static VOID TestFeed()
+{
+    std::string log = MakeLog(1000);
+    LogIndex whole;
+    LogIndexInit(&whole);
+    TEST_CHECK(LogIndexFeed(&whole, log.data(), log.size(), FALSE) == log.size());
+    TEST_CHECK(whole.dwLines == 1000);
+    TEST_CHECK(CheckLines(&whole, log));
+
+    for (size_t cbChunk : { (size_t)80, (size_t)101, (size_t)4096 }) {
+        LogIndex index;
+        LogIndexInit(&index);
+        FeedLog(&index, log, cbChunk);
+        TEST_CHECK(index.dwLines == whole.dwLines && index.ullIndexed == whole.ullIndexed);
+        TEST_CHECK(CheckLines(&index, log));
+        TEST_CHECK(index.timeMarks.size() == whole.timeMarks.size());
+        LogIndexFree(&index);
+    }
+    LogIndexFree(&whole);
+
+    // Lines longer than a chunk are split
+    LogIndex index;
+    LogIndexInit(&index);
+    FeedLog(&index, log, 7);
+    TEST_CHECK(index.dwLines > 1000 && index.ullIndexed == log.size());
+    LogIndexFree(&index);
+}
+
+// A last incomplete line is left, unless it's ended by the caller
+static VOID TestIncompleteLine()
+{
+    std::string log = "[info] a\n[error] b\npartial";
+    LogIndex index;
+    LogIndexInit(&index);
+    TEST_CHECK(LogIndexFeed(&index, log.data(), log.size(), FALSE) == log.size() - 7);
+    TEST_CHECK(index.dwLines == 2);
+    TEST_CHECK(LogIndexFeed(&index, log.data() + index.ullIndexed, 7, TRUE) == 7);
+    TEST_CHECK(index.dwLines == 3 && index.ullIndexed == log.size());
+
+    ULONGLONG ullStart, ullEnd;
+    BYTE bSeverity;
+    TEST_CHECK(LogIndexGetLine(&index, 2, &ullStart, &ullEnd, &bSeverity));
+    TEST_CHECK(ullStart == log.size() - 7 && ullEnd == log.size());
+    TEST_CHECK(bSeverity == LOGSEV_ERROR);   // Continuation of the previous line
+    LogIndexFree(&index);
+}
+
+// Line ranges and severities across blocks
+static VOID TestBlocks()
+{
+    DWORD dwLines = LOGINDEX_BLOCK_LINES * 2 + 10;
+    std::string log = MakeLog(dwLines);
+    LogIndex index;
+    LogIndexInit(&index);
+    FeedLog(&index, log, 65536);
+    TEST_CHECK(index.dwLines == dwLines);
+    TEST_CHECK(index.blocks.size() == 3);
+    TEST_CHECK(CheckLines(&index, log));
+
+    static const BYTE severities[] = { LOGSEV_ERROR, LOGSEV_WARNING, LOGSEV_INFO, LOGSEV_DEBUG, LOGSEV_DEBUG2, LOGSEV_DEBUG2 };
+    BOOL bSeverities = TRUE;
+    for (DWORD i = 0; i < dwLines; i++) {
+        ULONGLONG ullStart, ullEnd;
+        BYTE bSeverity;
+        LogIndexGetLine(&index, i, &ullStart, &ullEnd, &bSeverity);
+        bSeverities = bSeverities && (bSeverity == severities[i % 6]);
+    }
+    TEST_CHECK(bSeverities);
+    LogIndexFree(&index);
+    TEST_CHECK(index.blocks.empty() && index.dwLines == 0);
+}
+
+static VOID TestFilter()
+{
+    std::string log = MakeLog(600);
+    LogIndex index;
+    LogIndexInit(&index);
+    FeedLog(&index, log.substr(0, log.size() / 2), 4096);
+
+    // Errors and warnings, continued as more lines are indexed
+    LogFilter filter = { LOGSEV_WARNING, 0 };
+    std::vector<DWORD> lines;
+    DWORD dwNext = LogIndexFilter(&index, &filter, 0, lines);
+    TEST_CHECK(dwNext == index.dwLines);
+    FeedLog(&index, log, 4096);
+    TEST_CHECK(LogIndexFilter(&index, &filter, dwNext, lines) == 600);
+    BOOL bLines = (lines.size() == 200);
+    for (size_t i = 0; bLines && i < lines.size(); i++)
+        bLines = (lines[i] == (i / 2) * 6 + (i % 2));
+    TEST_CHECK(bLines);
+
+    // Everything
+    filter.bMaxSeverity = LOGSEV_NONE;
+    lines.clear();
+    TEST_CHECK(LogIndexFilter(&index, &filter, 590, lines) == 600 && lines.size() == 10);
+
+    // From a time (line 300 is logged at 00:05:00)
+    filter.ullFromTime = LogMakeTime(2024, 3, 7, 0, 5, 0);
+    lines.clear();
+    LogIndexFilter(&index, &filter, 0, lines);
+    TEST_CHECK(lines.size() == 300 && lines[0] == 300);
+    filter.ullFromTime = LogMakeTime(2024, 3, 8, 0, 0, 0);
+    lines.clear();
+    TEST_CHECK(LogIndexFilter(&index, &filter, 0, lines) == 600 && lines.empty());
+    LogIndexFree(&index);
+}
+
+// After a clock change, only the last run of lines at or after a time counts
+static VOID TestFindTime()
+{
+    std::string log = MakeLog(100, 1000) + MakeLog(100, 0);
+    LogIndex index;
+    LogIndexInit(&index);
+    FeedLog(&index, log, 4096);
+    TEST_CHECK(LogIndexFindTime(&index, LogMakeTime(2024, 3, 7, 0, 0, 50)) == 150);
+    TEST_CHECK(LogIndexFindTime(&index, LogMakeTime(2024, 3, 7, 0, 16, 50)) == 200);
+    TEST_CHECK(LogIndexFindTime(&index, 0) == 0);
+    LogIndexFree(&index);
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestParseLine);
+    TEST_RUN(TestMakeTime);
+    TEST_RUN(TestFeed);
+    TEST_RUN(TestIncompleteLine);
+    TEST_RUN(TestBlocks);
+    TEST_RUN(TestFilter);
+    TEST_RUN(TestFindTime);
+    return TestResult();
+}
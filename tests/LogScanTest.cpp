@@ -0,0 +1,199 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  LogScanTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <string>
+#include <stdio.h>
+#include "framework.h"
+#include "LogScan.h"
+#include "Test.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+#define LOG_PREFIX              "[Thu Mar  7 10:00:00 2024]"
+
+// Two runs: the first inventory logs an error and a warning, then a deploy
+// task logs its own; the second run starts an inventory that logs 2 errors.
+// Markers in the messages and partial task names aren't counted.
+static const CHAR szLog[] =
+    LOG_PREFIX "[info] target server0: server https://glpi/\n"
+    LOG_PREFIX "[info] running task Inventory\n"
+    LOG_PREFIX "[debug] message with [error] and ][warning]in it\n"
+    LOG_PREFIX "[error] [http client] communication error\n"
+    LOG_PREFIX "[warning] something odd\n"
+    LOG_PREFIX "[info] running task Deploy\n"
+    LOG_PREFIX "[error] deploy failure\n"
+    LOG_PREFIX "[info] running task InventoryX\n"
+    LOG_PREFIX "[warning] not an inventory one\n"
+    LOG_PREFIX "[info] target server0: server https://glpi/\n"
+    LOG_PREFIX "[info] running task Inventory\n"
+    LOG_PREFIX "[error] x\n"
+    LOG_PREFIX "[error] y\n";
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Scans a log by chunks of cbChunk bytes (more than LOGSCAN_LOOKAHEAD), each
+// one starting with the bytes left by the previous one
+static LogScanState ScanLog(const std::string& log, size_t cbChunk)
+{
+    LogScanState state = {};
+    size_t iOffset = 0;
+    do {
+        size_t cbData = log.size() - iOffset;
+        BOOL bEnd = (cbData <= cbChunk);
+        if (!bEnd)
+            cbData = cbChunk;
+        iOffset += LogScanFeed(&state, log.data() + iOffset, cbData, bEnd);
+    } while (iOffset < log.size());
+    return state;
+}
+
+static BOOL SameState(const LogScanState* pA, const LogScanState* pB)
+{
+    return (pA->ullScanned == pB->ullScanned && pA->dwErrors == pB->dwErrors && pA->dwWarnings == pB->dwWarnings &&
+        pA->bInventoryFound == pB->bInventoryFound && pA->bInInventory == pB->bInInventory &&
+        pA->ullInventoryStart == pB->ullInventoryStart && pA->dwInventoryErrors == pB->dwInventoryErrors &&
+        pA->dwInventoryWarnings == pB->dwInventoryWarnings);
+}
+
+// Large log, with markers at every alignment
+static std::string MakeLog()
+{
+    static const CHAR* levels[] = { "info", "debug", "debug2", "error", "warning" };
+    std::string log;
+    CHAR szLine[128];
+    for (int i = 0; i < 3000; i++) {
+        if (i % 200 == 0)
+            log += LOG_PREFIX "[info] target server0: server https://glpi/\n";
+        if (i % 200 == 7)
+            log += LOG_PREFIX "[info] running task Inventory\n";
+        if (i % 200 == 150)
+            log += LOG_PREFIX "[info] running task Deploy\n";
+        snprintf(szLine, sizeof(szLine), LOG_PREFIX "[%s] message %d%.*s\n", levels[(i * 7) % 5], i, i % 33, "with [error] ][error]x ]] padding");
+        log += szLine;
+    }
+    return log;
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+static VOID TestMarkers()
+{
+    std::string log(szLog);
+    LogScanState state = {};
+    TEST_CHECK(LogScanFeed(&state, log.data(), log.size(), TRUE) == log.size());
+    TEST_CHECK(state.ullScanned == log.size());
+    TEST_CHECK(state.dwErrors == 4);
+    TEST_CHECK(state.dwWarnings == 2);
+    TEST_CHECK(state.bInventoryFound);
+    TEST_CHECK(state.bInInventory);
+    TEST_CHECK(state.ullInventoryStart == log.rfind("] running task Inventory"));
+    TEST_CHECK(state.dwInventoryErrors == 2);
+    TEST_CHECK(state.dwInventoryWarnings == 0);
+}
+
+// A run start ends the inventory, another task too
+static VOID TestInventoryEnd()
+{
+    std::string log(szLog);
+    log += LOG_PREFIX "[info] target server0: server https://glpi/\n";
+    LogScanState state = ScanLog(log, log.size());
+    TEST_CHECK(state.bInventoryFound && !state.bInInventory);
+    TEST_CHECK(state.dwInventoryErrors == 2);
+
+    log = LOG_PREFIX "[info] running task Inventory\n" LOG_PREFIX "[info] running task Deploy\n" LOG_PREFIX "[error] x\n";
+    state = ScanLog(log, log.size());
+    TEST_CHECK(state.bInventoryFound && !state.bInInventory);
+    TEST_CHECK(state.dwErrors == 1 && state.dwInventoryErrors == 0);
+
+    log = LOG_PREFIX "[info] running task InventoryX\n" LOG_PREFIX "[error] x\n";
+    state = ScanLog(log, log.size());
+    TEST_CHECK(!state.bInventoryFound && state.dwErrors == 1);
+}
+
+// The lookahead is kept until the end of the log
+static VOID TestLookahead()
+{
+    std::string log(szLog);
+    LogScanState state = {};
+    TEST_CHECK(LogScanFeed(&state, log.data(), LOGSCAN_LOOKAHEAD, FALSE) == 0);
+    TEST_CHECK(LogScanFeed(&state, log.data(), log.size(), FALSE) == log.size() - LOGSCAN_LOOKAHEAD);
+    TEST_CHECK(state.dwErrors == 2);     // The last 2 lines are in the lookahead
+    size_t iOffset = (size_t)state.ullScanned;
+    TEST_CHECK(LogScanFeed(&state, log.data() + iOffset, log.size() - iOffset, TRUE) == LOGSCAN_LOOKAHEAD);
+    TEST_CHECK(state.dwErrors == 4);
+}
+
+// Every kernel the CPU supports finds the same markers as the scalar one,
+// whatever the chunks
+static VOID TestKernels()
+{
+    DWORD dwDefault = LogScanGetKernel();
+    std::string log = MakeLog();
+
+    TEST_CHECK(LogScanSetKernel(LOGSCAN_KERNEL_SCALAR));
+    LogScanState expected = ScanLog(log, log.size());
+    TEST_CHECK(expected.dwErrors > 0 && expected.dwWarnings > 0 && expected.bInventoryFound);
+
+    for (DWORD dwKernel = LOGSCAN_KERNEL_SCALAR; dwKernel <= LOGSCAN_KERNEL_AVX2; dwKernel++) {
+        if (!LogScanSetKernel(dwKernel)) {
+            printf("kernel %u not supported\n", (unsigned)dwKernel);
+            continue;
+        }
+        TEST_CHECK(LogScanGetKernel() == dwKernel);
+        for (size_t cbChunk : { (size_t)LOGSCAN_LOOKAHEAD + 1, (size_t)100, (size_t)4097, log.size() }) {
+            LogScanState state = ScanLog(log, cbChunk);
+            TEST_CHECK(SameState(&state, &expected));
+        }
+    }
+    TEST_CHECK(LogScanSetKernel(dwDefault));
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestMarkers);
+    TEST_RUN(TestInventoryEnd);
+    TEST_RUN(TestLookahead);
+    TEST_RUN(TestKernels);
+    return TestResult();
+}
@@ -0,0 +1,165 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  LogStreamTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <stdio.h>
+#include <string>
+#include "framework.h"
+#include "LogStream.h"
+#include "Test.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// Logfile whose segments are written by the tests (in the working directory)
+#define LOGFILE                 "logstream-test.log"
+#define LOGFILE_W               L"logstream-test.log"
+
+// tests/data/members.gz (see InflateTest.cpp)
+#define MEMBERS_SIZE            30225
+#define MEMBERS_CRC             0xD901C686
+
+static VOID RemoveSegments()
+{
+    remove(LOGFILE);
+    for (int n = 1; n <= LOGSTREAM_MAX_SEGMENTS; n++) {
+        char szPath[64];
+        snprintf(szPath, sizeof(szPath), LOGFILE ".%d", n);
+        remove(szPath);
+        snprintf(szPath, sizeof(szPath), LOGFILE ".%d.gz", n);
+        remove(szPath);
+    }
+}
+
+// Reads the current segment to its end, cbBuf bytes at a time
+static std::string ReadSegment(LogStream* pStream, size_t cbBuf)
+{
+    std::string data;
+    std::string buf(cbBuf, '\0');
+    size_t cbRead;
+    while ((cbRead = LogStreamRead(pStream, &buf[0], cbBuf)) > 0)
+        data.append(buf, 0, cbRead);
+    return data;
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+// Segments are read oldest first, one at a time, with the result of their
+// decompression
+static VOID TestSegments()
+{
+    RemoveSegments();
+    std::string members = TestReadData("members.gz");
+    std::string corrupt = members;
+    corrupt[corrupt.size() - 8] ^= 0x01;
+    TEST_CHECK(TestWriteFile(LOGFILE ".4.gz", members));
+    TEST_CHECK(TestWriteFile(LOGFILE ".3", "line 1\nline 2"));
+    TEST_CHECK(TestWriteFile(LOGFILE ".2.gz", corrupt));
+    TEST_CHECK(TestWriteFile(LOGFILE ".1", ""));
+    TEST_CHECK(TestWriteFile(LOGFILE, "active\n"));
+
+    for (size_t cbBuf : { (size_t)7, (size_t)LOGSTREAM_BLOCK_SIZE })
+    {
+        LogStream* pStream = LogStreamOpen(LOGFILE_W, TRUE);
+        TEST_CHECK(pStream->segments.size() == 5);
+        int nRes = -1;
+
+        std::string data = ReadSegment(pStream, cbBuf);
+        TEST_CHECK(data.size() == MEMBERS_SIZE);
+        TEST_CHECK(Crc32Update(0, (const BYTE*)data.data(), data.size()) == MEMBERS_CRC);
+        TEST_CHECK(LogStreamNextSegment(pStream, &nRes) && nRes == INFLATE_OK);
+
+        // A line break ends the segments
+        TEST_CHECK(ReadSegment(pStream, cbBuf) == "line 1\nline 2\n");
+        TEST_CHECK(LogStreamNextSegment(pStream, &nRes) && nRes == INFLATE_OK);
+
+        // The data read from a segment that fails to decompress is reported
+        data = ReadSegment(pStream, cbBuf);
+        TEST_CHECK(data.size() <= MEMBERS_SIZE);
+        TEST_CHECK(LogStreamNextSegment(pStream, &nRes) && nRes == INFLATE_BAD_CHECKSUM);
+
+        TEST_CHECK(ReadSegment(pStream, cbBuf).empty());
+        TEST_CHECK(LogStreamNextSegment(pStream, &nRes) && nRes == INFLATE_OK);
+        TEST_CHECK(ReadSegment(pStream, cbBuf) == "active\n");
+        TEST_CHECK(!LogStreamNextSegment(pStream, &nRes) && nRes == INFLATE_OK);
+
+        // Nothing is left
+        CHAR buf[16];
+        TEST_CHECK(LogStreamRead(pStream, buf, sizeof(buf)) == 0);
+        TEST_CHECK(!LogStreamNextSegment(pStream, &nRes));
+        LogStreamClose(pStream);
+    }
+    RemoveSegments();
+}
+
+// Compressed segments can be skipped (or closed) before being read
+static VOID TestSkipSegments()
+{
+    RemoveSegments();
+    std::string members = TestReadData("members.gz");
+    TEST_CHECK(TestWriteFile(LOGFILE ".3.gz", members));
+    TEST_CHECK(TestWriteFile(LOGFILE ".2.gz", members));
+    TEST_CHECK(TestWriteFile(LOGFILE ".1.gz", members));
+
+    LogStream* pStream = LogStreamOpen(LOGFILE_W, FALSE);
+    TEST_CHECK(pStream->segments.size() == 3);
+    int nRes;
+    TEST_CHECK(LogStreamNextSegment(pStream, &nRes));
+    TEST_CHECK(nRes == INFLATE_OK || nRes == INFLATE_ABORTED);
+    TEST_CHECK(ReadSegment(pStream, 4096).size() == MEMBERS_SIZE);
+    LogStreamClose(pStream);
+
+    // Without the active logfile or any segment
+    RemoveSegments();
+    pStream = LogStreamOpen(LOGFILE_W, FALSE);
+    TEST_CHECK(pStream->segments.empty());
+    CHAR buf[16];
+    TEST_CHECK(LogStreamRead(pStream, buf, sizeof(buf)) == 0);
+    TEST_CHECK(!LogStreamNextSegment(pStream, &nRes) && nRes == INFLATE_OK);
+    LogStreamClose(pStream);
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestSegments);
+    TEST_RUN(TestSkipSegments);
+    return TestResult();
+}
@@ -0,0 +1,211 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  MetricsTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <chrono>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "framework.h"
+#include "Metrics.h"
+#include "Test.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// Threads and values per thread of the concurrent recording test
+#define CONCURRENT_THREADS      4
+#define CONCURRENT_VALUES       100000
+
+// Overhead measurement: timed recordings, and the largest cost accepted per
+// recording (ns, well above the expected tens of ns, for the slow builds)
+#define OVERHEAD_PROBES         2000000
+#define OVERHEAD_MAX_NS         1000
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Returns the value of a sample of the exposition, by its name and labels
+// (-1 if it's not found)
+static double MetricValue(const std::string& strMetrics, const std::string& strSample)
+{
+    std::string strLine = "\n" + strSample + " ";
+    size_t nPos = strMetrics.find(strLine);
+    if (nPos == std::string::npos)
+        return -1;
+    return atof(strMetrics.c_str() + nPos + strLine.size());
+}
+
+static std::string FormatMetrics()
+{
+    std::string strMetrics;
+    MetricsFormat(strMetrics);
+    return strMetrics;
+}
+
+// Times a recording run by each of the given threads, and returns its cost
+// (ns). The probe includes its two clock reads, whose cost depends on the
+// platform (QueryPerformanceCounter on Windows, clock_gettime here).
+static double RecordingOverhead(int nThreads, BOOL bProbe)
+{
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([bProbe] {
+            for (int j = 0; j < OVERHEAD_PROBES; j++) {
+                if (bProbe)
+                    MetricsObserveSince(HIST_AGENT_NOW, MetricsNow());
+                else
+                    MetricsObserve(HIST_AGENT_NOW, (ULONGLONG)(j & 1023));
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / OVERHEAD_PROBES;
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+static VOID TestHistogram()
+{
+    const ULONGLONG ullValues[] = { 0, 1, 2, 3, 4, 5, 1000000, 1ULL << 40 };
+    for (ULONGLONG ullUs : ullValues)
+        MetricsObserve(HIST_SERVICE_QUERY, ullUs);
+
+    // Cumulative buckets, each up to 2^i us, the last one being +Inf
+    std::string strMetrics = FormatMetrics();
+    std::string strSample = "glpi_agentmonitor_probe_duration_seconds";
+    std::string strProbe = "probe=\"service_query\"";
+    TEST_CHECK(MetricValue(strMetrics, strSample + "_bucket{" + strProbe + ",le=\"1e-06\"}") == 2);
+    TEST_CHECK(MetricValue(strMetrics, strSample + "_bucket{" + strProbe + ",le=\"2e-06\"}") == 3);
+    TEST_CHECK(MetricValue(strMetrics, strSample + "_bucket{" + strProbe + ",le=\"4e-06\"}") == 5);
+    TEST_CHECK(MetricValue(strMetrics, strSample + "_bucket{" + strProbe + ",le=\"8e-06\"}") == 6);
+    TEST_CHECK(MetricValue(strMetrics, strSample + "_bucket{" + strProbe + ",le=\"0.524288\"}") == 6);
+    TEST_CHECK(MetricValue(strMetrics, strSample + "_bucket{" + strProbe + ",le=\"1.04858\"}") == 7);
+    TEST_CHECK(MetricValue(strMetrics, strSample + "_bucket{" + strProbe + ",le=\"4.1943\"}") == 7);
+    TEST_CHECK(MetricValue(strMetrics, strSample + "_bucket{" + strProbe + ",le=\"+Inf\"}") == 8);
+    TEST_CHECK(MetricValue(strMetrics, strSample + "_count{" + strProbe + "}") == 8);
+    TEST_CHECK(MetricValue(strMetrics, strSample + "_sum{" + strProbe + "}") == (double)((1ULL << 40) + 1000015) / 1000000);
+
+    // The other probes are untouched
+    TEST_CHECK(MetricValue(strMetrics, strSample + "_count{probe=\"registry_read\"}") == 0);
+}
+
+static VOID TestCounters()
+{
+    MetricsIncrement(CNT_SNAPSHOTS);
+    MetricsIncrement(CNT_SNAPSHOTS);
+    MetricsSetGauge(GAUGE_ENDPOINTS, 15);
+    MetricsSetGauge(GAUGE_ENDPOINTS, 12);
+
+    std::string strMetrics = FormatMetrics();
+    TEST_CHECK(MetricValue(strMetrics, "glpi_agentmonitor_snapshots_total") == 2);
+    TEST_CHECK(MetricValue(strMetrics, "glpi_agentmonitor_agent_errors_total") == 0);
+    TEST_CHECK(MetricValue(strMetrics, "glpi_agentmonitor_endpoints") == 12);
+    TEST_CHECK(strMetrics.find("# TYPE glpi_agentmonitor_snapshots_total counter\n") != std::string::npos);
+    TEST_CHECK(strMetrics.find("# TYPE glpi_agentmonitor_endpoints gauge\n") != std::string::npos);
+}
+
+static VOID TestStartupPhases()
+{
+    MetricsStartupBegin();
+    LONGLONG llStart = MetricsNow();
+    MetricsStartupPhase(STARTUP_SETTINGS, llStart);
+    double dSettings = MetricValue(FormatMetrics(), "glpi_agentmonitor_startup_phase_duration_seconds{phase=\"settings\"}");
+    TEST_CHECK(dSettings >= 0 && dSettings < 1);
+
+    // Only the first run of a phase is kept, and the phases not run are left out
+    MetricsStartupPhase(STARTUP_SETTINGS, llStart - 1000000);
+    std::string strMetrics = FormatMetrics();
+    TEST_CHECK(MetricValue(strMetrics, "glpi_agentmonitor_startup_phase_duration_seconds{phase=\"settings\"}") == dSettings);
+    TEST_CHECK(MetricValue(strMetrics, "glpi_agentmonitor_startup_phase_end_seconds{phase=\"settings\"}") >= 0);
+    TEST_CHECK(MetricValue(strMetrics, "glpi_agentmonitor_startup_phase_duration_seconds{phase=\"tray_icon\"}") == -1);
+}
+
+static VOID TestConcurrent()
+{
+    // No observation or increment is lost without a lock
+    std::vector<std::thread> threads;
+    for (int i = 0; i < CONCURRENT_THREADS; i++) {
+        threads.emplace_back([i] {
+            for (int j = 0; j < CONCURRENT_VALUES; j++) {
+                MetricsObserve(HIST_REGISTRY_READ, (ULONGLONG)(i + 1));
+                MetricsIncrement(CNT_ENDPOINTS_DOWN);
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    std::string strMetrics = FormatMetrics();
+    TEST_CHECK(MetricValue(strMetrics, "glpi_agentmonitor_probe_duration_seconds_count{probe=\"registry_read\"}") == CONCURRENT_THREADS * CONCURRENT_VALUES);
+    TEST_CHECK(MetricValue(strMetrics, "glpi_agentmonitor_probe_duration_seconds_bucket{probe=\"registry_read\",le=\"1e-06\"}") == CONCURRENT_VALUES);
+    TEST_CHECK(MetricValue(strMetrics, "glpi_agentmonitor_probe_duration_seconds_sum{probe=\"registry_read\"}") == (double)(1 + 2 + 3 + 4) * CONCURRENT_VALUES / 1000000);
+    TEST_CHECK(MetricValue(strMetrics, "glpi_agentmonitor_endpoints_down_total") == CONCURRENT_THREADS * CONCURRENT_VALUES);
+}
+
+static VOID TestOverhead()
+{
+    // Recording is two interlocked adds, so it costs tens of ns alone, more
+    // when the threads share the histogram
+    double dRecord = RecordingOverhead(1, FALSE);
+    double dShared = RecordingOverhead(CONCURRENT_THREADS, FALSE);
+    double dProbe = RecordingOverhead(1, TRUE);
+    printf("recording: %.1f ns alone, %.1f ns with %d threads; probe with its clock reads: %.1f ns\n",
+        dRecord, dShared, CONCURRENT_THREADS, dProbe);
+    TEST_CHECK(dRecord < OVERHEAD_MAX_NS && dProbe < OVERHEAD_MAX_NS);
+
+    std::string strMetrics = FormatMetrics();
+    TEST_CHECK(MetricValue(strMetrics, "glpi_agentmonitor_probe_duration_seconds_count{probe=\"agent_now\"}") == (double)(CONCURRENT_THREADS + 2) * OVERHEAD_PROBES);
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestHistogram);
+    TEST_RUN(TestCounters);
+    TEST_RUN(TestStartupPhases);
+    TEST_RUN(TestConcurrent);
+    TEST_RUN(TestOverhead);
+    return TestResult();
+}
@@ -0,0 +1,188 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  MonitorSnapshotTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <wchar.h>
+#include "framework.h"
+#include "MonitorSnapshot.h"
+#include "Test.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// Service states, after the "never queried" one
+#define STATE_FIRST             SERVICE_STOPPED
+#define STATE_LAST              SERVICE_PAUSED
+
+// Notification resource IDs (any value does)
+#define TEST_TITLE_RESID        101
+#define TEST_MSG_RESID          202
+#define TEST_INFO_FLAGS         0x3
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Returns a snapshot in the given service state (0 = never queried)
+static MonitorSnapshot MakeSnapshot(DWORD dwState)
+{
+    MonitorSnapshot snapshot = {};
+    snapshot.config.bInstalled = TRUE;
+    wcscpy_s(snapshot.szAgStatus, L"waiting");
+    if (dwState != 0)
+        MonitorSnapshotSetService(&snapshot, TRUE, dwState);
+    return snapshot;
+}
+
+// Returns the fields expected to change when the service goes from a state to another
+static DWORD ExpectedMask(DWORD dwOld, DWORD dwNew)
+{
+    DWORD dwMask = 0;
+    if (dwOld != dwNew)
+        dwMask |= SNAPSHOT_SERVICE;
+    if ((dwOld == SERVICE_RUNNING) != (dwNew == SERVICE_RUNNING))
+        dwMask |= SNAPSHOT_AGENTOK;
+    return dwMask;
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+static VOID TestFirstSnapshot()
+{
+    MonitorSnapshot snapshot = MakeSnapshot(0);
+    TEST_CHECK(MonitorSnapshotDiff(NULL, &snapshot) == SNAPSHOT_ALL);
+    TEST_CHECK(MonitorSnapshotDiff(&snapshot, &snapshot) == 0);
+    TEST_CHECK(!snapshot.bSvcQueryOk && !snapshot.bAgentOk);
+}
+
+// Every pair of states, including from the never queried one
+static VOID TestTransitions()
+{
+    DWORD dwMismatches = 0;
+    for (DWORD dwOld = 0; dwOld <= STATE_LAST; dwOld++) {
+        for (DWORD dwNew = STATE_FIRST; dwNew <= STATE_LAST; dwNew++) {
+            MonitorSnapshot previous = MakeSnapshot(dwOld);
+            MonitorSnapshot current = previous;
+            BOOL bChanged = MonitorSnapshotSetService(&current, TRUE, dwNew);
+
+            if (bChanged != (dwOld != dwNew) ||
+                MonitorSnapshotDiff(&previous, &current) != ExpectedMask(dwOld, dwNew) ||
+                current.dwSvcState != dwNew || !current.bSvcQueryOk ||
+                current.bAgentOk != (dwNew == SERVICE_RUNNING))
+                dwMismatches++;
+        }
+    }
+    TEST_CHECK(dwMismatches == 0);
+}
+
+// A failed query keeps the last state, but the icon shows the Agent as not running
+static VOID TestQueryFailure()
+{
+    DWORD dwMismatches = 0;
+    for (DWORD dwState = STATE_FIRST; dwState <= STATE_LAST; dwState++) {
+        for (DWORD dwQueried = STATE_FIRST; dwQueried <= STATE_LAST; dwQueried++) {
+            MonitorSnapshot previous = MakeSnapshot(dwState);
+            MonitorSnapshot current = previous;
+            DWORD dwMask = SNAPSHOT_SERVICE | (dwState == SERVICE_RUNNING ? SNAPSHOT_AGENTOK : 0);
+
+            if (MonitorSnapshotSetService(&current, FALSE, dwQueried) ||
+                MonitorSnapshotDiff(&previous, &current) != dwMask ||
+                current.dwSvcState != dwState || current.bSvcQueryOk || current.bAgentOk)
+                dwMismatches++;
+
+            // Querying the same state again only restores the query status
+            if (MonitorSnapshotSetService(&current, TRUE, dwState) ||
+                MonitorSnapshotDiff(&previous, &current) != 0)
+                dwMismatches++;
+        }
+    }
+    TEST_CHECK(dwMismatches == 0);
+}
+
+// A notification queued along with a transition is reported once, with it
+static VOID TestNotification()
+{
+    DWORD dwMismatches = 0;
+    for (DWORD dwOld = 0; dwOld <= STATE_LAST; dwOld++) {
+        for (DWORD dwNew = STATE_FIRST; dwNew <= STATE_LAST; dwNew++) {
+            MonitorSnapshot previous = MakeSnapshot(dwOld);
+            MonitorSnapshot current = previous;
+            MonitorSnapshotSetService(&current, TRUE, dwNew);
+            MonitorSnapshotNotify(&current, TEST_TITLE_RESID, TEST_MSG_RESID, TEST_INFO_FLAGS);
+
+            if (MonitorSnapshotDiff(&previous, &current) != (ExpectedMask(dwOld, dwNew) | SNAPSHOT_NOTIFICATION) ||
+                current.dwNotifySeq != previous.dwNotifySeq + 1 ||
+                current.uNotifyTitleResId != TEST_TITLE_RESID || current.uNotifyMsgResId != TEST_MSG_RESID ||
+                current.dwNotifyFlags != TEST_INFO_FLAGS)
+                dwMismatches++;
+
+            // Not shown again by the next snapshot
+            MonitorSnapshot next = current;
+            MonitorSnapshotSetService(&next, TRUE, dwNew);
+            if (MonitorSnapshotDiff(&current, &next) != 0)
+                dwMismatches++;
+        }
+    }
+    TEST_CHECK(dwMismatches == 0);
+}
+
+// Notifications queued between two snapshots: only the last one is shown
+static VOID TestNotificationOverwrite()
+{
+    MonitorSnapshot previous = MakeSnapshot(SERVICE_RUNNING);
+    MonitorSnapshot current = previous;
+    MonitorSnapshotNotify(&current, 1, 2, 0);
+    MonitorSnapshotSetService(&current, TRUE, SERVICE_STOPPED);
+    MonitorSnapshotNotify(&current, TEST_TITLE_RESID, TEST_MSG_RESID, TEST_INFO_FLAGS);
+
+    TEST_CHECK(MonitorSnapshotDiff(&previous, &current) == (SNAPSHOT_SERVICE | SNAPSHOT_AGENTOK | SNAPSHOT_NOTIFICATION));
+    TEST_CHECK(current.dwNotifySeq == previous.dwNotifySeq + 2);
+    TEST_CHECK(current.uNotifyTitleResId == TEST_TITLE_RESID && current.uNotifyMsgResId == TEST_MSG_RESID);
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestFirstSnapshot);
+    TEST_RUN(TestTransitions);
+    TEST_RUN(TestQueryFailure);
+    TEST_RUN(TestNotification);
+    TEST_RUN(TestNotificationOverwrite);
+    return TestResult();
+}
@@ -0,0 +1,307 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  OutboxTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <string>
+#include <vector>
+#include "framework.h"
+#include "Outbox.h"
+#include "Test.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+#define JOURNAL_PATH            L"OutboxTest.dat"
+#define JOURNAL_PATH_A          "OutboxTest.dat"
+
+// Test clock (ms)
+static ULONGLONG ullTestNow = 1000;
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+static ULONGLONG TestClock()
+{
+    return ullTestNow;
+}
+
+static BOOL Add(Outbox* pOutbox, WORD wAction, const std::string& payload, std::string* pJournal = NULL)
+{
+    std::string record;
+    BOOL bAdded = OutboxAdd(pOutbox, wAction, payload, record);
+    if (pJournal != NULL)
+        pJournal->append(record);
+    return bAdded;
+}
+
+static BOOL Complete(Outbox* pOutbox, DWORD dwSeq, OutboxResult result, std::string* pJournal = NULL)
+{
+    std::string record;
+    BOOL bRecord = OutboxComplete(pOutbox, dwSeq, result, record);
+    if (pJournal != NULL)
+        pJournal->append(record);
+    return bRecord;
+}
+
+static BOOL SamePending(const Outbox* pA, const Outbox* pB)
+{
+    if (pA->pending.size() != pB->pending.size())
+        return FALSE;
+    for (size_t i = 0; i < pA->pending.size(); i++) {
+        const OutboxAction& a = pA->pending[i];
+        const OutboxAction& b = pB->pending[i];
+        if (a.dwSeq != b.dwSeq || a.wAction != b.wAction || a.payload != b.payload)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+static VOID TestAdd()
+{
+    Outbox outbox;
+    OutboxInit(&outbox, TestClock);
+    TEST_CHECK(Add(&outbox, OUTBOX_ACTION_INVENTORY, ""));
+    TEST_CHECK(!Add(&outbox, OUTBOX_ACTION_INVENTORY, ""));
+    TEST_CHECK(Add(&outbox, OUTBOX_ACTION_TICKETS, ""));
+    TEST_CHECK(Add(&outbox, OUTBOX_ACTION_TICKETS, "a"));
+    TEST_CHECK(!Add(&outbox, OUTBOX_ACTION_TICKETS, "a"));
+    TEST_CHECK(outbox.dwCoalesced == 2);
+    TEST_CHECK(outbox.pending.size() == 3 && outbox.dwNextSeq == 4);
+
+    std::string record;
+    TEST_CHECK(!OutboxAdd(&outbox, OUTBOX_ACTION_COUNT, "", record) && record.empty());
+    TEST_CHECK(!OutboxAdd(&outbox, OUTBOX_ACTION_TICKETS, std::string(OUTBOX_MAX_PAYLOAD + 1, 'x'), record));
+    TEST_CHECK(OutboxAdd(&outbox, OUTBOX_ACTION_TICKETS, std::string(OUTBOX_MAX_PAYLOAD, 'x'), record));
+    TEST_CHECK(record.size() == sizeof(OutboxRecord) + OUTBOX_MAX_PAYLOAD);
+}
+
+// Batches: oldest first, of the types in the mask, not handed out twice
+static VOID TestBatches()
+{
+    Outbox outbox;
+    OutboxInit(&outbox, TestClock);
+    for (int i = 0; i < OUTBOX_BATCH_SIZE + 4; i++)
+        Add(&outbox, OUTBOX_ACTION_TICKETS, std::to_string(i));
+    Add(&outbox, OUTBOX_ACTION_INVENTORY, "");
+
+    std::vector<OutboxAction> batch;
+    TEST_CHECK(OutboxTakeBatch(&outbox, 1 << OUTBOX_ACTION_INVENTORY, batch) == 1);
+    TEST_CHECK(batch[0].wAction == OUTBOX_ACTION_INVENTORY);
+    TEST_CHECK(OutboxFindInFlight(&outbox, OUTBOX_ACTION_INVENTORY) == batch[0].dwSeq);
+    TEST_CHECK(OutboxFindInFlight(&outbox, OUTBOX_ACTION_TICKETS) == 0);
+
+    DWORD dwMask = (1 << OUTBOX_ACTION_INVENTORY) | (1 << OUTBOX_ACTION_TICKETS);
+    TEST_CHECK(OutboxTakeBatch(&outbox, dwMask, batch) == OUTBOX_BATCH_SIZE);
+    TEST_CHECK(batch.front().payload == "0" && batch.back().payload == std::to_string(OUTBOX_BATCH_SIZE - 1));
+    TEST_CHECK(OutboxTakeBatch(&outbox, dwMask, batch) == 4);
+    TEST_CHECK(OutboxTakeBatch(&outbox, dwMask, batch) == 0);
+    TEST_CHECK(outbox.dwReplayed == OUTBOX_BATCH_SIZE + 5);
+    TEST_CHECK(OutboxGetWait(&outbox, dwMask) == INFINITE);
+
+    // Only actions handed out can be completed
+    TEST_CHECK(Complete(&outbox, 1, OUTBOX_DONE));
+    TEST_CHECK(!Complete(&outbox, 1, OUTBOX_DONE));
+    TEST_CHECK(!Complete(&outbox, 1000, OUTBOX_DONE));
+    TEST_CHECK(Complete(&outbox, 2, OUTBOX_DROP));
+    TEST_CHECK(outbox.pending.size() == OUTBOX_BATCH_SIZE + 3);
+}
+
+// Failed actions are replayed after a backoff doubled on each failure
+static VOID TestBackoff()
+{
+    Outbox outbox;
+    OutboxInit(&outbox, TestClock);
+    Add(&outbox, OUTBOX_ACTION_INVENTORY, "");
+    Add(&outbox, OUTBOX_ACTION_TICKETS, "");
+    DWORD dwMask = 1 << OUTBOX_ACTION_INVENTORY;
+    TEST_CHECK(OutboxGetWait(&outbox, dwMask) == 0);
+
+    std::vector<OutboxAction> batch;
+    UINT uExpected = OUTBOX_BACKOFF_MIN;
+    for (int i = 0; i < 10; i++) {
+        TEST_CHECK(OutboxTakeBatch(&outbox, dwMask, batch) == 1);
+        TEST_CHECK(!Complete(&outbox, batch[0].dwSeq, OUTBOX_RETRY));
+        TEST_CHECK(OutboxGetWait(&outbox, dwMask) == uExpected);
+        TEST_CHECK(OutboxTakeBatch(&outbox, dwMask, batch) == 0);
+        ullTestNow += uExpected - 1;
+        TEST_CHECK(OutboxGetWait(&outbox, dwMask) == 1);
+        ullTestNow += 1;
+        uExpected = min(uExpected * 2, (UINT)OUTBOX_BACKOFF_MAX);
+    }
+    TEST_CHECK(uExpected == OUTBOX_BACKOFF_MAX);
+
+    // The other type isn't delayed, and a wake ends the backoff
+    TEST_CHECK(OutboxTakeBatch(&outbox, dwMask, batch) == 1);
+    Complete(&outbox, batch[0].dwSeq, OUTBOX_RETRY);
+    TEST_CHECK(OutboxGetWait(&outbox, 1 << OUTBOX_ACTION_TICKETS) == 0);
+    OutboxWake(&outbox, OUTBOX_ACTION_INVENTORY);
+    TEST_CHECK(OutboxGetWait(&outbox, dwMask) == 0);
+
+    // A success resets the backoff
+    TEST_CHECK(OutboxTakeBatch(&outbox, dwMask, batch) == 1);
+    Complete(&outbox, batch[0].dwSeq, OUTBOX_RETRY);
+    Add(&outbox, OUTBOX_ACTION_INVENTORY, "2");
+    ullTestNow += OUTBOX_BACKOFF_MIN;
+    TEST_CHECK(OutboxTakeBatch(&outbox, dwMask, batch) == 2);
+    TEST_CHECK(Complete(&outbox, batch[0].dwSeq, OUTBOX_DONE));
+    TEST_CHECK(!Complete(&outbox, batch[1].dwSeq, OUTBOX_RETRY));
+    TEST_CHECK(OutboxGetWait(&outbox, dwMask) == OUTBOX_BACKOFF_MIN);
+}
+
+// A journal replays to the same pending actions, whole or torn anywhere
+static VOID TestJournal()
+{
+    Outbox outbox;
+    OutboxInit(&outbox, TestClock);
+    std::string journal;
+    std::vector<OutboxAction> batch;
+    for (int i = 0; i < 20; i++) {
+        Add(&outbox, (WORD)(i % OUTBOX_ACTION_COUNT), std::string(i, 'p'), &journal);
+        if (i % 3 == 2) {
+            OutboxTakeBatch(&outbox, 0xFF, batch);
+            for (size_t j = 0; j < batch.size(); j++)
+                Complete(&outbox, batch[j].dwSeq, (j % 2 == 0 ? OUTBOX_DONE : OUTBOX_RETRY), &journal);
+            OutboxWake(&outbox, OUTBOX_ACTION_INVENTORY);
+            OutboxWake(&outbox, OUTBOX_ACTION_TICKETS);
+        }
+    }
+    TEST_CHECK(outbox.cbJournal == journal.size());
+
+    Outbox loaded;
+    OutboxInit(&loaded, TestClock);
+    TEST_CHECK(OutboxLoad(&loaded, (const BYTE*)journal.data(), journal.size()) == journal.size());
+    TEST_CHECK(SamePending(&loaded, &outbox));
+    TEST_CHECK(loaded.dwNextSeq == outbox.dwNextSeq);
+
+    // Torn tail: the records before it are kept
+    BOOL bTorn = TRUE;
+    for (size_t cbTorn = 1; cbTorn < journal.size(); cbTorn += 3) {
+        Outbox torn;
+        OutboxInit(&torn, TestClock);
+        size_t cbValid = OutboxLoad(&torn, (const BYTE*)journal.data(), journal.size() - cbTorn);
+        bTorn = bTorn && (cbValid <= journal.size() - cbTorn && cbValid + sizeof(OutboxRecord) + 20 > journal.size() - cbTorn);
+    }
+    TEST_CHECK(bTorn);
+
+    // A flipped bit stops the replay at its record
+    std::string bad = journal;
+    bad[sizeof(OutboxRecord) + 10] ^= 0x04;
+    Outbox flipped;
+    OutboxInit(&flipped, TestClock);
+    TEST_CHECK(OutboxLoad(&flipped, (const BYTE*)bad.data(), bad.size()) == sizeof(OutboxRecord));
+
+    // Snapshot of the pending actions
+    std::string snapshot;
+    OutboxSnapshot(&outbox, snapshot);
+    TEST_CHECK(snapshot.size() < journal.size() && outbox.cbJournal == snapshot.size());
+    Outbox compacted;
+    OutboxInit(&compacted, TestClock);
+    TEST_CHECK(OutboxLoad(&compacted, (const BYTE*)snapshot.data(), snapshot.size()) == snapshot.size());
+    TEST_CHECK(SamePending(&compacted, &outbox));
+}
+
+static VOID TestJournalFile()
+{
+    DeleteFile(JOURNAL_PATH);
+    Outbox outbox;
+    OutboxInit(&outbox, TestClock);
+    TEST_CHECK(OutboxOpen(&outbox, JOURNAL_PATH));
+    std::string record;
+    for (int i = 0; i < 3; i++) {
+        TEST_CHECK(OutboxAdd(&outbox, OUTBOX_ACTION_TICKETS, std::to_string(i), record));
+        TEST_CHECK(OutboxWrite(&outbox, record));
+    }
+    OutboxClose(&outbox);
+
+    // Reopened with a torn record appended
+    std::string journal = TestReadFile(JOURNAL_PATH_A);
+    TEST_CHECK(journal.size() == 3 * (sizeof(OutboxRecord) + 1));
+    TEST_CHECK(TestWriteFile(JOURNAL_PATH_A, journal + journal.substr(0, 10)));
+    Outbox reopened;
+    OutboxInit(&reopened, TestClock);
+    TEST_CHECK(OutboxOpen(&reopened, JOURNAL_PATH));
+    TEST_CHECK(SamePending(&reopened, &outbox));
+    TEST_CHECK(TestReadFile(JOURNAL_PATH_A) == journal);
+
+    // Emptied once no action is pending
+    std::vector<OutboxAction> batch;
+    OutboxTakeBatch(&reopened, 0xFF, batch);
+    for (const OutboxAction& action : batch) {
+        TEST_CHECK(OutboxComplete(&reopened, action.dwSeq, OUTBOX_DONE, record));
+        TEST_CHECK(OutboxWrite(&reopened, record));
+    }
+    TEST_CHECK(TestReadFile(JOURNAL_PATH_A).empty());
+
+    // Rewritten with the pending actions once too large
+    TEST_CHECK(OutboxAdd(&reopened, OUTBOX_ACTION_INVENTORY, "kept", record) && OutboxWrite(&reopened, record));
+    std::string payload(1000, 'x');
+    int nAdded = 0;
+    do {
+        TEST_CHECK(OutboxAdd(&reopened, OUTBOX_ACTION_TICKETS, payload, record) && OutboxWrite(&reopened, record));
+        OutboxTakeBatch(&reopened, 1 << OUTBOX_ACTION_TICKETS, batch);
+        TEST_CHECK(OutboxComplete(&reopened, batch[0].dwSeq, OUTBOX_DONE, record) && OutboxWrite(&reopened, record));
+        nAdded++;
+    } while (reopened.cbJournal > sizeof(OutboxRecord) + 4 && nAdded < 1000);
+    TEST_CHECK(nAdded > OUTBOX_COMPACT_SIZE / (2 * (int)payload.size()) && nAdded < 1000);
+    TEST_CHECK(TestReadFile(JOURNAL_PATH_A).size() == sizeof(OutboxRecord) + 4);
+    TEST_CHECK(reopened.cbJournal == sizeof(OutboxRecord) + 4);
+    TEST_CHECK(OutboxAdd(&reopened, OUTBOX_ACTION_TICKETS, "after", record) && OutboxWrite(&reopened, record));
+    OutboxClose(&reopened);
+
+    Outbox last;
+    OutboxInit(&last, TestClock);
+    TEST_CHECK(OutboxOpen(&last, JOURNAL_PATH));
+    TEST_CHECK(SamePending(&last, &reopened));
+    OutboxClose(&last);
+    DeleteFile(JOURNAL_PATH);
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestAdd);
+    TEST_RUN(TestBatches);
+    TEST_RUN(TestBackoff);
+    TEST_RUN(TestJournal);
+    TEST_RUN(TestJournalFile);
+    return TestResult();
+}
@@ -0,0 +1,313 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  PngEncoderTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include "framework.h"
+#include "PngEncoder.h"
+#include "Inflate.h"
+#include "Test.h"
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+static DWORD ReadBigEndian(const BYTE* p)
+{
+    return ((DWORD)p[0] << 24) | ((DWORD)p[1] << 16) | ((DWORD)p[2] << 8) | p[3];
+}
+
+static DWORD Adler32(DWORD dwAdler, const BYTE* pData, size_t cbData)
+{
+    DWORD a = dwAdler & 0xFFFF, b = dwAdler >> 16;
+    for (size_t i = 0; i < cbData; i++) {
+        a = (a + pData[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+static BOOL CollectOutput(PVOID pContext, const BYTE* pData, size_t cbData)
+{
+    ((std::string*)pContext)->append((const char*)pData, cbData);
+    return TRUE;
+}
+
+// Pseudo-random pixels (fixed seed, so failures can be reproduced)
+static std::vector<BYTE> MakePixels(size_t cbPixels, int nPattern)
+{
+    std::vector<BYTE> pixels(cbPixels);
+    srand(nPattern + 1);
+    for (size_t i = 0; i < cbPixels; i++) {
+        switch (nPattern) {
+            case 0: pixels[i] = (BYTE)rand(); break;            // Noise
+            case 1: pixels[i] = (BYTE)(i / 97); break;          // Gradient
+            case 2: pixels[i] = (BYTE)(rand() % 3); break;      // Few colors
+            default: pixels[i] = 0x80; break;                   // Flat
+        }
+    }
+    return pixels;
+}
+
+// Encodes an image as the screenshot does: header, strips, trailer
+static std::string EncodePng(const PngImage* pImage)
+{
+    std::string png(PNG_HEADER_SIZE, '\0');
+    TEST_CHECK(PngWriteHeader(pImage, (BYTE*)&png[0]) == PNG_HEADER_SIZE);
+
+    std::vector<BYTE> strip(PngStripBound(pImage));
+    DWORD dwAdler = 1;
+    for (DWORD i = 0; i < PngStripCount(pImage); i++) {
+        PngStrip s;
+        s.pData = strip.data();
+        PngEncodeStrip(pImage, i, &s);
+        TEST_CHECK(s.cbData <= strip.size());
+        png.append((const char*)s.pData, s.cbData);
+        dwAdler = PngAdlerCombine(dwAdler, s.dwAdler, s.cbRaw);
+    }
+
+    BYTE trailer[PNG_TRAILER_SIZE];
+    TEST_CHECK(PngWriteTrailer(dwAdler, trailer) == PNG_TRAILER_SIZE);
+    png.append((const char*)trailer, PNG_TRAILER_SIZE);
+    return png;
+}
+
+// Decodes a PNG written by the encoder (8-bit RGB, not interlaced) to RGB.
+// Every chunk CRC, the zlib stream and its checksum are checked.
+static BOOL DecodePng(const std::string& png, DWORD* pdwWidth, DWORD* pdwHeight, std::string& rgb)
+{
+    static const BYTE signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    if (png.size() < 8 || memcmp(png.data(), signature, 8) != 0)
+        return FALSE;
+
+    // Chunks
+    const BYTE* p = (const BYTE*)png.data();
+    size_t iChunk = 8;
+    std::string zlib;
+    BOOL bHeader = FALSE, bEnd = FALSE;
+    while (!bEnd) {
+        if (png.size() - iChunk < 12)
+            return FALSE;
+        DWORD cbData = ReadBigEndian(p + iChunk);
+        if (png.size() - iChunk - 12 < cbData)
+            return FALSE;
+        const BYTE* pType = p + iChunk + 4;
+        const BYTE* pData = pType + 4;
+        if (Crc32Update(0, pType, 4 + cbData) != ReadBigEndian(pData + cbData))
+            return FALSE;
+
+        if (memcmp(pType, "IHDR", 4) == 0) {
+            if (bHeader || cbData != 13 || pData[8] != 8 || pData[9] != 2 || pData[10] != 0 || pData[11] != 0 || pData[12] != 0)
+                return FALSE;
+            *pdwWidth = ReadBigEndian(pData);
+            *pdwHeight = ReadBigEndian(pData + 4);
+            bHeader = TRUE;
+        }
+        else if (memcmp(pType, "IDAT", 4) == 0) {
+            zlib.append((const char*)pData, cbData);
+        }
+        else if (memcmp(pType, "IEND", 4) == 0) {
+            bEnd = TRUE;
+        }
+        else {
+            return FALSE;
+        }
+        if (!bHeader)
+            return FALSE;
+        iChunk += 12 + cbData;
+    }
+    if (iChunk != png.size())
+        return FALSE;
+
+    // zlib stream, inflated as a gzip member (twice: the member trailer needs
+    // the CRC and size of the output)
+    if (zlib.size() < 6 || ((BYTE)zlib[0] << 8 | (BYTE)zlib[1]) % 31 != 0 || (zlib[0] & 0x0F) != 8 || (zlib[1] & 0x20) != 0)
+        return FALSE;
+    std::string gzip("\x1F\x8B\x08\x00\x00\x00\x00\x00\x00\xFF", 10);
+    gzip.append(zlib, 2, zlib.size() - 6);
+    std::string filtered;
+    std::vector<BYTE> out(INFLATE_WINDOW_SIZE);
+    std::string first = gzip + std::string(8, '\0');
+    if (GzipInflate((const BYTE*)first.data(), first.size(), out.data(), out.size(), CollectOutput, &filtered) == INFLATE_BAD_DATA)
+        return FALSE;
+
+    BYTE trailer[8];
+    DWORD dwCrc = Crc32Update(0, (const BYTE*)filtered.data(), filtered.size());
+    DWORD cbFiltered = (DWORD)filtered.size();
+    for (int i = 0; i < 4; i++) {
+        trailer[i] = (BYTE)(dwCrc >> (8 * i));
+        trailer[4 + i] = (BYTE)(cbFiltered >> (8 * i));
+    }
+    gzip.append((const char*)trailer, 8);
+    filtered.clear();
+    if (GzipInflate((const BYTE*)gzip.data(), gzip.size(), out.data(), out.size(), CollectOutput, &filtered) != INFLATE_OK)
+        return FALSE;
+    if (Adler32(1, (const BYTE*)filtered.data(), filtered.size()) != ReadBigEndian((const BYTE*)zlib.data() + zlib.size() - 4))
+        return FALSE;
+
+    // Rows
+    size_t cbRow = (size_t)*pdwWidth * 3;
+    if (filtered.size() != (cbRow + 1) * *pdwHeight)
+        return FALSE;
+    rgb.assign(cbRow * *pdwHeight, '\0');
+    BYTE* pRgb = (BYTE*)&rgb[0];
+    for (DWORD y = 0; y < *pdwHeight; y++) {
+        const BYTE* pIn = (const BYTE*)filtered.data() + y * (cbRow + 1);
+        BYTE* pCur = pRgb + y * cbRow;
+        const BYTE* pPrev = (y > 0 ? pCur - cbRow : NULL);
+        for (size_t i = 0; i < cbRow; i++) {
+            int a = (i >= 3 ? pCur[i - 3] : 0);
+            int b = (pPrev != NULL ? pPrev[i] : 0);
+            int c = (i >= 3 && pPrev != NULL ? pPrev[i - 3] : 0);
+            int nPred;
+            switch (pIn[0]) {
+                case 0: nPred = 0; break;
+                case 1: nPred = a; break;
+                case 2: nPred = b; break;
+                case 3: nPred = (a + b) / 2; break;
+                case 4: {
+                    int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2 * c);
+                    nPred = (pa <= pb && pa <= pc ? a : (pb <= pc ? b : c));
+                    break;
+                }
+                default: return FALSE;
+            }
+            pCur[i] = (BYTE)(pIn[1 + i] + nPred);
+        }
+    }
+    return TRUE;
+}
+
+// Returns the RGB pixels of a BGRX image
+static std::string ToRgb(const PngImage* pImage)
+{
+    std::string rgb;
+    for (DWORD y = 0; y < pImage->dwHeight; y++) {
+        const BYTE* pRow = pImage->pPixels + y * pImage->cbStride;
+        for (DWORD x = 0; x < pImage->dwWidth; x++) {
+            rgb += (char)pRow[4 * x + 2];
+            rgb += (char)pRow[4 * x + 1];
+            rgb += (char)pRow[4 * x];
+        }
+    }
+    return rgb;
+}
+
+// Encodes and decodes an image, returns TRUE if it's unchanged
+static BOOL RoundTrip(DWORD dwWidth, DWORD dwHeight, size_t cbPadding, int nPattern)
+{
+    size_t cbStride = (size_t)dwWidth * 4 + cbPadding;
+    std::vector<BYTE> pixels = MakePixels(cbStride * dwHeight, nPattern);
+    PngImage image = { pixels.data(), cbStride, dwWidth, dwHeight };
+
+    DWORD dwDecodedWidth = 0, dwDecodedHeight = 0;
+    std::string rgb;
+    if (!DecodePng(EncodePng(&image), &dwDecodedWidth, &dwDecodedHeight, rgb))
+        return FALSE;
+    return (dwDecodedWidth == dwWidth && dwDecodedHeight == dwHeight && rgb == ToRgb(&image));
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+static VOID TestAdlerCombine()
+{
+    std::vector<BYTE> data = MakePixels(100000, 0);
+    DWORD dwWhole = Adler32(1, data.data(), data.size());
+    for (size_t cbFirst : { (size_t)0, (size_t)1, (size_t)5552, (size_t)65521, data.size() }) {
+        DWORD dwFirst = Adler32(1, data.data(), cbFirst);
+        DWORD dwSecond = Adler32(1, data.data() + cbFirst, data.size() - cbFirst);
+        TEST_CHECK(PngAdlerCombine(dwFirst, dwSecond, data.size() - cbFirst) == dwWhole);
+    }
+}
+
+static VOID TestStrips()
+{
+    std::vector<BYTE> pixels(4 * 10 * (PNG_STRIP_ROWS * 2 + 1));
+    PngImage image = { pixels.data(), 4 * 10, 10, PNG_STRIP_ROWS * 2 + 1 };
+    TEST_CHECK(PngStripCount(&image) == 3);
+    image.dwHeight = PNG_STRIP_ROWS;
+    TEST_CHECK(PngStripCount(&image) == 1);
+}
+
+// Every pattern, with single and multiple strips, odd sizes and row padding
+static VOID TestRoundTrip()
+{
+    for (int nPattern = 0; nPattern < 4; nPattern++) {
+        TEST_CHECK(RoundTrip(1, 1, 0, nPattern));
+        TEST_CHECK(RoundTrip(37, PNG_STRIP_ROWS, 0, nPattern));
+        TEST_CHECK(RoundTrip(300, PNG_STRIP_ROWS * 3 + 5, 12, nPattern));
+    }
+}
+
+// Incompressible strips fit in the strip bound (as stored blocks)
+static VOID TestStripBound()
+{
+    TEST_CHECK(RoundTrip(1000, PNG_STRIP_ROWS + 1, 0, 0));
+}
+
+static VOID TestCorruption()
+{
+    std::vector<BYTE> pixels = MakePixels(4 * 50 * 50, 1);
+    PngImage image = { pixels.data(), 4 * 50, 50, 50 };
+    std::string png = EncodePng(&image);
+    DWORD dwWidth, dwHeight;
+    std::string rgb;
+    TEST_CHECK(DecodePng(png, &dwWidth, &dwHeight, rgb));
+
+    // The decoder used by the tests must notice a flipped bit anywhere
+    for (size_t i = 8; i < png.size(); i += 7) {
+        std::string bad = png;
+        bad[i] ^= 0x10;
+        TEST_CHECK(!DecodePng(bad, &dwWidth, &dwHeight, rgb));
+    }
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestAdlerCombine);
+    TEST_RUN(TestStrips);
+    TEST_RUN(TestRoundTrip);
+    TEST_RUN(TestStripBound);
+    TEST_RUN(TestCorruption);
+    return TestResult();
+}
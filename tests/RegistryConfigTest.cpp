@@ -0,0 +1,407 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  RegistryConfigTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <wchar.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "framework.h"
+#include "resource.h"
+#include "RegistryConfig.h"
+#include "Test.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+#define AGENT_KEY               L"SOFTWARE\\GLPI-Agent"
+#define AGENT_KEY32             L"SOFTWARE\\WOW6432Node\\GLPI-Agent"
+#define INSTALLER_KEY           L"SOFTWARE\\GLPI-Agent\\Installer"
+#define SERVICE_KEY             L"SYSTEM\\CurrentControlSet\\Services\\GLPI-Agent"
+
+// In-memory registry. Change notifications signal their event once, as the
+// registry does, and the handles of a deleted key fail afterwards.
+class FakeRegistryBackend : public RegistryBackend
+{
+public:
+    struct Key {
+        DWORD dwCreation;       // Creation the open handles refer to
+        std::map<std::wstring, std::vector<BYTE>> values;
+    };
+    struct OpenHandle {
+        std::wstring strKey;
+        DWORD dwCreation;
+    };
+    struct Notification {
+        HANDLE hEvent;
+        std::wstring strKey;
+        BOOL bSubtree;
+    };
+
+    std::map<std::wstring, Key> keys;
+    std::map<ULONG_PTR, OpenHandle> handles;    // Open handles (keys and events)
+    std::map<HANDLE, BOOL> events;              // Events, and whether they're signaled
+    std::vector<Notification> notifications;    // Armed notifications
+    ULONG_PTR uNextHandle = 1;
+    DWORD dwCreations = 0;
+    DWORD nQueries = 0;
+    BOOL bEventsFail = FALSE;
+
+    LONG OpenKey(LPCWSTR szKey, REGSAM samDesired, HKEY* phKey) override
+    {
+        TEST_CHECK(samDesired == KEY_READ || samDesired == KEY_NOTIFY);
+        auto it = keys.find(szKey);
+        if (it == keys.end())
+            return ERROR_FILE_NOT_FOUND;
+        handles[uNextHandle] = { szKey, it->second.dwCreation };
+        *phKey = (HKEY)uNextHandle++;
+        return ERROR_SUCCESS;
+    }
+
+    LONG QueryValue(HKEY hKey, LPCWSTR szName, LPVOID pData, DWORD* pcbData) override
+    {
+        nQueries++;
+        Key* pKey;
+        LONG lRes = Find(hKey, &pKey);
+        if (lRes != ERROR_SUCCESS)
+            return lRes;
+        auto it = pKey->values.find(szName);
+        if (it == pKey->values.end())
+            return ERROR_FILE_NOT_FOUND;
+        if (*pcbData < it->second.size()) {
+            *pcbData = (DWORD)it->second.size();
+            return ERROR_MORE_DATA;
+        }
+        CopyMemory(pData, it->second.data(), it->second.size());
+        *pcbData = (DWORD)it->second.size();
+        return ERROR_SUCCESS;
+    }
+
+    VOID CloseKey(HKEY hKey) override
+    {
+        TEST_CHECK(handles.erase((ULONG_PTR)hKey) == 1);
+    }
+
+    HANDLE CreateWatchEvent() override
+    {
+        if (bEventsFail)
+            return NULL;
+        HANDLE hEvent = (HANDLE)(0x10000 + uNextHandle++);
+        events[hEvent] = FALSE;
+        return hEvent;
+    }
+
+    VOID CloseWatchEvent(HANDLE hEvent) override
+    {
+        TEST_CHECK(events.erase(hEvent) == 1);
+    }
+
+    LONG NotifyChange(HKEY hKey, BOOL bSubtree, HANDLE hEvent) override
+    {
+        Key* pKey;
+        LONG lRes = Find(hKey, &pKey);
+        if (lRes != ERROR_SUCCESS)
+            return lRes;
+        TEST_CHECK(events.count(hEvent) == 1);
+        notifications.push_back({ hEvent, handles[(ULONG_PTR)hKey].strKey, bSubtree });
+        return ERROR_SUCCESS;
+    }
+
+    VOID SetString(LPCWSTR szKey, LPCWSTR szName, LPCWSTR szValue)
+    {
+        const BYTE* pb = (const BYTE*)szValue;
+        Set(szKey, szName, std::vector<BYTE>(pb, pb + (wcslen(szValue) + 1) * sizeof(WCHAR)));
+    }
+
+    VOID SetDword(LPCWSTR szKey, LPCWSTR szName, DWORD dwValue)
+    {
+        const BYTE* pb = (const BYTE*)&dwValue;
+        Set(szKey, szName, std::vector<BYTE>(pb, pb + sizeof(dwValue)));
+    }
+
+    // Deletes a key and its subkeys
+    VOID DeleteKey(LPCWSTR szKey)
+    {
+        std::wstring strPrefix = std::wstring(szKey) + L"\\";
+        for (auto it = keys.begin(); it != keys.end();) {
+            if (it->first == szKey || it->first.compare(0, strPrefix.size(), strPrefix) == 0)
+                it = keys.erase(it);
+            else
+                ++it;
+        }
+        Signal(szKey);
+    }
+
+    // Returns whether an event was signaled, and resets it
+    BOOL TakeSignal(HANDLE hEvent)
+    {
+        BOOL bSignaled = events[hEvent];
+        events[hEvent] = FALSE;
+        return bSignaled;
+    }
+
+private:
+    LONG Find(HKEY hKey, Key** ppKey)
+    {
+        auto itHandle = handles.find((ULONG_PTR)hKey);
+        if (itHandle == handles.end())
+            return ERROR_INVALID_HANDLE;
+        auto itKey = keys.find(itHandle->second.strKey);
+        if (itKey == keys.end() || itKey->second.dwCreation != itHandle->second.dwCreation)
+            return ERROR_KEY_DELETED;
+        *ppKey = &itKey->second;
+        return ERROR_SUCCESS;
+    }
+
+    VOID Set(LPCWSTR szKey, LPCWSTR szName, const std::vector<BYTE>& value)
+    {
+        if (keys.find(szKey) == keys.end())
+            keys[szKey].dwCreation = ++dwCreations;
+        keys[szKey].values[szName] = value;
+        Signal(szKey);
+    }
+
+    // Signals (and disarms) the notifications watching a key
+    VOID Signal(LPCWSTR szKey)
+    {
+        std::wstring strKey = szKey;
+        for (auto it = notifications.begin(); it != notifications.end();) {
+            std::wstring strPrefix = it->strKey + L"\\";
+            if (strKey == it->strKey || (it->bSubtree && strKey.compare(0, strPrefix.size(), strPrefix) == 0)) {
+                events[it->hEvent] = TRUE;
+                it = notifications.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Registry of an installed Agent
+static VOID InstallAgent(FakeRegistryBackend* pBackend, LPCWSTR szAgentKey)
+{
+    pBackend->SetString(szAgentKey, L"httpd-port", L"62354");
+    pBackend->SetString(szAgentKey, L"server", L"https://glpi.example.com/marketplace/glpiinventory/");
+    pBackend->SetString(szAgentKey, L"logfile", L"C:\\Program Files\\GLPI-Agent\\logs\\glpi-agent.log");
+    pBackend->SetString(INSTALLER_KEY, L"Version", L"1.7.1");
+    pBackend->SetDword(SERVICE_KEY, L"Start", SERVICE_AUTO_START);
+}
+
+// Reads the server URL set in the registry
+static std::wstring ReadServer(FakeRegistryBackend* pBackend, RegistryConfig* pCfg, LPCWSTR szValue)
+{
+    pBackend->SetString(AGENT_KEY, L"server", szValue);
+    AgentSettings settings;
+    UINT uErrResId = 0;
+    TEST_CHECK(RegConfigReadAgentSettings(pCfg, &settings, &uErrResId) == ERROR_SUCCESS);
+    return settings.szServer;
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+static VOID TestAgentSettings()
+{
+    FakeRegistryBackend backend;
+    RegistryConfig cfg;
+    RegConfigInit(&cfg, &backend, L"GLPI-Agent");
+
+    // Not installed
+    AgentSettings settings;
+    UINT uErrResId = 0;
+    TEST_CHECK(RegConfigReadAgentSettings(&cfg, &settings, &uErrResId) == ERROR_FILE_NOT_FOUND);
+    TEST_CHECK(uErrResId == IDS_ERR_AGENTSETTINGS && cfg.szAgentKey[0] == '\0');
+
+    // 32-bit Agent
+    InstallAgent(&backend, AGENT_KEY32);
+    TEST_CHECK(RegConfigReadAgentSettings(&cfg, &settings, &uErrResId) == ERROR_SUCCESS);
+    TEST_CHECK(wcscmp(cfg.szAgentKey, AGENT_KEY32) == 0 && settings.dwPort == 62354);
+    TEST_CHECK(wcscmp(settings.szServer, L"https://glpi.example.com") == 0);
+    TEST_CHECK(wcscmp(settings.szLogfile, L"C:\\Program Files\\GLPI-Agent\\logs\\glpi-agent.log") == 0);
+
+    // The 64-bit Agent is preferred, without server and logfile
+    backend.SetString(AGENT_KEY, L"httpd-port", L"62355");
+    TEST_CHECK(RegConfigReadAgentSettings(&cfg, &settings, &uErrResId) == ERROR_SUCCESS);
+    TEST_CHECK(wcscmp(cfg.szAgentKey, AGENT_KEY) == 0 && settings.dwPort == 62355);
+    TEST_CHECK(settings.szServer[0] == '\0' && settings.szLogfile[0] == '\0');
+
+    // Server URLs
+    TEST_CHECK(ReadServer(&backend, &cfg, L"'https://glpi.example.com/glpi/plugins/glpiinventory/'") == L"https://glpi.example.com/glpi");
+    TEST_CHECK(ReadServer(&backend, &cfg, L"\"https://a.example.com/front/inventory.php\",https://b.example.com") == L"https://a.example.com");
+    TEST_CHECK(ReadServer(&backend, &cfg, L"https://glpi.example.com//") == L"https://glpi.example.com");
+    TEST_CHECK(ReadServer(&backend, &cfg, L"glpi.example.com") == L"glpi.example.com");
+    TEST_CHECK(ReadServer(&backend, &cfg, L"''") == L"");
+
+    // Missing port
+    backend.keys[AGENT_KEY].values.erase(L"httpd-port");
+    TEST_CHECK(RegConfigReadAgentSettings(&cfg, &settings, &uErrResId) == ERROR_FILE_NOT_FOUND);
+    TEST_CHECK(uErrResId == IDS_ERR_HTTPDPORT);
+
+    // Values too long aren't read
+    backend.SetString(AGENT_KEY, L"httpd-port", L"62354");
+    backend.SetString(AGENT_KEY, L"logfile", std::wstring(MAX_PATH, 'x').c_str());
+    TEST_CHECK(RegConfigReadAgentSettings(&cfg, &settings, &uErrResId) == ERROR_SUCCESS);
+    TEST_CHECK(settings.szLogfile[0] == '\0');
+    TEST_CHECK(backend.handles.empty());
+}
+
+static VOID TestAgentConfig()
+{
+    FakeRegistryBackend backend;
+    RegistryConfig cfg;
+    RegConfigInit(&cfg, &backend, L"GLPI-Agent");
+
+    AgentConfig agentCfg = {};
+    RegConfigReadVersion(&cfg, &agentCfg);
+    RegConfigReadStartType(&cfg, &agentCfg);
+    TEST_CHECK(!agentCfg.bInstalled && !agentCfg.bVersionFound && agentCfg.uStartTypeResId == IDS_ERR_REGFAIL);
+
+    InstallAgent(&backend, AGENT_KEY);
+    RegConfigReadVersion(&cfg, &agentCfg);
+    TEST_CHECK(agentCfg.bInstalled && agentCfg.bVersionFound && wcscmp(agentCfg.szVersion, L"1.7.1") == 0);
+
+    // The Installer key of a 32-bit Agent
+    backend.DeleteKey(INSTALLER_KEY);
+    backend.SetString(L"SOFTWARE\\WOW6432Node\\GLPI-Agent\\Installer", L"Version", L"1.6");
+    RegConfigReadVersion(&cfg, &agentCfg);
+    TEST_CHECK(agentCfg.bVersionFound && wcscmp(agentCfg.szVersion, L"1.6") == 0);
+    backend.keys[L"SOFTWARE\\WOW6432Node\\GLPI-Agent\\Installer"].values.clear();
+    RegConfigReadVersion(&cfg, &agentCfg);
+    TEST_CHECK(agentCfg.bInstalled && !agentCfg.bVersionFound && agentCfg.szVersion[0] == '\0');
+
+    // Startup types
+    static const struct {
+        DWORD dwStart;
+        int nDelayed;           // DelayedAutostart value (-1 if not set)
+        UINT uResId;
+    } startTypes[] = {
+        { SERVICE_BOOT_START, -1, IDS_SVCSTART_BOOT },
+        { SERVICE_SYSTEM_START, -1, IDS_SVCSTART_SYSTEM },
+        { SERVICE_AUTO_START, -1, IDS_SVCSTART_AUTO },
+        { SERVICE_AUTO_START, 0, IDS_SVCSTART_AUTO },
+        { SERVICE_AUTO_START, 1, IDS_SVCSTART_DELAYEDAUTO },
+        { SERVICE_DEMAND_START, 1, IDS_SVCSTART_MANUAL },
+        { SERVICE_DISABLED, -1, IDS_SVCSTART_DISABLED },
+        { 42, -1, IDS_ERR_UNKSVCSTART },
+    };
+    for (const auto& startType : startTypes) {
+        backend.keys[SERVICE_KEY].values.clear();
+        backend.SetDword(SERVICE_KEY, L"Start", startType.dwStart);
+        if (startType.nDelayed >= 0)
+            backend.SetDword(SERVICE_KEY, L"DelayedAutostart", (DWORD)startType.nDelayed);
+        RegConfigReadStartType(&cfg, &agentCfg);
+        TEST_CHECK(agentCfg.uStartTypeResId == startType.uResId);
+    }
+    backend.keys[SERVICE_KEY].values.clear();
+    RegConfigReadStartType(&cfg, &agentCfg);
+    TEST_CHECK(agentCfg.uStartTypeResId == IDS_ERR_UNKSVCSTART);
+    TEST_CHECK(backend.handles.empty());
+}
+
+static VOID TestWatches()
+{
+    FakeRegistryBackend backend;
+    RegistryConfig cfg;
+    RegConfigInit(&cfg, &backend, L"GLPI-Agent");
+    AgentSettings settings;
+    UINT uErrResId;
+    AgentConfig agentCfg = {};
+
+    // Nothing to watch yet: the values are polled
+    TEST_CHECK(!RegConfigArmWatch(&cfg, REGWATCH_AGENT) && !RegConfigArmWatch(&cfg, REGWATCH_SERVICE));
+    TEST_CHECK(!RegConfigIsWatched(&cfg, REGWATCH_AGENT) && !RegConfigIsWatched(&cfg, REGWATCH_SERVICE));
+    TEST_CHECK(backend.handles.empty() && backend.events.size() == 2);
+
+    // Once installed, the keys are watched and no value is read until changed
+    InstallAgent(&backend, AGENT_KEY);
+    TEST_CHECK(RegConfigReadAgentSettings(&cfg, &settings, &uErrResId) == ERROR_SUCCESS);
+    TEST_CHECK(RegConfigArmWatch(&cfg, REGWATCH_AGENT) && RegConfigArmWatch(&cfg, REGWATCH_SERVICE));
+    TEST_CHECK(RegConfigIsWatched(&cfg, REGWATCH_AGENT) && RegConfigIsWatched(&cfg, REGWATCH_SERVICE));
+    HANDLE hAgentEvent = cfg.hWatchEvents[REGWATCH_AGENT];
+    HANDLE hServiceEvent = cfg.hWatchEvents[REGWATCH_SERVICE];
+    DWORD nQueries = backend.nQueries;
+    TEST_CHECK(!backend.TakeSignal(hAgentEvent) && !backend.TakeSignal(hServiceEvent));
+
+    // A change of the Installer subkey signals the Agent key
+    backend.SetString(INSTALLER_KEY, L"Version", L"1.8");
+    TEST_CHECK(backend.TakeSignal(hAgentEvent) && !backend.TakeSignal(hServiceEvent));
+    TEST_CHECK(RegConfigArmWatch(&cfg, REGWATCH_AGENT));
+    RegConfigReadVersion(&cfg, &agentCfg);
+    TEST_CHECK(wcscmp(agentCfg.szVersion, L"1.8") == 0 && backend.nQueries == nQueries + 1);
+
+    // The service key is watched without its subkeys
+    backend.SetDword(SERVICE_KEY L"\\Parameters", L"Value", 1);
+    TEST_CHECK(!backend.TakeSignal(hServiceEvent));
+    backend.SetDword(SERVICE_KEY, L"Start", SERVICE_DISABLED);
+    TEST_CHECK(backend.TakeSignal(hServiceEvent) && !backend.TakeSignal(hAgentEvent));
+    TEST_CHECK(RegConfigArmWatch(&cfg, REGWATCH_SERVICE));
+    RegConfigReadStartType(&cfg, &agentCfg);
+    TEST_CHECK(agentCfg.uStartTypeResId == IDS_SVCSTART_DISABLED);
+
+    // Uninstalled: the deleted keys can't be watched anymore
+    backend.DeleteKey(AGENT_KEY);
+    backend.DeleteKey(SERVICE_KEY);
+    TEST_CHECK(backend.TakeSignal(hAgentEvent) && backend.TakeSignal(hServiceEvent));
+    TEST_CHECK(!RegConfigArmWatch(&cfg, REGWATCH_AGENT) && !RegConfigArmWatch(&cfg, REGWATCH_SERVICE));
+    TEST_CHECK(!RegConfigIsWatched(&cfg, REGWATCH_AGENT) && !RegConfigIsWatched(&cfg, REGWATCH_SERVICE));
+    TEST_CHECK(backend.handles.empty());
+
+    // Reinstalled: watched again, with the same events
+    InstallAgent(&backend, AGENT_KEY);
+    TEST_CHECK(RegConfigArmWatch(&cfg, REGWATCH_AGENT) && RegConfigArmWatch(&cfg, REGWATCH_SERVICE));
+    TEST_CHECK(cfg.hWatchEvents[REGWATCH_AGENT] == hAgentEvent && backend.events.size() == 2);
+    RegConfigCloseWatches(&cfg);
+    TEST_CHECK(backend.handles.empty() && backend.events.empty());
+
+    // The events can't be created
+    backend.bEventsFail = TRUE;
+    TEST_CHECK(!RegConfigArmWatch(&cfg, REGWATCH_AGENT) && !RegConfigIsWatched(&cfg, REGWATCH_AGENT));
+    TEST_CHECK(backend.handles.empty());
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestAgentSettings);
+    TEST_RUN(TestAgentConfig);
+    TEST_RUN(TestWatches);
+    return TestResult();
+}
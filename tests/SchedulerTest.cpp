@@ -0,0 +1,193 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  SchedulerTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include "framework.h"
+#include "Scheduler.h"
+#include "Test.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// Test clock (ms)
+static ULONGLONG ullTestNow = 0;
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+static ULONGLONG TestClock()
+{
+    return ullTestNow;
+}
+
+// Scheduler with the test clock at a given time
+static VOID InitScheduler(ProbeScheduler* pSched, ULONGLONG ullNow)
+{
+    ullTestNow = ullNow;
+    SchedulerInit(pSched, TestClock);
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+// Nothing to run and nothing to wait for while every probe is disabled
+static VOID TestDisabled()
+{
+    ProbeScheduler sched;
+    InitScheduler(&sched, 100000);
+    TEST_CHECK(SchedulerGetWait(&sched) == INFINITE);
+    TEST_CHECK(SchedulerTakeDueProbes(&sched) == 0);
+    SchedulerRunNow(&sched, PROBE_AGENT);
+    TEST_CHECK(SchedulerGetWait(&sched) == INFINITE);
+    TEST_CHECK(SchedulerTakeDueProbes(&sched) == 0);
+
+    // Disabling the last enabled probe
+    SchedulerSetInterval(&sched, PROBE_AGENT, 2000);
+    TEST_CHECK(SchedulerGetWait(&sched) == 0);
+    SchedulerSetInterval(&sched, PROBE_AGENT, 0);
+    TEST_CHECK(SchedulerGetWait(&sched) == INFINITE);
+    TEST_CHECK(SchedulerTakeDueProbes(&sched) == 0);
+    TEST_CHECK(sched.dwWakeups == 3 && sched.dwProbeRuns == 0);
+}
+
+static VOID TestIntervals()
+{
+    ProbeScheduler sched;
+    InitScheduler(&sched, 100000);
+    SchedulerSetInterval(&sched, PROBE_AGENT, 2000);
+    SchedulerSetInterval(&sched, PROBE_SERVICE, 500);
+    TEST_CHECK(SchedulerTakeDueProbes(&sched) == ((1 << PROBE_AGENT) | (1 << PROBE_SERVICE)));
+    TEST_CHECK(SchedulerGetWait(&sched) == 500);
+
+    DWORD dwAgentRuns = 0, dwServiceRuns = 0;
+    for (int i = 0; i < 40; i++) {
+        ullTestNow += SchedulerGetWait(&sched);
+        DWORD dwProbes = SchedulerTakeDueProbes(&sched);
+        TEST_CHECK(dwProbes != 0);
+        dwAgentRuns += (dwProbes >> PROBE_AGENT) & 1;
+        dwServiceRuns += (dwProbes >> PROBE_SERVICE) & 1;
+    }
+    TEST_CHECK(ullTestNow == 100000 + 40 * 500);
+    TEST_CHECK(dwServiceRuns == 40 && dwAgentRuns == 10);
+    TEST_CHECK(sched.dwProbeRuns == 2 + 50);
+}
+
+// Probes due within the window run in the same wakeup, the others wait
+static VOID TestCoalescing()
+{
+    ProbeScheduler sched;
+    InitScheduler(&sched, 100000);
+    SchedulerSetInterval(&sched, PROBE_AGENT, 1000);
+    SchedulerSetInterval(&sched, PROBE_SERVICE, 1200);
+    SchedulerSetInterval(&sched, PROBE_REGISTRY, 1300);
+    TEST_CHECK(SchedulerTakeDueProbes(&sched) == ((1 << PROBE_AGENT) | (1 << PROBE_SERVICE) | (1 << PROBE_REGISTRY)));
+
+    // PROBE_SERVICE is due 200 ms later, PROBE_REGISTRY 300 ms later
+    ullTestNow = 101000;
+    TEST_CHECK(SchedulerTakeDueProbes(&sched) == ((1 << PROBE_AGENT) | (1 << PROBE_SERVICE)));
+    TEST_CHECK(SchedulerGetWait(&sched) == 300);
+    ullTestNow = 101300;
+    TEST_CHECK(SchedulerTakeDueProbes(&sched) == (1 << PROBE_REGISTRY));
+
+    // Due exactly at the window end (PROBE_REGISTRY at 102600)
+    ullTestNow = 102600 - SCHEDULER_COALESCE_WINDOW - 1;
+    TEST_CHECK(SchedulerTakeDueProbes(&sched) == ((1 << PROBE_AGENT) | (1 << PROBE_SERVICE)));
+    ullTestNow = 102600 - SCHEDULER_COALESCE_WINDOW;
+    TEST_CHECK(SchedulerTakeDueProbes(&sched) == (1 << PROBE_REGISTRY));
+    TEST_CHECK(sched.dwWakeups == 5 && sched.dwProbeRuns == 9);
+}
+
+// A new interval is relative to the last run
+static VOID TestIntervalChange()
+{
+    ProbeScheduler sched;
+    InitScheduler(&sched, 100000);
+    SchedulerSetInterval(&sched, PROBE_AGENT, 10000);
+    TEST_CHECK(SchedulerTakeDueProbes(&sched) == (1 << PROBE_AGENT));
+    ullTestNow = 103000;
+    TEST_CHECK(SchedulerGetWait(&sched) == 7000);
+
+    // Shorter: due 5 s after the last run
+    SchedulerSetInterval(&sched, PROBE_AGENT, 5000);
+    TEST_CHECK(SchedulerGetWait(&sched) == 2000);
+
+    // Shorter than the time since the last run: due now
+    SchedulerSetInterval(&sched, PROBE_AGENT, 1000);
+    TEST_CHECK(SchedulerGetWait(&sched) == 0);
+
+    // Longer: due 60 s after the last run
+    SchedulerSetInterval(&sched, PROBE_AGENT, 60000);
+    TEST_CHECK(SchedulerGetWait(&sched) == 57000);
+
+    // Setting the same interval doesn't move the next run
+    SchedulerRunNow(&sched, PROBE_AGENT);
+    SchedulerSetInterval(&sched, PROBE_AGENT, 60000);
+    TEST_CHECK(SchedulerGetWait(&sched) == 0);
+
+    // Re-enabled: relative to the run before it was disabled
+    TEST_CHECK(SchedulerTakeDueProbes(&sched) == (1 << PROBE_AGENT));
+    SchedulerSetInterval(&sched, PROBE_AGENT, 0);
+    ullTestNow += 4000;
+    SchedulerSetInterval(&sched, PROBE_AGENT, 5000);
+    TEST_CHECK(SchedulerGetWait(&sched) == 1000);
+}
+
+// Waits longer than INFINITE are capped below it
+static VOID TestLongWait()
+{
+    ProbeScheduler sched;
+    InitScheduler(&sched, 10000000000ULL);
+    SchedulerSetInterval(&sched, PROBE_LOGSCAN, INFINITE);
+    TEST_CHECK(SchedulerTakeDueProbes(&sched) == (1 << PROBE_LOGSCAN));
+    TEST_CHECK(SchedulerGetWait(&sched) == INFINITE - 1);
+    ullTestNow += INFINITE;
+    TEST_CHECK(SchedulerGetWait(&sched) == 0);
+    TEST_CHECK(SchedulerTakeDueProbes(&sched) == (1 << PROBE_LOGSCAN));
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestDisabled);
+    TEST_RUN(TestIntervals);
+    TEST_RUN(TestCoalescing);
+    TEST_RUN(TestIntervalChange);
+    TEST_RUN(TestLongWait);
+    return TestResult();
+}
@@ -0,0 +1,455 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  ServiceWatchTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <map>
+#include "framework.h"
+#include "resource.h"
+#include "Handoff.h"
+#include "ServiceWatch.h"
+#include "Test.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+#define WMAPP_TEST_NOTIFY       0x8001
+
+// In-memory SCM, with a single service. Reinstalling the service makes the
+// handles opened before stale, restarting the SCM makes every handle stale,
+// and the next calls of each function can be made to fail.
+class FakeServiceBackend : public ServiceBackend
+{
+public:
+    struct Handle {
+        BOOL bService;
+        DWORD dwInstall;        // Service installation the handle was opened on
+        DWORD dwBoot;           // SCM run the handle was opened on
+        DWORD dwAccess;
+    };
+
+    std::map<ULONG_PTR, Handle> handles;     // Open handles
+    ULONG_PTR uNextHandle = 1;
+    BOOL bExists = TRUE;
+    BOOL bDeletePending = FALSE;
+    DWORD dwInstall = 1;
+    DWORD dwBoot = 1;
+    DWORD dwState = SERVICE_RUNNING;
+
+    // Failures injected: error code, and number of calls failing
+    DWORD dwOpenManagerErr = 0, nOpenManagerFails = 0;
+    DWORD dwOpenServiceErr = 0, nOpenServiceFails = 0;
+    DWORD dwControlErr = 0, nControlFails = 0;
+    DWORD dwNotifyErr = ERROR_SUCCESS;
+
+    // Calls made
+    DWORD nQueries = 0, nStarts = 0, nControls = 0, dwLastControl = 0;
+    DWORD nNotifies = 0, dwNotifyMask = 0;
+    SC_HANDLE hNotifySvc = NULL;
+
+    SC_HANDLE OpenManager() override
+    {
+        if (Fail(&nOpenManagerFails, dwOpenManagerErr))
+            return NULL;
+        return Open({ FALSE, 0, dwBoot, 0 });
+    }
+
+    SC_HANDLE OpenService(SC_HANDLE hSc, DWORD dwAccess) override
+    {
+        const Handle* pScm = Find(hSc, FALSE);
+        if (pScm == NULL || Fail(&nOpenServiceFails, dwOpenServiceErr))
+            return NULL;
+        if (!bExists) {
+            SetLastError(ERROR_SERVICE_DOES_NOT_EXIST);
+            return NULL;
+        }
+        return Open({ TRUE, dwInstall, dwBoot, dwAccess });
+    }
+
+    VOID Close(SC_HANDLE hHandle) override
+    {
+        TEST_CHECK(handles.erase((ULONG_PTR)hHandle) == 1);
+        if (hHandle == hNotifySvc)
+            hNotifySvc = NULL;
+    }
+
+    BOOL QueryStatus(SC_HANDLE hSvc, SERVICE_STATUS* pStatus) override
+    {
+        nQueries++;
+        if (Find(hSvc, TRUE) == NULL)
+            return FALSE;
+        *pStatus = {};
+        pStatus->dwCurrentState = dwState;
+        return TRUE;
+    }
+
+    BOOL Start(SC_HANDLE hSvc) override
+    {
+        nStarts++;
+        return Operate(hSvc, SERVICE_START, 0);
+    }
+
+    BOOL Control(SC_HANDLE hSvc, DWORD dwControl) override
+    {
+        nControls++;
+        return Operate(hSvc, (dwControl == SERVICE_CONTROL_STOP ? SERVICE_STOP : SERVICE_PAUSE_CONTINUE), dwControl);
+    }
+
+    DWORD Notify(SC_HANDLE hSc, SC_HANDLE hSvc, DWORD dwMask, HWND hWnd, UINT uMsg) override
+    {
+        nNotifies++;
+        dwNotifyMask = dwMask;
+        hNotifySvc = hSvc;
+        TEST_CHECK(uMsg == WMAPP_TEST_NOTIFY);
+        TEST_CHECK(Find(hSc, FALSE) != NULL);
+        return dwNotifyErr;
+    }
+
+    // The service is reinstalled (i.e. by an Agent upgrade)
+    VOID Reinstall()
+    {
+        dwInstall++;
+        bExists = TRUE;
+        bDeletePending = FALSE;
+    }
+
+    DWORD CountOpen(BOOL bService) const
+    {
+        DWORD nOpen = 0;
+        for (const auto& handle : handles)
+            nOpen += (handle.second.bService == bService);
+        return nOpen;
+    }
+
+private:
+    SC_HANDLE Open(const Handle& handle)
+    {
+        handles[uNextHandle] = handle;
+        return (SC_HANDLE)uNextHandle++;
+    }
+
+    BOOL Fail(DWORD* pnFails, DWORD dwErr)
+    {
+        if (*pnFails == 0)
+            return FALSE;
+        (*pnFails)--;
+        SetLastError(dwErr);
+        return TRUE;
+    }
+
+    // Returns an open handle, setting the last error if it's stale
+    const Handle* Find(SC_HANDLE hHandle, BOOL bService)
+    {
+        auto it = handles.find((ULONG_PTR)hHandle);
+        if (it == handles.end() || it->second.bService != bService) {
+            SetLastError(ERROR_INVALID_HANDLE);
+            return NULL;
+        }
+        if (it->second.dwBoot != dwBoot) {
+            SetLastError(RPC_S_SERVER_UNAVAILABLE);
+            return NULL;
+        }
+        if (bService && it->second.dwInstall != dwInstall) {
+            SetLastError(bDeletePending ? ERROR_SERVICE_MARKED_FOR_DELETE : ERROR_INVALID_HANDLE);
+            return NULL;
+        }
+        return &it->second;
+    }
+
+    BOOL Operate(SC_HANDLE hSvc, DWORD dwRight, DWORD dwControl)
+    {
+        const Handle* pSvc = Find(hSvc, TRUE);
+        if (pSvc == NULL)
+            return FALSE;
+        if ((pSvc->dwAccess & dwRight) != dwRight) {
+            SetLastError(ERROR_ACCESS_DENIED);
+            return FALSE;
+        }
+        if (Fail(&nControlFails, dwControlErr))
+            return FALSE;
+        dwLastControl = dwControl;
+        dwState = (dwRight == SERVICE_STOP ? SERVICE_STOP_PENDING : SERVICE_START_PENDING);
+        return TRUE;
+    }
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Closes a watcher, checking no handle leaked
+static VOID CloseWatch(ServiceWatch* pWatch, FakeServiceBackend* pBackend)
+{
+    ServiceWatchClose(pWatch);
+    TEST_CHECK(pBackend->handles.empty());
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+static VOID TestHandleCache()
+{
+    FakeServiceBackend backend;
+    ServiceWatch watch;
+    ServiceWatchInit(&watch, &backend);
+
+    // The handles are opened once, then served from the cache
+    SERVICE_STATUS status;
+    for (int i = 0; i < 10; i++)
+        TEST_CHECK(ServiceWatchQuery(&watch, &status) && status.dwCurrentState == SERVICE_RUNNING);
+    TEST_CHECK(watch.counters.dwOpens == 2 && watch.counters.dwHits == 9 && watch.counters.dwReopens == 0);
+    TEST_CHECK(backend.CountOpen(FALSE) == 1 && backend.CountOpen(TRUE) == 1);
+
+    // Operations need more rights: the service handle is reopened once with
+    // the union of both, and then serves the queries too
+    UINT uErrResId;
+    TEST_CHECK(ServiceWatchControl(&watch, HANDOFF_SVC_STOP, &uErrResId) == ERROR_SUCCESS);
+    TEST_CHECK(backend.dwLastControl == SERVICE_CONTROL_STOP && backend.dwState == SERVICE_STOP_PENDING);
+    TEST_CHECK(watch.dwSvcAccess == (SVCWATCH_QUERY_ACCESS | SVCWATCH_CONTROL_ACCESS));
+    TEST_CHECK(ServiceWatchQuery(&watch, &status) && status.dwCurrentState == SERVICE_STOP_PENDING);
+    TEST_CHECK(ServiceWatchControl(&watch, HANDOFF_SVC_START, &uErrResId) == ERROR_SUCCESS && backend.nStarts == 1);
+    TEST_CHECK(watch.counters.dwOpens == 3 && watch.counters.dwHits == 11);
+    TEST_CHECK(backend.CountOpen(FALSE) == 1 && backend.CountOpen(TRUE) == 1);
+
+    TEST_CHECK(ServiceWatchControl(&watch, 0, &uErrResId) == ERROR_INVALID_PARAMETER);
+    TEST_CHECK(ServiceWatchControl(&watch, HANDOFF_SVC_CONTINUE + 1, &uErrResId) == ERROR_INVALID_PARAMETER);
+    TEST_CHECK(backend.nStarts == 1 && backend.nControls == 1);
+    CloseWatch(&watch, &backend);
+}
+
+static VOID TestStaleReopen()
+{
+    FakeServiceBackend backend;
+    ServiceWatch watch;
+    ServiceWatchInit(&watch, &backend);
+    SERVICE_STATUS status;
+    TEST_CHECK(ServiceWatchQuery(&watch, &status));
+
+    // Agent upgrade: the query is retried once with new handles
+    backend.Reinstall();
+    backend.dwState = SERVICE_START_PENDING;
+    TEST_CHECK(ServiceWatchQuery(&watch, &status) && status.dwCurrentState == SERVICE_START_PENDING);
+    TEST_CHECK(watch.counters.dwReopens == 1 && watch.counters.dwOpens == 4);
+    TEST_CHECK(backend.nQueries == 3);
+    TEST_CHECK(backend.CountOpen(FALSE) == 1 && backend.CountOpen(TRUE) == 1);
+
+    // SCM restart: same for the operations
+    backend.dwBoot++;
+    UINT uErrResId;
+    TEST_CHECK(ServiceWatchControl(&watch, HANDOFF_SVC_STOP, &uErrResId) == ERROR_SUCCESS);
+    TEST_CHECK(watch.counters.dwReopens == 2 && backend.nControls == 1);
+    TEST_CHECK(backend.CountOpen(FALSE) == 1 && backend.CountOpen(TRUE) == 1);
+
+    // A handle still stale after reopening isn't retried again
+    backend.dwBoot++;
+    backend.dwOpenManagerErr = RPC_S_SERVER_UNAVAILABLE;
+    backend.nOpenManagerFails = 5;
+    TEST_CHECK(!ServiceWatchQuery(&watch, &status));
+    TEST_CHECK(watch.counters.dwReopens == 3 && backend.nOpenManagerFails == 4);
+    TEST_CHECK(ServiceWatchControl(&watch, HANDOFF_SVC_STOP, &uErrResId) == RPC_S_SERVER_UNAVAILABLE);
+    TEST_CHECK(uErrResId == IDS_ERR_SCHANDLE && watch.counters.dwReopens == 3 && backend.nOpenManagerFails == 3);
+    TEST_CHECK(backend.handles.empty());
+
+    // Until the SCM is back
+    backend.nOpenManagerFails = 0;
+    TEST_CHECK(ServiceWatchQuery(&watch, &status));
+    TEST_CHECK(backend.CountOpen(FALSE) == 1 && backend.CountOpen(TRUE) == 1);
+    CloseWatch(&watch, &backend);
+}
+
+static VOID TestFailures()
+{
+    FakeServiceBackend backend;
+    ServiceWatch watch;
+    ServiceWatchInit(&watch, &backend);
+    SERVICE_STATUS status;
+    UINT uErrResId;
+
+    // The SCM can't be opened, then can
+    backend.dwOpenManagerErr = ERROR_ACCESS_DENIED;
+    backend.nOpenManagerFails = 1;
+    TEST_CHECK(!ServiceWatchQuery(&watch, &status) && GetLastError() == ERROR_ACCESS_DENIED);
+    TEST_CHECK(watch.hSc == NULL && watch.counters.dwReopens == 0);
+    TEST_CHECK(ServiceWatchQuery(&watch, &status) && watch.counters.dwOpens == 3);
+
+    // The service can't be opened for the operations: the query handle is kept
+    backend.dwOpenServiceErr = ERROR_ACCESS_DENIED;
+    backend.nOpenServiceFails = 1;
+    TEST_CHECK(ServiceWatchControl(&watch, HANDOFF_SVC_STOP, &uErrResId) == ERROR_ACCESS_DENIED);
+    TEST_CHECK(uErrResId == IDS_ERR_SVCHANDLE && watch.hSvc == NULL && watch.dwSvcAccess == 0);
+    TEST_CHECK(backend.CountOpen(FALSE) == 1 && backend.CountOpen(TRUE) == 0 && backend.nControls == 0);
+
+    // The operation fails, not because of the handles: it isn't retried
+    backend.dwControlErr = ERROR_SERVICE_NOT_ACTIVE;
+    backend.nControlFails = 2;
+    TEST_CHECK(ServiceWatchControl(&watch, HANDOFF_SVC_STOP, &uErrResId) == ERROR_SERVICE_NOT_ACTIVE);
+    TEST_CHECK(uErrResId == IDS_ERR_SVCOPERATION && backend.nControls == 1 && watch.counters.dwReopens == 0);
+    TEST_CHECK(backend.CountOpen(TRUE) == 1);
+
+    // The service doesn't exist
+    ServiceWatchClose(&watch);
+    backend.bExists = FALSE;
+    TEST_CHECK(!ServiceWatchQuery(&watch, &status) && GetLastError() == ERROR_SERVICE_DOES_NOT_EXIST);
+    TEST_CHECK(ServiceWatchControl(&watch, HANDOFF_SVC_START, &uErrResId) == ERROR_SERVICE_DOES_NOT_EXIST);
+    TEST_CHECK(uErrResId == IDS_ERR_SVCHANDLE && backend.nStarts == 0);
+    TEST_CHECK(backend.CountOpen(TRUE) == 0);
+    CloseWatch(&watch, &backend);
+}
+
+static VOID TestDeletePending()
+{
+    FakeServiceBackend backend;
+    ServiceWatch watch;
+    ServiceWatchInit(&watch, &backend);
+    TEST_CHECK(ServiceWatchArm(&watch, SERVICE_RUNNING, NULL, WMAPP_TEST_NOTIFY));
+
+    // The service is marked for deletion: no service handle is kept open
+    backend.bDeletePending = TRUE;
+    backend.dwState = SERVICE_STOPPED;
+    DWORD dwState = 0;
+    TEST_CHECK(ServiceWatchOnNotify(&watch, ERROR_SUCCESS, MAKELPARAM(SERVICE_NOTIFY_DELETE_PENDING, SERVICE_RUNNING), &dwState));
+    TEST_CHECK(dwState == SERVICE_STOPPED && watch.bDeletePending && !watch.bWatchActive);
+    TEST_CHECK(backend.CountOpen(TRUE) == 0);
+    DWORD dwOpens = watch.counters.dwOpens;
+    SERVICE_STATUS status;
+    TEST_CHECK(ServiceWatchQuery(&watch, &status) && ServiceWatchQuery(&watch, &status));
+    TEST_CHECK(watch.counters.dwOpens == dwOpens + 2 && backend.CountOpen(TRUE) == 0);
+    UINT uErrResId;
+    TEST_CHECK(ServiceWatchControl(&watch, HANDOFF_SVC_START, &uErrResId) == ERROR_SERVICE_MARKED_FOR_DELETE);
+    TEST_CHECK(backend.nStarts == 0);
+
+    // Only the service creation is watched
+    TEST_CHECK(ServiceWatchArm(&watch, SERVICE_STOPPED, NULL, WMAPP_TEST_NOTIFY));
+    TEST_CHECK(backend.dwNotifyMask == SERVICE_NOTIFY_CREATED && backend.hNotifySvc == NULL);
+
+    // The service is reinstalled
+    backend.bExists = FALSE;
+    backend.Reinstall();
+    TEST_CHECK(ServiceWatchOnNotify(&watch, ERROR_SUCCESS, MAKELPARAM(SERVICE_NOTIFY_CREATED, 0), &dwState));
+    TEST_CHECK(dwState == SERVICE_STOPPED && !watch.bDeletePending);
+    TEST_CHECK(backend.CountOpen(FALSE) == 1 && backend.CountOpen(TRUE) == 1);
+
+    // The polling fallback drops the pending deletion once the service is gone
+    backend.bDeletePending = TRUE;
+    watch.bDeletePending = TRUE;
+    backend.bExists = FALSE;
+    TEST_CHECK(!ServiceWatchPoll(&watch, &dwState) && !watch.bDeletePending);
+    TEST_CHECK(backend.CountOpen(TRUE) == 0);
+    CloseWatch(&watch, &backend);
+}
+
+static VOID TestNotify()
+{
+    FakeServiceBackend backend;
+    ServiceWatch watch;
+    ServiceWatchInit(&watch, &backend);
+
+    // Every state but the one known is watched, and the deletion
+    TEST_CHECK(ServiceWatchArm(&watch, SERVICE_RUNNING, NULL, WMAPP_TEST_NOTIFY));
+    TEST_CHECK(watch.bWatchActive && backend.hNotifySvc == watch.hSvc);
+    TEST_CHECK(backend.dwNotifyMask == ((SVCWATCH_NOTIFY_STATES & ~SERVICE_NOTIFY_RUNNING) | SERVICE_NOTIFY_DELETE_PENDING));
+    TEST_CHECK(ServiceWatchArm(&watch, SERVICE_STOPPED, NULL, WMAPP_TEST_NOTIFY));
+    TEST_CHECK(backend.dwNotifyMask == ((SVCWATCH_NOTIFY_STATES & ~SERVICE_NOTIFY_STOPPED) | SERVICE_NOTIFY_DELETE_PENDING));
+    TEST_CHECK(ServiceWatchArm(&watch, 0, NULL, WMAPP_TEST_NOTIFY));
+    TEST_CHECK(backend.dwNotifyMask == (SVCWATCH_NOTIFY_STATES | SERVICE_NOTIFY_DELETE_PENDING));
+
+    // A state change is taken from the notification, with no query
+    DWORD nQueries = backend.nQueries;
+    DWORD dwState = 0;
+    TEST_CHECK(ServiceWatchOnNotify(&watch, ERROR_SUCCESS, MAKELPARAM(SERVICE_NOTIFY_STOP_PENDING, SERVICE_STOP_PENDING), &dwState));
+    TEST_CHECK(dwState == SERVICE_STOP_PENDING && !watch.bWatchActive && backend.nQueries == nQueries);
+    TEST_CHECK(backend.CountOpen(TRUE) == 1);
+
+    // A failed notification releases the handles, then queries the status
+    TEST_CHECK(ServiceWatchArm(&watch, SERVICE_STOP_PENDING, NULL, WMAPP_TEST_NOTIFY));
+    TEST_CHECK(ServiceWatchOnNotify(&watch, ERROR_SERVICE_MARKED_FOR_DELETE, 0, &dwState));
+    TEST_CHECK(dwState == SERVICE_RUNNING && backend.nQueries == nQueries + 1 && !watch.bDeletePending);
+
+    // A notification that can't be armed releases the handles
+    backend.dwNotifyErr = ERROR_NOT_ENOUGH_MEMORY;
+    TEST_CHECK(!ServiceWatchArm(&watch, SERVICE_RUNNING, NULL, WMAPP_TEST_NOTIFY));
+    TEST_CHECK(!watch.bWatchActive && backend.handles.empty());
+
+    // Neither the service nor the SCM can be opened
+    backend.dwNotifyErr = ERROR_SUCCESS;
+    backend.dwOpenManagerErr = ERROR_ACCESS_DENIED;
+    backend.nOpenManagerFails = 2;
+    DWORD nNotifies = backend.nNotifies;
+    TEST_CHECK(!ServiceWatchArm(&watch, SERVICE_RUNNING, NULL, WMAPP_TEST_NOTIFY));
+    TEST_CHECK(backend.nNotifies == nNotifies && !watch.bWatchActive);
+    CloseWatch(&watch, &backend);
+}
+
+static VOID TestPollInterval()
+{
+    FakeServiceBackend backend;
+    ServiceWatch watch;
+    ServiceWatchInit(&watch, &backend);
+    TEST_CHECK(watch.uPollInterval == SVCPOLL_MIN_INTERVAL);
+
+    // Steady service: exponential backoff up to the maximum
+    UINT uExpected = SVCPOLL_MIN_INTERVAL;
+    for (int i = 0; i < 8; i++) {
+        uExpected = (uExpected * 2 < SVCPOLL_MAX_INTERVAL ? uExpected * 2 : SVCPOLL_MAX_INTERVAL);
+        TEST_CHECK(ServiceWatchNextInterval(&watch, FALSE, SERVICE_RUNNING, SVCPOLL_MAX_INTERVAL) == uExpected);
+    }
+    TEST_CHECK(watch.uPollInterval == SVCPOLL_MAX_INTERVAL);
+
+    // Changing or pending states poll fast again
+    TEST_CHECK(ServiceWatchNextInterval(&watch, TRUE, SERVICE_STOPPED, SVCPOLL_MAX_INTERVAL) == SVCPOLL_MIN_INTERVAL);
+    ServiceWatchNextInterval(&watch, FALSE, SERVICE_STOPPED, SVCPOLL_MAX_INTERVAL);
+    TEST_CHECK(ServiceWatchNextInterval(&watch, FALSE, SERVICE_START_PENDING, SVCPOLL_MAX_INTERVAL) == SVCPOLL_MIN_INTERVAL);
+
+    // Hidden window: longer backoff, back to fast once shown again
+    while (ServiceWatchNextInterval(&watch, FALSE, SERVICE_PAUSED, SVCPOLL_HIDDEN_MAX_INTERVAL) < SVCPOLL_HIDDEN_MAX_INTERVAL);
+    TEST_CHECK(ServiceWatchNextInterval(&watch, FALSE, SERVICE_PAUSED, SVCPOLL_MAX_INTERVAL) == SVCPOLL_MIN_INTERVAL);
+
+    // Armed notifications: polling is only a safety net
+    TEST_CHECK(ServiceWatchArm(&watch, SERVICE_RUNNING, NULL, WMAPP_TEST_NOTIFY));
+    TEST_CHECK(ServiceWatchNextInterval(&watch, TRUE, SERVICE_START_PENDING, SVCPOLL_MAX_INTERVAL) == SVCPOLL_WATCH_INTERVAL);
+    CloseWatch(&watch, &backend);
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestHandleCache);
+    TEST_RUN(TestStaleReopen);
+    TEST_RUN(TestFailures);
+    TEST_RUN(TestDeletePending);
+    TEST_RUN(TestNotify);
+    TEST_RUN(TestPollInterval);
+    return TestResult();
+}
@@ -0,0 +1,255 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  SharedStatusTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <new>
+#include <thread>
+#include <wchar.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#include "framework.h"
+#include "SharedStatus.h"
+#include "Test.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// Writes done by the stress test
+#define STRESS_WRITES           1000000
+
+// Block mapped by the stress test writer and reader
+struct StressMapping {
+    SharedStatusBlock block;
+    std::atomic<DWORD> dwReading;       // The reader started
+    std::atomic<DWORD> dwDone;
+};
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Fills data whose fields all derive from its sequence number, so that a torn
+// read is noticed
+static VOID MakeData(DWORD dwSeq, SharedStatusData* pData)
+{
+    ZeroMemory(pData, sizeof(SharedStatusData));
+    pData->ullHeartbeat = dwSeq * 3ULL;
+    pData->ullResponse = dwSeq * 2ULL;
+    pData->dwResponseSeq = dwSeq;
+    pData->dwError = ~dwSeq;
+    pData->dwStatusCode = 100 + dwSeq % 500;
+    pData->bStatusFound = dwSeq & 1;
+    swprintf(pData->szStatus, ARRAYSIZE(pData->szStatus), L"status %u", (unsigned)dwSeq);
+}
+
+static BOOL CheckData(const SharedStatusData* pData)
+{
+    SharedStatusData expected;
+    MakeData(pData->dwResponseSeq, &expected);
+    return pData->ullHeartbeat == expected.ullHeartbeat && pData->ullResponse == expected.ullResponse &&
+        pData->dwError == expected.dwError && SharedStatusSameResponse(pData, &expected);
+}
+
+static VOID StressWrite(StressMapping* pMapping)
+{
+    SharedStatusData data;
+    while (!pMapping->dwReading.load(std::memory_order_acquire))
+        std::this_thread::yield();
+    for (DWORD dwSeq = 1; dwSeq <= STRESS_WRITES; dwSeq++) {
+        MakeData(dwSeq, &data);
+        SharedStatusWrite(&pMapping->block, &data);
+    }
+    pMapping->dwDone.store(1, std::memory_order_release);
+}
+
+// Reads the block until the writer is done, counting the torn and out of order reads
+static VOID StressRead(StressMapping* pMapping, DWORD* pdwTorn, DWORD* pdwOutOfOrder, DWORD* pdwLast)
+{
+    SharedStatusData data;
+    DWORD dwLast = 0;
+    BOOL bDone;
+    pMapping->dwReading.store(1, std::memory_order_release);
+    do {
+        bDone = pMapping->dwDone.load(std::memory_order_acquire);
+        if (!SharedStatusRead(&pMapping->block, &data))
+            continue;
+        if (!CheckData(&data))
+            (*pdwTorn)++;
+        if (data.dwResponseSeq < dwLast)
+            (*pdwOutOfOrder)++;
+        dwLast = data.dwResponseSeq;
+    } while (!bDone);
+    *pdwLast = dwLast;
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+static VOID TestReadWrite()
+{
+    static SharedStatusBlock block;
+    SharedStatusData data, read;
+
+    // A new file reads as zeros
+    TEST_CHECK(!SharedStatusRead(&block, &read));
+
+    MakeData(5, &data);
+    SharedStatusWrite(&block, &data);
+    TEST_CHECK(SharedStatusRead(&block, &read) && CheckData(&read) && read.dwResponseSeq == 5);
+    TEST_CHECK(block.dwSeq.load() == 2);
+
+    // A leader that died while writing
+    block.dwSeq.store(3);
+    TEST_CHECK(!SharedStatusRead(&block, &read));
+    MakeData(6, &data);
+    SharedStatusWrite(&block, &data);
+    TEST_CHECK(block.dwSeq.load() == 6);
+    TEST_CHECK(SharedStatusRead(&block, &read) && read.dwResponseSeq == 6);
+
+    // Another layout
+    block.dwVersion = SHAREDSTATUS_VERSION + 1;
+    TEST_CHECK(!SharedStatusRead(&block, &read));
+
+    // An unterminated status
+    SharedStatusWrite(&block, &data);
+    wmemset(block.data.szStatus, L'x', ARRAYSIZE(block.data.szStatus));
+    TEST_CHECK(SharedStatusRead(&block, &read) && wcslen(read.szStatus) == ARRAYSIZE(read.szStatus) - 1);
+}
+
+static VOID TestValidate()
+{
+    SharedStatusData data = {};
+    data.ullHeartbeat = 10000;
+    data.ullResponse = 9000;
+    data.dwStatusCode = 200;
+    data.bStatusFound = TRUE;
+    wcscpy_s(data.szStatus, L"waiting");
+    TEST_CHECK(SharedStatusValidate(&data, 10000));
+    TEST_CHECK(SharedStatusValidate(&data, 10000 - SHAREDSTATUS_MAX_SKEW));
+    TEST_CHECK(!SharedStatusValidate(&data, 10000 - SHAREDSTATUS_MAX_SKEW - 1));
+
+    SharedStatusData forged = data;
+    forged.ullResponse = forged.ullHeartbeat + 1;
+    TEST_CHECK(!SharedStatusValidate(&forged, 20000));
+
+    forged = data;
+    forged.dwStatusCode = 99;
+    TEST_CHECK(!SharedStatusValidate(&forged, 20000));
+    forged.dwStatusCode = 600;
+    TEST_CHECK(!SharedStatusValidate(&forged, 20000));
+    forged.dwStatusCode = 0;
+    TEST_CHECK(SharedStatusValidate(&forged, 20000));
+
+    forged = data;
+    wcscpy_s(forged.szStatus, L"waiting\r\nrunning");
+    TEST_CHECK(!SharedStatusValidate(&forged, 20000));
+    forged.szStatus[7] = 0x7F;
+    TEST_CHECK(!SharedStatusValidate(&forged, 20000));
+}
+
+static VOID TestSameResponse()
+{
+    SharedStatusData data, other;
+    MakeData(7, &data);
+    other = data;
+    other.ullHeartbeat++;
+    other.ullResponse++;
+    other.dwResponseSeq++;
+    TEST_CHECK(SharedStatusSameResponse(&data, &other));
+
+    other = data;
+    other.dwError++;
+    TEST_CHECK(!SharedStatusSameResponse(&data, &other));
+    other = data;
+    other.dwStatusCode++;
+    TEST_CHECK(!SharedStatusSameResponse(&data, &other));
+    other = data;
+    other.bStatusFound = !other.bStatusFound;
+    TEST_CHECK(!SharedStatusSameResponse(&data, &other));
+    other = data;
+    other.szStatus[0] = L'S';
+    TEST_CHECK(!SharedStatusSameResponse(&data, &other));
+}
+
+// A writer and a reader in two processes sharing the block (two threads on
+// Windows, where the block is mapped by the Monitors the same way)
+static VOID TestStress()
+{
+    DWORD dwTorn = 0, dwOutOfOrder = 0, dwLast = 0;
+#ifndef _WIN32
+    PVOID pView = mmap(NULL, sizeof(StressMapping), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    TEST_CHECK(pView != MAP_FAILED);
+    if (pView == MAP_FAILED)
+        return;
+    StressMapping* pMapping = new (pView) StressMapping();
+
+    pid_t pid = fork();
+    TEST_CHECK(pid >= 0);
+    if (pid == 0) {
+        StressWrite(pMapping);
+        _exit(0);
+    }
+    if (pid > 0) {
+        StressRead(pMapping, &dwTorn, &dwOutOfOrder, &dwLast);
+        int nStatus = 0;
+        TEST_CHECK(waitpid(pid, &nStatus, 0) == pid && WIFEXITED(nStatus) && WEXITSTATUS(nStatus) == 0);
+    }
+    munmap(pView, sizeof(StressMapping));
+#else
+    static StressMapping mapping;
+    std::thread writer(StressWrite, &mapping);
+    StressRead(&mapping, &dwTorn, &dwOutOfOrder, &dwLast);
+    writer.join();
+#endif
+    TEST_CHECK(dwTorn == 0);
+    TEST_CHECK(dwOutOfOrder == 0);
+    TEST_CHECK(dwLast == STRESS_WRITES);
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestReadWrite);
+    TEST_RUN(TestValidate);
+    TEST_RUN(TestSameResponse);
+    TEST_RUN(TestStress);
+    return TestResult();
+}
@@ -0,0 +1,233 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  SnapshotJsonTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <string>
+#include <windows.h>
+#include <shellapi.h>
+#include "framework.h"
+#include "resource.h"
+#include "MonitorSnapshot.h"
+#include "Test.h"
+
+using namespace std;
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// Notification resource IDs (any value does)
+#define TEST_TITLE_RESID        101
+#define TEST_MSG_RESID          202
+
+// Time of the lines written
+static const SYSTEMTIME stTest = { 2025, 3, 0, 9, 14, 5, 7, 42 };
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+static LPCWSTR TestGetString(UINT uId)
+{
+    switch (uId)
+    {
+        case TEST_TITLE_RESID:
+            return L"GLPI Agent";
+        case TEST_MSG_RESID:
+            return L"Service \"stopped\"\r\nat 100%";
+        default:
+            return L"";
+    }
+}
+
+// Snapshot fixture: a running Agent with everything probed
+static MonitorSnapshot MakeFixture()
+{
+    MonitorSnapshot snapshot = {};
+    snapshot.dwVersion = 17;
+    MonitorSnapshotSetService(&snapshot, TRUE, SERVICE_RUNNING);
+    wcscpy_s(snapshot.szAgStatus, L"waiting");
+    snapshot.config.bInstalled = TRUE;
+    snapshot.config.bVersionFound = TRUE;
+    wcscpy_s(snapshot.config.szVersion, L"1.15");
+    snapshot.config.uStartTypeResId = IDS_SVCSTART_DELAYEDAUTO;
+    snapshot.dwEndpoints = 3;
+    snapshot.dwEndpointsResponding = 2;
+    snapshot.dwLastInvState = LASTINV_FAILED;
+    snapshot.dwLastInvErrors = 4;
+    return snapshot;
+}
+
+static string Format(const MonitorSnapshot* pSnapshot, DWORD dwChanged)
+{
+    string strJson;
+    SnapshotJsonFormat(strJson, pSnapshot, dwChanged, &stTest, TestGetString);
+    return strJson;
+}
+
+static string AppendString(LPCWSTR szValue)
+{
+    string strJson;
+    JsonAppendString(strJson, szValue);
+    return strJson;
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+static VOID TestFixture()
+{
+    MonitorSnapshot snapshot = MakeFixture();
+    TEST_CHECK(Format(&snapshot, SNAPSHOT_ALL) ==
+        "{\"seq\":17,\"time\":\"2025-03-09T14:05:07.042Z\",\"changed\":255,"
+        "\"service\":\"running\",\"agentOk\":true,\"agentStatus\":\"waiting\","
+        "\"agentInstalled\":true,\"agentVersion\":\"1.15\",\"startType\":\"delayed_auto\","
+        "\"endpoints\":{\"total\":3,\"responding\":2},"
+        "\"lastInventory\":{\"result\":\"failed\",\"errors\":4}}");
+
+    // The line is appended to what's already there
+    string strJson = "x";
+    SnapshotJsonFormat(strJson, &snapshot, 0, &stTest, TestGetString);
+    TEST_CHECK(strJson.compare(0, 10, "x{\"seq\":17") == 0 && strJson.back() == '}');
+}
+
+// Optional fields are left out (or null) until probed
+static VOID TestNotProbed()
+{
+    MonitorSnapshot snapshot = {};
+    TEST_CHECK(Format(&snapshot, SNAPSHOT_ALL) ==
+        "{\"seq\":0,\"time\":\"2025-03-09T14:05:07.042Z\",\"changed\":255,"
+        "\"service\":\"error\",\"agentOk\":false,\"agentStatus\":\"\","
+        "\"agentInstalled\":false,\"agentVersion\":null,\"startType\":\"unknown\"}");
+
+    snapshot = MakeFixture();
+    snapshot.dwLastInvState = LASTINV_OK;
+    snapshot.dwLastInvErrors = 0;
+    TEST_CHECK(Format(&snapshot, 0).find(",\"lastInventory\":{\"result\":\"ok\",\"errors\":0}}") != string::npos);
+}
+
+// Every service state has a name, and a failed query overrides the last state
+static VOID TestServiceNames()
+{
+    static const struct {
+        DWORD dwState;
+        LPCSTR szName;
+    } names[] = {
+        { SERVICE_STOPPED,          "stopped" },
+        { SERVICE_START_PENDING,    "start_pending" },
+        { SERVICE_STOP_PENDING,     "stop_pending" },
+        { SERVICE_RUNNING,          "running" },
+        { SERVICE_CONTINUE_PENDING, "continue_pending" },
+        { SERVICE_PAUSE_PENDING,    "pause_pending" },
+        { SERVICE_PAUSED,           "paused" }
+    };
+    for (size_t i = 0; i < ARRAYSIZE(names); i++) {
+        MonitorSnapshot snapshot = MakeFixture();
+        MonitorSnapshotSetService(&snapshot, TRUE, names[i].dwState);
+        TEST_CHECK(strcmp(SnapshotJsonServiceName(&snapshot), names[i].szName) == 0);
+        string strExpected = string("\"service\":\"") + names[i].szName + "\",\"agentOk\":" +
+            (names[i].dwState == SERVICE_RUNNING ? "true" : "false");
+        TEST_CHECK(Format(&snapshot, SNAPSHOT_SERVICE).find(strExpected) != string::npos);
+
+        MonitorSnapshotSetService(&snapshot, FALSE, 0);
+        TEST_CHECK(strcmp(SnapshotJsonServiceName(&snapshot), "error") == 0);
+    }
+
+    MonitorSnapshot snapshot = MakeFixture();
+    snapshot.dwSvcState = 0x42;
+    TEST_CHECK(strcmp(SnapshotJsonServiceName(&snapshot), "error") == 0);
+}
+
+// The notification is only written on the line it was queued for
+static VOID TestNotification()
+{
+    MonitorSnapshot snapshot = MakeFixture();
+    TEST_CHECK(Format(&snapshot, SNAPSHOT_NOTIFICATION).find("notification") == string::npos);
+
+    MonitorSnapshotNotify(&snapshot, TEST_TITLE_RESID, TEST_MSG_RESID, NIIF_WARNING | NIIF_NOSOUND);
+    string strJson = Format(&snapshot, SNAPSHOT_NOTIFICATION);
+    static const char szExpected[] =
+        ",\"notification\":{\"level\":\"warning\",\"title\":\"GLPI Agent\","
+        "\"message\":\"Service \\\"stopped\\\"\\r\\nat 100%\"}}";
+    TEST_CHECK(strJson.size() > sizeof(szExpected) - 1 &&
+        strJson.compare(strJson.size() - (sizeof(szExpected) - 1), string::npos, szExpected) == 0);
+    TEST_CHECK(Format(&snapshot, SNAPSHOT_SERVICE).find("notification") == string::npos);
+
+    MonitorSnapshotNotify(&snapshot, TEST_TITLE_RESID, TEST_MSG_RESID, NIIF_ERROR);
+    TEST_CHECK(Format(&snapshot, SNAPSHOT_ALL).find("{\"level\":\"error\"") != string::npos);
+    MonitorSnapshotNotify(&snapshot, TEST_TITLE_RESID, TEST_MSG_RESID, NIIF_INFO);
+    TEST_CHECK(Format(&snapshot, SNAPSHOT_ALL).find("{\"level\":\"info\"") != string::npos);
+    MonitorSnapshotNotify(&snapshot, TEST_TITLE_RESID, 999, NIIF_NONE);
+    TEST_CHECK(Format(&snapshot, SNAPSHOT_ALL).find("{\"level\":\"info\",\"title\":\"GLPI Agent\",\"message\":\"\"}") != string::npos);
+}
+
+// Strings are UTF-8 encoded, and what JSON doesn't allow raw is escaped
+static VOID TestStrings()
+{
+    TEST_CHECK(AppendString(L"") == "\"\"");
+    TEST_CHECK(AppendString(L"a\"b\\c/d") == "\"a\\\"b\\\\c/d\"");
+    TEST_CHECK(AppendString(L"\t\r\n\x01\x1f ") == "\"\\t\\r\\n\\u0001\\u001f \"");
+    TEST_CHECK(AppendString(L"\x7f") == "\"\x7f\"");
+    TEST_CHECK(AppendString(L"déjà €") == "\"d\xc3\xa9j\xc3\xa0 \xe2\x82\xac\"");
+
+    // No raw control character, whatever the string
+    WCHAR szAll[0x80];
+    for (int i = 1; i < 0x80; i++)
+        szAll[i - 1] = (WCHAR)i;
+    szAll[0x7f] = '\0';
+    string strJson = AppendString(szAll);
+    for (size_t i = 0; i < strJson.size(); i++)
+        TEST_CHECK((unsigned char)strJson[i] >= 0x20);
+
+    // Long strings aren't cut
+    MonitorSnapshot snapshot = MakeFixture();
+    for (size_t i = 0; i < ARRAYSIZE(snapshot.szAgStatus) - 1; i++)
+        snapshot.szAgStatus[i] = 0x20ac;
+    snapshot.szAgStatus[ARRAYSIZE(snapshot.szAgStatus) - 1] = '\0';
+    strJson = AppendString(snapshot.szAgStatus);
+    TEST_CHECK(strJson.size() == 2 + 3 * (ARRAYSIZE(snapshot.szAgStatus) - 1));
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestFixture);
+    TEST_RUN(TestNotProbed);
+    TEST_RUN(TestServiceNames);
+    TEST_RUN(TestNotification);
+    TEST_RUN(TestStrings);
+    return TestResult();
+}
@@ -0,0 +1,139 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  SpscChannelTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <thread>
+#include <wchar.h>
+#include "framework.h"
+#include "SpscChannel.h"
+#include "MonitorSnapshot.h"
+#include "Test.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// Snapshots sent through the channel by the stress test
+#define STRESS_SNAPSHOTS        200000
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Fills a snapshot whose fields all derive from its version, so that a torn
+// copy is noticed
+static VOID MakeSnapshot(DWORD dwVersion, MonitorSnapshot* pSnapshot)
+{
+    pSnapshot->dwVersion = dwVersion;
+    pSnapshot->dwSvcState = dwVersion % 7;
+    swprintf(pSnapshot->szAgStatus, AGENTSTATUS_MAX_VALUE, L"status %u", (unsigned)dwVersion);
+    swprintf(pSnapshot->config.szVersion, ARRAYSIZE(pSnapshot->config.szVersion), L"1.%u", (unsigned)(dwVersion * 3));
+    pSnapshot->dwNotifySeq = dwVersion / 5;
+    pSnapshot->dwLastInvErrors = ~dwVersion;
+}
+
+static BOOL CheckSnapshot(const MonitorSnapshot* pSnapshot)
+{
+    MonitorSnapshot expected = {};
+    MakeSnapshot(pSnapshot->dwVersion, &expected);
+    return (pSnapshot->dwSvcState == expected.dwSvcState && pSnapshot->dwNotifySeq == expected.dwNotifySeq &&
+        pSnapshot->dwLastInvErrors == expected.dwLastInvErrors && MonitorSnapshotDiff(pSnapshot, &expected) == 0);
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+static VOID TestFifo()
+{
+    SpscChannel<DWORD, 8> channel;
+    DWORD dwItem = 0;
+    TEST_CHECK(!channel.Pop(&dwItem));
+    for (DWORD i = 0; i < 7; i++)
+        TEST_CHECK(channel.Push(i));
+    TEST_CHECK(!channel.Push(7));
+    for (DWORD i = 0; i < 7; i++)
+        TEST_CHECK(channel.Pop(&dwItem) && dwItem == i);
+    TEST_CHECK(!channel.Pop(&dwItem));
+
+    // Across the wraparound
+    for (DWORD i = 0; i < 100; i++) {
+        TEST_CHECK(channel.Push(i) && channel.Push(i + 1000));
+        TEST_CHECK(channel.Pop(&dwItem) && dwItem == i);
+        TEST_CHECK(channel.Pop(&dwItem) && dwItem == i + 1000);
+    }
+}
+
+// A producer and a consumer thread, as the probe worker and the main window:
+// every snapshot is received once, in order and whole
+static VOID TestStress()
+{
+    static SpscChannel<MonitorSnapshot, 16> channel;
+    std::thread producer([] {
+        MonitorSnapshot snapshot = {};
+        for (DWORD dwVersion = 1; dwVersion <= STRESS_SNAPSHOTS; dwVersion++) {
+            MakeSnapshot(dwVersion, &snapshot);
+            while (!channel.Push(snapshot))
+                std::this_thread::yield();
+        }
+    });
+
+    DWORD dwExpected = 1, dwTorn = 0, dwOutOfOrder = 0;
+    MonitorSnapshot snapshot;
+    while (dwExpected <= STRESS_SNAPSHOTS) {
+        if (!channel.Pop(&snapshot)) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (snapshot.dwVersion != dwExpected)
+            dwOutOfOrder++;
+        if (!CheckSnapshot(&snapshot))
+            dwTorn++;
+        dwExpected = snapshot.dwVersion + 1;
+    }
+    producer.join();
+    TEST_CHECK(dwOutOfOrder == 0);
+    TEST_CHECK(dwTorn == 0);
+    TEST_CHECK(!channel.Pop(&snapshot));
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestFifo);
+    TEST_RUN(TestStress);
+    return TestResult();
+}
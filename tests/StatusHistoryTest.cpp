@@ -0,0 +1,254 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  StatusHistoryTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <wchar.h>
+#include <vector>
+#include "framework.h"
+#include "StatusHistory.h"
+#include "Test.h"
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+#define HISTORY_PATH            L"StatusHistoryTest.dat"
+
+// Records the ring holds (see HistoryCapacity)
+#define HISTORY_CAPACITY        ((HISTORY_FILE_SIZE - sizeof(HistoryHeader) - HISTORY_MAX_STRINGS * sizeof(HistoryString)) / sizeof(HistoryRecord))
+
+// One record in STRING_PERIOD is a string in the wraparound test, fewer than
+// the strings table holds being in the ring at once
+#define STRING_PERIOD           200
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+static BOOL OpenNew()
+{
+    HistoryClose();
+    DeleteFile(HISTORY_PATH);
+    return HistoryOpen(HISTORY_PATH);
+}
+
+static std::vector<HistoryEntry> CopyAll()
+{
+    std::vector<HistoryEntry> entries(HistoryGetCount() + 1);
+    entries.resize(HistoryCopy(entries.data(), (DWORD)entries.size()));
+    return entries;
+}
+
+static BOOL HasString(const HistoryEntry* pEntry, LPCWSTR szExpected)
+{
+    WCHAR szValue[HISTORY_MAX_STRING];
+    return pEntry->wType == HISTORY_AGENTSTATUS && pEntry->wValue != HISTORY_NO_STRING &&
+        HistoryGetString(pEntry->wValue, szValue, ARRAYSIZE(szValue)) && wcscmp(szValue, szExpected) == 0;
+}
+
+// Records of the wraparound test, by absolute index
+static VOID AppendNth(DWORD dwIndex)
+{
+    if (dwIndex % STRING_PERIOD == 0) {
+        WCHAR szStatus[32];
+        swprintf_s(szStatus, L"status %u", dwIndex / STRING_PERIOD);
+        HistoryAppendString(HISTORY_AGENTSTATUS, szStatus);
+    }
+    else {
+        HistoryAppend(HISTORY_SERVICE, dwIndex % 7 + 1);
+    }
+}
+
+static BOOL CheckNth(const HistoryEntry* pEntry, DWORD dwIndex)
+{
+    if (dwIndex % STRING_PERIOD != 0)
+        return pEntry->wType == HISTORY_SERVICE && pEntry->wValue == dwIndex % 7 + 1;
+    WCHAR szStatus[32];
+    swprintf_s(szStatus, L"status %u", dwIndex / STRING_PERIOD);
+    return HasString(pEntry, szStatus);
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+static VOID TestEncodeDecode()
+{
+    TEST_CHECK(OpenNew());
+    TEST_CHECK(HistoryGetCount() == 0);
+
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    ULONGLONG ullStart = (((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime) / 10000000;
+    WCHAR szLong[HISTORY_MAX_STRING * 2];
+    wmemset(szLong, L'x', ARRAYSIZE(szLong) - 1);
+    szLong[ARRAYSIZE(szLong) - 1] = '\0';
+
+    HistoryAppend(HISTORY_SERVICE, SERVICE_RUNNING);
+    HistoryAppendString(HISTORY_AGENTSTATUS, L"waiting");
+    HistoryAppend(HISTORY_AGENTERROR, 12029);
+    HistoryAppend(HISTORY_AGENTHTTP, 500);
+    HistoryAppendString(HISTORY_AGENTSTATUS, L"running task Inventory");
+    HistoryAppendString(HISTORY_AGENTSTATUS, L"waiting");
+    HistoryAppendString(HISTORY_AGENTSTATUS, szLong);
+    HistoryAppend(HISTORY_AGENTERROR, 0x12345);
+    HistoryAppend(HISTORY_SERVICE, 0);
+
+    std::vector<HistoryEntry> entries = CopyAll();
+    TEST_CHECK(entries.size() == 9 && HistoryGetCount() == 9);
+    if (entries.size() != 9)
+        return;
+    TEST_CHECK(entries[0].wType == HISTORY_SERVICE && entries[0].wValue == SERVICE_RUNNING);
+    TEST_CHECK(HasString(&entries[1], L"waiting"));
+    TEST_CHECK(entries[2].wType == HISTORY_AGENTERROR && entries[2].wValue == 12029);
+    TEST_CHECK(entries[3].wType == HISTORY_AGENTHTTP && entries[3].wValue == 500);
+    TEST_CHECK(HasString(&entries[4], L"running task Inventory"));
+    TEST_CHECK(entries[5].wValue == entries[1].wValue);
+    szLong[HISTORY_MAX_STRING - 1] = '\0';
+    TEST_CHECK(HasString(&entries[6], szLong));
+    TEST_CHECK(entries[7].wValue == 0xFFFF);
+    TEST_CHECK(entries[8].wType == HISTORY_SERVICE && entries[8].wValue == 0);
+
+    GetSystemTimeAsFileTime(&ft);
+    ULONGLONG ullEnd = (((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime) / 10000000;
+    BOOL bOrdered = TRUE;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].ullTime < ullStart || entries[i].ullTime > ullEnd || (i > 0 && entries[i].ullTime < entries[i - 1].ullTime))
+            bOrdered = FALSE;
+    }
+    TEST_CHECK(bOrdered);
+
+    // Fewer entries than recorded
+    HistoryEntry first[2];
+    TEST_CHECK(HistoryCopy(first, 2) == 2 && first[1].wValue == entries[1].wValue);
+    WCHAR szValue[HISTORY_MAX_STRING];
+    TEST_CHECK(!HistoryGetString(HISTORY_NO_STRING, szValue, ARRAYSIZE(szValue)));
+    HistoryClose();
+}
+
+// The ring wraps around several times, with more distinct strings than the
+// table holds: the strings of the dropped records are reclaimed
+static VOID TestWraparound()
+{
+    TEST_CHECK(OpenNew());
+    DWORD dwTotal = 3 * HISTORY_CAPACITY + 123;
+    TEST_CHECK(dwTotal / STRING_PERIOD > HISTORY_MAX_STRINGS && HISTORY_CAPACITY / STRING_PERIOD < HISTORY_MAX_STRINGS);
+    for (DWORD i = 0; i < dwTotal; i++)
+        AppendNth(i);
+
+    std::vector<HistoryEntry> entries = CopyAll();
+    TEST_CHECK(entries.size() == HISTORY_CAPACITY);
+    DWORD dwMismatches = 0;
+    for (DWORD i = 0; i < entries.size(); i++) {
+        if (!CheckNth(&entries[i], dwTotal - HISTORY_CAPACITY + i))
+            dwMismatches++;
+    }
+    TEST_CHECK(dwMismatches == 0);
+
+    // The counts are rebuilt when the file is opened again
+    HistoryClose();
+    TEST_CHECK(HistoryOpen(HISTORY_PATH));
+    for (DWORD i = dwTotal; i < dwTotal + HISTORY_CAPACITY / 2; i++)
+        AppendNth(i);
+    dwTotal += HISTORY_CAPACITY / 2;
+    entries = CopyAll();
+    dwMismatches = 0;
+    for (DWORD i = 0; i < entries.size(); i++) {
+        if (!CheckNth(&entries[i], dwTotal - HISTORY_CAPACITY + i))
+            dwMismatches++;
+    }
+    TEST_CHECK(entries.size() == HISTORY_CAPACITY && dwMismatches == 0);
+    HistoryClose();
+}
+
+// More distinct strings in the ring than the table holds: the extra ones are
+// recorded as HISTORY_NO_STRING, until older records are dropped
+static VOID TestTableFull()
+{
+    TEST_CHECK(OpenNew());
+    WCHAR szStatus[32];
+    for (DWORD i = 0; i < HISTORY_MAX_STRINGS + 10; i++) {
+        swprintf_s(szStatus, L"status %u", i);
+        HistoryAppendString(HISTORY_AGENTSTATUS, szStatus);
+    }
+    std::vector<HistoryEntry> entries = CopyAll();
+    TEST_CHECK(entries.size() == HISTORY_MAX_STRINGS + 10);
+    TEST_CHECK(HasString(&entries[HISTORY_MAX_STRINGS - 1], L"status 511"));
+    TEST_CHECK(entries[HISTORY_MAX_STRINGS].wValue == HISTORY_NO_STRING);
+
+    // Already interned strings are still found
+    HistoryAppendString(HISTORY_AGENTSTATUS, L"status 3");
+    entries = CopyAll();
+    TEST_CHECK(entries.back().wValue == entries[3].wValue);
+
+    // Drop the first records
+    for (DWORD i = 0; i < HISTORY_CAPACITY - HISTORY_MAX_STRINGS; i++)
+        HistoryAppend(HISTORY_SERVICE, SERVICE_STOPPED);
+    HistoryAppendString(HISTORY_AGENTSTATUS, L"new status");
+    entries = CopyAll();
+    TEST_CHECK(HasString(&entries.back(), L"new status"));
+    HistoryClose();
+}
+
+// A file with another layout is reset
+static VOID TestReset()
+{
+    TEST_CHECK(OpenNew());
+    HistoryAppend(HISTORY_SERVICE, SERVICE_RUNNING);
+    HistoryClose();
+    TEST_CHECK(HistoryOpen(HISTORY_PATH) && HistoryGetCount() == 1);
+    HistoryClose();
+
+    HANDLE hFile = CreateFile(HISTORY_PATH, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    DWORD dwVersion = HISTORY_VERSION - 1, cbWritten;
+    LARGE_INTEGER liOffset;
+    liOffset.QuadPart = sizeof(DWORD);
+    TEST_CHECK(SetFilePointerEx(hFile, liOffset, NULL, FILE_BEGIN) && WriteFile(hFile, &dwVersion, sizeof(dwVersion), &cbWritten, NULL));
+    CloseHandle(hFile);
+    TEST_CHECK(HistoryOpen(HISTORY_PATH) && HistoryGetCount() == 0);
+    HistoryClose();
+    DeleteFile(HISTORY_PATH);
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestEncodeDecode);
+    TEST_RUN(TestWraparound);
+    TEST_RUN(TestTableFull);
+    TEST_RUN(TestReset);
+    return TestResult();
+}
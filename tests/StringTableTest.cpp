@@ -0,0 +1,176 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  StringTableTest.cpp
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+//-[INCLUDES]------------------------------------------------------------------
+
+#include <windows.h>
+#include <string.h>
+#include "framework.h"
+#include "StringTable.h"
+#include "Test.h"
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+static BOOL AddString(StringTable* pTable, UINT uId, LPCWSTR szString)
+{
+    return StringTableAdd(pTable, uId, szString, wcslen(szString));
+}
+
+
+//-[TESTS]---------------------------------------------------------------------
+
+// Identical strings share their storage, whatever their IDs
+static VOID TestInterning()
+{
+    StringTable table;
+    StringTableClear(&table);
+    TEST_CHECK(AddString(&table, 10, L"Running"));
+    TEST_CHECK(AddString(&table, 20, L"Stopped"));
+    TEST_CHECK(AddString(&table, 30, L"Running"));
+    TEST_CHECK(AddString(&table, 40, L""));
+    TEST_CHECK(AddString(&table, 41, L""));
+
+    TEST_CHECK(table.refs[10].dwOffset == table.refs[30].dwOffset);
+    TEST_CHECK(table.refs[10].dwOffset != table.refs[20].dwOffset);
+    TEST_CHECK(table.refs[40].dwOffset == table.refs[41].dwOffset);
+    TEST_CHECK(table.arena.size() == (7 + 1) + (7 + 1) + 1);
+    TEST_CHECK(StringTableGet(&table, 10) == StringTableGet(&table, 30));
+    TEST_CHECK(wcscmp(StringTableGet(&table, 30), L"Running") == 0);
+
+    // A prefix isn't the same string
+    TEST_CHECK(StringTableAdd(&table, 50, L"Running", 3));
+    DWORD cch;
+    TEST_CHECK(wcscmp(StringTableGet(&table, 50, &cch), L"Run") == 0 && cch == 3);
+    TEST_CHECK(table.refs[50].dwOffset != table.refs[10].dwOffset);
+
+    // Embedded NULs are kept, and the length tells them apart
+    TEST_CHECK(StringTableAdd(&table, 60, L"A\0B", 3));
+    TEST_CHECK(StringTableAdd(&table, 61, L"A", 1));
+    LPCWSTR szString = StringTableGet(&table, 60, &cch);
+    TEST_CHECK(cch == 3 && memcmp(szString, L"A\0B", 4 * sizeof(WCHAR)) == 0);
+    TEST_CHECK(table.refs[60].dwOffset != table.refs[61].dwOffset);
+}
+
+// An ID is added once, the first string stays
+static VOID TestDuplicateId()
+{
+    StringTable table;
+    StringTableClear(&table);
+    TEST_CHECK(AddString(&table, 5, L"First"));
+    size_t cchArena = table.arena.size();
+    TEST_CHECK(!AddString(&table, 5, L"Second"));
+    TEST_CHECK(wcscmp(StringTableGet(&table, 5), L"First") == 0);
+    TEST_CHECK(table.arena.size() == cchArena);
+
+    StringTableClear(&table);
+    TEST_CHECK(table.refs.empty() && table.arena.empty() && table.interned.empty());
+    TEST_CHECK(AddString(&table, 5, L"Second"));
+    TEST_CHECK(wcscmp(StringTableGet(&table, 5), L"Second") == 0);
+}
+
+// IDs never added read as empty strings
+static VOID TestMissingIds()
+{
+    StringTable table;
+    StringTableClear(&table);
+    DWORD cch = 99;
+    TEST_CHECK(wcscmp(StringTableGet(&table, 0, &cch), L"") == 0 && cch == 0);
+
+    TEST_CHECK(AddString(&table, 3, L"Three"));
+    TEST_CHECK(AddString(&table, 7, L"Seven"));
+    for (UINT uId : { 0u, 1u, 4u, 6u, 8u, 1000u, 0xFFFFFFFFu }) {
+        cch = 99;
+        TEST_CHECK(wcscmp(StringTableGet(&table, uId, &cch), L"") == 0 && cch == 0);
+        TEST_CHECK(StringTableGet(&table, uId) != NULL);
+    }
+    TEST_CHECK(table.refs.size() == 8);
+
+    WCHAR szBuf[16] = L"garbage";
+    TEST_CHECK(StringTableCopy(&table, 4, szBuf, ARRAYSIZE(szBuf)) == 0 && szBuf[0] == '\0');
+    wcscpy(szBuf, L"garbage");
+    TEST_CHECK(StringTableCopy(&table, 1000, szBuf, ARRAYSIZE(szBuf)) == 0 && szBuf[0] == '\0');
+}
+
+// Copies are truncated to the buffer, and always NUL-terminated
+static VOID TestCopyTruncation()
+{
+    StringTable table;
+    StringTableClear(&table);
+    TEST_CHECK(AddString(&table, 1, L"Inventory"));
+
+    WCHAR szBuf[16];
+    wcscpy(szBuf, L"xxxxxxxxxxxxxxx");
+    TEST_CHECK(StringTableCopy(&table, 1, szBuf, 0) == 0);
+    TEST_CHECK(szBuf[0] == 'x');
+    TEST_CHECK(StringTableCopy(&table, 1, szBuf, -1) == 0);
+    TEST_CHECK(szBuf[0] == 'x');
+
+    TEST_CHECK(StringTableCopy(&table, 1, szBuf, 1) == 0);
+    TEST_CHECK(szBuf[0] == '\0' && szBuf[1] == 'x');
+
+    wcscpy(szBuf, L"xxxxxxxxxxxxxxx");
+    TEST_CHECK(StringTableCopy(&table, 1, szBuf, 4) == 3);
+    TEST_CHECK(wcscmp(szBuf, L"Inv") == 0 && szBuf[4] == 'x');
+
+    // Exactly the string and its NUL
+    wcscpy(szBuf, L"xxxxxxxxxxxxxxx");
+    TEST_CHECK(StringTableCopy(&table, 1, szBuf, 10) == 9);
+    TEST_CHECK(wcscmp(szBuf, L"Inventory") == 0 && szBuf[10] == 'x');
+
+    // One short of it
+    wcscpy(szBuf, L"xxxxxxxxxxxxxxx");
+    TEST_CHECK(StringTableCopy(&table, 1, szBuf, 9) == 8);
+    TEST_CHECK(wcscmp(szBuf, L"Inventor") == 0);
+
+    wcscpy(szBuf, L"xxxxxxxxxxxxxxx");
+    TEST_CHECK(StringTableCopy(&table, 1, szBuf, ARRAYSIZE(szBuf)) == 9);
+    TEST_CHECK(wcscmp(szBuf, L"Inventory") == 0 && szBuf[10] == 'x');
+
+    // The table isn't changed by a truncated copy
+    TEST_CHECK(wcscmp(StringTableGet(&table, 1), L"Inventory") == 0);
+}
+
+
+//-[MAIN]----------------------------------------------------------------------
+
+int main()
+{
+    TEST_RUN(TestInterning);
+    TEST_RUN(TestDuplicateId);
+    TEST_RUN(TestMissingIds);
+    TEST_RUN(TestCopyTruncation);
+    return TestResult();
+}
@@ -0,0 +1,105 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  Test.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include <stdio.h>
+#include <string>
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// Checks a condition. A failed check is reported, and the test goes on.
+#define TEST_CHECK(expr) \
+    do { \
+        if (!(expr)) { \
+            nTestFailures++; \
+            fprintf(stderr, "%s(%d): check failed: %s\n", __FILE__, __LINE__, #expr); \
+        } \
+    } while (0)
+
+// Runs a test function and reports its result
+#define TEST_RUN(fn) \
+    do { \
+        int nFailuresBefore = nTestFailures; \
+        fn(); \
+        printf("%s: %s\n", #fn, (nTestFailures == nFailuresBefore ? "ok" : "FAILED")); \
+    } while (0)
+
+
+//-[GLOBALS AND OTHERS]--------------------------------------------------------
+
+// Checks failed (each test is a program of its own)
+static int nTestFailures = 0;
+
+
+//-[FUNCTIONS]-----------------------------------------------------------------
+
+// Returns the test exit code
+inline int TestResult()
+{
+    return (nTestFailures == 0 ? 0 : 1);
+}
+
+// Reads a file (empty if it can't be read)
+inline std::string TestReadFile(const char* szPath)
+{
+    std::string data;
+    FILE* pFile = fopen(szPath, "rb");
+    if (pFile == NULL)
+        return data;
+    char buf[4096];
+    size_t cbRead;
+    while ((cbRead = fread(buf, 1, sizeof(buf), pFile)) > 0)
+        data.append(buf, cbRead);
+    fclose(pFile);
+    return data;
+}
+
+// Reads a file of the test data directory
+inline std::string TestReadData(const char* szName)
+{
+    return TestReadFile((std::string(TEST_DATA_DIR) + "/" + szName).c_str());
+}
+
+// Writes a file, in the test working directory if the path is relative
+inline bool TestWriteFile(const char* szPath, const std::string& data)
+{
+    FILE* pFile = fopen(szPath, "wb");
+    if (pFile == NULL)
+        return false;
+    bool bOk = (fwrite(data.data(), 1, data.size(), pFile) == data.size());
+    return (fclose(pFile) == 0 && bOk);
+}
@@ -0,0 +1,388 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  TestAgent.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AgentClient.h"
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+// Transport errors, as WinHTTP reports them
+#define ERROR_WINHTTP_OPERATION_CANCELLED   12017
+#define ERROR_WINHTTP_CANNOT_CONNECT        12029
+#define ERROR_WINHTTP_CONNECTION_ERROR      12030
+
+
+//-[STAND-IN AGENT]------------------------------------------------------------
+
+// In-process stand-in for the Agent httpd, on a loopback port: /status and
+// /now over HTTP/1.1 kept-alive connections, with delays and connection drops
+class TestAgentHttpd
+{
+public:
+    std::atomic<int> nConnections{ 0 };     // Connections accepted
+    std::atomic<int> nRequests{ 0 };        // Requests received
+    std::atomic<int> nDrops{ 0 };           // Next requests whose connection is closed unanswered
+    std::atomic<DWORD> dwStatusDelay{ 0 };  // Delays before answering (ms)
+    std::atomic<DWORD> dwNowDelay{ 0 };
+
+    ~TestAgentHttpd()
+    {
+        Stop();
+    }
+
+    // Starts listening on an ephemeral port
+    BOOL Start()
+    {
+        fdListen = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t cbAddr = sizeof(addr);
+        if (fdListen < 0 || bind(fdListen, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fdListen, 16) != 0 ||
+            getsockname(fdListen, (sockaddr*)&addr, &cbAddr) != 0)
+            return FALSE;
+        dwPort = ntohs(addr.sin_port);
+        acceptThread = std::thread([this] { AcceptLoop(); });
+        return TRUE;
+    }
+
+    VOID Stop()
+    {
+        if (fdListen < 0)
+            return;
+        bStopping = true;
+        shutdown(fdListen, SHUT_RDWR);
+        acceptThread.join();
+        close(fdListen);
+        fdListen = -1;
+        CloseConnections();
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            threads.swap(connThreads);
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    // Closes the open connections, as an Agent restart does
+    VOID CloseConnections()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (int fd : connFds)
+            shutdown(fd, SHUT_RDWR);
+    }
+
+    VOID SetStatus(const std::string& strBody)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        strStatus = strBody;
+    }
+
+    DWORD GetPort() const
+    {
+        return dwPort;
+    }
+
+private:
+    int fdListen = -1;
+    DWORD dwPort = 0;
+    std::atomic<bool> bStopping{ false };
+    std::thread acceptThread;
+    std::mutex lock;
+    std::vector<std::thread> connThreads;
+    std::set<int> connFds;
+    std::string strStatus = "status: waiting\n";
+
+    VOID AcceptLoop()
+    {
+        int fd;
+        while ((fd = accept(fdListen, NULL, NULL)) >= 0) {
+            nConnections++;
+            std::lock_guard<std::mutex> guard(lock);
+            connFds.insert(fd);
+            connThreads.emplace_back([this, fd] { Serve(fd); });
+        }
+    }
+
+    // Waits for a delay, unless the stand-in is stopped meanwhile
+    BOOL Delay(DWORD dwDelay)
+    {
+        for (DWORD dwWaited = 0; dwWaited < dwDelay && !bStopping; dwWaited += 10)
+            Sleep(10);
+        return !bStopping;
+    }
+
+    // Answers the requests of a connection until it's closed
+    VOID Serve(int fd)
+    {
+        std::string strIn;
+        char buf[4096];
+        for (;;)
+        {
+            size_t cbEnd;
+            ssize_t cbRead = 0;
+            while ((cbEnd = strIn.find("\r\n\r\n")) == std::string::npos &&
+                (cbRead = recv(fd, buf, sizeof(buf), 0)) > 0)
+                strIn.append(buf, cbRead);
+            if (cbEnd == std::string::npos)
+                break;
+            std::string strLine = strIn.substr(0, strIn.find("\r\n"));
+            strIn.erase(0, cbEnd + 4);
+            nRequests++;
+
+            int nDropsLeft = nDrops;
+            while (nDropsLeft > 0 && !nDrops.compare_exchange_weak(nDropsLeft, nDropsLeft - 1));
+            if (nDropsLeft > 0)
+                break;
+
+            std::string strCode = "200 OK", strBody;
+            if (strLine == "GET /status HTTP/1.1" && Delay(dwStatusDelay)) {
+                std::lock_guard<std::mutex> guard(lock);
+                strBody = strStatus;
+            }
+            else if (strLine == "GET /now HTTP/1.1" && Delay(dwNowDelay))
+                strBody = "<html><body>OK</body></html>\n";
+            else if (bStopping)
+                break;
+            else
+                strCode = "404 Not Found";
+            std::string strOut = "HTTP/1.1 " + strCode + "\r\nContent-Type: text/plain\r\nContent-Length: " +
+                std::to_string(strBody.size()) + "\r\n\r\n" + strBody;
+            if (send(fd, strOut.data(), strOut.size(), MSG_NOSIGNAL) != (ssize_t)strOut.size())
+                break;
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        connFds.erase(fd);
+        close(fd);
+    }
+};
+
+
+//-[SOCKET TRANSPORT]----------------------------------------------------------
+
+// Agent transport over POSIX sockets, standing for the WinHTTP one: a thread
+// per request, and a pool of the kept-alive connections of each endpoint
+class TestSocketTransport : public AgentTransport
+{
+public:
+    ~TestSocketTransport()
+    {
+        // Retries may start more requests while the others are joined
+        for (;;) {
+            std::vector<std::thread> threads;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                threads.swap(reqThreads);
+            }
+            if (threads.empty())
+                break;
+            for (std::thread& thread : threads)
+                thread.join();
+        }
+        for (Endpoint& endpoint : endpoints) {
+            for (int fd : endpoint.idleFds)
+                close(fd);
+        }
+    }
+
+    VOID Get(AgentRequest* pReq, LPCWSTR szPath)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        Endpoint* pEndpoint = &endpoints[pReq->dwEndpoint];
+        if (pEndpoint->dwPort == 0) {
+            guard.unlock();
+            AgentClientOnComplete(pReq, ERROR_NOT_FOUND);
+            AgentRequestRelease(pReq);
+            return;
+        }
+
+        // Reuse a kept-alive connection if there's one
+        Connection* pConn = new Connection();
+        pConn->dwEndpoint = pReq->dwEndpoint;
+        pConn->dwPort = pEndpoint->dwPort;
+        if (!pEndpoint->idleFds.empty()) {
+            pConn->fd = pEndpoint->idleFds.back();
+            pEndpoint->idleFds.pop_back();
+        }
+        pReq->pvHandle = pConn;
+        std::string strRequest = "GET ";
+        for (LPCWSTR p = szPath; *p != '\0'; p++)
+            strRequest += (char)*p;
+        strRequest += " HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n";
+        reqThreads.emplace_back([this, pReq, pConn, strRequest] { Run(pReq, pConn, strRequest); });
+    }
+
+    // Shutting the connection down makes the request thread fail
+    VOID Cancel(AgentRequest* pReq)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        Connection* pConn = (Connection*)InterlockedExchangePointer(&pReq->pvHandle, NULL);
+        if (pConn != NULL && pConn->fd >= 0)
+            shutdown(pConn->fd, SHUT_RDWR);
+    }
+
+    // Only loopback endpoints are reached, by port
+    VOID SetEndpoint(DWORD dwEndpoint, LPCWSTR szHost, DWORD dwPort)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        Endpoint* pEndpoint = &endpoints[dwEndpoint];
+        for (int fd : pEndpoint->idleFds)
+            close(fd);
+        pEndpoint->idleFds.clear();
+        pEndpoint->dwPort = (szHost != NULL ? dwPort : 0);
+    }
+
+private:
+    struct Endpoint {
+        DWORD dwPort = 0;
+        std::vector<int> idleFds;
+    };
+    // Connection of a request, owned by its thread
+    struct Connection {
+        int fd = -1;
+        DWORD dwEndpoint;
+        DWORD dwPort;
+    };
+
+    std::mutex lock;
+    Endpoint endpoints[AGENT_MAX_ENDPOINTS];
+    std::vector<std::thread> reqThreads;
+
+    VOID Run(AgentRequest* pReq, Connection* pConn, const std::string& strRequest)
+    {
+        DWORD dwError = Exchange(pReq, pConn, strRequest);
+
+        // Keep the connection alive if the response was read completely, before
+        // the completion is reported so the next request can reuse it
+        BOOL bKeep = FALSE;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (InterlockedExchangePointer(&pReq->pvHandle, NULL) == NULL)
+                dwError = ERROR_WINHTTP_OPERATION_CANCELLED;
+            else if (dwError == ERROR_SUCCESS && endpoints[pConn->dwEndpoint].dwPort == pConn->dwPort) {
+                endpoints[pConn->dwEndpoint].idleFds.push_back(pConn->fd);
+                bKeep = TRUE;
+            }
+        }
+        if (!bKeep && pConn->fd >= 0)
+            close(pConn->fd);
+        delete pConn;
+
+        // A kept-alive connection may have been closed by the Agent meanwhile
+        pReq->bRetryable = !pReq->bNewConnection && pReq->dwStatusCode == 0 && dwError == ERROR_WINHTTP_CONNECTION_ERROR;
+        AgentClientOnComplete(pReq, dwError);
+        AgentRequestRelease(pReq);
+    }
+
+    // Sends the request and reads the response
+    DWORD Exchange(AgentRequest* pReq, Connection* pConn, const std::string& strRequest)
+    {
+        if (pConn->fd < 0) {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = htons((uint16_t)pConn->dwPort);
+            if (fd >= 0 && connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+                close(fd);
+                fd = -1;
+            }
+            if (fd < 0)
+                return ERROR_WINHTTP_CANNOT_CONNECT;
+            pReq->bNewConnection = TRUE;
+
+            // Cancelled while connecting
+            std::lock_guard<std::mutex> guard(lock);
+            pConn->fd = fd;
+            if (pReq->pvHandle == NULL)
+                return ERROR_WINHTTP_OPERATION_CANCELLED;
+        }
+
+        QueryPerformanceCounter(&pReq->liSent);
+        if (send(pConn->fd, strRequest.data(), strRequest.size(), MSG_NOSIGNAL) != (ssize_t)strRequest.size())
+            return ERROR_WINHTTP_CONNECTION_ERROR;
+
+        // Headers
+        std::string strIn;
+        size_t cbEnd;
+        ssize_t cbRead;
+        while ((cbEnd = strIn.find("\r\n\r\n")) == std::string::npos) {
+            if ((cbRead = recv(pConn->fd, pReq->readBuf, sizeof(pReq->readBuf), 0)) <= 0)
+                return ERROR_WINHTTP_CONNECTION_ERROR;
+            strIn.append(pReq->readBuf, cbRead);
+        }
+        DWORD dwStatusCode = 0;
+        size_t cbBody = 0;
+        sscanf(strIn.c_str(), "HTTP/1.1 %u", &dwStatusCode);
+        size_t cbLength = strIn.find("Content-Length: ");
+        if (cbLength != std::string::npos && cbLength < cbEnd)
+            cbBody = strtoul(strIn.c_str() + cbLength + 16, NULL, 10);
+        AgentClientOnHeaders(pReq, dwStatusCode);
+        strIn.erase(0, cbEnd + 4);
+
+        // Body, passed to the client in chunks of the receive buffer size
+        size_t cbLeft = cbBody;
+        while (cbLeft > 0) {
+            DWORD cbChunk;
+            if (!strIn.empty()) {
+                cbChunk = (DWORD)std::min(std::min(strIn.size(), cbLeft), sizeof(pReq->readBuf));
+                memcpy(pReq->readBuf, strIn.data(), cbChunk);
+                strIn.erase(0, cbChunk);
+            }
+            else {
+                if ((cbRead = recv(pConn->fd, pReq->readBuf, std::min(cbLeft, sizeof(pReq->readBuf)), 0)) <= 0)
+                    return ERROR_WINHTTP_CONNECTION_ERROR;
+                cbChunk = (DWORD)cbRead;
+            }
+            cbLeft -= cbChunk;
+            if (!AgentClientOnData(pReq, pReq->readBuf, cbChunk))
+                return ERROR_INSUFFICIENT_BUFFER;
+        }
+        return ERROR_SUCCESS;
+    }
+};
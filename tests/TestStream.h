@@ -0,0 +1,113 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  TestStream.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <string.h>
+#include "Handoff.h"
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+// One direction of an in-memory connection
+struct TestChannel {
+    std::mutex lock;
+    std::condition_variable changed;
+    std::string data;
+    bool bClosed = false;
+};
+
+// End of an in-memory connection, standing for the named pipe in the protocol
+// tests. Reads wait up to HANDOFF_TIMEOUT, as the pipe stream ones.
+class TestStream : public HandoffStream
+{
+public:
+    TestStream(TestChannel* pIn, TestChannel* pOut) : pIn(pIn), pOut(pOut) {}
+
+    BOOL Read(PVOID pv, DWORD cb)
+    {
+        std::unique_lock<std::mutex> guard(pIn->lock);
+        if (!pIn->changed.wait_for(guard, std::chrono::milliseconds(HANDOFF_TIMEOUT),
+            [&] { return pIn->data.size() >= cb || pIn->bClosed; }) || pIn->data.size() < cb)
+            return FALSE;
+        memcpy(pv, pIn->data.data(), cb);
+        pIn->data.erase(0, cb);
+        return TRUE;
+    }
+
+    BOOL Write(const VOID* pv, DWORD cb)
+    {
+        std::lock_guard<std::mutex> guard(pOut->lock);
+        if (pOut->bClosed)
+            return FALSE;
+        pOut->data.append((const char*)pv, cb);
+        pOut->changed.notify_all();
+        return TRUE;
+    }
+
+    // Closes the connection: the other end reads what's left, then fails
+    VOID Close()
+    {
+        for (TestChannel* pChannel : { pIn, pOut }) {
+            std::lock_guard<std::mutex> guard(pChannel->lock);
+            pChannel->bClosed = true;
+            pChannel->changed.notify_all();
+        }
+    }
+
+    // Closes the sending side only
+    VOID Shutdown()
+    {
+        std::lock_guard<std::mutex> guard(pOut->lock);
+        pOut->bClosed = true;
+        pOut->changed.notify_all();
+    }
+
+private:
+    TestChannel* pIn;
+    TestChannel* pOut;
+};
+
+// In-memory connection
+struct TestPipe {
+    TestChannel toServer;
+    TestChannel toClient;
+    TestStream client{ &toClient, &toServer };
+    TestStream server{ &toServer, &toClient };
+};
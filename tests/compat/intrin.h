@@ -0,0 +1,47 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  compat/intrin.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+// Compiler intrinsics used by the Monitor, over the GCC and Clang builtins
+
+#pragma once
+
+// Index of the highest set bit (FALSE if the mask is 0)
+inline unsigned char _BitScanReverse(unsigned long* pulIndex, unsigned long ulMask)
+{
+    if (ulMask == 0)
+        return 0;
+    *pulIndex = (unsigned long)(sizeof(ulMask) * 8 - 1 - __builtin_clzl(ulMask));
+    return 1;
+}
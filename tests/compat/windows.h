@@ -0,0 +1,1049 @@
+/*
+ *  ---------------------------------------------------------------------------
+ *  compat/windows.h
+ *  Copyright (C) 2023, 2025 Leonardo Bernardes (redddcyclone)
+ *  ---------------------------------------------------------------------------
+ *
+ *  LICENSE
+ *
+ *  This file is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *
+ *  This file is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA,
+ *  or see <http://www.gnu.org/licenses/>.
+ *
+ *  ---------------------------------------------------------------------------
+ *
+ *  @author(s) Leonardo Bernardes (redddcyclone)
+ *  @license   GNU GPL version 2 or (at your option) any later version
+ *             http://www.gnu.org/licenses/old-licenses/gpl-2.0-standalone.html
+ *  @since     2023
+ *
+ *  ---------------------------------------------------------------------------
+ */
+
+
+// Subset of the Win32 API used by the modules under test, over POSIX. It's
+// only used by the non-Windows test builds, the Windows ones use the SDK.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <wchar.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <exception>
+#include <string>
+#include <thread>
+
+
+//-[TYPES]---------------------------------------------------------------------
+
+typedef int BOOL;
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONGLONG;
+typedef int64_t LONG64;
+typedef intptr_t LONG_PTR;
+typedef uintptr_t ULONG_PTR;
+typedef uint32_t UINT;
+typedef char CHAR;
+typedef wchar_t WCHAR;
+typedef WCHAR* LPWSTR;
+typedef const WCHAR* LPCWSTR;
+typedef const CHAR* LPCSTR;
+typedef void* PVOID;
+typedef void* LPVOID;
+typedef BYTE* LPBYTE;
+typedef void* HANDLE;
+typedef void* HWND;
+typedef void* HINSTANCE;
+typedef HINSTANCE HMODULE;
+typedef uint16_t LANGID;
+typedef void* PSECURITY_DESCRIPTOR;
+typedef void* SC_HANDLE;
+typedef void* HKEY;
+typedef DWORD REGSAM;
+typedef uintptr_t WPARAM;
+typedef intptr_t LPARAM;
+
+typedef union _LARGE_INTEGER {
+    struct {
+        DWORD LowPart;
+        LONG HighPart;
+    };
+    LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+typedef struct _FILETIME {
+    DWORD dwLowDateTime;
+    DWORD dwHighDateTime;
+} FILETIME;
+
+typedef struct _SYSTEMTIME {
+    WORD wYear;
+    WORD wMonth;
+    WORD wDayOfWeek;
+    WORD wDay;
+    WORD wHour;
+    WORD wMinute;
+    WORD wSecond;
+    WORD wMilliseconds;
+} SYSTEMTIME;
+
+typedef struct _SERVICE_STATUS {
+    DWORD dwServiceType;
+    DWORD dwCurrentState;
+    DWORD dwControlsAccepted;
+    DWORD dwWin32ExitCode;
+    DWORD dwServiceSpecificExitCode;
+    DWORD dwCheckPoint;
+    DWORD dwWaitHint;
+} SERVICE_STATUS;
+
+typedef struct _OVERLAPPED {
+    ULONG_PTR Internal;
+    ULONG_PTR InternalHigh;
+    DWORD Offset;
+    DWORD OffsetHigh;
+    HANDLE hEvent;
+} OVERLAPPED;
+
+
+//-[DEFINES]-------------------------------------------------------------------
+
+#define VOID                    void
+#define TRUE                    1
+#define FALSE                   0
+#define CALLBACK
+#define WINAPI
+#define INFINITE                0xFFFFFFFF
+#define MAX_PATH                260
+#define MAXDWORD                0xFFFFFFFF
+#define MAXULONGLONG            (~(ULONGLONG)0)
+#define ZeroMemory(p, cb)       memset((p), 0, (cb))
+#define CopyMemory(d, s, cb)    memcpy((d), (s), (cb))
+#define ARRAYSIZE(a)            (sizeof(a) / sizeof((a)[0]))
+#define _countof(a)             ARRAYSIZE(a)
+#define UNREFERENCED_PARAMETER(P) ((void)(P))
+#define INVALID_HANDLE_VALUE    ((HANDLE)(LONG_PTR)-1)
+#define INVALID_FILE_ATTRIBUTES ((DWORD)-1)
+#define _TRUNCATE               ((size_t)-1)
+#define MAKELONG(a, b)          ((LONG)(((WORD)(a)) | ((DWORD)((WORD)(b))) << 16))
+#define MAKELPARAM(l, h)        ((LPARAM)(DWORD)MAKELONG(l, h))
+#define LOWORD(l)               ((WORD)((uintptr_t)(l) & 0xffff))
+#define HIWORD(l)               ((WORD)(((uintptr_t)(l) >> 16) & 0xffff))
+
+// Service states (winsvc.h)
+#define SERVICE_STOPPED         0x00000001
+#define SERVICE_START_PENDING   0x00000002
+#define SERVICE_STOP_PENDING    0x00000003
+#define SERVICE_RUNNING         0x00000004
+#define SERVICE_CONTINUE_PENDING 0x00000005
+#define SERVICE_PAUSE_PENDING   0x00000006
+#define SERVICE_PAUSED          0x00000007
+
+// Service access rights, controls and notifications (winsvc.h)
+#define SERVICE_QUERY_STATUS    0x0004
+#define SERVICE_START           0x0010
+#define SERVICE_STOP            0x0020
+#define SERVICE_PAUSE_CONTINUE  0x0040
+#define SERVICE_CONTROL_STOP    0x00000001
+#define SERVICE_CONTROL_CONTINUE 0x00000003
+#define SERVICE_NOTIFY_STOPPED  0x00000001
+#define SERVICE_NOTIFY_START_PENDING 0x00000002
+#define SERVICE_NOTIFY_STOP_PENDING 0x00000004
+#define SERVICE_NOTIFY_RUNNING  0x00000008
+#define SERVICE_NOTIFY_CONTINUE_PENDING 0x00000010
+#define SERVICE_NOTIFY_PAUSE_PENDING 0x00000020
+#define SERVICE_NOTIFY_PAUSED   0x00000040
+#define SERVICE_NOTIFY_CREATED  0x00000080
+#define SERVICE_NOTIFY_DELETED  0x00000100
+#define SERVICE_NOTIFY_DELETE_PENDING 0x00000200
+
+// Service start types (winnt.h) and registry access rights (winreg.h)
+#define SERVICE_BOOT_START      0x00000000
+#define SERVICE_SYSTEM_START    0x00000001
+#define SERVICE_AUTO_START      0x00000002
+#define SERVICE_DEMAND_START    0x00000003
+#define SERVICE_DISABLED        0x00000004
+#define KEY_NOTIFY              0x0010
+#define KEY_READ                0x20019
+
+using std::min;
+using std::max;
+
+// Structured exception handling: no handler ever runs (the files mapped by
+// the tests aren't truncated while they're read)
+struct CompatSehException {};
+#ifndef __try
+#define __try                   try
+#endif
+#define __except(filter)        catch (CompatSehException&)
+#define GetExceptionCode()      0
+#define EXCEPTION_IN_PAGE_ERROR 0xC0000006
+#define EXCEPTION_EXECUTE_HANDLER 1
+#define EXCEPTION_CONTINUE_SEARCH 0
+
+
+//-[ERRORS]--------------------------------------------------------------------
+
+#define ERROR_SUCCESS           0
+#define ERROR_FILE_NOT_FOUND    2
+#define ERROR_PATH_NOT_FOUND    3
+#define ERROR_ACCESS_DENIED     5
+#define ERROR_INVALID_HANDLE    6
+#define ERROR_NOT_ENOUGH_MEMORY 8
+#define ERROR_HANDLE_EOF        38
+#define ERROR_NOT_SUPPORTED     50
+#define ERROR_FILE_EXISTS       80
+#define ERROR_INVALID_PARAMETER 87
+#define ERROR_INSUFFICIENT_BUFFER 122
+#define ERROR_ALREADY_EXISTS    183
+#define ERROR_MORE_DATA         234
+#define ERROR_KEY_DELETED       1018
+#define ERROR_SERVICE_ALREADY_RUNNING 1056
+#define ERROR_SERVICE_DOES_NOT_EXIST 1060
+#define ERROR_SERVICE_NOT_ACTIVE 1062
+#define ERROR_SERVICE_MARKED_FOR_DELETE 1072
+#define ERROR_NOT_FOUND         1168
+#define ERROR_TIMEOUT           1460
+#define RPC_S_SERVER_UNAVAILABLE 1722
+#define RPC_S_CALL_FAILED       1726
+
+inline DWORD& CompatLastError()
+{
+    static thread_local DWORD dwLastError = ERROR_SUCCESS;
+    return dwLastError;
+}
+
+inline DWORD GetLastError()
+{
+    return CompatLastError();
+}
+
+inline VOID SetLastError(DWORD dwErr)
+{
+    CompatLastError() = dwErr;
+}
+
+// Sets the last error from errno, returns FALSE
+inline BOOL CompatFail()
+{
+    switch (errno) {
+        case ENOENT: SetLastError(ERROR_FILE_NOT_FOUND); break;
+        case ENOTDIR: SetLastError(ERROR_PATH_NOT_FOUND); break;
+        case EACCES: case EPERM: SetLastError(ERROR_ACCESS_DENIED); break;
+        case EEXIST: SetLastError(ERROR_FILE_EXISTS); break;
+        case EBADF: SetLastError(ERROR_INVALID_HANDLE); break;
+        case ENOMEM: SetLastError(ERROR_NOT_ENOUGH_MEMORY); break;
+        default: SetLastError(ERROR_INVALID_PARAMETER); break;
+    }
+    return FALSE;
+}
+
+
+//-[STRINGS]-------------------------------------------------------------------
+
+#define _wcsicmp                wcscasecmp
+#define _wtoi(s)                ((int)wcstol((s), NULL, 10))
+#define _wcsnicmp               wcsncasecmp
+#define _stricmp                strcasecmp
+#define CP_UTF8                 65001
+
+// UTF-8 only, to UTF-32 code points (the wide characters of the POSIX
+// libraries). Invalid sequences are replaced with U+FFFD, as Windows does.
+inline int MultiByteToWideChar(UINT uCodePage, DWORD dwFlags, const CHAR* pch, int cb, WCHAR* pwch, int cwch)
+{
+    if (uCodePage != CP_UTF8 || dwFlags != 0) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return 0;
+    }
+    const BYTE* pb = (const BYTE*)pch;
+    size_t cbIn = (cb < 0 ? strlen(pch) + 1 : (size_t)cb);
+    std::wstring wstr;
+    for (size_t i = 0; i < cbIn;)
+    {
+        uint32_t c = pb[i];
+        size_t cbSeq = (c < 0x80 ? 1 : c >= 0xC2 && c < 0xE0 ? 2 : c >= 0xE0 && c < 0xF0 ? 3 : c >= 0xF0 && c < 0xF5 ? 4 : 0);
+        c &= (cbSeq == 2 ? 0x1F : cbSeq == 3 ? 0x0F : 0x07);
+        size_t cbValid = 1;
+        while (cbSeq > 1 && cbValid < cbSeq && i + cbValid < cbIn && (pb[i + cbValid] & 0xC0) == 0x80)
+            c = (c << 6) | (pb[i + cbValid++] & 0x3F);
+        if (cbSeq == 1)
+            c = pb[i];
+        else if (cbSeq == 0 || cbValid < cbSeq || (cbSeq == 3 && (c < 0x800 || (c >= 0xD800 && c < 0xE000))) ||
+            (cbSeq == 4 && (c < 0x10000 || c > 0x10FFFF)))
+            c = 0xFFFD;
+        wstr += (WCHAR)c;
+        i += (cbSeq == 0 ? 1 : cbValid);
+    }
+    if (cwch == 0)
+        return (int)wstr.size();
+    // The buffer is filled before failing, as Windows does
+    memcpy(pwch, wstr.data(), std::min(wstr.size(), (size_t)cwch) * sizeof(WCHAR));
+    if (wstr.size() > (size_t)cwch) {
+        SetLastError(ERROR_INSUFFICIENT_BUFFER);
+        return 0;
+    }
+    return (int)wstr.size();
+}
+
+// UTF-8 only. A wide string may hold UTF-16 (surrogate pairs) or UTF-32 code
+// points; invalid ones are replaced with U+FFFD, as Windows does.
+inline int WideCharToMultiByte(UINT uCodePage, DWORD dwFlags, const WCHAR* pwch, int cwch,
+    CHAR* pch, int cb, const CHAR* pDefault, BOOL* pbUsedDefault)
+{
+    if (uCodePage != CP_UTF8 || dwFlags != 0 || pDefault != NULL || pbUsedDefault != NULL) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return 0;
+    }
+    size_t cwchIn = (cwch < 0 ? wcslen(pwch) + 1 : (size_t)cwch);
+    std::string str;
+    for (size_t i = 0; i < cwchIn; i++)
+    {
+        uint32_t c = (uint32_t)pwch[i];
+        if (c >= 0xD800 && c < 0xDC00 && i + 1 < cwchIn &&
+            (uint32_t)pwch[i + 1] >= 0xDC00 && (uint32_t)pwch[i + 1] < 0xE000)
+            c = 0x10000 + ((c - 0xD800) << 10) + ((uint32_t)pwch[++i] - 0xDC00);
+        else if ((c >= 0xD800 && c < 0xE000) || c > 0x10FFFF)
+            c = 0xFFFD;
+        if (c < 0x80)
+            str += (CHAR)c;
+        else if (c < 0x800) {
+            str += (CHAR)(0xC0 | (c >> 6));
+            str += (CHAR)(0x80 | (c & 0x3F));
+        }
+        else if (c < 0x10000) {
+            str += (CHAR)(0xE0 | (c >> 12));
+            str += (CHAR)(0x80 | ((c >> 6) & 0x3F));
+            str += (CHAR)(0x80 | (c & 0x3F));
+        }
+        else {
+            str += (CHAR)(0xF0 | (c >> 18));
+            str += (CHAR)(0x80 | ((c >> 12) & 0x3F));
+            str += (CHAR)(0x80 | ((c >> 6) & 0x3F));
+            str += (CHAR)(0x80 | (c & 0x3F));
+        }
+    }
+    if (cb == 0)
+        return (int)str.size();
+    if (str.size() > (size_t)cb) {
+        SetLastError(ERROR_INSUFFICIENT_BUFFER);
+        return 0;
+    }
+    memcpy(pch, str.data(), str.size());
+    return (int)str.size();
+}
+
+// Converts a Microsoft printf format to a C library one: "%s" in the wide
+// functions is a wide string, and "l" sizes a 32-bit DWORD/LONG
+template <class T>
+std::basic_string<T> CompatFormat(const T* szFormat, BOOL bWide)
+{
+    std::basic_string<T> str;
+    for (const T* p = szFormat; *p != 0; p++)
+    {
+        str += *p;
+        if (*p != '%')
+            continue;
+        p++;
+        while (*p != 0 && wcschr(L"-+ #0123456789.*", (wchar_t)*p) != NULL)
+            str += *p++;
+        if (*p == 'l' && p[1] != 'l' && wcschr(L"diuxX", (wchar_t)p[1]) != NULL)
+            p++;
+        else if (bWide && (*p == 's' || *p == 'c'))
+            str += 'l';
+        else if (bWide && (*p == 'S' || *p == 'C'))
+            str += 'h';
+        if (*p == 0)
+            break;
+        str += *p;
+    }
+    return str;
+}
+
+inline int CompatVswprintf(WCHAR* szBuf, size_t cchBuf, const WCHAR* szFormat, va_list args)
+{
+    int nRes = vswprintf(szBuf, cchBuf, CompatFormat(szFormat, TRUE).c_str(), args);
+    if (nRes < 0 && cchBuf > 0)
+        szBuf[cchBuf - 1] = '\0';
+    return nRes;
+}
+
+template <size_t N>
+int swprintf_s(WCHAR (&szBuf)[N], const WCHAR* szFormat, ...)
+{
+    va_list args;
+    va_start(args, szFormat);
+    int nRes = CompatVswprintf(szBuf, N, szFormat, args);
+    va_end(args);
+    return nRes;
+}
+
+template <size_t N>
+int _snwprintf_s(WCHAR (&szBuf)[N], size_t cchCount, const WCHAR* szFormat, ...)
+{
+    va_list args;
+    va_start(args, szFormat);
+    int nRes = CompatVswprintf(szBuf, (cchCount == _TRUNCATE || cchCount >= N ? N : cchCount + 1), szFormat, args);
+    va_end(args);
+    return nRes;
+}
+
+inline int wsprintf(WCHAR* szBuf, const WCHAR* szFormat, ...)
+{
+    va_list args;
+    va_start(args, szFormat);
+    int nRes = CompatVswprintf(szBuf, 1024, szFormat, args);
+    va_end(args);
+    return nRes;
+}
+
+template <size_t N>
+int sprintf_s(CHAR (&szBuf)[N], const CHAR* szFormat, ...)
+{
+    va_list args;
+    va_start(args, szFormat);
+    int nRes = vsnprintf(szBuf, N, CompatFormat(szFormat, FALSE).c_str(), args);
+    va_end(args);
+    return nRes;
+}
+
+inline int wcscpy_s(WCHAR* szDest, size_t cchDest, const WCHAR* szSrc)
+{
+    if (cchDest == 0)
+        return EINVAL;
+    size_t cch = wcslen(szSrc);
+    if (cch >= cchDest) {
+        szDest[0] = '\0';
+        return ERANGE;
+    }
+    memcpy(szDest, szSrc, (cch + 1) * sizeof(WCHAR));
+    return 0;
+}
+
+template <size_t N>
+int wcscpy_s(WCHAR (&szDest)[N], const WCHAR* szSrc)
+{
+    return wcscpy_s(szDest, N, szSrc);
+}
+
+inline int wcsncpy_s(WCHAR* szDest, size_t cchDest, const WCHAR* szSrc, size_t cchCount)
+{
+    if (cchDest == 0)
+        return EINVAL;
+    size_t cch = wcsnlen(szSrc, cchCount == _TRUNCATE ? cchDest : cchCount);
+    if (cch >= cchDest) {
+        if (cchCount != _TRUNCATE) {
+            szDest[0] = '\0';
+            return ERANGE;
+        }
+        cch = cchDest - 1;
+    }
+    memcpy(szDest, szSrc, cch * sizeof(WCHAR));
+    szDest[cch] = '\0';
+    return 0;
+}
+
+template <size_t N>
+int wcsncpy_s(WCHAR (&szDest)[N], const WCHAR* szSrc, size_t cchCount)
+{
+    return wcsncpy_s(szDest, N, szSrc, cchCount);
+}
+
+inline int strcpy_s(CHAR* szDest, size_t cchDest, const CHAR* szSrc)
+{
+    if (cchDest == 0)
+        return EINVAL;
+    size_t cch = strlen(szSrc);
+    if (cch >= cchDest) {
+        szDest[0] = '\0';
+        return ERANGE;
+    }
+    memcpy(szDest, szSrc, cch + 1);
+    return 0;
+}
+
+template <size_t N>
+int strcpy_s(CHAR (&szDest)[N], const CHAR* szSrc)
+{
+    return strcpy_s(szDest, N, szSrc);
+}
+
+// Wide path to a native one (UTF-8)
+inline std::string CompatPath(LPCWSTR szPath)
+{
+    std::string str;
+    for (; *szPath != 0; szPath++) {
+        wchar_t ch = *szPath;
+        if (ch < 0x80) {
+            str += (char)ch;
+        }
+        else if (ch < 0x800) {
+            str += (char)(0xC0 | (ch >> 6));
+            str += (char)(0x80 | (ch & 0x3F));
+        }
+        else {
+            str += (char)(0xE0 | (ch >> 12));
+            str += (char)(0x80 | ((ch >> 6) & 0x3F));
+            str += (char)(0x80 | (ch & 0x3F));
+        }
+    }
+    return str;
+}
+
+
+//-[FILES]---------------------------------------------------------------------
+
+#define GENERIC_READ            0x80000000
+#define GENERIC_WRITE           0x40000000
+#define FILE_SHARE_READ         0x1
+#define FILE_SHARE_WRITE        0x2
+#define FILE_SHARE_DELETE       0x4
+#define CREATE_NEW              1
+#define CREATE_ALWAYS           2
+#define OPEN_EXISTING           3
+#define OPEN_ALWAYS             4
+#define TRUNCATE_EXISTING       5
+#define FILE_ATTRIBUTE_NORMAL   0x80
+#define FILE_FLAG_WRITE_THROUGH 0x80000000
+#define FILE_FLAG_SEQUENTIAL_SCAN 0x08000000
+#define FILE_BEGIN              0
+#define FILE_CURRENT            1
+#define FILE_END                2
+#define MOVEFILE_REPLACE_EXISTING 0x1
+#define MOVEFILE_WRITE_THROUGH  0x8
+#define PAGE_READONLY           0x2
+#define PAGE_READWRITE          0x4
+#define FILE_MAP_WRITE          0x2
+#define FILE_MAP_READ           0x4
+
+// File and file mapping handles (a file descriptor each)
+struct CompatHandle {
+    int fd;
+};
+
+inline int CompatFd(HANDLE h)
+{
+    return ((CompatHandle*)h)->fd;
+}
+
+inline HANDLE CreateFile(LPCWSTR szPath, DWORD dwAccess, DWORD dwShare, PVOID pSa, DWORD dwDisposition, DWORD dwFlags, HANDLE hTemplate)
+{
+    UNREFERENCED_PARAMETER(dwShare);
+    UNREFERENCED_PARAMETER(pSa);
+    UNREFERENCED_PARAMETER(dwFlags);
+    UNREFERENCED_PARAMETER(hTemplate);
+    int nFlags = ((dwAccess & GENERIC_WRITE) ? ((dwAccess & GENERIC_READ) ? O_RDWR : O_WRONLY) : O_RDONLY);
+    switch (dwDisposition) {
+        case CREATE_NEW: nFlags |= O_CREAT | O_EXCL; break;
+        case CREATE_ALWAYS: nFlags |= O_CREAT | O_TRUNC; break;
+        case OPEN_ALWAYS: nFlags |= O_CREAT; break;
+        case TRUNCATE_EXISTING: nFlags |= O_TRUNC; break;
+    }
+    int fd = open(CompatPath(szPath).c_str(), nFlags | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        CompatFail();
+        return INVALID_HANDLE_VALUE;
+    }
+    SetLastError(ERROR_SUCCESS);
+    return new CompatHandle{ fd };
+}
+
+inline BOOL CloseHandle(HANDLE h)
+{
+    if (h == NULL || h == INVALID_HANDLE_VALUE)
+        return FALSE;
+    close(CompatFd(h));
+    delete (CompatHandle*)h;
+    return TRUE;
+}
+
+inline BOOL ReadFile(HANDLE h, PVOID pv, DWORD cb, DWORD* pcbRead, OVERLAPPED* pOv)
+{
+    ssize_t n = (pOv != NULL ? pread(CompatFd(h), pv, cb, ((off_t)pOv->OffsetHigh << 32) | pOv->Offset) : read(CompatFd(h), pv, cb));
+    if (n < 0)
+        return CompatFail();
+    if (pcbRead != NULL)
+        *pcbRead = (DWORD)n;
+    return TRUE;
+}
+
+inline BOOL WriteFile(HANDLE h, const VOID* pv, DWORD cb, DWORD* pcbWritten, OVERLAPPED* pOv)
+{
+    ssize_t n = (pOv != NULL ? pwrite(CompatFd(h), pv, cb, ((off_t)pOv->OffsetHigh << 32) | pOv->Offset) : write(CompatFd(h), pv, cb));
+    if (n < 0)
+        return CompatFail();
+    if (pcbWritten != NULL)
+        *pcbWritten = (DWORD)n;
+    return TRUE;
+}
+
+inline BOOL GetFileSizeEx(HANDLE h, LARGE_INTEGER* pliSize)
+{
+    struct stat st;
+    if (fstat(CompatFd(h), &st) != 0)
+        return CompatFail();
+    pliSize->QuadPart = st.st_size;
+    return TRUE;
+}
+
+inline BOOL SetFilePointerEx(HANDLE h, LARGE_INTEGER liDistance, LARGE_INTEGER* pliNew, DWORD dwMethod)
+{
+    off_t off = lseek(CompatFd(h), liDistance.QuadPart, (dwMethod == FILE_BEGIN ? SEEK_SET : (dwMethod == FILE_CURRENT ? SEEK_CUR : SEEK_END)));
+    if (off < 0)
+        return CompatFail();
+    if (pliNew != NULL)
+        pliNew->QuadPart = off;
+    return TRUE;
+}
+
+inline BOOL SetEndOfFile(HANDLE h)
+{
+    off_t off = lseek(CompatFd(h), 0, SEEK_CUR);
+    return (off >= 0 && ftruncate(CompatFd(h), off) == 0 ? TRUE : CompatFail());
+}
+
+inline BOOL FlushFileBuffers(HANDLE h)
+{
+    return (fsync(CompatFd(h)) == 0 ? TRUE : CompatFail());
+}
+
+inline DWORD GetFileAttributes(LPCWSTR szPath)
+{
+    struct stat st;
+    if (stat(CompatPath(szPath).c_str(), &st) != 0) {
+        CompatFail();
+        return INVALID_FILE_ATTRIBUTES;
+    }
+    return FILE_ATTRIBUTE_NORMAL;
+}
+
+inline BOOL DeleteFile(LPCWSTR szPath)
+{
+    return (unlink(CompatPath(szPath).c_str()) == 0 ? TRUE : CompatFail());
+}
+
+inline BOOL MoveFileEx(LPCWSTR szFrom, LPCWSTR szTo, DWORD dwFlags)
+{
+    if (!(dwFlags & MOVEFILE_REPLACE_EXISTING) && access(CompatPath(szTo).c_str(), F_OK) == 0) {
+        SetLastError(ERROR_ALREADY_EXISTS);
+        return FALSE;
+    }
+    return (rename(CompatPath(szFrom).c_str(), CompatPath(szTo).c_str()) == 0 ? TRUE : CompatFail());
+}
+
+// Mappings of the whole file. A read-write mapping extends the file to its size.
+inline HANDLE CreateFileMapping(HANDLE hFile, PVOID pSa, DWORD dwProtect, DWORD dwSizeHigh, DWORD dwSizeLow, LPCWSTR szName)
+{
+    UNREFERENCED_PARAMETER(pSa);
+    UNREFERENCED_PARAMETER(szName);
+    off_t cbSize = ((off_t)dwSizeHigh << 32) | dwSizeLow;
+    struct stat st;
+    if (dwProtect == PAGE_READWRITE && (fstat(CompatFd(hFile), &st) != 0 ||
+        (st.st_size < cbSize && ftruncate(CompatFd(hFile), cbSize) != 0))) {
+        CompatFail();
+        return NULL;
+    }
+    int fd = dup(CompatFd(hFile));
+    if (fd < 0) {
+        CompatFail();
+        return NULL;
+    }
+    return new CompatHandle{ fd };
+}
+
+// Writable views, mapped shared (with their size, to unmap them)
+inline std::map<const VOID*, size_t>& CompatWritableViews()
+{
+    static std::map<const VOID*, size_t> views;
+    return views;
+}
+
+inline std::mutex& CompatViewsMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+// Read-only views are copies of the file, writable ones are mapped
+inline PVOID MapViewOfFile(HANDLE hMapping, DWORD dwAccess, DWORD dwOffsetHigh, DWORD dwOffsetLow, size_t cbMap)
+{
+    if (dwAccess & FILE_MAP_WRITE) {
+        PVOID pView = mmap(NULL, cbMap, PROT_READ | PROT_WRITE, MAP_SHARED, CompatFd(hMapping),
+            ((off_t)dwOffsetHigh << 32) | dwOffsetLow);
+        if (pView == MAP_FAILED) {
+            CompatFail();
+            return NULL;
+        }
+        std::lock_guard<std::mutex> lock(CompatViewsMutex());
+        CompatWritableViews()[pView] = cbMap;
+        return pView;
+    }
+
+    struct stat st;
+    if (fstat(CompatFd(hMapping), &st) != 0) {
+        CompatFail();
+        return NULL;
+    }
+    off_t off = ((off_t)dwOffsetHigh << 32) | dwOffsetLow;
+    if (cbMap == 0)
+        cbMap = (size_t)(st.st_size - off);
+    BYTE* pView = (BYTE*)malloc(cbMap > 0 ? cbMap : 1);
+    if (pView == NULL) {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+    ssize_t n = pread(CompatFd(hMapping), pView, cbMap, off);
+    if (n < 0 || (size_t)n != cbMap) {
+        free(pView);
+        SetLastError(ERROR_ACCESS_DENIED);
+        return NULL;
+    }
+    return pView;
+}
+
+inline BOOL UnmapViewOfFile(const VOID* pView)
+{
+    std::lock_guard<std::mutex> lock(CompatViewsMutex());
+    auto it = CompatWritableViews().find(pView);
+    if (it != CompatWritableViews().end()) {
+        munmap((PVOID)pView, it->second);
+        CompatWritableViews().erase(it);
+        return TRUE;
+    }
+    free((PVOID)pView);
+    return TRUE;
+}
+
+inline BOOL FlushViewOfFile(const VOID* pView, size_t cbFlush)
+{
+    std::lock_guard<std::mutex> lock(CompatViewsMutex());
+    auto it = CompatWritableViews().find(pView);
+    if (it != CompatWritableViews().end())
+        msync((PVOID)pView, (cbFlush == 0 ? it->second : cbFlush), MS_SYNC);
+    return TRUE;
+}
+
+
+//-[SYNCHRONIZATION]-----------------------------------------------------------
+
+// Slim locks: the mutex is held by an exclusive owner, and only for their
+// bookkeeping by the shared ones (and by the exclusive ones waiting for them)
+typedef struct _SRWLOCK {
+    pthread_mutex_t mutex;
+    pthread_cond_t released;    // The last shared owner released the lock
+    LONG lShared;               // Shared owners
+    LONG lExclusive;            // Held exclusive (atomic)
+} SRWLOCK;
+typedef struct _CONDITION_VARIABLE {
+    pthread_cond_t cond;
+} CONDITION_VARIABLE;
+
+#define SRWLOCK_INIT            { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0 }
+#define CONDITION_VARIABLE_INIT { PTHREAD_COND_INITIALIZER }
+
+inline VOID InitializeSRWLock(SRWLOCK* pLock)
+{
+    pthread_mutex_init(&pLock->mutex, NULL);
+    pthread_cond_init(&pLock->released, NULL);
+    pLock->lShared = 0;
+    pLock->lExclusive = 0;
+}
+
+// Waits for the shared owners to release the lock (the mutex is held)
+inline VOID CompatWaitShared(SRWLOCK* pLock)
+{
+    while (pLock->lShared > 0)
+        pthread_cond_wait(&pLock->released, &pLock->mutex);
+    __atomic_store_n(&pLock->lExclusive, 1, __ATOMIC_SEQ_CST);
+}
+
+inline VOID AcquireSRWLockExclusive(SRWLOCK* pLock)
+{
+    pthread_mutex_lock(&pLock->mutex);
+    CompatWaitShared(pLock);
+}
+
+inline VOID ReleaseSRWLockExclusive(SRWLOCK* pLock)
+{
+    __atomic_store_n(&pLock->lExclusive, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&pLock->mutex);
+}
+
+inline VOID AcquireSRWLockShared(SRWLOCK* pLock)
+{
+    pthread_mutex_lock(&pLock->mutex);
+    pLock->lShared++;
+    pthread_mutex_unlock(&pLock->mutex);
+}
+
+// Fails if the lock is held exclusive (it may still wait for an exclusive
+// owner that acquired it meanwhile)
+inline BOOL TryAcquireSRWLockShared(SRWLOCK* pLock)
+{
+    if (__atomic_load_n(&pLock->lExclusive, __ATOMIC_SEQ_CST))
+        return FALSE;
+    AcquireSRWLockShared(pLock);
+    return TRUE;
+}
+
+inline VOID ReleaseSRWLockShared(SRWLOCK* pLock)
+{
+    pthread_mutex_lock(&pLock->mutex);
+    if (--pLock->lShared == 0)
+        pthread_cond_broadcast(&pLock->released);
+    pthread_mutex_unlock(&pLock->mutex);
+}
+
+inline VOID InitializeConditionVariable(CONDITION_VARIABLE* pCv)
+{
+    pthread_cond_init(&pCv->cond, NULL);
+}
+
+inline BOOL SleepConditionVariableSRW(CONDITION_VARIABLE* pCv, SRWLOCK* pLock, DWORD dwMilliseconds, ULONG ulFlags)
+{
+    // Only the exclusive mode is used
+    UNREFERENCED_PARAMETER(ulFlags);
+    __atomic_store_n(&pLock->lExclusive, 0, __ATOMIC_SEQ_CST);
+    int nRes;
+    if (dwMilliseconds == INFINITE) {
+        nRes = pthread_cond_wait(&pCv->cond, &pLock->mutex);
+        CompatWaitShared(pLock);
+        return nRes == 0;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += dwMilliseconds / 1000;
+    ts.tv_nsec += (long)(dwMilliseconds % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    nRes = pthread_cond_timedwait(&pCv->cond, &pLock->mutex, &ts);
+    CompatWaitShared(pLock);
+    if (nRes != 0) {
+        SetLastError(ERROR_TIMEOUT);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+inline VOID WakeAllConditionVariable(CONDITION_VARIABLE* pCv)
+{
+    pthread_cond_broadcast(&pCv->cond);
+}
+
+inline VOID WakeConditionVariable(CONDITION_VARIABLE* pCv)
+{
+    pthread_cond_signal(&pCv->cond);
+}
+
+inline ULONGLONG GetTickCount64()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ULONGLONG)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Performance counter ticks are nanoseconds
+inline BOOL QueryPerformanceCounter(LARGE_INTEGER* pliCount)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    pliCount->QuadPart = (LONGLONG)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    return TRUE;
+}
+
+inline BOOL QueryPerformanceFrequency(LARGE_INTEGER* pliFreq)
+{
+    pliFreq->QuadPart = 1000000000;
+    return TRUE;
+}
+
+inline LONG InterlockedIncrement(volatile LONG* plValue)
+{
+    return __atomic_add_fetch(plValue, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedDecrement(volatile LONG* plValue)
+{
+    return __atomic_sub_fetch(plValue, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedExchange(volatile LONG* plTarget, LONG lValue)
+{
+    return __atomic_exchange_n(plTarget, lValue, __ATOMIC_SEQ_CST);
+}
+
+inline LONG64 InterlockedIncrement64(volatile LONG64* pllValue)
+{
+    return __atomic_add_fetch(pllValue, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG64 InterlockedExchangeAdd64(volatile LONG64* pllTarget, LONG64 llValue)
+{
+    return __atomic_fetch_add(pllTarget, llValue, __ATOMIC_SEQ_CST);
+}
+
+inline LONG64 InterlockedExchange64(volatile LONG64* pllTarget, LONG64 llValue)
+{
+    return __atomic_exchange_n(pllTarget, llValue, __ATOMIC_SEQ_CST);
+}
+
+inline LONG64 InterlockedCompareExchange64(volatile LONG64* pllTarget, LONG64 llExchange, LONG64 llComparand)
+{
+    __atomic_compare_exchange_n(pllTarget, &llComparand, llExchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return llComparand;
+}
+
+inline PVOID InterlockedExchangePointer(PVOID volatile* ppvTarget, PVOID pvValue)
+{
+    return __atomic_exchange_n(ppvTarget, pvValue, __ATOMIC_SEQ_CST);
+}
+
+inline PVOID InterlockedCompareExchangePointer(PVOID volatile* ppvTarget, PVOID pvExchange, PVOID pvComparand)
+{
+    __atomic_compare_exchange_n(ppvTarget, &pvComparand, pvExchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return pvComparand;
+}
+
+inline VOID GetSystemTimeAsFileTime(FILETIME* pft)
+{
+    // 100 ns intervals since 1601
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ULONGLONG ull = ((ULONGLONG)ts.tv_sec + 11644473600ULL) * 10000000 + ts.tv_nsec / 100;
+    pft->dwLowDateTime = (DWORD)ull;
+    pft->dwHighDateTime = (DWORD)(ull >> 32);
+}
+
+inline VOID Sleep(DWORD dwMilliseconds)
+{
+    usleep((useconds_t)dwMilliseconds * 1000);
+}
+
+
+//-[MESSAGES]------------------------------------------------------------------
+
+#define WM_APP                  0x8000
+#define PM_REMOVE               0x0001
+
+typedef struct tagMSG {
+    HWND hwnd;
+    UINT message;
+    WPARAM wParam;
+    LPARAM lParam;
+} MSG, *LPMSG;
+
+// Messages are posted to a single queue, whatever their window
+inline std::deque<MSG>& CompatMessages()
+{
+    static std::deque<MSG> messages;
+    return messages;
+}
+
+inline std::mutex& CompatMessagesMutex()
+{
+    static std::mutex lock;
+    return lock;
+}
+
+inline BOOL PostMessage(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+{
+    std::lock_guard<std::mutex> guard(CompatMessagesMutex());
+    CompatMessages().push_back({ hWnd, uMsg, wParam, lParam });
+    return TRUE;
+}
+
+// Only removes the next message, with no filter
+inline BOOL PeekMessage(LPMSG pMsg, HWND hWnd, UINT uMsgFilterMin, UINT uMsgFilterMax, UINT uRemoveMsg)
+{
+    if (hWnd != NULL || uMsgFilterMin != 0 || uMsgFilterMax != 0 || uRemoveMsg != PM_REMOVE)
+        return FALSE;
+    std::lock_guard<std::mutex> guard(CompatMessagesMutex());
+    if (CompatMessages().empty())
+        return FALSE;
+    *pMsg = CompatMessages().front();
+    CompatMessages().pop_front();
+    return TRUE;
+}
+
+
+//-[THREAD POOL]---------------------------------------------------------------
+
+// Work items run on a thread of their own
+typedef struct _TP_CALLBACK_INSTANCE* PTP_CALLBACK_INSTANCE;
+typedef struct _TP_WORK* PTP_WORK;
+typedef VOID (CALLBACK *PTP_WORK_CALLBACK)(PTP_CALLBACK_INSTANCE pInstance, PVOID pContext, PTP_WORK pWork);
+typedef VOID (CALLBACK *PTP_SIMPLE_CALLBACK)(PTP_CALLBACK_INSTANCE pInstance, PVOID pContext);
+
+struct _TP_WORK {
+    PTP_WORK_CALLBACK pfnCallback;
+    PVOID pContext;
+    std::thread thread;
+};
+
+inline PTP_WORK CreateThreadpoolWork(PTP_WORK_CALLBACK pfnCallback, PVOID pContext, PVOID pEnv)
+{
+    UNREFERENCED_PARAMETER(pEnv);
+    PTP_WORK pWork = new _TP_WORK();
+    pWork->pfnCallback = pfnCallback;
+    pWork->pContext = pContext;
+    return pWork;
+}
+
+inline VOID WaitForThreadpoolWorkCallbacks(PTP_WORK pWork, BOOL bCancelPending)
+{
+    UNREFERENCED_PARAMETER(bCancelPending);
+    if (pWork->thread.joinable())
+        pWork->thread.join();
+}
+
+inline VOID SubmitThreadpoolWork(PTP_WORK pWork)
+{
+    WaitForThreadpoolWorkCallbacks(pWork, FALSE);
+    pWork->thread = std::thread([pWork] { pWork->pfnCallback(NULL, pWork->pContext, pWork); });
+}
+
+inline VOID CloseThreadpoolWork(PTP_WORK pWork)
+{
+    WaitForThreadpoolWorkCallbacks(pWork, FALSE);
+    delete pWork;
+}
+
+inline BOOL TrySubmitThreadpoolCallback(PTP_SIMPLE_CALLBACK pfnCallback, PVOID pContext, PVOID pEnv)
+{
+    UNREFERENCED_PARAMETER(pEnv);
+    std::thread(pfnCallback, (PTP_CALLBACK_INSTANCE)NULL, pContext).detach();
+    return TRUE;
+}